@@ -108,6 +108,32 @@ esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode
  */
 esp_err_t bsp_extra_codec_open_playback(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
 
+/**
+ * @brief Get the format the playback device is currently opened with.
+ *
+ * Lets streaming players skip a close/reopen (and the click it causes) when
+ * the next stream has the same format.
+ *
+ * @param rate: Sample rate (may be NULL)
+ * @param bits_cfg: Bit lengths of one channel data (may be NULL)
+ * @param ch: Channels (may be NULL)
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_STATE: Playback device is not open
+ */
+esp_err_t bsp_extra_codec_get_fs(uint32_t *rate, uint32_t *bits_cfg, i2s_slot_mode_t *ch);
+
+/**
+ * @brief Get a counter that changes whenever the playback device is reopened.
+ *
+ * A streaming player compares it between writes to notice that another
+ * writer (beeps, prompts, capture) changed the format under it.
+ *
+ * @return Current generation
+ */
+uint32_t bsp_extra_codec_get_generation(void);
+
 /**
  * @brief I2S write callback (hook for AEC reference)
  */
@@ -118,6 +144,14 @@ typedef void (*i2s_write_callback_t)(const void *data, size_t len);
  */
 void bsp_extra_i2s_write_register_callback(i2s_write_callback_t cb);
 
+/**
+ * @brief I2S DMA queue overflows since boot
+ *
+ * @param rx: RX overruns (microphone data dropped because nobody read in time), can be NULL
+ * @param tx: TX underruns (DMA replayed a cleared buffer because nobody wrote in time), can be NULL
+ */
+void bsp_extra_i2s_get_overflows(uint32_t *rx, uint32_t *tx);
+
 /**
  * @brief Read data from recoder.
  *
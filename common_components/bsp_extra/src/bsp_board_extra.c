@@ -29,6 +29,10 @@ static esp_codec_dev_handle_t play_dev_handle;
 static esp_codec_dev_handle_t record_dev_handle;
 static bool play_dev_open = false;
 static bool record_dev_open = false;
+static esp_codec_dev_sample_info_t play_dev_fs;
+// Bumped on every playback device close/reopen, so a player can tell that
+// someone else reconfigured the codec under it
+static volatile uint32_t play_dev_generation = 0;
 
 static bool _is_audio_init = false;
 static bool _is_player_init = false;
@@ -47,6 +51,48 @@ void bsp_extra_i2s_write_register_callback(i2s_write_callback_t cb) {
     i2s_write_cb = cb;
 }
 
+// DMA queue overflows: RX = mic data lost (reader late), TX = DMA ran dry
+// and replayed cleared buffers (writer late)
+static volatile uint32_t i2s_rx_overflows = 0;
+static volatile uint32_t i2s_tx_overflows = 0;
+
+static IRAM_ATTR bool i2s_rx_q_ovf_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    i2s_rx_overflows++;
+    return false;
+}
+
+static IRAM_ATTR bool i2s_tx_q_ovf_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    i2s_tx_overflows++;
+    return false;
+}
+
+// Channels must not be enabled yet: only READY channels take callbacks
+static void i2s_register_overflow_callbacks(void)
+{
+    i2s_event_callbacks_t rx_cbs = {.on_recv_q_ovf = i2s_rx_q_ovf_cb};
+    i2s_event_callbacks_t tx_cbs = {.on_send_q_ovf = i2s_tx_q_ovf_cb};
+    i2s_chan_handle_t rx = bsp_audio_get_rx_chan();
+    i2s_chan_handle_t tx = bsp_audio_get_tx_chan();
+    if (rx && i2s_channel_register_event_callback(rx, &rx_cbs, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "RX overflow callback not registered");
+    }
+    if (tx && i2s_channel_register_event_callback(tx, &tx_cbs, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "TX overflow callback not registered");
+    }
+}
+
+void bsp_extra_i2s_get_overflows(uint32_t *rx, uint32_t *tx)
+{
+    if (rx) {
+        *rx = i2s_rx_overflows;
+    }
+    if (tx) {
+        *tx = i2s_tx_overflows;
+    }
+}
+
 static SemaphoreHandle_t get_audio_bus_mutex(void) {
     if (audio_bus_mutex == NULL) {
         audio_bus_mutex = xSemaphoreCreateMutex();
@@ -184,7 +230,11 @@ esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode
     if (play_dev_handle) {
         esp_err_t open_ret = esp_codec_dev_open(play_dev_handle, &fs);
         ret |= open_ret;
+        play_dev_generation++;
         play_dev_open = (open_ret == ESP_OK);
+        if (play_dev_open) {
+            play_dev_fs = fs;
+        }
         if (open_ret != ESP_OK) {
             ESP_LOGE(TAG, "Failed to open playback codec (ret=%s)", esp_err_to_name(open_ret));
         }
@@ -231,7 +281,11 @@ esp_err_t bsp_extra_codec_open_playback(uint32_t rate, uint32_t bits_cfg, i2s_sl
             play_dev_open = false;
         }
         ret = esp_codec_dev_open(play_dev_handle, &fs);
+        play_dev_generation++;
         play_dev_open = (ret == ESP_OK);
+        if (play_dev_open) {
+            play_dev_fs = fs;
+        }
         ESP_LOGI(TAG, "Setting codec to %d Hz, %d bits, %d channels", rate, bits_cfg, ch);
 
         // Restore output volume after open.
@@ -248,6 +302,28 @@ esp_err_t bsp_extra_codec_open_playback(uint32_t rate, uint32_t bits_cfg, i2s_sl
     return ret;
 }
 
+esp_err_t bsp_extra_codec_get_fs(uint32_t *rate, uint32_t *bits_cfg, i2s_slot_mode_t *ch)
+{
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    audio_bus_lock();
+    if (play_dev_handle && play_dev_open) {
+        if (rate) {
+            *rate = play_dev_fs.sample_rate;
+        }
+        if (bits_cfg) {
+            *bits_cfg = play_dev_fs.bits_per_sample;
+        }
+        if (ch) {
+            *ch = (i2s_slot_mode_t)play_dev_fs.channel;
+        }
+        ret = ESP_OK;
+    }
+    audio_bus_unlock();
+
+    return ret;
+}
+
 esp_err_t bsp_extra_codec_volume_set(int volume, int *volume_set)
 {
     ESP_RETURN_ON_ERROR(esp_codec_dev_set_out_vol(play_dev_handle, volume), TAG, "Set Codec volume failed");
@@ -272,6 +348,11 @@ esp_err_t bsp_extra_codec_mute_set(bool enable)
     return ret;
 }
 
+uint32_t bsp_extra_codec_get_generation(void)
+{
+    return play_dev_generation;
+}
+
 esp_err_t bsp_extra_codec_dev_stop(void)
 {
     esp_err_t ret = ESP_OK;
@@ -287,6 +368,7 @@ esp_err_t bsp_extra_codec_dev_stop(void)
     if (play_dev_handle) {
         if (play_dev_open) {
             ret = esp_codec_dev_close(play_dev_handle);
+            play_dev_generation++;
             play_dev_open = false;
         }
     }
@@ -311,6 +393,8 @@ esp_err_t bsp_extra_codec_init()
     record_dev_handle = bsp_audio_codec_microphone_init();
     assert((record_dev_handle) && "record_dev_handle not initialized");
 
+    i2s_register_overflow_callbacks();
+
     bsp_extra_codec_set_fs(CODEC_DEFAULT_SAMPLE_RATE, CODEC_DEFAULT_BIT_WIDTH, CODEC_DEFAULT_CHANNEL);
 
     _is_audio_init = true;
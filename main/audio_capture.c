@@ -6,6 +6,7 @@
 
 #include "audio_capture.h"
 #include "audio_ref_buffer.h"
+#include "audio_rt_monitor.h"
 #include "bsp_board_extra.h"
 #include "driver/i2s_types.h"
 #include "esp_afe_sr_iface.h"
@@ -14,12 +15,21 @@
 #include "esp_log.h"
 #include "esp_mn_iface.h"
 #include "esp_mn_models.h"
+#include "esp_mn_speech_commands.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
 #include "esp_vad.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "model_path.h"
 #include "sys_diag.h" // Phase 9
+#include "task_arena.h"
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "audio_capture";
 
@@ -29,107 +39,11 @@ static const char *TAG = "audio_capture";
 #define CAPTURE_TASK_PRIORITY 6
 #define CAPTURE_TASK_CORE 0
 #define I2S_READ_LEN 512
+#define AFE_SAMPLE_RATE 16000
+#define FEED_PERIOD_US (I2S_READ_LEN * 1000000LL / AFE_SAMPLE_RATE)
 
-#define FETCH_STACK_DEFAULT 16384
-#define FEED_STACK_DEFAULT 8192
-
-static void fetch_task(void *arg);
-static StackType_t *fetch_stack_mem = NULL;
-static StaticTask_t *fetch_tcb_mem = NULL;
-
-static bool create_pinned_task(TaskFunction_t task, const char *name,
-                               int stack_words, void *arg, UBaseType_t priority,
-                               TaskHandle_t *handle, BaseType_t core_id) {
-  BaseType_t ret = xTaskCreatePinnedToCore(task, name, stack_words, arg,
-                                           priority, handle, core_id);
-  if (ret == pdPASS) {
-    return true;
-  }
-  size_t free_internal =
-      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-  size_t free_psram =
-      heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  ESP_LOGW(TAG, "Task %s create failed (stack=%d). Free internal=%u, psram=%u",
-           name, stack_words, (unsigned)free_internal, (unsigned)free_psram);
-  return false;
-}
-
-static bool create_pinned_task_psram(TaskFunction_t task, const char *name,
-                                     int stack_words, void *arg,
-                                     UBaseType_t priority, TaskHandle_t *handle,
-                                     BaseType_t core_id) {
-  BaseType_t ret = xTaskCreatePinnedToCoreWithCaps(
-      task, name, stack_words, arg, priority, handle, core_id,
-      MALLOC_CAP_SPIRAM | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-  if (ret == pdPASS) {
-    ESP_LOGI(TAG, "Task %s created in PSRAM (stack=%d)", name, stack_words);
-    return true;
-  }
-  size_t free_internal =
-      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-  size_t free_psram =
-      heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  ESP_LOGW(TAG,
-           "Task %s PSRAM create failed (stack=%d). Free internal=%u, psram=%u",
-           name, stack_words, (unsigned)free_internal, (unsigned)free_psram);
-  return false;
-}
-
-static bool create_pinned_task_static(TaskFunction_t task, const char *name,
-                                      int stack_words, void *arg,
-                                      UBaseType_t priority,
-                                      TaskHandle_t *handle,
-                                      BaseType_t core_id) {
-  size_t stack_bytes = (size_t)stack_words * sizeof(StackType_t);
-  StackType_t *stack =
-      heap_caps_malloc(stack_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  StaticTask_t *tcb = heap_caps_malloc(sizeof(StaticTask_t),
-                                       MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-  if (!stack || !tcb) {
-    ESP_LOGW(TAG, "Static task alloc failed (stack=%d) stack=%p tcb=%p",
-             stack_words, stack, tcb);
-    free(stack);
-    free(tcb);
-    return false;
-  }
-
-  TaskHandle_t created = xTaskCreateStaticPinnedToCore(
-      task, name, stack_words, arg, priority, stack, tcb, core_id);
-  if (!created) {
-    ESP_LOGW(TAG, "Static task create failed (stack=%d)", stack_words);
-    free(stack);
-    free(tcb);
-    return false;
-  }
-
-  fetch_stack_mem = stack;
-  fetch_tcb_mem = tcb;
-  *handle = created;
-  ESP_LOGI(TAG, "Task %s created with static PSRAM stack (stack=%d)", name,
-           stack_words);
-  return true;
-}
-
-static bool create_fetch_task(TaskHandle_t *handle) {
-  const int fetch_stacks[] = {FETCH_STACK_DEFAULT, 12288, 8192};
-  for (size_t i = 0; i < sizeof(fetch_stacks) / sizeof(fetch_stacks[0]); i++) {
-    ESP_LOGI(TAG, "Creating fetch task (stack=%d)", fetch_stacks[i]);
-    if (create_pinned_task(fetch_task, "afe_fetch", fetch_stacks[i], NULL,
-                           AFE_TASK_PRIORITY, handle, AFE_TASK_CORE)) {
-      return true;
-    }
-    if (create_pinned_task_psram(fetch_task, "afe_fetch", fetch_stacks[i], NULL,
-                                 AFE_TASK_PRIORITY, handle, AFE_TASK_CORE)) {
-      return true;
-    }
-    if (create_pinned_task_static(fetch_task, "afe_fetch", fetch_stacks[i],
-                                  NULL, AFE_TASK_PRIORITY, handle,
-                                  AFE_TASK_CORE)) {
-      return true;
-    }
-  }
-  return false;
-}
+#define CALLBACK_BUDGET_US 10000 // Well inside one fetch chunk (32 ms)
+#define AFE_LOAD_WINDOW_US 5000000 // CPU load measurement window
 
 // -------------------------------------------------------------------------
 // STATE VARIABLES
@@ -140,10 +54,18 @@ static srmodel_list_t *models = NULL;
 
 static const esp_mn_iface_t *mn_handle = NULL;
 static model_iface_data_t *mn_data = NULL;
+// Held by fetch_task around detect and by command list updates
+static SemaphoreHandle_t mn_mutex = NULL;
+static audio_capture_load_stats_t load_stats = {0};
 
 static TaskHandle_t feed_task_handle = NULL;
 static TaskHandle_t fetch_task_handle = NULL;
 
+// feed_task frame buffers: touched every 32 ms, allocated once in internal RAM
+static int16_t *mic_buff = NULL;
+static int16_t *ref_buff = NULL;
+static int16_t *afe_buff = NULL; // 2 Channels (Mic+Ref)
+
 // Thread-safe is_running flag protected by spinlock
 static portMUX_TYPE running_mux = portMUX_INITIALIZER_UNLOCKED;
 static bool is_running_flag = false;
@@ -170,6 +92,195 @@ static audio_capture_callback_t audio_callback = NULL;
 static audio_capture_wwd_callback_t wwd_callback = NULL;
 static audio_capture_vad_callback_t vad_callback = NULL;
 static audio_capture_cmd_callback_t cmd_callback = NULL;
+static uint32_t callback_max_us = 0; // Longest callback run on fetch_task
+static volatile bool vad_reset_pending = false;
+
+// Wake words: word i is word wake_word_index[i] (1-based) of WakeNet model
+// wake_word_model[i] (1 or 2), as reported in afe_fetch_result_t
+static audio_capture_wake_words_t wake_words = {0};
+static uint8_t wake_word_model[AUDIO_CAPTURE_MAX_WAKE_WORDS];
+static uint8_t wake_word_index[AUDIO_CAPTURE_MAX_WAKE_WORDS];
+static float wake_thresholds[AUDIO_CAPTURE_MAX_WAKE_WORDS]; // 0 = default
+
+// Second-stage check of detections; only fetch_task touches the verifier
+static wake_verify_t *wake_verifier = NULL;
+static audio_capture_wake_stats_t wake_stats = {0};
+static int64_t wake_hold_until_ms = 0; // Set by audio_capture_hold_wake()
+static portMUX_TYPE wake_hold_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// AFE CPU load, sampled by fetch_task from the FreeRTOS run time counters
+static int64_t load_window_start_us = 0;
+static uint32_t load_window_start_runtime = 0;
+static float afe_load_pct = 0.0f;
+static bool afe_load_logged = false; // Logged once per capture start
+
+/**
+ * @brief Record how long a callback held up the fetch task
+ */
+static void callback_time_note(const char *name, int64_t start_us) {
+  uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+  if (elapsed_us <= callback_max_us) {
+    return;
+  }
+  callback_max_us = elapsed_us;
+  if (elapsed_us > CALLBACK_BUDGET_US) {
+    ESP_LOGW(TAG, "%s callback blocked fetch for %lu us", name,
+             (unsigned long)elapsed_us);
+  }
+}
+
+/**
+ * @brief Map a detection to the index in wake_words
+ */
+static int wake_word_from_result(const afe_fetch_result_t *res) {
+  int model = res->wakenet_model_index > 0 ? res->wakenet_model_index : 1;
+  for (int i = 0; i < wake_words.count; i++) {
+    if (wake_word_model[i] == model &&
+        wake_word_index[i] == res->wake_word_index) {
+      return i;
+    }
+  }
+  return 0; // Unknown word of a known model: treat as the main word
+}
+
+/**
+ * @brief Add the words of one WakeNet model
+ *
+ * Multi-word models list their words separated by ';'; otherwise the word
+ * is named after the model ("wn9_heykira_tts3" -> "heykira").
+ */
+static void wake_words_add_model(int model, char *model_name) {
+  char *words = esp_srmodel_get_wake_words(models, model_name);
+  int index = 1;
+  const char *p = words;
+  do {
+    if (wake_words.count >= AUDIO_CAPTURE_MAX_WAKE_WORDS) {
+      ESP_LOGW(TAG, "More than %d wake words, ignoring the rest of %s",
+               AUDIO_CAPTURE_MAX_WAKE_WORDS, model_name);
+      return;
+    }
+    char *name = wake_words.names[wake_words.count];
+    if (p && *p) {
+      size_t len = strcspn(p, ";");
+      snprintf(name, sizeof(wake_words.names[0]), "%.*s", (int)len, p);
+      p += len;
+      if (*p == ';')
+        p++;
+    } else {
+      const char *start = strchr(model_name, '_');
+      start = start ? start + 1 : model_name;
+      size_t len = strcspn(start, "_");
+      snprintf(name, sizeof(wake_words.names[0]), "%.*s", (int)len, start);
+    }
+    wake_word_model[wake_words.count] = (uint8_t)model;
+    wake_word_index[wake_words.count] = (uint8_t)index++;
+    ESP_LOGI(TAG, "Wake word %d: %s (model %d, word %d)", wake_words.count,
+             name, model, index - 1);
+    wake_words.count++;
+  } while (p && *p);
+}
+
+/**
+ * @brief Run the verifier on a detection (fetch_task)
+ *
+ * @return true to report the wake word
+ */
+static bool wake_detection_verify(int word) {
+  wake_stats.detections++;
+  if (!wake_verifier) {
+    return true;
+  }
+  int64_t start_us = esp_timer_get_time();
+  int64_t now_ms = start_us / 1000;
+
+  portENTER_CRITICAL(&wake_hold_mux);
+  int64_t hold_until_ms = wake_hold_until_ms;
+  portEXIT_CRITICAL(&wake_hold_mux);
+  if (hold_until_ms > now_ms) {
+    wake_verify_hold(wake_verifier, now_ms,
+                     (uint32_t)(hold_until_ms - now_ms));
+  }
+
+  wake_verify_result_t result = wake_verify_check(wake_verifier, now_ms);
+  uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+  if (elapsed_us > wake_stats.check_max_us) {
+    wake_stats.check_max_us = elapsed_us;
+  }
+  wake_verify_get_stats(wake_verifier, &wake_stats.verify);
+  if (result == WAKE_VERIFY_ACCEPT) {
+    ESP_LOGI(TAG, "Wake word %d verified (SNR %.1f dB, voiced %.0f%%, %lu us)",
+             word, wake_stats.verify.last_snr_db,
+             wake_stats.verify.last_voiced * 100.0f, (unsigned long)elapsed_us);
+    return true;
+  }
+  wake_stats.rejected++;
+  ESP_LOGI(TAG, "Wake word %d rejected: %s (SNR %.1f dB, voiced %.0f%%)", word,
+           wake_verify_result_name(result), wake_stats.verify.last_snr_db,
+           wake_stats.verify.last_voiced * 100.0f);
+  return false;
+}
+
+/**
+ * @brief Whether the AFE can take a threshold for word i
+ *
+ * set_wakenet_threshold() takes a word index but no model, so the index of
+ * a word of the second model would land on a word of the first one.
+ */
+static bool wake_threshold_settable(int i) { return wake_word_model[i] == 1; }
+
+static void wake_thresholds_apply(void) {
+  for (int i = 0; i < wake_words.count; i++) {
+    if (wake_thresholds[i] <= 0.0f) {
+      continue;
+    }
+    if (!wake_threshold_settable(i)) {
+      ESP_LOGW(TAG, "Wake word %s is in WakeNet model %d, threshold ignored",
+               wake_words.names[i], wake_word_model[i]);
+      continue;
+    }
+    afe_handle->set_wakenet_threshold(afe_data, wake_word_index[i],
+                                      wake_thresholds[i]);
+  }
+}
+
+/**
+ * @brief Update the AFE CPU load once per window (fetch_task)
+ *
+ * Run time counters are in microseconds (esp_timer); 32-bit wraparound is
+ * harmless over a 5 s window.
+ */
+static void afe_load_sample(void) {
+  TaskHandle_t feed = feed_task_handle;
+  TaskHandle_t fetch = fetch_task_handle;
+  if (!feed || !fetch) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  uint32_t runtime = (uint32_t)ulTaskGetRunTimeCounter(feed) +
+                     (uint32_t)ulTaskGetRunTimeCounter(fetch);
+  if (load_window_start_us == 0) {
+    load_window_start_us = now_us;
+    load_window_start_runtime = runtime;
+    return;
+  }
+  int64_t window_us = now_us - load_window_start_us;
+  if (window_us < AFE_LOAD_WINDOW_US) {
+    return;
+  }
+  float pct = 100.0f * (float)(runtime - load_window_start_runtime) /
+              (float)window_us;
+  afe_load_pct = pct;
+  load_window_start_us = now_us;
+  load_window_start_runtime = runtime;
+  if (!afe_load_logged) {
+    afe_load_logged = true;
+    ESP_LOGI(TAG, "AFE load: %.1f%% of a core (%d wake words, %s)", pct,
+             wake_words.count,
+             current_mode == CAPTURE_MODE_WAKE_WORD ? "wake word" : "recording");
+  } else {
+    ESP_LOGD(TAG, "AFE load: %.1f%%", pct);
+  }
+}
 
 // -------------------------------------------------------------------------
 // TASKS
@@ -177,25 +288,19 @@ static audio_capture_cmd_callback_t cmd_callback = NULL;
 
 static void feed_task(void *arg) {
   sys_diag_wdt_add(); // Monitor
-  int16_t *mic_buff = (int16_t *)malloc(I2S_READ_LEN * sizeof(int16_t));
-  int16_t *ref_buff = (int16_t *)malloc(I2S_READ_LEN * sizeof(int16_t));
-  int16_t *afe_buff = (int16_t *)malloc(
-      I2S_READ_LEN * 2 * sizeof(int16_t)); // 2 Channels (Mic+Ref)
   size_t bytes_read;
 
   ESP_LOGI(TAG, "Feed Task Started (AEC Enabled)");
+  audio_rt_stream_start(AUDIO_RT_FEED);
 
   if (mic_buff == NULL || ref_buff == NULL || afe_buff == NULL) {
-    ESP_LOGE(TAG, "Feed task OOM (mic=%p, ref=%p, afe=%p)", mic_buff, ref_buff,
-             afe_buff);
-    free(mic_buff);
-    free(ref_buff);
-    free(afe_buff);
+    ESP_LOGE(TAG, "Feed task has no buffers (mic=%p, ref=%p, afe=%p)",
+             mic_buff, ref_buff, afe_buff);
     if (capture_event_group)
       xEventGroupSetBits(capture_event_group, CAPTURE_FEED_DONE_BIT);
     feed_task_handle = NULL;
     sys_diag_wdt_remove();
-    vTaskDelete(NULL);
+    task_arena_exit(TASK_SLOT_AFE_FEED);
   }
 
   while (is_running_get()) {
@@ -206,6 +311,8 @@ static void feed_task(void *arg) {
                                        &bytes_read, 100);
 
     if (ret == ESP_OK && bytes_read > 0) {
+      audio_rt_cycle(AUDIO_RT_FEED, (uint32_t)FEED_PERIOD_US);
+
       // Read Reference (Playback Loopback)
       audio_ref_buffer_read(ref_buff, I2S_READ_LEN * sizeof(int16_t));
 
@@ -218,23 +325,23 @@ static void feed_task(void *arg) {
       // Feed to AFE (2 channels)
       afe_handle->feed(afe_data, afe_buff);
     } else {
+      audio_rt_error(AUDIO_RT_FEED);
       vTaskDelay(pdMS_TO_TICKS(10));
     }
   }
+  audio_rt_stream_stop(AUDIO_RT_FEED);
 
-  free(mic_buff);
-  free(ref_buff);
-  free(afe_buff);
   if (capture_event_group)
     xEventGroupSetBits(capture_event_group, CAPTURE_FEED_DONE_BIT);
   feed_task_handle = NULL;
   sys_diag_wdt_remove();
-  vTaskDelete(NULL);
+  task_arena_exit(TASK_SLOT_AFE_FEED);
 }
 
 static void fetch_task(void *arg) {
   sys_diag_wdt_add(); // Monitor
   ESP_LOGI(TAG, "Fetch Task Started");
+  audio_rt_stream_start(AUDIO_RT_FETCH);
 
   int vad_state_prev = -1;
 
@@ -243,25 +350,48 @@ static void fetch_task(void *arg) {
 
     // Fetch processed data from AFE
     afe_fetch_result_t *res = afe_handle->fetch(afe_data);
+    afe_load_sample();
 
     if (!res || res->ret_value == ESP_FAIL) {
+      audio_rt_error(AUDIO_RT_FETCH);
       continue;
     }
+    audio_rt_cycle(AUDIO_RT_FETCH,
+                   (uint32_t)((int64_t)res->data_size / sizeof(int16_t) *
+                              1000000 / AFE_SAMPLE_RATE));
+    audio_rt_afe_fill(res->ringbuff_free_pct);
+
+    // Energy history for the verifier: the audio WakeNet has just seen
+    if (current_mode == CAPTURE_MODE_WAKE_WORD && wake_verifier) {
+      wake_verify_push(wake_verifier, res->data,
+                       (size_t)res->data_size / sizeof(int16_t));
+    }
 
     // 1. Handle Wake Word
     if (res->wakeup_state == WAKENET_DETECTED) {
-      ESP_LOGI(TAG, "AFE: Wake Word Detected! (Index: %d)",
-               res->wake_word_index);
-      if (current_mode == CAPTURE_MODE_WAKE_WORD && wwd_callback) {
-        wwd_callback(NULL, 0);
+      int word = wake_word_from_result(res);
+      ESP_LOGI(TAG, "AFE: Wake Word Detected! (%s, model %d, index %d)",
+               wake_words.count ? wake_words.names[word] : "?",
+               res->wakenet_model_index, res->wake_word_index);
+      if (current_mode == CAPTURE_MODE_WAKE_WORD && wwd_callback &&
+          wake_detection_verify(word)) {
+        int64_t cb_start_us = esp_timer_get_time();
+        wwd_callback(NULL, 0, word);
+        callback_time_note("wake", cb_start_us);
       }
     }
 
     // 2. Handle Processing (VAD + MultiNet)
     if (current_mode == CAPTURE_MODE_RECORDING) {
 
+      if (vad_reset_pending) {
+        vad_reset_pending = false;
+        vad_state_prev = VAD_SILENCE; // Wait for speech before reporting
+      }
+
       // VAD Events
       if (res->vad_state != vad_state_prev) {
+        int64_t cb_start_us = esp_timer_get_time();
         if (res->vad_state == VAD_SPEECH) {
           if (vad_callback)
             vad_callback(VAD_EVENT_SPEECH_START);
@@ -269,16 +399,21 @@ static void fetch_task(void *arg) {
           if (vad_callback)
             vad_callback(VAD_EVENT_SPEECH_END);
         }
+        callback_time_note("vad", cb_start_us);
         vad_state_prev = res->vad_state;
       }
 
-      // Send cleaned audio data (for Streaming to HA)
-      if (audio_callback && res->data_size > 0) {
+      // Send cleaned audio data (for Streaming to HA); nothing after a
+      // callback above stopped the capture
+      if (audio_callback && res->data_size > 0 && is_running_get()) {
+        int64_t cb_start_us = esp_timer_get_time();
         audio_callback((const uint8_t *)res->data, res->data_size);
+        callback_time_note("audio", cb_start_us);
       }
 
-      // 3. MultiNet (Offline Commands)
-      if (mn_handle && mn_data) {
+      // 3. MultiNet (Offline Commands); skipped for a frame while the
+      // command list is being replaced
+      if (mn_handle && mn_data && xSemaphoreTake(mn_mutex, 0) == pdTRUE) {
         // Feed MultiNet
         esp_mn_state_t mn_state = mn_handle->detect(mn_data, res->data);
 
@@ -290,20 +425,22 @@ static void fetch_task(void *arg) {
                      mn_result->prob[0]);
 
             if (cmd_callback) {
+              int64_t cb_start_us = esp_timer_get_time();
               cmd_callback(mn_result->command_id[0], mn_result->phrase_id[0]);
+              callback_time_note("command", cb_start_us);
             }
           }
         }
+        xSemaphoreGive(mn_mutex);
       }
     }
   }
+  audio_rt_stream_stop(AUDIO_RT_FETCH);
   if (capture_event_group)
     xEventGroupSetBits(capture_event_group, CAPTURE_FETCH_DONE_BIT);
   fetch_task_handle = NULL;
-  // NOTE: Static memory cleanup moved to audio_capture_stop_wait() to avoid
-  // use-after-free (can't free stack while still running on it!)
   sys_diag_wdt_remove();
-  vTaskDelete(NULL);
+  task_arena_exit(TASK_SLOT_AFE_FETCH);
 }
 
 // -------------------------------------------------------------------------
@@ -316,6 +453,14 @@ esp_err_t audio_capture_init(void) {
 
   ESP_LOGI(TAG, "Initializing ESP-SR AFE & MultiNet with AEC...");
 
+  // Heap and time used by model loading, reported once init finishes
+  int64_t init_start_us = esp_timer_get_time();
+  size_t internal_before =
+      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  size_t psram_before =
+      heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  int64_t stage_us = init_start_us;
+
   if (capture_event_group == NULL) {
     capture_event_group = xEventGroupCreate();
     if (capture_event_group == NULL) {
@@ -324,6 +469,24 @@ esp_err_t audio_capture_init(void) {
     }
   }
 
+  // Frame buffers, kept across start/stop
+  if (mic_buff == NULL) {
+    mic_buff = mem_place_alloc(MEM_MOD_AUDIO, MEM_PLACE_HOT,
+                               I2S_READ_LEN * sizeof(int16_t));
+    ref_buff = mem_place_alloc(MEM_MOD_AUDIO, MEM_PLACE_HOT,
+                               I2S_READ_LEN * sizeof(int16_t));
+    afe_buff = mem_place_alloc(MEM_MOD_AUDIO, MEM_PLACE_HOT,
+                               I2S_READ_LEN * 2 * sizeof(int16_t));
+    if (mic_buff == NULL || ref_buff == NULL || afe_buff == NULL) {
+      ESP_LOGE(TAG, "Failed to allocate feed buffers");
+      mem_track_free(MEM_MOD_AUDIO, mic_buff);
+      mem_track_free(MEM_MOD_AUDIO, ref_buff);
+      mem_track_free(MEM_MOD_AUDIO, afe_buff);
+      mic_buff = ref_buff = afe_buff = NULL;
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
   // Init Reference Buffer (16KB ~ 0.5s)
   audio_ref_buffer_init(16 * 1024);
 
@@ -331,12 +494,20 @@ esp_err_t audio_capture_init(void) {
   bsp_extra_i2s_write_register_callback(audio_ref_buffer_write);
 
   // 1. Load models
+  // With CONFIG_MODEL_IN_FLASH the packed srmodels.bin image is mapped from
+  // the partition; weights are read through the flash cache, not copied.
   if (models == NULL) {
     models = esp_srmodel_init("model");
     if (models == NULL) {
       ESP_LOGE(TAG, "Failed to load models");
     }
   }
+  const esp_partition_t *model_part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "model");
+  load_stats.mapped_bytes = model_part ? model_part->size : 0;
+  load_stats.model_count = models ? models->num : 0;
+  load_stats.models_ms = (uint32_t)((esp_timer_get_time() - stage_us) / 1000);
+  stage_us = esp_timer_get_time();
 
   // 2. Init AFE for AEC (Mic + Ref)
   afe_config_t *afe_config =
@@ -353,10 +524,37 @@ esp_err_t audio_capture_init(void) {
   afe_config->vad_init = true;
   afe_config->aec_init = true;
 
+  // Every WakeNet model in the partition, up to the two the AFE can run
+  wake_words.count = 0;
+  int wn_models = 0;
+  for (int i = 0; models && i < models->num && wn_models < 2; i++) {
+    char *name = models->model_name[i];
+    if (strncmp(name, ESP_WN_PREFIX, strlen(ESP_WN_PREFIX)) != 0)
+      continue;
+    if (wn_models == 0) {
+      afe_config->wakenet_model_name = name;
+    } else {
+      afe_config->wakenet_model_name_2 = name;
+    }
+    wn_models++;
+    wake_words_add_model(wn_models, name);
+  }
+
   afe_handle = esp_afe_handle_from_config(afe_config);
   afe_data = afe_handle->create_from_config(afe_config);
   if (!afe_data)
     return ESP_FAIL;
+  load_stats.afe_ms = (uint32_t)((esp_timer_get_time() - stage_us) / 1000);
+
+  if (!wake_verifier) {
+    wake_verify_config_t verify_cfg;
+    wake_verify_default_config(&verify_cfg);
+    wake_verifier = wake_verify_create(&verify_cfg);
+    if (!wake_verifier) {
+      ESP_LOGW(TAG, "Wake verifier not available, detections unchecked");
+    }
+  }
+  stage_us = esp_timer_get_time();
 
   // 3. Init MultiNet
   if (models) {
@@ -365,32 +563,188 @@ esp_err_t audio_capture_init(void) {
       mn_handle = esp_mn_handle_from_name(mn_name);
       if (mn_handle) {
         mn_data = mn_handle->create(mn_name, 6000);
-        ESP_LOGI(TAG, "MultiNet initialized: %s", mn_name);
+        mn_mutex = xSemaphoreCreateMutex();
+        if (mn_data && mn_mutex) {
+          // Starts with the model's default list until one is loaded
+          esp_mn_commands_alloc(mn_handle, mn_data);
+          ESP_LOGI(TAG, "MultiNet initialized: %s", mn_name);
+        } else {
+          ESP_LOGE(TAG, "MultiNet init failed: %s", mn_name);
+          mn_data = NULL;
+        }
       }
     } else {
       ESP_LOGW(TAG, "MultiNet model not found");
     }
   }
+  load_stats.multinet_ms = (uint32_t)((esp_timer_get_time() - stage_us) / 1000);
+  load_stats.total_ms =
+      (uint32_t)((esp_timer_get_time() - init_start_us) / 1000);
+  load_stats.internal_bytes =
+      (int32_t)internal_before -
+      (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  load_stats.psram_bytes =
+      (int32_t)psram_before -
+      (int32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  ESP_LOGI(TAG,
+           "Model load: %d models, map %lu ms, AFE %lu ms, MultiNet %lu ms "
+           "(total %lu ms)",
+           load_stats.model_count, (unsigned long)load_stats.models_ms,
+           (unsigned long)load_stats.afe_ms,
+           (unsigned long)load_stats.multinet_ms,
+           (unsigned long)load_stats.total_ms);
+  ESP_LOGI(TAG,
+           "Model memory: internal %ld B, PSRAM %ld B on heap; %lu KB mapped "
+           "from flash",
+           (long)load_stats.internal_bytes, (long)load_stats.psram_bytes,
+           (unsigned long)(load_stats.mapped_bytes / 1024));
 
   ESP_LOGI(TAG, "Audio subsystem ready");
   return ESP_OK;
 }
 
+esp_err_t audio_capture_get_load_stats(audio_capture_load_stats_t *stats) {
+  if (!stats) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!afe_handle) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  *stats = load_stats;
+  return ESP_OK;
+}
+
+uint32_t audio_capture_get_callback_max_us(void) { return callback_max_us; }
+
+esp_err_t audio_capture_get_wake_words(audio_capture_wake_words_t *words) {
+  if (!words) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!afe_handle) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  *words = wake_words;
+  return ESP_OK;
+}
+
+esp_err_t audio_capture_set_wake_threshold(int wake_word, float threshold) {
+  if (wake_word < 0 || wake_word >= AUDIO_CAPTURE_MAX_WAKE_WORDS ||
+      threshold < 0.4f || threshold > 0.9999f) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (afe_data && wake_word >= wake_words.count) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (afe_data && !wake_threshold_settable(wake_word)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  wake_thresholds[wake_word] = threshold;
+  if (afe_handle && afe_data) {
+    afe_handle->set_wakenet_threshold(afe_data, wake_word_index[wake_word],
+                                      threshold);
+    ESP_LOGI(TAG, "Wake word %s threshold %.3f", wake_words.names[wake_word],
+             threshold);
+  }
+  return ESP_OK;
+}
+
+float audio_capture_get_afe_load(void) { return afe_load_pct; }
+
+void audio_capture_hold_wake(uint32_t duration_ms) {
+  int64_t until_ms = esp_timer_get_time() / 1000 + duration_ms;
+  portENTER_CRITICAL(&wake_hold_mux);
+  if (until_ms > wake_hold_until_ms) {
+    wake_hold_until_ms = until_ms;
+  }
+  portEXIT_CRITICAL(&wake_hold_mux);
+}
+
+void audio_capture_get_wake_stats(audio_capture_wake_stats_t *stats) {
+  if (stats) {
+    // Counters only grow; a torn read is off by one detection at most
+    *stats = wake_stats;
+  }
+}
+
 void audio_capture_register_cmd_callback(
     audio_capture_cmd_callback_t callback) {
   cmd_callback = callback;
 }
 
+bool audio_capture_has_multinet(void) { return mn_handle && mn_data; }
+
+esp_err_t audio_capture_set_commands(const audio_capture_command_t *commands,
+                                     size_t count) {
+  if (!commands && count > 0)
+    return ESP_ERR_INVALID_ARG;
+  if (!audio_capture_has_multinet())
+    return ESP_ERR_NOT_SUPPORTED;
+
+  xSemaphoreTake(mn_mutex, portMAX_DELAY);
+  esp_mn_commands_clear();
+  size_t added = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (esp_mn_commands_add(commands[i].id, (char *)commands[i].phrase) ==
+        ESP_OK) {
+      added++;
+    } else {
+      ESP_LOGW(TAG, "MultiNet rejected command %d: %s", commands[i].id,
+               commands[i].phrase);
+    }
+  }
+  esp_mn_error_t *errors = esp_mn_commands_update();
+  xSemaphoreGive(mn_mutex);
+
+  if (errors) {
+    for (int i = 0; i < errors->num; i++) {
+      ESP_LOGW(TAG, "MultiNet could not use phrase: %s",
+               errors->phrases[i]->string);
+    }
+    added = added > (size_t)errors->num ? added - (size_t)errors->num : 0;
+  }
+  ESP_LOGI(TAG, "MultiNet commands: %u of %u active", (unsigned)added,
+           (unsigned)count);
+  return added > 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief Start feed and fetch in their reserved slots
+ */
+static bool create_capture_tasks(void) {
+  if (task_arena_start(TASK_SLOT_AFE_FEED, feed_task, NULL,
+                       CAPTURE_TASK_PRIORITY, CAPTURE_TASK_CORE,
+                       &feed_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create feed task");
+    return false;
+  }
+  if (task_arena_start(TASK_SLOT_AFE_FETCH, fetch_task, NULL,
+                       AFE_TASK_PRIORITY, AFE_TASK_CORE,
+                       &fetch_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create fetch task");
+    return false;
+  }
+  return true;
+}
+
 esp_err_t audio_capture_start(audio_capture_callback_t callback) {
   if (is_running_get())
     return ESP_OK;
 
+  // A new utterance: drop partial state from the previous recording
+  if (audio_capture_has_multinet()) {
+    xSemaphoreTake(mn_mutex, portMAX_DELAY);
+    mn_handle->clean(mn_data);
+    xSemaphoreGive(mn_mutex);
+  }
+
   extern esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg,
                                           i2s_slot_mode_t ch);
   bsp_extra_codec_set_fs(16000, 16, I2S_SLOT_MODE_MONO);
 
   audio_callback = callback;
   current_mode = CAPTURE_MODE_RECORDING;
+  load_window_start_us = 0;
+  afe_load_logged = false;
   is_running_set(true);
 
   if (capture_event_group) {
@@ -398,16 +752,7 @@ esp_err_t audio_capture_start(audio_capture_callback_t callback) {
                          CAPTURE_FEED_DONE_BIT | CAPTURE_FETCH_DONE_BIT);
   }
 
-  if (!create_pinned_task(feed_task, "afe_feed", FEED_STACK_DEFAULT, NULL,
-                          CAPTURE_TASK_PRIORITY, &feed_task_handle,
-                          CAPTURE_TASK_CORE)) {
-    ESP_LOGE(TAG, "Failed to create feed task");
-    is_running_set(false);
-    current_mode = CAPTURE_MODE_IDLE;
-    return ESP_FAIL;
-  }
-  if (!create_fetch_task(&fetch_task_handle)) {
-    ESP_LOGE(TAG, "Failed to create fetch task");
+  if (!create_capture_tasks()) {
     is_running_set(false);
     current_mode = CAPTURE_MODE_IDLE;
     return ESP_FAIL;
@@ -426,7 +771,15 @@ audio_capture_start_wake_word_mode(audio_capture_wwd_callback_t callback) {
   bsp_extra_codec_set_fs(16000, 16, I2S_SLOT_MODE_MONO);
 
   wwd_callback = callback;
+  wake_thresholds_apply();
+  if (wake_verifier) {
+    // Old history belongs to before the conversation; fetch_task is not
+    // running yet
+    wake_verify_reset(wake_verifier);
+  }
   current_mode = CAPTURE_MODE_WAKE_WORD;
+  load_window_start_us = 0;
+  afe_load_logged = false;
   is_running_set(true);
 
   if (capture_event_group) {
@@ -434,16 +787,7 @@ audio_capture_start_wake_word_mode(audio_capture_wwd_callback_t callback) {
                          CAPTURE_FEED_DONE_BIT | CAPTURE_FETCH_DONE_BIT);
   }
 
-  if (!create_pinned_task(feed_task, "afe_feed", FEED_STACK_DEFAULT, NULL,
-                          CAPTURE_TASK_PRIORITY, &feed_task_handle,
-                          CAPTURE_TASK_CORE)) {
-    ESP_LOGE(TAG, "Failed to create feed task");
-    is_running_set(false);
-    current_mode = CAPTURE_MODE_IDLE;
-    return ESP_FAIL;
-  }
-  if (!create_fetch_task(&fetch_task_handle)) {
-    ESP_LOGE(TAG, "Failed to create fetch task");
+  if (!create_capture_tasks()) {
     is_running_set(false);
     current_mode = CAPTURE_MODE_IDLE;
     return ESP_FAIL;
@@ -484,15 +828,6 @@ esp_err_t audio_capture_stop_wait(uint32_t timeout_ms) {
 
   if ((bits & (CAPTURE_FEED_DONE_BIT | CAPTURE_FETCH_DONE_BIT)) ==
       (CAPTURE_FEED_DONE_BIT | CAPTURE_FETCH_DONE_BIT)) {
-    // Tasks have exited - now safe to free static memory (was allocated for
-    // fetch_task)
-    if (fetch_stack_mem || fetch_tcb_mem) {
-      ESP_LOGI(TAG, "Freeing fetch task static memory (after task exit)");
-      free(fetch_stack_mem);
-      free(fetch_tcb_mem);
-      fetch_stack_mem = NULL;
-      fetch_tcb_mem = NULL;
-    }
     return ESP_OK;
   }
   return ESP_ERR_TIMEOUT;
@@ -520,7 +855,7 @@ esp_err_t audio_capture_enable_vad(const void *config,
 }
 
 void audio_capture_disable_vad(void) { vad_callback = NULL; }
-void audio_capture_reset_vad(void) {}
+void audio_capture_reset_vad(void) { vad_reset_pending = true; }
 
 esp_err_t audio_capture_enable_agc(uint16_t target_level) {
   ESP_LOGW(TAG, "AGC not implemented");
@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h> // Added
+#include "wake_verify.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,9 +52,11 @@ typedef void (*audio_capture_callback_t)(const uint8_t *audio_data,
  *
  * @param audio_data PCM audio samples (int16_t array)
  * @param samples Number of samples
+ * @param wake_word Index of the detected word (see
+ *                  audio_capture_get_wake_words())
  */
 typedef void (*audio_capture_wwd_callback_t)(const int16_t *audio_data,
-                                             size_t samples);
+                                             size_t samples, int wake_word);
 
 /**
  * @brief Callback for VAD events
@@ -70,6 +73,54 @@ typedef void (*audio_capture_vad_callback_t)(audio_capture_vad_event_t event);
  */
 typedef void (*audio_capture_cmd_callback_t)(int command_id, int command_index);
 
+/**
+ * @brief One MultiNet command phrase
+ */
+typedef struct {
+  int id;             // Reported to the command callback
+  const char *phrase; // English text (MultiNet7 EN) or pinyin (CN models)
+} audio_capture_command_t;
+
+#define AUDIO_CAPTURE_MAX_WAKE_WORDS 4
+
+/**
+ * @brief Wake words the AFE listens for
+ *
+ * Words of the first WakeNet model come first, then those of the second
+ * (two models can be selected in menuconfig, or one multi-word model).
+ */
+typedef struct {
+  int count;
+  char names[AUDIO_CAPTURE_MAX_WAKE_WORDS][32];
+} audio_capture_wake_words_t;
+
+/**
+ * @brief Wake word detections and their second-stage check (wake_verify.h)
+ */
+typedef struct {
+  uint32_t detections;   // WakeNet detections in wake word mode
+  uint32_t rejected;     // Dropped by the verifier (no callback)
+  uint32_t check_max_us; // Longest verifier run (latency added to a wake)
+  wake_verify_stats_t verify;
+} audio_capture_wake_stats_t;
+
+/**
+ * @brief Model loading cost measured by audio_capture_init()
+ *
+ * Heap figures are the drop in free heap across init, so they include AFE
+ * working buffers as well as any model data copied out of flash.
+ */
+typedef struct {
+  uint32_t models_ms;     // esp_srmodel_init (partition map + model list)
+  uint32_t afe_ms;        // AFE create (WakeNet/VAD/AEC instances)
+  uint32_t multinet_ms;   // MultiNet create (0 if no MultiNet model)
+  uint32_t total_ms;      // Whole init
+  int32_t internal_bytes; // Internal RAM taken
+  int32_t psram_bytes;    // PSRAM taken
+  uint32_t mapped_bytes;  // Model partition mapped from flash (not on heap)
+  int model_count;        // Models found in the partition
+} audio_capture_load_stats_t;
+
 /**
  * @brief Initialize audio capture
  *
@@ -77,11 +128,92 @@ typedef void (*audio_capture_cmd_callback_t)(int command_id, int command_index);
  */
 esp_err_t audio_capture_init(void);
 
+/**
+ * @brief Get the model loading cost of the last audio_capture_init()
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE before init
+ */
+esp_err_t audio_capture_get_load_stats(audio_capture_load_stats_t *stats);
+
+/**
+ * @brief Longest time a single callback blocked the AFE fetch task
+ *
+ * Callbacks run on the real-time fetch task; anything slow should be handed
+ * off (see event_bus.h).
+ *
+ * @return Microseconds since boot
+ */
+uint32_t audio_capture_get_callback_max_us(void);
+
+/**
+ * @brief Get the loaded wake words
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE before init
+ */
+esp_err_t audio_capture_get_wake_words(audio_capture_wake_words_t *words);
+
+/**
+ * @brief Set the detection threshold of one wake word
+ *
+ * Kept across capture restarts. Only words of the first WakeNet model can
+ * be tuned: the AFE addresses thresholds by word index, without the model.
+ *
+ * @param wake_word Index from audio_capture_get_wake_words()
+ * @param threshold 0.4 (eager) - 0.9999 (strict)
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for an unknown word or bad value,
+ *         ESP_ERR_NOT_SUPPORTED for a word of the second model
+ */
+esp_err_t audio_capture_set_wake_threshold(int wake_word, float threshold);
+
+/**
+ * @brief Ignore wake words for a while
+ *
+ * For audio that may echo the wake word, e.g. right after TTS. Extends, never
+ * shortens, a running cooldown. Any task.
+ *
+ * @param duration_ms Cooldown from now
+ */
+void audio_capture_hold_wake(uint32_t duration_ms);
+
+/**
+ * @brief Get wake word detection and verification counters
+ */
+void audio_capture_get_wake_stats(audio_capture_wake_stats_t *stats);
+
+/**
+ * @brief CPU time of the AFE feed and fetch tasks
+ *
+ * Share of one core over the last measurement window (about 5 s of
+ * capture), covering AEC, VAD, WakeNet for every loaded word and MultiNet.
+ *
+ * @return Percent of one core, 0 before the first window
+ */
+float audio_capture_get_afe_load(void);
+
 /**
  * @brief Register callback for offline commands
  */
 void audio_capture_register_cmd_callback(audio_capture_cmd_callback_t callback);
 
+/**
+ * @brief Whether a MultiNet model was loaded
+ */
+bool audio_capture_has_multinet(void);
+
+/**
+ * @brief Replace the MultiNet command list
+ *
+ * Safe while capture runs: recognition pauses for the update. Phrases the
+ * model rejects are logged and skipped.
+ *
+ * @param commands Commands (phrases are copied)
+ * @param count Number of commands
+ * @return ESP_OK if at least one phrase was accepted, ESP_ERR_NOT_SUPPORTED
+ *         without a MultiNet model, ESP_FAIL if every phrase was rejected
+ */
+esp_err_t audio_capture_set_commands(const audio_capture_command_t *commands,
+                                     size_t count);
+
 /**
  * @brief Start capturing audio
  *
@@ -128,6 +260,9 @@ void audio_capture_disable_vad(void);
 
 /**
  * @brief Reset VAD state
+ *
+ * The next VAD event is a speech start: silence up to then is not reported
+ * as the end of speech. Takes effect on the next frame; any task.
  */
 void audio_capture_reset_vad(void);
 
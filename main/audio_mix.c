@@ -0,0 +1,165 @@
+/**
+ * @file audio_mix.c
+ * @brief Fixed-point gain ramp, resampler and mixer for 16-bit PCM
+ */
+
+#include "audio_mix.h"
+
+#define GAIN_Q30_SHIFT 15 // Q15 API gain -> Q30 internal
+
+static inline int16_t clip16(int32_t v) {
+  if (v > INT16_MAX) {
+    return INT16_MAX;
+  }
+  if (v < INT16_MIN) {
+    return INT16_MIN;
+  }
+  return (int16_t)v;
+}
+
+/* ---------- Gain ---------- */
+
+void audio_gain_init(audio_gain_t *g, uint32_t gain) {
+  g->gain = (int32_t)(gain << GAIN_Q30_SHIFT);
+  g->target = g->gain;
+  g->step = 0;
+}
+
+void audio_gain_set_target(audio_gain_t *g, uint32_t gain,
+                           uint32_t ramp_frames) {
+  g->target = (int32_t)(gain << GAIN_Q30_SHIFT);
+  if (ramp_frames == 0 || g->target == g->gain) {
+    g->gain = g->target;
+    g->step = 0;
+    return;
+  }
+  g->step = (g->target - g->gain) / (int32_t)ramp_frames;
+  if (g->step == 0) {
+    g->step = g->target > g->gain ? 1 : -1;
+  }
+}
+
+bool audio_gain_is_unity(const audio_gain_t *g) {
+  return g->step == 0 &&
+         g->gain == (int32_t)((uint32_t)AUDIO_GAIN_UNITY << GAIN_Q30_SHIFT);
+}
+
+void audio_gain_apply(audio_gain_t *g, int16_t *pcm, size_t frames,
+                      int channels) {
+  size_t i = 0;
+
+  // Ramp: new gain every frame until the target is reached
+  while (g->step != 0 && i < frames) {
+    g->gain += g->step;
+    if ((g->step > 0 && g->gain >= g->target) ||
+        (g->step < 0 && g->gain <= g->target)) {
+      g->gain = g->target;
+      g->step = 0;
+    }
+    int32_t q15 = g->gain >> GAIN_Q30_SHIFT;
+    for (int ch = 0; ch < channels; ch++) {
+      int16_t *s = &pcm[i * channels + ch];
+      *s = clip16(((int32_t)*s * q15) >> 15);
+    }
+    i++;
+  }
+
+  // Steady state: one multiply per sample
+  int32_t q15 = g->gain >> GAIN_Q30_SHIFT;
+  if (q15 == AUDIO_GAIN_UNITY) {
+    return;
+  }
+  for (size_t n = i * channels; n < frames * channels; n++) {
+    pcm[n] = (int16_t)(((int32_t)pcm[n] * q15) >> 15);
+  }
+}
+
+/* ---------- Resampler ---------- */
+
+void audio_resampler_init(audio_resampler_t *rs, uint32_t in_rate,
+                          int in_channels, uint32_t out_rate,
+                          int out_channels) {
+  rs->step = (uint32_t)(((uint64_t)in_rate << 16) / out_rate);
+  rs->phase = 0;
+  rs->in_channels = in_channels;
+  rs->out_channels = out_channels;
+  rs->prev[0] = 0;
+  rs->prev[1] = 0;
+  rs->primed = false;
+}
+
+size_t audio_resampler_max_out(const audio_resampler_t *rs, size_t in_frames) {
+  return (size_t)(((uint64_t)in_frames << 16) / rs->step) + 2;
+}
+
+/**
+ * @brief Input frame i as out_channels samples (i == -1 is the carried frame)
+ */
+static inline void fetch_frame(const audio_resampler_t *rs, const int16_t *in,
+                               int32_t i, int32_t out[2]) {
+  int32_t l;
+  int32_t r;
+  if (i < 0) {
+    l = rs->prev[0];
+    r = rs->prev[1];
+  } else if (rs->in_channels == 1) {
+    l = r = in[i];
+  } else {
+    l = in[2 * i];
+    r = in[2 * i + 1];
+  }
+  if (rs->out_channels == 1) {
+    out[0] = (l + r) >> 1;
+  } else {
+    out[0] = l;
+    out[1] = r;
+  }
+}
+
+size_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in,
+                               size_t in_frames, int16_t *out) {
+  if (in_frames == 0) {
+    return 0;
+  }
+  if (!rs->primed) {
+    // Start on the first input frame instead of ramping up from silence
+    rs->prev[0] = in[0];
+    rs->prev[1] = rs->in_channels == 1 ? in[0] : in[1];
+    rs->primed = true;
+  }
+
+  // Positions are relative to the carried frame: 0 = prev, 1 = in[0], ...
+  uint64_t end = (uint64_t)in_frames << 16;
+  uint64_t phase = rs->phase;
+  size_t o = 0;
+  int oc = rs->out_channels;
+
+  while (phase < end) {
+    int32_t i = (int32_t)(phase >> 16);
+    // Q15 fraction keeps the interpolation product within 32 bits
+    int32_t frac = (int32_t)(phase & 0xFFFF) >> 1;
+    int32_t a[2];
+    int32_t b[2];
+    fetch_frame(rs, in, i - 1, a);
+    fetch_frame(rs, in, i, b);
+    for (int ch = 0; ch < oc; ch++) {
+      out[o * oc + ch] = (int16_t)(a[ch] + (((b[ch] - a[ch]) * frac) >> 15));
+    }
+    o++;
+    phase += rs->step;
+  }
+
+  rs->phase = (uint32_t)(phase - end);
+  const int16_t *last = &in[(in_frames - 1) * rs->in_channels];
+  rs->prev[0] = last[0];
+  rs->prev[1] = rs->in_channels == 1 ? last[0] : last[1];
+  return o;
+}
+
+/* ---------- Mixer ---------- */
+
+void audio_mix_add(int16_t *dst, const int16_t *src, size_t samples) {
+  for (size_t i = 0; i < samples; i++) {
+    dst[i] = clip16((int32_t)dst[i] + src[i]);
+  }
+}
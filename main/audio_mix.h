@@ -0,0 +1,102 @@
+/**
+ * @file audio_mix.h
+ * @brief Fixed-point gain ramp, resampler and mixer for 16-bit PCM
+ *
+ * Used to duck local music under TTS: the music is scaled by a gain that
+ * ramps linearly to its target (no zipper noise or clicks), and the TTS is
+ * converted to the music's rate and channel count and added on top with
+ * saturation. Everything is integer arithmetic on interleaved int16 samples.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Unity gain for audio_gain_t (Q15)
+#define AUDIO_GAIN_UNITY 32768
+
+/**
+ * @brief Ramped gain stage
+ */
+typedef struct {
+  int32_t gain;   ///< Current gain (Q30)
+  int32_t target; ///< Target gain (Q30)
+  int32_t step;   ///< Change per frame while ramping (Q30)
+} audio_gain_t;
+
+/**
+ * @brief Linear-interpolating sample rate and channel converter
+ */
+typedef struct {
+  uint32_t step;  ///< Input frames per output frame (Q16)
+  uint32_t phase; ///< Next output position after prev (Q16)
+  uint8_t in_channels;
+  uint8_t out_channels;
+  int16_t prev[2]; ///< Last input frame of the previous call
+  bool primed;
+} audio_resampler_t;
+
+/**
+ * @brief Set a gain immediately
+ *
+ * @param gain Gain in Q15 (AUDIO_GAIN_UNITY = 1.0)
+ */
+void audio_gain_init(audio_gain_t *g, uint32_t gain);
+
+/**
+ * @brief Ramp linearly to a new gain
+ *
+ * @param gain Target in Q15
+ * @param ramp_frames Frames the ramp takes (0 jumps immediately)
+ */
+void audio_gain_set_target(audio_gain_t *g, uint32_t gain,
+                           uint32_t ramp_frames);
+
+/**
+ * @brief Check if the stage is at unity and not ramping (nothing to do)
+ */
+bool audio_gain_is_unity(const audio_gain_t *g);
+
+/**
+ * @brief Scale interleaved PCM in place, advancing the ramp per frame
+ */
+void audio_gain_apply(audio_gain_t *g, int16_t *pcm, size_t frames,
+                      int channels);
+
+/**
+ * @brief Prepare a converter (1 or 2 channels each way)
+ */
+void audio_resampler_init(audio_resampler_t *rs, uint32_t in_rate,
+                          int in_channels, uint32_t out_rate,
+                          int out_channels);
+
+/**
+ * @brief Upper bound of output frames for a number of input frames
+ */
+size_t audio_resampler_max_out(const audio_resampler_t *rs, size_t in_frames);
+
+/**
+ * @brief Convert a block; all input is consumed
+ *
+ * @param out Room for audio_resampler_max_out(in_frames) frames
+ * @return Output frames written
+ */
+size_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in,
+                               size_t in_frames, int16_t *out);
+
+/**
+ * @brief Add src to dst with saturation
+ *
+ * @param samples Interleaved samples (not frames)
+ */
+void audio_mix_add(int16_t *dst, const int16_t *src, size_t samples);
+
+#ifdef __cplusplus
+}
+#endif
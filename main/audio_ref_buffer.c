@@ -6,6 +6,8 @@
 
 static const char *TAG = "audio_ref";
 static RingbufHandle_t ref_rb = NULL;
+static size_t ref_rb_size = 0;
+static volatile uint32_t dropped_bytes = 0;
 
 esp_err_t audio_ref_buffer_init(size_t size) {
     if (ref_rb) return ESP_OK;
@@ -17,6 +19,7 @@ esp_err_t audio_ref_buffer_init(size_t size) {
         ESP_LOGE(TAG, "Failed to create reference ring buffer");
         return ESP_FAIL;
     }
+    ref_rb_size = size;
     ESP_LOGI(TAG, "Reference buffer initialized (%d bytes)", size);
     return ESP_OK;
 }
@@ -32,8 +35,8 @@ void audio_ref_buffer_write(const void *data, size_t len) {
         // We could try to reset, but that causes sync issues.
         // For AEC, it's better to have gaps than delay? 
         // Actually, delay kills AEC. If full, it means desync.
-        // Just drop for now.
-        // ESP_LOGW(TAG, "Ref buffer full, dropped %d bytes", len);
+        // Just drop for now; counted for the audio monitor.
+        dropped_bytes += len;
     }
 }
 
@@ -62,3 +65,14 @@ size_t audio_ref_buffer_read(void *dest, size_t len) {
         return 0;
     }
 }
+
+uint32_t audio_ref_buffer_get_dropped(void) {
+    return dropped_bytes;
+}
+
+int audio_ref_buffer_get_fill_pct(void) {
+    if (!ref_rb || ref_rb_size == 0) return 0;
+    size_t free_bytes = xRingbufferGetCurFreeSize(ref_rb);
+    if (free_bytes > ref_rb_size) free_bytes = ref_rb_size;
+    return (int)((ref_rb_size - free_bytes) * 100 / ref_rb_size);
+}
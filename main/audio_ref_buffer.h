@@ -33,6 +33,16 @@ void audio_ref_buffer_write(const void *data, size_t len);
  */
 size_t audio_ref_buffer_read(void *dest, size_t len);
 
+/**
+ * @brief Playback bytes dropped because the buffer was full (AEC lost them)
+ */
+uint32_t audio_ref_buffer_get_dropped(void);
+
+/**
+ * @brief Reference bytes waiting for the AFE, in percent of the buffer
+ */
+int audio_ref_buffer_get_fill_pct(void);
+
 #ifdef __cplusplus
 }
 #endif
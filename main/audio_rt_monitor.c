@@ -0,0 +1,364 @@
+/**
+ * @file audio_rt_monitor.c
+ * @brief Audio path real-time monitor implementation
+ *
+ * Stream state is written by the audio tasks under rt_mux and never
+ * allocates. I2S overflow counters tick continuously while a channel is
+ * enabled and nobody reads or writes it, so their deltas are only charged
+ * to a stream between two of its cycles.
+ */
+
+#include "audio_rt_monitor.h"
+#include "audio_ref_buffer.h"
+#include "bsp_board_extra.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sys_diag.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "audio_rt";
+
+#define WRITE_IDLE_GAP_US 250000 // Longer write gaps: playback had stopped
+#define CHECK_PERIOD_MS 1000
+#define CHECK_TASK_STACK 3072
+#define CHECK_TASK_PRIORITY 2
+#define BUSY_TASKS 3     // Recorded per glitch second
+#define SUSPECT_SLOTS 12 // Tracked; the top AUDIO_RT_SUSPECTS are reported
+
+static const char *const stream_names[AUDIO_RT_STREAM_COUNT] = {
+    "feed", "fetch", "write"};
+
+typedef struct {
+  int64_t last_us;    // 0: stopped
+  uint32_t period_us; // Of the last cycle
+  uint32_t ovf_seen;  // I2S overflow counter at the last cycle
+  audio_rt_stream_stats_t stats;
+} stream_state_t;
+
+static portMUX_TYPE rt_mux = portMUX_INITIALIZER_UNLOCKED;
+static stream_state_t streams[AUDIO_RT_STREAM_COUNT];
+static uint32_t rx_overruns = 0;
+static uint32_t tx_underruns = 0;
+static uint8_t afe_fill_pct = 0;
+static uint8_t afe_fill_max_pct = 0;
+
+// Owned by check_task; read by the getters under rt_mux
+static TaskHandle_t check_task_handle = NULL;
+static uint32_t glitch_seconds = 0;
+static audio_rt_suspect_t suspects[SUSPECT_SLOTS];
+static char last_glitch[96] = "";
+
+static int jitter_bin(uint32_t jitter_us) {
+  int bin = 0;
+  for (uint32_t j = jitter_us / 250; j && bin < AUDIO_RT_JITTER_BINS - 1;
+       j >>= 1) {
+    bin++;
+  }
+  return bin;
+}
+
+/**
+ * @brief I2S overflow counter that belongs to a stream (FETCH has none)
+ */
+static uint32_t stream_overflows(audio_rt_stream_t stream) {
+  uint32_t rx = 0, tx = 0;
+  if (stream != AUDIO_RT_FETCH) {
+    bsp_extra_i2s_get_overflows(&rx, &tx);
+  }
+  return stream == AUDIO_RT_FEED ? rx : tx;
+}
+
+void audio_rt_stream_start(audio_rt_stream_t stream) {
+  if (stream >= AUDIO_RT_STREAM_COUNT) {
+    return;
+  }
+  uint32_t ovf = stream_overflows(stream);
+  portENTER_CRITICAL(&rt_mux);
+  streams[stream].last_us = 0;
+  streams[stream].ovf_seen = ovf;
+  portEXIT_CRITICAL(&rt_mux);
+}
+
+void audio_rt_stream_stop(audio_rt_stream_t stream) {
+  audio_rt_stream_start(stream); // Same reset; the name says why
+}
+
+void audio_rt_cycle(audio_rt_stream_t stream, uint32_t period_us) {
+  if (stream >= AUDIO_RT_STREAM_COUNT) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  uint32_t ovf = stream_overflows(stream);
+
+  portENTER_CRITICAL(&rt_mux);
+  stream_state_t *st = &streams[stream];
+  int64_t interval_us = st->last_us ? now_us - st->last_us : -1;
+  if (stream == AUDIO_RT_WRITE && interval_us > WRITE_IDLE_GAP_US) {
+    interval_us = -1; // New playback, not a stall
+  }
+  if (interval_us >= 0) {
+    audio_rt_stream_stats_t *s = &st->stats;
+    uint32_t interval = (uint32_t)interval_us;
+    uint32_t jitter = interval > st->period_us ? interval - st->period_us
+                                               : st->period_us - interval;
+    s->cycles++;
+    s->jitter_hist[jitter_bin(jitter)]++;
+    if (jitter > s->jitter_max_us) {
+      s->jitter_max_us = jitter;
+    }
+    if (interval > st->period_us + st->period_us / 2) {
+      s->late++;
+    }
+    if (stream == AUDIO_RT_FEED) {
+      rx_overruns += ovf - st->ovf_seen;
+    } else if (stream == AUDIO_RT_WRITE) {
+      tx_underruns += ovf - st->ovf_seen;
+    }
+  }
+  st->last_us = now_us;
+  st->period_us = period_us;
+  st->ovf_seen = ovf;
+  portEXIT_CRITICAL(&rt_mux);
+}
+
+void audio_rt_error(audio_rt_stream_t stream) {
+  if (stream >= AUDIO_RT_STREAM_COUNT) {
+    return;
+  }
+  portENTER_CRITICAL(&rt_mux);
+  streams[stream].stats.errors++;
+  portEXIT_CRITICAL(&rt_mux);
+}
+
+void audio_rt_afe_fill(float free_fraction) {
+  if (free_fraction < 0.0f || free_fraction > 1.0f) {
+    return;
+  }
+  uint8_t pct = (uint8_t)((1.0f - free_fraction) * 100.0f + 0.5f);
+  afe_fill_pct = pct;
+  if (pct > afe_fill_max_pct) {
+    afe_fill_max_pct = pct;
+  }
+}
+
+/* ---------- Glitch correlation ---------- */
+
+typedef struct {
+  uint32_t late[AUDIO_RT_STREAM_COUNT];
+  uint32_t errors[AUDIO_RT_STREAM_COUNT];
+  uint32_t rx_overruns;
+  uint32_t tx_underruns;
+  uint32_t ref_dropped;
+} glitch_counters_t;
+
+static void read_counters(glitch_counters_t *c) {
+  portENTER_CRITICAL(&rt_mux);
+  for (int i = 0; i < AUDIO_RT_STREAM_COUNT; i++) {
+    c->late[i] = streams[i].stats.late;
+    c->errors[i] = streams[i].stats.errors;
+  }
+  c->rx_overruns = rx_overruns;
+  c->tx_underruns = tx_underruns;
+  bool capturing = streams[AUDIO_RT_FEED].last_us != 0;
+  portEXIT_CRITICAL(&rt_mux);
+  // Without capture nobody drains the reference; drops then mean nothing
+  c->ref_dropped = capturing ? audio_ref_buffer_get_dropped() : 0;
+}
+
+static size_t append(char *buf, size_t len, size_t used, const char *fmt,
+                     const char *what, uint32_t n) {
+  if (n == 0 || used >= len) {
+    return used;
+  }
+  int w = snprintf(buf + used, len - used, fmt, used ? ", " : "", what,
+                   (unsigned)n);
+  return w > 0 ? used + (size_t)w : used;
+}
+
+static void note_suspect(const char *name) {
+  audio_rt_suspect_t *slot = NULL;
+  audio_rt_suspect_t *weakest = &suspects[0];
+  for (int i = 0; i < SUSPECT_SLOTS; i++) {
+    if (strcmp(suspects[i].name, name) == 0) {
+      slot = &suspects[i];
+      break;
+    }
+    if (suspects[i].glitches < weakest->glitches) {
+      weakest = &suspects[i];
+    }
+  }
+  portENTER_CRITICAL(&rt_mux);
+  if (!slot) {
+    // New name (or a free slot, which has 0 glitches)
+    slot = weakest;
+    strncpy(slot->name, name, sizeof(slot->name) - 1);
+    slot->name[sizeof(slot->name) - 1] = '\0';
+    slot->glitches = 0;
+  }
+  slot->glitches++;
+  portEXIT_CRITICAL(&rt_mux);
+}
+
+static void check_task(void *arg) {
+  (void)arg;
+  glitch_counters_t prev;
+  read_counters(&prev);
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(CHECK_PERIOD_MS));
+    glitch_counters_t now;
+    read_counters(&now);
+
+    char what[64] = "";
+    size_t used = 0;
+    for (int i = 0; i < AUDIO_RT_STREAM_COUNT; i++) {
+      used = append(what, sizeof(what), used, "%s%s late %u", stream_names[i],
+                    now.late[i] - prev.late[i]);
+      used = append(what, sizeof(what), used, "%s%s err %u", stream_names[i],
+                    now.errors[i] - prev.errors[i]);
+    }
+    used = append(what, sizeof(what), used, "%s%s %u", "rx overrun",
+                  now.rx_overruns - prev.rx_overruns);
+    used = append(what, sizeof(what), used, "%s%s %u", "tx underrun",
+                  now.tx_underruns - prev.tx_underruns);
+    if (now.ref_dropped > prev.ref_dropped) {
+      used = append(what, sizeof(what), used, "%s%s %u B", "ref drop",
+                    now.ref_dropped - prev.ref_dropped);
+    }
+    prev = now;
+    if (used == 0) {
+      continue;
+    }
+
+    char busy[BUSY_TASKS][SYS_DIAG_TASK_NAME_LEN];
+    int n = sys_diag_get_busy_tasks(busy, BUSY_TASKS);
+    char glitch[sizeof(last_glitch)];
+    size_t g = (size_t)snprintf(glitch, sizeof(glitch), "%s; busy:", what);
+    for (int i = 0; i < n && g < sizeof(glitch); i++) {
+      note_suspect(busy[i]);
+      g += (size_t)snprintf(glitch + g, sizeof(glitch) - g, "%s %s",
+                            i ? "," : "", busy[i]);
+    }
+    ESP_LOGW(TAG, "Glitch: %s", glitch);
+
+    portENTER_CRITICAL(&rt_mux);
+    glitch_seconds++;
+    memcpy(last_glitch, glitch, sizeof(last_glitch));
+    portEXIT_CRITICAL(&rt_mux);
+  }
+}
+
+esp_err_t audio_rt_monitor_init(void) {
+  if (check_task_handle) {
+    return ESP_OK;
+  }
+  if (xTaskCreate(check_task, "audio_rt", CHECK_TASK_STACK, NULL,
+                  CHECK_TASK_PRIORITY, &check_task_handle) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create monitor task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+/* ---------- Reports ---------- */
+
+void audio_rt_get_stats(audio_rt_stats_t *out) {
+  if (!out) {
+    return;
+  }
+  memset(out, 0, sizeof(*out));
+  bool listed[SUSPECT_SLOTS] = {false};
+  portENTER_CRITICAL(&rt_mux);
+  for (int i = 0; i < AUDIO_RT_STREAM_COUNT; i++) {
+    out->streams[i] = streams[i].stats;
+  }
+  out->rx_overruns = rx_overruns;
+  out->tx_underruns = tx_underruns;
+  out->afe_fill_pct = afe_fill_pct;
+  out->afe_fill_max_pct = afe_fill_max_pct;
+  out->glitch_seconds = glitch_seconds;
+  memcpy(out->last_glitch, last_glitch, sizeof(out->last_glitch));
+  for (int n = 0; n < AUDIO_RT_SUSPECTS; n++) {
+    int best = -1;
+    for (int i = 0; i < SUSPECT_SLOTS; i++) {
+      if (!listed[i] && suspects[i].glitches &&
+          (best < 0 || suspects[i].glitches > suspects[best].glitches)) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    listed[best] = true;
+    out->suspects[n] = suspects[best];
+  }
+  portEXIT_CRITICAL(&rt_mux);
+  out->ref_dropped_bytes = audio_ref_buffer_get_dropped();
+  out->ref_fill_pct = (uint8_t)audio_ref_buffer_get_fill_pct();
+}
+
+size_t audio_rt_format(char *buf, size_t len) {
+  if (!buf || len == 0) {
+    return 0;
+  }
+  audio_rt_stats_t s;
+  audio_rt_get_stats(&s);
+  const audio_rt_stream_stats_t *f = &s.streams[AUDIO_RT_FEED];
+  const audio_rt_stream_stats_t *x = &s.streams[AUDIO_RT_FETCH];
+  const audio_rt_stream_stats_t *w = &s.streams[AUDIO_RT_WRITE];
+  int used = snprintf(
+      buf, len,
+      "late %u/%u/%u err %u/%u/%u jit %u/%u/%u ms xrun %u/%u ref %u%% "
+      "drop %u B afe %u%% max %u%% glitch %u s",
+      (unsigned)f->late, (unsigned)x->late, (unsigned)w->late,
+      (unsigned)f->errors, (unsigned)x->errors, (unsigned)w->errors,
+      (unsigned)(f->jitter_max_us / 1000), (unsigned)(x->jitter_max_us / 1000),
+      (unsigned)(w->jitter_max_us / 1000), (unsigned)s.rx_overruns,
+      (unsigned)s.tx_underruns, s.ref_fill_pct, (unsigned)s.ref_dropped_bytes,
+      s.afe_fill_pct, s.afe_fill_max_pct, (unsigned)s.glitch_seconds);
+  for (int i = 0; i < AUDIO_RT_SUSPECTS && s.suspects[i].glitches; i++) {
+    if (used < 0 || (size_t)used >= len) {
+      break;
+    }
+    used += snprintf(buf + used, len - (size_t)used, "%s%s %u",
+                     i ? ", " : ": ", s.suspects[i].name,
+                     (unsigned)s.suspects[i].glitches);
+  }
+  if (used < 0) {
+    buf[0] = '\0';
+    return 0;
+  }
+  return (size_t)used < len ? (size_t)used : len - 1;
+}
+
+void audio_rt_log_report(void) {
+  audio_rt_stats_t s;
+  audio_rt_get_stats(&s);
+  for (int i = 0; i < AUDIO_RT_STREAM_COUNT; i++) {
+    const audio_rt_stream_stats_t *st = &s.streams[i];
+    const uint32_t *h = st->jitter_hist;
+    ESP_LOGI(TAG,
+             "%-5s cycles %lu late %lu err %lu jitter max %lu us | <0.25 %lu "
+             "<0.5 %lu <1 %lu <2 %lu <4 %lu <8 %lu <16 %lu >=16 ms %lu",
+             stream_names[i], (unsigned long)st->cycles,
+             (unsigned long)st->late, (unsigned long)st->errors,
+             (unsigned long)st->jitter_max_us, (unsigned long)h[0],
+             (unsigned long)h[1], (unsigned long)h[2], (unsigned long)h[3],
+             (unsigned long)h[4], (unsigned long)h[5], (unsigned long)h[6],
+             (unsigned long)h[7]);
+  }
+  ESP_LOGI(TAG,
+           "I2S rx overruns %lu, tx underruns %lu; reference %u%% full, %lu B "
+           "dropped; AFE ring %u%% full (max %u%%)",
+           (unsigned long)s.rx_overruns, (unsigned long)s.tx_underruns,
+           s.ref_fill_pct, (unsigned long)s.ref_dropped_bytes, s.afe_fill_pct,
+           s.afe_fill_max_pct);
+  ESP_LOGI(TAG, "Glitch seconds %lu, last: %s", (unsigned long)s.glitch_seconds,
+           s.last_glitch[0] ? s.last_glitch : "none");
+  for (int i = 0; i < AUDIO_RT_SUSPECTS && s.suspects[i].glitches; i++) {
+    ESP_LOGI(TAG, "Busy during %lu glitch seconds: %s",
+             (unsigned long)s.suspects[i].glitches, s.suspects[i].name);
+  }
+}
@@ -0,0 +1,121 @@
+/**
+ * @file audio_rt_monitor.h
+ * @brief Real-time budget monitor of the audio path
+ *
+ * Three audio loops must keep pace with the hardware: feed_task reading the
+ * microphone, fetch_task pulling processed frames out of the AFE, and the
+ * players writing to I2S. Each marks the start of every cycle with the
+ * audio duration the cycle covers; the monitor turns the intervals into
+ * jitter histograms and counts late cycles (interval over 1.5 periods) and
+ * failed ones. It also counts what the hardware lost: I2S RX overruns while
+ * capture runs, TX underruns while something plays, and reference bytes
+ * dropped before the AEC saw them. The AFE ring buffer fill level shows how
+ * far fetch is behind feed.
+ *
+ * Marking a cycle is a few arithmetic operations under a spinlock, safe in
+ * the audio tasks. A low-priority task checks once a second for new
+ * glitches and records which tasks were busiest in that second (from the
+ * sys_diag profiler), so repeated glitches point at their cause.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_RT_JITTER_BINS 8 ///< <0.25, <0.5, <1, <2, <4, <8, <16, >=16 ms
+#define AUDIO_RT_SUSPECTS 4    ///< Tasks ranked by glitches they ran in
+
+typedef enum {
+  AUDIO_RT_FEED = 0, ///< I2S microphone read -> AFE feed
+  AUDIO_RT_FETCH,    ///< AFE fetch
+  AUDIO_RT_WRITE,    ///< I2S playback write (TTS, music, beeps)
+  AUDIO_RT_STREAM_COUNT
+} audio_rt_stream_t;
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t late;          ///< Interval over 1.5 periods
+  uint32_t errors;        ///< Read, fetch or write failed
+  uint32_t jitter_max_us; ///< Largest |interval - period|
+  uint32_t jitter_hist[AUDIO_RT_JITTER_BINS];
+} audio_rt_stream_stats_t;
+
+typedef struct {
+  char name[16];
+  uint32_t glitches; ///< Glitch seconds this task was among the busiest
+} audio_rt_suspect_t;
+
+typedef struct {
+  audio_rt_stream_stats_t streams[AUDIO_RT_STREAM_COUNT];
+  uint32_t rx_overruns;       ///< Microphone data lost while capturing
+  uint32_t tx_underruns;      ///< DMA ran dry while playing
+  uint32_t ref_dropped_bytes; ///< Playback the AEC never saw
+  uint8_t ref_fill_pct;       ///< AEC reference buffer
+  uint8_t afe_fill_pct;       ///< AFE ring buffer, last fetch
+  uint8_t afe_fill_max_pct;
+  uint32_t glitch_seconds; ///< Seconds with any late cycle, error or xrun
+  audio_rt_suspect_t suspects[AUDIO_RT_SUSPECTS]; ///< Most glitches first
+  char last_glitch[96];                           ///< What and who, or ""
+} audio_rt_stats_t;
+
+/**
+ * @brief Start the glitch correlation task (idempotent)
+ *
+ * Cycles are recorded without it; only the correlation needs the task.
+ */
+esp_err_t audio_rt_monitor_init(void);
+
+/**
+ * @brief A stream (re)starts: the next interval is not measured
+ */
+void audio_rt_stream_start(audio_rt_stream_t stream);
+
+/**
+ * @brief A stream stops: overruns until the next start are not its fault
+ */
+void audio_rt_stream_stop(audio_rt_stream_t stream);
+
+/**
+ * @brief A cycle starts
+ *
+ * @param period_us Audio duration this cycle handles; the next cycle is
+ *                  due that much later
+ */
+void audio_rt_cycle(audio_rt_stream_t stream, uint32_t period_us);
+
+/**
+ * @brief A cycle failed (read error, fetch ESP_FAIL, write error)
+ */
+void audio_rt_error(audio_rt_stream_t stream);
+
+/**
+ * @brief AFE ring buffer state from a fetch result
+ *
+ * @param free_fraction afe_fetch_result_t.ringbuff_free_pct (0..1)
+ */
+void audio_rt_afe_fill(float free_fraction);
+
+void audio_rt_get_stats(audio_rt_stats_t *out);
+
+/**
+ * @brief One-line summary for MQTT (fits the HA state limit)
+ *
+ * @return Characters written (without the terminator)
+ */
+size_t audio_rt_format(char *buf, size_t len);
+
+/**
+ * @brief Log everything, histograms included (diagnostic dump)
+ */
+void audio_rt_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
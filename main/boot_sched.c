@@ -0,0 +1,297 @@
+/**
+ * @file boot_sched.c
+ * @brief Dependency-driven parallel boot
+ *
+ * Dependencies are bitmasks over the step table. A finished step clears its
+ * bit in every dependent's pending mask; steps whose mask becomes empty are
+ * submitted to the pool. Bookkeeping happens under a spinlock, submission
+ * outside it.
+ */
+
+#include "boot_sched.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "worker_pool.h"
+#include <string.h>
+
+static const char *TAG = "boot_sched";
+
+#define WORKER_STACK_SIZE 12288 // Same as the main task the steps came from
+#define WORKER_PRIORITY 1       // Main task priority
+#define STEP_NAME_MAX 24
+
+typedef enum {
+  STEP_WAITING = 0,
+  STEP_RUNNING,
+  STEP_DONE,
+  STEP_FAILED,
+  STEP_SKIPPED,
+} step_state_t;
+
+typedef struct {
+  const char *name;
+  boot_step_fn_t fn;
+  const char *deps;
+  uint32_t pending; // Dependencies not finished yet (bit per step)
+  step_state_t state;
+  esp_err_t result;
+  int64_t start_us;
+  int64_t end_us;
+} boot_step_t;
+
+static boot_step_t steps[BOOT_SCHED_MAX_STEPS];
+static int step_count = 0;
+static int finished = 0;
+static bool started = false;
+static int64_t sched_start_us = 0;
+static portMUX_TYPE sched_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t done_sem = NULL;
+static worker_pool_handle_t pool = NULL;
+
+static int find_step(const char *name, size_t len) {
+  for (int i = 0; i < step_count; i++) {
+    if (strlen(steps[i].name) == len && strncmp(steps[i].name, name, len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Turn a deps string into a bitmask
+ */
+static esp_err_t parse_deps(const boot_step_t *step, uint32_t *mask) {
+  *mask = 0;
+  const char *p = step->deps;
+  while (p && *p) {
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+    size_t len = strcspn(p, ", ");
+    if (len == 0) {
+      break;
+    }
+    int dep = find_step(p, len);
+    if (dep < 0) {
+      ESP_LOGE(TAG, "Step %s depends on unknown step %.*s", step->name,
+               (int)len, p);
+      return ESP_ERR_NOT_FOUND;
+    }
+    *mask |= 1u << dep;
+    p += len;
+  }
+  return ESP_OK;
+}
+
+/**
+ * @brief Check that every step can become ready (Kahn's algorithm)
+ */
+static bool graph_is_acyclic(void) {
+  uint32_t pending[BOOT_SCHED_MAX_STEPS];
+  uint32_t resolved = 0;
+  for (int i = 0; i < step_count; i++) {
+    pending[i] = steps[i].pending;
+  }
+  for (int round = 0; round < step_count; round++) {
+    bool progress = false;
+    for (int i = 0; i < step_count; i++) {
+      if (!(resolved & (1u << i)) && (pending[i] & ~resolved) == 0) {
+        resolved |= 1u << i;
+        progress = true;
+      }
+    }
+    if (!progress) {
+      break;
+    }
+  }
+  return resolved == (1u << step_count) - 1;
+}
+
+static void log_timeline(void) {
+  ESP_LOGI(TAG, "Boot timeline (ms since reset):");
+  for (int i = 0; i < step_count; i++) {
+    const boot_step_t *s = &steps[i];
+    if (s->state == STEP_SKIPPED) {
+      ESP_LOGW(TAG, "  %-*s skipped", STEP_NAME_MAX, s->name);
+      continue;
+    }
+    ESP_LOGI(TAG, "  %-*s %6lld -> %6lld (%5lld ms)%s", STEP_NAME_MAX, s->name,
+             s->start_us / 1000, s->end_us / 1000,
+             (s->end_us - s->start_us) / 1000,
+             s->state == STEP_FAILED ? " FAILED" : "");
+  }
+  ESP_LOGI(TAG, "Boot steps finished in %lld ms",
+           (esp_timer_get_time() - sched_start_us) / 1000);
+}
+
+static void run_step(void *arg);
+
+/**
+ * @brief Record a finished step and collect dependents that became ready
+ *
+ * Called with sched_mux held.
+ *
+ * @return Bitmask of steps to submit
+ */
+static uint32_t complete_step(int index, bool ok) {
+  uint32_t bit = 1u << index;
+  uint32_t ready = 0;
+  uint32_t failed = ok ? 0 : bit;
+
+  // Failures propagate through the whole dependent subtree
+  bool changed = !ok;
+  while (changed) {
+    changed = false;
+    for (int i = 0; i < step_count; i++) {
+      if (steps[i].state == STEP_WAITING && (steps[i].pending & failed)) {
+        steps[i].state = STEP_SKIPPED;
+        failed |= 1u << i;
+        finished++;
+        changed = true;
+      }
+    }
+  }
+
+  if (ok) {
+    for (int i = 0; i < step_count; i++) {
+      if (steps[i].state == STEP_WAITING && (steps[i].pending & bit)) {
+        steps[i].pending &= ~bit;
+        if (steps[i].pending == 0) {
+          steps[i].state = STEP_RUNNING;
+          ready |= 1u << i;
+        }
+      }
+    }
+  }
+  finished++;
+  return ready;
+}
+
+static void submit_ready(uint32_t ready) {
+  for (int i = 0; i < step_count; i++) {
+    if (ready & (1u << i)) {
+      worker_pool_submit(pool, run_step, (void *)(intptr_t)i, portMAX_DELAY);
+    }
+  }
+}
+
+static void run_step(void *arg) {
+  int index = (int)(intptr_t)arg;
+  boot_step_t *s = &steps[index];
+
+  s->start_us = esp_timer_get_time();
+  esp_err_t ret = s->fn();
+  s->end_us = esp_timer_get_time();
+  s->result = ret;
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Boot step %s failed: %s (dependents skipped)", s->name,
+             esp_err_to_name(ret));
+  }
+
+  portENTER_CRITICAL(&sched_mux);
+  s->state = ret == ESP_OK ? STEP_DONE : STEP_FAILED;
+  uint32_t ready = complete_step(index, ret == ESP_OK);
+  bool all_done = finished == step_count;
+  portEXIT_CRITICAL(&sched_mux);
+
+  submit_ready(ready);
+  if (all_done) {
+    xSemaphoreGive(done_sem);
+  }
+}
+
+esp_err_t boot_sched_add(const char *name, boot_step_fn_t fn,
+                         const char *deps) {
+  if (!name || !fn) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (started) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (step_count >= BOOT_SCHED_MAX_STEPS) {
+    ESP_LOGE(TAG, "Too many boot steps (max %d)", BOOT_SCHED_MAX_STEPS);
+    return ESP_ERR_NO_MEM;
+  }
+  if (find_step(name, strlen(name)) >= 0) {
+    ESP_LOGE(TAG, "Duplicate boot step %s", name);
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  steps[step_count++] = (boot_step_t){.name = name, .fn = fn, .deps = deps};
+  return ESP_OK;
+}
+
+esp_err_t boot_sched_start(int workers) {
+  if (started || step_count == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  for (int i = 0; i < step_count; i++) {
+    esp_err_t ret = parse_deps(&steps[i], &steps[i].pending);
+    if (ret != ESP_OK) {
+      return ret;
+    }
+  }
+  if (!graph_is_acyclic()) {
+    ESP_LOGE(TAG, "Boot step dependencies contain a cycle");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  done_sem = xSemaphoreCreateBinary();
+  worker_pool_config_t config = {
+      .name = "boot",
+      .workers = workers,
+      .stack_size = WORKER_STACK_SIZE,
+      .priority = WORKER_PRIORITY,
+      .queue_len = step_count,
+  };
+  if (!done_sem || worker_pool_create(&config, &pool) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create boot workers");
+    return ESP_ERR_NO_MEM;
+  }
+
+  started = true;
+  sched_start_us = esp_timer_get_time();
+  ESP_LOGI(TAG, "Starting %d boot steps on %d workers", step_count, workers);
+
+  uint32_t ready = 0;
+  portENTER_CRITICAL(&sched_mux);
+  for (int i = 0; i < step_count; i++) {
+    if (steps[i].pending == 0) {
+      steps[i].state = STEP_RUNNING;
+      ready |= 1u << i;
+    }
+  }
+  portEXIT_CRITICAL(&sched_mux);
+  submit_ready(ready);
+  return ESP_OK;
+}
+
+bool boot_sched_wait(uint32_t timeout_ms) {
+  if (!started) {
+    return false;
+  }
+  if (!pool) {
+    return true; // Already completed and reported
+  }
+  if (xSemaphoreTake(done_sem, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    return false;
+  }
+
+  log_timeline();
+  worker_pool_destroy(pool);
+  pool = NULL;
+  vSemaphoreDelete(done_sem);
+  done_sem = NULL;
+  return true;
+}
+
+uint32_t boot_sched_get_done_ms(const char *name) {
+  int i = name ? find_step(name, strlen(name)) : -1;
+  if (i < 0 || steps[i].state != STEP_DONE) {
+    return 0;
+  }
+  return (uint32_t)(steps[i].end_us / 1000);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file boot_sched.h
+ * @brief Dependency-driven parallel boot
+ *
+ * Each subsystem is added as a step naming the steps it depends on. Steps
+ * run on a worker pool as soon as all their dependencies have succeeded, so
+ * independent work (model loading, network bring-up, HA authentication)
+ * overlaps instead of running back to back. A failed step skips everything
+ * that depends on it; unrelated steps still run.
+ *
+ * When the boot completes, a timeline with each step's start, end and status
+ * is logged.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_SCHED_MAX_STEPS 24
+
+typedef esp_err_t (*boot_step_fn_t)(void);
+
+/**
+ * @brief Add a step (before boot_sched_start)
+ *
+ * @param name Unique step name (stored by pointer, must stay valid)
+ * @param fn Step function, runs on a worker
+ * @param deps Comma-separated names of the steps to wait for, or NULL
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE or ESP_ERR_NO_MEM
+ */
+esp_err_t boot_sched_add(const char *name, boot_step_fn_t fn,
+                         const char *deps);
+
+/**
+ * @brief Resolve the dependencies and start the steps without any
+ *
+ * @param workers Steps that may run at the same time
+ * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown dependency,
+ *         ESP_ERR_INVALID_STATE for a cycle, or ESP_ERR_NO_MEM
+ */
+esp_err_t boot_sched_start(int workers);
+
+/**
+ * @brief Wait for every step to finish or be skipped
+ *
+ * On completion the timeline is logged and the workers are freed.
+ *
+ * @return true if the boot has completed
+ */
+bool boot_sched_wait(uint32_t timeout_ms);
+
+/**
+ * @brief Time since reset at which a step finished successfully
+ *
+ * @return Milliseconds, 0 if the step has not (successfully) finished
+ */
+uint32_t boot_sched_get_done_ms(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,616 @@
+/**
+ * @file duration_parse.c
+ * @brief Timer durations from STT text and HA intent slots
+ *
+ * The lexicon is hashed with hash-and-displace: FNV-1a picks a bucket, and
+ * each bucket has a displacement chosen at init so that its words land in
+ * free slots of the word table. A lookup is one hash, one probe and one
+ * compare; unknown words cost the same.
+ *
+ * Folding is lossy ("što" and "sto" both become "sto"), so a word with
+ * diacritics is first looked up as spoken, lower-cased, and only then in
+ * its folded form; the few words that fold onto a number are in the
+ * lexicon with their diacritics.
+ *
+ * Numbers are assembled from their parts as they arrive ("sto" "dvadeset"
+ * "pet"), and a unit word consumes the number in front of it. Nothing
+ * looks ahead except a half: "sat i pol" only knows it means half an hour
+ * once it is clear no unit follows the "pol". A "pol" that neither follows
+ * "i" nor precedes a unit is ignored ("deset minuta pola").
+ */
+
+#include "duration_parse.h"
+
+#include <string.h>
+
+#define WORD_MAX 24 // Longer words are not in the lexicon
+#define LEX_BUCKETS 64
+#define LEX_SLOTS 256
+#define LEX_BUCKET_MAX 8  // Words per bucket the displacement search handles
+#define NUMBER_MAX 1e6    // Larger numbers are clamped
+
+typedef enum {
+  LEX_NUM,      // value: 0-19, tens, hundreds
+  LEX_HUNDRED,  // "hundred": multiplies the number before it
+  LEX_UNIT,     // value: seconds
+  LEX_UNIT_ONE, // Unit that also means one of it ("minutu", "hour")
+  LEX_HALF,
+  LEX_AND,
+  LEX_FILLER, // "a", "an": skipped
+  LEX_TIMER,
+} lex_kind_t;
+
+typedef struct {
+  const char *word;
+  uint8_t kind;
+  uint32_t value;
+} lex_entry_t;
+
+// Folded to lowercase ASCII: "cetiri" matches "četiri". Entries with
+// diacritics (UTF-8) only match the word as spoken.
+static const lex_entry_t lexicon[] = {
+    // Croatian numbers (with the forms STT produces for case and gender)
+    {"nula", LEX_NUM, 0},
+    {"jedan", LEX_NUM, 1}, {"jedna", LEX_NUM, 1}, {"jedno", LEX_NUM, 1},
+    {"jednu", LEX_NUM, 1}, {"jednog", LEX_NUM, 1}, {"jedne", LEX_NUM, 1},
+    {"dva", LEX_NUM, 2}, {"dvije", LEX_NUM, 2}, {"dvaju", LEX_NUM, 2},
+    {"dviju", LEX_NUM, 2},
+    {"tri", LEX_NUM, 3}, {"triju", LEX_NUM, 3},
+    {"cetiri", LEX_NUM, 4}, {"chetiri", LEX_NUM, 4},
+    {"pet", LEX_NUM, 5},
+    {"sest", LEX_NUM, 6}, {"shest", LEX_NUM, 6},
+    {"sedam", LEX_NUM, 7}, {"osam", LEX_NUM, 8}, {"devet", LEX_NUM, 9},
+    {"deset", LEX_NUM, 10}, {"jedanaest", LEX_NUM, 11},
+    {"dvanaest", LEX_NUM, 12}, {"trinaest", LEX_NUM, 13},
+    {"cetrnaest", LEX_NUM, 14}, {"chetrnaest", LEX_NUM, 14},
+    {"petnaest", LEX_NUM, 15},
+    {"sesnaest", LEX_NUM, 16}, {"shesnaest", LEX_NUM, 16},
+    {"sedamnaest", LEX_NUM, 17}, {"osamnaest", LEX_NUM, 18},
+    {"devetnaest", LEX_NUM, 19},
+    {"dvadeset", LEX_NUM, 20}, {"trideset", LEX_NUM, 30},
+    {"cetrdeset", LEX_NUM, 40}, {"chetrdeset", LEX_NUM, 40},
+    {"pedeset", LEX_NUM, 50},
+    {"sezdeset", LEX_NUM, 60}, {"shezdeset", LEX_NUM, 60},
+    {"sedamdeset", LEX_NUM, 70}, {"osamdeset", LEX_NUM, 80},
+    {"devedeset", LEX_NUM, 90},
+    {"sto", LEX_NUM, 100}, {"stotinu", LEX_NUM, 100},
+    {"dvjesto", LEX_NUM, 200}, {"dvjesta", LEX_NUM, 200},
+    {"tristo", LEX_NUM, 300}, {"trista", LEX_NUM, 300},
+    {"cetiristo", LEX_NUM, 400}, {"petsto", LEX_NUM, 500},
+    {"sesto", LEX_NUM, 600}, {"sedamsto", LEX_NUM, 700},
+    {"osamsto", LEX_NUM, 800}, {"devetsto", LEX_NUM, 900},
+
+    // English numbers
+    {"zero", LEX_NUM, 0}, {"one", LEX_NUM, 1}, {"two", LEX_NUM, 2},
+    {"three", LEX_NUM, 3}, {"four", LEX_NUM, 4}, {"five", LEX_NUM, 5},
+    {"six", LEX_NUM, 6}, {"seven", LEX_NUM, 7}, {"eight", LEX_NUM, 8},
+    {"nine", LEX_NUM, 9}, {"ten", LEX_NUM, 10}, {"eleven", LEX_NUM, 11},
+    {"twelve", LEX_NUM, 12}, {"thirteen", LEX_NUM, 13},
+    {"fourteen", LEX_NUM, 14}, {"fifteen", LEX_NUM, 15},
+    {"sixteen", LEX_NUM, 16}, {"seventeen", LEX_NUM, 17},
+    {"eighteen", LEX_NUM, 18}, {"nineteen", LEX_NUM, 19},
+    {"twenty", LEX_NUM, 20}, {"thirty", LEX_NUM, 30},
+    {"forty", LEX_NUM, 40}, {"fifty", LEX_NUM, 50}, {"sixty", LEX_NUM, 60},
+    {"seventy", LEX_NUM, 70}, {"eighty", LEX_NUM, 80},
+    {"ninety", LEX_NUM, 90},
+    {"hundred", LEX_HUNDRED, 100},
+
+    // Units
+    {"sat", LEX_UNIT_ONE, 3600}, {"sata", LEX_UNIT, 3600},
+    {"sati", LEX_UNIT, 3600}, {"satova", LEX_UNIT, 3600},
+    {"satu", LEX_UNIT, 3600}, {"satom", LEX_UNIT, 3600},
+    {"h", LEX_UNIT, 3600}, {"hr", LEX_UNIT, 3600}, {"hrs", LEX_UNIT, 3600},
+    {"hour", LEX_UNIT_ONE, 3600}, {"hours", LEX_UNIT, 3600},
+    {"minuta", LEX_UNIT, 60}, {"minute", LEX_UNIT_ONE, 60},
+    {"minutu", LEX_UNIT_ONE, 60}, {"minut", LEX_UNIT_ONE, 60},
+    {"minuti", LEX_UNIT, 60}, {"minutom", LEX_UNIT, 60},
+    {"minutama", LEX_UNIT, 60}, {"min", LEX_UNIT, 60},
+    {"mins", LEX_UNIT, 60}, {"minutes", LEX_UNIT, 60},
+    {"sekunda", LEX_UNIT, 1}, {"sekunde", LEX_UNIT, 1},
+    {"sekundi", LEX_UNIT, 1}, {"sekundu", LEX_UNIT_ONE, 1},
+    {"sekundom", LEX_UNIT, 1}, {"sekundama", LEX_UNIT, 1},
+    {"sek", LEX_UNIT, 1}, {"sec", LEX_UNIT, 1}, {"secs", LEX_UNIT, 1},
+    {"second", LEX_UNIT_ONE, 1}, {"seconds", LEX_UNIT, 1},
+    {"dan", LEX_UNIT, 86400}, {"dana", LEX_UNIT, 86400},
+    {"day", LEX_UNIT_ONE, 86400}, {"days", LEX_UNIT, 86400},
+
+    // Halves, joiners and fillers
+    {"pola", LEX_HALF, 0}, {"pol", LEX_HALF, 0}, {"half", LEX_HALF, 0},
+    {"i", LEX_AND, 0}, {"and", LEX_AND, 0},
+    {"a", LEX_FILLER, 0}, {"an", LEX_FILLER, 0},
+    {"\xc5\xa1to", LEX_FILLER, 0}, // "što", not "sto" (100)
+
+    // Timer keywords
+    {"timer", LEX_TIMER, 0}, {"tajmer", LEX_TIMER, 0},
+    {"timera", LEX_TIMER, 0}, {"tajmera", LEX_TIMER, 0},
+    {"odbrojavanje", LEX_TIMER, 0}, {"odbroj", LEX_TIMER, 0},
+    {"alarm", LEX_TIMER, 0}, {"alarma", LEX_TIMER, 0},
+    {"podsjetnik", LEX_TIMER, 0}, {"podsjetnika", LEX_TIMER, 0},
+    {"countdown", LEX_TIMER, 0},
+};
+
+#define LEX_COUNT (sizeof(lexicon) / sizeof(lexicon[0]))
+_Static_assert(LEX_COUNT < 255, "word table holds uint8_t indices");
+
+static uint8_t lex_disp[LEX_BUCKETS]; // Displacement per bucket
+static uint8_t lex_table[LEX_SLOTS];  // Lexicon index + 1, 0: empty
+static bool lex_ready = false;
+
+// --- Perfect hash ------------------------------------------------------------
+
+static uint32_t fnv1a_step(uint32_t h, unsigned char c) {
+  return (h ^ c) * 16777619u;
+}
+
+static uint32_t lex_hash(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    h = fnv1a_step(h, (unsigned char)s[i]);
+  return h;
+}
+
+static uint32_t lex_slot(uint32_t h, uint32_t disp) {
+  // Odd stride: the displacements of a bucket visit every slot
+  return ((h >> 8) + disp * ((h >> 16) | 1u)) & (LEX_SLOTS - 1);
+}
+
+bool duration_parse_init(void) {
+  if (lex_ready)
+    return true;
+
+  uint32_t hashes[LEX_COUNT];
+  uint8_t bucket_size[LEX_BUCKETS] = {0};
+  for (size_t i = 0; i < LEX_COUNT; i++) {
+    hashes[i] = lex_hash(lexicon[i].word, strlen(lexicon[i].word));
+    bucket_size[hashes[i] % LEX_BUCKETS]++;
+  }
+
+  // Largest buckets first, while the table is still empty
+  uint8_t order[LEX_BUCKETS];
+  for (int b = 0; b < LEX_BUCKETS; b++) {
+    int j = b;
+    while (j > 0 && bucket_size[order[j - 1]] < bucket_size[b]) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = (uint8_t)b;
+  }
+
+  memset(lex_table, 0, sizeof(lex_table));
+  memset(lex_disp, 0, sizeof(lex_disp));
+  for (int o = 0; o < LEX_BUCKETS && bucket_size[order[o]] > 0; o++) {
+    int b = order[o];
+    if (bucket_size[b] > LEX_BUCKET_MAX)
+      return false;
+    size_t members[LEX_BUCKET_MAX];
+    int n = 0;
+    for (size_t i = 0; i < LEX_COUNT; i++) {
+      if (hashes[i] % LEX_BUCKETS == (uint32_t)b)
+        members[n++] = i;
+    }
+
+    bool placed = false;
+    for (uint32_t d = 0; d < 256 && !placed; d++) {
+      uint32_t slots[LEX_BUCKET_MAX];
+      placed = true;
+      for (int k = 0; k < n && placed; k++) {
+        slots[k] = lex_slot(hashes[members[k]], d);
+        placed = lex_table[slots[k]] == 0;
+        for (int m = 0; m < k && placed; m++)
+          placed = slots[m] != slots[k];
+      }
+      if (placed) {
+        lex_disp[b] = (uint8_t)d;
+        for (int k = 0; k < n; k++)
+          lex_table[slots[k]] = (uint8_t)(members[k] + 1);
+      }
+    }
+    if (!placed)
+      return false;
+  }
+  lex_ready = true;
+  return true;
+}
+
+static const lex_entry_t *lex_find(const char *word, size_t len, uint32_t h) {
+  uint8_t idx = lex_table[lex_slot(h, lex_disp[h % LEX_BUCKETS])];
+  if (idx == 0)
+    return NULL;
+  const lex_entry_t *e = &lexicon[idx - 1];
+  if (strncmp(e->word, word, len) != 0 || e->word[len] != '\0')
+    return NULL;
+  return e;
+}
+
+// --- Parser ------------------------------------------------------------------
+
+// Croatian letters as UTF-8 pairs, folded to ASCII; upper case at even
+// indices, its lower case right after it
+static const struct {
+  unsigned char lead;
+  unsigned char trail;
+  char ascii;
+} folds[] = {
+    {0xC4, 0x8C, 'c'}, {0xC4, 0x8D, 'c'}, // Č č
+    {0xC4, 0x86, 'c'}, {0xC4, 0x87, 'c'}, // Ć ć
+    {0xC4, 0x90, 'd'}, {0xC4, 0x91, 'd'}, // Đ đ
+    {0xC5, 0xA0, 's'}, {0xC5, 0xA1, 's'}, // Š š
+    {0xC5, 0xBD, 'z'}, {0xC5, 0xBE, 'z'}, // Ž ž
+};
+
+typedef enum {
+  PART_NONE,
+  PART_ONES,
+  PART_TEENS,
+  PART_TENS,
+  PART_HUNDREDS
+} part_t;
+
+typedef struct {
+  double total; // Seconds
+  bool has_duration;
+  bool has_timer;
+  bool other; // A token that is not part of a number
+  // Number being assembled
+  double num;
+  bool have_num;
+  part_t part;
+  // "pol" without a number: half of the next unit, or of the last one
+  // after "i" ("sat i pol")
+  bool half_pending;
+  bool half_after_and;
+  bool after_and;     // Previous word was "i"/"and" (fillers in between)
+  uint32_t last_unit; // Seconds of the unit just consumed, 0 if none
+} state_t;
+
+static bool is_digit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+static bool is_letter(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+static void number_reset(state_t *st) {
+  st->have_num = false;
+  st->part = PART_NONE;
+}
+
+static void half_flush(state_t *st) {
+  if (st->half_pending && st->half_after_and && st->last_unit) {
+    st->total += 0.5 * st->last_unit; // "sat i pol"
+    st->has_duration = true;
+  }
+  st->half_pending = false;
+}
+
+static void number_start(state_t *st, double v, part_t part) {
+  half_flush(st);
+  st->num = v;
+  st->have_num = true;
+  st->part = part;
+  st->last_unit = 0;
+}
+
+static part_t part_of(uint32_t v) {
+  if (v < 10)
+    return PART_ONES;
+  if (v < 20)
+    return PART_TEENS;
+  if (v < 100)
+    return PART_TENS;
+  return PART_HUNDREDS;
+}
+
+static void on_number_word(state_t *st, uint32_t v) {
+  part_t part = part_of(v);
+  // "sto dvadeset pet": a smaller part joins a larger one still open
+  bool joins = st->have_num &&
+               ((st->part == PART_HUNDREDS && part != PART_HUNDREDS) ||
+                (st->part == PART_TENS && part == PART_ONES && v > 0));
+  if (joins) {
+    st->num += v;
+    st->part = part;
+  } else {
+    number_start(st, v, part);
+  }
+}
+
+static void on_hundred(state_t *st) {
+  if (st->have_num && st->part == PART_ONES && st->num >= 1) {
+    st->num *= 100; // "two hundred"
+    st->part = PART_HUNDREDS;
+  } else {
+    number_start(st, 100, PART_HUNDREDS);
+  }
+}
+
+static void on_unit(state_t *st, uint32_t seconds, bool means_one) {
+  double v;
+  if (st->have_num)
+    v = st->num;
+  else if (st->half_pending)
+    v = 0.5; // "pola sata"
+  else if (means_one)
+    v = 1.0; // "timer na minutu"
+  else {
+    half_flush(st);
+    st->other = true;
+    return;
+  }
+  st->total += v * seconds;
+  st->has_duration = true;
+  st->half_pending = false;
+  st->last_unit = seconds;
+  st->other = true;
+  number_reset(st);
+}
+
+static void on_half(state_t *st) {
+  if (st->have_num) {
+    st->num += 0.5; // "dva i pol"
+    st->part = PART_NONE;
+    return;
+  }
+  st->half_pending = true;
+  st->half_after_and = st->after_and;
+}
+
+/**
+ * @brief Something that is not part of a duration: drop what is half built
+ */
+static void on_other(state_t *st) {
+  half_flush(st);
+  number_reset(st);
+  st->last_unit = 0;
+  st->other = true;
+}
+
+/**
+ * @param spoken Lower-cased word with its diacritics, NULL if it has none
+ */
+static void on_word(state_t *st, const char *spoken, size_t spoken_len,
+                    uint32_t spoken_h, const char *word, size_t len,
+                    uint32_t h) {
+  const lex_entry_t *e = spoken ? lex_find(spoken, spoken_len, spoken_h) : NULL;
+  if (!e && word) {
+    e = lex_find(word, len, h);
+  }
+  if (!e) {
+    st->after_and = false;
+    on_other(st);
+    return;
+  }
+  switch ((lex_kind_t)e->kind) {
+  case LEX_NUM:
+    on_number_word(st, e->value);
+    break;
+  case LEX_HUNDRED:
+    on_hundred(st);
+    break;
+  case LEX_UNIT:
+  case LEX_UNIT_ONE:
+    on_unit(st, e->value, e->kind == LEX_UNIT_ONE);
+    break;
+  case LEX_HALF:
+    on_half(st);
+    break;
+  case LEX_AND:
+  case LEX_FILLER:
+    break;
+  case LEX_TIMER:
+    on_other(st);
+    st->has_timer = true;
+    break;
+  }
+  st->after_and = e->kind == LEX_AND ||
+                  (e->kind == LEX_FILLER && st->after_and); // "and a half"
+}
+
+/**
+ * @brief Digits with an optional decimal part ("2,5" or "2.5")
+ */
+static const unsigned char *scan_decimal(const unsigned char *p, double *out) {
+  double v = 0;
+  while (is_digit(*p)) {
+    if (v < NUMBER_MAX)
+      v = v * 10 + (*p - '0');
+    p++;
+  }
+  if ((*p == '.' || *p == ',') && is_digit(p[1])) {
+    double scale = 0.1;
+    for (p++; is_digit(*p); p++) {
+      v += (*p - '0') * scale;
+      scale *= 0.1;
+    }
+  }
+  *out = v < NUMBER_MAX ? v : NUMBER_MAX;
+  return p;
+}
+
+/**
+ * @brief "1:30" (m:s) or "1:02:03" (h:m:s) at p
+ *
+ * @return Position after it, or NULL if this is not a clock duration
+ */
+static const unsigned char *scan_clock(const unsigned char *p,
+                                       double *seconds) {
+  uint32_t parts[3];
+  int count = 0;
+  while (count < 3 && is_digit(*p)) {
+    uint32_t v = 0;
+    int digits = 0;
+    for (; is_digit(*p); p++, digits++) {
+      if (digits < 6)
+        v = v * 10 + (uint32_t)(*p - '0');
+    }
+    parts[count++] = v;
+    if (*p != ':' || !is_digit(p[1]))
+      break;
+    p++;
+  }
+  if (count < 2)
+    return NULL;
+  *seconds = count == 3 ? parts[0] * 3600.0 + parts[1] * 60.0 + parts[2]
+                        : parts[0] * 60.0 + parts[1];
+  return p;
+}
+
+/**
+ * @brief ISO-8601 duration at p ("PT1H30M", "P1DT2H", "PT1.5S")
+ *
+ * @return Position after it, or NULL if this is not one
+ */
+static const unsigned char *scan_iso8601(const unsigned char *p,
+                                         double *seconds) {
+  if (*p != 'P' && *p != 'p')
+    return NULL;
+  p++;
+  bool in_time = false;
+  bool any = false;
+  double total = 0;
+  while (*p) {
+    if ((*p == 'T' || *p == 't') && !in_time) {
+      in_time = true;
+      p++;
+      continue;
+    }
+    if (!is_digit(*p))
+      break;
+    double v;
+    p = scan_decimal(p, &v);
+    unsigned char d = (unsigned char)(*p & ~0x20); // Upper case
+    double unit;
+    if (!in_time && d == 'W')
+      unit = 604800;
+    else if (!in_time && d == 'D')
+      unit = 86400;
+    else if (in_time && d == 'H')
+      unit = 3600;
+    else if (in_time && d == 'M')
+      unit = 60; // Months (M before T) are not durations we can time
+    else if (in_time && d == 'S')
+      unit = 1;
+    else
+      return NULL;
+    total += v * unit;
+    any = true;
+    p++;
+  }
+  if (!any || is_letter(*p) || is_digit(*p))
+    return NULL;
+  *seconds = total;
+  return p;
+}
+
+static void scan(const char *text, state_t *st) {
+  memset(st, 0, sizeof(*st));
+  const unsigned char *p = (const unsigned char *)text;
+  while (*p) {
+    if (!is_letter(*p) && !is_digit(*p)) {
+      p++;
+      continue;
+    }
+
+    double seconds;
+    const unsigned char *after;
+    if ((*p == 'P' || *p == 'p') &&
+        (after = scan_iso8601(p, &seconds)) != NULL) {
+      st->after_and = false;
+      on_other(st);
+      st->total += seconds;
+      st->has_duration = true;
+      p = after;
+      continue;
+    }
+
+    if (is_digit(*p)) {
+      st->after_and = false;
+      if ((after = scan_clock(p, &seconds)) != NULL) {
+        on_other(st);
+        st->total += seconds;
+        st->has_duration = true;
+      } else {
+        double v;
+        after = scan_decimal(p, &v);
+        number_start(st, v, PART_NONE); // Digits never join words
+      }
+      p = after;
+      continue;
+    }
+
+    // Word: lower-cased as spoken and folded, both hashed in the same pass;
+    // digits end it ("5min")
+    char word[WORD_MAX], spoken[WORD_MAX];
+    size_t len = 0, spoken_len = 0;
+    bool truncated = false, folded = false;
+    uint32_t h = 2166136261u, spoken_h = 2166136261u;
+    while (is_letter(*p)) {
+      char c = (char)*p;
+      size_t used = 1;
+      if (*p >= 'A' && *p <= 'Z') {
+        c = (char)(*p - 'A' + 'a');
+      } else if (*p >= 0x80) {
+        for (size_t i = 0; i < sizeof(folds) / sizeof(folds[0]); i++) {
+          if (folds[i].lead == p[0] && folds[i].trail == p[1]) {
+            c = folds[i].ascii;
+            used = 2;
+            folded = true;
+            if (spoken_len + 2 < WORD_MAX) {
+              spoken[spoken_len++] = (char)folds[i | 1].lead; // Lower case
+              spoken[spoken_len++] = (char)folds[i | 1].trail;
+              spoken_h = fnv1a_step(spoken_h, folds[i | 1].lead);
+              spoken_h = fnv1a_step(spoken_h, folds[i | 1].trail);
+            } else {
+              truncated = true;
+            }
+            break;
+          }
+        }
+      }
+      if (used == 1) {
+        if (spoken_len + 1 < WORD_MAX) {
+          spoken[spoken_len++] = c;
+          spoken_h = fnv1a_step(spoken_h, (unsigned char)c);
+        } else {
+          truncated = true;
+        }
+      }
+      p += used;
+      if (len < WORD_MAX - 1) {
+        word[len++] = c;
+        h = fnv1a_step(h, (unsigned char)c);
+      } else {
+        truncated = true;
+      }
+    }
+    if (truncated) {
+      on_word(st, NULL, 0, 0, NULL, 0, 0); // Longer than any lexicon word
+    } else {
+      on_word(st, folded ? spoken : NULL, spoken_len, spoken_h, word, len, h);
+    }
+  }
+  half_flush(st);
+}
+
+bool duration_parse(const char *text, duration_parse_result_t *result) {
+  if (!text || !result || !lex_ready)
+    return false;
+  state_t st;
+  scan(text, &st);
+  result->has_duration = st.has_duration;
+  result->has_timer_word = st.has_timer;
+  bool ok = st.has_duration && st.total >= 1.0 &&
+            st.total <= DURATION_PARSE_MAX_SECONDS;
+  result->seconds = ok ? (uint32_t)(st.total + 0.5) : 0;
+  return ok;
+}
+
+bool duration_parse_number(const char *text, double *value) {
+  if (!text || !value || !lex_ready)
+    return false;
+  state_t st;
+  scan(text, &st);
+  if (!st.have_num || st.other || st.has_duration || st.has_timer)
+    return false;
+  *value = st.num;
+  return true;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file duration_parse.h
+ * @brief Timer durations from STT text and HA intent slots
+ *
+ * One pass over the text, no heap: words are folded to lowercase ASCII
+ * (č/ć -> c, š -> s, ž -> z, đ -> d) into a small stack buffer and looked
+ * up in a Croatian/English lexicon through a perfect hash built once by
+ * duration_parse_init(). Understood:
+ *
+ *  - numbers in digits ("25", "2,5") and words, including compounds
+ *    ("dvadeset pet", "dvadeset i pet", "sto dvadeset", "twenty five",
+ *    "one hundred twenty") and inflected forms ("jednu", "dvije");
+ *  - units in their inflected forms (sat/sata/sati, minuta/minute/minutu,
+ *    sekunda/sekunde/sekundi, h/min/sek, hours/minutes/seconds, days);
+ *  - halves: "pola sata", "dva i pol sata", "sat i pol", "half an hour",
+ *    "an hour and a half";
+ *  - a unit without a number counts once ("timer na minutu");
+ *  - clock durations "1:30" (m:s) and "1:02:03" (h:m:s);
+ *  - ISO-8601 durations ("PT1H30M", "P1DT2H", "PT1.5S").
+ *
+ * The module has no ESP-IDF dependencies.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DURATION_PARSE_MAX_SECONDS (7u * 24u * 3600u) ///< Longer is rejected
+
+typedef struct {
+  uint32_t seconds;   ///< Sum of all durations found
+  bool has_duration;  ///< A unit, clock or ISO-8601 duration was found
+  bool has_timer_word; ///< "timer", "tajmer", "odbrojavanje", "alarm"...
+} duration_parse_result_t;
+
+/**
+ * @brief Build the lexicon hash (idempotent; call before parsing)
+ *
+ * @return false if the lexicon does not hash perfectly (a build error)
+ */
+bool duration_parse_init(void);
+
+/**
+ * @brief Find the durations in a text
+ *
+ * @return true if a duration was found and the total is within
+ *         DURATION_PARSE_MAX_SECONDS
+ */
+bool duration_parse(const char *text, duration_parse_result_t *result);
+
+/**
+ * @brief Parse a number alone: "25", "2.5", "dvadeset pet", "twenty five"
+ *
+ * @return false if the text holds no number or anything else
+ */
+bool duration_parse_number(const char *text, double *value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file event_bus.c
+ * @brief Lock-free event hand-off from the audio thread
+ *
+ * head and tail are free-running counters: the producer only writes head,
+ * the consumer only writes tail. The release store of head publishes the
+ * slot contents, the acquire load on the other side picks them up. The
+ * producer wakes the dispatcher with a task notification, which is a short
+ * bounded call that never blocks.
+ */
+
+#include "event_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sys_diag.h"
+#include "task_arena.h"
+#include <stdatomic.h>
+
+static const char *TAG = "event_bus";
+
+#define DISPATCH_TASK_PRIORITY 4 // Below AFE fetch (5) and feed (6)
+#define DISPATCH_IDLE_MS 1000    // Wake up to feed the watchdog
+
+_Static_assert((EVENT_BUS_QUEUE_LEN & (EVENT_BUS_QUEUE_LEN - 1)) == 0,
+               "EVENT_BUS_QUEUE_LEN must be a power of two");
+
+static event_bus_event_t ring[EVENT_BUS_QUEUE_LEN];
+static atomic_uint head = 0; // Events posted (producer)
+static atomic_uint tail = 0; // Events dispatched (consumer)
+
+static event_bus_handler_t handlers[EVENT_BUS_TYPE_MAX];
+static event_bus_stats_t stats;
+
+static TaskHandle_t dispatch_task_handle = NULL;
+
+static void dispatch(const event_bus_event_t *event) {
+  int64_t start_us = esp_timer_get_time();
+  uint32_t latency_us = (uint32_t)(start_us - event->posted_us);
+  if (latency_us > stats.max_latency_us) {
+    stats.max_latency_us = latency_us;
+  }
+
+  event_bus_handler_t handler = handlers[event->type];
+  if (!handler) {
+    return;
+  }
+  handler(event);
+
+  uint32_t handler_us = (uint32_t)(esp_timer_get_time() - start_us);
+  if (handler_us > stats.max_handler_us) {
+    stats.max_handler_us = handler_us;
+  }
+}
+
+static void dispatch_task(void *arg) {
+  (void)arg;
+  sys_diag_wdt_add();
+
+  while (1) {
+    sys_diag_wdt_feed();
+    unsigned t = atomic_load_explicit(&tail, memory_order_relaxed);
+    if (t == atomic_load_explicit(&head, memory_order_acquire)) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DISPATCH_IDLE_MS));
+      continue;
+    }
+    // Copy out first so the slot is free while the handler runs
+    event_bus_event_t event = ring[t & (EVENT_BUS_QUEUE_LEN - 1)];
+    atomic_store_explicit(&tail, t + 1, memory_order_release);
+    dispatch(&event);
+  }
+}
+
+esp_err_t event_bus_init(void) {
+  if (dispatch_task_handle) {
+    return ESP_OK;
+  }
+
+  // Stack in the arena (PSRAM); handlers do WebSocket/MQTT sends
+  if (task_arena_start(TASK_SLOT_EVENT_BUS, dispatch_task, NULL,
+                       DISPATCH_TASK_PRIORITY, tskNO_AFFINITY,
+                       &dispatch_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create dispatcher task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t event_bus_subscribe(event_bus_type_t type,
+                              event_bus_handler_t handler) {
+  if (type >= EVENT_BUS_TYPE_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  handlers[type] = handler;
+  return ESP_OK;
+}
+
+bool event_bus_post(event_bus_type_t type, int32_t arg) {
+  int64_t now_us = esp_timer_get_time();
+  if (!dispatch_task_handle || type >= EVENT_BUS_TYPE_MAX) {
+    stats.dropped++;
+    return false;
+  }
+
+  unsigned h = atomic_load_explicit(&head, memory_order_relaxed);
+  if (h - atomic_load_explicit(&tail, memory_order_acquire) >=
+      EVENT_BUS_QUEUE_LEN) {
+    stats.dropped++;
+    return false;
+  }
+  ring[h & (EVENT_BUS_QUEUE_LEN - 1)] =
+      (event_bus_event_t){.type = type, .arg = arg, .posted_us = now_us};
+  atomic_store_explicit(&head, h + 1, memory_order_release);
+  xTaskNotifyGive(dispatch_task_handle);
+
+  stats.posted++;
+  uint32_t post_us = (uint32_t)(esp_timer_get_time() - now_us);
+  if (post_us > stats.max_post_us) {
+    stats.max_post_us = post_us;
+  }
+  return true;
+}
+
+void event_bus_get_stats(event_bus_stats_t *out) {
+  if (out) {
+    *out = stats;
+  }
+}
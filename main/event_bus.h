@@ -0,0 +1,89 @@
+/**
+ * @file event_bus.h
+ * @brief Lock-free event hand-off from the audio thread
+ *
+ * The AFE fetch task must never block on UI, MQTT or network work. It posts
+ * small typed events into a single-producer/single-consumer ring instead;
+ * a lower-priority dispatcher task drains the ring and runs the handlers
+ * subscribed to each event type.
+ *
+ * Posting never blocks and never allocates. If the ring is full the event
+ * is dropped and counted.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_BUS_QUEUE_LEN 16 // Power of two
+
+/**
+ * @brief Event types posted by the audio thread
+ */
+typedef enum {
+  EVENT_BUS_WAKE_WORD = 0, ///< Wake word detected (arg: wake word index)
+  EVENT_BUS_VAD_START,     ///< Speech started
+  EVENT_BUS_VAD_END,       ///< Speech ended
+  EVENT_BUS_OFFLINE_CMD,   ///< MultiNet command (arg: command id)
+  EVENT_BUS_TYPE_MAX
+} event_bus_type_t;
+
+typedef struct {
+  event_bus_type_t type;
+  int32_t arg;
+  int64_t posted_us; ///< esp_timer time of the post
+} event_bus_event_t;
+
+typedef void (*event_bus_handler_t)(const event_bus_event_t *event);
+
+/**
+ * @brief Event bus statistics
+ */
+typedef struct {
+  uint32_t posted;         ///< Events accepted
+  uint32_t dropped;        ///< Events lost because the ring was full
+  uint32_t max_post_us;    ///< Longest post (time spent on the audio thread)
+  uint32_t max_latency_us; ///< Longest post-to-dispatch delay
+  uint32_t max_handler_us; ///< Longest handler run on the dispatcher
+} event_bus_stats_t;
+
+/**
+ * @brief Create the ring and start the dispatcher task
+ *
+ * @return ESP_OK (also if already running) or ESP_ERR_NO_MEM
+ */
+esp_err_t event_bus_init(void);
+
+/**
+ * @brief Set the handler for an event type (one per type)
+ *
+ * Handlers run on the dispatcher task and may block.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t event_bus_subscribe(event_bus_type_t type,
+                              event_bus_handler_t handler);
+
+/**
+ * @brief Post an event without blocking
+ *
+ * Only one task may post at a time (the AFE fetch task).
+ *
+ * @return true if queued, false if dropped (ring full or bus not running)
+ */
+bool event_bus_post(event_bus_type_t type, int32_t arg);
+
+/**
+ * @brief Get event bus statistics
+ */
+void event_bus_get_stats(event_bus_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
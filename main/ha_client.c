@@ -20,7 +20,10 @@
 #include "audio_capture.h"
 #include "config.h" // For fallback/defaults if needed
 #include "ha_client.h"
+#include "mem_track.h"
 #include "oled_status.h"
+#include "task_arena.h"
+#include "tts_cache.h"
 
 static const char *TAG = "ha_client";
 
@@ -28,7 +31,7 @@ static esp_websocket_client_handle_t ws_client = NULL;
 static bool ws_connected = false;
 static bool ws_authenticated = false;
 static int message_id = 1;
-static TaskHandle_t reconnect_task_handle = NULL;
+static volatile bool reconnect_pending = false;
 
 // Internal Config Storage
 static ha_client_config_t client_config;
@@ -42,11 +45,15 @@ static ha_tts_audio_callback_t tts_audio_callback = NULL;
 static ha_pipeline_error_callback_t error_callback = NULL;
 static ha_intent_callback_t intent_callback = NULL;
 static ha_stt_callback_t stt_callback = NULL;
+static ha_run_end_callback_t run_end_callback = NULL;
 
 static int stt_binary_handler_id = -1;
 static int last_run_message_id = -1;
 static bool timer_started_this_conversation = false;
 static bool speech_text_sent_this_run = false;
+static char run_conversation_id[64]; // From intent-end, passed to callbacks
+static char run_tts_voice[96]; // tts-start engine|language|voice (cache key)
+static tts_cache_writer_t *tts_cache_writer = NULL; // Download being cached
 
 static uint8_t *audio_frame_buf = NULL;
 static size_t audio_frame_buf_cap = 0;
@@ -58,15 +65,18 @@ static EventGroupHandle_t ha_event_group;
 
 #define HA_SEND_TEXT_TIMEOUT_MS 2000
 #define HA_SEND_AUDIO_TIMEOUT_MS 2000
+#define TTS_CACHE_FEED_CHUNK 4096
 
 // Forward declarations
-static void download_tts_audio(const char *url);
+static void download_tts_audio(const char *url, const uint64_t *cache_key);
+static bool play_cached_tts(uint64_t cache_key);
 static bool ha_find_stt_handler_id(const cJSON *node, int depth, int *out_id);
 static void ha_clear_audio_ready(void);
 static void ha_set_audio_ready(int handler_id, const char *source);
 static const char *ha_extract_intent_json(const cJSON *data_obj);
 static bool ha_intent_name_is_timer(const char *intent_name);
 static const char *ha_extract_stt_text(const cJSON *data_obj);
+static void ha_read_tts_voice(const cJSON *data_obj);
 
 static void trim_ascii_whitespace_inplace(char *s) {
   if (s == NULL)
@@ -227,6 +237,32 @@ static const char *ha_extract_stt_text(const cJSON *data_obj) {
   return NULL;
 }
 
+static const char *ha_json_string(const cJSON *obj, const char *name) {
+  const cJSON *item = cJSON_GetObjectItemCaseSensitive((cJSON *)obj, name);
+  return cJSON_IsString(item) && item->valuestring ? item->valuestring : "";
+}
+
+/**
+ * Remember what the run's TTS speaks with, from tts-start
+ *
+ * Engine, language and voice all change the audio for the same text; they
+ * are left empty (not cacheable) if HA does not report an engine or they do
+ * not fit.
+ */
+static void ha_read_tts_voice(const cJSON *data_obj) {
+  run_tts_voice[0] = '\0';
+  const char *engine = data_obj ? ha_json_string(data_obj, "engine") : "";
+  if (!engine[0]) {
+    return;
+  }
+  int n = snprintf(run_tts_voice, sizeof(run_tts_voice), "%s|%s|%s", engine,
+                   ha_json_string(data_obj, "language"),
+                   ha_json_string(data_obj, "voice"));
+  if (n < 0 || (size_t)n >= sizeof(run_tts_voice)) {
+    run_tts_voice[0] = '\0';
+  }
+}
+
 static void ha_clear_audio_ready(void) {
   stt_binary_handler_id = -1;
   if (ha_event_group)
@@ -317,6 +353,13 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
       oled_status_set_last_event("auth-bad");
     } else if (type && strcmp(type->valuestring, "event") == 0) {
       cJSON *event = cJSON_GetObjectItem(json, "event");
+      cJSON *run_id = cJSON_GetObjectItem(json, "id");
+      if (event && cJSON_IsNumber(run_id) &&
+          (int)run_id->valuedouble != last_run_message_id) {
+        // An earlier or abandoned run
+        ESP_LOGD(TAG, "Ignoring event of run %d", (int)run_id->valuedouble);
+        event = NULL;
+      }
       if (event) {
         cJSON *evt_type = cJSON_GetObjectItem(event, "type");
         cJSON *data_obj = cJSON_GetObjectItem(event, "data");
@@ -325,6 +368,8 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
           if (strcmp(evt_type->valuestring, "run-start") == 0) {
             timer_started_this_conversation = false;
             speech_text_sent_this_run = false;
+            run_conversation_id[0] = '\0';
+            run_tts_voice[0] = '\0';
             int hid = -1;
             if (data_obj && ha_find_stt_handler_id(data_obj, 6, &hid)) {
               ha_set_audio_ready(hid, "run-start");
@@ -351,20 +396,35 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
                     cJSON_GetObjectItemCaseSensitive((cJSON *)intent, "name");
               }
               intent_data = ha_extract_intent_json(data_obj);
+              const cJSON *output = intent_output
+                                        ? intent_output
+                                        : cJSON_GetObjectItemCaseSensitive(
+                                              (cJSON *)data_obj,
+                                              "intent_output");
+              const cJSON *conv_id =
+                  output ? cJSON_GetObjectItemCaseSensitive((cJSON *)output,
+                                                            "conversation_id")
+                         : NULL;
+              if (cJSON_IsString(conv_id) && conv_id->valuestring) {
+                snprintf(run_conversation_id, sizeof(run_conversation_id),
+                         "%s", conv_id->valuestring);
+              }
             }
+            const char *conv =
+                run_conversation_id[0] ? run_conversation_id : NULL;
 
             if (intent_name && cJSON_IsString(intent_name) &&
                 intent_name->valuestring && intent_callback) {
               if (ha_intent_name_is_timer(intent_name->valuestring)) {
                 timer_started_this_conversation = true;
               }
-              intent_callback(intent_name->valuestring, intent_data, NULL);
+              intent_callback(intent_name->valuestring, intent_data, conv);
             }
 
             const char *speech =
                 ha_extract_response_speech_plain_speech(data_obj);
             if (speech && conversation_callback) {
-              conversation_callback(speech, NULL);
+              conversation_callback(speech, conv);
               speech_text_sent_this_run = true;
             }
           } else if (strcmp(evt_type->valuestring, "stt-end") == 0) {
@@ -375,6 +435,8 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
             if (stt_text && stt_callback) {
               stt_callback(stt_text, NULL);
             }
+          } else if (strcmp(evt_type->valuestring, "tts-start") == 0) {
+            ha_read_tts_voice(data_obj);
           } else if (strcmp(evt_type->valuestring, "tts-end") == 0) {
             if (timer_started_this_conversation) {
               ESP_LOGI(TAG, "Skipping TTS (timer started)");
@@ -384,11 +446,24 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
                 cJSON *text = cJSON_GetObjectItem(tts_out, "text");
                 if (!speech_text_sent_this_run && text && text->valuestring &&
                     conversation_callback) {
-                  conversation_callback(text->valuestring, NULL);
+                  conversation_callback(text->valuestring,
+                                        run_conversation_id[0]
+                                            ? run_conversation_id
+                                            : NULL);
                 }
                 cJSON *url = cJSON_GetObjectItem(tts_out, "url");
                 if (url && url->valuestring) {
-                  download_tts_audio(url->valuestring);
+                  // Same text and voice, same audio; without a known voice
+                  // a cached answer could be in the wrong one
+                  bool cacheable = text && text->valuestring &&
+                                   text->valuestring[0] && run_tts_voice[0];
+                  uint64_t key = cacheable ? tts_cache_key(text->valuestring,
+                                                           run_tts_voice)
+                                           : 0;
+                  if (!cacheable || !play_cached_tts(key)) {
+                    download_tts_audio(url->valuestring,
+                                       cacheable ? &key : NULL);
+                  }
                 }
               }
             }
@@ -403,6 +478,9 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base,
               conversation_callback("", NULL);
             }
             ha_clear_audio_ready();
+            if (run_end_callback) {
+              run_end_callback();
+            }
           } else if (strcmp(evt_type->valuestring, "error") == 0) {
             const char *err_code = "error";
             const char *err_msg = "Pipeline Error";
@@ -471,10 +549,41 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
       evt->data_len > 0) {
     tts_audio_callback((const uint8_t *)evt->data, evt->data_len);
   }
+  if (evt->event_id == HTTP_EVENT_ON_DATA && evt->data_len > 0) {
+    tts_cache_append(tts_cache_writer, (const uint8_t *)evt->data,
+                     evt->data_len);
+  }
   return ESP_OK;
 }
 
-static void download_tts_audio(const char *url) {
+/**
+ * @brief Play an answer from the TTS cache instead of downloading it
+ *
+ * Feeds the player the same way the download does, in chunks, then ends
+ * the stream.
+ *
+ * @return true on a cache hit
+ */
+static bool play_cached_tts(uint64_t cache_key) {
+  const uint8_t *data;
+  size_t size;
+  if (!tts_cache_acquire(cache_key, &data, &size))
+    return false;
+  ESP_LOGI(TAG, "TTS from cache (%u bytes)", (unsigned)size);
+  if (tts_audio_callback) {
+    for (size_t off = 0; off < size; off += TTS_CACHE_FEED_CHUNK) {
+      size_t n = size - off;
+      if (n > TTS_CACHE_FEED_CHUNK)
+        n = TTS_CACHE_FEED_CHUNK;
+      tts_audio_callback(data + off, n);
+    }
+    tts_audio_callback(NULL, 0); // End
+  }
+  tts_cache_release(cache_key);
+  return true;
+}
+
+static void download_tts_audio(const char *url, const uint64_t *cache_key) {
   if (!url || !strlen(url))
     return;
 
@@ -504,8 +613,10 @@ static void download_tts_audio(const char *url) {
     return;
   }
 
+  tts_cache_writer = cache_key ? tts_cache_begin(*cache_key) : NULL;
   esp_err_t err = esp_http_client_perform(client);
-  if (err == ESP_OK && esp_http_client_get_status_code(client) == 200) {
+  bool ok = err == ESP_OK && esp_http_client_get_status_code(client) == 200;
+  if (ok) {
     if (tts_audio_callback)
       tts_audio_callback(NULL, 0); // End
   } else {
@@ -513,6 +624,8 @@ static void download_tts_audio(const char *url) {
     if (tts_audio_callback)
       tts_audio_callback(NULL, 0);
   }
+  tts_cache_commit(tts_cache_writer, ok);
+  tts_cache_writer = NULL;
   esp_http_client_cleanup(client);
 }
 
@@ -595,7 +708,9 @@ esp_err_t ha_client_request_tts(const char *text) {
   if (!ha_client_is_connected())
     return ESP_FAIL;
   cJSON *root = cJSON_CreateObject();
-  cJSON_AddNumberToObject(root, "id", message_id++);
+  last_run_message_id = message_id++; // Its events replace the current run's
+  run_tts_voice[0] = '\0';
+  cJSON_AddNumberToObject(root, "id", last_run_message_id);
   cJSON_AddStringToObject(root, "type", "assist_pipeline/run");
   cJSON_AddStringToObject(root, "start_stage", "intent");
   cJSON_AddStringToObject(root, "end_stage", "tts");
@@ -619,17 +734,63 @@ esp_err_t ha_client_request_tts(const char *text) {
   return ESP_OK;
 }
 
-char *ha_client_start_conversation(void) {
+esp_err_t ha_client_call_service(const char *service, const char *entity_id) {
+  if (!service)
+    return ESP_ERR_INVALID_ARG;
+  const char *dot = strchr(service, '.');
+  if (!dot || dot == service || !dot[1])
+    return ESP_ERR_INVALID_ARG;
+  if (!ha_client_is_connected())
+    return ESP_FAIL;
+
+  char domain[32];
+  snprintf(domain, sizeof(domain), "%.*s", (int)(dot - service), service);
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "id", message_id++);
+  cJSON_AddStringToObject(root, "type", "call_service");
+  cJSON_AddStringToObject(root, "domain", domain);
+  cJSON_AddStringToObject(root, "service", dot + 1);
+  if (entity_id && entity_id[0]) {
+    cJSON *target = cJSON_CreateObject();
+    cJSON_AddStringToObject(target, "entity_id", entity_id);
+    cJSON_AddItemToObject(root, "target", target);
+  }
+
+  char *str = cJSON_PrintUnformatted(root);
+  if (!str) {
+    cJSON_Delete(root);
+    return ESP_FAIL;
+  }
+  int ret = esp_websocket_client_send_text(ws_client, str, strlen(str),
+                                           pdMS_TO_TICKS(2000));
+  free(str);
+  cJSON_Delete(root);
+  if (ret < 0) {
+    (void)ha_client_request_reconnect("call_service send failed");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+char *ha_client_start_conversation(const char *pipeline_id,
+                                   const char *conversation_id) {
   if (!ha_client_is_connected())
     return NULL;
   ha_clear_audio_ready();
 
   cJSON *root = cJSON_CreateObject();
   last_run_message_id = message_id++;
+  run_tts_voice[0] = '\0';
   cJSON_AddNumberToObject(root, "id", last_run_message_id);
   cJSON_AddStringToObject(root, "type", "assist_pipeline/run");
   cJSON_AddStringToObject(root, "start_stage", "stt");
   cJSON_AddStringToObject(root, "end_stage", "tts");
+  if (pipeline_id && pipeline_id[0]) {
+    cJSON_AddStringToObject(root, "pipeline", pipeline_id);
+  }
+  if (conversation_id && conversation_id[0]) {
+    cJSON_AddStringToObject(root, "conversation_id", conversation_id);
+  }
   cJSON *input = cJSON_CreateObject();
   cJSON_AddNumberToObject(input, "sample_rate", 16000);
   cJSON_AddItemToObject(root, "input", input);
@@ -648,7 +809,7 @@ char *ha_client_start_conversation(void) {
     return NULL;
   }
 
-  char *hid = malloc(32);
+  char *hid = mem_track_malloc(MEM_MOD_PIPELINE, 32, 0);
   if (!hid) {
     ESP_LOGE(TAG, "Failed to allocate handler ID");
     return NULL;
@@ -664,7 +825,8 @@ esp_err_t ha_client_stream_audio(const uint8_t *audio_data, size_t length,
 
   size_t needed = 1 + length;
   if (!audio_frame_buf || audio_frame_buf_cap < needed) {
-    uint8_t *new_buf = realloc(audio_frame_buf, needed);
+    uint8_t *new_buf =
+        mem_track_realloc(MEM_MOD_HA_CLIENT, audio_frame_buf, needed, 0);
     if (!new_buf) {
       ESP_LOGE(TAG, "Failed to realloc audio buffer (OOM)");
       return ESP_ERR_NO_MEM;
@@ -685,6 +847,15 @@ esp_err_t ha_client_stream_audio(const uint8_t *audio_data, size_t length,
   return ESP_OK;
 }
 
+esp_err_t ha_client_abandon_run(void) {
+  esp_err_t ret = ESP_OK;
+  if (stt_binary_handler_id >= 0) {
+    ret = ha_client_end_audio_stream();
+  }
+  last_run_message_id = -1;
+  return ret;
+}
+
 esp_err_t ha_client_end_audio_stream(void) {
   if (!ha_client_is_connected() || stt_binary_handler_id < 0)
     return ESP_ERR_INVALID_STATE;
@@ -724,6 +895,11 @@ void ha_client_register_stt_callback(ha_stt_callback_t cb) {
   stt_callback = cb;
   portEXIT_CRITICAL(&callback_mux);
 }
+void ha_client_register_run_end_callback(ha_run_end_callback_t cb) {
+  portENTER_CRITICAL(&callback_mux);
+  run_end_callback = cb;
+  portEXIT_CRITICAL(&callback_mux);
+}
 
 void ha_client_stop(void) {
   if (ws_client) {
@@ -739,25 +915,24 @@ void ha_client_stop(void) {
 
   // Cleanup audio buffer to prevent memory leak on reinit
   if (audio_frame_buf) {
-    free(audio_frame_buf);
+    mem_track_free(MEM_MOD_HA_CLIENT, audio_frame_buf);
     audio_frame_buf = NULL;
     audio_frame_buf_cap = 0;
   }
 }
 
-static void ha_reconnect_task(void *arg) {
+static void ha_reconnect_job(void *arg) {
   char *reason = (char *)arg;
   if (reason && reason[0] != '\0') {
     ESP_LOGW(TAG, "Reconnecting to Home Assistant: %s", reason);
   } else {
     ESP_LOGW(TAG, "Reconnecting to Home Assistant");
   }
-  free(reason);
+  mem_track_free(MEM_MOD_HA_CLIENT, reason);
 
   (void)ha_client_init(&client_config);
 
-  reconnect_task_handle = NULL;
-  vTaskDelete(NULL);
+  reconnect_pending = false;
 }
 
 esp_err_t ha_client_ensure_connected(uint32_t timeout_ms) {
@@ -798,26 +973,24 @@ esp_err_t ha_client_ensure_connected(uint32_t timeout_ms) {
 }
 
 esp_err_t ha_client_request_reconnect(const char *reason) {
-  if (reconnect_task_handle != NULL)
+  if (reconnect_pending)
     return ESP_OK;
 
   char *reason_copy = NULL;
   if (reason) {
     size_t n = strlen(reason) + 1;
-    reason_copy = malloc(n);
+    reason_copy = mem_track_malloc(MEM_MOD_HA_CLIENT, n, 0);
     if (!reason_copy)
       return ESP_ERR_NO_MEM;
     memcpy(reason_copy, reason, n);
   }
 
-  TaskHandle_t task = NULL;
-  BaseType_t ok = xTaskCreate(ha_reconnect_task, "ha_reconnect", 6144,
-                              reason_copy, 4, &task);
-  if (ok != pdPASS) {
-    free(reason_copy);
-    return ESP_FAIL;
+  reconnect_pending = true;
+  esp_err_t err = task_arena_submit_job(ha_reconnect_job, reason_copy);
+  if (err != ESP_OK) {
+    mem_track_free(MEM_MOD_HA_CLIENT, reason_copy);
+    reconnect_pending = false;
+    return err;
   }
-
-  reconnect_task_handle = task;
   return ESP_OK;
 }
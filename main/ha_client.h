@@ -75,9 +75,14 @@ esp_err_t ha_client_send_text(const char *text);
  * Initiates a new conversation with HA Assist Pipeline.
  * After this, audio can be streamed.
  *
- * @return conversation_id (allocated string, caller must free)
+ * @param pipeline_id Assist pipeline to run, NULL or "" for the preferred one
+ * @param conversation_id Conversation to continue (from an earlier intent
+ *                        result), NULL or "" to start a new one
+ * @return Run handler id (allocated string, caller frees it with
+ *         mem_track_free(MEM_MOD_PIPELINE, ...))
  */
-char *ha_client_start_conversation(void);
+char *ha_client_start_conversation(const char *pipeline_id,
+                                   const char *conversation_id);
 
 /**
  * @brief Stream audio data to Home Assistant
@@ -97,6 +102,17 @@ esp_err_t ha_client_stream_audio(const uint8_t *audio_data, size_t length,
  */
 esp_err_t ha_client_end_audio_stream(void);
 
+/**
+ * @brief Give up on the current run
+ *
+ * Ends its audio stream if HA is still waiting for audio, and drops the
+ * events HA sends for it afterwards (STT errors for a run nobody spoke into
+ * must not reach the callbacks).
+ *
+ * @return ESP_OK, or the error of ending the audio stream
+ */
+esp_err_t ha_client_abandon_run(void);
+
 /**
  * @brief Request a Home Assistant reconnect (non-blocking).
  *
@@ -168,6 +184,11 @@ typedef void (*ha_intent_callback_t)(const char *intent_name,
 typedef void (*ha_stt_callback_t)(const char *text,
                                   const char *conversation_id);
 
+/**
+ * @brief Callback for the end of a pipeline run (after TTS was sent)
+ */
+typedef void (*ha_run_end_callback_t)(void);
+
 /**
  * @brief Register callback for conversation responses
  *
@@ -204,6 +225,13 @@ void ha_client_register_intent_callback(ha_intent_callback_t callback);
  */
 void ha_client_register_stt_callback(ha_stt_callback_t callback);
 
+/**
+ * @brief Register callback for the end of a run
+ *
+ * @param callback Function to call on HA's run-end event
+ */
+void ha_client_register_run_end_callback(ha_run_end_callback_t callback);
+
 /**
  * @brief Stop Home Assistant client and disconnect
  */
@@ -220,6 +248,17 @@ void ha_client_stop(void);
  */
 esp_err_t ha_client_request_tts(const char *text);
 
+/**
+ * @brief Call a Home Assistant service
+ *
+ * Sends a call_service request; the result is not waited for.
+ *
+ * @param service "domain.service" (e.g., "light.turn_on")
+ * @param entity_id Target entity, or NULL for none
+ * @return ESP_OK if the request was sent
+ */
+esp_err_t ha_client_call_service(const char *service, const char *entity_id);
+
 #ifdef __cplusplus
 }
 #endif
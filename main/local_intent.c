@@ -0,0 +1,719 @@
+/**
+ * @file local_intent.c
+ * @brief Local intent matching for common commands
+ *
+ * The grammar is parsed twice: the first pass validates it and counts
+ * rules, phrases and tokens, the second fills arrays sized from those
+ * counts. Nothing is reallocated and the matcher never allocates.
+ *
+ * Words are interned into an open-addressed FNV-1a table; their slot index
+ * is the token id (0 is the number token). The trie edges live in a second
+ * open-addressed table keyed by (node, token id), so a node costs the same
+ * whatever its fan-out.
+ */
+
+#include "local_intent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_MAX 32          // Longer words are truncated (both sides)
+#define PHRASE_MAX_TOKENS 12  // Per phrase
+#define LINE_MAX 256          // Per grammar line
+#define NUM_TOKEN 0           // Token id of any number
+#define VALUE_MAX 1000000     // Number slot values are clamped to this
+
+typedef enum { TOK_END = 0, TOK_WORD, TOK_NUM, TOK_SLOT } tok_kind_t;
+
+typedef struct {
+  tok_kind_t kind;
+  int len;
+  int value; // TOK_NUM
+  char text[TOKEN_MAX];
+} token_t;
+
+typedef struct {
+  local_intent_action_t action;
+  const char *service;
+  const char *target;
+} rule_t;
+
+typedef struct {
+  int rule;
+  int tokens;
+  int slot; // Index of the {n} token, -1 if none
+} phrase_t;
+
+typedef struct {
+  int parent;
+  int token;
+  int depth;
+  int fail;
+  int out;  // Phrase ending here, -1 if none
+  int dict; // Nearest node on the fail chain with an output, -1 if none
+} node_t;
+
+typedef struct {
+  int node; // -1: empty
+  int token;
+  int child;
+} edge_t;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t off; // Into words
+  uint16_t len; // 0: empty
+} word_slot_t;
+
+typedef struct {
+  int id;
+  int rule;
+} command_t;
+
+struct local_intent {
+  rule_t *rules;
+  int rule_count;
+  phrase_t *phrases;
+  int phrase_count;
+  command_t *commands;
+  int command_count;
+
+  node_t *nodes;
+  int node_count;
+  edge_t *edges;
+  uint32_t edge_mask;
+
+  word_slot_t *word_slots;
+  uint32_t word_mask;
+  char *words;
+  uint32_t words_used;
+
+  char *strings; // Service names and targets
+  uint32_t strings_used;
+};
+
+// Sizes found by the counting pass
+typedef struct {
+  int rules;
+  int phrases;
+  int commands;
+  int tokens;
+  uint32_t word_bytes;
+  uint32_t string_bytes;
+} sizes_t;
+
+static const char *const action_names[LOCAL_INTENT_ACTION_COUNT] = {
+    [LOCAL_INTENT_NONE] = "none",
+    [LOCAL_INTENT_MUSIC_PLAY] = "music.play",
+    [LOCAL_INTENT_MUSIC_STOP] = "music.stop",
+    [LOCAL_INTENT_MUSIC_PAUSE] = "music.pause",
+    [LOCAL_INTENT_MUSIC_NEXT] = "music.next",
+    [LOCAL_INTENT_MUSIC_PREVIOUS] = "music.previous",
+    [LOCAL_INTENT_VOLUME_UP] = "volume.up",
+    [LOCAL_INTENT_VOLUME_DOWN] = "volume.down",
+    [LOCAL_INTENT_VOLUME_SET] = "volume.set",
+    [LOCAL_INTENT_TIMER_CANCEL] = "timer.cancel",
+    [LOCAL_INTENT_ALARM_STOP] = "alarm.stop",
+    [LOCAL_INTENT_LED_ON] = "led.on",
+    [LOCAL_INTENT_LED_OFF] = "led.off",
+    [LOCAL_INTENT_SERVICE] = "service",
+};
+
+// MultiNet ids 0-5 keep the actions of the former hard-coded command table
+static const char default_grammar[] =
+    "music.play : pusti glazbu | pusti muziku | upali glazbu | play music"
+    " | #2\n"
+    "music.stop : zaustavi glazbu | ugasi glazbu | stop glazba"
+    " | stop music | #3\n"
+    "music.pause : pauziraj | pauza | pause music\n"
+    "music.next : sljedeca pjesma | iduca pjesma | preskoci pjesmu"
+    " | next song | #4\n"
+    "music.previous : prethodna pjesma | vrati pjesmu | previous song | #5\n"
+    "volume.up : pojacaj glasnocu | pojacaj zvuk | glasnije | volume up"
+    " | louder\n"
+    "volume.down : smanji glasnocu | smanji zvuk | stisaj | tise"
+    " | volume down | quieter\n"
+    "volume.set : glasnoca {n} | glasnocu na {n} | postavi glasnocu {n}"
+    " | volume {n} | set volume to {n}\n"
+    "timer.cancel : otkazi timer | ugasi timer | prekini timer"
+    " | cancel timer | stop timer\n"
+    "alarm.stop : ugasi alarm | iskljuci alarm | stop alarm\n"
+    "led.on : #0\n"
+    "led.off : #1\n";
+
+// --- Tokenizer ---------------------------------------------------------------
+
+// Croatian letters as UTF-8 pairs, folded to ASCII
+static const struct {
+  unsigned char lead;
+  unsigned char trail;
+  char ascii;
+} folds[] = {
+    {0xC4, 0x8C, 'c'}, {0xC4, 0x8D, 'c'}, // Č č
+    {0xC4, 0x86, 'c'}, {0xC4, 0x87, 'c'}, // Ć ć
+    {0xC4, 0x90, 'd'}, {0xC4, 0x91, 'd'}, // Đ đ
+    {0xC5, 0xA0, 's'}, {0xC5, 0xA1, 's'}, // Š š
+    {0xC5, 0xBD, 'z'}, {0xC5, 0xBE, 'z'}, // Ž ž
+};
+
+static bool is_word_byte(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static void token_put(token_t *t, char c) {
+  if (t->len < TOKEN_MAX - 1) {
+    t->text[t->len++] = c;
+  }
+}
+
+/**
+ * @brief Read the next normalised token from [p, end)
+ *
+ * @param grammar Recognise the "{n}" slot
+ * @return Position after the token
+ */
+static const char *next_token(const char *p, const char *end, bool grammar,
+                              token_t *t) {
+  t->kind = TOK_END;
+  t->len = 0;
+  while (p < end && !is_word_byte((unsigned char)*p)) {
+    if (grammar && end - p >= 3 && memcmp(p, "{n}", 3) == 0) {
+      t->kind = TOK_SLOT;
+      return p + 3;
+    }
+    p++;
+  }
+  if (p == end) {
+    return p;
+  }
+
+  bool digits = true;
+  while (p < end && is_word_byte((unsigned char)*p)) {
+    unsigned char c = (unsigned char)*p;
+    if (c < 0x80) {
+      if (c >= 'A' && c <= 'Z') {
+        c = (unsigned char)(c - 'A' + 'a');
+      }
+      digits = digits && c >= '0' && c <= '9';
+      token_put(t, (char)c);
+      p++;
+      continue;
+    }
+    digits = false;
+    bool folded = false;
+    if (end - p >= 2) {
+      for (size_t i = 0; i < sizeof(folds) / sizeof(folds[0]); i++) {
+        if (folds[i].lead == c && folds[i].trail == (unsigned char)p[1]) {
+          token_put(t, folds[i].ascii);
+          p += 2;
+          folded = true;
+          break;
+        }
+      }
+    }
+    if (!folded) {
+      // Other non-ASCII: keep the bytes, the word just has to match exactly
+      token_put(t, (char)c);
+      p++;
+    }
+  }
+  t->text[t->len] = '\0';
+
+  if (digits) {
+    t->kind = TOK_NUM;
+    t->value = 0;
+    for (int i = 0; i < t->len && t->value < VALUE_MAX; i++) {
+      t->value = t->value * 10 + (t->text[i] - '0');
+    }
+    if (t->value > VALUE_MAX) {
+      t->value = VALUE_MAX;
+    }
+  } else {
+    t->kind = TOK_WORD;
+  }
+  return p;
+}
+
+// --- Hash tables -------------------------------------------------------------
+
+static uint32_t fnv1a(const char *s, int len) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static uint32_t table_size(int entries) {
+  uint32_t size = 16;
+  while (size < (uint32_t)entries * 2) {
+    size <<= 1;
+  }
+  return size;
+}
+
+// Token id of a word, -1 if the grammar does not use it
+static int word_lookup(const local_intent_t *li, const char *s, int len) {
+  uint32_t h = fnv1a(s, len);
+  for (uint32_t i = h & li->word_mask;; i = (i + 1) & li->word_mask) {
+    const word_slot_t *w = &li->word_slots[i];
+    if (w->len == 0) {
+      return -1;
+    }
+    if (w->hash == h && w->len == len &&
+        memcmp(li->words + w->off, s, (size_t)len) == 0) {
+      return (int)i + 1;
+    }
+  }
+}
+
+static int word_intern(local_intent_t *li, const char *s, int len) {
+  uint32_t h = fnv1a(s, len);
+  uint32_t i = h & li->word_mask;
+  for (;; i = (i + 1) & li->word_mask) {
+    word_slot_t *w = &li->word_slots[i];
+    if (w->len == 0) {
+      break;
+    }
+    if (w->hash == h && w->len == len &&
+        memcmp(li->words + w->off, s, (size_t)len) == 0) {
+      return (int)i + 1;
+    }
+  }
+  word_slot_t *w = &li->word_slots[i];
+  memcpy(li->words + li->words_used, s, (size_t)len);
+  w->hash = h;
+  w->off = li->words_used;
+  w->len = (uint16_t)len;
+  li->words_used += (uint32_t)len;
+  return (int)i + 1;
+}
+
+static uint32_t edge_hash(int node, int token) {
+  return ((uint32_t)node * 0x9E3779B1u) ^ ((uint32_t)token * 0x85EBCA77u);
+}
+
+static int edge_get(const local_intent_t *li, int node, int token) {
+  for (uint32_t i = edge_hash(node, token) & li->edge_mask;;
+       i = (i + 1) & li->edge_mask) {
+    const edge_t *e = &li->edges[i];
+    if (e->node < 0) {
+      return -1;
+    }
+    if (e->node == node && e->token == token) {
+      return e->child;
+    }
+  }
+}
+
+static int edge_add(local_intent_t *li, int node, int token) {
+  uint32_t i = edge_hash(node, token) & li->edge_mask;
+  for (;; i = (i + 1) & li->edge_mask) {
+    edge_t *e = &li->edges[i];
+    if (e->node < 0) {
+      break;
+    }
+    if (e->node == node && e->token == token) {
+      return e->child;
+    }
+  }
+  int child = li->node_count++;
+  li->edges[i] = (edge_t){.node = node, .token = token, .child = child};
+  li->nodes[child] = (node_t){.parent = node,
+                              .token = token,
+                              .depth = li->nodes[node].depth + 1,
+                              .fail = 0,
+                              .out = -1,
+                              .dict = -1};
+  return child;
+}
+
+// --- Grammar -----------------------------------------------------------------
+
+static const char *trim_start(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+static const char *trim_end(const char *p, const char *end) {
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+    end--;
+  }
+  return end;
+}
+
+// Next whitespace-separated word of [*p, end), NULL if none
+static const char *next_word(const char **p, const char *end, int *len) {
+  const char *s = trim_start(*p, end);
+  const char *e = s;
+  while (e < end && *e != ' ' && *e != '\t') {
+    e++;
+  }
+  *p = e;
+  *len = (int)(e - s);
+  return *len > 0 ? s : NULL;
+}
+
+static char *store_string(local_intent_t *li, const char *s, int len) {
+  char *dst = li->strings + li->strings_used;
+  memcpy(dst, s, (size_t)len);
+  dst[len] = '\0';
+  li->strings_used += (uint32_t)len + 1;
+  return dst;
+}
+
+static void set_error(char *err, size_t err_len, int line, const char *msg) {
+  if (err && err_len) {
+    snprintf(err, err_len, "line %d: %s", line, msg);
+  }
+}
+
+static bool parse_action(const char *s, int len, local_intent_action_t *out) {
+  for (int a = LOCAL_INTENT_NONE + 1; a < LOCAL_INTENT_ACTION_COUNT; a++) {
+    if ((int)strlen(action_names[a]) == len &&
+        memcmp(action_names[a], s, (size_t)len) == 0) {
+      *out = (local_intent_action_t)a;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Add one phrase to the trie (li != NULL) or just validate it
+ */
+static const char *add_phrase(local_intent_t *li, sizes_t *sz, int rule,
+                              const char *p, const char *end) {
+  token_t t;
+  int tokens = 0;
+  int slot = -1;
+  int node = 0;
+  while ((p = next_token(p, end, true, &t)), t.kind != TOK_END) {
+    if (t.kind == TOK_NUM) {
+      return "numbers in phrases must be written as {n}";
+    }
+    if (t.kind == TOK_SLOT) {
+      if (slot >= 0) {
+        return "only one {n} per phrase";
+      }
+      slot = tokens;
+    }
+    if (++tokens > PHRASE_MAX_TOKENS) {
+      return "phrase too long";
+    }
+    if (!li) {
+      sz->word_bytes += (uint32_t)t.len;
+      continue;
+    }
+    int id = t.kind == TOK_SLOT ? NUM_TOKEN : word_intern(li, t.text, t.len);
+    node = edge_add(li, node, id);
+  }
+  if (tokens == 0) {
+    return "empty phrase";
+  }
+  if (!li) {
+    sz->phrases++;
+    sz->tokens += tokens;
+    return NULL;
+  }
+
+  int index = li->phrase_count++;
+  li->phrases[index] = (phrase_t){.rule = rule, .tokens = tokens, .slot = slot};
+  if (li->nodes[node].out < 0) {
+    li->nodes[node].out = index; // The same phrase twice: first rule wins
+  }
+  return NULL;
+}
+
+/**
+ * @brief Parse one rule line
+ *
+ * @return NULL on success, otherwise the error message
+ */
+static const char *parse_line(local_intent_t *li, sizes_t *sz, const char *p,
+                              const char *end) {
+  const char *colon = memchr(p, ':', (size_t)(end - p));
+  if (!colon) {
+    return "missing ':'";
+  }
+
+  const char *lp = p;
+  int len;
+  const char *name = next_word(&lp, colon, &len);
+  local_intent_action_t action;
+  if (!name || !parse_action(name, len, &action)) {
+    return "unknown action";
+  }
+  int service_len = 0;
+  int target_len = 0;
+  const char *service = next_word(&lp, colon, &service_len);
+  const char *target = next_word(&lp, colon, &target_len);
+  int extra_len;
+  if (next_word(&lp, colon, &extra_len)) {
+    return "too many arguments";
+  }
+  if (action == LOCAL_INTENT_SERVICE) {
+    if (!service || !memchr(service, '.', (size_t)service_len)) {
+      return "service needs domain.service";
+    }
+  } else if (service) {
+    return "action takes no arguments";
+  }
+
+  int rule = li ? li->rule_count : sz->rules;
+  if (li) {
+    rule_t *r = &li->rules[li->rule_count++];
+    r->action = action;
+    r->service = service ? store_string(li, service, service_len) : NULL;
+    r->target = target ? store_string(li, target, target_len) : NULL;
+  } else {
+    sz->rules++;
+    sz->string_bytes += service ? (uint32_t)service_len + 1 : 0;
+    sz->string_bytes += target ? (uint32_t)target_len + 1 : 0;
+  }
+
+  const char *alt = colon + 1;
+  while (alt <= end) {
+    const char *bar = memchr(alt, '|', (size_t)(end - alt));
+    const char *alt_end = bar ? bar : end;
+    const char *s = trim_start(alt, alt_end);
+    const char *e = trim_end(s, alt_end);
+
+    if (s < e && *s == '#') {
+      char *num_end;
+      long id = strtol(s + 1, &num_end, 10);
+      if (num_end == s + 1 || trim_start(num_end, e) != e || id < 0) {
+        return "bad command id";
+      }
+      if (li) {
+        li->commands[li->command_count++] =
+            (command_t){.id = (int)id, .rule = rule};
+      } else {
+        sz->commands++;
+      }
+    } else {
+      const char *msg = add_phrase(li, sz, rule, s, e);
+      if (msg) {
+        return msg;
+      }
+    }
+    if (!bar) {
+      break;
+    }
+    alt = bar + 1;
+  }
+  return NULL;
+}
+
+static bool parse_grammar(local_intent_t *li, sizes_t *sz, const char *grammar,
+                          char *err, size_t err_len) {
+  int line = 0;
+  const char *p = grammar;
+  while (*p) {
+    const char *eol = strchr(p, '\n');
+    if (!eol) {
+      eol = p + strlen(p);
+    }
+    line++;
+    const char *s = trim_start(p, eol);
+    const char *e = trim_end(s, eol);
+    if (s < e && *s != '#') {
+      const char *msg =
+          e - s >= LINE_MAX ? "line too long" : parse_line(li, sz, s, e);
+      if (msg) {
+        set_error(err, err_len, line, msg);
+        return false;
+      }
+    }
+    p = *eol ? eol + 1 : eol;
+  }
+  return true;
+}
+
+// Fail and dictionary links, shallow nodes first
+static void build_links(local_intent_t *li) {
+  for (int depth = 1; depth <= PHRASE_MAX_TOKENS; depth++) {
+    for (int n = 1; n < li->node_count; n++) {
+      node_t *node = &li->nodes[n];
+      if (node->depth != depth) {
+        continue;
+      }
+      int fail = 0;
+      if (node->parent != 0) {
+        int f = li->nodes[node->parent].fail;
+        int child;
+        while ((child = edge_get(li, f, node->token)) < 0 && f != 0) {
+          f = li->nodes[f].fail;
+        }
+        fail = child >= 0 ? child : 0;
+      }
+      node->fail = fail;
+      node->dict = li->nodes[fail].out >= 0 ? fail : li->nodes[fail].dict;
+    }
+  }
+}
+
+// --- Public API --------------------------------------------------------------
+
+local_intent_t *local_intent_compile(const char *grammar, char *err,
+                                     size_t err_len) {
+  if (err && err_len) {
+    err[0] = '\0';
+  }
+  if (!grammar) {
+    return NULL;
+  }
+
+  sizes_t sz = {0};
+  if (!parse_grammar(NULL, &sz, grammar, err, err_len)) {
+    return NULL;
+  }
+
+  local_intent_t *li = calloc(1, sizeof(*li));
+  if (!li) {
+    return NULL;
+  }
+  li->edge_mask = table_size(sz.tokens) - 1;
+  li->word_mask = table_size(sz.tokens) - 1;
+  li->rules = calloc((size_t)sz.rules + 1, sizeof(rule_t));
+  li->phrases = calloc((size_t)sz.phrases + 1, sizeof(phrase_t));
+  li->commands = calloc((size_t)sz.commands + 1, sizeof(command_t));
+  li->nodes = calloc((size_t)sz.tokens + 1, sizeof(node_t));
+  li->edges = malloc((li->edge_mask + 1) * sizeof(edge_t));
+  li->word_slots = calloc(li->word_mask + 1, sizeof(word_slot_t));
+  li->words = malloc(sz.word_bytes + 1);
+  li->strings = malloc(sz.string_bytes + 1);
+  if (!li->rules || !li->phrases || !li->commands || !li->nodes ||
+      !li->edges || !li->word_slots || !li->words || !li->strings) {
+    local_intent_free(li);
+    if (err && err_len) {
+      snprintf(err, err_len, "out of memory");
+    }
+    return NULL;
+  }
+  for (uint32_t i = 0; i <= li->edge_mask; i++) {
+    li->edges[i].node = -1;
+  }
+  li->nodes[0] = (node_t){.out = -1, .dict = -1};
+  li->node_count = 1;
+
+  parse_grammar(li, &sz, grammar, NULL, 0); // Validated by the first pass
+  build_links(li);
+  return li;
+}
+
+void local_intent_free(local_intent_t *li) {
+  if (!li) {
+    return;
+  }
+  free(li->rules);
+  free(li->phrases);
+  free(li->commands);
+  free(li->nodes);
+  free(li->edges);
+  free(li->word_slots);
+  free(li->words);
+  free(li->strings);
+  free(li);
+}
+
+static void fill_match(const local_intent_t *li, int rule, int value,
+                       int tokens, local_intent_match_t *out) {
+  const rule_t *r = &li->rules[rule];
+  out->action = r->action;
+  out->rule = rule;
+  out->value = value;
+  out->tokens = tokens;
+  out->service = r->service;
+  out->target = r->target;
+}
+
+bool local_intent_match_text(const local_intent_t *li, const char *text,
+                             local_intent_match_t *out) {
+  if (!li || !text || !out) {
+    return false;
+  }
+
+  // Number values of the last tokens, for the {n} slot of a match
+  int values[PHRASE_MAX_TOKENS];
+  int best = -1;
+  int best_value = -1;
+  int node = 0;
+  int pos = 0;
+  const char *p = text;
+  const char *end = text + strlen(text);
+  token_t t;
+
+  while ((p = next_token(p, end, false, &t)), t.kind != TOK_END) {
+    int id = t.kind == TOK_NUM ? NUM_TOKEN : word_lookup(li, t.text, t.len);
+    values[pos % PHRASE_MAX_TOKENS] = t.kind == TOK_NUM ? t.value : -1;
+
+    if (id < 0) {
+      node = 0; // Word not in the grammar: no phrase continues through it
+    } else {
+      int child;
+      while ((child = edge_get(li, node, id)) < 0 && node != 0) {
+        node = li->nodes[node].fail;
+      }
+      node = child >= 0 ? child : 0;
+    }
+
+    // The node's own output is the longest phrase ending here
+    int hit = li->nodes[node].out >= 0 ? node : li->nodes[node].dict;
+    if (hit >= 0) {
+      int index = li->nodes[hit].out;
+      const phrase_t *ph = &li->phrases[index];
+      if (best < 0 || ph->tokens > li->phrases[best].tokens ||
+          (ph->tokens == li->phrases[best].tokens &&
+           ph->rule < li->phrases[best].rule)) {
+        best = index;
+        best_value =
+            ph->slot >= 0
+                ? values[(pos - ph->tokens + 1 + ph->slot) % PHRASE_MAX_TOKENS]
+                : -1;
+      }
+    }
+    pos++;
+  }
+
+  if (best < 0) {
+    return false;
+  }
+  fill_match(li, li->phrases[best].rule, best_value, li->phrases[best].tokens,
+             out);
+  return true;
+}
+
+bool local_intent_match_command(const local_intent_t *li, int command_id,
+                                local_intent_match_t *out) {
+  if (!li || !out) {
+    return false;
+  }
+  for (int i = 0; i < li->command_count; i++) {
+    if (li->commands[i].id == command_id) {
+      fill_match(li, li->commands[i].rule, -1, 0, out);
+      return true;
+    }
+  }
+  return false;
+}
+
+void local_intent_get_size(const local_intent_t *li, int *rules,
+                           int *phrases) {
+  if (rules) {
+    *rules = li ? li->rule_count : 0;
+  }
+  if (phrases) {
+    *phrases = li ? li->phrase_count : 0;
+  }
+}
+
+const char *local_intent_action_name(local_intent_action_t action) {
+  return action < LOCAL_INTENT_ACTION_COUNT ? action_names[action] : "?";
+}
+
+const char *local_intent_default_grammar(void) { return default_grammar; }
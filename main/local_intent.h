@@ -0,0 +1,112 @@
+/**
+ * @file local_intent.h
+ * @brief Local intent matching for common commands
+ *
+ * A small grammar maps phrases (STT text) and MultiNet command ids to
+ * actions, so frequent commands run on the device right after STT instead
+ * of waiting for the HA intent and TTS.
+ *
+ * Grammar, one rule per line:
+ *
+ *     # comment
+ *     music.play : pusti glazbu | pusti muziku | #2
+ *     volume.set : glasnoca {n} | stavi glasnocu na {n}
+ *     service light.turn_on light.dnevni_boravak : upali svjetlo
+ *
+ * Left of ':' is the action and its arguments; right of it are
+ * alternatives separated by '|'. "{n}" matches a number and passes it to
+ * the action; "#<id>" binds a MultiNet command id. Phrases are normalised
+ * the same way as STT text: lower case, Croatian diacritics folded
+ * (č/ć -> c, š -> s, ž -> z, đ -> d), punctuation removed.
+ *
+ * Phrases are compiled into an Aho-Corasick automaton over token ids, so
+ * matching is linear in the utterance length whatever the grammar size.
+ * When several phrases occur in the text, the longest wins (then the
+ * earliest rule).
+ *
+ * The module only depends on the C library.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  LOCAL_INTENT_NONE = 0,
+  LOCAL_INTENT_MUSIC_PLAY,
+  LOCAL_INTENT_MUSIC_STOP,
+  LOCAL_INTENT_MUSIC_PAUSE,
+  LOCAL_INTENT_MUSIC_NEXT,
+  LOCAL_INTENT_MUSIC_PREVIOUS,
+  LOCAL_INTENT_VOLUME_UP,
+  LOCAL_INTENT_VOLUME_DOWN,
+  LOCAL_INTENT_VOLUME_SET, ///< value: 0-100
+  LOCAL_INTENT_TIMER_CANCEL,
+  LOCAL_INTENT_ALARM_STOP,
+  LOCAL_INTENT_LED_ON,
+  LOCAL_INTENT_LED_OFF,
+  LOCAL_INTENT_SERVICE, ///< HA call_service: service + target
+  LOCAL_INTENT_ACTION_COUNT
+} local_intent_action_t;
+
+typedef struct local_intent local_intent_t;
+
+typedef struct {
+  local_intent_action_t action;
+  int rule;          ///< Rule index (line order, comments excluded)
+  int value;         ///< Number slot value, -1 if the phrase has none
+  int tokens;        ///< Phrase length in tokens (0 for a command id)
+  const char *service; ///< "domain.service" (LOCAL_INTENT_SERVICE)
+  const char *target;  ///< entity_id (LOCAL_INTENT_SERVICE)
+} local_intent_match_t;
+
+/**
+ * @brief Compile a grammar
+ *
+ * @param grammar Grammar text (not referenced after the call)
+ * @param err Optional buffer for the first error ("line 3: ...")
+ * @param err_len Size of err
+ * @return Compiled grammar, or NULL on a syntax error or out of memory
+ */
+local_intent_t *local_intent_compile(const char *grammar, char *err,
+                                     size_t err_len);
+
+void local_intent_free(local_intent_t *li);
+
+/**
+ * @brief Find the best rule for an utterance
+ *
+ * @return true if a phrase matched
+ */
+bool local_intent_match_text(const local_intent_t *li, const char *text,
+                             local_intent_match_t *out);
+
+/**
+ * @brief Find the rule bound to a MultiNet command id
+ *
+ * @return true if a rule binds the id
+ */
+bool local_intent_match_command(const local_intent_t *li, int command_id,
+                                local_intent_match_t *out);
+
+/**
+ * @brief Number of rules and phrases compiled
+ */
+void local_intent_get_size(const local_intent_t *li, int *rules, int *phrases);
+
+const char *local_intent_action_name(local_intent_action_t action);
+
+/**
+ * @brief Built-in grammar (Croatian and English)
+ */
+const char *local_intent_default_grammar(void);
+
+#ifdef __cplusplus
+}
+#endif
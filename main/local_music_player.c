@@ -1,112 +1,957 @@
 /**
  * @file local_music_player.c
  * @brief Local music player implementation
+ *
+ * Tracks are decoded by a dedicated playback task through the decoder
+ * registry (MP3, WAV, FLAC; chosen by header sniffing) and written straight
+ * to I2S. The codec is configured from the native rate/channels the decoder
+ * reports when a track is opened, and only when that format changes.
+ *
+ * During the last seconds of the current track a low-priority prefetch task
+ * opens the next track and decodes its first blocks into PSRAM, so the
+ * handover is a stream swap: no fopen, no decoder warm-up and no codec
+ * reconfiguration when both tracks share a format.
+ *
+ * Track order comes from music_queue (library order or a shuffled
+ * permutation, plus tracks queued by the user). The playback position is
+ * persisted write-behind: the playback task only updates a RAM copy and arms
+ * a one-shot timer; when it expires the timer wakes the prefetch task, which
+ * writes it to NVS, so at most every RESUME_SAVE_INTERVAL_MS and never on the
+ * timer service task. Pause, stop and deinit flush it immediately.
+ * play() resumes from that position through the decoder's seek table instead
+ * of restarting the library.
+ *
+ * TTS does not pause the music: the music is ducked by a ramped software
+ * gain and the TTS PCM, converted by the TTS player to the music's rate and
+ * channel count, arrives through a stream buffer and is mixed on top before
+ * the I2S write. The codec keeps its configuration throughout.
+ *
+ * Every track opened from the card is also handed to music_cache, which
+ * copies it into PSRAM in the background. When the card has to be released
+ * for the Wi-Fi fallback the player switches to cache mode: track indices
+ * then refer to the cached entries, playback continues from PSRAM where it
+ * was, and the position is not persisted (the saved library position stays
+ * valid for when the card returns).
  */
 
 #include "local_music_player.h"
-#include "audio_player.h"
 #include "bsp/esp32_p4_function_ev_board.h"
 #include "bsp_board_extra.h"
 #include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "file_iterator.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "audio_mix.h"
+#include "audio_rt_monitor.h"
+#include "freertos/stream_buffer.h"
+#include "music_cache.h"
+#include "music_decoder.h"
+#include "music_library.h"
+#include "music_queue.h"
+#include "esp_random.h"
+#include "freertos/timers.h"
+#include "nvs.h"
+#include "sd_stream.h"
+#include "task_arena.h"
 #include <stdlib.h>
 #include <string.h>
 
-
 static const char *TAG = "local_music";
 
-// External function from BSP to reconfigure codec sample rate
-extern esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg,
-                                        i2s_slot_mode_t ch);
-
 #define MUSIC_DIR "/sdcard/music"
 
+#define MUSIC_TASK_PRIORITY 5
+#define PREFETCH_TASK_PRIORITY 3
+#define MUSIC_CMD_QUEUE_SIZE 8
+#define MUSIC_CMD_ACK_TIMEOUT_MS 2000
+// End of a track: whether the play order starts over (prefetch follows it)
+#define END_OF_TRACK_WRAP false
+
+// Start preparing the next track this long before the current one ends
+#define PREFETCH_LEAD_MS 5000
+// Decoded head of the next track kept in PSRAM (~0.4 s of 44.1 kHz stereo)
+#define PREFETCH_BLOCKS 16
+// Audio the I2S DMA still holds when we stop feeding it
+// (I2S_CHANNEL_DEFAULT_CONFIG: 6 descriptors x 240 frames)
+#define I2S_DMA_FRAMES (6 * 240)
+
+// TTS PCM waiting to be mixed (~170 ms of 48 kHz stereo); frame multiple
+#define MIX_BUFFER_BYTES (32 * 1024)
+// Time the music gain takes to reach the duck level and back
+#define DUCK_RAMP_MS 10
+#define DUCK_LEVEL_DEFAULT 20 // Percent of the music level kept under TTS
+// Longest mix_end() waits for queued TTS to be played
+#define MIX_DRAIN_TIMEOUT_MS 2000
+
+#define RESUME_NVS_NAMESPACE "music"
+#define RESUME_NVS_KEY "resume"
+#define RESUME_VERSION 1
+// Longest the persisted position lags behind playback
+#define RESUME_SAVE_INTERVAL_MS 30000
+
+/**
+ * @brief Persisted play order and position (NVS blob)
+ */
+typedef struct {
+  uint8_t version;
+  uint8_t shuffle;
+  uint16_t reserved;
+  uint32_t seed;        // Shuffle seed, the order is rebuilt from it
+  int32_t first_track;  // Track placed first by the shuffle
+  int32_t track;        // -1: start from the beginning of the order
+  int32_t track_count;  // Library size the state belongs to
+  uint32_t file_size;   // Of track, to detect a changed library
+  uint64_t sample;      // Per-channel sample position within track
+} music_resume_t;
+
+typedef struct {
+  FILE *fp;
+  music_decoder_t dec;
+  int track;
+  uint32_t duration_ms;     // From the library index (0 if unknown)
+  uint32_t file_size;
+  uint32_t sample_rate;     // Native format reported by the decoder
+  int channels;
+  uint64_t samples_out;     // Per-channel samples handed to I2S
+  uint64_t samples_decoded; // Per-channel samples produced by the decoder
+  int64_t decode_us;        // Time spent in the decoder
+  int16_t *head_pcm;        // Prefetched decoded head (PSRAM)
+  size_t head_samples;      // Interleaved samples in head_pcm
+  size_t head_pos;
+} music_stream_t;
+
+typedef enum {
+  MUSIC_TASK_CMD_PLAY = 0,
+  MUSIC_TASK_CMD_STOP,
+  MUSIC_TASK_CMD_PAUSE,
+  MUSIC_TASK_CMD_RESUME,
+} music_task_cmd_type_t;
+
+typedef struct {
+  music_task_cmd_type_t type;
+  int track;
+  uint64_t sample; // PLAY: position to start at
+  bool ack;
+} music_task_cmd_t;
+
+typedef enum {
+  PREFETCH_EMPTY = 0,
+  PREFETCH_LOADING,
+  PREFETCH_READY,
+} prefetch_state_t;
+
 // Player state
 static bool player_initialized = false;
 static music_state_t player_state = MUSIC_STATE_IDLE;
-static file_iterator_instance_t *file_iterator = NULL;
 static int current_track_index = -1;
 static int total_tracks = 0;
+static volatile bool cache_mode = false; // Tracks are music_cache entries
 static music_event_callback_t event_callback = NULL;
-static bool manual_stop = false; // Flag to prevent auto-play after manual stop
 
-static void free_file_iterator_instance(file_iterator_instance_t **instance) {
-  if (instance == NULL || *instance == NULL) {
+// Playback task (owns cur_stream)
+static QueueHandle_t cmd_queue = NULL;
+static SemaphoreHandle_t cmd_ack = NULL;
+static TaskHandle_t music_task_handle = NULL;
+static music_stream_t cur_stream = {.track = -1};
+
+// Prefetch task (next_stream guarded by prefetch_mutex)
+static TaskHandle_t prefetch_task_handle = NULL;
+static SemaphoreHandle_t prefetch_mutex = NULL;
+static music_stream_t next_stream = {.track = -1};
+static prefetch_state_t prefetch_state = PREFETCH_EMPTY;
+static int prefetch_track = -1;
+
+static music_playback_stats_t stats;
+
+// Ducking and TTS mixing (gain and DSP counters owned by the playback task;
+// the output format and mix state guarded by mix_mux)
+static StreamBufferHandle_t mix_buffer = NULL;
+static portMUX_TYPE mix_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool mix_active = false;
+static uint32_t out_rate = 0; // Format the codec plays music at, 0 if none
+static int out_channels = 0;
+static uint32_t mix_rate = 0; // Format the active mix was started with
+static int mix_channels = 0;
+static volatile uint32_t duck_gain = AUDIO_GAIN_UNITY; // Requested, Q15
+static uint8_t duck_level = DUCK_LEVEL_DEFAULT;
+static int64_t mix_dsp_us = 0;
+static uint64_t mix_samples = 0; // Per-channel samples processed while mixing
+
+// Resume state (guarded by resume_mux, written to NVS by the prefetch task
+// when resume_timer expires)
+static portMUX_TYPE resume_mux = portMUX_INITIALIZER_UNLOCKED;
+static music_resume_t resume = {.version = RESUME_VERSION, .track = -1};
+static bool resume_dirty = false;
+static volatile bool resume_save_due = false;
+static TimerHandle_t resume_timer = NULL;
+
+static void notify_state(void) {
+  if (event_callback) {
+    event_callback(player_state, current_track_index, total_tracks);
+  }
+}
+
+/* ---------- Resume state ---------- */
+
+static void resume_save(void) {
+  if (cache_mode) {
+    return; // Cache indices mean nothing to the library
+  }
+  portENTER_CRITICAL(&resume_mux);
+  music_resume_t copy = resume;
+  resume_dirty = false;
+  portEXIT_CRITICAL(&resume_mux);
+
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(RESUME_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Cannot open NVS for resume state: %s", esp_err_to_name(err));
     return;
   }
+  err = nvs_set_blob(handle, RESUME_NVS_KEY, &copy, sizeof(copy));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to save resume state: %s", esp_err_to_name(err));
+  }
+}
+
+static void resume_timer_callback(TimerHandle_t timer) {
+  (void)timer;
+  resume_save_due = true;
+  if (prefetch_task_handle) {
+    xTaskNotifyGive(prefetch_task_handle);
+  }
+}
+
+/**
+ * @brief Flush a pending resume update to NVS now
+ */
+static void resume_flush(void) {
+  if (resume_timer) {
+    xTimerStop(resume_timer, 0);
+  }
+  if (resume_dirty) {
+    resume_save();
+  }
+}
+
+/**
+ * @brief Record the playback position (RAM only; the timer persists it)
+ */
+static void resume_set_position(int track, uint64_t sample) {
+  portENTER_CRITICAL(&resume_mux);
+  bool arm = !resume_dirty;
+  resume.track = track;
+  resume.sample = sample;
+  resume_dirty = true;
+  portEXIT_CRITICAL(&resume_mux);
+
+  if (arm && resume_timer && !cache_mode) {
+    xTimerStart(resume_timer, 0);
+  }
+}
 
-  file_iterator_instance_t *it = *instance;
+/**
+ * @brief Record a new track (write-behind)
+ *
+ * @param file_size Size of the track file, checked when the state is loaded
+ */
+static void resume_set_track(int track, uint32_t file_size, uint64_t sample) {
+  portENTER_CRITICAL(&resume_mux);
+  resume.track_count = total_tracks;
+  resume.file_size = file_size;
+  portEXIT_CRITICAL(&resume_mux);
+  resume_set_position(track, sample);
+}
+
+/**
+ * @brief Record the current shuffle order and persist it at once
+ */
+static void resume_set_order(void) {
+  portENTER_CRITICAL(&resume_mux);
+  resume.shuffle = music_queue_get_shuffle();
+  resume.seed = music_queue_get_seed();
+  resume.first_track = music_queue_get_first();
+  resume_dirty = true;
+  portEXIT_CRITICAL(&resume_mux);
+  resume_flush();
+}
 
-  if (it->list) {
-    for (size_t i = 0; i < it->count; i++) {
-      free(it->list[i]);
+/**
+ * @brief Load the persisted state and restore the play order from it
+ */
+static void resume_load(void) {
+  music_resume_t loaded = {0};
+  size_t size = sizeof(loaded);
+  nvs_handle_t handle;
+  bool valid = false;
+
+  if (nvs_open(RESUME_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    valid = nvs_get_blob(handle, RESUME_NVS_KEY, &loaded, &size) == ESP_OK &&
+            size == sizeof(loaded) && loaded.version == RESUME_VERSION &&
+            loaded.track_count == total_tracks;
+    nvs_close(handle);
+  }
+
+  if (valid && loaded.shuffle) {
+    music_queue_set_shuffle(true, loaded.seed, loaded.first_track);
+  }
+  if (valid && loaded.track >= 0) {
+    music_track_info_t info;
+    if (loaded.track >= total_tracks ||
+        music_library_get_info(loaded.track, &info) != ESP_OK ||
+        info.file_size != loaded.file_size) {
+      loaded.track = -1; // Library changed under the saved position
+      loaded.sample = 0;
     }
-    free(it->list);
   }
+  if (!valid) {
+    loaded = (music_resume_t){.version = RESUME_VERSION, .track = -1};
+  }
+
+  portENTER_CRITICAL(&resume_mux);
+  resume = loaded;
+  resume.track_count = total_tracks;
+  resume_dirty = false;
+  portEXIT_CRITICAL(&resume_mux);
+
+  if (resume.track >= 0) {
+    music_queue_jump_to_track(resume.track);
+    ESP_LOGI(TAG, "Resume position: track %d at sample %llu%s",
+             (int)resume.track + 1, (unsigned long long)resume.sample,
+             resume.shuffle ? " (shuffled)" : "");
+  }
+}
+
+/* ---------- Tracks ---------- */
 
-  if (it->directory_path) {
-    free((void *)it->directory_path);
+/**
+ * @brief Path and metadata of a track in the current source
+ */
+static esp_err_t track_lookup(int track, char *path, music_track_info_t *info) {
+  if (cache_mode) {
+    return music_cache_get_entry(track, path, NULL, info);
+  }
+  esp_err_t ret = music_library_get_path(track, path, MUSIC_LIBRARY_PATH_MAX);
+  if (ret == ESP_OK && music_library_get_info(track, info) != ESP_OK) {
+    memset(info, 0, sizeof(*info));
   }
+  return ret;
+}
 
-  free(it);
-  *instance = NULL;
+/**
+ * @brief Index of the track stored under path, or -1
+ */
+static int track_find(const char *path) {
+  char candidate[MUSIC_LIBRARY_PATH_MAX];
+  music_track_info_t info;
+  for (int i = 0; i < total_tracks; i++) {
+    if (track_lookup(i, candidate, &info) == ESP_OK &&
+        strcmp(candidate, path) == 0) {
+      return i;
+    }
+  }
+  return -1;
 }
 
 /**
- * @brief Audio player callback from BSP
+ * @brief Current playback position from the RAM resume state
  */
-static void audio_player_callback(audio_player_cb_ctx_t *ctx) {
-  ESP_LOGI(TAG, "Audio player event: %d", ctx->audio_event);
+static void current_position(int *track, uint64_t *sample) {
+  portENTER_CRITICAL(&resume_mux);
+  *track = resume.track;
+  *sample = resume.sample;
+  portEXIT_CRITICAL(&resume_mux);
+}
 
-  switch (ctx->audio_event) {
-  case AUDIO_PLAYER_CALLBACK_EVENT_IDLE:
-  case AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT:
-    // Track finished - only auto-play next if not manually stopped
-    if (manual_stop) {
-      ESP_LOGI(TAG, "Track stopped manually - staying stopped");
-      manual_stop = false; // Reset flag
-    } else {
-      // Check if this was the last track
-      if (current_track_index == total_tracks - 1) {
-        ESP_LOGI(TAG, "Last track finished - stopping playback");
-        player_state = MUSIC_STATE_STOPPED;
-        if (event_callback) {
-          event_callback(player_state, current_track_index, total_tracks);
-        }
-      } else {
-        ESP_LOGI(TAG, "Track finished, playing next...");
-        local_music_player_next();
+/* ---------- Streams ---------- */
+
+static void stream_close(music_stream_t *s) {
+  if (s->decode_us > 0 && s->sample_rate > 0) {
+    uint32_t audio_ms =
+        (uint32_t)(s->samples_decoded * 1000 / s->sample_rate);
+    ESP_LOGI(TAG, "Track %d (%s): decoded %u ms of audio in %lld ms "
+                  "(%lux realtime)",
+             s->track + 1, music_format_to_string(s->dec.ops->format),
+             (unsigned)audio_ms, s->decode_us / 1000,
+             (unsigned long)((int64_t)audio_ms * 1000 / s->decode_us));
+  }
+  music_decoder_close(&s->dec);
+  if (s->fp) {
+    fclose(s->fp);
+  }
+  heap_caps_free(s->head_pcm);
+  memset(s, 0, sizeof(*s));
+  s->track = -1;
+}
+
+static esp_err_t stream_open(music_stream_t *s, int track) {
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  music_track_info_t info;
+
+  memset(s, 0, sizeof(*s));
+  s->track = -1;
+
+  if (track_lookup(track, path, &info) != ESP_OK) {
+    ESP_LOGE(TAG, "No path for track %d", track);
+    return ESP_ERR_NOT_FOUND;
+  }
+  s->duration_ms = info.duration_ms;
+  s->file_size = info.file_size;
+
+  s->fp = music_cache_fopen(path);
+  if (!s->fp && !cache_mode) {
+    s->fp = sd_stream_fopen(path);
+    if (s->fp) {
+      // Keep a PSRAM copy in case the card is released during playback
+      char name[MUSIC_CACHE_NAME_MAX];
+      if (music_library_get_display_name(track, name, sizeof(name)) != ESP_OK) {
+        snprintf(name, sizeof(name), "Track %d", track + 1);
       }
+      music_cache_request(path, name, &info);
     }
-    break;
+  }
+  if (!s->fp) {
+    ESP_LOGE(TAG, "Cannot open %s", path);
+    return ESP_FAIL;
+  }
+  esp_err_t ret = music_decoder_open(&s->dec, s->fp);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "No decoder for %s", path);
+    stream_close(s);
+    return ret;
+  }
+  s->sample_rate = s->dec.sample_rate;
+  s->channels = s->dec.channels;
+  s->track = track;
+  ESP_LOGD(TAG, "Track %d: %s, %u Hz, %d ch", track + 1, s->dec.ops->name,
+           (unsigned)s->sample_rate, s->channels);
+  return ESP_OK;
+}
 
-  case AUDIO_PLAYER_CALLBACK_EVENT_PLAYING:
-    player_state = MUSIC_STATE_PLAYING;
-    if (event_callback) {
-      event_callback(player_state, current_track_index, total_tracks);
+/**
+ * @brief Decode the next block of PCM
+ *
+ * @return Interleaved samples decoded, 0 at end of stream
+ */
+static int stream_decode(music_stream_t *s, int16_t *pcm) {
+  int64_t start_us = esp_timer_get_time();
+  int n = music_decoder_decode(&s->dec, pcm);
+  s->decode_us += esp_timer_get_time() - start_us;
+  if (n < 0) {
+    ESP_LOGW(TAG, "Decode error in track %d, skipping rest", s->track + 1);
+    return 0;
+  }
+  s->samples_decoded += n / s->channels;
+  return n;
+}
+
+/**
+ * @brief Decode the first blocks of a stream into a PSRAM buffer
+ */
+static esp_err_t stream_decode_head(music_stream_t *s) {
+  s->head_pcm = heap_caps_malloc(PREFETCH_BLOCKS * MUSIC_DECODER_BLOCK_SAMPLES *
+                                     sizeof(int16_t),
+                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!s->head_pcm) {
+    return ESP_ERR_NO_MEM;
+  }
+  for (int i = 0; i < PREFETCH_BLOCKS; i++) {
+    int n = stream_decode(s, s->head_pcm + s->head_samples);
+    if (n <= 0) {
+      break;
     }
-    break;
+    s->head_samples += n;
+  }
+  return s->head_samples > 0 ? ESP_OK : ESP_FAIL;
+}
 
-  case AUDIO_PLAYER_CALLBACK_EVENT_PAUSE:
-    player_state = MUSIC_STATE_PAUSED;
-    if (event_callback) {
-      event_callback(player_state, current_track_index, total_tracks);
+/**
+ * @brief Get the next block of PCM, from the prefetched head first
+ *
+ * @param scratch Decode buffer (MUSIC_DECODER_BLOCK_SAMPLES)
+ * @param out Set to the block to write (scratch or prefetched head)
+ * @return Interleaved samples, 0 at end of stream
+ */
+static int stream_next_block(music_stream_t *s, int16_t *scratch,
+                             const int16_t **out) {
+  if (s->head_pcm) {
+    if (s->head_pos < s->head_samples) {
+      size_t n = s->head_samples - s->head_pos;
+      if (n > MUSIC_DECODER_BLOCK_SAMPLES) {
+        n = MUSIC_DECODER_BLOCK_SAMPLES;
+      }
+      *out = s->head_pcm + s->head_pos;
+      s->head_pos += n;
+      return (int)n;
     }
-    break;
+    heap_caps_free(s->head_pcm);
+    s->head_pcm = NULL;
+  }
+  *out = scratch;
+  return stream_decode(s, scratch);
+}
+
+/* ---------- Prefetch ---------- */
+
+static void prefetch_task(void *arg) {
+  (void)arg;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-  case AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN:
+    if (resume_save_due) {
+      resume_save_due = false;
+      resume_save();
+    }
+
+    // A wake-up for the resume save alone finds nothing to prefetch here
+    xSemaphoreTake(prefetch_mutex, portMAX_DELAY);
+    int track = prefetch_track;
+    if (track >= 0 && prefetch_state == PREFETCH_EMPTY) {
+      prefetch_state = PREFETCH_LOADING;
+      int64_t start_us = esp_timer_get_time();
+      if (stream_open(&next_stream, track) == ESP_OK &&
+          stream_decode_head(&next_stream) == ESP_OK) {
+        prefetch_state = PREFETCH_READY;
+        ESP_LOGI(TAG, "Prefetched track %d (%u Hz, %d ch) in %lld ms",
+                 track + 1, (unsigned)next_stream.sample_rate,
+                 next_stream.channels,
+                 (esp_timer_get_time() - start_us) / 1000);
+      } else {
+        ESP_LOGW(TAG, "Prefetch of track %d failed", track + 1);
+        stream_close(&next_stream);
+        prefetch_state = PREFETCH_EMPTY;
+      }
+    }
+    xSemaphoreGive(prefetch_mutex);
+  }
+}
+
+/**
+ * @brief Ask the prefetch task to prepare a track (never blocks)
+ */
+static bool request_prefetch(int track) {
+  if (xSemaphoreTake(prefetch_mutex, 0) != pdTRUE) {
+    return false;
+  }
+  bool queued = false;
+  if (prefetch_state == PREFETCH_EMPTY) {
+    prefetch_track = track;
+    xTaskNotifyGive(prefetch_task_handle);
+    queued = true;
+  }
+  xSemaphoreGive(prefetch_mutex);
+  return queued;
+}
+
+/**
+ * @brief Take the prefetched stream if it is for the given track
+ *
+ * Waits for an in-flight prefetch to finish; any other prefetched stream is
+ * discarded.
+ */
+static bool take_prefetched(int track, music_stream_t *out) {
+  bool hit = false;
+  xSemaphoreTake(prefetch_mutex, portMAX_DELAY);
+  if (prefetch_state == PREFETCH_READY && next_stream.track == track) {
+    *out = next_stream;
+    memset(&next_stream, 0, sizeof(next_stream));
+    next_stream.track = -1;
+    hit = true;
+  } else if (prefetch_state == PREFETCH_READY) {
+    stream_close(&next_stream);
+  }
+  prefetch_state = PREFETCH_EMPTY;
+  prefetch_track = -1;
+  xSemaphoreGive(prefetch_mutex);
+  return hit;
+}
+
+/**
+ * @brief Drop any prefetched (or in-flight) stream
+ */
+static void discard_prefetch(void) {
+  xSemaphoreTake(prefetch_mutex, portMAX_DELAY);
+  if (prefetch_state == PREFETCH_READY) {
+    stream_close(&next_stream);
+  }
+  prefetch_state = PREFETCH_EMPTY;
+  prefetch_track = -1;
+  xSemaphoreGive(prefetch_mutex);
+}
+
+/* ---------- Playback task ---------- */
+
+static esp_err_t ensure_output_format(uint32_t rate, int channels,
+                                      bool *reconfigured) {
+  uint32_t cur_rate = 0;
+  uint32_t cur_bits = 0;
+  i2s_slot_mode_t cur_ch = I2S_SLOT_MODE_MONO;
+  if (bsp_extra_codec_get_fs(&cur_rate, &cur_bits, &cur_ch) == ESP_OK &&
+      cur_rate == rate && cur_bits == 16 && (int)cur_ch == channels) {
+    return ESP_OK;
+  }
+
+  ESP_LOGI(TAG, "Configuring codec for music playback (%u Hz, %d ch)",
+           (unsigned)rate, channels);
+  *reconfigured = true;
+  return bsp_extra_codec_set_fs(rate, 16, (i2s_slot_mode_t)channels);
+}
+
+/**
+ * @brief Publish the music output format; ends a mix started with another
+ *
+ * The mixer's producer converted its audio for the old format, so it gets
+ * ESP_ERR_INVALID_STATE from the next write and plays the rest itself.
+ */
+static void set_output_format(uint32_t rate, int channels) {
+  portENTER_CRITICAL(&mix_mux);
+  out_rate = rate;
+  out_channels = channels;
+  bool ended = mix_active && (rate != mix_rate || channels != mix_channels);
+  if (ended) {
+    mix_active = false;
+  }
+  portEXIT_CRITICAL(&mix_mux);
+  if (ended) {
+    ESP_LOGW(TAG, "Music format changed to %u Hz %d ch, ending the mix",
+             (unsigned)rate, channels);
+  }
+}
+
+static esp_err_t start_track(int track, uint64_t sample) {
+  stream_close(&cur_stream);
+  if (sample == 0 && take_prefetched(track, &cur_stream)) {
+    return ESP_OK;
+  }
+  if (sample > 0) {
+    discard_prefetch();
+  }
+  esp_err_t ret = stream_open(&cur_stream, track);
+  if (ret != ESP_OK || sample == 0) {
+    return ret;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  uint64_t actual = 0;
+  ret = music_decoder_seek(&cur_stream.dec, sample, &actual);
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "Seek in track %d failed (%s), starting from the top",
+             track + 1, esp_err_to_name(ret));
+    stream_close(&cur_stream);
+    return stream_open(&cur_stream, track);
+  }
+  cur_stream.samples_out = actual;
+  ESP_LOGI(TAG, "Resumed track %d at %u ms (seek %lld ms)", track + 1,
+           (unsigned)(actual * 1000 / cur_stream.sample_rate),
+           (esp_timer_get_time() - start_us) / 1000);
+  return ESP_OK;
+}
+
+/**
+ * @brief Switch to the next track at end of stream
+ *
+ * @return true if playback continues
+ */
+static bool advance_track(void) {
+  int next = music_queue_advance(END_OF_TRACK_WRAP);
+  stream_close(&cur_stream);
+
+  if (next < 0) {
+    ESP_LOGI(TAG, "Last track finished - stopping playback");
+    discard_prefetch();
+    resume_set_track(-1, 0, 0); // Next play() starts the order again
+    resume_flush();
+    player_state = MUSIC_STATE_STOPPED;
+    notify_state();
+    return false;
+  }
+
+  bool hit = take_prefetched(next, &cur_stream);
+  if (!hit && stream_open(&cur_stream, next) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open track %d - stopping playback", next + 1);
     player_state = MUSIC_STATE_STOPPED;
-    if (event_callback) {
-      event_callback(player_state, current_track_index, total_tracks);
+    notify_state();
+    return false;
+  }
+
+  stats.transitions++;
+  if (hit) {
+    stats.prefetch_hits++;
+  }
+  current_track_index = next;
+  resume_set_track(next, cur_stream.file_size, 0);
+  ESP_LOGI(TAG, "Track finished, playing next %d/%d (%s)", next + 1,
+           total_tracks, hit ? "prefetched" : "cold open");
+  notify_state();
+  return true;
+}
+
+static void record_handover(int64_t handover_us, uint32_t rate,
+                            bool reconfigured) {
+  uint32_t samples = (uint32_t)((uint64_t)handover_us * rate / 1000000ULL);
+  // Without a reconfigure the DMA keeps playing what it still holds, so only
+  // the part of the handover beyond that is silence. A reconfigure restarts
+  // I2S, so the whole handover is audible.
+  uint32_t gap = samples;
+  if (!reconfigured) {
+    gap = samples > I2S_DMA_FRAMES ? samples - I2S_DMA_FRAMES : 0;
+  } else {
+    stats.codec_reconfigs++;
+  }
+  stats.last_gap_samples = gap;
+  if (gap > stats.max_gap_samples) {
+    stats.max_gap_samples = gap;
+  }
+  ESP_LOGI(TAG, "Track handover: %lld us (%u samples), gap %u samples%s",
+           handover_us, (unsigned)samples, (unsigned)gap,
+           reconfigured ? ", codec reconfigured" : "");
+}
+
+static void handle_command(const music_task_cmd_t *cmd, bool *playing,
+                           bool *prefetch_requested) {
+  switch (cmd->type) {
+  case MUSIC_TASK_CMD_PLAY:
+    if (start_track(cmd->track, cmd->sample) == ESP_OK) {
+      resume_set_track(cmd->track, cur_stream.file_size,
+                       cur_stream.samples_out);
+      bsp_extra_codec_mute_set(false);
+      *playing = true;
+      *prefetch_requested = false;
+    } else {
+      *playing = false;
+      player_state = MUSIC_STATE_STOPPED;
+      notify_state();
     }
     break;
-
-  default:
+  case MUSIC_TASK_CMD_STOP:
+    stream_close(&cur_stream);
+    discard_prefetch();
+    *playing = false;
+    resume_flush(); // Keep the position for the next play()
     break;
+  case MUSIC_TASK_CMD_PAUSE:
+    *playing = false;
+    resume_flush();
+    break;
+  case MUSIC_TASK_CMD_RESUME:
+    *playing = (cur_stream.fp != NULL);
+    break;
+  }
+
+  if (cmd->ack) {
+    xSemaphoreGive(cmd_ack);
+  }
+}
+
+/**
+ * @brief Apply the duck gain to a block and add any queued TTS on top
+ *
+ * @param block Decoded block (may be the read-only prefetched head)
+ * @param pcm Writable block buffer
+ * @param mix_pcm Scratch for TTS samples
+ * @return Block to write (pcm)
+ */
+static const int16_t *duck_and_mix(audio_gain_t *gain, const int16_t *block,
+                                   int16_t *pcm, int16_t *mix_pcm, int n,
+                                   int channels) {
+  int64_t start_us = esp_timer_get_time();
+  if (block != pcm) {
+    memcpy(pcm, block, n * sizeof(int16_t));
+  }
+  audio_gain_apply(gain, pcm, n / channels, channels);
+
+  if (mix_active) {
+    // Whole frames only, so a partial write can't swap the channels
+    size_t frame_bytes = channels * sizeof(int16_t);
+    size_t want = xStreamBufferBytesAvailable(mix_buffer);
+    if (want > n * sizeof(int16_t)) {
+      want = n * sizeof(int16_t);
+    }
+    want -= want % frame_bytes;
+    size_t got = want ? xStreamBufferReceive(mix_buffer, mix_pcm, want, 0) : 0;
+    audio_mix_add(pcm, mix_pcm, got / sizeof(int16_t));
+    mix_samples += n / channels;
+    mix_dsp_us += esp_timer_get_time() - start_us;
+  }
+  return pcm;
+}
+
+static void music_task(void *arg) {
+  (void)arg;
+  int16_t *pcm = heap_caps_malloc(MUSIC_DECODER_BLOCK_SAMPLES * sizeof(int16_t),
+                                  MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  int16_t *mix_pcm = heap_caps_malloc(
+      MUSIC_DECODER_BLOCK_SAMPLES * sizeof(int16_t),
+      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (!pcm || !mix_pcm) {
+    ESP_LOGE(TAG, "Failed to allocate PCM buffer");
+    heap_caps_free(pcm);
+    heap_caps_free(mix_pcm);
+    music_task_handle = NULL;
+    task_arena_exit(TASK_SLOT_MUSIC_PLAY);
+  }
+
+  audio_gain_t gain;
+  audio_gain_init(&gain, AUDIO_GAIN_UNITY);
+  uint32_t gain_target = AUDIO_GAIN_UNITY;
+
+  bool playing = false;
+  bool prefetch_requested = false;
+  bool handover_pending = false;
+  bool format_checked = false; // Codec matches cur_stream's native format
+  uint32_t codec_generation = 0; // Codec generation format_checked is for
+  int64_t handover_start_us = 0;
+
+  while (1) {
+    music_task_cmd_t cmd;
+    while (xQueueReceive(cmd_queue, &cmd, playing ? 0 : portMAX_DELAY) ==
+           pdTRUE) {
+      handle_command(&cmd, &playing, &prefetch_requested);
+      handover_pending = false;
+      format_checked = false; // TTS/WWD may have reconfigured the codec
+    }
+    if (!playing) {
+      continue;
+    }
+
+    const int16_t *block = NULL;
+    int n = stream_next_block(&cur_stream, pcm, &block);
+    if (n <= 0) {
+      handover_start_us = esp_timer_get_time();
+      playing = advance_track();
+      handover_pending = playing;
+      prefetch_requested = false;
+      format_checked = false;
+      continue;
+    }
+
+    // Beeps, local voice, the wake prompt and capture reopen the codec in
+    // their own format without telling us; check again before every block
+    uint32_t generation = bsp_extra_codec_get_generation();
+    if (generation != codec_generation) {
+      format_checked = false;
+    }
+    bool reconfigured = false;
+    if (!format_checked) {
+      // Read before our own reopen, which then only costs one extra check
+      codec_generation = generation;
+      if (ensure_output_format(cur_stream.sample_rate, cur_stream.channels,
+                               &reconfigured) == ESP_OK) {
+        set_output_format(cur_stream.sample_rate, cur_stream.channels);
+        format_checked = true;
+      } else {
+        ESP_LOGW(TAG, "Codec reconfiguration failed");
+      }
+    }
+    if (handover_pending) {
+      record_handover(esp_timer_get_time() - handover_start_us,
+                      cur_stream.sample_rate, reconfigured);
+      handover_pending = false;
+    }
+
+    if (duck_gain != gain_target) {
+      gain_target = duck_gain;
+      audio_gain_set_target(&gain, gain_target,
+                            cur_stream.sample_rate * DUCK_RAMP_MS / 1000);
+    }
+    if (mix_active || !audio_gain_is_unity(&gain)) {
+      block = duck_and_mix(&gain, block, pcm, mix_pcm, n, cur_stream.channels);
+    }
+
+    size_t written = 0;
+    audio_rt_cycle(AUDIO_RT_WRITE,
+                   (uint32_t)((int64_t)n / cur_stream.channels * 1000000 /
+                              cur_stream.sample_rate));
+    esp_err_t ret = bsp_extra_i2s_write((void *)block, n * sizeof(int16_t),
+                                        &written, 0);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "I2S write failed: %s", esp_err_to_name(ret));
+      audio_rt_error(AUDIO_RT_WRITE);
+      vTaskDelay(pdMS_TO_TICKS(10)); // Codec closed under us (e.g. capture)
+      format_checked = false;
+      continue;
+    }
+    cur_stream.samples_out += n / cur_stream.channels;
+    resume_set_position(cur_stream.track, cur_stream.samples_out);
+
+    if (!prefetch_requested) {
+      uint32_t played_ms =
+          (uint32_t)(cur_stream.samples_out * 1000 / cur_stream.sample_rate);
+      if (cur_stream.duration_ms == 0 ||
+          played_ms + PREFETCH_LEAD_MS >= cur_stream.duration_ms) {
+        int next = music_queue_peek_next(END_OF_TRACK_WRAP);
+        prefetch_requested = next < 0 || request_prefetch(next);
+      }
+    }
+  }
+}
+
+static esp_err_t post_command(music_task_cmd_type_t type, int track,
+                              uint64_t sample, bool wait) {
+  if (!cmd_queue) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (wait) {
+    xSemaphoreTake(cmd_ack, 0); // Drop a stale ack
+  }
+  music_task_cmd_t cmd = {
+      .type = type, .track = track, .sample = sample, .ack = wait};
+  if (xQueueSend(cmd_queue, &cmd, pdMS_TO_TICKS(500)) != pdTRUE) {
+    ESP_LOGE(TAG, "Music command queue full");
+    return ESP_FAIL;
+  }
+  if (wait &&
+      xSemaphoreTake(cmd_ack, pdMS_TO_TICKS(MUSIC_CMD_ACK_TIMEOUT_MS)) !=
+          pdTRUE) {
+    ESP_LOGW(TAG, "Music task did not acknowledge command %d", type);
+    return ESP_ERR_TIMEOUT;
+  }
+  return ESP_OK;
+}
+
+static esp_err_t start_tasks(void) {
+  if (music_task_handle) {
+    return ESP_OK;
+  }
+
+  cmd_queue = xQueueCreate(MUSIC_CMD_QUEUE_SIZE, sizeof(music_task_cmd_t));
+  cmd_ack = xSemaphoreCreateBinary();
+  prefetch_mutex = xSemaphoreCreateMutex();
+  resume_timer =
+      xTimerCreate("music_resume", pdMS_TO_TICKS(RESUME_SAVE_INTERVAL_MS),
+                   pdFALSE, NULL, resume_timer_callback);
+  mix_buffer = xStreamBufferCreate(MIX_BUFFER_BYTES, 1);
+  if (!cmd_queue || !cmd_ack || !prefetch_mutex || !resume_timer ||
+      !mix_buffer) {
+    ESP_LOGE(TAG, "Failed to create music player sync objects");
+    return ESP_ERR_NO_MEM;
+  }
+
+  if (task_arena_start(TASK_SLOT_MUSIC_PREFETCH, prefetch_task, NULL,
+                       PREFETCH_TASK_PRIORITY, tskNO_AFFINITY,
+                       &prefetch_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create prefetch task");
+    return ESP_ERR_NO_MEM;
   }
+  if (task_arena_start(TASK_SLOT_MUSIC_PLAY, music_task, NULL,
+                       MUSIC_TASK_PRIORITY, tskNO_AFFINITY,
+                       &music_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create music playback task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
 }
 
+/* ---------- Public API ---------- */
+
 /**
  * @brief Initialize local music player
  */
@@ -125,36 +970,39 @@ esp_err_t local_music_player_init(void) {
     return ESP_FAIL;
   }
 
-  // Initialize BSP audio player
-  esp_err_t ret = bsp_extra_player_init();
+  // Playback and prefetch tasks persist across init/deinit
+  esp_err_t ret = start_tasks();
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to initialize BSP audio player: %s",
-             esp_err_to_name(ret));
     return ret;
   }
+  if (music_cache_init() != ESP_OK) {
+    ESP_LOGW(TAG, "Track cache unavailable, music stops with the SD card");
+  }
 
-  // Register audio player callback
-  bsp_extra_player_register_callback(audio_player_callback, NULL);
-
-  // Initialize file iterator for music directory
-  file_iterator = file_iterator_new(MUSIC_DIR);
-  if (file_iterator == NULL) {
-    ESP_LOGE(TAG, "Failed to initialize file iterator for %s", MUSIC_DIR);
-    bsp_extra_player_del();
+  // Open the on-card library index (rescans only if the directory changed)
+  ret = music_library_open(MUSIC_DIR);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open music library for %s", MUSIC_DIR);
     return ESP_FAIL;
   }
 
   // Count total tracks
-  total_tracks = file_iterator->count;
+  total_tracks = music_library_get_count();
   ESP_LOGI(TAG, "Found %d music tracks in %s", total_tracks, MUSIC_DIR);
 
   if (total_tracks == 0) {
     ESP_LOGW(TAG, "No music files found in %s", MUSIC_DIR);
-    bsp_extra_player_del();
-    free_file_iterator_instance(&file_iterator);
+    music_library_close();
     return ESP_FAIL;
   }
 
+  ret = music_queue_init(total_tracks);
+  if (ret != ESP_OK) {
+    music_library_close();
+    return ret;
+  }
+  resume_load();
+
   player_initialized = true;
   player_state = MUSIC_STATE_IDLE;
   current_track_index = -1;
@@ -175,18 +1023,16 @@ esp_err_t local_music_player_deinit(void) {
 
   ESP_LOGI(TAG, "Deinitializing local music player...");
 
-  // Stop playback if active
-  if (player_state == MUSIC_STATE_PLAYING ||
-      player_state == MUSIC_STATE_PAUSED) {
-    local_music_player_stop();
+  // Close every open file before the SD card goes away
+  if (post_command(MUSIC_TASK_CMD_STOP, -1, 0, true) != ESP_OK) {
+    ESP_LOGW(TAG, "Music task busy while deinitializing");
   }
+  resume_flush();
+  music_queue_deinit();
 
-  // Delete BSP audio player
-  bsp_extra_player_del();
-
-  // Delete file iterator (manual cleanup since file_iterator_delete doesn't
-  // exist)
-  free_file_iterator_instance(&file_iterator);
+  // Close the library index (only the header and one page were in RAM)
+  music_library_close();
+  cache_mode = false;
   total_tracks = 0;
   current_track_index = -1;
   player_state = MUSIC_STATE_IDLE;
@@ -198,54 +1044,168 @@ esp_err_t local_music_player_deinit(void) {
 }
 
 /**
- * @brief Start playing music
+ * @brief Restart playback at a track of the new source after a switch
  */
-esp_err_t local_music_player_play(void) {
+static void continue_after_switch(bool was_playing, const char *path,
+                                  uint64_t sample) {
+  int track = was_playing ? track_find(path) : -1;
+  if (track < 0) {
+    player_state = was_playing ? MUSIC_STATE_STOPPED : MUSIC_STATE_IDLE;
+    current_track_index = -1;
+    notify_state();
+    return;
+  }
+  current_track_index = track;
+  music_queue_jump_to_track(track);
+  if (post_command(MUSIC_TASK_CMD_PLAY, track, sample, false) == ESP_OK) {
+    player_state = MUSIC_STATE_PLAYING;
+  } else {
+    player_state = MUSIC_STATE_STOPPED;
+  }
+  notify_state();
+}
+
+/**
+ * @brief Switch to the PSRAM cache before the SD card is released
+ */
+esp_err_t local_music_player_use_cache(void) {
   if (!player_initialized) {
-    ESP_LOGE(TAG, "Music player not initialized");
-    return ESP_FAIL;
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (cache_mode) {
+    return ESP_OK;
   }
 
-  if (total_tracks == 0) {
-    ESP_LOGE(TAG, "No tracks available");
-    return ESP_FAIL;
+  bool was_playing = player_state == MUSIC_STATE_PLAYING;
+  char path[MUSIC_LIBRARY_PATH_MAX] = "";
+  music_track_info_t info;
+  int track;
+  uint64_t sample;
+  current_position(&track, &sample);
+  if (track < 0 || track_lookup(track, path, &info) != ESP_OK) {
+    was_playing = false;
   }
 
-  // If paused, resume
-  if (player_state == MUSIC_STATE_PAUSED) {
-    return local_music_player_resume();
+  // Stops playback and prefetch, and persists the library position
+  if (post_command(MUSIC_TASK_CMD_STOP, -1, 0, true) != ESP_OK) {
+    ESP_LOGW(TAG, "Music task busy while switching to the cache");
+  }
+  resume_flush();
+  music_queue_deinit();
+  music_library_close();
+
+  int count = music_cache_get_count();
+  if (count == 0 || music_queue_init(count) != ESP_OK) {
+    ESP_LOGI(TAG, "No cached tracks, music unavailable until the card returns");
+    total_tracks = 0;
+    current_track_index = -1;
+    player_state = MUSIC_STATE_IDLE;
+    player_initialized = false;
+    notify_state();
+    return ESP_ERR_NOT_FOUND;
   }
 
-  // Start from first track
-  current_track_index = 0;
-  ESP_LOGI(TAG, "Starting playback from track %d/%d", current_track_index + 1,
-           total_tracks);
+  cache_mode = true;
+  total_tracks = count;
+  ESP_LOGI(TAG, "Playing from PSRAM cache: %d tracks", count);
+  continue_after_switch(was_playing, path, sample);
+  return ESP_OK;
+}
+
+/**
+ * @brief Switch back to the library once the SD card is mounted again
+ */
+esp_err_t local_music_player_use_library(void) {
+  if (!cache_mode) {
+    return player_initialized ? ESP_OK : local_music_player_init();
+  }
 
-  // Clear manual stop flag - user explicitly pressed play
-  manual_stop = false;
+  bool was_playing = player_state == MUSIC_STATE_PLAYING;
+  char path[MUSIC_LIBRARY_PATH_MAX] = "";
+  music_track_info_t info;
+  int track;
+  uint64_t sample;
+  current_position(&track, &sample);
+  if (track < 0 || track_lookup(track, path, &info) != ESP_OK) {
+    was_playing = false;
+  }
+
+  if (post_command(MUSIC_TASK_CMD_STOP, -1, 0, true) != ESP_OK) {
+    ESP_LOGW(TAG, "Music task busy while switching to the library");
+  }
+  music_queue_deinit();
+  cache_mode = false;
+  player_initialized = false;
+  total_tracks = 0;
 
-  // Reconfigure codec for MP3 playback (48kHz stereo for your MP3 files)
-  // This is critical after voice recording which uses 16kHz mono
-  ESP_LOGI(TAG, "Configuring codec for music playback (48kHz stereo)");
-  esp_err_t codec_ret = bsp_extra_codec_set_fs(48000, 16, I2S_SLOT_MODE_STEREO);
-  if (codec_ret != ESP_OK) {
-    ESP_LOGW(TAG, "Failed to reconfigure codec, music may play at wrong speed");
+  // Reloads the persisted library position and play order
+  esp_err_t ret = local_music_player_init();
+  if (ret != ESP_OK) {
+    notify_state();
+    return ret;
   }
+  continue_after_switch(was_playing, path, sample);
+  return ESP_OK;
+}
 
+/**
+ * @brief Check if tracks are served from the PSRAM cache
+ */
+bool local_music_player_is_cache_mode(void) { return cache_mode; }
+
+/**
+ * @brief Start playback of current_track_index and report it
+ */
+static esp_err_t play_current_track(uint64_t sample) {
   esp_err_t ret =
-      bsp_extra_player_play_index(file_iterator, current_track_index);
+      post_command(MUSIC_TASK_CMD_PLAY, current_track_index, sample, false);
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "Failed to play track %d", current_track_index);
     return ret;
   }
 
   player_state = MUSIC_STATE_PLAYING;
+  notify_state();
+  return ESP_OK;
+}
 
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
+/**
+ * @brief Start playing music
+ */
+esp_err_t local_music_player_play(void) {
+  if (!player_initialized) {
+    ESP_LOGE(TAG, "Music player not initialized");
+    return ESP_FAIL;
   }
 
-  return ESP_OK;
+  if (total_tracks == 0) {
+    ESP_LOGE(TAG, "No tracks available");
+    return ESP_FAIL;
+  }
+
+  // If paused, resume
+  if (player_state == MUSIC_STATE_PAUSED) {
+    return local_music_player_resume();
+  }
+
+  // Continue where playback last stopped, else from the start of the order
+  int track;
+  uint64_t sample;
+  current_position(&track, &sample);
+
+  if (track >= 0 && music_queue_jump_to_track(track) == ESP_OK) {
+    ESP_LOGI(TAG, "Resuming playback of track %d/%d", track + 1, total_tracks);
+  } else {
+    music_queue_rewind();
+    sample = 0;
+    track = music_queue_advance(true);
+    ESP_LOGI(TAG, "Starting playback from track %d/%d", track + 1,
+             total_tracks);
+  }
+  current_track_index = track;
+
+  // The playback task configures the codec from the decoded stream format
+  return play_current_track(sample);
 }
 
 /**
@@ -258,23 +1218,15 @@ esp_err_t local_music_player_stop(void) {
 
   ESP_LOGI(TAG, "Stopping music playback (manual stop)");
 
-  // Set manual stop flag to prevent auto-play next track
-  manual_stop = true;
-
-  // Use audio player stop (queues stop request)
-  esp_err_t ret = audio_player_stop();
+  esp_err_t ret = post_command(MUSIC_TASK_CMD_STOP, -1, 0, false);
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to stop audio player");
-    manual_stop = false; // Reset on error
+    ESP_LOGE(TAG, "Failed to stop music playback");
     return ret;
   }
 
   player_state = MUSIC_STATE_STOPPED;
   current_track_index = -1;
-
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
-  }
+  notify_state();
 
   return ESP_OK;
 }
@@ -290,18 +1242,15 @@ esp_err_t local_music_player_pause(void) {
 
   ESP_LOGI(TAG, "Pausing music playback");
 
-  // Use audio player pause (queues pause request)
-  esp_err_t ret = audio_player_pause();
+  // Wait so that nothing is written to I2S once this returns (TTS follows)
+  esp_err_t ret = post_command(MUSIC_TASK_CMD_PAUSE, -1, 0, true);
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to pause audio player");
+    ESP_LOGE(TAG, "Failed to pause music playback");
     return ret;
   }
 
   player_state = MUSIC_STATE_PAUSED;
-
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
-  }
+  notify_state();
 
   return ESP_OK;
 }
@@ -317,29 +1266,16 @@ esp_err_t local_music_player_resume(void) {
 
   ESP_LOGI(TAG, "Resuming music playback");
 
-  // Clear manual stop flag - user pressed resume
-  manual_stop = false;
-
-  // Ensure codec is back to music playback settings (TTS/WWD may have changed
-  // it)
-  ESP_LOGI(TAG, "Configuring codec for music playback (48kHz stereo)");
-  esp_err_t codec_ret = bsp_extra_codec_set_fs(48000, 16, I2S_SLOT_MODE_STEREO);
-  if (codec_ret != ESP_OK) {
-    ESP_LOGW(TAG, "Failed to reconfigure codec");
-  }
-
-  // Use audio player resume (queues resume request)
-  esp_err_t ret = audio_player_resume();
+  // TTS/WWD may have changed the codec format; the playback task restores
+  // it before the next write.
+  esp_err_t ret = post_command(MUSIC_TASK_CMD_RESUME, -1, 0, false);
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to resume audio player");
+    ESP_LOGE(TAG, "Failed to resume music playback");
     return ret;
   }
 
   player_state = MUSIC_STATE_PLAYING;
-
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
-  }
+  notify_state();
 
   return ESP_OK;
 }
@@ -352,36 +1288,13 @@ esp_err_t local_music_player_next(void) {
     return ESP_FAIL;
   }
 
-  // Increment track index (loop to beginning)
-  current_track_index = (current_track_index + 1) % total_tracks;
+  // Queued tracks first, then the play order (loop to beginning)
+  current_track_index = music_queue_advance(true);
 
   ESP_LOGI(TAG, "Playing next track: %d/%d", current_track_index + 1,
            total_tracks);
 
-  // Clear manual stop flag - user pressed next or track auto-advanced
-  manual_stop = false;
-
-  // Reconfigure codec for MP3 playback
-  ESP_LOGI(TAG, "Configuring codec for music playback (48kHz stereo)");
-  esp_err_t codec_ret = bsp_extra_codec_set_fs(48000, 16, I2S_SLOT_MODE_STEREO);
-  if (codec_ret != ESP_OK) {
-    ESP_LOGW(TAG, "Failed to reconfigure codec");
-  }
-
-  esp_err_t ret =
-      bsp_extra_player_play_index(file_iterator, current_track_index);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to play next track");
-    return ret;
-  }
-
-  player_state = MUSIC_STATE_PLAYING;
-
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
-  }
-
-  return ESP_OK;
+  return play_current_track(0);
 }
 
 /**
@@ -392,39 +1305,13 @@ esp_err_t local_music_player_previous(void) {
     return ESP_FAIL;
   }
 
-  // Decrement track index (loop to end)
-  current_track_index--;
-  if (current_track_index < 0) {
-    current_track_index = total_tracks - 1;
-  }
+  // Step back in the play order (loop to end)
+  current_track_index = music_queue_previous(true);
 
   ESP_LOGI(TAG, "Playing previous track: %d/%d", current_track_index + 1,
            total_tracks);
 
-  // Clear manual stop flag - user pressed previous
-  manual_stop = false;
-
-  // Reconfigure codec for MP3 playback
-  ESP_LOGI(TAG, "Configuring codec for music playback (48kHz stereo)");
-  esp_err_t codec_ret = bsp_extra_codec_set_fs(48000, 16, I2S_SLOT_MODE_STEREO);
-  if (codec_ret != ESP_OK) {
-    ESP_LOGW(TAG, "Failed to reconfigure codec");
-  }
-
-  esp_err_t ret =
-      bsp_extra_player_play_index(file_iterator, current_track_index);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to play previous track");
-    return ret;
-  }
-
-  player_state = MUSIC_STATE_PLAYING;
-
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
-  }
-
-  return ESP_OK;
+  return play_current_track(0);
 }
 
 /**
@@ -443,35 +1330,153 @@ esp_err_t local_music_player_play_track(int track_index) {
   }
 
   current_track_index = track_index;
-
-  // BUG FIX: Clear manual stop flag - user explicitly requested track
-  manual_stop = false;
+  music_queue_jump_to_track(track_index);
 
   ESP_LOGI(TAG, "Playing track %d/%d", current_track_index + 1, total_tracks);
 
-  // BUG FIX: Reconfigure codec for music playback (may be different after TTS)
-  ESP_LOGI(TAG, "Configuring codec for music playback (48kHz stereo)");
-  esp_err_t codec_ret = bsp_extra_codec_set_fs(48000, 16, I2S_SLOT_MODE_STEREO);
-  if (codec_ret != ESP_OK) {
-    ESP_LOGW(TAG, "Failed to reconfigure codec, music may play at wrong speed");
-  }
+  return play_current_track(0);
+}
 
-  esp_err_t ret =
-      bsp_extra_player_play_index(file_iterator, current_track_index);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to play track %d", current_track_index);
-    return ret;
+/**
+ * @brief Turn shuffle on or off
+ */
+esp_err_t local_music_player_set_shuffle(bool enable) {
+  if (!player_initialized) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (enable == music_queue_get_shuffle()) {
+    return ESP_OK;
   }
 
-  player_state = MUSIC_STATE_PLAYING;
+  music_queue_set_shuffle(enable, esp_random(), -1);
+  resume_set_order();
+  return ESP_OK;
+}
 
-  if (event_callback) {
-    event_callback(player_state, current_track_index, total_tracks);
+/**
+ * @brief Check if shuffle is on
+ */
+bool local_music_player_get_shuffle(void) { return music_queue_get_shuffle(); }
+
+/**
+ * @brief Queue a track to play after the current one
+ */
+esp_err_t local_music_player_enqueue(int track_index) {
+  if (!player_initialized) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t ret = music_queue_enqueue(track_index);
+  if (ret == ESP_OK) {
+    ESP_LOGI(TAG, "Queued track %d (%d pending)", track_index + 1,
+             music_queue_pending());
   }
+  return ret;
+}
 
+/**
+ * @brief Duck the music under other audio, or restore it
+ */
+esp_err_t local_music_player_duck(bool enable) {
+  if (!player_initialized) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  duck_gain = enable ? (uint32_t)duck_level * AUDIO_GAIN_UNITY / 100
+                     : AUDIO_GAIN_UNITY;
+  ESP_LOGD(TAG, "Music %s", enable ? "ducked" : "restored");
   return ESP_OK;
 }
 
+/**
+ * @brief Set the music level kept while ducked
+ */
+void local_music_player_set_duck_level(uint8_t percent) {
+  if (percent > 100) {
+    percent = 100;
+  }
+  bool ducked = duck_gain != AUDIO_GAIN_UNITY;
+  duck_level = percent;
+  if (ducked) {
+    duck_gain = (uint32_t)percent * AUDIO_GAIN_UNITY / 100;
+  }
+}
+
+/**
+ * @brief Get the music level kept while ducked
+ */
+uint8_t local_music_player_get_duck_level(void) { return duck_level; }
+
+/**
+ * @brief Start mixing external PCM into the music
+ */
+esp_err_t local_music_player_mix_begin(uint32_t *sample_rate, int *channels) {
+  if (!sample_rate || !channels) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!player_initialized || player_state != MUSIC_STATE_PLAYING ||
+      !mix_buffer || mix_active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // Nothing reads the buffer until mix_active is set
+  xStreamBufferReset(mix_buffer);
+  mix_dsp_us = 0;
+  mix_samples = 0;
+
+  // The playback task publishes the format it has configured the codec for;
+  // a later change ends the mix (set_output_format)
+  portENTER_CRITICAL(&mix_mux);
+  bool started = out_rate != 0 && out_channels != 0 && !mix_active;
+  if (started) {
+    mix_rate = out_rate;
+    mix_channels = out_channels;
+    mix_active = true;
+    *sample_rate = mix_rate;
+    *channels = mix_channels;
+  }
+  portEXIT_CRITICAL(&mix_mux);
+  return started ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+/**
+ * @brief Queue PCM (music rate and channels) to be mixed into the music
+ */
+esp_err_t local_music_player_mix_write(const int16_t *pcm, size_t samples,
+                                       uint32_t timeout_ms) {
+  if (!mix_active || !pcm) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  size_t bytes = samples * sizeof(int16_t);
+  size_t sent = xStreamBufferSend(mix_buffer, pcm, bytes,
+                                  pdMS_TO_TICKS(timeout_ms));
+  return sent == bytes ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Wait for the queued PCM to be played and stop mixing
+ */
+void local_music_player_mix_end(void) {
+  if (!mix_active) {
+    return;
+  }
+  int waited_ms = 0;
+  while (!xStreamBufferIsEmpty(mix_buffer) &&
+         player_state == MUSIC_STATE_PLAYING &&
+         waited_ms < MIX_DRAIN_TIMEOUT_MS) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+    waited_ms += 10;
+  }
+  portENTER_CRITICAL(&mix_mux);
+  mix_active = false;
+  portEXIT_CRITICAL(&mix_mux);
+
+  uint32_t rate = mix_rate ? mix_rate : 1;
+  uint32_t audio_ms = (uint32_t)(mix_samples * 1000 / rate);
+  ESP_LOGI(TAG, "Mixed %u ms of audio into music, duck/mix DSP %lld us "
+                "(%u.%02u%% of one core)",
+           (unsigned)audio_ms, mix_dsp_us,
+           (unsigned)(audio_ms ? mix_dsp_us / (10 * audio_ms) : 0),
+           (unsigned)(audio_ms ? (mix_dsp_us * 10 / audio_ms) % 100 : 0));
+}
+
 /**
  * @brief Get current player state
  */
@@ -500,21 +1505,33 @@ esp_err_t local_music_player_get_track_name(char *name, size_t max_len) {
     return ESP_FAIL;
   }
 
-  if (file_iterator && file_iterator->list) {
-    // Get filename from iterator
-    const char *filename =
-        file_iterator_get_name_from_index(file_iterator, current_track_index);
-    if (filename) {
-      strncpy(name, filename, max_len - 1);
-      name[max_len - 1] = '\0';
+  if (cache_mode) {
+    char cached[MUSIC_CACHE_NAME_MAX];
+    if (music_cache_get_entry(current_track_index, NULL, cached, NULL) ==
+        ESP_OK) {
+      snprintf(name, max_len, "%s", cached);
       return ESP_OK;
     }
+  } else if (music_library_get_display_name(current_track_index, name,
+                                            max_len) == ESP_OK) {
+    return ESP_OK;
   }
 
   snprintf(name, max_len, "Track %d", current_track_index + 1);
   return ESP_OK;
 }
 
+/**
+ * @brief Get gapless playback statistics
+ */
+esp_err_t local_music_player_get_stats(music_playback_stats_t *out) {
+  if (!out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *out = stats;
+  return ESP_OK;
+}
+
 /**
  * @brief Check if player is initialized
  */
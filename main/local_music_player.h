@@ -1,9 +1,12 @@
 /**
  * @file local_music_player.h
- * @brief Local music player for SD card MP3 playback
+ * @brief Local music player for SD card music playback
  *
- * Manages playback of MP3 files from /sdcard/music directory.
+ * Manages playback of MP3, WAV and FLAC files from /sdcard/music directory.
  * Only active when Ethernet is connected (SD card mounted).
+ *
+ * Play order, shuffle and the current position survive stop, deinit and
+ * reboots: play() continues the last track where it stopped.
  */
 
 #ifndef LOCAL_MUSIC_PLAYER_H
@@ -11,6 +14,8 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +31,17 @@ typedef enum {
     MUSIC_STATE_STOPPED         ///< Music stopped
 } music_state_t;
 
+/**
+ * @brief Track-to-track (gapless) playback statistics
+ */
+typedef struct {
+    uint32_t transitions;       ///< Automatic track-to-track transitions
+    uint32_t prefetch_hits;     ///< Transitions served from a prefetched stream
+    uint32_t codec_reconfigs;   ///< Transitions that needed a codec format change
+    uint32_t last_gap_samples;  ///< Estimated silence at the last transition (output samples)
+    uint32_t max_gap_samples;   ///< Largest estimated silence seen
+} music_playback_stats_t;
+
 /**
  * @brief Music player event callback
  */
@@ -34,7 +50,8 @@ typedef void (*music_event_callback_t)(music_state_t state, int current_track, i
 /**
  * @brief Initialize local music player
  *
- * Scans /sdcard/music directory for MP3 files.
+ * Opens the persistent library index for /sdcard/music (rescanning only
+ * when the directory changed).
  * Must be called after SD card is mounted.
  *
  * @return ESP_OK on success
@@ -52,10 +69,39 @@ esp_err_t local_music_player_init(void);
  */
 esp_err_t local_music_player_deinit(void);
 
+/**
+ * @brief Switch to the tracks cached in PSRAM before the SD card is released
+ *
+ * Closes every file on the card. If a cached track was playing, it continues
+ * from the same position out of PSRAM. Track indices then refer to the
+ * cached tracks.
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_NOT_FOUND if nothing is cached (the player is deinitialized)
+ *         ESP_ERR_INVALID_STATE if the player is not initialized
+ */
+esp_err_t local_music_player_use_cache(void);
+
+/**
+ * @brief Switch back to the library after the SD card is mounted again
+ *
+ * A track playing from the cache continues from the card at the same
+ * position. Initializes the player if it is not.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t local_music_player_use_library(void);
+
+/**
+ * @brief Check if tracks are served from the PSRAM cache
+ */
+bool local_music_player_is_cache_mode(void);
+
 /**
  * @brief Start playing music
  *
- * Starts playing from first track or resumes if paused.
+ * Resumes if paused, otherwise continues the saved track and position, or
+ * starts from the first track of the play order.
  *
  * @return ESP_OK on success
  *         ESP_FAIL if player not initialized or no tracks
@@ -106,6 +152,87 @@ esp_err_t local_music_player_previous(void);
  */
 esp_err_t local_music_player_play_track(int track_index);
 
+/**
+ * @brief Turn shuffle on or off
+ *
+ * The current track stays current; the rest of the library follows it in a
+ * new random order. The setting is persisted.
+ *
+ * @param enable Shuffle on/off
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t local_music_player_set_shuffle(bool enable);
+
+/**
+ * @brief Check if shuffle is on
+ */
+bool local_music_player_get_shuffle(void);
+
+/**
+ * @brief Queue a track to play after the current one
+ *
+ * @param track_index Track index (0-based)
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t local_music_player_enqueue(int track_index);
+
+/**
+ * @brief Duck the music under other audio, or restore it
+ *
+ * The music gain ramps over a few milliseconds to the duck level (or back
+ * to full level); playback itself continues.
+ *
+ * @param enable true to duck, false to restore
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t local_music_player_duck(bool enable);
+
+/**
+ * @brief Set the music level kept while ducked
+ *
+ * @param percent 0-100 % of the normal music level
+ */
+void local_music_player_set_duck_level(uint8_t percent);
+
+/**
+ * @brief Get the music level kept while ducked (percent)
+ */
+uint8_t local_music_player_get_duck_level(void);
+
+/**
+ * @brief Start mixing external PCM (e.g. TTS) into the playing music
+ *
+ * The caller converts its audio to the reported format and feeds it with
+ * local_music_player_mix_write(); the codec is not reconfigured. If the
+ * music changes format (a track at another rate) the mix ends and further
+ * writes fail.
+ *
+ * @param sample_rate Output: music sample rate in Hz
+ * @param channels Output: music channel count
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if music is not playing
+ */
+esp_err_t local_music_player_mix_begin(uint32_t *sample_rate, int *channels);
+
+/**
+ * @brief Queue interleaved PCM to be mixed into the music
+ *
+ * Blocks while the mix buffer is full, so the caller is paced by playback.
+ *
+ * @param pcm Samples in the format reported by local_music_player_mix_begin()
+ * @param samples Interleaved sample count
+ * @param timeout_ms Longest time to wait for room
+ * @return ESP_OK, ESP_ERR_TIMEOUT if playback did not take the samples
+ *         (e.g. music stopped) or ESP_ERR_INVALID_STATE if the mix ended
+ *         (music changed format); the caller should then play them itself
+ */
+esp_err_t local_music_player_mix_write(const int16_t *pcm, size_t samples,
+                                       uint32_t timeout_ms);
+
+/**
+ * @brief Wait until the queued PCM has been played, then stop mixing
+ */
+void local_music_player_mix_end(void);
+
 /**
  * @brief Get current player state
  *
@@ -136,6 +263,17 @@ int local_music_player_get_total_tracks(void);
  */
 esp_err_t local_music_player_get_track_name(char *name, size_t max_len);
 
+/**
+ * @brief Get gapless playback statistics
+ *
+ * The gap is the time between the last PCM write of one track and the first
+ * write of the next, minus what the I2S DMA still holds, in output samples.
+ *
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t local_music_player_get_stats(music_playback_stats_t *stats);
+
 /**
  * @brief Check if player is initialized
  *
@@ -0,0 +1,390 @@
+/**
+ * @file local_tts.c
+ * @brief On-device phrase synthesis from pre-recorded units
+ */
+
+#include "local_tts.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GAP_SAMPLES (LOCAL_TTS_SAMPLE_RATE * 40 / 1000) // Between words
+#define FADE_SAMPLES (LOCAL_TTS_SAMPLE_RATE * 3 / 1000) // At unit edges
+#define PATH_MAX_LEN 160
+
+// Unit ids: numbers first, so a number maps to its unit by arithmetic
+enum {
+  U_N0 = 0, // n0..n19
+  U_N1F = 20,
+  U_N2F,
+  U_N20, // n20..n90
+  U_N100 = U_N20 + 8, // n100..n900
+  U_SAT = U_N100 + 9,
+  U_SATA,
+  U_SATI,
+  U_MINUTA,
+  U_MINUTE,
+  U_SEKUNDA,
+  U_SEKUNDE,
+  U_SEKUNDI,
+  U_I,
+  U_STATUS, // local_tts_status_t order
+  U_COUNT = U_STATUS + LOCAL_TTS_STATUS_COUNT
+};
+
+/* File names (without .wav) and what each unit says */
+static const char *const unit_names[U_COUNT] = {
+    "n0",  "n1",  "n2",  "n3",  "n4",  "n5",  "n6",  "n7",  "n8",  "n9",
+    "n10", "n11", "n12", "n13", "n14", "n15", "n16", "n17", "n18", "n19",
+    "n1f",  // jedna
+    "n2f",  // dvije
+    "n20", "n30", "n40", "n50", "n60", "n70", "n80", "n90",
+    "n100", // sto
+    "n200", "n300", "n400", "n500", "n600", "n700", "n800", "n900",
+    "sat", "sata", "sati", "minuta", "minute", "sekunda", "sekunde",
+    "sekundi",
+    "i",
+    "ha_nedostupan",     // Home Assistant nije dostupan
+    "ha_ne_odgovara",    // Home Assistant ne odgovara
+    "greska",            // Došlo je do greške
+    "tajmer_postavljen", // Tajmer postavljen na
+    "tajmer_istekao",    // Tajmer je istekao
+};
+
+struct local_tts {
+  int16_t *audio; // All units back to back
+  uint32_t offset[U_COUNT];
+  uint32_t length[U_COUNT]; // 0: not loaded
+  local_tts_info_t info;
+};
+
+/* ---------- WAV units ---------- */
+
+static uint32_t rd_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint16_t rd_le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Check the format and seek to the samples
+ *
+ * @return Sample count, 0 if the file is not 16 kHz mono 16-bit PCM
+ */
+static uint32_t wav_open_data(FILE *f) {
+  uint8_t hdr[12];
+  if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+      memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) {
+    return 0;
+  }
+  bool fmt_ok = false;
+  uint8_t chunk[8];
+  while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+    uint32_t size = rd_le32(chunk + 4);
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+      uint8_t fmt[16];
+      if (fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt))
+        return 0;
+      fmt_ok = rd_le16(fmt) == 1 && rd_le16(fmt + 2) == 1 &&
+               rd_le32(fmt + 4) == LOCAL_TTS_SAMPLE_RATE &&
+               rd_le16(fmt + 14) == 16;
+      size -= sizeof(fmt);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      return fmt_ok ? size / sizeof(int16_t) : 0;
+    }
+    if (fseek(f, (long)(size + (size & 1)), SEEK_CUR) != 0)
+      return 0;
+  }
+  return 0;
+}
+
+static FILE *unit_open(const char *dir, int unit, uint32_t *samples) {
+  char path[PATH_MAX_LEN];
+  snprintf(path, sizeof(path), "%s/%s.wav", dir, unit_names[unit]);
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  *samples = wav_open_data(f);
+  if (*samples == 0) {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+local_tts_t *local_tts_load(const char *dir) {
+  if (!dir)
+    return NULL;
+  local_tts_t *lt = calloc(1, sizeof(*lt));
+  if (!lt)
+    return NULL;
+
+  // Sizes first, so all units fit in one allocation
+  uint32_t total = 0;
+  for (int u = 0; u < U_COUNT; u++) {
+    uint32_t samples = 0;
+    FILE *f = unit_open(dir, u, &samples);
+    if (!f)
+      continue;
+    fclose(f);
+    if ((total + samples) * sizeof(int16_t) > LOCAL_TTS_MAX_BYTES)
+      break;
+    lt->offset[u] = total;
+    lt->length[u] = samples;
+    total += samples;
+  }
+  if (total == 0 || !(lt->audio = malloc(total * sizeof(int16_t)))) {
+    free(lt);
+    return NULL;
+  }
+
+  for (int u = 0; u < U_COUNT; u++) {
+    uint32_t samples = 0;
+    FILE *f = lt->length[u] ? unit_open(dir, u, &samples) : NULL;
+    bool ok = f && samples == lt->length[u] &&
+              fread(lt->audio + lt->offset[u], sizeof(int16_t), samples, f) ==
+                  samples;
+    if (f)
+      fclose(f);
+    if (ok) {
+      lt->info.units_loaded++;
+      lt->info.bytes += samples * sizeof(int16_t);
+    } else {
+      lt->length[u] = 0; // Changed on the card since the first pass
+      lt->info.units_missing++;
+    }
+  }
+  if (lt->info.units_loaded == 0) {
+    local_tts_free(lt);
+    return NULL;
+  }
+  return lt;
+}
+
+void local_tts_free(local_tts_t *lt) {
+  if (!lt)
+    return;
+  free(lt->audio);
+  free(lt);
+}
+
+void local_tts_get_info(const local_tts_t *lt, local_tts_info_t *info) {
+  if (!info)
+    return;
+  if (!lt) {
+    memset(info, 0, sizeof(*info));
+    return;
+  }
+  *info = lt->info;
+}
+
+/* ---------- Phrases ---------- */
+
+void local_tts_phrase_clear(local_tts_phrase_t *phrase) {
+  if (phrase)
+    phrase->count = 0;
+}
+
+static bool phrase_add(local_tts_phrase_t *phrase, int unit) {
+  if (!phrase || phrase->count >= LOCAL_TTS_MAX_UNITS)
+    return false;
+  phrase->units[phrase->count++] = (uint8_t)unit;
+  return true;
+}
+
+bool local_tts_phrase_status(local_tts_phrase_t *phrase,
+                             local_tts_status_t status) {
+  if (status < 0 || status >= LOCAL_TTS_STATUS_COUNT)
+    return false;
+  return phrase_add(phrase, U_STATUS + status);
+}
+
+static int digit_unit(unsigned d, local_tts_gender_t gender) {
+  if (gender == LOCAL_TTS_FEMININE && d == 1)
+    return U_N1F;
+  if (gender == LOCAL_TTS_FEMININE && d == 2)
+    return U_N2F;
+  return U_N0 + (int)d;
+}
+
+bool local_tts_phrase_number(local_tts_phrase_t *phrase, unsigned n,
+                             local_tts_gender_t gender) {
+  if (n > 999)
+    return false;
+  if (n == 0)
+    return phrase_add(phrase, U_N0);
+  unsigned rest = n % 100;
+  bool ok = true;
+  if (n >= 100)
+    ok = phrase_add(phrase, U_N100 + (int)(n / 100) - 1);
+  if (rest == 0)
+    return ok;
+  if (rest < 20)
+    return ok && phrase_add(phrase, digit_unit(rest, gender));
+  ok = ok && phrase_add(phrase, U_N20 + (int)(rest / 10) - 2);
+  if (rest % 10)
+    ok = ok && phrase_add(phrase, digit_unit(rest % 10, gender));
+  return ok;
+}
+
+/**
+ * @brief Croatian noun form after a number: 0 = one, 1 = few (2-4), 2 = many
+ */
+static int plural_form(unsigned n) {
+  unsigned tens = n % 100;
+  unsigned ones = n % 10;
+  if (tens >= 11 && tens <= 14)
+    return 2;
+  if (ones == 1)
+    return 0;
+  if (ones >= 2 && ones <= 4)
+    return 1;
+  return 2;
+}
+
+static bool phrase_quantity(local_tts_phrase_t *phrase, unsigned n,
+                            local_tts_gender_t gender, const int forms[3]) {
+  return local_tts_phrase_number(phrase, n, gender) &&
+         phrase_add(phrase, forms[plural_form(n)]);
+}
+
+bool local_tts_phrase_duration(local_tts_phrase_t *phrase, uint32_t seconds) {
+  static const int hour_forms[3] = {U_SAT, U_SATA, U_SATI};
+  static const int minute_forms[3] = {U_MINUTA, U_MINUTE, U_MINUTA};
+  static const int second_forms[3] = {U_SEKUNDA, U_SEKUNDE, U_SEKUNDI};
+
+  unsigned parts[3] = {seconds / 3600, (seconds % 3600) / 60, seconds % 60};
+  if (parts[0] > 999)
+    return false;
+  const int *forms[3] = {hour_forms, minute_forms, second_forms};
+  const local_tts_gender_t genders[3] = {
+      LOCAL_TTS_MASCULINE, LOCAL_TTS_FEMININE, LOCAL_TTS_FEMININE};
+
+  int left = 0;
+  for (int i = 0; i < 3; i++)
+    left += parts[i] != 0;
+  if (left == 0)
+    return phrase_quantity(phrase, 0, LOCAL_TTS_FEMININE, second_forms);
+
+  bool first = true;
+  for (int i = 0; i < 3; i++) {
+    if (parts[i] == 0)
+      continue;
+    // "... i deset sekundi": "i" before the last of several parts
+    if (--left == 0 && !first && !phrase_add(phrase, U_I))
+      return false;
+    if (!phrase_quantity(phrase, parts[i], genders[i], forms[i]))
+      return false;
+    first = false;
+  }
+  return true;
+}
+
+/* ---------- Rendering ---------- */
+
+bool local_tts_can_say(const local_tts_t *lt, const local_tts_phrase_t *phrase) {
+  if (!lt || !phrase || phrase->count == 0)
+    return false;
+  for (int i = 0; i < phrase->count; i++) {
+    if (phrase->units[i] >= U_COUNT || lt->length[phrase->units[i]] == 0)
+      return false;
+  }
+  return true;
+}
+
+uint32_t local_tts_phrase_samples(const local_tts_t *lt,
+                                  const local_tts_phrase_t *phrase) {
+  if (!local_tts_can_say(lt, phrase))
+    return 0;
+  uint32_t total = GAP_SAMPLES * (phrase->count - 1u);
+  for (int i = 0; i < phrase->count; i++)
+    total += lt->length[phrase->units[i]];
+  return total;
+}
+
+void local_tts_reader_init(local_tts_reader_t *reader,
+                           const local_tts_phrase_t *phrase) {
+  if (!reader)
+    return;
+  reader->phrase = phrase;
+  reader->unit = 0;
+  reader->pos = 0;
+}
+
+size_t local_tts_read(const local_tts_t *lt, local_tts_reader_t *reader,
+                      int16_t *out, size_t max_samples) {
+  if (!lt || !reader || !reader->phrase || !out)
+    return 0;
+  const local_tts_phrase_t *phrase = reader->phrase;
+  size_t n = 0;
+  while (n < max_samples && reader->unit < phrase->count) {
+    int unit = phrase->units[reader->unit];
+    uint32_t len = unit < U_COUNT ? lt->length[unit] : 0;
+    bool last = reader->unit == phrase->count - 1;
+    uint32_t span = len + (last ? 0 : GAP_SAMPLES);
+
+    if (reader->pos < len) {
+      // Unit audio, faded in and out so the joins do not click
+      const int16_t *src = lt->audio + lt->offset[unit];
+      while (n < max_samples && reader->pos < len) {
+        uint32_t p = reader->pos++;
+        int32_t s = src[p];
+        if (p < FADE_SAMPLES)
+          s = s * (int32_t)p / FADE_SAMPLES;
+        else if (len - p <= FADE_SAMPLES)
+          s = s * (int32_t)(len - p - 1) / FADE_SAMPLES;
+        out[n++] = (int16_t)s;
+      }
+    } else if (reader->pos < span) {
+      size_t gap = span - reader->pos;
+      if (gap > max_samples - n)
+        gap = max_samples - n;
+      memset(out + n, 0, gap * sizeof(int16_t));
+      n += gap;
+      reader->pos += (uint32_t)gap;
+    }
+    if (reader->pos >= span) {
+      reader->unit++;
+      reader->pos = 0;
+    }
+  }
+  return n;
+}
+
+static void wr_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+int local_tts_write_wav(const local_tts_t *lt, const local_tts_phrase_t *phrase,
+                        FILE *f) {
+  if (!f || !local_tts_can_say(lt, phrase))
+    return -1;
+  uint32_t data_bytes = local_tts_phrase_samples(lt, phrase) * sizeof(int16_t);
+  uint8_t hdr[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                     'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+                     0,   0,   0,   0,   0, 0, 0, 0, 2, 0, 16, 0,
+                     'd', 'a', 't', 'a', 0, 0, 0, 0};
+  wr_le32(hdr + 4, 36 + data_bytes);
+  wr_le32(hdr + 24, LOCAL_TTS_SAMPLE_RATE);
+  wr_le32(hdr + 28, LOCAL_TTS_SAMPLE_RATE * sizeof(int16_t));
+  wr_le32(hdr + 40, data_bytes);
+  if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+    return -1;
+
+  // Host byte order is little-endian on both targets
+  int16_t buf[256];
+  local_tts_reader_t reader;
+  local_tts_reader_init(&reader, phrase);
+  size_t n;
+  while ((n = local_tts_read(lt, &reader, buf, 256)) > 0) {
+    if (fwrite(buf, sizeof(int16_t), n, f) != n)
+      return -1;
+  }
+  return 0;
+}
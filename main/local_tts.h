@@ -0,0 +1,149 @@
+/**
+ * @file local_tts.h
+ * @brief On-device phrase synthesis from pre-recorded units
+ *
+ * When HA is unreachable there is nobody to synthesise speech, so timer
+ * confirmations and errors would only be beeps. This module speaks a small
+ * closed vocabulary instead: numbers 0-999, durations and a few status
+ * phrases in Croatian, built by concatenating recorded words.
+ *
+ * Units are 16 kHz mono 16-bit WAV files named after the unit (`n7.wav`,
+ * `minute.wav`; the list is in local_tts.c, 21 is `n20` + `n1`). They are
+ * loaded once into one buffer (PSRAM on the device), so speaking works
+ * after the SD card has been released for Wi-Fi. Rendering is a copy with a
+ * short fade at each unit edge and a gap between words; the caller pulls
+ * samples in chunks, so no output buffer is needed.
+ *
+ * The module has no ESP-IDF dependencies. On Linux, a phrase can be
+ * rendered to a WAV file with local_tts_write_wav() to check the units and
+ * the grammar.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOCAL_TTS_SAMPLE_RATE 16000
+#define LOCAL_TTS_MAX_UNITS 24 ///< Units in one phrase
+#define LOCAL_TTS_MAX_BYTES (2 * 1024 * 1024) ///< All units together
+
+typedef enum {
+  LOCAL_TTS_HA_UNAVAILABLE = 0, ///< "Home Assistant nije dostupan"
+  LOCAL_TTS_HA_NO_RESPONSE,     ///< "Home Assistant ne odgovara"
+  LOCAL_TTS_ERROR,              ///< "Došlo je do greške"
+  LOCAL_TTS_TIMER_SET,          ///< "Tajmer postavljen na" (+ duration)
+  LOCAL_TTS_TIMER_DONE,         ///< "Tajmer je istekao"
+  LOCAL_TTS_STATUS_COUNT
+} local_tts_status_t;
+
+typedef enum {
+  LOCAL_TTS_MASCULINE = 0, ///< jedan, dva (sat)
+  LOCAL_TTS_FEMININE,      ///< jedna, dvije (minuta, sekunda)
+} local_tts_gender_t;
+
+/**
+ * @brief Sequence of units; built with the local_tts_phrase_* functions
+ */
+typedef struct {
+  uint8_t units[LOCAL_TTS_MAX_UNITS];
+  uint8_t count;
+} local_tts_phrase_t;
+
+/**
+ * @brief Playback position in a phrase
+ */
+typedef struct {
+  const local_tts_phrase_t *phrase;
+  int unit;     ///< Current unit
+  uint32_t pos; ///< Sample in the unit and the gap after it
+} local_tts_reader_t;
+
+typedef struct {
+  int units_loaded;
+  int units_missing;
+  uint32_t bytes; ///< Audio held
+} local_tts_info_t;
+
+typedef struct local_tts local_tts_t;
+
+/**
+ * @brief Load all units found in a directory
+ *
+ * Missing or malformed units are skipped; phrases that need them cannot be
+ * spoken (local_tts_can_say()).
+ *
+ * @return Voice, or NULL if no unit was loaded or out of memory
+ */
+local_tts_t *local_tts_load(const char *dir);
+
+void local_tts_free(local_tts_t *lt);
+
+void local_tts_get_info(const local_tts_t *lt, local_tts_info_t *info);
+
+void local_tts_phrase_clear(local_tts_phrase_t *phrase);
+
+/**
+ * @brief Append a status phrase
+ *
+ * @return false if the phrase is full
+ */
+bool local_tts_phrase_status(local_tts_phrase_t *phrase,
+                             local_tts_status_t status);
+
+/**
+ * @brief Append a number (0-999) in the given gender
+ *
+ * @return false if out of range or the phrase is full
+ */
+bool local_tts_phrase_number(local_tts_phrase_t *phrase, unsigned n,
+                             local_tts_gender_t gender);
+
+/**
+ * @brief Append a duration: "jedan sat, pet minuta i deset sekundi"
+ *
+ * Zero parts are left out; hours above 999 are not supported.
+ *
+ * @return false if out of range or the phrase is full
+ */
+bool local_tts_phrase_duration(local_tts_phrase_t *phrase, uint32_t seconds);
+
+/**
+ * @brief All units of the phrase are loaded
+ */
+bool local_tts_can_say(const local_tts_t *lt, const local_tts_phrase_t *phrase);
+
+/**
+ * @brief Length of the rendered phrase in samples
+ */
+uint32_t local_tts_phrase_samples(const local_tts_t *lt,
+                                  const local_tts_phrase_t *phrase);
+
+void local_tts_reader_init(local_tts_reader_t *reader,
+                           const local_tts_phrase_t *phrase);
+
+/**
+ * @brief Render the next samples of a phrase
+ *
+ * @return Samples written to out, 0 at the end of the phrase
+ */
+size_t local_tts_read(const local_tts_t *lt, local_tts_reader_t *reader,
+                      int16_t *out, size_t max_samples);
+
+/**
+ * @brief Render a whole phrase as a WAV file
+ *
+ * @return 0 on success, -1 on a write error or a missing unit
+ */
+int local_tts_write_wav(const local_tts_t *lt, const local_tts_phrase_t *phrase,
+                        FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,30 +21,44 @@
 // Modules
 #include "alarm_manager.h"
 #include "audio_capture.h"
+#include "boot_sched.h"
 #include "config.h"
+#include "event_bus.h"
 #include "ha_client.h"
 #include "led_status.h"
 #include "local_music_player.h"
+#include "mn_commands.h"
 #include "mqtt_ha.h"
+#include "music_cache.h"
 #include "network_manager.h"
 #include "oled_status.h"
 #include "ota_update.h"
+#include "sd_stream.h"
 #include "settings_manager.h"
 #include "sys_diag.h" // Phase 9
+#include "task_arena.h"
+#include "tts_cache.h"
+#include "audio_rt_monitor.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "va_control.h"
 #include "voice_pipeline.h"
+#include "wake_prompt.h"
 #include "webserial.h"
 #include "wifi_manager.h"
 
 #define TAG "main"
 
 static bool sd_init_done = false;
-static TaskHandle_t post_connect_task_handle = NULL;
+static network_type_t last_connected_type = NETWORK_TYPE_NONE;
+static volatile bool post_connect_pending = false;
 static char ota_url_value[256] = {0};
-static TaskHandle_t music_control_task_handle = NULL;
+static volatile bool music_control_pending = false;
 static bool audio_hw_ready = false;
 static TaskHandle_t metrics_task_handle = NULL;
 static TaskHandle_t led_ready_task_handle = NULL;
+static app_settings_t boot_settings;
+static bool boot_safe_mode = false;
 
 static const char *ota_state_to_string(ota_state_t state);
 static const char *music_state_to_string(music_state_t state);
@@ -66,7 +80,7 @@ typedef enum {
   MUSIC_CMD_STOP = 1,
 } music_cmd_t;
 
-static void music_control_task(void *arg) {
+static void music_control_job(void *arg) {
   music_cmd_t cmd = (music_cmd_t)(uintptr_t)arg;
 
   if (cmd == MUSIC_CMD_PLAY) {
@@ -116,8 +130,7 @@ static void music_control_task(void *arg) {
     voice_pipeline_start();
   }
 
-  music_control_task_handle = NULL;
-  vTaskDelete(NULL);
+  music_control_pending = false;
 }
 
 static const char *ota_state_to_string(ota_state_t state) {
@@ -186,6 +199,19 @@ static void mqtt_update_music_state(music_state_t state, int current_track,
   } else {
     mqtt_ha_update_sensor("current_track", "None");
   }
+
+  music_playback_stats_t stats;
+  if (local_music_player_get_stats(&stats) == ESP_OK) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned)stats.last_gap_samples);
+    mqtt_ha_update_sensor("music_gap", buf);
+  }
+
+  sd_stream_stats_t sd_stats;
+  sd_stream_get_stats(&sd_stats);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)sd_stats.underruns);
+  mqtt_ha_update_sensor("sd_underruns", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)sd_stream_get_throughput_kbps());
+  mqtt_ha_update_sensor("sd_throughput", buf);
 }
 
 static void mqtt_publish_telemetry(void) {
@@ -204,6 +230,98 @@ static void mqtt_publish_telemetry(void) {
 
   network_type_t active = network_manager_get_active_type();
   mqtt_ha_update_sensor("network_type", network_manager_type_to_string(active));
+  snprintf(buf, sizeof(buf), "%u",
+           (unsigned)network_manager_get_last_failover_ms());
+  mqtt_ha_update_sensor("failover_time", buf);
+  snprintf(buf, sizeof(buf), "%u",
+           (unsigned)boot_sched_get_done_ms("wake_word"));
+  mqtt_ha_update_sensor("boot_wake_ready", buf);
+  audio_capture_load_stats_t load;
+  if (audio_capture_get_load_stats(&load) == ESP_OK) {
+    snprintf(buf, sizeof(buf), "%u", (unsigned)load.total_ms);
+    mqtt_ha_update_sensor("model_load_time", buf);
+    snprintf(buf, sizeof(buf), "%ld",
+             (long)(load.internal_bytes + load.psram_bytes));
+    mqtt_ha_update_sensor("model_heap", buf);
+  }
+  snprintf(buf, sizeof(buf), "%u",
+           (unsigned)audio_capture_get_callback_max_us());
+  mqtt_ha_update_sensor("audio_callback_max", buf);
+  snprintf(buf, sizeof(buf), "%.1f", audio_capture_get_afe_load());
+  mqtt_ha_update_sensor("afe_load", buf);
+  audio_capture_wake_stats_t wake;
+  audio_capture_get_wake_stats(&wake);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)wake.rejected);
+  mqtt_ha_update_sensor("wake_rejected", buf);
+  event_bus_stats_t bus;
+  event_bus_get_stats(&bus);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)bus.max_latency_us);
+  mqtt_ha_update_sensor("event_latency_max", buf);
+  vp_fsm_t fsm_stats;
+  if (voice_pipeline_get_fsm_stats(&fsm_stats) == ESP_OK) {
+    snprintf(buf, sizeof(buf), "%u",
+             (unsigned)(fsm_stats.states[VP_STATE_AWAITING_RESPONSE].last_us /
+                        1000));
+    mqtt_ha_update_sensor("va_response_time", buf);
+  }
+  voice_pipeline_run_stats_t runs;
+  voice_pipeline_get_run_stats(&runs);
+  snprintf(buf, sizeof(buf), "%u",
+           runs.runs ? (unsigned)(runs.offline_runs * 100 / runs.runs) : 0);
+  mqtt_ha_update_sensor("offline_handled", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)runs.offline_avg_ms);
+  mqtt_ha_update_sensor("offline_latency", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)runs.ha_avg_ms);
+  mqtt_ha_update_sensor("ha_latency", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)runs.false_wakes);
+  mqtt_ha_update_sensor("false_wakes", buf);
+  tts_cache_stats_t tts_cache;
+  tts_cache_get_stats(&tts_cache);
+  snprintf(buf, sizeof(buf), "%u",
+           tts_cache.lookups
+               ? (unsigned)(tts_cache.hits * 100 / tts_cache.lookups)
+               : 0);
+  mqtt_ha_update_sensor("tts_cache_hit_rate", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)(tts_cache.bytes_saved / 1024));
+  mqtt_ha_update_sensor("tts_cache_saved", buf);
+  for (int core = 0; core < 2; core++) {
+    float idle = sys_diag_get_cpu_idle(core);
+    if (idle >= 0.0f) {
+      snprintf(buf, sizeof(buf), "%.1f", (double)idle);
+      mqtt_ha_update_sensor(core ? "cpu_idle_core1" : "cpu_idle_core0", buf);
+    }
+  }
+  snprintf(buf, sizeof(buf), "%u", (unsigned)sys_diag_get_budget_misses());
+  mqtt_ha_update_sensor("task_budget_misses", buf);
+  char tasks[256]; // HA state limit
+  if (sys_diag_format_task_stats(tasks, sizeof(tasks), 8) > 0) {
+    mqtt_ha_update_sensor("task_load", tasks);
+  }
+  audio_rt_stats_t audio_rt;
+  audio_rt_get_stats(&audio_rt);
+  snprintf(buf, sizeof(buf), "%u",
+           (unsigned)(audio_rt.rx_overruns + audio_rt.tx_underruns));
+  mqtt_ha_update_sensor("audio_xruns", buf);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)audio_rt.glitch_seconds);
+  mqtt_ha_update_sensor("audio_glitches", buf);
+  if (audio_rt_format(tasks, sizeof(tasks)) > 0) {
+    mqtt_ha_update_sensor("audio_rt", tasks);
+  }
+  mem_track_heap_t heap;
+  mem_track_get_heap(false, &heap);
+  snprintf(buf, sizeof(buf), "%u", (unsigned)(heap.largest_block / 1024));
+  mqtt_ha_update_sensor("heap_largest_block", buf);
+  snprintf(buf, sizeof(buf), "%u", heap.frag_pct);
+  mqtt_ha_update_sensor("heap_fragmentation", buf);
+  mem_track_get_heap(true, &heap);
+  snprintf(buf, sizeof(buf), "%u", heap.frag_pct);
+  mqtt_ha_update_sensor("psram_fragmentation", buf);
+  if (mem_track_format(tasks, sizeof(tasks)) > 0) {
+    mqtt_ha_update_sensor("mem_modules", tasks);
+  }
+  if (task_arena_format(tasks, sizeof(tasks)) > 0) {
+    mqtt_ha_update_sensor("task_arena", tasks);
+  }
 
   int rssi = 0;
   if (get_wifi_rssi(&rssi)) {
@@ -276,7 +394,7 @@ static void ota_progress_handler(ota_state_t state, int progress,
   mqtt_ha_update_sensor("ota_progress", buf);
 }
 
-static void post_connect_task(void *arg) {
+static void post_connect_job(void *arg) {
   network_type_t type = (network_type_t)(uintptr_t)arg;
 
   char ip_str[16];
@@ -288,6 +406,17 @@ static void post_connect_task(void *arg) {
   ESP_LOGI(TAG, "Network Connected: %s (IP: %s)",
            network_manager_type_to_string(type), ip_str);
 
+  // Sockets opened on the previous interface keep its source address and
+  // would only fail at keepalive; rebind HA and MQTT on the new link now
+  if (last_connected_type != NETWORK_TYPE_NONE && last_connected_type != type) {
+    ESP_LOGI(TAG, "Network changed (%s -> %s), reconnecting HA and MQTT",
+             network_manager_type_to_string(last_connected_type),
+             network_manager_type_to_string(type));
+    (void)ha_client_request_reconnect("network changed");
+    (void)mqtt_ha_reconnect();
+  }
+  last_connected_type = type;
+
   if (mqtt_ha_is_connected()) {
     mqtt_ha_update_sensor("ip_address", ip_str);
   }
@@ -297,18 +426,41 @@ static void post_connect_task(void *arg) {
   webserial_init();
 
   // SD/music init can be slow; keep it out of the network event loop task.
+  // In WiFi standby the SDIO lines belong to WiFi even on Ethernet
   if (!sys_diag_is_safe_mode() && !sd_init_done &&
-      type == NETWORK_TYPE_ETHERNET) {
+      type == NETWORK_TYPE_ETHERNET && !network_manager_is_wifi_standby()) {
     if (bsp_sdcard_mount() == ESP_OK) {
       ESP_LOGI(TAG, "SD Card mounted");
-      local_music_player_init();
-      local_music_player_register_callback(NULL); // Or proper callback
+      music_cache_resume();
+      tts_cache_set_spill(true);
+      // Loaded into PSRAM once, so the prompt survives the next release
+      wake_prompt_init();
+      (void)voice_pipeline_load_voice(VOICE_PIPELINE_VOICE_DIR);
+      (void)voice_pipeline_load_intents(VOICE_PIPELINE_INTENTS_PATH);
+      (void)mn_commands_load(MN_COMMANDS_PATH);
+      // Continues a track that was playing from the cache during fallback
+      local_music_player_use_library();
+      local_music_player_register_callback(music_state_callback);
       sd_init_done = true;
     }
   }
 
-  post_connect_task_handle = NULL;
-  vTaskDelete(NULL);
+  post_connect_pending = false;
+}
+
+/**
+ * @brief Run a music command on the control worker, one at a time
+ */
+static void submit_music_control(music_cmd_t cmd) {
+  if (music_control_pending) {
+    return;
+  }
+  music_control_pending = true;
+  if (task_arena_submit_control(music_control_job, (void *)(uintptr_t)cmd) !=
+      ESP_OK) {
+    ESP_LOGW(TAG, "Job queue full, music command %d dropped", cmd);
+    music_control_pending = false;
+  }
 }
 
 // MQTT Callbacks (Keep implementation same)
@@ -337,28 +489,158 @@ static void mqtt_diagnostic_dump_callback(const char *entity_id,
   (void)entity_id;
   (void)payload;
   sys_diag_report_status();
+  audio_rt_log_report();
+  mem_place_bench_log();
+  task_arena_log_report();
+  char report[256];
+  if (audio_rt_format(report, sizeof(report)) > 0) {
+    mqtt_ha_update_sensor("audio_rt", report);
+  }
 }
 
 static void mqtt_music_play_callback(const char *entity_id,
                                      const char *payload) {
   (void)entity_id;
   (void)payload;
-  if (music_control_task_handle == NULL) {
-    xTaskCreate(music_control_task, "music_ctl", 4096,
-                (void *)(uintptr_t)MUSIC_CMD_PLAY, 5,
-                &music_control_task_handle);
-  }
+  submit_music_control(MUSIC_CMD_PLAY);
 }
 
 static void mqtt_music_stop_callback(const char *entity_id,
                                      const char *payload) {
   (void)entity_id;
   (void)payload;
-  if (music_control_task_handle == NULL) {
-    xTaskCreate(music_control_task, "music_ctl", 4096,
-                (void *)(uintptr_t)MUSIC_CMD_STOP, 5,
-                &music_control_task_handle);
+  submit_music_control(MUSIC_CMD_STOP);
+}
+
+static void mqtt_music_duck_level_callback(const char *entity_id,
+                                           const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  char *end = NULL;
+  float v = strtof(payload, &end);
+  if (end == payload) {
+    ESP_LOGW(TAG, "Invalid music duck level payload: %s", payload);
+    return;
+  }
+  if (v < 0.0f)
+    v = 0.0f;
+  if (v > 100.0f)
+    v = 100.0f;
+
+  local_music_player_set_duck_level((uint8_t)lroundf(v));
+  mqtt_ha_update_number("music_duck_level",
+                        (float)local_music_player_get_duck_level());
+}
+
+static void mqtt_music_shuffle_callback(const char *entity_id,
+                                        const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  bool enable = (strcmp(payload, "ON") == 0);
+  if (local_music_player_set_shuffle(enable) != ESP_OK) {
+    ESP_LOGW(TAG, "Shuffle needs the local music player (SD card)");
+  }
+  mqtt_ha_update_switch("music_shuffle", local_music_player_get_shuffle());
+}
+
+static void mqtt_wifi_standby_callback(const char *entity_id,
+                                      const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  // Applied at boot: standby WiFi and the SD card exclude each other
+  bool enable = (strcmp(payload, "ON") == 0);
+  app_settings_t s;
+  if (settings_manager_load(&s) == ESP_OK && s.wifi_standby != enable) {
+    s.wifi_standby = enable;
+    (void)settings_manager_save(&s);
+    ESP_LOGI(TAG, "WiFi standby %s - takes effect after restart",
+             enable ? "enabled" : "disabled");
   }
+  mqtt_ha_update_switch("wifi_standby", enable);
+}
+
+static void mqtt_offline_commands_callback(const char *entity_id,
+                                           const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  bool enable = (strcmp(payload, "ON") == 0);
+  voice_pipeline_set_offline_commands(enable);
+  app_settings_t s;
+  if (settings_manager_load(&s) == ESP_OK && s.offline_commands != enable) {
+    s.offline_commands = enable;
+    (void)settings_manager_save(&s);
+  }
+  mqtt_ha_update_switch("offline_commands", enable);
+}
+
+static void mqtt_wake2_route_callback(const char *entity_id,
+                                      const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  if (voice_pipeline_set_wake_route(1, payload) != ESP_OK) {
+    ESP_LOGW(TAG, "Invalid wake word 2 route: %s", payload);
+    return;
+  }
+  app_settings_t s;
+  if (settings_manager_load(&s) == ESP_OK) {
+    strncpy(s.wake2_route, payload, sizeof(s.wake2_route) - 1);
+    s.wake2_route[sizeof(s.wake2_route) - 1] = '\0';
+    (void)settings_manager_save(&s);
+  }
+  mqtt_ha_update_text("wake2_route", payload);
+}
+
+static void mqtt_wake2_threshold_callback(const char *entity_id,
+                                          const char *payload) {
+  (void)entity_id;
+  if (!payload)
+    return;
+
+  char *end = NULL;
+  float v = strtof(payload, &end);
+  if (end == payload) {
+    ESP_LOGW(TAG, "Invalid wake word 2 threshold payload: %s", payload);
+    return;
+  }
+  if (v < 0.5f)
+    v = 0.5f;
+  if (v > 0.95f)
+    v = 0.95f;
+
+  esp_err_t err = audio_capture_set_wake_threshold(1, v);
+  if (err == ESP_ERR_NOT_SUPPORTED) {
+    ESP_LOGW(TAG, "Second wake word is in the second WakeNet model, its "
+                  "threshold cannot be changed");
+    return;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "No second wake word loaded");
+    return;
+  }
+  app_settings_t s;
+  if (settings_manager_load(&s) == ESP_OK) {
+    s.wake2_threshold = v;
+    (void)settings_manager_save(&s);
+  }
+  mqtt_ha_update_number("wake2_threshold", v);
+}
+
+static void mqtt_simulate_link_down_callback(const char *entity_id,
+                                             const char *payload) {
+  (void)entity_id;
+  (void)payload;
+  ESP_LOGW(TAG, "Simulating Ethernet link loss");
+  network_manager_force_wifi_fallback();
 }
 
 static void mqtt_led_test_callback(const char *entity_id, const char *payload) {
@@ -592,9 +874,7 @@ static void mqtt_vad_max_recording_callback(const char *entity_id,
 
 static void mqtt_setup_task(void *arg) {
   ESP_LOGI(TAG, "Waiting for MQTT connection...");
-  while (!mqtt_ha_is_connected()) {
-    vTaskDelay(pdMS_TO_TICKS(500));
-  }
+  mqtt_ha_wait_connected(UINT32_MAX);
 
   ESP_LOGI(TAG, "Registering HA Entities...");
 
@@ -619,12 +899,59 @@ static void mqtt_setup_task(void *arg) {
   mqtt_ha_register_sensor("uptime", "Uptime", "s", NULL);
   mqtt_ha_register_sensor("firmware_version", "Firmware Version", NULL, NULL);
   mqtt_ha_register_sensor("network_type", "Network Type", NULL, NULL);
+  mqtt_ha_register_sensor("failover_time", "Network Failover Time", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("boot_wake_ready", "Boot to Wake Word Ready", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("model_load_time", "Model Load Time", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("model_heap", "Model Heap Usage", "B", "data_size");
+  mqtt_ha_register_sensor("audio_callback_max", "Audio Callback Max", "µs",
+                          "duration");
+  mqtt_ha_register_sensor("afe_load", "AFE CPU Load", "%", NULL);
+  mqtt_ha_register_sensor("wake_rejected", "Wake Words Rejected", NULL, NULL);
+  mqtt_ha_register_sensor("false_wakes", "Wakes Without Speech", NULL, NULL);
+  mqtt_ha_register_sensor("event_latency_max", "Event Dispatch Latency Max",
+                          "µs", "duration");
+  mqtt_ha_register_sensor("va_response_time", "HA Response Time", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("offline_handled", "Handled Offline", "%", NULL);
+  mqtt_ha_register_sensor("offline_latency", "Offline Command Latency", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("ha_latency", "HA Pipeline Latency", "ms",
+                          "duration");
+  mqtt_ha_register_sensor("tts_cache_hit_rate", "TTS Cache Hit Rate", "%",
+                          NULL);
+  mqtt_ha_register_sensor("tts_cache_saved", "TTS Cache Bytes Saved", "KiB",
+                          "data_size");
+  mqtt_ha_register_sensor("cpu_idle_core0", "CPU Idle Core 0", "%", NULL);
+  mqtt_ha_register_sensor("cpu_idle_core1", "CPU Idle Core 1", "%", NULL);
+  mqtt_ha_register_sensor("task_load", "Busiest Tasks", NULL, NULL);
+  mqtt_ha_register_sensor("task_budget_misses", "Task Budget Misses", NULL,
+                          NULL);
+  mqtt_ha_register_sensor("task_alert", "Task Budget Alert", NULL, NULL);
+  mqtt_ha_register_sensor("audio_xruns", "Audio I2S Overruns/Underruns", NULL,
+                          NULL);
+  mqtt_ha_register_sensor("audio_glitches", "Audio Glitch Seconds", NULL,
+                          NULL);
+  mqtt_ha_register_sensor("audio_rt", "Audio Real-Time Report", NULL, NULL);
+  mqtt_ha_register_sensor("heap_largest_block", "Internal RAM Largest Block",
+                          "KiB", "data_size");
+  mqtt_ha_register_sensor("heap_fragmentation", "Internal RAM Fragmentation",
+                          "%", NULL);
+  mqtt_ha_register_sensor("psram_fragmentation", "PSRAM Fragmentation", "%",
+                          NULL);
+  mqtt_ha_register_sensor("mem_modules", "Memory by Module", NULL, NULL);
+  mqtt_ha_register_sensor("task_arena", "Task Stack Arena", NULL, NULL);
   mqtt_ha_register_sensor("webserial_requests", "WebSerial Requests", NULL,
                           NULL);
   mqtt_ha_register_sensor("agc_current_gain", "AGC Current Gain", NULL, NULL);
   mqtt_ha_register_sensor("music_state", "Music State", NULL, NULL);
   mqtt_ha_register_sensor("current_track", "Current Track", NULL, NULL);
   mqtt_ha_register_sensor("total_tracks", "Total Tracks", NULL, NULL);
+  mqtt_ha_register_sensor("music_gap", "Music Track Gap", "samples", NULL);
+  mqtt_ha_register_sensor("sd_underruns", "SD Read Underruns", NULL, NULL);
+  mqtt_ha_register_sensor("sd_throughput", "SD Read Throughput", "KB/s", NULL);
   mqtt_ha_register_sensor("sd_card_status", "SD Card Status", NULL, NULL);
   mqtt_ha_register_sensor("ota_status", "OTA Status", NULL, NULL);
   mqtt_ha_register_sensor("ota_progress", "OTA Progress", "%", NULL);
@@ -643,6 +970,10 @@ static void mqtt_setup_task(void *arg) {
                           "", mqtt_agc_target_callback);
   mqtt_ha_register_number("wwd_detection_threshold", "WWD Detection Threshold",
                           0.5f, 0.95f, 0.01f, "", mqtt_wwd_threshold_callback);
+  mqtt_ha_register_number("wake2_threshold", "Wake Word 2 Threshold", 0.5f,
+                          0.95f, 0.01f, "", mqtt_wake2_threshold_callback);
+  mqtt_ha_register_text("wake2_route", "Wake Word 2 Route",
+                        mqtt_wake2_route_callback);
 
   mqtt_ha_register_text("ota_url_input", "OTA URL", mqtt_ota_url_callback);
   mqtt_ha_register_button("ota_trigger", "Start OTA",
@@ -650,7 +981,17 @@ static void mqtt_setup_task(void *arg) {
 
   mqtt_ha_register_button("music_play", "Play Music", mqtt_music_play_callback);
   mqtt_ha_register_button("music_stop", "Stop Music", mqtt_music_stop_callback);
+  mqtt_ha_register_switch("music_shuffle", "Shuffle Music",
+                          mqtt_music_shuffle_callback);
+  mqtt_ha_register_number("music_duck_level", "Music Level Under TTS", 0, 100,
+                          5, "%", mqtt_music_duck_level_callback);
   mqtt_ha_register_button("led_test", "LED Test", mqtt_led_test_callback);
+  mqtt_ha_register_switch("wifi_standby", "WiFi Warm Standby",
+                          mqtt_wifi_standby_callback);
+  mqtt_ha_register_button("simulate_link_down", "Simulate Ethernet Loss",
+                          mqtt_simulate_link_down_callback);
+  mqtt_ha_register_switch("offline_commands", "Offline Commands",
+                          mqtt_offline_commands_callback);
 
   // VAD Configuration Entities
   mqtt_ha_register_number("vad_threshold", "VAD Threshold", 0, 1000, 10, "",
@@ -666,6 +1007,10 @@ static void mqtt_setup_task(void *arg) {
   mqtt_ha_update_switch("wwd_enabled", true);
   mqtt_ha_update_switch("auto_gain_control", va_control_get_agc_enabled());
   mqtt_ha_update_switch("led_status_indicator", led_status_is_enabled());
+  mqtt_ha_update_switch("music_shuffle", local_music_player_get_shuffle());
+  mqtt_ha_update_switch("wifi_standby", network_manager_is_wifi_standby());
+  mqtt_ha_update_switch("offline_commands",
+                        voice_pipeline_get_offline_commands());
 
   // Publish current IP once MQTT is up (covers cases where network connected
   // earlier).
@@ -677,10 +1022,19 @@ static void mqtt_setup_task(void *arg) {
   // Publish initial LED brightness and OTA URL state.
   mqtt_ha_update_number("led_brightness", (float)led_status_get_brightness());
   mqtt_ha_update_number("output_volume", (float)bsp_extra_codec_volume_get());
+  mqtt_ha_update_number("music_duck_level",
+                        (float)local_music_player_get_duck_level());
   mqtt_ha_update_number("agc_target_level",
                         (float)va_control_get_agc_target_level());
   mqtt_ha_update_number("wwd_detection_threshold",
                         va_control_get_wwd_threshold());
+  app_settings_t wake_settings;
+  if (settings_manager_load(&wake_settings) == ESP_OK) {
+    mqtt_ha_update_text("wake2_route", wake_settings.wake2_route);
+    if (wake_settings.wake2_threshold > 0.0f) {
+      mqtt_ha_update_number("wake2_threshold", wake_settings.wake2_threshold);
+    }
+  }
 
   // Publish initial VAD settings
   mqtt_ha_update_number("vad_threshold", (float)va_control_get_vad_threshold());
@@ -714,9 +1068,13 @@ static void mqtt_setup_task(void *arg) {
 
 static void network_event_callback(network_type_t type, bool connected) {
   if (connected) {
-    if (post_connect_task_handle == NULL) {
-      xTaskCreate(post_connect_task, "net_post", 4096, (void *)(uintptr_t)type,
-                  5, &post_connect_task_handle);
+    if (!post_connect_pending) {
+      post_connect_pending = true;
+      if (task_arena_submit_job(post_connect_job, (void *)(uintptr_t)type) !=
+          ESP_OK) {
+        ESP_LOGW(TAG, "Job queue full, post-connect setup skipped");
+        post_connect_pending = false;
+      }
     }
     if (type == NETWORK_TYPE_ETHERNET) {
       oled_status_set_last_event("eth-up");
@@ -785,8 +1143,12 @@ static void sdcard_release_for_wifi_fallback(void) {
   }
 
   ESP_LOGI(TAG, "Releasing SD card for WiFi fallback");
+  // The C6 SDIO link and the card share the bus, so the card has to go;
+  // recently played tracks keep playing from PSRAM
+  music_cache_suspend();
+  tts_cache_set_spill(false); // Waits for an answer being written
   if (local_music_player_is_initialized()) {
-    local_music_player_deinit();
+    local_music_player_use_cache();
   }
 
   esp_err_t ret = bsp_sdcard_unmount();
@@ -796,109 +1158,194 @@ static void sdcard_release_for_wifi_fallback(void) {
   sd_init_done = false;
 }
 
-void app_main(void) {
-  // 1. NVS Init
-  esp_err_t ret = nvs_flash_init();
-  if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
-      ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    ret = nvs_flash_init();
+/* ---------- Boot steps (run in parallel by boot_sched) ---------- */
+
+static esp_err_t boot_step_settings(void) {
+  if (settings_manager_load(&boot_settings) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to load settings!");
   }
-  ESP_ERROR_CHECK(ret);
 
-  // 2. System Diagnostics (Boot Loop Protection)
-  bool safe_mode = (sys_diag_init() != ESP_OK);
+  // Load persisted OTA URL
+  if (boot_settings.ota_url[0] != '\0') {
+    strncpy(ota_url_value, boot_settings.ota_url, sizeof(ota_url_value) - 1);
+    ota_url_value[sizeof(ota_url_value) - 1] = '\0';
+    ESP_LOGI(TAG, "Loaded OTA URL from settings: %s", ota_url_value);
+  }
+  return ESP_OK;
+}
 
-  if (safe_mode) {
-    ESP_LOGE(TAG, "STARTING IN SAFE MODE (Audio disabled)");
-    // Init minimal LED
-    led_status_init();
-    led_status_set(LED_STATUS_ERROR); // Red Blink
-  } else {
-    ESP_LOGI(TAG, "Starting ESP32-P4 Voice Assistant (Normal Mode)");
-    // 3. Hardware Init (Codec, LED)
-    ESP_LOGI(TAG, "Initializing Hardware...");
-    ESP_ERROR_CHECK(bsp_extra_codec_init());
-    bsp_extra_codec_volume_set(60, NULL);
-    bsp_extra_player_init();
-    audio_hw_ready = true;
+static esp_err_t boot_step_codec(void) {
+  ESP_LOGI(TAG, "Initializing Hardware...");
+  ESP_ERROR_CHECK(bsp_extra_codec_init());
+  // Apply persisted output volume (default 60)
+  bsp_extra_codec_volume_set(boot_settings.output_volume, NULL);
+  audio_hw_ready = true;
+  return ESP_OK;
+}
 
-    led_status_init();
-    led_status_set(LED_STATUS_BOOTING);
-  }
+static esp_err_t boot_step_led(void) {
+  led_status_init();
+  // Safe mode: red blink
+  led_status_set(boot_safe_mode ? LED_STATUS_ERROR : LED_STATUS_BOOTING);
+  return ESP_OK;
+}
 
+static esp_err_t boot_step_oled(void) {
   oled_status_init();
-  oled_status_set_safe_mode(safe_mode);
-  oled_status_set_last_event(safe_mode ? "safe-on" : "boot");
+  oled_status_set_safe_mode(boot_safe_mode);
+  oled_status_set_last_event(boot_safe_mode ? "safe-on" : "boot");
+  oled_status_set_ota_url_present(ota_url_value[0] != '\0');
+  return ESP_OK;
+}
 
+static esp_err_t boot_step_ota(void) {
   // OTA module (available in both normal and safe mode)
   ota_update_init();
   ota_update_register_callback(ota_progress_handler);
+  return ESP_OK;
+}
 
-  // 4. Watchdog Init (30 seconds timeout)
-  sys_diag_wdt_init(30);
+static esp_err_t boot_step_network(void) {
+  network_manager_register_callback(network_event_callback);
+  // MQTT and HA clients retry on their own once a link comes up, so a
+  // failed bring-up must not skip them
+  if (network_manager_init() != ESP_OK) {
+    ESP_LOGW(TAG, "No network yet");
+  }
+  return ESP_OK;
+}
 
-  // 5. Load Settings
-  app_settings_t settings;
-  if (settings_manager_load(&settings) != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to load settings!");
+static esp_err_t boot_step_mqtt(void) {
+  mqtt_ha_config_t mqtt_conf = {
+      .broker_uri = boot_settings.mqtt_broker_uri,
+      // Treat empty strings as "not set" so MQTT auth is truly optional.
+      .username = (boot_settings.mqtt_username[0] != '\0')
+                      ? boot_settings.mqtt_username
+                      : NULL,
+      .password = (boot_settings.mqtt_password[0] != '\0')
+                      ? boot_settings.mqtt_password
+                      : NULL,
+      .client_id = boot_settings.mqtt_client_id};
+  esp_err_t ret = mqtt_ha_init(&mqtt_conf);
+  if (ret != ESP_OK) {
+    return ret;
   }
+  mqtt_ha_start();
+  xTaskCreate(mqtt_setup_task, "mqtt_setup", 4096, NULL, 5, NULL);
+  return ESP_OK;
+}
 
-  // Apply persisted output volume (default 60)
-  if (!safe_mode) {
-    bsp_extra_codec_volume_set(settings.output_volume, NULL);
+static esp_err_t boot_step_ha_client(void) {
+  ha_client_config_t ha_conf = {.hostname = boot_settings.ha_hostname,
+                                .port = boot_settings.ha_port,
+                                .access_token = boot_settings.ha_token,
+                                .use_ssl = boot_settings.ha_use_ssl};
+  (void)tts_cache_init();
+  // Waits for authentication; the websocket keeps retrying on its own
+  if (ha_client_init(&ha_conf) != ESP_OK) {
+    ESP_LOGW(TAG, "Home Assistant not connected yet");
   }
+  return ESP_OK;
+}
 
-  // Load persisted OTA URL
-  if (settings.ota_url[0] != '\0') {
-    strncpy(ota_url_value, settings.ota_url, sizeof(ota_url_value) - 1);
-    ota_url_value[sizeof(ota_url_value) - 1] = '\0';
-    ESP_LOGI(TAG, "Loaded OTA URL from settings: %s", ota_url_value);
+static esp_err_t boot_step_voice_pipeline(void) {
+  ESP_LOGI(TAG, "Initializing Voice Pipeline...");
+  ESP_ERROR_CHECK(voice_pipeline_init());
+  voice_pipeline_set_offline_commands(boot_settings.offline_commands);
+  (void)voice_pipeline_set_wake_route(1, boot_settings.wake2_route);
+  if (boot_settings.wake2_threshold > 0.0f &&
+      audio_capture_set_wake_threshold(1, boot_settings.wake2_threshold) ==
+          ESP_ERR_NOT_SUPPORTED) {
+    ESP_LOGW(TAG, "Saved wake word 2 threshold ignored: second WakeNet model");
   }
-  oled_status_set_ota_url_present(ota_url_value[0] != '\0');
+  audio_capture_wake_words_t words;
+  if (audio_capture_get_wake_words(&words) == ESP_OK && words.count > 1) {
+    ESP_LOGI(TAG, "Wake words: %s (HA), %s (%s)", words.names[0],
+             words.names[1],
+             boot_settings.wake2_route[0] ? boot_settings.wake2_route : "HA");
+  }
+  return ESP_OK;
+}
 
-  // 6. Network Init
-  network_manager_register_callback(network_event_callback);
-  network_manager_init();
+static esp_err_t boot_step_wake_prompt(void) {
+  // Non-fatal if the files are missing (beep fallback); loaded again when
+  // the SD card is mounted
+  wake_prompt_init();
+  (void)voice_pipeline_load_voice(VOICE_PIPELINE_VOICE_DIR);
+  return ESP_OK;
+}
 
-  mqtt_ha_config_t mqtt_conf = {
-      .broker_uri = settings.mqtt_broker_uri,
-      // Treat empty strings as "not set" so MQTT auth is truly optional.
-      .username =
-          (settings.mqtt_username[0] != '\0') ? settings.mqtt_username : NULL,
-      .password =
-          (settings.mqtt_password[0] != '\0') ? settings.mqtt_password : NULL,
-      .client_id = settings.mqtt_client_id};
-  mqtt_ha_init(&mqtt_conf);
-  mqtt_ha_start();
+static esp_err_t boot_step_alarms(void) { return alarm_manager_init(); }
 
-  // 7. Core Systems (Skip in Safe Mode)
-  if (!safe_mode) {
-    ha_client_config_t ha_conf = {.hostname = settings.ha_hostname,
-                                  .port = settings.ha_port,
-                                  .access_token = settings.ha_token,
-                                  .use_ssl = settings.ha_use_ssl};
-    ha_client_init(&ha_conf);
+static esp_err_t boot_step_wake_word(void) {
+  local_music_player_register_callback(music_state_callback);
 
-    ESP_LOGI(TAG, "Initializing Voice Pipeline...");
-    ESP_ERROR_CHECK(voice_pipeline_init());
+  ESP_LOGI(TAG, "System Ready. Waiting for Wake Word...");
+  led_status_set(LED_STATUS_IDLE);
+  voice_pipeline_start();
+  if (led_ready_task_handle == NULL) {
+    xTaskCreate(led_ready_task, "led_ready", 2048, NULL, 2,
+                &led_ready_task_handle);
+  }
+  ESP_LOGI(TAG, "Wake word ready %lld ms after reset",
+           esp_timer_get_time() / 1000);
+  return ESP_OK;
+}
 
-    alarm_manager_init();
-    local_music_player_register_callback(music_state_callback);
+void app_main(void) {
+  // 1. NVS Init
+  esp_err_t ret = nvs_flash_init();
+  if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
+      ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    ret = nvs_flash_init();
+  }
+  ESP_ERROR_CHECK(ret);
 
-    ESP_LOGI(TAG, "System Ready. Waiting for Wake Word...");
-    led_status_set(LED_STATUS_IDLE);
-    voice_pipeline_start();
-    if (led_ready_task_handle == NULL) {
-      xTaskCreate(led_ready_task, "led_ready", 2048, NULL, 2,
-                  &led_ready_task_handle);
-    }
+  // 2. System Diagnostics (Boot Loop Protection)
+  boot_safe_mode = (sys_diag_init() != ESP_OK);
+  if (boot_safe_mode) {
+    ESP_LOGE(TAG, "STARTING IN SAFE MODE (Audio disabled)");
+  } else {
+    ESP_LOGI(TAG, "Starting ESP32-P4 Voice Assistant (Normal Mode)");
+  }
+
+  // Task stacks are reserved now, before anything can fragment the heap
+  ESP_ERROR_CHECK(task_arena_init());
+
+  // 3. Watchdog Init (30 seconds timeout); this task feeds it below
+  sys_diag_wdt_init(30);
+  (void)sys_diag_task_stats_start();
+  (void)audio_rt_monitor_init();
+
+  // 4. Subsystems, each started as soon as its dependencies are up. Model
+  // loading, network bring-up and HA authentication overlap.
+  boot_sched_add("settings", boot_step_settings, NULL);
+  boot_sched_add("led", boot_step_led, NULL);
+  boot_sched_add("oled", boot_step_oled, "settings");
+  boot_sched_add("ota", boot_step_ota, NULL);
+  // post_connect reports through the OLED
+  boot_sched_add("network", boot_step_network, "oled");
+  boot_sched_add("mqtt", boot_step_mqtt, "settings, network");
+
+  // 5. Core Systems (Skip in Safe Mode)
+  if (!boot_safe_mode) {
+    boot_sched_add("codec", boot_step_codec, "settings");
+    boot_sched_add("ha_client", boot_step_ha_client, "settings, network");
+    boot_sched_add("voice_pipeline", boot_step_voice_pipeline, "codec, led");
+    boot_sched_add("wake_prompt", boot_step_wake_prompt, NULL);
+    boot_sched_add("alarms", boot_step_alarms, "codec");
+    boot_sched_add("wake_word", boot_step_wake_word,
+                   "voice_pipeline, wake_prompt, alarms");
   } else {
     // Safe Mode Loop
     ESP_LOGW(TAG, "Safe Mode: Use Web/OTA to fix issues.");
   }
 
-  xTaskCreate(mqtt_setup_task, "mqtt_setup", 4096, NULL, 5, NULL);
+  ESP_ERROR_CHECK(boot_sched_start(3));
+  while (!boot_sched_wait(1000)) {
+    sys_diag_wdt_feed();
+  }
 
   // Main Loop - Keep main task alive to feed watchdog
   while (1) {
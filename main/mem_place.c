@@ -0,0 +1,160 @@
+/**
+ * @file mem_place.c
+ * @brief Placement policy implementation
+ */
+
+#include "mem_place.h"
+#include "esp_cache.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "mem_place";
+
+#ifdef CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#define HOT_ALIGN CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#else
+#define HOT_ALIGN 64
+#endif
+
+#define BENCH_FRAME_SAMPLES 512 // feed_task I2S_READ_LEN
+#define BENCH_RUNS 16
+
+static const uint32_t place_caps[MEM_PLACE_COUNT] = {
+    [MEM_PLACE_HOT] = MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT,
+    [MEM_PLACE_COLD] = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+};
+
+static const char *const place_names[MEM_PLACE_COUNT] = {"internal", "psram"};
+
+static volatile uint32_t fallbacks;
+
+static void *alloc_caps(mem_place_t place, size_t size) {
+  if (place == MEM_PLACE_HOT) {
+    return heap_caps_aligned_alloc(HOT_ALIGN, size, place_caps[place]);
+  }
+  return heap_caps_malloc(size, place_caps[place]);
+}
+
+void *mem_place_alloc(mem_mod_t mod, mem_place_t place, size_t size) {
+  if (place >= MEM_PLACE_COUNT || size == 0) {
+    return NULL;
+  }
+  void *p = alloc_caps(place, size);
+  if (!p) {
+    mem_place_t other = place == MEM_PLACE_HOT ? MEM_PLACE_COLD : MEM_PLACE_HOT;
+    p = alloc_caps(other, size);
+    if (!p) {
+      p = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    if (!p) {
+      ESP_LOGE(TAG, "%s: no memory for %u bytes", mem_track_module_name(mod),
+               (unsigned)size);
+      return NULL;
+    }
+    fallbacks++;
+    ESP_LOGW(TAG, "%s: %u bytes wanted %s, placed elsewhere",
+             mem_track_module_name(mod), (unsigned)size, place_names[place]);
+  }
+  mem_track_adopt(mod, p);
+  return p;
+}
+
+char *mem_place_strdup(mem_mod_t mod, mem_place_t place, const char *s) {
+  if (!s) {
+    return NULL;
+  }
+  size_t len = strlen(s) + 1;
+  char *p = mem_place_alloc(mod, place, len);
+  if (p) {
+    memcpy(p, s, len);
+  }
+  return p;
+}
+
+uint32_t mem_place_get_fallbacks(void) { return fallbacks; }
+
+// -------------------------------------------------------------------------
+// BENCHMARK
+// -------------------------------------------------------------------------
+
+/**
+ * @brief The feed_task inner loop: [mic, ref, mic, ref, ...]
+ */
+static void interleave(int16_t *out, const int16_t *mic, const int16_t *ref,
+                       int n) {
+  for (int i = 0; i < n; i++) {
+    out[i * 2] = mic[i];
+    out[i * 2 + 1] = ref[i];
+  }
+}
+
+static void flush(void *p, size_t size) {
+  // Internal RAM may not be cacheable on every target; nothing to flush then
+  (void)esp_cache_msync(p, size,
+                        ESP_CACHE_MSYNC_FLAG_DIR_C2M |
+                            ESP_CACHE_MSYNC_FLAG_INVALIDATE);
+}
+
+static uint32_t bench_one(int16_t *buf, bool cold) {
+  const size_t ch_bytes = BENCH_FRAME_SAMPLES * sizeof(int16_t);
+  int16_t *mic = buf;
+  int16_t *ref = buf + BENCH_FRAME_SAMPLES;
+  int16_t *out = buf + 2 * BENCH_FRAME_SAMPLES;
+  uint32_t best = UINT32_MAX;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    if (cold) {
+      flush(buf, 4 * ch_bytes);
+    }
+    // Fastest run: preemption and migration only ever make one slower
+    uint32_t start = esp_cpu_get_cycle_count();
+    interleave(out, mic, ref, BENCH_FRAME_SAMPLES);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    if (cycles < best) {
+      best = cycles;
+    }
+  }
+  return best;
+}
+
+esp_err_t mem_place_bench(mem_place_bench_t *out) {
+  if (!out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // mic + ref + interleaved output, each channel BENCH_FRAME_SAMPLES long
+  const size_t size = 4 * BENCH_FRAME_SAMPLES * sizeof(int16_t);
+  memset(out, 0, sizeof(*out));
+  out->frame_samples = BENCH_FRAME_SAMPLES;
+  for (int place = 0; place < MEM_PLACE_COUNT; place++) {
+    // No fallback here: the point is to measure this placement
+    int16_t *buf = heap_caps_aligned_alloc(HOT_ALIGN, size, place_caps[place]);
+    if (!buf) {
+      return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < 2 * BENCH_FRAME_SAMPLES; i++) {
+      buf[i] = (int16_t)(i * 37);
+    }
+    out->cycles[place] = bench_one(buf, false);
+    out->cold_cycles[place] = bench_one(buf, true);
+    heap_caps_free(buf);
+  }
+  return ESP_OK;
+}
+
+void mem_place_bench_log(void) {
+  mem_place_bench_t b;
+  esp_err_t err = mem_place_bench(&b);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Placement benchmark failed: %s", esp_err_to_name(err));
+    return;
+  }
+  ESP_LOGI(TAG, "Frame loop (%u samples) cycles, cached / flushed:",
+           (unsigned)b.frame_samples);
+  for (int place = 0; place < MEM_PLACE_COUNT; place++) {
+    ESP_LOGI(TAG, "  %-8s %6u / %6u", place_names[place],
+             (unsigned)b.cycles[place], (unsigned)b.cold_cycles[place]);
+  }
+  ESP_LOGI(TAG, "Placement fallbacks: %u", (unsigned)fallbacks);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file mem_place.h
+ * @brief Placement policy: hot audio buffers in internal SRAM, bulk in PSRAM
+ *
+ * PSRAM is reached through the L2 cache. A miss stalls the CPU for a burst
+ * over the PSRAM bus, and an audio loop that misses in the middle of a frame
+ * loses time it does not have. Buffers touched every frame (DSP input and
+ * output, I2S writes) are HOT: internal, DMA-capable and aligned to a cache
+ * line. Large buffers touched rarely or once in sequence (TTS accumulation,
+ * retained JSON, logs, caches) are COLD: PSRAM, so internal RAM stays free
+ * for stacks, DMA and the hot buffers.
+ *
+ * Hot buffers are allocated once at init and kept. When the preferred
+ * memory is exhausted the allocation falls back to the other one and the
+ * fallback is counted, so a device that lost its placement shows it rather
+ * than just running slower.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "mem_track.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  MEM_PLACE_HOT = 0, ///< Internal, DMA-capable, cache-line aligned
+  MEM_PLACE_COLD,    ///< PSRAM
+  MEM_PLACE_COUNT
+} mem_place_t;
+
+typedef struct {
+  uint32_t frame_samples; ///< Samples per channel in the benchmark frame
+  uint32_t cycles[MEM_PLACE_COUNT];      ///< Per frame, data in the cache
+  uint32_t cold_cycles[MEM_PLACE_COUNT]; ///< Per frame, cache flushed first
+} mem_place_bench_t;
+
+/**
+ * @brief Allocate by placement, tracked for mod; freed with mem_track_free()
+ *
+ * @return NULL only if neither kind of memory has room
+ */
+void *mem_place_alloc(mem_mod_t mod, mem_place_t place, size_t size);
+
+/**
+ * @brief Copy of s in the given placement
+ */
+char *mem_place_strdup(mem_mod_t mod, mem_place_t place, const char *s);
+
+/**
+ * @brief Allocations that did not get the memory their placement asked for
+ */
+uint32_t mem_place_get_fallbacks(void);
+
+/**
+ * @brief Time the capture frame loop on internal and PSRAM buffers
+ *
+ * Runs the feed interleave (two 16-bit channels into one stereo frame) over
+ * buffers of each placement, with the data in the cache and after flushing
+ * it, and keeps the fastest of several runs. Takes a few milliseconds.
+ */
+esp_err_t mem_place_bench(mem_place_bench_t *out);
+
+/**
+ * @brief Run mem_place_bench() and log the result (diagnostic dump)
+ */
+void mem_place_bench_log(void);
+
+#ifdef __cplusplus
+}
+#endif
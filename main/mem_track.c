@@ -0,0 +1,284 @@
+/**
+ * @file mem_track.c
+ * @brief Module allocation tracker implementation
+ *
+ * Counters are updated under a spinlock; the heap call itself runs outside
+ * it. Rates are computed lazily on query over windows of at least
+ * RATE_WINDOW_US, so no timer is needed.
+ */
+
+#include "mem_track.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RATE_WINDOW_US 10000000LL
+
+typedef struct {
+  mem_track_module_stats_t stats;
+  int64_t window_start_us;
+  uint32_t window_allocs;
+} module_t;
+
+static const char *const module_names[MEM_MOD_COUNT] = {
+    "tts",  "tts_cache", "wake_prompt", "ha_client", "pipeline",
+    "mqtt", "ota",       "audio",       "web"};
+
+static portMUX_TYPE track_mux = portMUX_INITIALIZER_UNLOCKED;
+static module_t modules[MEM_MOD_COUNT];
+
+static void note_alloc(mem_mod_t mod, void *ptr) {
+  size_t size = heap_caps_get_allocated_size(ptr);
+  bool psram = esp_ptr_external_ram(ptr);
+  portENTER_CRITICAL(&track_mux);
+  mem_track_module_stats_t *s = &modules[mod].stats;
+  s->live_bytes += size;
+  if (psram) {
+    s->live_psram_bytes += size;
+  }
+  if (s->live_bytes > s->peak_bytes) {
+    s->peak_bytes = s->live_bytes;
+  }
+  s->allocs++;
+  portEXIT_CRITICAL(&track_mux);
+}
+
+static void note_free(mem_mod_t mod, size_t size, bool psram) {
+  portENTER_CRITICAL(&track_mux);
+  mem_track_module_stats_t *s = &modules[mod].stats;
+  // Clamped: a block allocated untracked may be freed here
+  s->live_bytes -= size < s->live_bytes ? size : s->live_bytes;
+  if (psram) {
+    s->live_psram_bytes -=
+        size < s->live_psram_bytes ? size : s->live_psram_bytes;
+  }
+  s->frees++;
+  portEXIT_CRITICAL(&track_mux);
+}
+
+static void note_failure(mem_mod_t mod) {
+  portENTER_CRITICAL(&track_mux);
+  modules[mod].stats.failures++;
+  portEXIT_CRITICAL(&track_mux);
+}
+
+void *mem_track_malloc(mem_mod_t mod, size_t size, uint32_t caps) {
+  if (mod >= MEM_MOD_COUNT) {
+    return NULL;
+  }
+  void *p = caps ? heap_caps_malloc(size, caps) : malloc(size);
+  if (p) {
+    note_alloc(mod, p);
+  } else if (size) {
+    note_failure(mod);
+  }
+  return p;
+}
+
+void *mem_track_calloc(mem_mod_t mod, size_t n, size_t size, uint32_t caps) {
+  if (mod >= MEM_MOD_COUNT) {
+    return NULL;
+  }
+  void *p = caps ? heap_caps_calloc(n, size, caps) : calloc(n, size);
+  if (p) {
+    note_alloc(mod, p);
+  } else if (n && size) {
+    note_failure(mod);
+  }
+  return p;
+}
+
+void *mem_track_realloc(mem_mod_t mod, void *ptr, size_t size, uint32_t caps) {
+  if (mod >= MEM_MOD_COUNT) {
+    return NULL;
+  }
+  if (!ptr) {
+    return mem_track_malloc(mod, size, caps);
+  }
+  if (size == 0) {
+    mem_track_free(mod, ptr);
+    return NULL;
+  }
+  size_t old_size = heap_caps_get_allocated_size(ptr);
+  bool old_psram = esp_ptr_external_ram(ptr);
+  void *p = caps ? heap_caps_realloc(ptr, size, caps) : realloc(ptr, size);
+  if (!p) {
+    note_failure(mod); // ptr is still valid and still counted
+    return NULL;
+  }
+  note_free(mod, old_size, old_psram);
+  note_alloc(mod, p);
+  return p;
+}
+
+char *mem_track_strdup(mem_mod_t mod, const char *s) {
+  if (!s) {
+    return NULL;
+  }
+  size_t len = strlen(s) + 1;
+  char *p = mem_track_malloc(mod, len, 0);
+  if (p) {
+    memcpy(p, s, len);
+  }
+  return p;
+}
+
+void mem_track_free(mem_mod_t mod, void *ptr) {
+  if (!ptr || mod >= MEM_MOD_COUNT) {
+    return;
+  }
+  size_t size = heap_caps_get_allocated_size(ptr);
+  bool psram = esp_ptr_external_ram(ptr);
+  heap_caps_free(ptr);
+  note_free(mod, size, psram);
+}
+
+void mem_track_adopt(mem_mod_t mod, void *ptr) {
+  if (ptr && mod < MEM_MOD_COUNT) {
+    note_alloc(mod, ptr);
+  }
+}
+
+const char *mem_track_module_name(mem_mod_t mod) {
+  return mod < MEM_MOD_COUNT ? module_names[mod] : "?";
+}
+
+void mem_track_get_module(mem_mod_t mod, mem_track_module_stats_t *out) {
+  if (!out || mod >= MEM_MOD_COUNT) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&track_mux);
+  module_t *m = &modules[mod];
+  int64_t elapsed_us = now_us - m->window_start_us;
+  if (m->window_start_us == 0) {
+    m->window_start_us = now_us;
+    m->window_allocs = m->stats.allocs;
+  } else if (elapsed_us >= RATE_WINDOW_US) {
+    m->stats.alloc_rate = (float)(m->stats.allocs - m->window_allocs) *
+                          1000000.0f / (float)elapsed_us;
+    m->window_start_us = now_us;
+    m->window_allocs = m->stats.allocs;
+  }
+  *out = m->stats;
+  portEXIT_CRITICAL(&track_mux);
+}
+
+void mem_track_get_heap(bool psram, mem_track_heap_t *out) {
+  if (!out) {
+    return;
+  }
+  uint32_t caps = (psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) |
+                  MALLOC_CAP_8BIT;
+  out->free_bytes = heap_caps_get_free_size(caps);
+  out->min_free_bytes = heap_caps_get_minimum_free_size(caps);
+  out->largest_block = heap_caps_get_largest_free_block(caps);
+  out->frag_pct = 0;
+  if (out->free_bytes) {
+    out->frag_pct = (uint8_t)(100 - (uint64_t)out->largest_block * 100 /
+                                        out->free_bytes);
+  }
+}
+
+size_t mem_track_format(char *buf, size_t len) {
+  if (!buf || len == 0) {
+    return 0;
+  }
+  buf[0] = '\0';
+  mem_track_module_stats_t stats[MEM_MOD_COUNT];
+  for (int i = 0; i < MEM_MOD_COUNT; i++) {
+    mem_track_get_module((mem_mod_t)i, &stats[i]);
+  }
+
+  size_t used = 0;
+  bool listed[MEM_MOD_COUNT] = {false};
+  for (int n = 0; n < MEM_MOD_COUNT; n++) {
+    int best = -1;
+    for (int i = 0; i < MEM_MOD_COUNT; i++) {
+      if (!listed[i] && stats[i].peak_bytes &&
+          (best < 0 || stats[i].live_bytes > stats[best].live_bytes)) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    listed[best] = true;
+    const mem_track_module_stats_t *s = &stats[best];
+    int w = snprintf(buf + used, len - used, "%s%s %.1fk/%.1fk %.1f/s",
+                     used ? ", " : "", module_names[best],
+                     s->live_bytes / 1024.0, s->peak_bytes / 1024.0,
+                     (double)s->alloc_rate);
+    if (w < 0 || (size_t)w >= len - used) {
+      buf[used] = '\0'; // Whole entries only
+      break;
+    }
+    used += (size_t)w;
+  }
+  return used;
+}
+
+/**
+ * @brief snprintf at buf + *used; false once the text no longer fits
+ */
+static bool appendf(char *buf, size_t len, size_t *used, const char *fmt,
+                    ...) {
+  if (*used >= len) {
+    return false;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  int w = vsnprintf(buf + *used, len - *used, fmt, ap);
+  va_end(ap);
+  if (w < 0 || (size_t)w >= len - *used) {
+    *used = len;
+    return false;
+  }
+  *used += (size_t)w;
+  return true;
+}
+
+static bool append_heap_json(char *buf, size_t len, size_t *used, bool psram) {
+  mem_track_heap_t h;
+  mem_track_get_heap(psram, &h);
+  return appendf(buf, len, used,
+                 "\"%s\":{\"free\":%u,\"min_free\":%u,\"largest\":%u,"
+                 "\"frag\":%u}",
+                 psram ? "psram" : "internal", (unsigned)h.free_bytes,
+                 (unsigned)h.min_free_bytes, (unsigned)h.largest_block,
+                 h.frag_pct);
+}
+
+size_t mem_track_format_json(char *buf, size_t len) {
+  if (!buf || len == 0) {
+    return 0;
+  }
+  size_t used = 0;
+  bool ok = appendf(buf, len, &used, "{\"modules\":[");
+  for (int i = 0; ok && i < MEM_MOD_COUNT; i++) {
+    mem_track_module_stats_t s;
+    mem_track_get_module((mem_mod_t)i, &s);
+    ok = appendf(buf, len, &used,
+                 "%s{\"name\":\"%s\",\"live\":%u,\"psram\":%u,\"peak\":%u,"
+                 "\"allocs\":%u,\"frees\":%u,\"failures\":%u,\"rate\":%.2f}",
+                 i ? "," : "", module_names[i], (unsigned)s.live_bytes,
+                 (unsigned)s.live_psram_bytes, (unsigned)s.peak_bytes,
+                 (unsigned)s.allocs, (unsigned)s.frees, (unsigned)s.failures,
+                 (double)s.alloc_rate);
+  }
+  ok = ok && appendf(buf, len, &used, "],") &&
+       append_heap_json(buf, len, &used, false) &&
+       appendf(buf, len, &used, ",") &&
+       append_heap_json(buf, len, &used, true) &&
+       appendf(buf, len, &used, "}");
+  if (!ok) {
+    buf[0] = '\0';
+    return 0;
+  }
+  return used;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file mem_track.h
+ * @brief Heap allocations attributed to modules
+ *
+ * The big and the frequent allocations go through these wrappers with the
+ * module that owns them, so live bytes, peak and allocation rate can be
+ * read per module: a leak shows as live bytes that only grow, a hot
+ * allocator as a high rate. Block sizes come from the heap itself
+ * (heap_caps_get_allocated_size()), so there is no header per block and a
+ * tracked block can be freed by heap_caps_free() without corrupting
+ * anything; it is then just not subtracted.
+ *
+ * Heap health is reported next to it: free, minimum free and largest free
+ * block of internal RAM and PSRAM, and fragmentation as the share of free
+ * memory that is not in the largest block.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  MEM_MOD_TTS = 0,    ///< tts_player buffers and queued chunks
+  MEM_MOD_TTS_CACHE,  ///< Cached answers
+  MEM_MOD_WAKE_PROMPT,
+  MEM_MOD_HA_CLIENT,  ///< Audio frames, messages
+  MEM_MOD_PIPELINE,   ///< Per-run handler data
+  MEM_MOD_MQTT,       ///< Discovery payloads
+  MEM_MOD_OTA,        ///< Download buffer, task stack
+  MEM_MOD_AUDIO,      ///< Capture frame buffers
+  MEM_MOD_WEB,        ///< WebSerial log buffer
+  MEM_MOD_COUNT
+} mem_mod_t;
+
+typedef struct {
+  uint32_t live_bytes;
+  uint32_t live_psram_bytes; ///< Of live_bytes
+  uint32_t peak_bytes;
+  uint32_t allocs; ///< Since boot, reallocs included
+  uint32_t frees;
+  uint32_t failures;
+  float alloc_rate; ///< Allocations per second, last window
+} mem_track_module_stats_t;
+
+typedef struct {
+  uint32_t free_bytes;
+  uint32_t min_free_bytes;
+  uint32_t largest_block;
+  uint8_t frag_pct; ///< 100 - largest_block * 100 / free_bytes
+} mem_track_heap_t;
+
+/**
+ * @param caps heap_caps flags, or 0 for plain malloc()
+ */
+void *mem_track_malloc(mem_mod_t mod, size_t size, uint32_t caps);
+void *mem_track_calloc(mem_mod_t mod, size_t n, size_t size, uint32_t caps);
+
+/**
+ * @brief realloc() with the same caps rules; ptr may be NULL
+ */
+void *mem_track_realloc(mem_mod_t mod, void *ptr, size_t size, uint32_t caps);
+char *mem_track_strdup(mem_mod_t mod, const char *s);
+
+/**
+ * @brief Free a block allocated for the same module (NULL is ignored)
+ */
+void mem_track_free(mem_mod_t mod, void *ptr);
+
+/**
+ * @brief Count a block allocated elsewhere (e.g. by cJSON_Print)
+ */
+void mem_track_adopt(mem_mod_t mod, void *ptr);
+
+const char *mem_track_module_name(mem_mod_t mod);
+
+void mem_track_get_module(mem_mod_t mod, mem_track_module_stats_t *out);
+
+/**
+ * @param psram true: PSRAM, false: internal RAM
+ */
+void mem_track_get_heap(bool psram, mem_track_heap_t *out);
+
+/**
+ * @brief Modules with live memory, largest first: "tts 128.0k/128.0k 0.4/s"
+ *        (live/peak, allocation rate); fits the HA state limit
+ *
+ * @return Characters written (without the terminator)
+ */
+size_t mem_track_format(char *buf, size_t len);
+
+/**
+ * @brief Everything as JSON (for the web dashboard)
+ *
+ * @return Characters written, or 0 if buf is too small
+ */
+size_t mem_track_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,164 @@
+/**
+ * @file mn_commands.c
+ * @brief MultiNet command phrase list from the SD card or NVS
+ */
+
+#include "mn_commands.h"
+#include "audio_capture.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "mn_commands";
+
+#define LIST_MAX_BYTES 3072 // Fits a single NVS string entry
+#define COMMANDS_MAX 64
+#define NVS_NAMESPACE "mn_cmds"
+#define NVS_KEY "list"
+
+static char *read_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size <= 0 || size >= LIST_MAX_BYTES) {
+    ESP_LOGE(TAG, "%s: invalid size %ld (max %d)", path, size,
+             LIST_MAX_BYTES - 1);
+    fclose(f);
+    return NULL;
+  }
+  char *text = malloc((size_t)size + 1);
+  if (text) {
+    size_t read = fread(text, 1, (size_t)size, f);
+    text[read] = '\0';
+  }
+  fclose(f);
+  return text;
+}
+
+static char *read_nvs(void) {
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return NULL;
+  }
+  size_t len = 0;
+  char *text = NULL;
+  if (nvs_get_str(handle, NVS_KEY, NULL, &len) == ESP_OK && len > 0) {
+    text = malloc(len);
+    if (text && nvs_get_str(handle, NVS_KEY, text, &len) != ESP_OK) {
+      free(text);
+      text = NULL;
+    }
+  }
+  nvs_close(handle);
+  return text;
+}
+
+static void save_nvs(const char *text) {
+  char *stored = read_nvs();
+  bool same = stored && strcmp(stored, text) == 0;
+  free(stored);
+  if (same) {
+    return;
+  }
+
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return;
+  }
+  esp_err_t err = nvs_set_str(handle, NVS_KEY, text);
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to store list in NVS: %s", esp_err_to_name(err));
+  }
+}
+
+/**
+ * @brief Split "id phrase" lines in place
+ *
+ * @return Number of commands, or -1 on a syntax error
+ */
+static int parse(char *text, audio_capture_command_t *commands) {
+  int count = 0;
+  int line = 0;
+  char *save = NULL;
+  for (char *s = strtok_r(text, "\n", &save); s;
+       s = strtok_r(NULL, "\n", &save)) {
+    line++;
+    while (*s == ' ' || *s == '\t') {
+      s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+      *--end = '\0';
+    }
+    if (*s == '\0' || *s == '#') {
+      continue;
+    }
+
+    char *phrase;
+    long id = strtol(s, &phrase, 10);
+    if (phrase == s || id < 0 || (*phrase != ' ' && *phrase != '\t')) {
+      ESP_LOGE(TAG, "Line %d: expected \"<id> <phrase>\"", line);
+      return -1;
+    }
+    while (*phrase == ' ' || *phrase == '\t') {
+      phrase++;
+    }
+    if (count == COMMANDS_MAX) {
+      ESP_LOGW(TAG, "More than %d commands, rest ignored", COMMANDS_MAX);
+      break;
+    }
+    commands[count++] =
+        (audio_capture_command_t){.id = (int)id, .phrase = phrase};
+  }
+  return count;
+}
+
+esp_err_t mn_commands_load(const char *path) {
+  if (!audio_capture_has_multinet()) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  const char *source = path;
+  char *text = path ? read_file(path) : NULL;
+  bool from_file = text != NULL;
+  if (!text) {
+    text = read_nvs();
+    source = "NVS";
+  }
+  if (!text) {
+    ESP_LOGI(TAG, "No command list, using the model defaults");
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // parse() cuts the text up; keep the original for NVS
+  char *copy = from_file ? strdup(text) : NULL;
+  audio_capture_command_t commands[COMMANDS_MAX];
+  int count = parse(text, commands);
+  esp_err_t err = ESP_ERR_INVALID_ARG;
+  if (count > 0) {
+    err = audio_capture_set_commands(commands, (size_t)count);
+  }
+  free(text);
+
+  if (err == ESP_OK) {
+    ESP_LOGI(TAG, "%d commands loaded from %s", count, source);
+    if (copy) {
+      save_nvs(copy);
+    }
+  } else {
+    ESP_LOGE(TAG, "Command list from %s not applied: %s", source,
+             esp_err_to_name(err));
+  }
+  free(copy);
+  return err;
+}
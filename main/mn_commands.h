@@ -0,0 +1,39 @@
+/**
+ * @file mn_commands.h
+ * @brief MultiNet command phrase list from the SD card or NVS
+ *
+ * File format, one command per line ('#' starts a comment line):
+ *
+ *     # id phrase
+ *     2 play music
+ *     3 stop music
+ *
+ * The id is what the command callback reports; the local intent grammar
+ * maps it to an action with "#<id>" (see local_intent.h). A list read from
+ * the SD card is also stored in NVS, so it is still there when the card is
+ * released for Wi-Fi or missing at boot.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MN_COMMANDS_PATH "/sdcard/mn_commands.txt"
+
+/**
+ * @brief Load the phrase list and apply it to MultiNet
+ *
+ * Reads path, or the copy in NVS if the file is missing.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without a MultiNet model,
+ *         ESP_ERR_NOT_FOUND if there is no list, or a parse/apply error
+ */
+esp_err_t mn_commands_load(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,6 +6,10 @@
 #include "cJSON.h"
 #include "esp_app_desc.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "mqtt_client.h"
 #include "oled_status.h"
 #include <stdio.h>
@@ -28,7 +32,7 @@ static void build_discovery_topic(const char *component, const char *entity_id,
 #define STATE_PREFIX "esp32p4"
 
 // Entity tracking
-#define MAX_ENTITIES 40
+#define MAX_ENTITIES 80
 
 typedef struct {
   char entity_id[32];
@@ -41,6 +45,8 @@ typedef struct {
 // Global state
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool mqtt_connected = false;
+static EventGroupHandle_t mqtt_events = NULL;
+#define MQTT_CONNECTED_BIT BIT0
 static mqtt_entity_t entities[MAX_ENTITIES];
 static int entity_count = 0;
 static bool legacy_cleanup_done = false;
@@ -179,20 +185,20 @@ static esp_err_t publish_discovery(const char *component, const char *entity_id,
   // Add device information
   cJSON_AddItemToObject(config, "device", build_device_json());
 
-  // Convert to JSON string
-  char *json_str = cJSON_PrintUnformatted(config);
+  // Convert to JSON string; kept for every reconnect, so it goes to PSRAM
+  char *printed = cJSON_PrintUnformatted(config);
+  cJSON_Delete(config);
+  char *json_str = mem_place_strdup(MEM_MOD_MQTT, MEM_PLACE_COLD, printed);
+  cJSON_free(printed);
   if (!json_str) {
     ESP_LOGE(TAG, "Failed to serialize discovery JSON");
-    cJSON_Delete(config);
     return ESP_FAIL;
   }
 
-  cJSON_Delete(config);
-
   int idx = find_entity_index(entity_id);
   if (idx < 0) {
     ESP_LOGW(TAG, "Discovery prepared for unknown entity: %s", entity_id);
-    free(json_str);
+    mem_track_free(MEM_MOD_MQTT, json_str);
     return ESP_FAIL;
   }
 
@@ -201,7 +207,7 @@ static esp_err_t publish_discovery(const char *component, const char *entity_id,
   entities[idx].component[sizeof(entities[idx].component) - 1] = '\0';
 
   if (entities[idx].discovery_payload) {
-    free(entities[idx].discovery_payload);
+    mem_track_free(MEM_MOD_MQTT, entities[idx].discovery_payload);
   }
   entities[idx].discovery_payload = json_str;
 
@@ -227,6 +233,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   case MQTT_EVENT_CONNECTED:
     ESP_LOGI(TAG, "MQTT connected to Home Assistant");
     mqtt_connected = true;
+    xEventGroupSetBits(mqtt_events, MQTT_CONNECTED_BIT);
     oled_status_set_mqtt_connected(true);
     oled_status_set_last_event("mqtt-up");
 
@@ -254,6 +261,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   case MQTT_EVENT_DISCONNECTED:
     ESP_LOGW(TAG, "MQTT disconnected");
     mqtt_connected = false;
+    xEventGroupClearBits(mqtt_events, MQTT_CONNECTED_BIT);
     oled_status_set_mqtt_connected(false);
     oled_status_set_last_event("mqtt-down");
     break;
@@ -319,6 +327,13 @@ esp_err_t mqtt_ha_init(const mqtt_ha_config_t *config) {
     mqtt_cfg.credentials.authentication.password = config->password;
   }
 
+  if (!mqtt_events) {
+    mqtt_events = xEventGroupCreate();
+    if (!mqtt_events) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
   mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
   if (!mqtt_client) {
     ESP_LOGE(TAG, "Failed to initialize MQTT client");
@@ -352,10 +367,25 @@ esp_err_t mqtt_ha_stop(void) {
   if (mqtt_client) {
     esp_mqtt_client_stop(mqtt_client);
     mqtt_connected = false;
+    xEventGroupClearBits(mqtt_events, MQTT_CONNECTED_BIT);
   }
   return ESP_OK;
 }
 
+esp_err_t mqtt_ha_reconnect(void) {
+  if (!mqtt_client) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  ESP_LOGI(TAG, "Reconnecting MQTT client");
+  // Stop returns within a poll interval; start connects without the
+  // reconnect back-off
+  esp_mqtt_client_stop(mqtt_client);
+  mqtt_connected = false;
+  xEventGroupClearBits(mqtt_events, MQTT_CONNECTED_BIT);
+  return esp_mqtt_client_start(mqtt_client);
+}
+
 esp_err_t mqtt_ha_register_sensor(const char *entity_id, const char *name,
                                   const char *unit, const char *device_class) {
   if (entity_count >= MAX_ENTITIES) {
@@ -689,3 +719,14 @@ esp_err_t mqtt_ha_update_text(const char *entity_id, const char *value) {
 }
 
 bool mqtt_ha_is_connected(void) { return mqtt_connected; }
+
+bool mqtt_ha_wait_connected(uint32_t timeout_ms) {
+  if (!mqtt_events) {
+    return false;
+  }
+  TickType_t ticks =
+      timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  EventBits_t bits = xEventGroupWaitBits(mqtt_events, MQTT_CONNECTED_BIT,
+                                         pdFALSE, pdFALSE, ticks);
+  return (bits & MQTT_CONNECTED_BIT) != 0;
+}
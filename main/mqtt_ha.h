@@ -9,6 +9,7 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -64,6 +65,16 @@ esp_err_t mqtt_ha_start(void);
  */
 esp_err_t mqtt_ha_stop(void);
 
+/**
+ * Drop the broker connection and connect again at once
+ *
+ * For a change of network interface: the old socket keeps the previous
+ * interface's source address and would otherwise only fail at keepalive.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mqtt_ha_reconnect(void);
+
 /**
  * Register a sensor entity with Home Assistant
  *
@@ -191,6 +202,14 @@ esp_err_t mqtt_ha_update_text(const char *entity_id, const char *value);
  */
 bool mqtt_ha_is_connected(void);
 
+/**
+ * Block until MQTT is connected
+ *
+ * @param timeout_ms Longest wait, UINT32_MAX for no limit
+ * @return true if connected (false also before mqtt_ha_init)
+ */
+bool mqtt_ha_wait_connected(uint32_t timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,430 @@
+/**
+ * @file music_cache.c
+ * @brief PSRAM track cache implementation
+ *
+ * Requests are queued to a low-priority task that copies the file in large
+ * reads while playback continues; the playing stream's read-ahead runs at a
+ * higher priority, so the copy only uses spare SD bandwidth. A copy is
+ * abandoned (and its buffer freed) when the card is about to be released.
+ *
+ * Entry metadata is guarded by cache_lock. The data of a complete entry is
+ * immutable and pinned by its open count, so reads run without the lock.
+ */
+
+#define _GNU_SOURCE
+#include "music_cache.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "task_arena.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "music_cache";
+
+#define FILL_TASK_PRIORITY 2 // Below the SD read-ahead and prefetch tasks
+#define FILL_QUEUE_SIZE 4
+#define FILL_CHUNK_SIZE (32 * 1024)
+// PSRAM left for everything else when sizing a fill
+#define PSRAM_RESERVE_BYTES (4 * 1024 * 1024)
+
+#ifdef __LARGE64_FILES
+typedef _off64_t cookie_off_t;
+#else
+typedef off_t cookie_off_t;
+#endif
+
+typedef struct {
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  char name[MUSIC_CACHE_NAME_MAX];
+  music_track_info_t info;
+} fill_request_t;
+
+typedef struct {
+  fill_request_t meta;
+  uint8_t *data; // NULL: slot free
+  size_t size;
+  bool complete;
+  int refs; // Open FILEs
+  TickType_t last_used;
+} cache_entry_t;
+
+typedef struct {
+  cache_entry_t *entry;
+  size_t pos;
+} cache_file_t;
+
+static SemaphoreHandle_t cache_lock = NULL;
+static SemaphoreHandle_t fill_lock = NULL; // Held while a copy is running
+static QueueHandle_t fill_queue = NULL;
+static TaskHandle_t fill_task_handle = NULL;
+static volatile bool suspended = false;
+static cache_entry_t entries[MUSIC_CACHE_MAX_TRACKS];
+static music_cache_stats_t stats;
+
+/* ---------- Entries (caller holds cache_lock) ---------- */
+
+static cache_entry_t *find_entry(const char *path) {
+  for (int i = 0; i < MUSIC_CACHE_MAX_TRACKS; i++) {
+    if (entries[i].data && strcmp(entries[i].meta.path, path) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static size_t bytes_used(void) {
+  size_t total = 0;
+  for (int i = 0; i < MUSIC_CACHE_MAX_TRACKS; i++) {
+    if (entries[i].data) {
+      total += entries[i].size;
+    }
+  }
+  return total;
+}
+
+static void entry_free(cache_entry_t *e) {
+  heap_caps_free(e->data);
+  memset(e, 0, sizeof(*e));
+}
+
+/**
+ * @brief Evict least recently used entries until size bytes and a slot fit
+ *
+ * @return Free slot, or NULL if pinned entries leave no room
+ */
+static cache_entry_t *make_room(size_t size) {
+  for (;;) {
+    cache_entry_t *free_slot = NULL;
+    cache_entry_t *lru = NULL;
+    for (int i = 0; i < MUSIC_CACHE_MAX_TRACKS; i++) {
+      cache_entry_t *e = &entries[i];
+      if (!e->data) {
+        free_slot = free_slot ? free_slot : e;
+      } else if (e->complete && e->refs == 0 &&
+                 (!lru || (int32_t)(e->last_used - lru->last_used) < 0)) {
+        lru = e;
+      }
+    }
+    if (free_slot && bytes_used() + size <= MUSIC_CACHE_MAX_BYTES) {
+      return free_slot;
+    }
+    if (!lru) {
+      return NULL;
+    }
+    ESP_LOGI(TAG, "Evicting %s", lru->meta.name);
+    entry_free(lru);
+    stats.evictions++;
+  }
+}
+
+/* ---------- Fill task ---------- */
+
+/**
+ * @brief Copy a file into e->data
+ *
+ * @return false if the copy failed or was abandoned for a suspend
+ */
+static bool copy_file(cache_entry_t *e, int fd) {
+  size_t done = 0;
+  while (done < e->size) {
+    if (suspended) {
+      return false;
+    }
+    size_t n = e->size - done;
+    if (n > FILL_CHUNK_SIZE) {
+      n = FILL_CHUNK_SIZE;
+    }
+    ssize_t got = read(fd, e->data + done, n);
+    if (got <= 0) {
+      return false;
+    }
+    done += got;
+  }
+  return true;
+}
+
+static void fill_one(const fill_request_t *req) {
+  int fd = open(req->path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+      (size_t)st.st_size > MUSIC_CACHE_MAX_BYTES ||
+      heap_caps_get_free_size(MALLOC_CAP_SPIRAM) <
+          (size_t)st.st_size + PSRAM_RESERVE_BYTES) {
+    close(fd);
+    return;
+  }
+  size_t size = st.st_size;
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  cache_entry_t *e = find_entry(req->path) ? NULL : make_room(size);
+  uint8_t *data =
+      e ? heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+  if (data) {
+    e->meta = *req;
+    e->data = data; // Reserves the slot; not visible until complete
+    e->size = size;
+  }
+  xSemaphoreGive(cache_lock);
+  if (!data) {
+    close(fd);
+    return;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  bool ok = copy_file(e, fd);
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  close(fd);
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  if (ok) {
+    e->complete = true;
+    e->last_used = xTaskGetTickCount();
+    stats.fills++;
+    stats.fill_kbps =
+        elapsed_us > 0 ? (uint32_t)((uint64_t)size * 1000 / elapsed_us) : 0;
+    stats.bytes_used = bytes_used();
+  } else {
+    entry_free(e);
+  }
+  xSemaphoreGive(cache_lock);
+
+  if (ok) {
+    ESP_LOGI(TAG, "Cached %s: %u KB in %lld ms (%u KB/s)", req->name,
+             (unsigned)(size / 1024), elapsed_us / 1000,
+             (unsigned)stats.fill_kbps);
+  }
+}
+
+static void fill_task(void *arg) {
+  (void)arg;
+  fill_request_t *req = malloc(sizeof(*req));
+  if (!req) {
+    ESP_LOGE(TAG, "Failed to allocate fill request");
+    fill_task_handle = NULL;
+    task_arena_exit(TASK_SLOT_MUSIC_CACHE);
+  }
+  while (1) {
+    if (xQueueReceive(fill_queue, req, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    xSemaphoreTake(fill_lock, portMAX_DELAY);
+    if (!suspended) {
+      fill_one(req);
+    }
+    xSemaphoreGive(fill_lock);
+  }
+}
+
+/* ---------- FILE interface ---------- */
+
+static ssize_t cookie_read(void *cookie, char *dst, size_t len) {
+  cache_file_t *f = cookie;
+  size_t left = f->entry->size - f->pos;
+  if (len > left) {
+    len = left;
+  }
+  memcpy(dst, f->entry->data + f->pos, len);
+  f->pos += len;
+  return (ssize_t)len;
+}
+
+static int cookie_seek(void *cookie, cookie_off_t *offset, int whence) {
+  cache_file_t *f = cookie;
+  cookie_off_t target;
+  switch (whence) {
+  case SEEK_SET:
+    target = *offset;
+    break;
+  case SEEK_CUR:
+    target = (cookie_off_t)f->pos + *offset;
+    break;
+  case SEEK_END:
+    target = (cookie_off_t)f->entry->size + *offset;
+    break;
+  default:
+    return -1;
+  }
+  if (target < 0 || target > (cookie_off_t)f->entry->size) {
+    return -1;
+  }
+  f->pos = target;
+  *offset = target;
+  return 0;
+}
+
+static int cookie_close(void *cookie) {
+  cache_file_t *f = cookie;
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  f->entry->refs--;
+  f->entry->last_used = xTaskGetTickCount();
+  xSemaphoreGive(cache_lock);
+  free(f);
+  return 0;
+}
+
+/* ---------- Public API ---------- */
+
+esp_err_t music_cache_init(void) {
+  if (fill_task_handle) {
+    return ESP_OK;
+  }
+  cache_lock = xSemaphoreCreateMutex();
+  fill_lock = xSemaphoreCreateMutex();
+  fill_queue = xQueueCreate(FILL_QUEUE_SIZE, sizeof(fill_request_t));
+  if (!cache_lock || !fill_lock || !fill_queue) {
+    ESP_LOGE(TAG, "Failed to create cache sync objects");
+    return ESP_ERR_NO_MEM;
+  }
+  if (task_arena_start(TASK_SLOT_MUSIC_CACHE, fill_task, NULL,
+                       FILL_TASK_PRIORITY, tskNO_AFFINITY,
+                       &fill_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create cache fill task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void music_cache_request(const char *path, const char *name,
+                         const music_track_info_t *info) {
+  if (!fill_queue || suspended || !path) {
+    return;
+  }
+  if (info && info->file_size > MUSIC_CACHE_MAX_BYTES) {
+    return;
+  }
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  bool cached = find_entry(path) != NULL;
+  xSemaphoreGive(cache_lock);
+  if (cached) {
+    return;
+  }
+
+  fill_request_t req = {0};
+  snprintf(req.path, sizeof(req.path), "%s", path);
+  snprintf(req.name, sizeof(req.name), "%s", name ? name : path);
+  if (info) {
+    req.info = *info;
+  }
+  xQueueSend(fill_queue, &req, 0); // Dropped when busy; not worth waiting
+}
+
+void music_cache_suspend(void) {
+  if (!fill_queue) {
+    return;
+  }
+  suspended = true;
+  xQueueReset(fill_queue);
+  // Wait for an in-progress copy to notice and close its file
+  xSemaphoreTake(fill_lock, portMAX_DELAY);
+  xSemaphoreGive(fill_lock);
+}
+
+void music_cache_resume(void) { suspended = false; }
+
+FILE *music_cache_fopen(const char *path) {
+  if (!cache_lock || !path) {
+    return NULL;
+  }
+  cache_file_t *f = calloc(1, sizeof(*f));
+  if (!f) {
+    return NULL;
+  }
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  cache_entry_t *e = find_entry(path);
+  if (e && e->complete) {
+    e->refs++;
+    e->last_used = xTaskGetTickCount();
+    stats.hits++;
+  } else {
+    e = NULL;
+  }
+  xSemaphoreGive(cache_lock);
+  if (!e) {
+    free(f);
+    return NULL;
+  }
+
+  f->entry = e;
+  cookie_io_functions_t io = {
+      .read = cookie_read,
+      .write = NULL,
+      .seek = cookie_seek,
+      .close = cookie_close,
+  };
+  FILE *fp = fopencookie(f, "r", io);
+  if (!fp) {
+    cookie_close(f);
+    return NULL;
+  }
+  setvbuf(fp, NULL, _IONBF, 0); // Already in RAM
+  return fp;
+}
+
+int music_cache_get_count(void) {
+  if (!cache_lock) {
+    return 0;
+  }
+  int count = 0;
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  for (int i = 0; i < MUSIC_CACHE_MAX_TRACKS; i++) {
+    if (entries[i].data && entries[i].complete) {
+      count++;
+    }
+  }
+  xSemaphoreGive(cache_lock);
+  return count;
+}
+
+esp_err_t music_cache_get_entry(int index, char *path, char *name,
+                                music_track_info_t *info) {
+  if (!cache_lock) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  esp_err_t ret = ESP_ERR_NOT_FOUND;
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  for (int i = 0; i < MUSIC_CACHE_MAX_TRACKS; i++) {
+    cache_entry_t *e = &entries[i];
+    if (!e->data || !e->complete || index-- > 0) {
+      continue;
+    }
+    if (path) {
+      snprintf(path, MUSIC_LIBRARY_PATH_MAX, "%s", e->meta.path);
+    }
+    if (name) {
+      snprintf(name, MUSIC_CACHE_NAME_MAX, "%s", e->meta.name);
+    }
+    if (info) {
+      *info = e->meta.info;
+    }
+    ret = ESP_OK;
+    break;
+  }
+  xSemaphoreGive(cache_lock);
+  return ret;
+}
+
+void music_cache_get_stats(music_cache_stats_t *out) {
+  if (!out) {
+    return;
+  }
+  if (!cache_lock) {
+    memset(out, 0, sizeof(*out));
+    return;
+  }
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  *out = stats;
+  xSemaphoreGive(cache_lock);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file music_cache.h
+ * @brief PSRAM copy of recently played tracks for playback without the SD card
+ *
+ * The ESP32-C6 Wi-Fi link and the SD card share the SDIO lines, so the card
+ * is unmounted when the network falls back to Wi-Fi. To keep music
+ * available, the last few tracks played (and the prefetched next one) are
+ * copied whole into PSRAM by a low-priority task while the card is still
+ * mounted. Cached tracks open as ordinary read-only, seekable FILE streams,
+ * so the decoders don't care where the bytes come from.
+ *
+ * Entries are evicted least recently used first; an entry that is open is
+ * never evicted.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "music_library.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MUSIC_CACHE_MAX_TRACKS 4                   ///< Tracks kept in PSRAM
+#define MUSIC_CACHE_MAX_BYTES (12 * 1024 * 1024)   ///< PSRAM budget
+#define MUSIC_CACHE_NAME_MAX 64                    ///< Display name length
+
+/**
+ * @brief Cache statistics since boot
+ */
+typedef struct {
+  uint32_t fills;       ///< Tracks copied into the cache
+  uint32_t hits;        ///< Opens served from PSRAM
+  uint32_t evictions;   ///< Tracks dropped to make room
+  uint32_t fill_kbps;   ///< SD read throughput of the last fill
+  uint32_t bytes_used;  ///< PSRAM currently held by complete entries
+} music_cache_stats_t;
+
+/**
+ * @brief Start the fill task (idempotent)
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+esp_err_t music_cache_init(void);
+
+/**
+ * @brief Ask for a track to be copied into PSRAM (returns immediately)
+ *
+ * Ignored if the track is already cached, too large or the fill queue is
+ * full.
+ *
+ * @param path File path on the card
+ * @param name Display name kept with the entry
+ * @param info Library metadata kept with the entry
+ */
+void music_cache_request(const char *path, const char *name,
+                         const music_track_info_t *info);
+
+/**
+ * @brief Stop filling and drop queued requests before the card goes away
+ *
+ * Blocks until an in-progress copy has closed its file.
+ */
+void music_cache_suspend(void);
+
+/**
+ * @brief Allow filling again after the card is mounted
+ */
+void music_cache_resume(void);
+
+/**
+ * @brief Open a cached track
+ *
+ * @param path File path the track was cached under
+ * @return Read-only seekable FILE (close with fclose), or NULL if not cached
+ */
+FILE *music_cache_fopen(const char *path);
+
+/**
+ * @brief Number of complete entries
+ */
+int music_cache_get_count(void);
+
+/**
+ * @brief Get a complete entry by index (0 .. count-1, in slot order)
+ *
+ * @param path Output path buffer (MUSIC_LIBRARY_PATH_MAX), may be NULL
+ * @param name Output display name (MUSIC_CACHE_NAME_MAX), may be NULL
+ * @param info Output metadata, may be NULL
+ * @return ESP_OK or ESP_ERR_NOT_FOUND
+ */
+esp_err_t music_cache_get_entry(int index, char *path, char *name,
+                                music_track_info_t *info);
+
+/**
+ * @brief Get cache statistics
+ */
+void music_cache_get_stats(music_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @file music_decoder.c
+ * @brief Decoder registry
+ */
+
+#include "music_decoder.h"
+#include "esp_log.h"
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "music_dec";
+
+// Sniff order matters: container magics first, MP3 (frame sync) last
+static const music_decoder_ops_t *const decoders[] = {
+    &music_decoder_wav,
+    &music_decoder_flac,
+    &music_decoder_mp3,
+};
+
+#define NUM_DECODERS (sizeof(decoders) / sizeof(decoders[0]))
+
+const music_decoder_ops_t *music_decoder_sniff(FILE *fp) {
+  uint8_t hdr[MUSIC_DECODER_SNIFF_SIZE];
+
+  if (!fp || fseek(fp, 0, SEEK_SET) != 0) {
+    return NULL;
+  }
+  size_t n = fread(hdr, 1, sizeof(hdr), fp);
+  fseek(fp, 0, SEEK_SET);
+
+  for (size_t i = 0; i < NUM_DECODERS; i++) {
+    if (decoders[i]->sniff(hdr, n)) {
+      return decoders[i];
+    }
+  }
+  return NULL;
+}
+
+bool music_decoder_is_supported_name(const char *name) {
+  if (!name || name[0] == '.') {
+    return false; // Hidden files and macOS "._" resource forks
+  }
+  const char *ext = strrchr(name, '.');
+  if (!ext) {
+    return false;
+  }
+  for (size_t i = 0; i < NUM_DECODERS; i++) {
+    for (const char *const *e = decoders[i]->extensions; *e; e++) {
+      if (strcasecmp(ext, *e) == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+esp_err_t music_decoder_open(music_decoder_t *dec, FILE *fp) {
+  if (!dec || !fp) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(dec, 0, sizeof(*dec));
+
+  const music_decoder_ops_t *ops = music_decoder_sniff(fp);
+  if (!ops) {
+    ESP_LOGW(TAG, "Unrecognized audio format");
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  esp_err_t ret = ops->open(fp, &dec->ctx, &dec->sample_rate, &dec->channels);
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "%s decoder failed to open stream: %s", ops->name,
+             esp_err_to_name(ret));
+    memset(dec, 0, sizeof(*dec));
+    return ret;
+  }
+  if (dec->sample_rate == 0 || dec->channels == 0 || dec->channels > 2) {
+    ESP_LOGW(TAG, "%s stream has unsupported format (%u Hz, %u ch)", ops->name,
+             (unsigned)dec->sample_rate, dec->channels);
+    ops->close(dec->ctx);
+    memset(dec, 0, sizeof(*dec));
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  dec->ops = ops;
+  return ESP_OK;
+}
+
+int music_decoder_decode(music_decoder_t *dec, int16_t *pcm) {
+  if (!dec || !dec->ops) {
+    return -1;
+  }
+  return dec->ops->decode(dec->ctx, pcm, MUSIC_DECODER_BLOCK_SAMPLES);
+}
+
+esp_err_t music_decoder_seek(music_decoder_t *dec, uint64_t sample,
+                             uint64_t *actual) {
+  if (!dec || !dec->ops || !actual) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return dec->ops->seek(dec->ctx, sample, actual);
+}
+
+void music_decoder_close(music_decoder_t *dec) {
+  if (dec && dec->ops) {
+    dec->ops->close(dec->ctx);
+  }
+  if (dec) {
+    memset(dec, 0, sizeof(*dec));
+  }
+}
+
+const char *music_format_to_string(music_format_t format) {
+  switch (format) {
+  case MUSIC_FORMAT_MP3:
+    return "mp3";
+  case MUSIC_FORMAT_WAV:
+    return "wav";
+  case MUSIC_FORMAT_FLAC:
+    return "flac";
+  default:
+    return "unknown";
+  }
+}
+
+void music_seek_table_add(music_seek_table_t *table, uint64_t sample,
+                          uint32_t offset) {
+  if (table->count >= MUSIC_SEEK_POINTS) {
+    return;
+  }
+  if (table->count > 0) {
+    const music_seek_point_t *last = &table->points[table->count - 1];
+    if (sample <= last->sample || offset < last->offset) {
+      return;
+    }
+  }
+  table->points[table->count].sample = sample;
+  table->points[table->count].offset = offset;
+  table->count++;
+}
+
+const music_seek_point_t *music_seek_table_find(const music_seek_table_t *table,
+                                                uint64_t sample) {
+  if (table->count == 0) {
+    return NULL;
+  }
+  int lo = 0;
+  int hi = table->count - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (table->points[mid].sample <= sample) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return &table->points[lo];
+}
@@ -0,0 +1,200 @@
+/**
+ * @file music_decoder.h
+ * @brief Per-format decoder registry for local music playback
+ *
+ * Every supported format provides a music_decoder_ops_t: a header sniffer,
+ * a metadata probe used by the library indexer, and a streaming decoder that
+ * reports the native sample rate and channel count when it is opened, so the
+ * codec can be configured once per track. Formats are chosen from the first
+ * bytes of the file, not from the file name.
+ *
+ * When a decoder is opened it also builds a seek table for the track from
+ * what the stream headers provide (Xing TOC, FLAC SEEKTABLE, or a linear
+ * estimate), so seeking costs one file seek plus at most a table interval of
+ * frame skipping instead of decoding from the start.
+ *
+ * Decoders always produce interleaved 16-bit PCM.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Max interleaved samples returned by one decode call (MPEG-1 stereo frame)
+#define MUSIC_DECODER_BLOCK_SAMPLES 2304
+/// Bytes needed by the header sniffers
+#define MUSIC_DECODER_SNIFF_SIZE 12
+/// Max length of probed tag strings (including NUL)
+#define MUSIC_DECODER_TAG_MAX 96
+/// Seek table entries per track (1% steps)
+#define MUSIC_SEEK_POINTS 100
+
+/**
+ * @brief Audio container/codec of a track
+ *
+ * Values are stored in the on-card library index; only append.
+ */
+typedef enum {
+  MUSIC_FORMAT_UNKNOWN = 0, ///< Not probed or unsupported
+  MUSIC_FORMAT_MP3,         ///< MPEG-1/2/2.5 Layer III
+  MUSIC_FORMAT_WAV,         ///< RIFF/WAVE linear PCM
+  MUSIC_FORMAT_FLAC,        ///< Native FLAC
+} music_format_t;
+
+/**
+ * @brief Metadata gathered by a probe (library indexing)
+ */
+typedef struct {
+  uint32_t duration_ms;  ///< Duration (0 if unknown)
+  uint32_t sample_rate;  ///< Native sample rate in Hz
+  uint16_t bitrate_kbps; ///< Average bitrate
+  uint8_t channels;      ///< Native channel count
+  char title[MUSIC_DECODER_TAG_MAX];  ///< Title tag ("" if none)
+  char artist[MUSIC_DECODER_TAG_MAX]; ///< Artist tag ("" if none)
+} music_probe_t;
+
+/**
+ * @brief Seek table entry
+ */
+typedef struct {
+  uint64_t sample; ///< Per-channel sample position of the point
+  uint32_t offset; ///< File offset to resume reading from
+} music_seek_point_t;
+
+/**
+ * @brief Per-track seek table, ordered by sample
+ */
+typedef struct {
+  uint16_t count;
+  music_seek_point_t points[MUSIC_SEEK_POINTS];
+} music_seek_table_t;
+
+/**
+ * @brief Decoder plug-in operations
+ */
+typedef struct {
+  const char *name;      ///< Short name for logs
+  music_format_t format; ///< Format handled
+  const char *const *extensions; ///< NULL-terminated list (".mp3", ...)
+
+  /** Check the first MUSIC_DECODER_SNIFF_SIZE bytes of a file */
+  bool (*sniff)(const uint8_t *hdr, size_t len);
+
+  /** Fill metadata; fp is at offset 0, buf is scratch space */
+  esp_err_t (*probe)(FILE *fp, uint32_t file_size, uint8_t *buf,
+                     size_t buf_size, music_probe_t *out);
+
+  /** Parse headers, allocate state and report the native PCM format */
+  esp_err_t (*open)(FILE *fp, void **ctx, uint32_t *sample_rate,
+                    uint8_t *channels);
+
+  /** Decode up to max_samples interleaved samples; 0 at end, <0 on error */
+  int (*decode)(void *ctx, int16_t *pcm, size_t max_samples);
+
+  /** Seek near a per-channel sample position; report the position reached */
+  esp_err_t (*seek)(void *ctx, uint64_t sample, uint64_t *actual);
+
+  /** Free decoder state (does not close fp) */
+  void (*close)(void *ctx);
+} music_decoder_ops_t;
+
+/**
+ * @brief Open decoder instance
+ */
+typedef struct {
+  const music_decoder_ops_t *ops; ///< NULL when closed
+  void *ctx;
+  uint32_t sample_rate; ///< Native rate reported by open()
+  uint8_t channels;     ///< Native channel count reported by open()
+} music_decoder_t;
+
+/**
+ * @brief Find the decoder for a file by sniffing its header
+ *
+ * Reads MUSIC_DECODER_SNIFF_SIZE bytes and rewinds fp.
+ *
+ * @param fp Open file
+ * @return Decoder operations, or NULL if no decoder recognizes the file
+ */
+const music_decoder_ops_t *music_decoder_sniff(FILE *fp);
+
+/**
+ * @brief Check if a file name has an extension any decoder handles
+ *
+ * Used to skip unrelated files during directory scans; the decoder itself is
+ * still chosen by music_decoder_sniff().
+ */
+bool music_decoder_is_supported_name(const char *name);
+
+/**
+ * @brief Sniff the format of fp and open a decoder for it
+ *
+ * @param dec Decoder instance (zeroed on failure)
+ * @param fp Open file positioned at offset 0 (stays owned by the caller)
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED for unknown formats, or an error
+ */
+esp_err_t music_decoder_open(music_decoder_t *dec, FILE *fp);
+
+/**
+ * @brief Decode the next block of PCM
+ *
+ * @param dec Open decoder
+ * @param pcm Output buffer of MUSIC_DECODER_BLOCK_SAMPLES samples
+ * @return Interleaved samples written, 0 at end of stream, <0 on error
+ */
+int music_decoder_decode(music_decoder_t *dec, int16_t *pcm);
+
+/**
+ * @brief Seek to a per-channel sample position
+ *
+ * Lands on the frame containing the position where the format allows it,
+ * otherwise on the nearest frame before it.
+ *
+ * @param dec Open decoder
+ * @param sample Target position in per-channel samples
+ * @param actual Position the next decode starts at
+ * @return ESP_OK, or an error (stream position is then undefined)
+ */
+esp_err_t music_decoder_seek(music_decoder_t *dec, uint64_t sample,
+                             uint64_t *actual);
+
+/**
+ * @brief Close a decoder instance (safe on a closed instance)
+ */
+void music_decoder_close(music_decoder_t *dec);
+
+/**
+ * @brief Format name for logs and telemetry
+ */
+const char *music_format_to_string(music_format_t format);
+
+/**
+ * @brief Append a seek point (ignored when full or out of order)
+ */
+void music_seek_table_add(music_seek_table_t *table, uint64_t sample,
+                          uint32_t offset);
+
+/**
+ * @brief Find the last seek point at or before a sample (binary search)
+ *
+ * @return Seek point, or NULL if the table is empty
+ */
+const music_seek_point_t *music_seek_table_find(const music_seek_table_t *table,
+                                                uint64_t sample);
+
+/* Built-in decoders (music_decoder_*.c) */
+extern const music_decoder_ops_t music_decoder_mp3;
+extern const music_decoder_ops_t music_decoder_wav;
+extern const music_decoder_ops_t music_decoder_flac;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,851 @@
+/**
+ * @file music_decoder_flac.c
+ * @brief FLAC decoder plug-in
+ *
+ * Small integer-only FLAC decoder: fixed and LPC predictors, Rice residuals
+ * (both parameter widths, escape partitions), wasted bits and all stereo
+ * decorrelation modes, for mono/stereo streams of 8 to 24 bits. Frame CRCs
+ * are not verified; a frame that fails to parse is skipped by resyncing on
+ * the next frame header. Prediction uses 32-bit arithmetic whenever the
+ * coefficient precision allows it, which covers all 16-bit material.
+ *
+ * Tags come from the VORBIS_COMMENT block (TITLE, ARTIST).
+ *
+ * The seek table is taken from the SEEKTABLE block (thinned to
+ * MUSIC_SEEK_POINTS), or estimated linearly from the file size when the
+ * encoder wrote none. Either way the frame number in the first header found
+ * after the seek gives the exact position, and whole frames are decoded and
+ * dropped until the target frame.
+ */
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "music_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "flac_dec";
+
+#define FLAC_INPUT_BUF_SIZE 4096
+#define FLAC_MAX_BLOCK_SIZE 16384 // libFLAC presets use 4096 or 4608
+#define FLAC_MAX_CHANNELS 2
+#define FLAC_MAX_LPC_ORDER 32
+
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_SEEKTABLE 3
+#define FLAC_BLOCK_VORBIS_COMMENT 4
+#define FLAC_SEEKPOINT_SIZE 18
+#define FLAC_SEEKPOINT_PLACEHOLDER 0xFFFFFFFFFFFFFFFFULL
+// Frames decoded and dropped at most while landing on a seek target
+#define FLAC_SEEK_MAX_FRAMES 256
+
+typedef struct {
+  FILE *fp;
+  uint8_t *buf;
+  size_t len;
+  size_t pos;
+  uint64_t cache; // MSB-first bit cache
+  int bits;       // Valid bits in cache
+  bool eof;
+} flac_bits_t;
+
+typedef struct {
+  flac_bits_t br;
+  uint32_t sample_rate;
+  uint8_t channels;
+  uint8_t bps;
+  uint32_t min_block;
+  uint32_t max_block;
+  int32_t *samples[FLAC_MAX_CHANNELS]; // Decoded block per channel (PSRAM)
+  uint32_t block_size;                 // Samples per channel in the block
+  uint32_t block_pos;                  // Next sample to output
+  uint64_t frame_sample;               // Position of the decoded block
+  music_seek_table_t seek_table;
+} flac_ctx_t;
+
+typedef struct {
+  uint32_t sample_rate;
+  uint8_t channels;
+  uint8_t bps;
+  uint16_t min_block;
+  uint16_t max_block;
+  uint64_t total_samples;
+} flac_streaminfo_t;
+
+/* ---------- Bit reader ---------- */
+
+static void br_refill(flac_bits_t *br) {
+  while (br->bits <= 56) {
+    if (br->pos >= br->len) {
+      if (br->eof) {
+        return;
+      }
+      br->len = fread(br->buf, 1, FLAC_INPUT_BUF_SIZE, br->fp);
+      br->pos = 0;
+      if (br->len == 0) {
+        br->eof = true;
+        return;
+      }
+    }
+    br->cache |= (uint64_t)br->buf[br->pos++] << (56 - br->bits);
+    br->bits += 8;
+  }
+}
+
+/**
+ * @brief Read n bits (n <= 32)
+ *
+ * @return false at end of stream
+ */
+static bool br_read(flac_bits_t *br, int n, uint32_t *out) {
+  if (n == 0) {
+    *out = 0;
+    return true;
+  }
+  if (br->bits < n) {
+    br_refill(br);
+    if (br->bits < n) {
+      return false;
+    }
+  }
+  *out = (uint32_t)(br->cache >> (64 - n));
+  br->cache <<= n;
+  br->bits -= n;
+  return true;
+}
+
+static bool br_read_signed(flac_bits_t *br, int n, int32_t *out) {
+  uint32_t v;
+  if (!br_read(br, n, &v)) {
+    return false;
+  }
+  if (n > 0 && n < 32) {
+    v = (v ^ (1U << (n - 1))) - (1U << (n - 1)); // Sign extend
+  }
+  *out = (int32_t)v;
+  return true;
+}
+
+/**
+ * @brief Count zero bits up to and including the terminating one
+ */
+static bool br_read_unary(flac_bits_t *br, uint32_t *out) {
+  uint32_t zeros = 0;
+  for (;;) {
+    if (br->bits == 0) {
+      br_refill(br);
+      if (br->bits == 0) {
+        return false;
+      }
+    }
+    uint64_t valid = br->cache & (~0ULL << (64 - br->bits));
+    if (valid) {
+      int lz = __builtin_clzll(valid);
+      zeros += lz;
+      br->cache = lz < 63 ? br->cache << (lz + 1) : 0;
+      br->bits -= lz + 1;
+      *out = zeros;
+      return true;
+    }
+    zeros += br->bits;
+    br->cache = 0;
+    br->bits = 0;
+  }
+}
+
+static void br_align(flac_bits_t *br) {
+  int drop = br->bits & 7;
+  br->cache <<= drop;
+  br->bits -= drop;
+}
+
+/* ---------- Metadata ---------- */
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void parse_streaminfo(const uint8_t *p, flac_streaminfo_t *si) {
+  si->min_block = (p[0] << 8) | p[1];
+  si->max_block = (p[2] << 8) | p[3];
+  si->sample_rate = (p[10] << 12) | (p[11] << 4) | (p[12] >> 4);
+  si->channels = ((p[12] >> 1) & 0x07) + 1;
+  si->bps = (((p[12] & 0x01) << 4) | (p[13] >> 4)) + 1;
+  si->total_samples = ((uint64_t)(p[13] & 0x0F) << 32) |
+                      ((uint32_t)p[14] << 24) | (p[15] << 16) | (p[16] << 8) |
+                      p[17];
+}
+
+static void copy_comment(const char *value, uint32_t len, char *out) {
+  size_t n = len < MUSIC_DECODER_TAG_MAX - 1 ? len : MUSIC_DECODER_TAG_MAX - 1;
+  memcpy(out, value, n);
+  out[n] = '\0';
+}
+
+static void parse_vorbis_comment(const uint8_t *p, uint32_t len,
+                                 music_probe_t *out) {
+  if (len < 8) {
+    return;
+  }
+  uint32_t pos = 4 + le32(p); // Skip vendor string
+  if (pos + 4 > len) {
+    return;
+  }
+  uint32_t count = le32(p + pos);
+  pos += 4;
+  for (uint32_t i = 0; i < count && pos + 4 <= len; i++) {
+    uint32_t clen = le32(p + pos);
+    pos += 4;
+    if (clen > len - pos) {
+      break;
+    }
+    const char *c = (const char *)p + pos;
+    if (clen > 6 && strncasecmp(c, "TITLE=", 6) == 0) {
+      copy_comment(c + 6, clen - 6, out->title);
+    } else if (clen > 7 && strncasecmp(c, "ARTIST=", 7) == 0) {
+      copy_comment(c + 7, clen - 7, out->artist);
+    }
+    pos += clen;
+  }
+}
+
+static uint64_t be64(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+/**
+ * @brief Read SEEKTABLE points (offsets relative to the first frame)
+ */
+static esp_err_t read_seektable(FILE *fp, uint32_t len,
+                                music_seek_table_t *table) {
+  uint32_t count = len / FLAC_SEEKPOINT_SIZE;
+  uint32_t stride = (count + MUSIC_SEEK_POINTS - 1) / MUSIC_SEEK_POINTS;
+  uint8_t pt[FLAC_SEEKPOINT_SIZE];
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (fread(pt, 1, sizeof(pt), fp) != sizeof(pt)) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint64_t sample = be64(pt);
+    uint64_t offset = be64(pt + 8);
+    if (i % stride == 0 && sample != FLAC_SEEKPOINT_PLACEHOLDER &&
+        offset < UINT32_MAX) {
+      music_seek_table_add(table, sample, (uint32_t)offset);
+    }
+  }
+  return fseek(fp, len - count * FLAC_SEEKPOINT_SIZE, SEEK_CUR) == 0
+             ? ESP_OK
+             : ESP_ERR_INVALID_RESPONSE;
+}
+
+/**
+ * @brief Read the metadata blocks, leaving fp at the first frame
+ *
+ * @param buf Scratch for VORBIS_COMMENT (NULL to skip tags)
+ * @param seek Seek table to fill from SEEKTABLE (NULL to skip)
+ */
+static esp_err_t read_metadata(FILE *fp, flac_streaminfo_t *si, uint8_t *buf,
+                               size_t buf_size, music_probe_t *probe,
+                               music_seek_table_t *seek) {
+  uint8_t hdr[4];
+  if (fread(hdr, 1, 4, fp) != 4 || memcmp(hdr, "fLaC", 4) != 0) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  bool have_info = false;
+  bool last = false;
+  while (!last) {
+    if (fread(hdr, 1, 4, fp) != 4) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    last = hdr[0] & 0x80;
+    int type = hdr[0] & 0x7F;
+    uint32_t len = (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+
+    if (type == FLAC_BLOCK_STREAMINFO && len >= 34) {
+      uint8_t info[34];
+      if (fread(info, 1, sizeof(info), fp) != sizeof(info)) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      parse_streaminfo(info, si);
+      have_info = true;
+      len -= sizeof(info);
+    } else if (type == FLAC_BLOCK_VORBIS_COMMENT && buf && len <= buf_size) {
+      if (fread(buf, 1, len, fp) != len) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      parse_vorbis_comment(buf, len, probe);
+      len = 0;
+    } else if (type == FLAC_BLOCK_SEEKTABLE && seek) {
+      esp_err_t ret = read_seektable(fp, len, seek);
+      if (ret != ESP_OK) {
+        return ret;
+      }
+      len = 0;
+    }
+    if (len > 0 && fseek(fp, len, SEEK_CUR) != 0) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+  }
+  return have_info ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+/* ---------- Frame decoding ---------- */
+
+static bool decode_residual(flac_bits_t *br, uint32_t block_size, int order,
+                            int32_t *res) {
+  uint32_t method, part_order;
+  if (!br_read(br, 2, &method) || method > 1 || !br_read(br, 4, &part_order)) {
+    return false;
+  }
+  int param_bits = method == 0 ? 4 : 5;
+  uint32_t escape = method == 0 ? 15 : 31;
+  uint32_t parts = 1U << part_order;
+  uint32_t part_size = block_size >> part_order;
+  if (part_size * parts != block_size || part_size < (uint32_t)order) {
+    return false;
+  }
+
+  uint32_t i = order;
+  for (uint32_t p = 0; p < parts; p++) {
+    uint32_t end = (p + 1) * part_size;
+    uint32_t k;
+    if (!br_read(br, param_bits, &k)) {
+      return false;
+    }
+    if (k == escape) {
+      uint32_t raw_bits;
+      if (!br_read(br, 5, &raw_bits)) {
+        return false;
+      }
+      for (; i < end; i++) {
+        if (!br_read_signed(br, raw_bits, &res[i])) {
+          return false;
+        }
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      uint32_t q, r;
+      if (!br_read_unary(br, &q) || !br_read(br, k, &r)) {
+        return false;
+      }
+      uint32_t v = (q << k) | r;
+      res[i] = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+  }
+  return true;
+}
+
+static void restore_fixed(int32_t *s, uint32_t n, int order) {
+  switch (order) {
+  case 1:
+    for (uint32_t i = 1; i < n; i++) {
+      s[i] += s[i - 1];
+    }
+    break;
+  case 2:
+    for (uint32_t i = 2; i < n; i++) {
+      s[i] += 2 * s[i - 1] - s[i - 2];
+    }
+    break;
+  case 3:
+    for (uint32_t i = 3; i < n; i++) {
+      s[i] += 3 * s[i - 1] - 3 * s[i - 2] + s[i - 3];
+    }
+    break;
+  case 4:
+    for (uint32_t i = 4; i < n; i++) {
+      s[i] += 4 * s[i - 1] - 6 * s[i - 2] + 4 * s[i - 3] - s[i - 4];
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void restore_lpc(int32_t *s, uint32_t n, const int32_t *coefs,
+                        int order, int shift, bool wide) {
+  if (!wide) {
+    for (uint32_t i = order; i < n; i++) {
+      int32_t sum = 0;
+      for (int j = 0; j < order; j++) {
+        sum += coefs[j] * s[i - 1 - j];
+      }
+      s[i] += sum >> shift;
+    }
+    return;
+  }
+  for (uint32_t i = order; i < n; i++) {
+    int64_t sum = 0;
+    for (int j = 0; j < order; j++) {
+      sum += (int64_t)coefs[j] * s[i - 1 - j];
+    }
+    s[i] += (int32_t)(sum >> shift);
+  }
+}
+
+static bool decode_subframe(flac_bits_t *br, uint32_t block_size, int bps,
+                            int32_t *s) {
+  uint32_t pad, type, wasted_flag;
+  if (!br_read(br, 1, &pad) || pad != 0 || !br_read(br, 6, &type) ||
+      !br_read(br, 1, &wasted_flag)) {
+    return false;
+  }
+  uint32_t wasted = 0;
+  if (wasted_flag) {
+    if (!br_read_unary(br, &wasted)) {
+      return false;
+    }
+    wasted++;
+    if ((int)wasted >= bps) {
+      return false;
+    }
+    bps -= wasted;
+  }
+
+  if (type == 0) {
+    // Constant
+    int32_t v;
+    if (!br_read_signed(br, bps, &v)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < block_size; i++) {
+      s[i] = v;
+    }
+  } else if (type == 1) {
+    // Verbatim
+    for (uint32_t i = 0; i < block_size; i++) {
+      if (!br_read_signed(br, bps, &s[i])) {
+        return false;
+      }
+    }
+  } else if (type >= 8 && type <= 12) {
+    // Fixed predictor
+    int order = type & 0x07;
+    for (int i = 0; i < order; i++) {
+      if (!br_read_signed(br, bps, &s[i])) {
+        return false;
+      }
+    }
+    if (!decode_residual(br, block_size, order, s)) {
+      return false;
+    }
+    restore_fixed(s, block_size, order);
+  } else if (type >= 32) {
+    // LPC
+    int order = (type & 0x1F) + 1;
+    for (int i = 0; i < order; i++) {
+      if (!br_read_signed(br, bps, &s[i])) {
+        return false;
+      }
+    }
+    uint32_t precision;
+    int32_t shift;
+    int32_t coefs[FLAC_MAX_LPC_ORDER];
+    if (!br_read(br, 4, &precision) || precision == 15 ||
+        !br_read_signed(br, 5, &shift) || shift < 0) {
+      return false;
+    }
+    precision++;
+    for (int i = 0; i < order; i++) {
+      if (!br_read_signed(br, precision, &coefs[i])) {
+        return false;
+      }
+    }
+    if (!decode_residual(br, block_size, order, s)) {
+      return false;
+    }
+    // sum of order products of bps-bit samples and precision-bit coefs
+    int log2_order = 32 - __builtin_clz((uint32_t)order);
+    bool wide = bps + (int)precision + log2_order > 32;
+    restore_lpc(s, block_size, coefs, order, shift, wide);
+  } else {
+    return false; // Reserved subframe type
+  }
+
+  if (wasted) {
+    for (uint32_t i = 0; i < block_size; i++) {
+      s[i] = (int32_t)((uint32_t)s[i] << wasted);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Find and parse the next frame header
+ *
+ * @return Samples per channel, 0 at end of stream
+ */
+static uint32_t read_frame_header(flac_ctx_t *c, uint32_t *assignment,
+                                  int *bps) {
+  static const uint8_t sample_sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  flac_bits_t *br = &c->br;
+
+  for (;;) {
+    // Sync code 0b11111111111110 plus the reserved bit, byte aligned
+    br_align(br);
+    uint32_t sync;
+    if (!br_read(br, 8, &sync)) {
+      return 0;
+    }
+    if (sync != 0xFF) {
+      continue;
+    }
+    uint32_t b;
+    if (!br_read(br, 8, &b)) {
+      return 0;
+    }
+    if ((b & 0xFE) != 0xF8) {
+      continue;
+    }
+    bool variable_block = b & 0x01;
+
+    uint32_t bs_code, sr_code, ch, ss_code, reserved;
+    if (!br_read(br, 4, &bs_code) || !br_read(br, 4, &sr_code) ||
+        !br_read(br, 4, &ch) || !br_read(br, 3, &ss_code) ||
+        !br_read(br, 1, &reserved)) {
+      return 0;
+    }
+    if (bs_code == 0 || sr_code == 15 || ch > 10 || ss_code == 3 ||
+        ss_code == 7 || reserved) {
+      continue; // False sync
+    }
+
+    // Frame/sample number, UTF-8 style coded
+    uint32_t lead;
+    if (!br_read(br, 8, &lead)) {
+      return 0;
+    }
+    int extra = 0;
+    while (extra < 7 && (lead & (0x80 >> extra))) {
+      extra++;
+    }
+    if (extra == 1 || extra == 7) {
+      continue;
+    }
+    uint64_t number = lead & (0x7F >> extra);
+    bool ok = true;
+    for (int i = 1; i < extra && ok; i++) {
+      uint32_t cont;
+      ok = br_read(br, 8, &cont) && (cont & 0xC0) == 0x80;
+      number = (number << 6) | (cont & 0x3F);
+    }
+    if (!ok) {
+      continue;
+    }
+
+    uint32_t block_size;
+    if (bs_code == 1) {
+      block_size = 192;
+    } else if (bs_code <= 5) {
+      block_size = 576U << (bs_code - 2);
+    } else if (bs_code == 6 || bs_code == 7) {
+      if (!br_read(br, bs_code == 6 ? 8 : 16, &block_size)) {
+        return 0;
+      }
+      block_size++;
+    } else {
+      block_size = 256U << (bs_code - 8);
+    }
+
+    // The rate comes from STREAMINFO; only skip an explicit one
+    if (sr_code >= 12) {
+      uint32_t skip;
+      if (!br_read(br, sr_code == 12 ? 8 : 16, &skip)) {
+        return 0;
+      }
+    }
+
+    uint32_t crc8;
+    if (!br_read(br, 8, &crc8)) {
+      return 0;
+    }
+
+    int frame_channels = ch < 8 ? (int)ch + 1 : 2;
+    int frame_bps = ss_code ? sample_sizes[ss_code] : c->bps;
+    if (frame_channels != c->channels || frame_bps != c->bps ||
+        block_size > c->max_block) {
+      continue;
+    }
+    // Fixed-blocksize streams number frames, variable ones number samples
+    c->frame_sample = variable_block ? number : number * c->min_block;
+    *assignment = ch;
+    *bps = frame_bps;
+    return block_size;
+  }
+}
+
+static bool decode_frame(flac_ctx_t *c) {
+  for (;;) {
+    uint32_t assignment;
+    int bps;
+    uint32_t n = read_frame_header(c, &assignment, &bps);
+    if (n == 0) {
+      return false;
+    }
+
+    bool ok = true;
+    for (int ch = 0; ch < c->channels && ok; ch++) {
+      // The side channel carries one extra bit
+      bool side = (assignment == 8 && ch == 1) ||
+                  (assignment == 9 && ch == 0) ||
+                  (assignment == 10 && ch == 1);
+      ok = decode_subframe(&c->br, n, bps + (side ? 1 : 0), c->samples[ch]);
+    }
+    if (!ok) {
+      ESP_LOGD(TAG, "Corrupt frame, resyncing");
+      continue;
+    }
+    br_align(&c->br);
+    uint32_t crc16;
+    br_read(&c->br, 16, &crc16);
+
+    int32_t *l = c->samples[0];
+    int32_t *r = c->samples[1];
+    switch (assignment) {
+    case 8: // Left/side
+      for (uint32_t i = 0; i < n; i++) {
+        r[i] = l[i] - r[i];
+      }
+      break;
+    case 9: // Side/right
+      for (uint32_t i = 0; i < n; i++) {
+        l[i] += r[i];
+      }
+      break;
+    case 10: // Mid/side
+      for (uint32_t i = 0; i < n; i++) {
+        int32_t side = r[i];
+        int32_t mid = (int32_t)((uint32_t)l[i] << 1) | (side & 1);
+        l[i] = (mid + side) >> 1;
+        r[i] = (mid - side) >> 1;
+      }
+      break;
+    default:
+      break;
+    }
+
+    c->block_size = n;
+    c->block_pos = 0;
+    return true;
+  }
+}
+
+/* ---------- Plug-in operations ---------- */
+
+static bool flac_sniff(const uint8_t *hdr, size_t len) {
+  return len >= 4 && memcmp(hdr, "fLaC", 4) == 0;
+}
+
+static esp_err_t flac_probe(FILE *fp, uint32_t file_size, uint8_t *buf,
+                            size_t buf_size, music_probe_t *out) {
+  flac_streaminfo_t si = {0};
+  esp_err_t ret = read_metadata(fp, &si, buf, buf_size, out, NULL);
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  out->sample_rate = si.sample_rate;
+  out->channels = si.channels;
+  if (si.sample_rate > 0 && si.total_samples > 0) {
+    out->duration_ms = (uint32_t)(si.total_samples * 1000 / si.sample_rate);
+  }
+  if (out->duration_ms > 0) {
+    out->bitrate_kbps = (uint16_t)((uint64_t)file_size * 8 / out->duration_ms);
+  }
+  return ESP_OK;
+}
+
+static void flac_close(void *ctx) {
+  flac_ctx_t *c = ctx;
+  if (!c) {
+    return;
+  }
+  for (int i = 0; i < FLAC_MAX_CHANNELS; i++) {
+    heap_caps_free(c->samples[i]);
+  }
+  free(c->br.buf);
+  free(c);
+}
+
+static void build_seek_table(flac_ctx_t *c, FILE *fp, uint64_t total_samples) {
+  music_seek_table_t *t = &c->seek_table;
+  long first_frame = ftell(fp);
+  if (first_frame < 0) {
+    t->count = 0;
+    return;
+  }
+
+  if (t->count > 0) {
+    // SEEKTABLE offsets are relative to the first frame
+    for (int i = 0; i < t->count; i++) {
+      t->points[i].offset += (uint32_t)first_frame;
+    }
+    return;
+  }
+
+  // No SEEKTABLE: linear estimate, the landing frame header corrects it
+  if (total_samples == 0 || fseek(fp, 0, SEEK_END) != 0) {
+    fseek(fp, first_frame, SEEK_SET);
+    return;
+  }
+  long file_size = ftell(fp);
+  fseek(fp, first_frame, SEEK_SET);
+  if (file_size <= first_frame) {
+    return;
+  }
+  uint32_t audio_bytes = (uint32_t)(file_size - first_frame);
+  for (int i = 0; i < MUSIC_SEEK_POINTS; i++) {
+    music_seek_table_add(
+        t, total_samples * i / MUSIC_SEEK_POINTS,
+        (uint32_t)first_frame +
+            (uint32_t)((uint64_t)audio_bytes * i / MUSIC_SEEK_POINTS));
+  }
+}
+
+static esp_err_t flac_open(FILE *fp, void **ctx, uint32_t *sample_rate,
+                           uint8_t *channels) {
+  flac_streaminfo_t si = {0};
+  music_seek_table_t *seek = calloc(1, sizeof(*seek));
+  if (!seek) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_err_t ret = read_metadata(fp, &si, NULL, 0, NULL, seek);
+  if (ret != ESP_OK) {
+    free(seek);
+    return ret;
+  }
+  if (si.channels > FLAC_MAX_CHANNELS || si.bps < 8 || si.bps > 24 ||
+      si.max_block == 0 || si.max_block > FLAC_MAX_BLOCK_SIZE) {
+    ESP_LOGW(TAG, "Unsupported FLAC stream (%u ch, %u bit, block %u)",
+             si.channels, si.bps, si.max_block);
+    free(seek);
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  flac_ctx_t *c = calloc(1, sizeof(*c));
+  if (!c) {
+    free(seek);
+    return ESP_ERR_NO_MEM;
+  }
+  c->seek_table = *seek;
+  free(seek);
+  c->br.fp = fp;
+  c->br.buf = malloc(FLAC_INPUT_BUF_SIZE);
+  c->sample_rate = si.sample_rate;
+  c->channels = si.channels;
+  c->bps = si.bps;
+  c->min_block = si.min_block;
+  c->max_block = si.max_block;
+  bool ok = c->br.buf != NULL;
+  for (int i = 0; i < c->channels && ok; i++) {
+    c->samples[i] = heap_caps_malloc(si.max_block * sizeof(int32_t),
+                                     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ok = c->samples[i] != NULL;
+  }
+  if (!ok) {
+    flac_close(c);
+    return ESP_ERR_NO_MEM;
+  }
+
+  build_seek_table(c, fp, si.total_samples);
+
+  *sample_rate = c->sample_rate;
+  *channels = c->channels;
+  *ctx = c;
+  return ESP_OK;
+}
+
+static int flac_decode(void *ctx, int16_t *pcm, size_t max_samples) {
+  flac_ctx_t *c = ctx;
+
+  if (c->block_pos >= c->block_size && !decode_frame(c)) {
+    return 0;
+  }
+
+  uint32_t frames = c->block_size - c->block_pos;
+  if (frames > max_samples / c->channels) {
+    frames = max_samples / c->channels;
+  }
+
+  int shift = c->bps - 16;
+  size_t o = 0;
+  for (uint32_t i = c->block_pos; i < c->block_pos + frames; i++) {
+    for (int ch = 0; ch < c->channels; ch++) {
+      int32_t v = c->samples[ch][i];
+      pcm[o++] = (int16_t)(shift >= 0 ? v >> shift : v << -shift);
+    }
+  }
+  c->block_pos += frames;
+  return (int)o;
+}
+
+/**
+ * @brief Decode frames from a file offset until the one containing sample
+ *
+ * @return false if the stream ended first
+ */
+static bool seek_from(flac_ctx_t *c, uint32_t offset, uint64_t sample) {
+  if (fseek(c->br.fp, offset, SEEK_SET) != 0) {
+    return false;
+  }
+  c->br.len = 0;
+  c->br.pos = 0;
+  c->br.cache = 0;
+  c->br.bits = 0;
+  c->br.eof = false;
+
+  for (int i = 0; i < FLAC_SEEK_MAX_FRAMES; i++) {
+    if (!decode_frame(c)) {
+      return false;
+    }
+    if (c->frame_sample + c->block_size > sample) {
+      return true;
+    }
+  }
+  return true; // Too far to walk; start at the frame reached
+}
+
+static esp_err_t flac_seek(void *ctx, uint64_t sample, uint64_t *actual) {
+  flac_ctx_t *c = ctx;
+  const music_seek_point_t *pt = music_seek_table_find(&c->seek_table, sample);
+  if (!pt) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  // Estimated points can land past the target; step back a point if so
+  while (!seek_from(c, pt->offset, sample) || c->frame_sample > sample) {
+    if (pt == c->seek_table.points) {
+      if (c->block_size == 0) {
+        return ESP_ERR_NOT_FOUND;
+      }
+      break;
+    }
+    pt--;
+  }
+  if (sample > c->frame_sample) {
+    uint64_t skip = sample - c->frame_sample;
+    c->block_pos = skip < c->block_size ? (uint32_t)skip : c->block_size;
+  }
+  *actual = c->frame_sample + c->block_pos;
+  return ESP_OK;
+}
+
+static const char *const flac_extensions[] = {".flac", NULL};
+
+const music_decoder_ops_t music_decoder_flac = {
+    .name = "FLAC",
+    .format = MUSIC_FORMAT_FLAC,
+    .extensions = flac_extensions,
+    .sniff = flac_sniff,
+    .probe = flac_probe,
+    .open = flac_open,
+    .decode = flac_decode,
+    .seek = flac_seek,
+    .close = flac_close,
+};
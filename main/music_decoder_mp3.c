@@ -0,0 +1,504 @@
+/**
+ * @file music_decoder_mp3.c
+ * @brief MP3 decoder plug-in (libhelix, as in the TTS player)
+ *
+ * The probe reads ID3v2 TIT2/TPE1 and takes the duration from a Xing/Info or
+ * VBRI frame count, falling back to a CBR estimate. The decoder skips the
+ * ID3v2 tag before syncing so embedded artwork is never fed to libhelix.
+ *
+ * The seek table comes from the Xing TOC when present, otherwise it is a
+ * linear byte/time map (exact for CBR). After the table lookup, seeking walks
+ * frame headers without decoding up to the target frame.
+ */
+
+#include "esp_log.h"
+#include "mp3dec.h"
+#include "music_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "mp3_dec";
+
+#define MP3_INPUT_BUF_SIZE (MAINBUF_SIZE * 2)
+#define XING_FLAG_FRAMES 0x01
+#define XING_FLAG_BYTES 0x02
+#define XING_FLAG_TOC 0x04
+
+typedef struct {
+  uint32_t sample_rate;
+  uint16_t kbps;
+  uint16_t frame_len;
+  uint16_t samples;
+  uint8_t channels;
+  bool mpeg1;
+} mp3_frame_hdr_t;
+
+typedef struct {
+  FILE *fp;
+  HMP3Decoder decoder;
+  uint8_t *in_buf;
+  uint8_t *read_ptr;
+  int bytes_left;
+  bool eof;
+  uint16_t frame_samples; // Per-channel samples per frame
+  music_seek_table_t seek_table;
+} mp3_ctx_t;
+
+static uint32_t be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t syncsafe32(const uint8_t *p) {
+  return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+         ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+static bool parse_mp3_header(const uint8_t *h, mp3_frame_hdr_t *out) {
+  static const uint16_t kbps_v1[15] = {0,   32,  40,  48,  56,  64,  80, 96,
+                                       112, 128, 160, 192, 224, 256, 320};
+  static const uint16_t kbps_v2[15] = {0,  8,  16, 24,  32,  40,  48, 56,
+                                       64, 80, 96, 112, 128, 144, 160};
+  static const uint32_t rate_v1[3] = {44100, 48000, 32000};
+
+  if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+    return false;
+  }
+  int version = (h[1] >> 3) & 0x03; // 0 = 2.5, 1 = reserved, 2 = 2, 3 = 1
+  int layer = (h[1] >> 1) & 0x03;   // 1 = Layer III
+  int br_idx = h[2] >> 4;
+  int sr_idx = (h[2] >> 2) & 0x03;
+  if (version == 1 || layer != 1 || br_idx == 0 || br_idx == 15 ||
+      sr_idx == 3) {
+    return false;
+  }
+
+  out->mpeg1 = (version == 3);
+  out->sample_rate = rate_v1[sr_idx] >> (out->mpeg1 ? 0 : (version == 2 ? 1 : 2));
+  out->kbps = out->mpeg1 ? kbps_v1[br_idx] : kbps_v2[br_idx];
+  out->channels = ((h[3] >> 6) == 3) ? 1 : 2;
+  out->samples = out->mpeg1 ? 1152 : 576;
+  out->frame_len = (out->mpeg1 ? 144000U : 72000U) * out->kbps /
+                       out->sample_rate +
+                   ((h[2] >> 1) & 0x01);
+  return true;
+}
+
+/**
+ * @brief Find the first frame header confirmed by a second sync
+ *
+ * @return Offset of the frame in buf, or -1
+ */
+static int find_first_frame(const uint8_t *buf, size_t n,
+                            mp3_frame_hdr_t *hdr) {
+  for (size_t i = 0; i + 4 <= n; i++) {
+    if (!parse_mp3_header(buf + i, hdr)) {
+      continue;
+    }
+    // Require a second sync when the next header is inside the buffer
+    size_t next = i + hdr->frame_len;
+    mp3_frame_hdr_t hdr2;
+    if (next + 4 <= n && !parse_mp3_header(buf + next, &hdr2)) {
+      continue;
+    }
+    return (int)i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Offset of the Xing/Info tag inside the first frame
+ */
+static size_t xing_offset(const mp3_frame_hdr_t *hdr) {
+  return 4 + (hdr->mpeg1 ? (hdr->channels == 1 ? 17 : 32)
+                         : (hdr->channels == 1 ? 9 : 17));
+}
+
+/**
+ * @brief Size of a leading ID3v2 tag (0 if none)
+ */
+static uint32_t id3v2_size(const uint8_t *h, size_t len) {
+  if (len < 10 || memcmp(h, "ID3", 3) != 0) {
+    return 0;
+  }
+  return 10 + syncsafe32(h + 6) + ((h[5] & 0x10) ? 10 : 0);
+}
+
+static void copy_id3_text(const uint8_t *data, uint32_t size, char *out,
+                          size_t out_len) {
+  if (size < 2 || out_len == 0) {
+    return;
+  }
+  uint8_t enc = data[0];
+  const uint8_t *p = data + 1;
+  uint32_t n = size - 1;
+  size_t o = 0;
+
+  if (enc == 1 || enc == 2) {
+    // UTF-16: keep the ASCII range, replace everything else
+    bool little = false;
+    if (enc == 1 && n >= 2) {
+      little = (p[0] == 0xFF && p[1] == 0xFE);
+      if ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF)) {
+        p += 2;
+        n -= 2;
+      }
+    }
+    for (uint32_t i = 0; i + 1 < n && o + 1 < out_len; i += 2) {
+      uint16_t cu = little ? (uint16_t)(p[i] | (p[i + 1] << 8))
+                           : (uint16_t)((p[i] << 8) | p[i + 1]);
+      if (cu == 0) {
+        break;
+      }
+      out[o++] = (cu < 0x80) ? (char)cu : '?';
+    }
+  } else {
+    // ISO-8859-1 (0) or UTF-8 (3)
+    for (uint32_t i = 0; i < n && o + 1 < out_len; i++) {
+      if (p[i] == 0) {
+        break;
+      }
+      out[o++] = (enc == 0 && p[i] >= 0x80) ? '?' : (char)p[i];
+    }
+  }
+  out[o] = '\0';
+}
+
+static void parse_id3v2_frames(const uint8_t *buf, size_t len, int version,
+                               char *title, char *artist) {
+  size_t pos = 0;
+  while (pos + 10 <= len) {
+    const uint8_t *f = buf + pos;
+    if (f[0] == 0) {
+      break; // Padding
+    }
+    uint32_t fsize = (version >= 4) ? syncsafe32(f + 4) : be32(f + 4);
+    if (fsize == 0 || pos + 10 + fsize > len) {
+      break;
+    }
+    if (memcmp(f, "TIT2", 4) == 0) {
+      copy_id3_text(f + 10, fsize, title, MUSIC_DECODER_TAG_MAX);
+    } else if (memcmp(f, "TPE1", 4) == 0) {
+      copy_id3_text(f + 10, fsize, artist, MUSIC_DECODER_TAG_MAX);
+    }
+    pos += 10 + fsize;
+  }
+}
+
+/**
+ * @brief Build the seek table from the first frame (buf holds it at offset 0)
+ *
+ * @param frame_offset File offset of the first frame
+ * @param file_size Total file size
+ */
+static void build_seek_table(mp3_ctx_t *c, const uint8_t *buf, size_t len,
+                             const mp3_frame_hdr_t *hdr, uint32_t frame_offset,
+                             uint32_t file_size) {
+  music_seek_table_t *t = &c->seek_table;
+  uint32_t audio_bytes =
+      file_size > frame_offset ? file_size - frame_offset : 0;
+  uint64_t total = 0;
+  const uint8_t *toc = NULL;
+
+  size_t xing = xing_offset(hdr);
+  if (xing + 8 <= len && (memcmp(buf + xing, "Xing", 4) == 0 ||
+                          memcmp(buf + xing, "Info", 4) == 0)) {
+    uint32_t flags = be32(buf + xing + 4);
+    size_t pos = xing + 8;
+    if ((flags & XING_FLAG_FRAMES) && pos + 4 <= len) {
+      total = (uint64_t)be32(buf + pos) * hdr->samples;
+      pos += 4;
+    }
+    if ((flags & XING_FLAG_BYTES) && pos + 4 <= len) {
+      uint32_t bytes = be32(buf + pos);
+      if (bytes > 0 && bytes <= audio_bytes) {
+        audio_bytes = bytes;
+      }
+      pos += 4;
+    }
+    if ((flags & XING_FLAG_TOC) && pos + 100 <= len) {
+      toc = buf + pos;
+    }
+  }
+  if (total == 0 && hdr->kbps > 0) {
+    // CBR (or VBR without a tag): estimate from the first frame's bitrate
+    total = (uint64_t)audio_bytes * 8 * hdr->sample_rate / (hdr->kbps * 1000U);
+  }
+  if (total == 0) {
+    return;
+  }
+
+  for (int i = 0; i < MUSIC_SEEK_POINTS; i++) {
+    uint32_t rel = toc ? (uint32_t)((uint64_t)toc[i] * audio_bytes / 256)
+                       : (uint32_t)((uint64_t)audio_bytes * i /
+                                    MUSIC_SEEK_POINTS);
+    music_seek_table_add(t, total * i / MUSIC_SEEK_POINTS, frame_offset + rel);
+  }
+}
+
+/* ---------- Plug-in operations ---------- */
+
+static bool mp3_sniff(const uint8_t *hdr, size_t len) {
+  if (len >= 3 && memcmp(hdr, "ID3", 3) == 0) {
+    return true;
+  }
+  mp3_frame_hdr_t fh;
+  return len >= 4 && parse_mp3_header(hdr, &fh);
+}
+
+static esp_err_t mp3_probe(FILE *fp, uint32_t file_size, uint8_t *buf,
+                           size_t buf_size, music_probe_t *out) {
+  uint32_t audio_start = 0;
+
+  size_t n = fread(buf, 1, 10, fp);
+  audio_start = id3v2_size(buf, n);
+  if (audio_start > 0 && buf[3] >= 3) {
+    int version = buf[3];
+    uint32_t tag_size = audio_start - 10;
+    size_t want = tag_size < buf_size ? tag_size : buf_size;
+    n = fread(buf, 1, want, fp);
+    parse_id3v2_frames(buf, n, version, out->title, out->artist);
+  }
+
+  if (fseek(fp, audio_start, SEEK_SET) != 0) {
+    return ESP_FAIL;
+  }
+  n = fread(buf, 1, buf_size, fp);
+
+  mp3_frame_hdr_t hdr;
+  int i = find_first_frame(buf, n, &hdr);
+  if (i < 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  out->sample_rate = hdr.sample_rate;
+  out->channels = hdr.channels;
+  out->bitrate_kbps = hdr.kbps;
+
+  uint32_t audio_bytes =
+      file_size > audio_start + i ? file_size - (audio_start + i) : 0;
+
+  // Xing/Info (VBR or LAME CBR) or VBRI header carries the frame count
+  uint32_t frames = 0;
+  size_t xing = i + xing_offset(&hdr);
+  size_t vbri = i + 4 + 32;
+  if (xing + 12 <= n && (memcmp(buf + xing, "Xing", 4) == 0 ||
+                         memcmp(buf + xing, "Info", 4) == 0)) {
+    if (be32(buf + xing + 4) & XING_FLAG_FRAMES) {
+      frames = be32(buf + xing + 8);
+    }
+  } else if (vbri + 18 <= n && memcmp(buf + vbri, "VBRI", 4) == 0) {
+    frames = be32(buf + vbri + 14);
+  }
+
+  if (frames > 0) {
+    out->duration_ms =
+        (uint32_t)((uint64_t)frames * hdr.samples * 1000 / hdr.sample_rate);
+    if (out->duration_ms > 0) {
+      out->bitrate_kbps =
+          (uint16_t)((uint64_t)audio_bytes * 8 / out->duration_ms);
+    }
+  } else if (hdr.kbps > 0) {
+    out->duration_ms = (uint32_t)((uint64_t)audio_bytes * 8 / hdr.kbps);
+  }
+  return ESP_OK;
+}
+
+static void mp3_fill(mp3_ctx_t *c) {
+  if (c->eof) {
+    return;
+  }
+  if (c->bytes_left > 0 && c->read_ptr != c->in_buf) {
+    memmove(c->in_buf, c->read_ptr, c->bytes_left);
+  }
+  c->read_ptr = c->in_buf;
+  size_t n = fread(c->in_buf + c->bytes_left, 1,
+                   MP3_INPUT_BUF_SIZE - c->bytes_left, c->fp);
+  if (n == 0) {
+    c->eof = true;
+  }
+  c->bytes_left += n;
+}
+
+static void mp3_close(void *ctx) {
+  mp3_ctx_t *c = ctx;
+  if (!c) {
+    return;
+  }
+  if (c->decoder) {
+    MP3FreeDecoder(c->decoder);
+  }
+  free(c->in_buf);
+  free(c);
+}
+
+static esp_err_t mp3_open(FILE *fp, void **ctx, uint32_t *sample_rate,
+                          uint8_t *channels) {
+  mp3_ctx_t *c = calloc(1, sizeof(*c));
+  if (!c) {
+    return ESP_ERR_NO_MEM;
+  }
+  c->fp = fp;
+  c->decoder = MP3InitDecoder();
+  c->in_buf = malloc(MP3_INPUT_BUF_SIZE);
+  if (!c->decoder || !c->in_buf) {
+    mp3_close(c);
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Skip the ID3v2 tag; artwork in it can look like frame syncs
+  uint8_t id3[10];
+  size_t n = fread(id3, 1, sizeof(id3), fp);
+  uint32_t audio_start = id3v2_size(id3, n);
+  if (fseek(fp, audio_start, SEEK_SET) != 0) {
+    mp3_close(c);
+    return ESP_FAIL;
+  }
+
+  c->read_ptr = c->in_buf;
+  mp3_fill(c);
+
+  // Report the native format from the first confirmed frame header
+  mp3_frame_hdr_t hdr;
+  int offset = find_first_frame(c->in_buf, c->bytes_left, &hdr);
+  if (offset < 0) {
+    ESP_LOGW(TAG, "No MPEG audio frame found");
+    mp3_close(c);
+    return ESP_ERR_NOT_FOUND;
+  }
+  c->read_ptr += offset;
+  c->bytes_left -= offset;
+  c->frame_samples = hdr.samples;
+
+  long resume_pos = ftell(fp);
+  if (resume_pos >= 0 && fseek(fp, 0, SEEK_END) == 0) {
+    long file_size = ftell(fp);
+    fseek(fp, resume_pos, SEEK_SET);
+    build_seek_table(c, c->read_ptr, c->bytes_left, &hdr,
+                     audio_start + offset, (uint32_t)file_size);
+  }
+
+  *sample_rate = hdr.sample_rate;
+  *channels = hdr.channels;
+  *ctx = c;
+  return ESP_OK;
+}
+
+static int mp3_decode(void *ctx, int16_t *pcm, size_t max_samples) {
+  mp3_ctx_t *c = ctx;
+  if (max_samples < MAX_NGRAN * MAX_NCHAN * MAX_NSAMP) {
+    return -1;
+  }
+
+  for (;;) {
+    if (c->bytes_left < MAINBUF_SIZE) {
+      mp3_fill(c);
+    }
+    if (c->bytes_left <= 0) {
+      return 0;
+    }
+
+    int offset = MP3FindSyncWord(c->read_ptr, c->bytes_left);
+    if (offset < 0) {
+      if (c->eof) {
+        return 0;
+      }
+      c->bytes_left = 0; // No sync in this window, drop it
+      continue;
+    }
+    c->read_ptr += offset;
+    c->bytes_left -= offset;
+
+    int err = MP3Decode(c->decoder, &c->read_ptr, &c->bytes_left, pcm, 0);
+    if (err == ERR_MP3_NONE) {
+      MP3FrameInfo info;
+      MP3GetLastFrameInfo(c->decoder, &info);
+      return info.outputSamps;
+    }
+    if (err == ERR_MP3_INDATA_UNDERFLOW) {
+      if (c->eof) {
+        return 0;
+      }
+      if (c->bytes_left >= MAINBUF_SIZE) {
+        c->read_ptr++; // Corrupt frame larger than the window
+        c->bytes_left--;
+      }
+      continue;
+    }
+    if (err == ERR_MP3_MAINDATA_UNDERFLOW) {
+      continue; // Bit reservoir not filled yet, frame already consumed
+    }
+    ESP_LOGD(TAG, "MP3 decode error %d, resyncing", err);
+    if (c->bytes_left > 0) {
+      c->read_ptr++;
+      c->bytes_left--;
+    }
+  }
+}
+
+static esp_err_t mp3_seek(void *ctx, uint64_t sample, uint64_t *actual) {
+  mp3_ctx_t *c = ctx;
+  const music_seek_point_t *pt = music_seek_table_find(&c->seek_table, sample);
+  if (!pt) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (fseek(c->fp, pt->offset, SEEK_SET) != 0) {
+    return ESP_FAIL;
+  }
+
+  // Fresh decoder state: no overlap or bit reservoir from the old position
+  MP3FreeDecoder(c->decoder);
+  c->decoder = MP3InitDecoder();
+  if (!c->decoder) {
+    return ESP_ERR_NO_MEM;
+  }
+  c->read_ptr = c->in_buf;
+  c->bytes_left = 0;
+  c->eof = false;
+  mp3_fill(c);
+
+  mp3_frame_hdr_t hdr;
+  int offset = find_first_frame(c->read_ptr, c->bytes_left, &hdr);
+  if (offset < 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  c->read_ptr += offset;
+  c->bytes_left -= offset;
+
+  // Walk frame headers (no decoding) up to the frame holding the target
+  uint64_t pos = pt->sample;
+  while (pos + c->frame_samples <= sample) {
+    if (c->bytes_left < 4) {
+      mp3_fill(c);
+    }
+    if (c->bytes_left < 4 || !parse_mp3_header(c->read_ptr, &hdr)) {
+      break; // Lost sync; the decode loop resyncs from here
+    }
+    if (c->bytes_left < hdr.frame_len) {
+      mp3_fill(c);
+      if (c->bytes_left < hdr.frame_len) {
+        break;
+      }
+    }
+    c->read_ptr += hdr.frame_len;
+    c->bytes_left -= hdr.frame_len;
+    pos += c->frame_samples;
+  }
+
+  *actual = pos;
+  return ESP_OK;
+}
+
+static const char *const mp3_extensions[] = {".mp3", NULL};
+
+const music_decoder_ops_t music_decoder_mp3 = {
+    .name = "MP3",
+    .format = MUSIC_FORMAT_MP3,
+    .extensions = mp3_extensions,
+    .sniff = mp3_sniff,
+    .probe = mp3_probe,
+    .open = mp3_open,
+    .decode = mp3_decode,
+    .seek = mp3_seek,
+    .close = mp3_close,
+};
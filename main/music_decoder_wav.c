@@ -0,0 +1,265 @@
+/**
+ * @file music_decoder_wav.c
+ * @brief WAV decoder plug-in
+ *
+ * 16-bit little-endian PCM is passed through: fread() goes straight into the
+ * output buffer with no conversion. 8/24/32-bit integer PCM is converted to
+ * 16-bit in place. Tags come from the LIST/INFO chunk (INAM, IART).
+ *
+ * PCM needs no seek table: a sample position maps straight to a byte offset.
+ */
+
+#include "esp_log.h"
+#include "music_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "wav_dec";
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef struct {
+  FILE *fp;
+  uint32_t sample_rate;
+  uint16_t channels;
+  uint16_t bits;
+  uint32_t data_offset;
+  uint32_t data_size;
+  uint32_t data_left; // Bytes of the data chunk not read yet
+} wav_ctx_t;
+
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void copy_info_text(const uint8_t *p, uint32_t len, char *out) {
+  size_t n = len < MUSIC_DECODER_TAG_MAX - 1 ? len : MUSIC_DECODER_TAG_MAX - 1;
+  memcpy(out, p, n);
+  out[n] = '\0';
+}
+
+static void parse_info_list(const uint8_t *p, uint32_t len,
+                            music_probe_t *out) {
+  if (len < 4 || memcmp(p, "INFO", 4) != 0) {
+    return;
+  }
+  uint32_t pos = 4;
+  while (pos + 8 <= len) {
+    uint32_t size = le32(p + pos + 4);
+    if (pos + 8 + size > len) {
+      break;
+    }
+    if (memcmp(p + pos, "INAM", 4) == 0) {
+      copy_info_text(p + pos + 8, size, out->title);
+    } else if (memcmp(p + pos, "IART", 4) == 0) {
+      copy_info_text(p + pos + 8, size, out->artist);
+    }
+    pos += 8 + size + (size & 1);
+  }
+}
+
+/**
+ * @brief Walk the RIFF chunks up to the data chunk
+ *
+ * @param info_buf Scratch for the LIST chunk (NULL to skip tags)
+ */
+static esp_err_t parse_chunks(FILE *fp, wav_ctx_t *w, uint8_t *info_buf,
+                              size_t info_buf_size, music_probe_t *probe) {
+  uint8_t hdr[12];
+  if (fread(hdr, 1, 12, fp) != 12 || memcmp(hdr, "RIFF", 4) != 0 ||
+      memcmp(hdr + 8, "WAVE", 4) != 0) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  bool have_fmt = false;
+  uint32_t pos = 12;
+  for (;;) {
+    uint8_t ch[8];
+    if (fread(ch, 1, 8, fp) != 8) {
+      return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t size = le32(ch + 4);
+    pos += 8;
+
+    if (memcmp(ch, "fmt ", 4) == 0) {
+      uint8_t fmt[40];
+      size_t want = size < sizeof(fmt) ? size : sizeof(fmt);
+      if (want < 16 || fread(fmt, 1, want, fp) != want) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      uint16_t tag = le16(fmt);
+      if (tag == WAV_FORMAT_EXTENSIBLE && want >= 26) {
+        tag = le16(fmt + 24); // Sub-format GUID starts with the format tag
+      }
+      if (tag != WAV_FORMAT_PCM) {
+        ESP_LOGW(TAG, "Unsupported WAV format tag 0x%04x", tag);
+        return ESP_ERR_NOT_SUPPORTED;
+      }
+      w->channels = le16(fmt + 2);
+      w->sample_rate = le32(fmt + 4);
+      w->bits = le16(fmt + 14);
+      if (w->bits != 8 && w->bits != 16 && w->bits != 24 && w->bits != 32) {
+        ESP_LOGW(TAG, "Unsupported WAV sample size %u", w->bits);
+        return ESP_ERR_NOT_SUPPORTED;
+      }
+      have_fmt = true;
+    } else if (memcmp(ch, "LIST", 4) == 0 && info_buf && size <= info_buf_size) {
+      if (fread(info_buf, 1, size, fp) == size) {
+        parse_info_list(info_buf, size, probe);
+      }
+    } else if (memcmp(ch, "data", 4) == 0) {
+      if (!have_fmt) {
+        return ESP_ERR_INVALID_RESPONSE;
+      }
+      w->data_offset = pos;
+      w->data_size = size;
+      return ESP_OK;
+    }
+
+    pos += size + (size & 1); // Chunks are word aligned
+    if (fseek(fp, pos, SEEK_SET) != 0) {
+      return ESP_ERR_NOT_FOUND;
+    }
+  }
+}
+
+/* ---------- Plug-in operations ---------- */
+
+static bool wav_sniff(const uint8_t *hdr, size_t len) {
+  return len >= 12 && memcmp(hdr, "RIFF", 4) == 0 &&
+         memcmp(hdr + 8, "WAVE", 4) == 0;
+}
+
+static esp_err_t wav_probe(FILE *fp, uint32_t file_size, uint8_t *buf,
+                           size_t buf_size, music_probe_t *out) {
+  wav_ctx_t w = {0};
+  esp_err_t ret = parse_chunks(fp, &w, buf, buf_size, out);
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (w.data_offset > file_size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (w.data_size > file_size - w.data_offset) {
+    w.data_size = file_size - w.data_offset; // Truncated recording
+  }
+
+  uint32_t frame_bytes = w.channels * (w.bits / 8);
+  out->sample_rate = w.sample_rate;
+  out->channels = w.channels;
+  out->bitrate_kbps = (uint16_t)(w.sample_rate * frame_bytes * 8 / 1000);
+  if (w.sample_rate > 0 && frame_bytes > 0) {
+    out->duration_ms =
+        (uint32_t)((uint64_t)(w.data_size / frame_bytes) * 1000 / w.sample_rate);
+  }
+  return ESP_OK;
+}
+
+static esp_err_t wav_open(FILE *fp, void **ctx, uint32_t *sample_rate,
+                          uint8_t *channels) {
+  wav_ctx_t *w = calloc(1, sizeof(*w));
+  if (!w) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_err_t ret = parse_chunks(fp, w, NULL, 0, NULL);
+  if (ret != ESP_OK) {
+    free(w);
+    return ret;
+  }
+  w->fp = fp;
+  w->data_left = w->data_size;
+
+  *sample_rate = w->sample_rate;
+  *channels = (uint8_t)w->channels;
+  *ctx = w;
+  return ESP_OK;
+}
+
+static int wav_decode(void *ctx, int16_t *pcm, size_t max_samples) {
+  wav_ctx_t *w = ctx;
+  size_t bytes_per_sample = w->bits / 8;
+
+  // Whole frames only, so channels never swap after a short read. Wider
+  // samples are read raw into pcm, so they have to fit its byte size too.
+  size_t samples = max_samples;
+  if (bytes_per_sample > sizeof(int16_t)) {
+    samples = max_samples * sizeof(int16_t) / bytes_per_sample;
+  }
+  samples -= samples % w->channels;
+  size_t want = samples * bytes_per_sample;
+  if (want > w->data_left) {
+    want = w->data_left - w->data_left % (bytes_per_sample * w->channels);
+  }
+  if (want == 0) {
+    return 0;
+  }
+
+  if (w->bits == 16) {
+    size_t n = fread(pcm, 1, want, w->fp);
+    w->data_left -= n;
+    return (int)(n / 2);
+  }
+
+  // Narrow in place: output never overtakes input, since each output sample
+  // is at most as wide as the input sample it comes from. 8-bit input is
+  // wider on output, so it is read into the upper half of the buffer first.
+  uint8_t *raw = (uint8_t *)pcm;
+  if (w->bits == 8) {
+    raw += samples;
+  }
+  size_t n = fread(raw, 1, want, w->fp);
+  w->data_left -= n;
+  size_t count = n / bytes_per_sample;
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *s = raw + i * bytes_per_sample;
+    switch (w->bits) {
+    case 8:
+      pcm[i] = (int16_t)((s[0] - 128) * 256); // 8-bit WAV is unsigned
+      break;
+    case 24:
+      pcm[i] = (int16_t)(s[1] | (s[2] << 8));
+      break;
+    case 32:
+      pcm[i] = (int16_t)(s[2] | (s[3] << 8));
+      break;
+    }
+  }
+  return (int)count;
+}
+
+static esp_err_t wav_seek(void *ctx, uint64_t sample, uint64_t *actual) {
+  wav_ctx_t *w = ctx;
+  uint32_t frame_bytes = w->channels * (w->bits / 8);
+  uint64_t frames = w->data_size / frame_bytes;
+  if (sample > frames) {
+    sample = frames;
+  }
+
+  uint32_t offset = (uint32_t)(sample * frame_bytes);
+  if (fseek(w->fp, w->data_offset + offset, SEEK_SET) != 0) {
+    return ESP_FAIL;
+  }
+  w->data_left = w->data_size - offset;
+  *actual = sample;
+  return ESP_OK;
+}
+
+static void wav_close(void *ctx) { free(ctx); }
+
+static const char *const wav_extensions[] = {".wav", NULL};
+
+const music_decoder_ops_t music_decoder_wav = {
+    .name = "WAV",
+    .format = MUSIC_FORMAT_WAV,
+    .extensions = wav_extensions,
+    .sniff = wav_sniff,
+    .probe = wav_probe,
+    .open = wav_open,
+    .decode = wav_decode,
+    .seek = wav_seek,
+    .close = wav_close,
+};
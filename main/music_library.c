@@ -0,0 +1,615 @@
+/**
+ * @file music_library.c
+ * @brief Persistent music library index implementation
+ *
+ * Index file layout (little-endian, packed):
+ *   music_index_header_t
+ *   music_index_record_t[count]
+ *   string table (NUL-terminated UTF-8, referenced by record offsets)
+ *
+ * Records are fixed size so any track can be located with a single seek.
+ * They are read in pages of PAGE_RECORDS; strings are read only when a path
+ * or display name is requested.
+ *
+ * Per-track metadata comes from the probe of the decoder that recognizes the
+ * file header (music_decoder.h).
+ *
+ * On FATFS a directory's st_size is always 0 and its mtime does not follow
+ * the entries, so validity is checked against a fingerprint of the listing
+ * instead: the number of music files and a hash of their names, sizes and
+ * modification times, so a file replaced under the same name is seen too.
+ * On the card this is one FatFs f_readdir() pass, which returns size and
+ * date with each entry; a stat() per file would search the directory again
+ * for every name. Elsewhere (host tests) each file is stat()ed.
+ */
+
+#include "music_library.h"
+#include "music_decoder.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef ESP_PLATFORM
+#include "bsp/esp32_p4_function_ev_board.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
+#endif
+
+static const char *TAG = "music_lib";
+
+#ifndef MUSIC_LIBRARY_INDEX_DIR
+#define MUSIC_LIBRARY_INDEX_DIR "/sdcard" // Host tests point this elsewhere
+#endif
+#define INDEX_PATH MUSIC_LIBRARY_INDEX_DIR "/.music_index.bin"
+#define INDEX_TMP_PATH MUSIC_LIBRARY_INDEX_DIR "/.music_index.tmp"
+#define INDEX_STR_PATH MUSIC_LIBRARY_INDEX_DIR "/.music_index.str"
+#define INDEX_MAGIC 0x58494C4DU // "MLIX"
+#define INDEX_VERSION 4 // 3: listing fingerprint, 4: with sizes and mtimes
+#define INDEX_NO_STRING 0xFFFFFFFFU
+#define INDEX_DIR_MAX 64
+#define INDEX_IO_BUF_SIZE 4096
+#define PAGE_RECORDS 16
+#define PROBE_BUF_SIZE 4096
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t count;
+  uint32_t dir_mtime;
+  uint32_t dir_entries; // Music files in the listing
+  uint32_t dir_files;   // Order-independent hash of name, size, mtime
+  uint32_t strings_offset; // Absolute file offset of the string table
+  uint32_t strings_size;
+  char dir[INDEX_DIR_MAX];
+} music_index_header_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t path_off; // File name relative to the indexed directory
+  uint32_t title_off;
+  uint32_t artist_off;
+  uint32_t file_size;
+  uint32_t duration_ms;
+  uint32_t sample_rate;
+  uint16_t bitrate_kbps;
+  uint8_t channels;
+  uint8_t format;
+  uint32_t reserved;
+} music_index_record_t;
+
+_Static_assert(sizeof(music_index_record_t) == 32,
+               "index record size is part of the on-card format");
+
+// Library state
+static SemaphoreHandle_t lib_mutex = NULL;
+static FILE *index_fp = NULL;
+static music_index_header_t header;
+static char music_dir[INDEX_DIR_MAX];
+
+// One page of records kept in RAM
+static music_index_record_t page[PAGE_RECORDS];
+static int page_first = -1;
+static int page_count = 0;
+
+/* ---------- Index building ---------- */
+
+typedef struct {
+  uint32_t mtime;
+  uint32_t entries;
+  uint32_t files;
+} dir_fingerprint_t;
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len) {
+  const uint8_t *p = data;
+  while (len--) {
+    h = (h ^ *p++) * 16777619U;
+  }
+  return h;
+}
+
+/**
+ * @brief Add one music file to the fingerprint
+ *
+ * Files are summed rather than chained so the listing order does not matter.
+ */
+static void fingerprint_add(dir_fingerprint_t *fp, const char *name,
+                            uint32_t size, uint32_t mtime) {
+  uint32_t h = fnv1a(2166136261U, name, strlen(name));
+  h = fnv1a(h, &size, sizeof(size));
+  h = fnv1a(h, &mtime, sizeof(mtime));
+  fp->entries++;
+  fp->files += h;
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief List dir through FatFs, which has size and date in every entry
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if dir is not on the mounted card
+ */
+static esp_err_t fingerprint_fatfs(const char *dir, dir_fingerprint_t *fp) {
+  size_t mount_len = strlen(BSP_SD_MOUNT_POINT);
+  if (!bsp_sdcard || strncmp(dir, BSP_SD_MOUNT_POINT, mount_len) != 0 ||
+      (dir[mount_len] != '/' && dir[mount_len] != '\0')) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  BYTE pdrv = ff_diskio_get_pdrv_card(bsp_sdcard);
+  if (pdrv == 0xFF) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  char path[INDEX_DIR_MAX + 4];
+  snprintf(path, sizeof(path), "%u:%s", (unsigned)pdrv,
+           dir[mount_len] ? dir + mount_len : "/");
+
+  FF_DIR d;
+  if (f_opendir(&d, path) != FR_OK) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  FILINFO info;
+  while (f_readdir(&d, &info) == FR_OK && info.fname[0]) {
+    if ((info.fattrib & AM_DIR) ||
+        !music_decoder_is_supported_name(info.fname)) {
+      continue;
+    }
+    fingerprint_add(fp, info.fname, (uint32_t)info.fsize,
+                    ((uint32_t)info.fdate << 16) | info.ftime);
+  }
+  f_closedir(&d);
+  return ESP_OK;
+}
+#endif
+
+/**
+ * @brief Fingerprint the music files in dir (one listing pass)
+ */
+static esp_err_t dir_fingerprint(const char *dir, dir_fingerprint_t *fp) {
+  struct stat st;
+  if (stat(dir, &st) != 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  fp->mtime = (uint32_t)st.st_mtime;
+  fp->entries = 0;
+  fp->files = 0;
+#ifdef ESP_PLATFORM
+  esp_err_t err = fingerprint_fatfs(dir, fp);
+  if (err != ESP_ERR_NOT_SUPPORTED) {
+    return err;
+  }
+#endif
+
+  DIR *d = opendir(dir);
+  if (!d) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  struct dirent *ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (ent->d_type == DT_DIR ||
+        !music_decoder_is_supported_name(ent->d_name)) {
+      continue;
+    }
+    int len = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+    if (len < 0 || len >= (int)sizeof(path) || stat(path, &st) != 0) {
+      st.st_size = 0;
+      st.st_mtime = 0;
+    }
+    fingerprint_add(fp, ent->d_name, (uint32_t)st.st_size,
+                    (uint32_t)st.st_mtime);
+  }
+  closedir(d);
+  return ESP_OK;
+}
+
+static uint32_t append_string(FILE *fp, uint32_t *offset, const char *s) {
+  size_t len = strlen(s) + 1;
+  if (fwrite(s, 1, len, fp) != len) {
+    return INDEX_NO_STRING;
+  }
+  uint32_t off = *offset;
+  *offset += len;
+  return off;
+}
+
+static esp_err_t build_index(const char *dir, const dir_fingerprint_t *dir_fp) {
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t ret = ESP_FAIL;
+  music_index_header_t hdr = {
+      .magic = INDEX_MAGIC,
+      .version = INDEX_VERSION,
+      .record_size = sizeof(music_index_record_t),
+      .dir_mtime = dir_fp->mtime,
+      .dir_entries = dir_fp->entries,
+      .dir_files = dir_fp->files,
+  };
+  strncpy(hdr.dir, dir, sizeof(hdr.dir) - 1);
+
+  DIR *d = opendir(dir);
+  if (!d) {
+    ESP_LOGE(TAG, "Cannot open %s", dir);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  uint8_t *buf = malloc(PROBE_BUF_SIZE);
+  FILE *rec_fp = fopen(INDEX_TMP_PATH, "wb");
+  FILE *str_fp = fopen(INDEX_STR_PATH, "wb");
+  if (!buf || !rec_fp || !str_fp) {
+    ESP_LOGE(TAG, "Cannot create index files");
+    goto cleanup;
+  }
+  setvbuf(rec_fp, NULL, _IOFBF, INDEX_IO_BUF_SIZE);
+  setvbuf(str_fp, NULL, _IOFBF, INDEX_IO_BUF_SIZE);
+
+  if (fwrite(&hdr, sizeof(hdr), 1, rec_fp) != 1) {
+    goto cleanup;
+  }
+
+  uint32_t count = 0;
+  uint32_t strings_size = 0;
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  music_probe_t probe;
+  struct dirent *ent;
+
+  while ((ent = readdir(d)) != NULL) {
+    if (ent->d_type == DT_DIR ||
+        !music_decoder_is_supported_name(ent->d_name)) {
+      continue;
+    }
+    int len = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+    if (len < 0 || len >= (int)sizeof(path)) {
+      ESP_LOGW(TAG, "Skipping %s (path too long)", ent->d_name);
+      continue;
+    }
+
+    music_index_record_t rec = {
+        .title_off = INDEX_NO_STRING,
+        .artist_off = INDEX_NO_STRING,
+    };
+    memset(&probe, 0, sizeof(probe));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+      ESP_LOGW(TAG, "Skipping %s (open failed)", ent->d_name);
+      continue;
+    }
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0) {
+      rec.file_size = (uint32_t)st.st_size;
+    }
+    // The decoder is chosen from the file header, not the extension
+    const music_decoder_ops_t *dec = music_decoder_sniff(fp);
+    if (dec && dec->probe(fp, rec.file_size, buf, PROBE_BUF_SIZE, &probe) ==
+                   ESP_OK) {
+      rec.format = dec->format;
+      rec.duration_ms = probe.duration_ms;
+      rec.sample_rate = probe.sample_rate;
+      rec.bitrate_kbps = probe.bitrate_kbps;
+      rec.channels = probe.channels;
+    } else {
+      ESP_LOGW(TAG, "%s: unrecognized audio, indexed without metadata",
+               ent->d_name);
+    }
+    fclose(fp);
+
+    rec.path_off = append_string(str_fp, &strings_size, ent->d_name);
+    if (probe.title[0]) {
+      rec.title_off = append_string(str_fp, &strings_size, probe.title);
+    }
+    if (probe.artist[0]) {
+      rec.artist_off = append_string(str_fp, &strings_size, probe.artist);
+    }
+    if (rec.path_off == INDEX_NO_STRING ||
+        fwrite(&rec, sizeof(rec), 1, rec_fp) != 1) {
+      ESP_LOGE(TAG, "Index write failed");
+      goto cleanup;
+    }
+    count++;
+  }
+
+  // Append the string table after the records
+  fclose(str_fp);
+  str_fp = fopen(INDEX_STR_PATH, "rb");
+  if (!str_fp) {
+    goto cleanup;
+  }
+  size_t n;
+  while ((n = fread(buf, 1, PROBE_BUF_SIZE, str_fp)) > 0) {
+    if (fwrite(buf, 1, n, rec_fp) != n) {
+      ESP_LOGE(TAG, "Index write failed");
+      goto cleanup;
+    }
+  }
+
+  hdr.count = count;
+  hdr.strings_offset = sizeof(hdr) + count * sizeof(music_index_record_t);
+  hdr.strings_size = strings_size;
+  if (fseek(rec_fp, 0, SEEK_SET) != 0 ||
+      fwrite(&hdr, sizeof(hdr), 1, rec_fp) != 1) {
+    goto cleanup;
+  }
+
+  ret = ESP_OK;
+
+cleanup:
+  closedir(d);
+  free(buf);
+  if (str_fp) {
+    fclose(str_fp);
+  }
+  if (rec_fp && fclose(rec_fp) != 0) {
+    ret = ESP_FAIL;
+  }
+  remove(INDEX_STR_PATH);
+
+  if (ret == ESP_OK) {
+    remove(INDEX_PATH);
+    if (rename(INDEX_TMP_PATH, INDEX_PATH) != 0) {
+      ESP_LOGE(TAG, "Failed to install new index");
+      ret = ESP_FAIL;
+    } else {
+      ESP_LOGI(TAG, "Indexed %lu tracks in %lld ms",
+               (unsigned long)hdr.count,
+               (esp_timer_get_time() - start_us) / 1000);
+    }
+  } else {
+    remove(INDEX_TMP_PATH);
+  }
+  return ret;
+}
+
+/* ---------- Index access ---------- */
+
+static bool header_matches(const music_index_header_t *hdr, const char *dir,
+                           const dir_fingerprint_t *dir_fp) {
+  return hdr->magic == INDEX_MAGIC && hdr->version == INDEX_VERSION &&
+         hdr->record_size == sizeof(music_index_record_t) &&
+         strncmp(hdr->dir, dir, sizeof(hdr->dir)) == 0 &&
+         hdr->dir_mtime == dir_fp->mtime &&
+         hdr->dir_entries == dir_fp->entries &&
+         hdr->dir_files == dir_fp->files &&
+         hdr->strings_offset ==
+             sizeof(*hdr) + hdr->count * sizeof(music_index_record_t);
+}
+
+static FILE *open_index(const char *dir, const dir_fingerprint_t *dir_fp) {
+  FILE *fp = fopen(INDEX_PATH, "rb");
+  if (!fp) {
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      !header_matches(&header, dir, dir_fp)) {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+static esp_err_t load_record(int index, music_index_record_t *rec) {
+  if (index < page_first || index >= page_first + page_count) {
+    int first = index - (index % PAGE_RECORDS);
+    int n = (int)header.count - first;
+    if (n > PAGE_RECORDS) {
+      n = PAGE_RECORDS;
+    }
+    long off = sizeof(header) + (long)first * sizeof(music_index_record_t);
+    if (fseek(index_fp, off, SEEK_SET) != 0 ||
+        fread(page, sizeof(music_index_record_t), n, index_fp) != (size_t)n) {
+      page_first = -1;
+      page_count = 0;
+      ESP_LOGE(TAG, "Failed to read index page at %d", first);
+      return ESP_FAIL;
+    }
+    page_first = first;
+    page_count = n;
+  }
+  *rec = page[index - page_first];
+  return ESP_OK;
+}
+
+static esp_err_t read_string(uint32_t off, char *buf, size_t max_len) {
+  if (off == INDEX_NO_STRING || off >= header.strings_size || max_len == 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  size_t want = header.strings_size - off;
+  if (want > max_len - 1) {
+    want = max_len - 1;
+  }
+  if (fseek(index_fp, header.strings_offset + off, SEEK_SET) != 0) {
+    return ESP_FAIL;
+  }
+  size_t n = fread(buf, 1, want, index_fp);
+  buf[n] = '\0'; // Strings are NUL-terminated; this only caps truncation
+  return n > 0 ? ESP_OK : ESP_FAIL;
+}
+
+static bool lock(void) {
+  return lib_mutex && xSemaphoreTake(lib_mutex, portMAX_DELAY) == pdTRUE;
+}
+
+static void unlock(void) { xSemaphoreGive(lib_mutex); }
+
+static esp_err_t open_locked(const char *dir, bool force_rebuild) {
+  dir_fingerprint_t dir_fp;
+  if (dir_fingerprint(dir, &dir_fp) != ESP_OK) {
+    ESP_LOGE(TAG, "Music directory %s not found", dir);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  if (index_fp) {
+    fclose(index_fp);
+    index_fp = NULL;
+  }
+  page_first = -1;
+  page_count = 0;
+
+  if (!force_rebuild) {
+    index_fp = open_index(dir, &dir_fp);
+  }
+  if (!index_fp) {
+    ESP_LOGI(TAG, "Index missing or stale, scanning %s", dir);
+    esp_err_t ret = build_index(dir, &dir_fp);
+    if (ret != ESP_OK) {
+      return ret;
+    }
+    index_fp = open_index(dir, &dir_fp);
+    if (!index_fp) {
+      ESP_LOGE(TAG, "Freshly built index failed validation");
+      return ESP_FAIL;
+    }
+  } else {
+    ESP_LOGI(TAG, "Loaded index: %lu tracks", (unsigned long)header.count);
+  }
+
+  strncpy(music_dir, dir, sizeof(music_dir) - 1);
+  music_dir[sizeof(music_dir) - 1] = '\0';
+  return ESP_OK;
+}
+
+esp_err_t music_library_open(const char *dir) {
+  if (!dir || strlen(dir) >= INDEX_DIR_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!lib_mutex) {
+    lib_mutex = xSemaphoreCreateMutex();
+    if (!lib_mutex) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  lock();
+  esp_err_t ret = open_locked(dir, false);
+  unlock();
+  return ret;
+}
+
+esp_err_t music_library_rebuild(void) {
+  if (!lock()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t ret = music_dir[0] ? open_locked(music_dir, true)
+                               : ESP_ERR_INVALID_STATE;
+  unlock();
+  return ret;
+}
+
+void music_library_close(void) {
+  if (!lock()) {
+    return;
+  }
+  if (index_fp) {
+    fclose(index_fp);
+    index_fp = NULL;
+  }
+  memset(&header, 0, sizeof(header));
+  page_first = -1;
+  page_count = 0;
+  unlock();
+}
+
+bool music_library_is_open(void) {
+  if (!lock()) {
+    return false;
+  }
+  bool open = index_fp != NULL;
+  unlock();
+  return open;
+}
+
+int music_library_get_count(void) {
+  if (!lock()) {
+    return 0;
+  }
+  int count = index_fp ? (int)header.count : 0;
+  unlock();
+  return count;
+}
+
+esp_err_t music_library_get_info(int index, music_track_info_t *info) {
+  if (!info) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!lock()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t ret = ESP_ERR_INVALID_ARG;
+  music_index_record_t rec;
+  if (index_fp && index >= 0 && index < (int)header.count) {
+    ret = load_record(index, &rec);
+  }
+  unlock();
+
+  if (ret == ESP_OK) {
+    info->file_size = rec.file_size;
+    info->duration_ms = rec.duration_ms;
+    info->sample_rate = rec.sample_rate;
+    info->bitrate_kbps = rec.bitrate_kbps;
+    info->channels = rec.channels;
+    info->format = (music_format_t)rec.format;
+  }
+  return ret;
+}
+
+esp_err_t music_library_get_path(int index, char *path, size_t max_len) {
+  if (!path || max_len == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!lock()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t ret = ESP_ERR_INVALID_ARG;
+  music_index_record_t rec;
+  if (index_fp && index >= 0 && index < (int)header.count) {
+    ret = load_record(index, &rec);
+  }
+  if (ret == ESP_OK) {
+    int len = snprintf(path, max_len, "%s/", music_dir);
+    if (len < 0 || (size_t)len >= max_len) {
+      ret = ESP_ERR_INVALID_SIZE;
+    } else {
+      ret = read_string(rec.path_off, path + len, max_len - len);
+    }
+  }
+  unlock();
+  return ret;
+}
+
+esp_err_t music_library_get_display_name(int index, char *name,
+                                         size_t max_len) {
+  if (!name || max_len == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!lock()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t ret = ESP_ERR_INVALID_ARG;
+  music_index_record_t rec;
+  if (index_fp && index >= 0 && index < (int)header.count) {
+    ret = load_record(index, &rec);
+  }
+  if (ret == ESP_OK) {
+    char title[MUSIC_DECODER_TAG_MAX];
+    char artist[MUSIC_DECODER_TAG_MAX];
+    bool has_title = read_string(rec.title_off, title, sizeof(title)) == ESP_OK;
+    bool has_artist =
+        read_string(rec.artist_off, artist, sizeof(artist)) == ESP_OK;
+
+    if (has_title && has_artist) {
+      snprintf(name, max_len, "%s - %s", artist, title);
+    } else if (has_title) {
+      snprintf(name, max_len, "%s", title);
+    } else {
+      ret = read_string(rec.path_off, name, max_len);
+      char *ext = (ret == ESP_OK) ? strrchr(name, '.') : NULL;
+      if (ext) {
+        *ext = '\0';
+      }
+    }
+  }
+  unlock();
+  return ret;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file music_library.h
+ * @brief Persistent on-card index of the local music library
+ *
+ * Instead of scanning /sdcard/music and keeping every file name in RAM, the
+ * library keeps a compact binary index file on the SD card. Each track is a
+ * fixed-size record (path offset, size, duration, sample rate, channels, tag
+ * offsets) followed by a shared string table. Records are paged in on demand,
+ * so opening a large library costs one directory listing and a header read.
+ *
+ * The index is rebuilt when the music files in the directory (count,
+ * names, sizes and modification times) or its mtime no longer match the
+ * index header, or on explicit request.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "music_decoder.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MUSIC_LIBRARY_PATH_MAX 128 ///< Max full path length (BSP player limit)
+
+/**
+ * @brief Per-track metadata stored in the index
+ */
+typedef struct {
+  uint32_t file_size;   ///< File size in bytes
+  uint32_t duration_ms; ///< Duration (estimated for CBR MP3)
+  uint32_t sample_rate; ///< Native sample rate in Hz (0 if unknown)
+  uint16_t bitrate_kbps; ///< Nominal/average bitrate
+  uint8_t channels;     ///< Native channel count (0 if unknown)
+  music_format_t format; ///< Detected format
+} music_track_info_t;
+
+/**
+ * @brief Open the library for a directory
+ *
+ * Loads the index file if it is valid for the directory, otherwise scans the
+ * directory once and writes a fresh index. Only the header is kept in RAM.
+ *
+ * @param dir Music directory (e.g. "/sdcard/music")
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the directory is missing
+ */
+esp_err_t music_library_open(const char *dir);
+
+/**
+ * @brief Close the index file and drop cached pages
+ */
+void music_library_close(void);
+
+/**
+ * @brief Force a rescan of the music directory and rewrite the index
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t music_library_rebuild(void);
+
+/**
+ * @brief Check if the library is open
+ */
+bool music_library_is_open(void);
+
+/**
+ * @brief Get number of indexed tracks
+ */
+int music_library_get_count(void);
+
+/**
+ * @brief Get metadata for a track
+ *
+ * @param index Track index (0-based)
+ * @param info Output metadata
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if out of range
+ */
+esp_err_t music_library_get_info(int index, music_track_info_t *info);
+
+/**
+ * @brief Get full path of a track
+ *
+ * @param index Track index (0-based)
+ * @param path Output buffer
+ * @param max_len Buffer length (MUSIC_LIBRARY_PATH_MAX is always enough)
+ * @return ESP_OK on success
+ */
+esp_err_t music_library_get_path(int index, char *path, size_t max_len);
+
+/**
+ * @brief Get a display name for a track
+ *
+ * Returns "Artist - Title" from tags when available, otherwise the file name.
+ *
+ * @param index Track index (0-based)
+ * @param name Output buffer
+ * @param max_len Buffer length
+ * @return ESP_OK on success
+ */
+esp_err_t music_library_get_display_name(int index, char *name,
+                                         size_t max_len);
+
+#ifdef __cplusplus
+}
+#endif
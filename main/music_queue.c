@@ -0,0 +1,286 @@
+/**
+ * @file music_queue.c
+ * @brief Play order, shuffle and user queue for local music
+ */
+
+#include "music_queue.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "music_queue";
+
+// order/position are swapped as a pair; everything below is guarded by mux
+static portMUX_TYPE queue_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t *order = NULL;    // Play position -> track (PSRAM)
+static uint16_t *position = NULL; // Track -> play position (PSRAM)
+static int track_count = 0;
+static int cursor = -1; // Play position of the current track
+static int current = -1;
+static bool shuffled = false;
+static uint32_t shuffle_seed = 0;
+static int shuffle_first = -1;
+
+// User queue (ring)
+static uint16_t pending[MUSIC_QUEUE_MAX_PENDING];
+static int pending_head = 0;
+static int pending_count = 0;
+
+static uint32_t xorshift32(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static esp_err_t alloc_order(int count, uint16_t **out_order,
+                             uint16_t **out_position) {
+  *out_order = heap_caps_malloc(count * sizeof(uint16_t),
+                                MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  *out_position = heap_caps_malloc(count * sizeof(uint16_t),
+                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!*out_order || !*out_position) {
+    heap_caps_free(*out_order);
+    heap_caps_free(*out_position);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+/**
+ * @brief Fill a play order: identity, or Fisher-Yates with first at the front
+ */
+static void build_order(uint16_t *ord, uint16_t *pos, int count, bool shuffle,
+                        uint32_t seed, int first) {
+  for (int i = 0; i < count; i++) {
+    ord[i] = i;
+  }
+  if (shuffle) {
+    uint32_t state = seed ? seed : 1; // xorshift state must be non-zero
+    for (int i = count - 1; i > 0; i--) {
+      int j = xorshift32(&state) % (i + 1);
+      uint16_t tmp = ord[i];
+      ord[i] = ord[j];
+      ord[j] = tmp;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    pos[ord[i]] = i;
+  }
+  if (shuffle && first >= 0 && first < count) {
+    int p = pos[first];
+    uint16_t front = ord[0];
+    ord[0] = first;
+    ord[p] = front;
+    pos[first] = 0;
+    pos[front] = p;
+  }
+}
+
+esp_err_t music_queue_init(int count) {
+  if (count <= 0 || count > UINT16_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  music_queue_deinit();
+
+  uint16_t *ord;
+  uint16_t *pos;
+  if (alloc_order(count, &ord, &pos) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to allocate play order for %d tracks", count);
+    return ESP_ERR_NO_MEM;
+  }
+  build_order(ord, pos, count, false, 0, -1);
+
+  portENTER_CRITICAL(&queue_mux);
+  order = ord;
+  position = pos;
+  track_count = count;
+  cursor = -1;
+  current = -1;
+  shuffled = false;
+  shuffle_seed = 0;
+  shuffle_first = -1;
+  pending_head = 0;
+  pending_count = 0;
+  portEXIT_CRITICAL(&queue_mux);
+  return ESP_OK;
+}
+
+void music_queue_deinit(void) {
+  portENTER_CRITICAL(&queue_mux);
+  uint16_t *ord = order;
+  uint16_t *pos = position;
+  order = NULL;
+  position = NULL;
+  track_count = 0;
+  cursor = -1;
+  current = -1;
+  pending_count = 0;
+  portEXIT_CRITICAL(&queue_mux);
+
+  heap_caps_free(ord);
+  heap_caps_free(pos);
+}
+
+void music_queue_set_shuffle(bool enable, uint32_t seed, int first) {
+  portENTER_CRITICAL(&queue_mux);
+  int count = track_count;
+  if (first < 0) {
+    first = current;
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  if (count == 0) {
+    return;
+  }
+
+  // Build the new order outside the lock; it is O(n) over the library
+  uint16_t *ord;
+  uint16_t *pos;
+  if (alloc_order(count, &ord, &pos) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to allocate shuffled order");
+    return;
+  }
+  build_order(ord, pos, count, enable, seed, first);
+
+  portENTER_CRITICAL(&queue_mux);
+  uint16_t *old_ord = order;
+  uint16_t *old_pos = position;
+  if (track_count != count) { // Library reopened meanwhile
+    old_ord = ord;
+    old_pos = pos;
+  } else {
+    order = ord;
+    position = pos;
+    shuffled = enable;
+    shuffle_seed = enable ? seed : 0;
+    shuffle_first = enable ? first : -1;
+    cursor = current >= 0 ? position[current] : -1;
+  }
+  portEXIT_CRITICAL(&queue_mux);
+
+  heap_caps_free(old_ord);
+  heap_caps_free(old_pos);
+  ESP_LOGI(TAG, "Shuffle %s (%d tracks)", enable ? "on" : "off", count);
+}
+
+bool music_queue_get_shuffle(void) { return shuffled; }
+
+uint32_t music_queue_get_seed(void) { return shuffle_seed; }
+
+int music_queue_get_first(void) { return shuffle_first; }
+
+int music_queue_current(void) { return current; }
+
+esp_err_t music_queue_jump_to_track(int track) {
+  esp_err_t ret = ESP_ERR_INVALID_ARG;
+  portENTER_CRITICAL(&queue_mux);
+  if (track >= 0 && track < track_count) {
+    cursor = position[track];
+    current = track;
+    ret = ESP_OK;
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  return ret;
+}
+
+void music_queue_rewind(void) {
+  portENTER_CRITICAL(&queue_mux);
+  cursor = -1;
+  current = -1;
+  portEXIT_CRITICAL(&queue_mux);
+}
+
+/**
+ * @brief Order position after the cursor, shared by advance and peek
+ *
+ * Called inside queue_mux.
+ *
+ * @return Position, or -1 at the end of the order (or an empty library)
+ */
+static int next_cursor(bool wrap) {
+  int next = cursor + 1;
+  if (next >= track_count && wrap) {
+    next = 0;
+  }
+  return next < track_count ? next : -1;
+}
+
+int music_queue_advance(bool wrap) {
+  int track = -1;
+  portENTER_CRITICAL(&queue_mux);
+  if (pending_count > 0) {
+    // Queued tracks play out of order; the order resumes after them
+    track = pending[pending_head];
+    pending_head = (pending_head + 1) % MUSIC_QUEUE_MAX_PENDING;
+    pending_count--;
+    current = track;
+  } else {
+    int next = next_cursor(wrap);
+    if (next >= 0) {
+      cursor = next;
+      track = order[next];
+      current = track;
+    }
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  return track;
+}
+
+int music_queue_peek_next(bool wrap) {
+  int track = -1;
+  portENTER_CRITICAL(&queue_mux);
+  if (pending_count > 0) {
+    track = pending[pending_head];
+  } else {
+    int next = next_cursor(wrap);
+    track = next >= 0 ? order[next] : -1;
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  return track;
+}
+
+int music_queue_previous(bool wrap) {
+  int track = -1;
+  portENTER_CRITICAL(&queue_mux);
+  if (track_count > 0) {
+    int prev = cursor - 1;
+    if (prev < 0 && wrap) {
+      prev = track_count - 1;
+    }
+    if (prev >= 0) {
+      cursor = prev;
+      track = order[prev];
+      current = track;
+    }
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  return track;
+}
+
+esp_err_t music_queue_enqueue(int track) {
+  esp_err_t ret = ESP_OK;
+  portENTER_CRITICAL(&queue_mux);
+  if (track < 0 || track >= track_count) {
+    ret = ESP_ERR_INVALID_ARG;
+  } else if (pending_count >= MUSIC_QUEUE_MAX_PENDING) {
+    ret = ESP_ERR_NO_MEM;
+  } else {
+    pending[(pending_head + pending_count) % MUSIC_QUEUE_MAX_PENDING] = track;
+    pending_count++;
+  }
+  portEXIT_CRITICAL(&queue_mux);
+  return ret;
+}
+
+void music_queue_clear(void) {
+  portENTER_CRITICAL(&queue_mux);
+  pending_head = 0;
+  pending_count = 0;
+  portEXIT_CRITICAL(&queue_mux);
+}
+
+int music_queue_pending(void) { return pending_count; }
@@ -0,0 +1,131 @@
+/**
+ * @file music_queue.h
+ * @brief Play order, shuffle and user queue for local music
+ *
+ * The play order is a permutation of the library's track indices (identity
+ * when shuffle is off) plus its inverse, so moving to the next or previous
+ * track, jumping to an arbitrary track and finding a track's position are all
+ * O(1). Shuffling is a Fisher-Yates pass driven by a seeded PRNG: the seed
+ * and the track placed first are enough to rebuild the same order after a
+ * reboot, so only those need to be persisted.
+ *
+ * Tracks queued by the user are played before the play order continues,
+ * without changing the order itself.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Tracks that can be queued ahead of the play order
+#define MUSIC_QUEUE_MAX_PENDING 32
+
+/**
+ * @brief Allocate the play order for a library of count tracks
+ *
+ * Starts unshuffled with the cursor before the first track.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG or ESP_ERR_NO_MEM
+ */
+esp_err_t music_queue_init(int count);
+
+/**
+ * @brief Free the play order and clear the user queue
+ */
+void music_queue_deinit(void);
+
+/**
+ * @brief Turn shuffle on or off
+ *
+ * The current track (if any) becomes the first entry of the new order so the
+ * rest of the library follows it. Turning shuffle off restores library order
+ * with the cursor on the current track.
+ *
+ * @param enable Shuffle on/off
+ * @param seed PRNG seed for the permutation (ignored when disabling)
+ * @param first Track to place first, or -1 to keep the current track
+ */
+void music_queue_set_shuffle(bool enable, uint32_t seed, int first);
+
+/**
+ * @brief Check if shuffle is on
+ */
+bool music_queue_get_shuffle(void);
+
+/**
+ * @brief Seed of the current shuffle order (0 when unshuffled)
+ */
+uint32_t music_queue_get_seed(void);
+
+/**
+ * @brief Track placed first in the current shuffle order
+ */
+int music_queue_get_first(void);
+
+/**
+ * @brief Track at the cursor, or -1 before the first advance
+ */
+int music_queue_current(void);
+
+/**
+ * @brief Move the cursor to a track's position in the play order
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t music_queue_jump_to_track(int track);
+
+/**
+ * @brief Move the cursor back before the first track of the play order
+ */
+void music_queue_rewind(void);
+
+/**
+ * @brief Move to the next track (user queue first, then the play order)
+ *
+ * @param wrap Continue from the start after the last track
+ * @return Track index, or -1 at the end of the order
+ */
+int music_queue_advance(bool wrap);
+
+/**
+ * @brief Track music_queue_advance(wrap) would return, without moving
+ *
+ * @param wrap Same wrap rule the caller will advance with
+ * @return Track index, or -1 at the end of the order
+ */
+int music_queue_peek_next(bool wrap);
+
+/**
+ * @brief Move to the previous track in the play order
+ *
+ * @param wrap Continue from the end before the first track
+ * @return Track index, or -1 at the start of the order
+ */
+int music_queue_previous(bool wrap);
+
+/**
+ * @brief Queue a track to play after the current one
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_ERR_NO_MEM when the queue is full
+ */
+esp_err_t music_queue_enqueue(int track);
+
+/**
+ * @brief Drop all queued tracks
+ */
+void music_queue_clear(void);
+
+/**
+ * @brief Number of queued tracks
+ */
+int music_queue_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,17 +1,26 @@
 /**
  * @file network_manager.c
  * @brief Network manager implementation - Ethernet priority with WiFi fallback
+ *
+ * Cold fallback starts WiFi only when the Ethernet link drops, so the device
+ * is offline for association plus DHCP. With the wifi_standby setting WiFi
+ * instead stays associated in max modem sleep behind Ethernet (keeping its
+ * DHCP lease), and a link drop only moves the default route and wakes the
+ * radio. The SDIO lines are then owned by WiFi, so the SD card stays
+ * unmounted.
  */
 
 #include "network_manager.h"
 #include "wifi_manager.h"
 #include "settings_manager.h" // Added for WiFi credentials
+#include "task_arena.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_eth.h"
 #include "esp_eth_mac.h"
 #include "esp_eth_phy.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -27,12 +36,22 @@ static const char *TAG = "network_manager";
 #define ETH_MDC_GPIO        31
 #define ETH_MDIO_GPIO       52
 
+// How long init waits for an Ethernet lease before starting WiFi
+#ifndef ETH_LINK_WAIT_MS
+#define ETH_LINK_WAIT_MS    5000
+#endif
+
 // Network state
 static network_type_t active_network = NETWORK_TYPE_NONE;
 static bool ethernet_available = false;
 static bool wifi_fallback_active = false;
 static network_event_callback_t event_callback = NULL;
 
+// Warm standby
+static bool wifi_standby = false;
+static int64_t failover_start_us = 0;   // Ethernet link loss, 0: none pending
+static uint32_t last_failover_ms = 0;
+
 static void esp_hosted_log_suppress(bool suppress) {
     esp_log_level_set("H_API", suppress ? ESP_LOG_NONE : ESP_LOG_ERROR);
 }
@@ -59,11 +78,25 @@ static esp_netif_t *get_active_netif(void) {
 }
 
 typedef enum {
+    WIFI_FALLBACK_CMD_NONE = -1,
     WIFI_FALLBACK_CMD_START = 0,
     WIFI_FALLBACK_CMD_STOP = 1,
+    WIFI_FALLBACK_CMD_STANDBY = 2,   // Associate (if needed) and sleep
+    WIFI_FALLBACK_CMD_ACTIVATE = 3,  // Wake a promoted standby link
 } wifi_fallback_cmd_t;
 
-static TaskHandle_t wifi_fallback_task_handle = NULL;
+// WiFi commands are coalesced: each one supersedes those not yet taken, and
+// a single job runs them in order until none is left. net_mux guards them
+// and active_network, which the job re-checks before acting.
+static portMUX_TYPE net_mux = portMUX_INITIALIZER_UNLOCKED;
+static wifi_fallback_cmd_t wifi_fallback_next = WIFI_FALLBACK_CMD_NONE;
+static bool wifi_fallback_running = false;  // Job submitted or running
+
+static void set_active_network(network_type_t type) {
+    portENTER_CRITICAL(&net_mux);
+    active_network = type;
+    portEXIT_CRITICAL(&net_mux);
+}
 
 // Helper to start WiFi with stored credentials
 static esp_err_t start_wifi_fallback(void) {
@@ -78,25 +111,131 @@ static esp_err_t start_wifi_fallback(void) {
     return wifi_manager_init(settings.wifi_ssid, settings.wifi_password);
 }
 
-static void wifi_fallback_task(void *arg) {
-    wifi_fallback_cmd_t cmd = (wifi_fallback_cmd_t)(uintptr_t)arg;
-
+static void run_wifi_fallback_cmd(wifi_fallback_cmd_t cmd) {
     if (cmd == WIFI_FALLBACK_CMD_START) {
         (void)start_wifi_fallback();
     } else if (cmd == WIFI_FALLBACK_CMD_STOP) {
-        (void)wifi_manager_stop();
+        // May have superseded the START that would have brought it up
+        if (wifi_manager_is_active()) {
+            (void)wifi_manager_stop();
+        }
+    } else if (cmd == WIFI_FALLBACK_CMD_STANDBY) {
+        if (!wifi_manager_is_active() && start_wifi_fallback() == ESP_OK) {
+            ESP_LOGI(TAG, "WiFi standby associated");
+        }
+        // Ethernet may have dropped and WiFi been promoted meanwhile. A
+        // promotion after this check queues ACTIVATE, which runs next.
+        portENTER_CRITICAL(&net_mux);
+        bool sleep = active_network == NETWORK_TYPE_ETHERNET &&
+                     wifi_fallback_next == WIFI_FALLBACK_CMD_NONE;
+        portEXIT_CRITICAL(&net_mux);
+        if (sleep && wifi_manager_is_active()) {
+            (void)wifi_manager_set_power_save(true);
+        }
+    } else if (cmd == WIFI_FALLBACK_CMD_ACTIVATE) {
+        (void)wifi_manager_set_power_save(false);
+    }
+}
+
+static void wifi_fallback_job(void *arg) {
+    (void)arg;
+    while (1) {
+        portENTER_CRITICAL(&net_mux);
+        wifi_fallback_cmd_t cmd = wifi_fallback_next;
+        wifi_fallback_next = WIFI_FALLBACK_CMD_NONE;
+        if (cmd == WIFI_FALLBACK_CMD_NONE) {
+            wifi_fallback_running = false;
+        }
+        portEXIT_CRITICAL(&net_mux);
+        if (cmd == WIFI_FALLBACK_CMD_NONE) {
+            return;
+        }
+        run_wifi_fallback_cmd(cmd);
     }
+}
 
-    wifi_fallback_task_handle = NULL;
-    vTaskDelete(NULL);
+static void schedule_wifi_fallback_job(wifi_fallback_cmd_t cmd) {
+    portENTER_CRITICAL(&net_mux);
+    wifi_fallback_next = cmd;
+    bool submit = !wifi_fallback_running;
+    wifi_fallback_running = true;
+    portEXIT_CRITICAL(&net_mux);
+
+    if (submit && task_arena_submit_job(wifi_fallback_job, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "Job queue full, WiFi fallback command %d dropped", cmd);
+        portENTER_CRITICAL(&net_mux);
+        wifi_fallback_next = WIFI_FALLBACK_CMD_NONE;
+        wifi_fallback_running = false;
+        portEXIT_CRITICAL(&net_mux);
+    }
 }
 
-static void schedule_wifi_fallback_task(wifi_fallback_cmd_t cmd) {
-    if (wifi_fallback_task_handle != NULL) {
+/**
+ * @brief Report how long the device was without a usable link
+ */
+static void record_failover(const char *path)
+{
+    if (failover_start_us == 0) {
         return;
     }
-    xTaskCreate(wifi_fallback_task, "wifi_fallback", 4096, (void *)(uintptr_t)cmd, 4,
-                &wifi_fallback_task_handle);
+    last_failover_ms = (uint32_t)((esp_timer_get_time() - failover_start_us) / 1000);
+    failover_start_us = 0;
+    ESP_LOGI(TAG, "Failover to WiFi took %u ms (%s)", (unsigned)last_failover_ms, path);
+}
+
+/**
+ * @brief Make an associated standby WiFi link the active network
+ *
+ * @return false if there is no standby link to promote
+ */
+static bool promote_standby_wifi(void)
+{
+    esp_netif_t *sta_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (!wifi_standby || sta_netif == NULL || !wifi_manager_is_active()) {
+        return false;
+    }
+
+    esp_netif_set_default_netif(sta_netif);
+    set_active_network(NETWORK_TYPE_WIFI);
+    record_failover("warm standby");
+
+    if (event_callback) {
+        event_callback(NETWORK_TYPE_WIFI, true);
+    }
+    // Leave max modem sleep off the failover path
+    schedule_wifi_fallback_job(WIFI_FALLBACK_CMD_ACTIVATE);
+    return true;
+}
+
+/**
+ * @brief Ethernet link lost (cable event or simulated)
+ */
+static void ethernet_link_lost(void)
+{
+    if (wifi_fallback_active) {
+        return;
+    }
+    failover_start_us = esp_timer_get_time();
+
+    // Mark Ethernet as inactive
+    if (active_network == NETWORK_TYPE_ETHERNET) {
+        set_active_network(NETWORK_TYPE_NONE);
+
+        // Notify application
+        if (event_callback) {
+            event_callback(NETWORK_TYPE_ETHERNET, false);
+        }
+    }
+
+    wifi_fallback_active = true;
+    if (promote_standby_wifi()) {
+        return;
+    }
+
+    // Activate WiFi fallback
+    ESP_LOGI(TAG, "Activating WiFi fallback...");
+    // Do NOT block the system event loop with a synchronous WiFi connect attempt.
+    schedule_wifi_fallback_job(WIFI_FALLBACK_CMD_START);
 }
 
 /**
@@ -216,35 +355,20 @@ static void ethernet_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(TAG, "Ethernet cable connected");
         esp_hosted_log_suppress(true);
 
-        // If WiFi fallback was active, stop it
-        if (wifi_fallback_active && wifi_manager_is_active()) {
+        // If WiFi fallback was active, stop it (standby: keep it, the
+        // Ethernet IP event puts it back to sleep). WiFi may not be up yet:
+        // STOP then supersedes the START still queued.
+        if (wifi_fallback_active && !wifi_standby) {
             ESP_LOGI(TAG, "Stopping WiFi fallback - switching to Ethernet");
-            schedule_wifi_fallback_task(WIFI_FALLBACK_CMD_STOP);
-            wifi_fallback_active = false;
+            schedule_wifi_fallback_job(WIFI_FALLBACK_CMD_STOP);
         }
+        wifi_fallback_active = false;
         break;
 
     case ETHERNET_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "Ethernet cable disconnected");
         esp_hosted_log_suppress(false);
-
-        // Mark Ethernet as inactive
-        if (active_network == NETWORK_TYPE_ETHERNET) {
-            active_network = NETWORK_TYPE_NONE;
-
-            // Notify application
-            if (event_callback) {
-                event_callback(NETWORK_TYPE_ETHERNET, false);
-            }
-        }
-
-        // Activate WiFi fallback
-        if (!wifi_fallback_active) {
-            ESP_LOGI(TAG, "Activating WiFi fallback...");
-            wifi_fallback_active = true;
-            // Do NOT block the system event loop with a synchronous WiFi connect attempt.
-            schedule_wifi_fallback_task(WIFI_FALLBACK_CMD_START);
-        }
+        ethernet_link_lost();
         break;
 
     case ETHERNET_EVENT_START:
@@ -272,8 +396,13 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(TAG, "   Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
         ESP_LOGI(TAG, "   Netmask: " IPSTR, IP2STR(&event->ip_info.netmask));
 
-        // Set Ethernet as active network
-        active_network = NETWORK_TYPE_ETHERNET;
+        // Set Ethernet as active network (explicitly: a standby WiFi link
+        // would otherwise win the default route by netif priority)
+        set_active_network(NETWORK_TYPE_ETHERNET);
+        esp_netif_set_default_netif(eth_netif);
+        if (wifi_standby) {
+            schedule_wifi_fallback_job(WIFI_FALLBACK_CMD_STANDBY);
+        }
 
         // Notify application
         if (event_callback) {
@@ -286,12 +415,15 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base,
             ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
             ESP_LOGI(TAG, "WiFi IP (fallback): " IPSTR, IP2STR(&event->ip_info.ip));
 
-            active_network = NETWORK_TYPE_WIFI;
+            set_active_network(NETWORK_TYPE_WIFI);
+            record_failover("cold start");
 
             // Notify application
             if (event_callback) {
                 event_callback(NETWORK_TYPE_WIFI, true);
             }
+        } else if (wifi_standby) {
+            ESP_LOGI(TAG, "WiFi standby ready behind Ethernet");
         } else {
             ESP_LOGI(TAG, "WiFi IP acquired but Ethernet is active - ignoring");
         }
@@ -324,6 +456,14 @@ esp_err_t network_manager_init(void)
     }
     ESP_LOGI(TAG, "Event loop ready");
 
+    app_settings_t settings;
+    if (settings_manager_load(&settings) == ESP_OK) {
+        wifi_standby = settings.wifi_standby;
+    }
+    if (wifi_standby) {
+        ESP_LOGI(TAG, "WiFi warm standby enabled (SD card unavailable)");
+    }
+
     // Register WiFi IP event handler
     ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
                                       ip_event_handler, NULL);
@@ -335,9 +475,9 @@ esp_err_t network_manager_init(void)
     ret = ethernet_init();
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Ethernet initialization successful");
-        // Wait for Ethernet link (timeout 5 seconds)
-        ESP_LOGI(TAG, "Waiting for Ethernet link... (5s timeout)");
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        // Wait for Ethernet link
+        ESP_LOGI(TAG, "Waiting for Ethernet link... (%d ms timeout)", ETH_LINK_WAIT_MS);
+        vTaskDelay(pdMS_TO_TICKS(ETH_LINK_WAIT_MS));
 
         // Check if we got IP via Ethernet
         if (active_network == NETWORK_TYPE_ETHERNET) {
@@ -452,17 +592,29 @@ esp_err_t network_manager_force_wifi_fallback(void)
 
     if (eth_handle && active_network == NETWORK_TYPE_ETHERNET) {
         esp_eth_stop(eth_handle);
-        active_network = NETWORK_TYPE_NONE;
-    }
-
-    if (!wifi_fallback_active) {
-        wifi_fallback_active = true;
-        return start_wifi_fallback();
     }
 
+    // Same path as a cable pull, so the failover time is comparable
+    ethernet_link_lost();
     return ESP_OK;
 }
 
+/**
+ * @brief Check if WiFi is kept associated behind Ethernet
+ */
+bool network_manager_is_wifi_standby(void)
+{
+    return wifi_standby;
+}
+
+/**
+ * @brief Duration of the last Ethernet -> WiFi failover
+ */
+uint32_t network_manager_get_last_failover_ms(void)
+{
+    return last_failover_ms;
+}
+
 /**
  * @brief Convert network type to string
  */
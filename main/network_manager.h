@@ -19,6 +19,7 @@
 #include "esp_err.h"
 #include "esp_netif.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -110,10 +111,30 @@ void network_manager_register_callback(network_event_callback_t callback);
 /**
  * @brief Manually trigger WiFi fallback (for testing)
  *
+ * Stops Ethernet and runs the same failover path as a cable pull, so the
+ * failover time can be measured without touching the hardware.
+ *
  * @return ESP_OK on success
  */
 esp_err_t network_manager_force_wifi_fallback(void);
 
+/**
+ * @brief Check if WiFi is kept associated behind Ethernet (warm standby)
+ *
+ * Read from settings at init. While enabled the SD card cannot be mounted,
+ * since WiFi owns the shared SDIO lines.
+ */
+bool network_manager_is_wifi_standby(void);
+
+/**
+ * @brief Get the duration of the last Ethernet -> WiFi failover
+ *
+ * Measured from the link loss to the WiFi network being reported connected.
+ *
+ * @return Milliseconds, 0 if no failover happened yet
+ */
+uint32_t network_manager_get_last_failover_ms(void);
+
 /**
  * @brief Get network type as string
  *
@@ -13,12 +13,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "led_status.h"
+#include "mem_track.h"
 #include "oled_status.h"
+#include "task_arena.h"
 #include <string.h>
 
 static const char *TAG = "ota_update";
 
-#define OTA_TASK_STACK_WORDS 4096
 #define OTA_TASK_PRIORITY 2
 
 // OTA state
@@ -32,8 +33,6 @@ static TaskHandle_t ota_task_handle = NULL;
 
 typedef struct {
   char *url;
-  StackType_t *stack;
-  StaticTask_t *tcb;
 } ota_task_ctx_t;
 
 /**
@@ -79,7 +78,7 @@ static void ota_update_task(void *pvParameter) {
   led_status_set(LED_STATUS_OTA);
 
   // Allocate download buffer
-  buffer = malloc(buffer_size);
+  buffer = mem_track_malloc(MEM_MOD_OTA, buffer_size, 0);
   if (buffer == NULL) {
     ESP_LOGE(TAG, "Failed to allocate buffer");
     notify_progress(OTA_STATE_FAILED, 0, "Memory allocation failed");
@@ -251,7 +250,7 @@ ota_end:
 
   // Free buffer
   if (buffer) {
-    free(buffer);
+    mem_track_free(MEM_MOD_OTA, buffer);
   }
 
   // Free URL string
@@ -259,18 +258,12 @@ ota_end:
     if (ctx->url) {
       free(ctx->url);
     }
-    if (ctx->stack) {
-      heap_caps_free(ctx->stack);
-    }
-    if (ctx->tcb) {
-      heap_caps_free(ctx->tcb);
-    }
     free(ctx);
   }
 
   ota_running = false;
   ota_task_handle = NULL;
-  vTaskDelete(NULL);
+  task_arena_exit(TASK_SLOT_OTA);
 }
 
 /**
@@ -322,47 +315,15 @@ esp_err_t ota_update_start(const char *url) {
   ota_state = OTA_STATE_IDLE;
   ota_progress = 0;
 
-  // Create OTA task
-  BaseType_t ret = xTaskCreate(ota_update_task, "ota_update_task",
-                               OTA_TASK_STACK_WORDS, (void *)ctx,
-                               OTA_TASK_PRIORITY,
-                               &ota_task_handle);
-
-  if (ret != pdPASS) {
-    ESP_LOGW(TAG, "OTA task create failed; internal free=%u",
-             (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
-
-    ctx->stack = (StackType_t *)heap_caps_malloc(
-        OTA_TASK_STACK_WORDS * sizeof(StackType_t),
-        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    ctx->tcb = (StaticTask_t *)heap_caps_malloc(sizeof(StaticTask_t),
-                                                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    if (!ctx->stack || !ctx->tcb) {
-      ESP_LOGE(TAG, "Failed to allocate OTA task stack/TCB");
-      if (ctx->stack) {
-        heap_caps_free(ctx->stack);
-      }
-      if (ctx->tcb) {
-        heap_caps_free(ctx->tcb);
-      }
-      free(ctx->url);
-      free(ctx);
-      ota_running = false;
-      return ESP_FAIL;
-    }
-
-    ota_task_handle = xTaskCreateStaticPinnedToCore(
-        ota_update_task, "ota_update_task", OTA_TASK_STACK_WORDS, (void *)ctx,
-        OTA_TASK_PRIORITY, ctx->stack, ctx->tcb, tskNO_AFFINITY);
-    if (ota_task_handle == NULL) {
-      ESP_LOGE(TAG, "Failed to create OTA task (static)");
-      heap_caps_free(ctx->stack);
-      heap_caps_free(ctx->tcb);
-      free(ctx->url);
-      free(ctx);
-      ota_running = false;
-      return ESP_FAIL;
-    }
+  // Stack is reserved at boot; no allocation here
+  if (task_arena_start(TASK_SLOT_OTA, ota_update_task, (void *)ctx,
+                       OTA_TASK_PRIORITY, tskNO_AFFINITY,
+                       &ota_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create OTA task");
+    free(ctx->url);
+    free(ctx);
+    ota_running = false;
+    return ESP_FAIL;
   }
 
   return ESP_OK;
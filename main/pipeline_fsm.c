@@ -0,0 +1,148 @@
+/**
+ * @file pipeline_fsm.c
+ * @brief Voice pipeline state machine
+ */
+
+#include "pipeline_fsm.h"
+#include <stddef.h>
+#include <string.h>
+
+#define VP_STATE_ANY VP_STATE_COUNT
+
+typedef struct {
+  vp_state_t from; // VP_STATE_ANY matches every state
+  vp_event_t event;
+  vp_state_t to;
+} vp_transition_t;
+
+// First match wins
+static const vp_transition_t transitions[] = {
+    {VP_STATE_ANY, VP_EVENT_ALARM, VP_STATE_ALARM},
+
+    {VP_STATE_IDLE, VP_EVENT_WAKE, VP_STATE_LISTENING},
+
+    {VP_STATE_LISTENING, VP_EVENT_COMMAND_WINDOW, VP_STATE_COMMAND},
+    {VP_STATE_LISTENING, VP_EVENT_STREAM_STARTED, VP_STATE_STREAMING},
+    {VP_STATE_LISTENING, VP_EVENT_STREAM_FAILED, VP_STATE_IDLE},
+    {VP_STATE_LISTENING, VP_EVENT_ERROR, VP_STATE_IDLE},
+
+    // No command recognised: the HA run opens late and gets the buffered audio
+    {VP_STATE_COMMAND, VP_EVENT_HANDLED, VP_STATE_IDLE},
+    {VP_STATE_COMMAND, VP_EVENT_STREAM_STARTED, VP_STATE_STREAMING},
+    {VP_STATE_COMMAND, VP_EVENT_STREAM_FAILED, VP_STATE_IDLE},
+    {VP_STATE_COMMAND, VP_EVENT_ERROR, VP_STATE_IDLE},
+
+    {VP_STATE_STREAMING, VP_EVENT_SPEECH_END, VP_STATE_AWAITING_RESPONSE},
+    // HA may end STT and answer before the local VAD sees the end of speech
+    {VP_STATE_STREAMING, VP_EVENT_TTS_START, VP_STATE_SPEAKING},
+    {VP_STATE_STREAMING, VP_EVENT_TTS_DONE, VP_STATE_IDLE},
+    {VP_STATE_STREAMING, VP_EVENT_HANDLED, VP_STATE_IDLE},
+    {VP_STATE_STREAMING, VP_EVENT_ERROR, VP_STATE_IDLE},
+
+    {VP_STATE_AWAITING_RESPONSE, VP_EVENT_TTS_START, VP_STATE_SPEAKING},
+    {VP_STATE_AWAITING_RESPONSE, VP_EVENT_TTS_DONE, VP_STATE_IDLE},
+    {VP_STATE_AWAITING_RESPONSE, VP_EVENT_HANDLED, VP_STATE_IDLE},
+    {VP_STATE_AWAITING_RESPONSE, VP_EVENT_ERROR, VP_STATE_IDLE},
+    {VP_STATE_AWAITING_RESPONSE, VP_EVENT_TIMEOUT, VP_STATE_IDLE},
+
+    {VP_STATE_SPEAKING, VP_EVENT_TTS_DONE, VP_STATE_IDLE},
+    {VP_STATE_SPEAKING, VP_EVENT_FOLLOWUP, VP_STATE_FOLLOWUP},
+    {VP_STATE_SPEAKING, VP_EVENT_HANDLED, VP_STATE_IDLE},
+    {VP_STATE_SPEAKING, VP_EVENT_ERROR, VP_STATE_IDLE},
+
+    {VP_STATE_FOLLOWUP, VP_EVENT_STREAM_STARTED, VP_STATE_STREAMING},
+    {VP_STATE_FOLLOWUP, VP_EVENT_STREAM_FAILED, VP_STATE_IDLE},
+    {VP_STATE_FOLLOWUP, VP_EVENT_ERROR, VP_STATE_IDLE},
+
+    {VP_STATE_ALARM, VP_EVENT_ALARM_DONE, VP_STATE_IDLE},
+};
+
+static const char *const state_names[VP_STATE_COUNT] = {
+    [VP_STATE_IDLE] = "idle",
+    [VP_STATE_LISTENING] = "listening",
+    [VP_STATE_COMMAND] = "command",
+    [VP_STATE_STREAMING] = "streaming",
+    [VP_STATE_AWAITING_RESPONSE] = "awaiting",
+    [VP_STATE_SPEAKING] = "speaking",
+    [VP_STATE_FOLLOWUP] = "followup",
+    [VP_STATE_ALARM] = "alarm",
+};
+
+static const char *const event_names[VP_EVENT_COUNT] = {
+    [VP_EVENT_WAKE] = "wake",
+    [VP_EVENT_COMMAND_WINDOW] = "command_window",
+    [VP_EVENT_STREAM_STARTED] = "stream_started",
+    [VP_EVENT_STREAM_FAILED] = "stream_failed",
+    [VP_EVENT_SPEECH_END] = "speech_end",
+    [VP_EVENT_TTS_START] = "tts_start",
+    [VP_EVENT_TTS_DONE] = "tts_done",
+    [VP_EVENT_FOLLOWUP] = "followup",
+    [VP_EVENT_HANDLED] = "handled",
+    [VP_EVENT_ERROR] = "error",
+    [VP_EVENT_TIMEOUT] = "timeout",
+    [VP_EVENT_ALARM] = "alarm",
+    [VP_EVENT_ALARM_DONE] = "alarm_done",
+};
+
+void vp_fsm_init(vp_fsm_t *fsm, int64_t now_us) {
+  memset(fsm, 0, sizeof(*fsm));
+  fsm->state = VP_STATE_IDLE;
+  fsm->entered_us = now_us;
+  fsm->states[VP_STATE_IDLE].entries = 1;
+}
+
+static const vp_transition_t *find_transition(vp_state_t from,
+                                              vp_event_t event) {
+  for (size_t i = 0; i < sizeof(transitions) / sizeof(transitions[0]); i++) {
+    const vp_transition_t *t = &transitions[i];
+    if (t->event == event && (t->from == from || t->from == VP_STATE_ANY)) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+bool vp_fsm_dispatch(vp_fsm_t *fsm, vp_event_t event, int64_t posted_us,
+                     int64_t now_us) {
+  if (event >= VP_EVENT_COUNT) {
+    return false;
+  }
+  vp_event_stats_t *es = &fsm->events[event];
+  const vp_transition_t *t = find_transition(fsm->state, event);
+  if (!t) {
+    es->ignored++;
+    return false;
+  }
+
+  uint32_t latency_us = now_us > posted_us ? (uint32_t)(now_us - posted_us) : 0;
+  es->applied++;
+  es->total_latency_us += latency_us;
+  if (latency_us > es->max_latency_us) {
+    es->max_latency_us = latency_us;
+  }
+
+  vp_state_stats_t *ss = &fsm->states[fsm->state];
+  uint32_t dwell_us = vp_fsm_current_dwell_us(fsm, now_us);
+  ss->total_us += dwell_us;
+  ss->last_us = dwell_us;
+  if (dwell_us > ss->max_us) {
+    ss->max_us = dwell_us;
+  }
+
+  fsm->state = t->to;
+  fsm->entered_us = now_us;
+  fsm->states[t->to].entries++;
+  return true;
+}
+
+uint32_t vp_fsm_current_dwell_us(const vp_fsm_t *fsm, int64_t now_us) {
+  return now_us > fsm->entered_us ? (uint32_t)(now_us - fsm->entered_us) : 0;
+}
+
+const char *vp_fsm_state_name(vp_state_t state) {
+  return state < VP_STATE_COUNT ? state_names[state] : "?";
+}
+
+const char *vp_fsm_event_name(vp_event_t event) {
+  return event < VP_EVENT_COUNT ? event_names[event] : "?";
+}
@@ -0,0 +1,107 @@
+/**
+ * @file pipeline_fsm.h
+ * @brief Voice pipeline state machine
+ *
+ * The conversation state lives in one place and only changes through the
+ * transition table in pipeline_fsm.c. Events that are not valid in the
+ * current state are ignored and counted.
+ *
+ * The module has no ESP-IDF dependencies and takes time as a parameter, so
+ * it can be driven from a host harness with scripted events and simulated
+ * time. It is not thread-safe: one task owns a vp_fsm_t and dispatches all
+ * events to it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  VP_STATE_IDLE = 0,          ///< Waiting for the wake word (or music plays)
+  VP_STATE_LISTENING,         ///< Wake prompt, opening the HA run
+  VP_STATE_COMMAND,           ///< Offline command window (MultiNet, no HA)
+  VP_STATE_STREAMING,         ///< Mic audio streamed to HA until speech ends
+  VP_STATE_AWAITING_RESPONSE, ///< Speech ended, waiting for HA to answer
+  VP_STATE_SPEAKING,          ///< TTS answer downloading and playing
+  VP_STATE_FOLLOWUP,          ///< Answer was a question, reopening the mic
+  VP_STATE_ALARM,             ///< Timer/alarm sound playing
+  VP_STATE_COUNT
+} vp_state_t;
+
+typedef enum {
+  VP_EVENT_WAKE = 0,       ///< Wake word or manual trigger
+  VP_EVENT_COMMAND_WINDOW, ///< Capture running for offline commands only
+  VP_EVENT_STREAM_STARTED, ///< Capture for the HA run is running
+  VP_EVENT_STREAM_FAILED,  ///< HA or capture not available
+  VP_EVENT_SPEECH_END,     ///< VAD or HA stt-end, audio stream closed
+  VP_EVENT_TTS_START,      ///< First TTS audio arrived
+  VP_EVENT_TTS_DONE,       ///< TTS finished (or was suppressed)
+  VP_EVENT_FOLLOWUP,       ///< TTS finished and a follow-up is expected
+  VP_EVENT_HANDLED,        ///< Request handled locally, nothing to say
+  VP_EVENT_ERROR,          ///< HA pipeline error
+  VP_EVENT_TIMEOUT,        ///< No HA response in time
+  VP_EVENT_ALARM,          ///< Timer expired or alarm fired
+  VP_EVENT_ALARM_DONE,     ///< Alarm sound finished
+  VP_EVENT_COUNT
+} vp_event_t;
+
+/**
+ * @brief Time spent in one state
+ */
+typedef struct {
+  uint32_t entries;
+  uint64_t total_us;
+  uint32_t last_us; ///< Dwell of the most recent visit
+  uint32_t max_us;
+} vp_state_stats_t;
+
+/**
+ * @brief Handling of one event type
+ *
+ * Latency is the time from posting the event to applying the transition.
+ */
+typedef struct {
+  uint32_t applied;
+  uint32_t ignored; ///< Not valid in the state it arrived in
+  uint64_t total_latency_us;
+  uint32_t max_latency_us;
+} vp_event_stats_t;
+
+typedef struct {
+  vp_state_t state;
+  int64_t entered_us;
+  vp_state_stats_t states[VP_STATE_COUNT];
+  vp_event_stats_t events[VP_EVENT_COUNT];
+} vp_fsm_t;
+
+/**
+ * @brief Reset to IDLE and clear the statistics
+ */
+void vp_fsm_init(vp_fsm_t *fsm, int64_t now_us);
+
+/**
+ * @brief Apply an event
+ *
+ * @param posted_us Time the event was raised
+ * @param now_us Current time
+ * @return true if a transition was taken (possibly back to the same state)
+ */
+bool vp_fsm_dispatch(vp_fsm_t *fsm, vp_event_t event, int64_t posted_us,
+                     int64_t now_us);
+
+/**
+ * @brief Time spent in the current state so far
+ */
+uint32_t vp_fsm_current_dwell_us(const vp_fsm_t *fsm, int64_t now_us);
+
+const char *vp_fsm_state_name(vp_state_t state);
+const char *vp_fsm_event_name(vp_event_t event);
+
+#ifdef __cplusplus
+}
+#endif
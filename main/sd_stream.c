@@ -0,0 +1,415 @@
+/**
+ * @file sd_stream.c
+ * @brief Read-ahead file streaming implementation
+ *
+ * Each stream owns SD_STREAM_BLOCKS buffers of SD_STREAM_BLOCK_SIZE bytes in
+ * PSRAM. The reader task fills them in file order with read() at block
+ * aligned offsets (files start on a cluster boundary, so these are cluster
+ * aligned multi-sector transfers). The consumer copies out of filled blocks
+ * and only blocks when the ring is empty, which is counted as an underrun.
+ *
+ * All ring indices are guarded by one mutex; the card I/O itself runs
+ * without it. A seek outside the buffered window bumps the stream
+ * generation so an in-flight read is discarded.
+ */
+
+#define _GNU_SOURCE
+#include "sd_stream.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "task_arena.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "sd_stream";
+
+#define READER_TASK_PRIORITY 4
+#define READER_IDLE_POLL_MS 100
+#define CONSUMER_WAIT_MS 1000
+
+// SDMMC DMA into PSRAM needs whole cache lines; a buffer off the L2 line
+// goes through a bounce buffer or is split into single-sector transfers
+#ifdef CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#define BLOCK_ALIGN CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#else
+#define BLOCK_ALIGN 64
+#endif
+_Static_assert(SD_STREAM_BLOCK_SIZE % BLOCK_ALIGN == 0,
+               "every ring block must start on a cache line");
+
+#ifdef __LARGE64_FILES
+typedef _off64_t cookie_off_t;
+#else
+typedef off_t cookie_off_t;
+#endif
+
+typedef struct sd_stream {
+  int fd;
+  off_t file_size;
+  uint8_t *buf; // SD_STREAM_BLOCKS * SD_STREAM_BLOCK_SIZE
+  size_t block_len[SD_STREAM_BLOCKS];
+  uint32_t head;    // Blocks filled (producer)
+  uint32_t tail;    // Blocks consumed (consumer)
+  size_t tail_off;  // Offset inside the tail block
+  off_t file_pos;   // File offset of the next block to read
+  off_t read_pos;   // Consumer position
+  uint32_t generation;
+  bool eof;
+  bool error;
+  bool busy;   // Reader is doing I/O for this stream
+  bool closed; // Freed by the reader once busy clears
+  bool primed; // First block delivered; waits after this are underruns
+  SemaphoreHandle_t data_ready;
+  struct sd_stream *next;
+} sd_stream_t;
+
+static SemaphoreHandle_t streams_lock = NULL;
+static TaskHandle_t reader_task_handle = NULL;
+static sd_stream_t *streams = NULL;
+static sd_stream_stats_t stats;
+
+static void stream_free(sd_stream_t *s) {
+  if (s->fd >= 0) {
+    close(s->fd);
+  }
+  if (s->data_ready) {
+    vSemaphoreDelete(s->data_ready);
+  }
+  heap_caps_free(s->buf);
+  free(s);
+}
+
+static void stream_unlink(sd_stream_t *s) {
+  for (sd_stream_t **pp = &streams; *pp; pp = &(*pp)->next) {
+    if (*pp == s) {
+      *pp = s->next;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Pick a stream with free ring space (caller holds streams_lock)
+ *
+ * The stream with the fewest buffered blocks goes first, so a prefetching
+ * stream never starves the one that is playing.
+ */
+static sd_stream_t *pick_stream(void) {
+  sd_stream_t *best = NULL;
+  uint32_t best_fill = SD_STREAM_BLOCKS;
+  for (sd_stream_t *s = streams; s; s = s->next) {
+    uint32_t fill = s->head - s->tail;
+    if (s->closed || s->eof || s->error || fill >= SD_STREAM_BLOCKS) {
+      continue;
+    }
+    if (fill < best_fill) {
+      best = s;
+      best_fill = fill;
+    }
+  }
+  return best;
+}
+
+static void reader_task(void *arg) {
+  (void)arg;
+  while (1) {
+    xSemaphoreTake(streams_lock, portMAX_DELAY);
+    sd_stream_t *s = pick_stream();
+    if (!s) {
+      xSemaphoreGive(streams_lock);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(READER_IDLE_POLL_MS));
+      continue;
+    }
+
+    uint32_t slot = s->head % SD_STREAM_BLOCKS;
+    uint32_t gen = s->generation;
+    off_t pos = s->file_pos;
+    s->busy = true;
+    xSemaphoreGive(streams_lock);
+
+    uint8_t *dst = s->buf + slot * SD_STREAM_BLOCK_SIZE;
+    int64_t start_us = esp_timer_get_time();
+    ssize_t n = -1;
+    if (lseek(s->fd, pos, SEEK_SET) == pos) {
+      n = read(s->fd, dst, SD_STREAM_BLOCK_SIZE);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    xSemaphoreTake(streams_lock, portMAX_DELAY);
+    s->busy = false;
+    if (s->closed) {
+      stream_unlink(s);
+      xSemaphoreGive(streams_lock);
+      stream_free(s);
+      continue;
+    }
+    if (n > 0) {
+      stats.sd_reads++;
+      stats.sd_bytes += n;
+      stats.sd_read_us += elapsed_us;
+    }
+    if (gen == s->generation) {
+      if (n < 0) {
+        ESP_LOGE(TAG, "Read failed at offset %ld", (long)pos);
+        s->error = true;
+      } else {
+        if (n > 0) {
+          s->block_len[slot] = n;
+          s->head++;
+          s->file_pos += n;
+        }
+        if (n < SD_STREAM_BLOCK_SIZE) {
+          s->eof = true;
+        }
+      }
+      xSemaphoreGive(s->data_ready);
+    }
+    xSemaphoreGive(streams_lock);
+  }
+}
+
+static void wake_reader(void) {
+  if (reader_task_handle) {
+    xTaskNotifyGive(reader_task_handle);
+  }
+}
+
+/* ---------- Cookie I/O ---------- */
+
+static ssize_t cookie_read(void *cookie, char *dst, size_t len) {
+  sd_stream_t *s = cookie;
+  size_t done = 0;
+  bool waited = false;
+
+  while (done < len) {
+    xSemaphoreTake(streams_lock, portMAX_DELAY);
+    if (s->tail == s->head) {
+      bool end = s->eof || s->error;
+      xSemaphoreGive(streams_lock);
+      if (end) {
+        break;
+      }
+
+      // Ring empty mid-stream: this is the stall read-ahead should prevent
+      wake_reader();
+      int64_t wait_start = esp_timer_get_time();
+      bool got = xSemaphoreTake(s->data_ready, pdMS_TO_TICKS(CONSUMER_WAIT_MS));
+      uint32_t waited_us = (uint32_t)(esp_timer_get_time() - wait_start);
+      if (s->primed) {
+        xSemaphoreTake(streams_lock, portMAX_DELAY);
+        if (!waited) {
+          stats.underruns++;
+          waited = true;
+        }
+        if (waited_us > stats.max_underrun_us) {
+          stats.max_underrun_us = waited_us;
+        }
+        xSemaphoreGive(streams_lock);
+      }
+      if (!got) {
+        ESP_LOGW(TAG, "Read-ahead stalled for %d ms", CONSUMER_WAIT_MS);
+      }
+      continue;
+    }
+
+    uint32_t slot = s->tail % SD_STREAM_BLOCKS;
+    size_t avail = s->block_len[slot] - s->tail_off;
+    size_t n = len - done;
+    if (n > avail) {
+      n = avail;
+    }
+    memcpy(dst + done, s->buf + slot * SD_STREAM_BLOCK_SIZE + s->tail_off, n);
+    done += n;
+    s->tail_off += n;
+    s->read_pos += n;
+    s->primed = true;
+    bool freed = false;
+    if (s->tail_off >= s->block_len[slot]) {
+      s->tail++;
+      s->tail_off = 0;
+      freed = true;
+    }
+    xSemaphoreGive(streams_lock);
+
+    if (freed) {
+      wake_reader();
+    }
+  }
+
+  return s->error && done == 0 ? -1 : (ssize_t)done;
+}
+
+static int cookie_seek(void *cookie, cookie_off_t *offset, int whence) {
+  sd_stream_t *s = cookie;
+
+  xSemaphoreTake(streams_lock, portMAX_DELAY);
+  off_t target;
+  switch (whence) {
+  case SEEK_SET:
+    target = *offset;
+    break;
+  case SEEK_CUR:
+    target = s->read_pos + *offset;
+    break;
+  case SEEK_END:
+    target = s->file_size + *offset;
+    break;
+  default:
+    xSemaphoreGive(streams_lock);
+    return -1;
+  }
+  if (target < 0) {
+    xSemaphoreGive(streams_lock);
+    return -1;
+  }
+
+  off_t base = s->read_pos - s->tail_off; // File offset of the tail block
+  if (target >= base && target <= s->file_pos) {
+    // Inside the buffered window: just move the consumer
+    off_t rel = target - base;
+    while (s->tail != s->head &&
+           rel >= (off_t)s->block_len[s->tail % SD_STREAM_BLOCKS]) {
+      rel -= s->block_len[s->tail % SD_STREAM_BLOCKS];
+      s->tail++;
+    }
+    s->tail_off = rel;
+  } else {
+    // Restart read-ahead at the block containing the target
+    s->generation++;
+    s->head = 0;
+    s->tail = 0;
+    s->file_pos = target - (target % SD_STREAM_BLOCK_SIZE);
+    s->tail_off = target - s->file_pos;
+    s->eof = false;
+    s->error = false;
+    s->primed = false;
+    xSemaphoreTake(s->data_ready, 0);
+  }
+  s->read_pos = target;
+  *offset = target;
+  xSemaphoreGive(streams_lock);
+
+  wake_reader();
+  return 0;
+}
+
+static int cookie_close(void *cookie) {
+  sd_stream_t *s = cookie;
+
+  xSemaphoreTake(streams_lock, portMAX_DELAY);
+  s->closed = true;
+  bool free_now = !s->busy;
+  if (free_now) {
+    stream_unlink(s);
+  }
+  xSemaphoreGive(streams_lock);
+
+  if (free_now) {
+    stream_free(s);
+  }
+  return 0;
+}
+
+/* ---------- Public API ---------- */
+
+static esp_err_t ensure_reader(void) {
+  if (reader_task_handle) {
+    return ESP_OK;
+  }
+  if (!streams_lock) {
+    streams_lock = xSemaphoreCreateMutex();
+    if (!streams_lock) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  if (task_arena_start(TASK_SLOT_SD_READER, reader_task, NULL,
+                       READER_TASK_PRIORITY, tskNO_AFFINITY,
+                       &reader_task_handle) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create reader task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+FILE *sd_stream_fopen(const char *path) {
+  if (!path || ensure_reader() != ESP_OK) {
+    return NULL;
+  }
+
+  sd_stream_t *s = calloc(1, sizeof(*s));
+  if (!s) {
+    return NULL;
+  }
+  s->fd = open(path, O_RDONLY);
+  if (s->fd < 0) {
+    free(s);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(s->fd, &st) == 0) {
+    s->file_size = st.st_size;
+  }
+  s->buf = heap_caps_aligned_alloc(BLOCK_ALIGN,
+                                   SD_STREAM_BLOCKS * SD_STREAM_BLOCK_SIZE,
+                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  s->data_ready = xSemaphoreCreateBinary();
+  if (!s->buf || !s->data_ready) {
+    ESP_LOGE(TAG, "Out of memory for read-ahead of %s", path);
+    stream_free(s);
+    return NULL;
+  }
+
+  cookie_io_functions_t io = {
+      .read = cookie_read,
+      .write = NULL,
+      .seek = cookie_seek,
+      .close = cookie_close,
+  };
+  FILE *fp = fopencookie(s, "r", io);
+  if (!fp) {
+    stream_free(s);
+    return NULL;
+  }
+  // The ring already buffers; let fread() go straight to cookie_read()
+  setvbuf(fp, NULL, _IONBF, 0);
+
+  xSemaphoreTake(streams_lock, portMAX_DELAY);
+  s->next = streams;
+  streams = s;
+  stats.streams_opened++;
+  xSemaphoreGive(streams_lock);
+
+  wake_reader();
+  return fp;
+}
+
+void sd_stream_get_stats(sd_stream_stats_t *out) {
+  if (!out) {
+    return;
+  }
+  if (streams_lock) {
+    xSemaphoreTake(streams_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(streams_lock);
+  } else {
+    *out = stats;
+  }
+}
+
+uint32_t sd_stream_get_throughput_kbps(void) {
+  sd_stream_stats_t s;
+  sd_stream_get_stats(&s);
+  if (s.sd_read_us == 0) {
+    return 0;
+  }
+  return (uint32_t)(s.sd_bytes * 1000000ULL / s.sd_read_us / 1024);
+}
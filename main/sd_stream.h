@@ -0,0 +1,62 @@
+/**
+ * @file sd_stream.h
+ * @brief Read-ahead file streaming for SD card audio
+ *
+ * A shared reader task keeps a PSRAM ring of large, block-aligned reads
+ * ahead of each open stream, so decoders never wait on SD latency and the
+ * SDMMC bus sees a few large transfers instead of many small stdio reads.
+ * Streams are exposed as a plain FILE* (fopencookie), so existing decode
+ * loops only change the fopen() call.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SD_STREAM_BLOCK_SIZE (32 * 1024) ///< One SD read (cluster aligned)
+#define SD_STREAM_BLOCKS 4               ///< Blocks of read-ahead per stream
+
+/**
+ * @brief Aggregate statistics for all streams since boot
+ */
+typedef struct {
+  uint32_t streams_opened;   ///< Streams opened
+  uint32_t sd_reads;         ///< Block reads issued to the card
+  uint64_t sd_bytes;         ///< Bytes read from the card
+  uint64_t sd_read_us;       ///< Time spent inside read() calls
+  uint32_t underruns;        ///< Consumer had to wait for data mid-stream
+  uint32_t max_underrun_us;  ///< Longest single consumer wait
+} sd_stream_stats_t;
+
+/**
+ * @brief Open a file for read-ahead streaming
+ *
+ * The reader task starts filling the ring immediately, so opening a stream
+ * ahead of time (e.g. for the next track) also prefetches its data.
+ *
+ * @param path File path
+ * @return FILE* (read-only, seekable) or NULL on error. Close with fclose().
+ */
+FILE *sd_stream_fopen(const char *path);
+
+/**
+ * @brief Get aggregate stream statistics
+ *
+ * @param stats Output statistics
+ */
+void sd_stream_get_stats(sd_stream_stats_t *stats);
+
+/**
+ * @brief Average SD read throughput in KB/s (0 if nothing read yet)
+ */
+uint32_t sd_stream_get_throughput_kbps(void);
+
+#ifdef __cplusplus
+}
+#endif
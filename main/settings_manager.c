@@ -8,6 +8,9 @@
 #define TAG "settings"
 #define NVS_NAMESPACE "sys_config"
 #define DEFAULT_OUTPUT_VOLUME 60
+#define DEFAULT_WIFI_STANDBY false
+#define DEFAULT_OFFLINE_COMMANDS false
+#define DEFAULT_WAKE2_ROUTE "local"
 
 esp_err_t settings_manager_init(void) {
     // NVS init is usually done in main, but we can double check here
@@ -71,6 +74,10 @@ esp_err_t settings_manager_load(app_settings_t *settings) {
         settings->mqtt_client_id[sizeof(settings->mqtt_client_id)-1] = '\0';
         settings->output_volume = DEFAULT_OUTPUT_VOLUME;
         settings->ota_url[0] = '\0';
+        settings->wifi_standby = DEFAULT_WIFI_STANDBY;
+        settings->offline_commands = DEFAULT_OFFLINE_COMMANDS;
+        strcpy(settings->wake2_route, DEFAULT_WAKE2_ROUTE);
+        settings->wake2_threshold = 0.0f;
         return ESP_OK;
     }
 
@@ -102,6 +109,19 @@ esp_err_t settings_manager_load(app_settings_t *settings) {
 
     nvs_get_str_safe(my_handle, "ota_url", settings->ota_url, sizeof(settings->ota_url), "");
 
+    uint8_t standby = DEFAULT_WIFI_STANDBY;
+    (void)nvs_get_u8(my_handle, "wifi_stby", &standby);
+    settings->wifi_standby = (bool)standby;
+
+    uint8_t offline_cmds = DEFAULT_OFFLINE_COMMANDS;
+    (void)nvs_get_u8(my_handle, "offline_cmd", &offline_cmds);
+    settings->offline_commands = (bool)offline_cmds;
+
+    nvs_get_str_safe(my_handle, "wake2_route", settings->wake2_route, sizeof(settings->wake2_route), DEFAULT_WAKE2_ROUTE);
+    uint16_t wake2_thr = 0; // Per mille (NVS has no float)
+    (void)nvs_get_u16(my_handle, "wake2_thr", &wake2_thr);
+    settings->wake2_threshold = wake2_thr / 1000.0f;
+
     nvs_close(my_handle);
     return ESP_OK;
 }
@@ -132,6 +152,10 @@ esp_err_t settings_manager_save(const app_settings_t *settings) {
     nvs_set_i32(my_handle, "out_vol", out_vol);
 
     nvs_set_str(my_handle, "ota_url", settings->ota_url);
+    nvs_set_u8(my_handle, "wifi_stby", (uint8_t)settings->wifi_standby);
+    nvs_set_u8(my_handle, "offline_cmd", (uint8_t)settings->offline_commands);
+    nvs_set_str(my_handle, "wake2_route", settings->wake2_route);
+    nvs_set_u16(my_handle, "wake2_thr", (uint16_t)(settings->wake2_threshold * 1000.0f + 0.5f));
 
     err = nvs_commit(my_handle);
     nvs_close(my_handle);
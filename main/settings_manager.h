@@ -23,6 +23,11 @@ typedef struct {
 
     int output_volume; // 0-100
     char ota_url[256];
+
+    bool wifi_standby; // Keep WiFi associated behind Ethernet (no SD card)
+    bool offline_commands; // MultiNet command window after wake
+    char wake2_route[40]; // Second wake word: "", "local" or HA pipeline id
+    float wake2_threshold; // Second wake word threshold, 0 = model default
 } app_settings_t;
 
 // Initialize settings manager (mounts NVS)
@@ -4,10 +4,14 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "mqtt_ha.h"
 #include "led_status.h"
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "sys_diag";
 static const char *NVS_NAMESPACE = "diag";
@@ -189,3 +193,303 @@ void sys_diag_report_status(void) {
         mqtt_ha_update_sensor("va_response", msg);
     }
 }
+
+/* ---------- Task profiler ---------- */
+
+#define TASK_STATS_PERIOD_MS 1000
+#define TASK_STATS_WINDOW 10 // Samples in the rolling window
+#define TASK_STATS_RING (TASK_STATS_WINDOW + 1)
+#define TASK_STATS_MAX_TASKS 48
+#define TASK_STATS_STACK 3072
+#define TASK_STATS_ALERT_HOLDOFF_US (30 * 1000000LL) // Per task
+
+typedef struct {
+    const char *name;
+    uint8_t cpu_pct;      // Of its core, in one sample
+    uint16_t stack_floor; // Bytes that must stay free
+} rt_budget_t;
+
+// Tasks whose overrun is heard as an audio glitch or seen as a UI stall
+static const rt_budget_t rt_budgets[] = {
+    {"afe_feed", 30, 1024},
+    {"afe_fetch", 75, 1024},
+    {"tts_playback", 40, 1024},
+    {"voice_pipeline", 40, 1024},
+    {"websocket_task", 20, 512},
+    {"oled_task", 10, 512},
+    {"led_effect", 10, 512},
+    {"mqtt_metrics", 10, 512},
+};
+
+typedef struct {
+    TaskHandle_t handle; // NULL: slot free
+    char name[configMAX_TASK_NAME_LEN];
+    int8_t core;         // -1: not pinned
+    const rt_budget_t *budget;
+    configRUN_TIME_COUNTER_TYPE runtime[TASK_STATS_RING];
+    uint32_t since;      // First sample of this task
+    uint32_t seen;       // Last sample that listed it
+    uint32_t stack_free; // High-water mark, bytes
+    uint16_t cpu_x10;    // Window, 0.1 %
+    uint16_t last_x10;   // Last sample, 0.1 %
+    bool stack_low;
+    int64_t last_alert_us;
+} task_slot_t;
+
+static SemaphoreHandle_t stats_lock = NULL;
+static TaskStatus_t status_buf[TASK_STATS_MAX_TASKS];
+static task_slot_t slots[TASK_STATS_MAX_TASKS];
+static configRUN_TIME_COUNTER_TYPE sample_time[TASK_STATS_RING];
+static uint32_t sample_no = 0;
+static uint32_t budget_misses = 0;
+static TaskHandle_t idle_handles[portNUM_PROCESSORS];
+
+static const rt_budget_t *find_budget(const char *name) {
+    for (size_t i = 0; i < sizeof(rt_budgets) / sizeof(rt_budgets[0]); i++) {
+        if (strcmp(rt_budgets[i].name, name) == 0) {
+            return &rt_budgets[i];
+        }
+    }
+    return NULL;
+}
+
+static task_slot_t *find_slot(const TaskStatus_t *st) {
+    task_slot_t *free_slot = NULL;
+    for (int i = 0; i < TASK_STATS_MAX_TASKS; i++) {
+        task_slot_t *slot = &slots[i];
+        if (!slot->handle) {
+            if (!free_slot) free_slot = slot;
+        } else if (slot->handle == st->xHandle &&
+                   strncmp(slot->name, st->pcTaskName, sizeof(slot->name)) == 0) {
+            return slot;
+        }
+    }
+    if (free_slot) {
+        // A new task (a recycled TCB under another name counts as new)
+        memset(free_slot, 0, sizeof(*free_slot));
+        free_slot->handle = st->xHandle;
+        strncpy(free_slot->name, st->pcTaskName, sizeof(free_slot->name) - 1);
+        free_slot->budget = find_budget(free_slot->name);
+        free_slot->since = sample_no;
+    }
+    return free_slot;
+}
+
+static uint16_t share_x10(configRUN_TIME_COUNTER_TYPE task_delta,
+                          configRUN_TIME_COUNTER_TYPE time_delta) {
+    if (time_delta == 0) return 0;
+    uint64_t x10 = (uint64_t)task_delta * 1000 / time_delta;
+    return (uint16_t)(x10 > 1000 ? 1000 : x10);
+}
+
+/**
+ * @brief Check a real-time task against its budget (caller holds stats_lock)
+ * @return true if an alert is due; alert holds its text
+ */
+static bool check_budget(task_slot_t *slot, char *alert, size_t alert_len) {
+    const rt_budget_t *b = slot->budget;
+    bool miss = false;
+    if (slot->last_x10 > b->cpu_pct * 10) {
+        snprintf(alert, alert_len, "%s CPU %u.%u%% > %u%%", slot->name,
+                 slot->last_x10 / 10, slot->last_x10 % 10, b->cpu_pct);
+        miss = true;
+    }
+    bool stack_low = slot->stack_free < b->stack_floor;
+    if (stack_low && !slot->stack_low) {
+        // Counted once per drop; the high-water mark never recovers
+        snprintf(alert, alert_len, "%s stack %u B free < %u B", slot->name,
+                 (unsigned)slot->stack_free, b->stack_floor);
+        miss = true;
+    }
+    slot->stack_low = stack_low;
+    if (!miss) return false;
+
+    budget_misses++;
+    int64_t now = esp_timer_get_time();
+    if (slot->last_alert_us && now - slot->last_alert_us < TASK_STATS_ALERT_HOLDOFF_US) {
+        return false;
+    }
+    slot->last_alert_us = now;
+    return true;
+}
+
+static void task_stats_sample(void) {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(status_buf, TASK_STATS_MAX_TASKS, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, profiler skipped a sample", TASK_STATS_MAX_TASKS);
+        return;
+    }
+
+    char alert[64] = {0};
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    sample_no++;
+    uint32_t cur = sample_no % TASK_STATS_RING;
+    uint32_t prev = (sample_no - 1) % TASK_STATS_RING;
+    sample_time[cur] = total;
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *st = &status_buf[i];
+        task_slot_t *slot = find_slot(st);
+        if (!slot) continue;
+        slot->seen = sample_no;
+        slot->core = (st->xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)st->xCoreID;
+        slot->stack_free = st->usStackHighWaterMark; // StackType_t is a byte
+        slot->runtime[cur] = st->ulRunTimeCounter;
+        if (slot->since == sample_no) continue; // No delta yet
+
+        slot->last_x10 = share_x10(slot->runtime[cur] - slot->runtime[prev],
+                                   sample_time[cur] - sample_time[prev]);
+        uint32_t first = sample_no - TASK_STATS_WINDOW;
+        if (sample_no < TASK_STATS_WINDOW || first < slot->since) {
+            first = slot->since;
+        }
+        uint32_t f = first % TASK_STATS_RING;
+        slot->cpu_x10 = share_x10(slot->runtime[cur] - slot->runtime[f],
+                                  sample_time[cur] - sample_time[f]);
+        if (slot->budget && check_budget(slot, alert, sizeof(alert))) {
+            ESP_LOGW(TAG, "Task budget miss: %s", alert);
+        }
+    }
+
+    // Deleted tasks
+    for (int i = 0; i < TASK_STATS_MAX_TASKS; i++) {
+        if (slots[i].handle && slots[i].seen != sample_no) {
+            slots[i].handle = NULL;
+        }
+    }
+    xSemaphoreGive(stats_lock);
+
+    if (alert[0] && mqtt_ha_is_connected()) {
+        mqtt_ha_update_sensor("task_alert", alert);
+    }
+}
+
+static void task_stats_task(void *arg) {
+    (void)arg;
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        task_stats_sample();
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(TASK_STATS_PERIOD_MS));
+    }
+}
+
+esp_err_t sys_diag_task_stats_start(void) {
+    if (stats_lock) {
+        return ESP_OK;
+    }
+    stats_lock = xSemaphoreCreateMutex();
+    if (!stats_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        idle_handles[core] = xTaskGetIdleTaskHandleForCore(core);
+    }
+    // Lowest priority above idle: sampling must not disturb what it measures
+    if (xTaskCreate(task_stats_task, "task_stats", TASK_STATS_STACK, NULL, 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task profiler");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+float sys_diag_get_cpu_idle(int core) {
+    if (!stats_lock || core < 0 || core >= portNUM_PROCESSORS) {
+        return -1.0f;
+    }
+    float idle = -1.0f;
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    for (int i = 0; i < TASK_STATS_MAX_TASKS; i++) {
+        if (slots[i].handle == idle_handles[core] && slots[i].since != sample_no) {
+            idle = slots[i].cpu_x10 / 10.0f;
+            break;
+        }
+    }
+    xSemaphoreGive(stats_lock);
+    return idle;
+}
+
+uint32_t sys_diag_get_budget_misses(void) {
+    return budget_misses;
+}
+
+static bool is_idle_task(TaskHandle_t handle) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (handle == idle_handles[core]) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Busiest task not listed yet (caller holds stats_lock)
+ * Selection by CPU share; a few dozen tasks, so no sort buffer.
+ * @return Slot index, or -1
+ */
+static int next_busiest(bool *listed, bool last_sample) {
+    int best = -1;
+    uint16_t best_x10 = 0;
+    for (int i = 0; i < TASK_STATS_MAX_TASKS; i++) {
+        const task_slot_t *slot = &slots[i];
+        if (!slot->handle || listed[i] || is_idle_task(slot->handle)) continue;
+        uint16_t x10 = last_sample ? slot->last_x10 : slot->cpu_x10;
+        if (best < 0 || x10 > best_x10) {
+            best = i;
+            best_x10 = x10;
+        }
+    }
+    if (best >= 0) listed[best] = true;
+    return best;
+}
+
+int sys_diag_get_busy_tasks(char (*names)[SYS_DIAG_TASK_NAME_LEN], int max_tasks) {
+    if (!names || !stats_lock) {
+        return 0;
+    }
+    int n = 0;
+    bool listed[TASK_STATS_MAX_TASKS] = {false};
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    while (n < max_tasks) {
+        int best = next_busiest(listed, true);
+        if (best < 0) break;
+        strncpy(names[n], slots[best].name, SYS_DIAG_TASK_NAME_LEN - 1);
+        names[n][SYS_DIAG_TASK_NAME_LEN - 1] = '\0';
+        n++;
+    }
+    xSemaphoreGive(stats_lock);
+    return n;
+}
+
+size_t sys_diag_format_task_stats(char *buf, size_t len, int max_tasks) {
+    if (!buf || len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+    if (!stats_lock) {
+        return 0;
+    }
+    size_t used = 0;
+    bool listed[TASK_STATS_MAX_TASKS] = {false};
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    for (int n = 0; n < max_tasks; n++) {
+        int best = next_busiest(listed, false);
+        if (best < 0) break;
+
+        const task_slot_t *slot = &slots[best];
+        char core[4];
+        if (slot->core < 0) {
+            strcpy(core, "-");
+        } else {
+            snprintf(core, sizeof(core), "%d", slot->core);
+        }
+        int w = snprintf(buf + used, len - used, "%s%s %u.%u%%@%s %u", n ? ", " : "",
+                         slot->name, slot->cpu_x10 / 10, slot->cpu_x10 % 10, core,
+                         (unsigned)slot->stack_free);
+        if (w < 0 || (size_t)w >= len - used) {
+            buf[used] = '\0'; // Whole entries only
+            break;
+        }
+        used += (size_t)w;
+    }
+    xSemaphoreGive(stats_lock);
+    return used;
+}
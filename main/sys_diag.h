@@ -2,11 +2,15 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define SYS_DIAG_TASK_NAME_LEN 16 // configMAX_TASK_NAME_LEN
+
 // Global flag: Is the system in Safe Mode?
 bool sys_diag_is_safe_mode(void);
 
@@ -57,6 +61,40 @@ int sys_diag_get_boot_count(void);
  */
 void sys_diag_report_status(void);
 
+/**
+ * @brief Start the task profiler
+ * Samples FreeRTOS run-time stats once a second: CPU share of every task
+ * and idle share of every core over a rolling 10 s window, plus stack
+ * high-water marks. Real-time tasks (audio, TTS, pipeline, UI) have a CPU
+ * and stack budget; a miss is logged and published as "task_alert".
+ */
+esp_err_t sys_diag_task_stats_start(void);
+
+/**
+ * @brief Idle share of a core over the window
+ * @return Percent, or -1 before the first full sample
+ */
+float sys_diag_get_cpu_idle(int core);
+
+/**
+ * @brief Budget misses of real-time tasks since boot
+ */
+uint32_t sys_diag_get_budget_misses(void);
+
+/**
+ * @brief Names of the busiest tasks in the last sample (idle left out)
+ * For correlating a glitch with what was running when it happened.
+ * @return Names written
+ */
+int sys_diag_get_busy_tasks(char (*names)[SYS_DIAG_TASK_NAME_LEN], int max_tasks);
+
+/**
+ * @brief Busiest tasks as "name cpu%@core stack_free_bytes, ..."
+ * @param max_tasks Tasks listed (idle tasks are left out)
+ * @return Characters written (without the terminator)
+ */
+size_t sys_diag_format_task_stats(char *buf, size_t len, int max_tasks);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,455 @@
+/**
+ * @file task_arena.c
+ * @brief Boot-time task stack arena and shared job workers
+ *
+ * The stack layout is a struct per memory kind, so the compiler sums the
+ * table and checks it against the budget. Free stack is measured from the
+ * fill pattern FreeRTOS writes into a new stack, which works for tasks that
+ * have already exited and for the job workers, whose handles we never see.
+ */
+
+#include "task_arena.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "task_arena";
+
+#define JOB_WORKERS 2
+#define JOB_STACK_SIZE 6144 // ha_reconnect needs the most
+#define JOB_PRIORITY 5
+#define JOB_QUEUE_LEN 8
+
+// One worker for user-facing jobs, so they never wait behind the above
+#define CONTROL_STACK_SIZE 6144 // Music play may init the player
+#define CONTROL_QUEUE_LEN 4
+
+#define START_GRACE_MS 500   // A stopping task finishes its last cycle
+#define STACK_FILL_BYTE 0xa5 // tskSTACK_FILL_BYTE
+
+// Budgets; raise deliberately, the compiler refuses a table over them
+#define INTERNAL_BUDGET (80 * 1024)
+#define PSRAM_BUDGET (32 * 1024)
+
+// StackType_t is one byte on ESP-IDF: sizes are in bytes
+typedef struct {
+  StackType_t afe_feed[8192];
+  StackType_t afe_fetch[16384];
+  StackType_t tts_playback[8192];
+  StackType_t music_play[6144];
+  StackType_t music_prefetch[6144];
+  StackType_t sd_reader[3072];
+  StackType_t music_cache[3072];
+  StackType_t ota[4096];
+  StackType_t jobs[JOB_WORKERS][JOB_STACK_SIZE];
+  StackType_t control[CONTROL_STACK_SIZE];
+} internal_stacks_t;
+
+// Control tasks, off the audio path
+typedef struct {
+  StackType_t voice_pipeline[12288];
+  StackType_t event_bus[8192];
+} psram_stacks_t;
+
+_Static_assert(sizeof(internal_stacks_t) +
+                       TASK_SLOT_COUNT * sizeof(StaticTask_t) <=
+                   INTERNAL_BUDGET,
+               "internal task stacks over budget");
+_Static_assert(sizeof(psram_stacks_t) <= PSRAM_BUDGET,
+               "PSRAM task stacks over budget");
+_Static_assert(TASK_SLOT_JOBS1 - TASK_SLOT_JOBS0 + 1 == JOB_WORKERS,
+               "one slot per job worker");
+_Static_assert(TASK_SLOT_CONTROL == TASK_SLOT_JOBS1 + 1,
+               "worker slots are contiguous");
+
+typedef struct {
+  const char *name;
+  bool psram;
+  size_t offset;
+  uint32_t size;
+} slot_def_t;
+
+#define INTERNAL_SLOT(task_name, field)                                        \
+  {task_name, false, offsetof(internal_stacks_t, field),                       \
+   sizeof(((internal_stacks_t *)0)->field)}
+#define PSRAM_SLOT(task_name, field)                                           \
+  {task_name, true, offsetof(psram_stacks_t, field),                           \
+   sizeof(((psram_stacks_t *)0)->field)}
+
+static const slot_def_t slot_defs[TASK_SLOT_COUNT] = {
+    [TASK_SLOT_AFE_FEED] = INTERNAL_SLOT("afe_feed", afe_feed),
+    [TASK_SLOT_AFE_FETCH] = INTERNAL_SLOT("afe_fetch", afe_fetch),
+    [TASK_SLOT_TTS_PLAYBACK] = INTERNAL_SLOT("tts_playback", tts_playback),
+    [TASK_SLOT_MUSIC_PLAY] = INTERNAL_SLOT("music_play", music_play),
+    [TASK_SLOT_MUSIC_PREFETCH] =
+        INTERNAL_SLOT("music_prefetch", music_prefetch),
+    [TASK_SLOT_SD_READER] = INTERNAL_SLOT("sd_reader", sd_reader),
+    [TASK_SLOT_MUSIC_CACHE] = INTERNAL_SLOT("music_cache", music_cache),
+    [TASK_SLOT_OTA] = INTERNAL_SLOT("ota_update_task", ota),
+    [TASK_SLOT_JOBS0] = INTERNAL_SLOT("jobs0", jobs[0]),
+    [TASK_SLOT_JOBS1] = INTERNAL_SLOT("jobs1", jobs[1]),
+    [TASK_SLOT_CONTROL] = INTERNAL_SLOT("control0", control),
+    [TASK_SLOT_VOICE_PIPELINE] =
+        PSRAM_SLOT("voice_pipeline", voice_pipeline),
+    [TASK_SLOT_EVENT_BUS] = PSRAM_SLOT("event_bus", event_bus),
+};
+
+typedef struct {
+  TaskHandle_t handle;
+  bool parked;       // Occupant called task_arena_exit()
+  bool used;         // Ever started: the stack has the fill pattern
+  uint32_t starts;
+  uint32_t min_free; // Lowest free stack seen, bytes
+} slot_t;
+
+static internal_stacks_t *internal_stacks = NULL;
+static psram_stacks_t *psram_stacks = NULL;
+static StaticTask_t tcbs[TASK_SLOT_COUNT];
+static slot_t slots[TASK_SLOT_COUNT];
+static portMUX_TYPE arena_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static worker_pool_handle_t jobs = NULL;
+static worker_pool_handle_t control = NULL;
+static uint32_t jobs_submitted = 0;
+static uint32_t jobs_dropped = 0;
+static uint32_t heap_free_after = 0;
+
+static bool is_job_slot(int slot) {
+  return slot >= TASK_SLOT_JOBS0 && slot <= TASK_SLOT_CONTROL;
+}
+
+static StackType_t *slot_stack(task_slot_t slot) {
+  const slot_def_t *def = &slot_defs[slot];
+  uint8_t *base =
+      def->psram ? (uint8_t *)psram_stacks : (uint8_t *)internal_stacks;
+  return (StackType_t *)(base + def->offset);
+}
+
+/**
+ * @brief Bytes at the far end of the stack the task never wrote
+ */
+static uint32_t stack_unused(task_slot_t slot) {
+  const uint8_t *p = (const uint8_t *)slot_stack(slot);
+  uint32_t n = 0;
+  while (n < slot_defs[slot].size && p[n] == STACK_FILL_BYTE) {
+    n++;
+  }
+  return n;
+}
+
+static void note_stack(task_slot_t slot) {
+  if (!slots[slot].used) {
+    return;
+  }
+  uint32_t unused = stack_unused(slot);
+  portENTER_CRITICAL(&arena_mux);
+  if (unused < slots[slot].min_free) {
+    slots[slot].min_free = unused;
+  }
+  portEXIT_CRITICAL(&arena_mux);
+}
+
+static bool running_anywhere(TaskHandle_t handle) {
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    if (xTaskGetCurrentTaskHandleForCore(core) == handle) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Start a pool whose workers run in consecutive slots from first
+ */
+static esp_err_t start_pool(worker_pool_config_t *config, int first,
+                            worker_pool_handle_t *out) {
+  StackType_t *stacks[JOB_WORKERS];
+  StaticTask_t *pool_tcbs[JOB_WORKERS];
+  if (config->workers > JOB_WORKERS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  for (int i = 0; i < config->workers; i++) {
+    stacks[i] = slot_stack(first + i);
+    pool_tcbs[i] = &tcbs[first + i];
+    slots[first + i].used = true;
+    slots[first + i].starts = 1;
+  }
+  config->stacks = stacks;
+  config->tcbs = pool_tcbs;
+  esp_err_t err = worker_pool_create(config, out);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start %s workers: %s", config->name,
+             esp_err_to_name(err));
+  }
+  return err;
+}
+
+/**
+ * @brief Delete a parked occupant so the slot can be reused
+ *
+ * A suspended task that is not running anywhere is deleted on the spot,
+ * not handed to the idle task, so its stack is free when this returns.
+ */
+static bool reap(task_slot_t slot, uint32_t wait_ms) {
+  slot_t *s = &slots[slot];
+  uint32_t waited_ms = 0;
+  while (s->handle) {
+    if (s->parked && eTaskGetState(s->handle) == eSuspended &&
+        !running_anywhere(s->handle)) {
+      note_stack(slot);
+      vTaskDelete(s->handle);
+      s->handle = NULL;
+      break;
+    }
+    if (waited_ms >= wait_ms) {
+      return false;
+    }
+    vTaskDelay(1);
+    waited_ms += portTICK_PERIOD_MS;
+  }
+  return true;
+}
+
+esp_err_t task_arena_init(void) {
+  if (internal_stacks) {
+    return ESP_OK;
+  }
+
+  internal_stacks = heap_caps_aligned_alloc(
+      16, sizeof(internal_stacks_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  psram_stacks = heap_caps_aligned_alloc(16, sizeof(psram_stacks_t),
+                                         MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!internal_stacks || !psram_stacks) {
+    ESP_LOGE(TAG,
+             "Task arena does not fit: internal %u bytes (largest block %u), "
+             "PSRAM %u bytes (largest block %u)",
+             (unsigned)sizeof(internal_stacks_t),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL |
+                                                        MALLOC_CAP_8BIT),
+             (unsigned)sizeof(psram_stacks_t),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM |
+                                                        MALLOC_CAP_8BIT));
+    heap_caps_free(internal_stacks);
+    heap_caps_free(psram_stacks);
+    internal_stacks = NULL;
+    psram_stacks = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  heap_free_after =
+      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  for (int i = 0; i < TASK_SLOT_COUNT; i++) {
+    slots[i].min_free = UINT32_MAX;
+  }
+
+  worker_pool_config_t job_config = {
+      .name = "jobs",
+      .workers = JOB_WORKERS,
+      .stack_size = JOB_STACK_SIZE,
+      .priority = JOB_PRIORITY,
+      .queue_len = JOB_QUEUE_LEN,
+  };
+  esp_err_t err = start_pool(&job_config, TASK_SLOT_JOBS0, &jobs);
+  if (err != ESP_OK) {
+    return err;
+  }
+  worker_pool_config_t control_config = {
+      .name = "control",
+      .workers = 1,
+      .stack_size = CONTROL_STACK_SIZE,
+      .priority = JOB_PRIORITY,
+      .queue_len = CONTROL_QUEUE_LEN,
+  };
+  err = start_pool(&control_config, TASK_SLOT_CONTROL, &control);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  task_arena_log_report();
+  return ESP_OK;
+}
+
+esp_err_t task_arena_start(task_slot_t slot, TaskFunction_t fn, void *arg,
+                           UBaseType_t priority, BaseType_t core,
+                           TaskHandle_t *out) {
+  if (slot >= TASK_SLOT_COUNT || !fn || is_job_slot(slot)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!internal_stacks) {
+    ESP_LOGE(TAG, "%s started before task_arena_init()",
+             slot_defs[slot].name);
+    return ESP_ERR_INVALID_STATE;
+  }
+  slot_t *s = &slots[slot];
+  if (s->handle == xTaskGetCurrentTaskHandle() || !reap(slot, START_GRACE_MS)) {
+    ESP_LOGE(TAG, "Slot %s is still in use", slot_defs[slot].name);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  portENTER_CRITICAL(&arena_mux);
+  s->parked = false;
+  s->used = true;
+  s->starts++;
+  portEXIT_CRITICAL(&arena_mux);
+  TaskHandle_t handle = xTaskCreateStaticPinnedToCore(
+      fn, slot_defs[slot].name, slot_defs[slot].size, arg, priority,
+      slot_stack(slot), &tcbs[slot], core);
+  if (!handle) {
+    ESP_LOGE(TAG, "Failed to create %s", slot_defs[slot].name);
+    return ESP_FAIL;
+  }
+  s->handle = handle;
+  if (out) {
+    *out = handle;
+  }
+  return ESP_OK;
+}
+
+void task_arena_exit(task_slot_t slot) {
+  if (slot < TASK_SLOT_COUNT) {
+    note_stack(slot);
+    portENTER_CRITICAL(&arena_mux);
+    slots[slot].parked = true;
+    portEXIT_CRITICAL(&arena_mux);
+  }
+  // The next task_arena_start() of the slot deletes this task
+  for (;;) {
+    vTaskSuspend(NULL);
+  }
+}
+
+void task_arena_stop(task_slot_t slot) {
+  if (slot >= TASK_SLOT_COUNT || is_job_slot(slot)) {
+    return;
+  }
+  slot_t *s = &slots[slot];
+  if (!s->handle || s->handle == xTaskGetCurrentTaskHandle()) {
+    return;
+  }
+  vTaskSuspend(s->handle);
+  portENTER_CRITICAL(&arena_mux);
+  s->parked = true;
+  portEXIT_CRITICAL(&arena_mux);
+  (void)reap(slot, START_GRACE_MS);
+}
+
+static esp_err_t submit(worker_pool_handle_t pool, worker_job_fn_t fn,
+                        void *arg) {
+  if (!pool) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t err = worker_pool_submit(pool, fn, arg, 0);
+  portENTER_CRITICAL(&arena_mux);
+  if (err == ESP_OK) {
+    jobs_submitted++;
+  } else {
+    jobs_dropped++;
+  }
+  portEXIT_CRITICAL(&arena_mux);
+  return err;
+}
+
+esp_err_t task_arena_submit_job(worker_job_fn_t fn, void *arg) {
+  return submit(jobs, fn, arg);
+}
+
+esp_err_t task_arena_submit_control(worker_job_fn_t fn, void *arg) {
+  return submit(control, fn, arg);
+}
+
+void task_arena_get_stats(task_arena_stats_t *out) {
+  if (!out) {
+    return;
+  }
+  memset(out, 0, sizeof(*out));
+  out->internal_bytes =
+      sizeof(internal_stacks_t) + TASK_SLOT_COUNT * sizeof(StaticTask_t);
+  out->internal_budget = INTERNAL_BUDGET;
+  out->psram_bytes = sizeof(psram_stacks_t);
+  out->psram_budget = PSRAM_BUDGET;
+  out->heap_free_after = heap_free_after;
+  if (!internal_stacks) {
+    return;
+  }
+
+  int tightest = -1;
+  for (int i = 0; i < TASK_SLOT_COUNT; i++) {
+    note_stack((task_slot_t)i);
+    if (slots[i].used &&
+        (tightest < 0 || slots[i].min_free < slots[tightest].min_free)) {
+      tightest = i;
+    }
+  }
+  portENTER_CRITICAL(&arena_mux);
+  out->jobs_submitted = jobs_submitted;
+  out->jobs_dropped = jobs_dropped;
+  if (tightest >= 0) {
+    strncpy(out->tightest, slot_defs[tightest].name,
+            sizeof(out->tightest) - 1);
+    out->tightest_free = slots[tightest].min_free;
+  }
+  portEXIT_CRITICAL(&arena_mux);
+}
+
+size_t task_arena_format(char *buf, size_t len) {
+  if (!buf || len == 0) {
+    return 0;
+  }
+  task_arena_stats_t st;
+  task_arena_get_stats(&st);
+  int w = snprintf(buf, len,
+                   "internal %.1f/%.0fk, psram %.1f/%.0fk, tightest %s %.1fk "
+                   "free, jobs %u (%u dropped)",
+                   st.internal_bytes / 1024.0, st.internal_budget / 1024.0,
+                   st.psram_bytes / 1024.0, st.psram_budget / 1024.0,
+                   st.tightest[0] ? st.tightest : "-",
+                   st.tightest_free / 1024.0, (unsigned)st.jobs_submitted,
+                   (unsigned)st.jobs_dropped);
+  if (w < 0) {
+    buf[0] = '\0';
+    return 0;
+  }
+  return (size_t)w < len ? (size_t)w : len - 1;
+}
+
+static const char *slot_state(int slot) {
+  const slot_t *s = &slots[slot];
+  if (!s->used) {
+    return "unused";
+  }
+  if (is_job_slot(slot)) {
+    return "worker";
+  }
+  if (!s->handle) {
+    return "idle";
+  }
+  return s->parked ? "parked" : "running";
+}
+
+void task_arena_log_report(void) {
+  task_arena_stats_t st;
+  task_arena_get_stats(&st);
+  ESP_LOGI(TAG,
+           "Task arena: internal %u of %u bytes (%u spare), PSRAM %u of %u "
+           "(%u spare); internal heap after it %u",
+           (unsigned)st.internal_bytes, (unsigned)st.internal_budget,
+           (unsigned)(st.internal_budget - st.internal_bytes),
+           (unsigned)st.psram_bytes, (unsigned)st.psram_budget,
+           (unsigned)(st.psram_budget - st.psram_bytes),
+           (unsigned)st.heap_free_after);
+  if (!internal_stacks) {
+    return;
+  }
+  for (int i = 0; i < TASK_SLOT_COUNT; i++) {
+    const slot_t *s = &slots[i];
+    char free_str[16] = "-";
+    if (s->used) {
+      snprintf(free_str, sizeof(free_str), "%u", (unsigned)s->min_free);
+    }
+    ESP_LOGI(TAG, "  %-16s %-8s %6u stack, %6s min free, %u starts, %s",
+             slot_defs[i].name, slot_defs[i].psram ? "psram" : "internal",
+             (unsigned)slot_defs[i].size, free_str, (unsigned)s->starts,
+             slot_state(i));
+  }
+}
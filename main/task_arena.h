@@ -0,0 +1,135 @@
+/**
+ * @file task_arena.h
+ * @brief Task stacks reserved at boot, plus a shared pool for short jobs
+ *
+ * Tasks that are started and stopped while the device runs (capture,
+ * playback, OTA, music) used to allocate their stacks at that moment; once
+ * the heap is fragmented that can fail in the middle of a session. Every
+ * such task now has a slot in a table with its stack size and memory, and
+ * task_arena_init() reserves all of them in one block per memory kind
+ * during boot. The table is checked against a budget at compile time; if
+ * the reservation itself fails the device does not boot half-working.
+ *
+ * A slot holds one task at a time. A task in a slot ends with
+ * task_arena_exit() instead of vTaskDelete(NULL): it parks, and the next
+ * start of the slot deletes it and reuses the memory.
+ *
+ * One-shot work that used to get its own xTaskCreate() runs as a job on a
+ * worker whose stack is in the arena too. Network setup (post-connect, HA
+ * reconnect, Wi-Fi fallback) can block for seconds and goes to a small
+ * shared pool; what the user is waiting on (music control, restart) has a
+ * worker of its own, so it never queues behind those.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "worker_pool.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  // Internal RAM
+  TASK_SLOT_AFE_FEED = 0,
+  TASK_SLOT_AFE_FETCH,
+  TASK_SLOT_TTS_PLAYBACK,
+  TASK_SLOT_MUSIC_PLAY,
+  TASK_SLOT_MUSIC_PREFETCH,
+  TASK_SLOT_SD_READER,
+  TASK_SLOT_MUSIC_CACHE,
+  TASK_SLOT_OTA,
+  TASK_SLOT_JOBS0,
+  TASK_SLOT_JOBS1,
+  TASK_SLOT_CONTROL,
+  // PSRAM
+  TASK_SLOT_VOICE_PIPELINE,
+  TASK_SLOT_EVENT_BUS,
+  TASK_SLOT_COUNT
+} task_slot_t;
+
+typedef struct {
+  uint32_t internal_bytes; ///< Reserved stacks + TCBs
+  uint32_t internal_budget;
+  uint32_t psram_bytes;
+  uint32_t psram_budget;
+  uint32_t heap_free_after; ///< Internal heap free right after reserving
+  char tightest[16];        ///< Slot with the least stack left, "" if none ran
+  uint32_t tightest_free;   ///< Its lowest free stack, bytes
+  uint32_t jobs_submitted; ///< Both job queues
+  uint32_t jobs_dropped;   ///< Job queue full
+} task_arena_stats_t;
+
+/**
+ * @brief Reserve every slot and start the job workers
+ *
+ * Call once, early in app_main().
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the arena does not fit
+ */
+esp_err_t task_arena_init(void);
+
+/**
+ * @brief Start a task in its slot
+ *
+ * A previous occupant that called task_arena_exit() is deleted first; one
+ * still running gets a short grace period to get there.
+ *
+ * @param core Core to pin to, or tskNO_AFFINITY
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the slot is still busy
+ */
+esp_err_t task_arena_start(task_slot_t slot, TaskFunction_t fn, void *arg,
+                           UBaseType_t priority, BaseType_t core,
+                           TaskHandle_t *out);
+
+/**
+ * @brief End the calling task; replaces vTaskDelete(NULL) in slot tasks
+ */
+void task_arena_exit(task_slot_t slot) __attribute__((noreturn));
+
+/**
+ * @brief Delete the task in a slot from outside (not from the task itself)
+ */
+void task_arena_stop(task_slot_t slot);
+
+/**
+ * @brief Run fn(arg) on the shared job workers; does not wait for room
+ *
+ * For network work that may block for seconds.
+ *
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the queue is full
+ */
+esp_err_t task_arena_submit_job(worker_job_fn_t fn, void *arg);
+
+/**
+ * @brief Run fn(arg) on the control worker; does not wait for room
+ *
+ * For short jobs a user is waiting on. Jobs run one at a time in order, so
+ * nothing that waits on the network belongs here.
+ *
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the queue is full
+ */
+esp_err_t task_arena_submit_control(worker_job_fn_t fn, void *arg);
+
+void task_arena_get_stats(task_arena_stats_t *out);
+
+/**
+ * @brief One-line summary for MQTT (fits the HA state limit)
+ *
+ * @return Characters written (without the terminator)
+ */
+size_t task_arena_format(char *buf, size_t len);
+
+/**
+ * @brief Log the budget, headroom and every slot
+ */
+void task_arena_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
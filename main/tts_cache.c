@@ -0,0 +1,329 @@
+/**
+ * @file tts_cache.c
+ * @brief TTS answer cache implementation
+ *
+ * Entry metadata is guarded by cache_lock. The data of an entry is
+ * immutable and pinned by its reference count while it plays, so playback
+ * reads it without the lock. SD files are named after the key, so a
+ * lookup needs no index on the card.
+ */
+
+#include "tts_cache.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "mem_place.h"
+#include "mem_track.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "tts_cache";
+
+#define FNV64_OFFSET 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+#define WRITER_INITIAL_BYTES (16 * 1024)
+
+typedef struct {
+  uint64_t key;
+  uint8_t *data; // NULL: slot free
+  size_t size;
+  int refs; // Playbacks in progress
+  uint32_t last_used;
+} cache_entry_t;
+
+struct tts_cache_writer {
+  uint64_t key;
+  uint8_t *data;
+  size_t size;
+  size_t cap;
+  bool overflow;
+};
+
+static SemaphoreHandle_t cache_lock = NULL;
+static cache_entry_t entries[TTS_CACHE_MAX_ENTRIES];
+static uint32_t use_clock = 0;
+static bool spill_enabled = false;
+static tts_cache_stats_t stats;
+
+static void sd_path(uint64_t key, char *out, size_t out_len) {
+  snprintf(out, out_len, TTS_CACHE_SD_DIR "/%016" PRIx64 ".mp3", key);
+}
+
+/* ---------- Entries (caller holds cache_lock) ---------- */
+
+static cache_entry_t *find_entry(uint64_t key) {
+  for (int i = 0; i < TTS_CACHE_MAX_ENTRIES; i++) {
+    if (entries[i].data && entries[i].key == key) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static void drop_entry(cache_entry_t *e) {
+  stats.bytes_used -= e->size;
+  stats.entries--;
+  mem_track_free(MEM_MOD_TTS_CACHE, e->data);
+  memset(e, 0, sizeof(*e));
+}
+
+/**
+ * @brief Free slot with room for size bytes, evicting unpinned LRU entries
+ *
+ * @return Slot, or NULL if pinned entries hold the space
+ */
+static cache_entry_t *make_room(size_t size) {
+  while (1) {
+    cache_entry_t *free_slot = NULL;
+    cache_entry_t *lru = NULL;
+    for (int i = 0; i < TTS_CACHE_MAX_ENTRIES; i++) {
+      cache_entry_t *e = &entries[i];
+      if (!e->data) {
+        if (!free_slot)
+          free_slot = e;
+      } else if (e->refs == 0 && (!lru || e->last_used < lru->last_used)) {
+        lru = e;
+      }
+    }
+    if (free_slot && stats.bytes_used + size <= TTS_CACHE_MAX_BYTES) {
+      return free_slot;
+    }
+    if (!lru) {
+      return NULL;
+    }
+    drop_entry(lru);
+    stats.evictions++;
+  }
+}
+
+static cache_entry_t *insert_entry(uint64_t key, uint8_t *data, size_t size) {
+  cache_entry_t *e = make_room(size);
+  if (!e) {
+    return NULL;
+  }
+  e->key = key;
+  e->data = data;
+  e->size = size;
+  e->refs = 0;
+  e->last_used = ++use_clock;
+  stats.bytes_used += size;
+  stats.entries++;
+  stats.inserts++;
+  return e;
+}
+
+/**
+ * @brief Load an answer from the card into PSRAM
+ */
+static cache_entry_t *load_from_sd(uint64_t key) {
+  char path[64];
+  sd_path(key, path, sizeof(path));
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  cache_entry_t *e = NULL;
+  struct stat st;
+  if (fstat(fileno(f), &st) == 0 && st.st_size > 0 &&
+      st.st_size <= TTS_CACHE_ENTRY_MAX_BYTES) {
+    uint8_t *data = mem_place_alloc(MEM_MOD_TTS_CACHE, MEM_PLACE_COLD,
+                                    (size_t)st.st_size);
+    if (data && fread(data, 1, (size_t)st.st_size, f) == (size_t)st.st_size) {
+      e = insert_entry(key, data, (size_t)st.st_size);
+    }
+    if (!e) {
+      mem_track_free(MEM_MOD_TTS_CACHE, data);
+    }
+  }
+  fclose(f);
+  return e;
+}
+
+static void save_to_sd(uint64_t key, const uint8_t *data, size_t size) {
+  if (mkdir(TTS_CACHE_SD_DIR, 0775) != 0 && errno != EEXIST) {
+    ESP_LOGW(TAG, "Cannot create %s", TTS_CACHE_SD_DIR);
+    return;
+  }
+  char path[64];
+  sd_path(key, path, sizeof(path));
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return;
+  }
+  bool ok = fwrite(data, 1, size, f) == size;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) {
+    remove(path); // Never leave a truncated answer behind
+  }
+}
+
+/* ---------- API ---------- */
+
+esp_err_t tts_cache_init(void) {
+  if (cache_lock) {
+    return ESP_OK;
+  }
+  cache_lock = xSemaphoreCreateMutex();
+  return cache_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+uint64_t tts_cache_key(const char *text, const char *voice) {
+  uint64_t h = FNV64_OFFSET;
+  for (const char *p = text ? text : ""; *p; p++) {
+    h = (h ^ (uint8_t)*p) * FNV64_PRIME;
+  }
+  h = (h ^ 0xff) * FNV64_PRIME; // Separator: "ab"+"c" != "a"+"bc"
+  for (const char *p = voice ? voice : ""; *p; p++) {
+    h = (h ^ (uint8_t)*p) * FNV64_PRIME;
+  }
+  return h;
+}
+
+bool tts_cache_acquire(uint64_t key, const uint8_t **data, size_t *size) {
+  if (!cache_lock || !data || !size) {
+    return false;
+  }
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  stats.lookups++;
+  cache_entry_t *e = find_entry(key);
+  if (!e && spill_enabled) {
+    e = load_from_sd(key);
+    if (e) {
+      stats.sd_hits++;
+    }
+  }
+  if (e) {
+    e->refs++;
+    e->last_used = ++use_clock;
+    stats.hits++;
+    stats.bytes_saved += e->size;
+    *data = e->data;
+    *size = e->size;
+  }
+  xSemaphoreGive(cache_lock);
+  return e != NULL;
+}
+
+void tts_cache_release(uint64_t key) {
+  if (!cache_lock) {
+    return;
+  }
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  cache_entry_t *e = find_entry(key);
+  if (e && e->refs > 0) {
+    e->refs--;
+  }
+  xSemaphoreGive(cache_lock);
+}
+
+tts_cache_writer_t *tts_cache_begin(uint64_t key) {
+  if (!cache_lock) {
+    return NULL;
+  }
+  tts_cache_writer_t *w = calloc(1, sizeof(*w));
+  if (!w) {
+    return NULL;
+  }
+  w->key = key;
+  return w;
+}
+
+void tts_cache_append(tts_cache_writer_t *w, const uint8_t *data,
+                      size_t size) {
+  if (!w || w->overflow || !data || size == 0) {
+    return;
+  }
+  if (w->size + size > TTS_CACHE_ENTRY_MAX_BYTES) {
+    w->overflow = true;
+    mem_track_free(MEM_MOD_TTS_CACHE, w->data);
+    w->data = NULL;
+    return;
+  }
+  if (w->size + size > w->cap) {
+    size_t cap = w->cap ? w->cap : WRITER_INITIAL_BYTES;
+    while (cap < w->size + size) {
+      cap *= 2;
+    }
+    if (cap > TTS_CACHE_ENTRY_MAX_BYTES) {
+      cap = TTS_CACHE_ENTRY_MAX_BYTES;
+    }
+    uint8_t *grown = mem_track_realloc(MEM_MOD_TTS_CACHE, w->data, cap,
+                                       MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+      w->overflow = true; // Out of PSRAM: not cached
+      mem_track_free(MEM_MOD_TTS_CACHE, w->data);
+      w->data = NULL;
+      return;
+    }
+    w->data = grown;
+    w->cap = cap;
+  }
+  memcpy(w->data + w->size, data, size);
+  w->size += size;
+}
+
+void tts_cache_commit(tts_cache_writer_t *w, bool complete) {
+  if (!w) {
+    return;
+  }
+  if (!complete || w->overflow || w->size == 0) {
+    mem_track_free(MEM_MOD_TTS_CACHE, w->data);
+    free(w);
+    return;
+  }
+
+  // Give back the unused tail of the growth buffer
+  uint8_t *data = mem_track_realloc(MEM_MOD_TTS_CACHE, w->data, w->size,
+                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!data) {
+    data = w->data;
+  }
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  cache_entry_t *e = find_entry(w->key);
+  if (e) {
+    // Cached meanwhile (same answer twice)
+    mem_track_free(MEM_MOD_TTS_CACHE, data);
+  } else if ((e = insert_entry(w->key, data, w->size)) == NULL) {
+    mem_track_free(MEM_MOD_TTS_CACHE, data);
+  } else if (spill_enabled) {
+    // Entry data is immutable, but the lock keeps the card from being
+    // released mid-write
+    save_to_sd(w->key, e->data, e->size);
+  }
+  if (e) {
+    ESP_LOGI(TAG, "Cached answer %016" PRIx64 " (%u B, %u entries, %u KB)",
+             w->key, (unsigned)w->size, (unsigned)stats.entries,
+             (unsigned)(stats.bytes_used / 1024));
+  }
+  xSemaphoreGive(cache_lock);
+  free(w);
+}
+
+void tts_cache_set_spill(bool enable) {
+  if (!cache_lock) {
+    spill_enabled = enable; // Card mounted before init, nothing to race
+    return;
+  }
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  spill_enabled = enable;
+  xSemaphoreGive(cache_lock);
+}
+
+void tts_cache_get_stats(tts_cache_stats_t *out) {
+  if (!out) {
+    return;
+  }
+  if (!cache_lock) {
+    memset(out, 0, sizeof(*out));
+    return;
+  }
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  *out = stats;
+  xSemaphoreGive(cache_lock);
+}
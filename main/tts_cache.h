@@ -0,0 +1,117 @@
+/**
+ * @file tts_cache.h
+ * @brief Cache of TTS answers, keyed by the response text
+ *
+ * Many answers repeat word for word ("Turned on the light", error
+ * messages). Their audio, as downloaded from HA (MP3), is kept in PSRAM
+ * under a 64-bit FNV-1a hash of the text and the voice (TTS engine,
+ * language and voice, as HA reports them in tts-start). A repeated answer
+ * plays straight from the cache, without waiting for HA to synthesise and
+ * serve it.
+ *
+ * Entries are evicted least recently used first; an entry being played is
+ * never evicted. While the SD card is mounted, new entries are also written
+ * to TTS_CACHE_SD_DIR, and a PSRAM miss is looked up there, so the cache
+ * survives a reboot.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TTS_CACHE_MAX_ENTRIES 32               ///< Answers kept in PSRAM
+#define TTS_CACHE_MAX_BYTES (1024 * 1024)      ///< PSRAM budget
+#define TTS_CACHE_ENTRY_MAX_BYTES (192 * 1024) ///< Longer answers not cached
+#define TTS_CACHE_SD_DIR "/sdcard/tts_cache"
+
+/**
+ * @brief Cache statistics since boot
+ */
+typedef struct {
+  uint32_t lookups;
+  uint32_t hits;    ///< From PSRAM or the card
+  uint32_t sd_hits; ///< Of those, loaded from the card
+  uint32_t inserts;
+  uint32_t evictions;
+  uint64_t bytes_saved; ///< Audio not downloaded thanks to hits
+  uint32_t bytes_used;  ///< PSRAM held by entries
+  uint32_t entries;
+} tts_cache_stats_t;
+
+typedef struct tts_cache_writer tts_cache_writer_t;
+
+/**
+ * @brief Create the cache lock (idempotent)
+ *
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+esp_err_t tts_cache_init(void);
+
+/**
+ * @brief Key of an answer
+ *
+ * @param text Response text, verbatim
+ * @param voice What else changes the audio (engine|language|voice), may
+ *              be NULL
+ */
+uint64_t tts_cache_key(const char *text, const char *voice);
+
+/**
+ * @brief Find an answer and pin it for playback
+ *
+ * @param data Audio (MP3), valid until tts_cache_release()
+ * @param size Audio size in bytes
+ * @return true on a hit
+ */
+bool tts_cache_acquire(uint64_t key, const uint8_t **data, size_t *size);
+
+/**
+ * @brief Unpin an entry from tts_cache_acquire()
+ */
+void tts_cache_release(uint64_t key);
+
+/**
+ * @brief Start recording a downloaded answer
+ *
+ * @return Writer, or NULL if the cache is not initialised or out of memory
+ */
+tts_cache_writer_t *tts_cache_begin(uint64_t key);
+
+/**
+ * @brief Add downloaded audio; an answer over TTS_CACHE_ENTRY_MAX_BYTES is
+ * dropped at commit
+ */
+void tts_cache_append(tts_cache_writer_t *writer, const uint8_t *data,
+                      size_t size);
+
+/**
+ * @brief Finish recording: insert the answer, or discard it
+ *
+ * Frees the writer in both cases. Writes the SD copy if spilling is on.
+ *
+ * @param complete The download succeeded
+ */
+void tts_cache_commit(tts_cache_writer_t *writer, bool complete);
+
+/**
+ * @brief Use the SD card as a second level (call before unmounting)
+ *
+ * Blocks until a running SD write has finished.
+ */
+void tts_cache_set_spill(bool enable);
+
+/**
+ * @brief Get cache statistics
+ */
+void tts_cache_get_stats(tts_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
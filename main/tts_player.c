@@ -1,24 +1,43 @@
 /**
  * TTS Audio Player Implementation
+ *
+ * While local music is playing, TTS is not written to I2S directly: it is
+ * resampled to the music's format and mixed into the (ducked) music stream,
+ * so the codec is never reconfigured and the music never stops. The music
+ * task owns the codec for as long as music plays; if the mix cannot be kept
+ * up, the music is paused for the rest of the answer rather than written to
+ * from two tasks.
  */
 
 #include "tts_player.h"
 #include "audio_capture.h"
+#include "audio_mix.h"
+#include "audio_rt_monitor.h"
 #include "audio_player.h"
 #include "bsp_board_extra.h"
 #include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "local_music_player.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "mp3dec.h"
+#include "task_arena.h"
 #include <string.h>
 
 static const char *TAG = "tts_player";
 
 #define TTS_BUFFER_SIZE (128 * 1024) // 128KB buffer for audio chunks
 #define TTS_QUEUE_SIZE 10
-#define PCM_BUFFER_SIZE (MAX_NCHAN * MAX_NSAMP * 2) // Max PCM output per frame
+// Max PCM output per frame: MPEG1 stereo decodes 2 granules of 576 x 2 ch
+#define PCM_BUFFER_SIZE (MAX_NGRAN * MAX_NCHAN * MAX_NSAMP * sizeof(int16_t))
+#define MIX_WRITE_TIMEOUT_MS 1000
+// How long a playing track may keep the mixer unavailable (track change,
+// format switch) before the answer pauses the music instead
+#define MIX_ATTACH_TIMEOUT_MS 500
 
 typedef struct {
   uint8_t *data;
@@ -32,10 +51,15 @@ static bool is_playing = false;
 // MP3 decoder instance
 static HMP3Decoder mp3_decoder = NULL;
 
-// Simple audio buffer for accumulating chunks
+// Simple audio buffer for accumulating chunks (PSRAM, written once, read once)
 static uint8_t *tts_buffer = NULL;
 static size_t tts_buffer_pos = 0;
 
+// Per-frame buffers, internal RAM: decoded frame, resampled frame for the mixer
+static int16_t *pcm_buffer = NULL;
+static int16_t *mix_buffer = NULL;
+static size_t mix_buffer_samples = 0;
+
 // Playback completion callback
 static tts_playback_complete_callback_t playback_complete_callback = NULL;
 
@@ -54,12 +78,78 @@ static void tts_queue_stop_signal(void) {
   }
 }
 
+/**
+ * Try to hand playback to the music player's mixer
+ *
+ * @return Buffer for resampled PCM, or NULL to play through I2S directly
+ */
+static int16_t *mix_begin(const MP3FrameInfo *info, audio_resampler_t *rs,
+                          int *mix_channels) {
+  uint32_t rate;
+  if (local_music_player_mix_begin(&rate, mix_channels) != ESP_OK) {
+    return NULL;
+  }
+  audio_resampler_init(rs, info->samprate, info->nChans, rate, *mix_channels);
+  size_t frames = audio_resampler_max_out(rs, MAX_NGRAN * MAX_NSAMP);
+  size_t samples = frames * *mix_channels;
+  // Kept between answers; only a higher rate ratio than before reallocates
+  if (samples > mix_buffer_samples) {
+    mem_track_free(MEM_MOD_TTS, mix_buffer);
+    mix_buffer_samples = 0;
+    mix_buffer = mem_place_alloc(MEM_MOD_TTS, MEM_PLACE_HOT,
+                                 samples * sizeof(int16_t));
+    if (mix_buffer == NULL) {
+      local_music_player_mix_end();
+      return NULL;
+    }
+    mix_buffer_samples = samples;
+  }
+  ESP_LOGI(TAG, "Mixing TTS into music: %d Hz %d ch -> %u Hz %d ch",
+           info->samprate, info->nChans, (unsigned)rate, *mix_channels);
+  return mix_buffer;
+}
+
+/**
+ * Keep the answer in the mixer while music plays
+ *
+ * (Re)starts the mix at the music's current format, waiting out a track
+ * change or format switch. Music that stays playing without a mix is paused
+ * (the pause returns once the music task has stopped writing), so the caller
+ * can own the codec.
+ *
+ * @param paused_music Set when the music was paused here
+ * @return Buffer for resampled PCM, or NULL if the codec is free to use
+ */
+static int16_t *mix_attach(const MP3FrameInfo *info, audio_resampler_t *rs,
+                           int *mix_channels, bool *paused_music) {
+  int waited_ms = 0;
+  while (local_music_player_get_state() == MUSIC_STATE_PLAYING) {
+    int16_t *buf = mix_begin(info, rs, mix_channels);
+    if (buf) {
+      return buf;
+    }
+    if (waited_ms >= MIX_ATTACH_TIMEOUT_MS) {
+      ESP_LOGW(TAG, "Music mixer unavailable, pausing music for TTS");
+      *paused_music = local_music_player_pause() == ESP_OK;
+      break;
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+    waited_ms += 10;
+  }
+  return NULL;
+}
+
 /**
  * Decode and play MP3 audio buffer
  */
 static esp_err_t play_mp3_buffer(uint8_t *mp3_data, size_t mp3_size) {
   esp_err_t overall_ret = ESP_OK;
-  int16_t *pcm_buffer = NULL;
+
+  // Mixing into playing music instead of owning the codec
+  audio_resampler_t resampler;
+  int16_t *mix_pcm = NULL;
+  int mix_channels = 0;
+  bool paused_music = false;
 
   if (mp3_decoder == NULL) {
     ESP_LOGE(TAG, "MP3 decoder not initialized");
@@ -78,14 +168,6 @@ static esp_err_t play_mp3_buffer(uint8_t *mp3_data, size_t mp3_size) {
   static bool codec_configured_flag = false;
   codec_configured_flag = false;
 
-  // PCM output buffer
-  pcm_buffer = (int16_t *)malloc(PCM_BUFFER_SIZE);
-  if (pcm_buffer == NULL) {
-    ESP_LOGE(TAG, "Failed to allocate PCM buffer");
-    overall_ret = ESP_ERR_NO_MEM;
-    goto out;
-  }
-
   uint8_t *read_ptr = mp3_data;
   int bytes_left = mp3_size;
   int total_samples = 0;
@@ -113,6 +195,31 @@ static esp_err_t play_mp3_buffer(uint8_t *mp3_data, size_t mp3_size) {
       ESP_LOGD(TAG, "Decoded frame: %d Hz, %d ch, %d samples",
                frame_info.samprate, frame_info.nChans, frame_info.outputSamps);
 
+      // Music playing: mix into it at its rate, leaving the codec alone
+      if (!codec_configured_flag && !mix_pcm) {
+        mix_pcm = mix_attach(&frame_info, &resampler, &mix_channels,
+                             &paused_music);
+      }
+      while (mix_pcm) {
+        size_t frames = audio_resampler_process(
+            &resampler, pcm_buffer, frame_info.outputSamps / frame_info.nChans,
+            mix_pcm);
+        if (local_music_player_mix_write(mix_pcm, frames * mix_channels,
+                                         MIX_WRITE_TIMEOUT_MS) == ESP_OK) {
+          break;
+        }
+        // Music changed format or stalled: convert this frame again for
+        // whatever is playing now; the codec stays the music task's
+        ESP_LOGW(TAG, "Music mixer ended, reattaching");
+        local_music_player_mix_end();
+        mix_pcm = mix_attach(&frame_info, &resampler, &mix_channels,
+                             &paused_music);
+      }
+      if (mix_pcm) {
+        total_samples += frame_info.outputSamps;
+        continue;
+      }
+
       // Configure I2S for this sample rate on first frame
       // Always reconfigure to handle cases where beep tone changed codec
       // settings
@@ -123,18 +230,23 @@ static esp_err_t play_mp3_buffer(uint8_t *mp3_data, size_t mp3_size) {
         // This is critical after beep tone which uses 16kHz MONO
         bsp_extra_codec_set_fs(frame_info.samprate, 16,
                                (i2s_slot_mode_t)frame_info.nChans);
-        codec_configured_flag = true;
       }
+      codec_configured_flag = true;
 
       // Write PCM data to I2S
       size_t pcm_bytes = frame_info.outputSamps * sizeof(int16_t);
       size_t bytes_written = 0;
+      audio_rt_cycle(AUDIO_RT_WRITE,
+                     (uint32_t)((int64_t)frame_info.outputSamps /
+                                frame_info.nChans * 1000000 /
+                                frame_info.samprate));
       // timeout_ms: 0 means block indefinitely
       esp_err_t ret =
           bsp_extra_i2s_write(pcm_buffer, pcm_bytes, &bytes_written, 0);
 
       if (ret != ESP_OK) {
         ESP_LOGE(TAG, "I2S write failed: %s", esp_err_to_name(ret));
+        audio_rt_error(AUDIO_RT_WRITE);
         overall_ret = ret;
         goto out;
       }
@@ -157,8 +269,12 @@ static esp_err_t play_mp3_buffer(uint8_t *mp3_data, size_t mp3_size) {
   ESP_LOGI(TAG, "Playback complete: %d samples", total_samples);
 
 out:
-  if (pcm_buffer) {
-    free(pcm_buffer);
+  if (mix_pcm) {
+    // Returns once the music task has played the queued TTS
+    local_music_player_mix_end();
+  }
+  if (paused_music) {
+    local_music_player_resume();
   }
 
   // Always signal completion so the assistant can resume listening even on
@@ -224,7 +340,7 @@ static void playback_task(void *arg) {
       }
 
       // Free chunk data
-      free(chunk.data);
+      mem_track_free(MEM_MOD_TTS, chunk.data);
     }
   }
 }
@@ -239,10 +355,15 @@ esp_err_t tts_player_init(void) {
     return ESP_ERR_NO_MEM;
   }
 
-  // Allocate audio buffer
-  tts_buffer = (uint8_t *)malloc(TTS_BUFFER_SIZE);
-  if (tts_buffer == NULL) {
-    ESP_LOGE(TAG, "Failed to allocate TTS buffer");
+  // Allocate audio buffers
+  tts_buffer = mem_place_alloc(MEM_MOD_TTS, MEM_PLACE_COLD, TTS_BUFFER_SIZE);
+  pcm_buffer = mem_place_alloc(MEM_MOD_TTS, MEM_PLACE_HOT, PCM_BUFFER_SIZE);
+  if (tts_buffer == NULL || pcm_buffer == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate TTS buffers");
+    mem_track_free(MEM_MOD_TTS, tts_buffer);
+    mem_track_free(MEM_MOD_TTS, pcm_buffer);
+    tts_buffer = NULL;
+    pcm_buffer = NULL;
     MP3FreeDecoder(mp3_decoder);
     return ESP_ERR_NO_MEM;
   }
@@ -252,18 +373,23 @@ esp_err_t tts_player_init(void) {
   audio_queue = xQueueCreate(TTS_QUEUE_SIZE, sizeof(audio_chunk_t));
   if (audio_queue == NULL) {
     ESP_LOGE(TAG, "Failed to create audio queue");
-    free(tts_buffer);
+    mem_track_free(MEM_MOD_TTS, tts_buffer);
+    mem_track_free(MEM_MOD_TTS, pcm_buffer);
+    tts_buffer = NULL;
+    pcm_buffer = NULL;
     MP3FreeDecoder(mp3_decoder);
     return ESP_ERR_NO_MEM;
   }
 
   // Create playback task
-  BaseType_t ret = xTaskCreate(playback_task, "tts_playback", 8192, NULL, 5,
-                               &playback_task_handle);
-  if (ret != pdPASS) {
+  if (task_arena_start(TASK_SLOT_TTS_PLAYBACK, playback_task, NULL, 5,
+                       tskNO_AFFINITY, &playback_task_handle) != ESP_OK) {
     ESP_LOGE(TAG, "Failed to create playback task");
     vQueueDelete(audio_queue);
-    free(tts_buffer);
+    mem_track_free(MEM_MOD_TTS, tts_buffer);
+    mem_track_free(MEM_MOD_TTS, pcm_buffer);
+    tts_buffer = NULL;
+    pcm_buffer = NULL;
     MP3FreeDecoder(mp3_decoder);
     return ESP_FAIL;
   }
@@ -286,7 +412,7 @@ esp_err_t tts_player_feed(const uint8_t *audio_data, size_t length) {
   }
 
   // Allocate chunk and copy data
-  uint8_t *chunk_data = (uint8_t *)malloc(length);
+  uint8_t *chunk_data = (uint8_t *)mem_track_malloc(MEM_MOD_TTS, length, 0);
   if (chunk_data == NULL) {
     ESP_LOGE(TAG, "Failed to allocate chunk memory");
     return ESP_ERR_NO_MEM;
@@ -298,7 +424,7 @@ esp_err_t tts_player_feed(const uint8_t *audio_data, size_t length) {
 
   if (xQueueSend(audio_queue, &chunk, pdMS_TO_TICKS(100)) != pdTRUE) {
     ESP_LOGW(TAG, "Audio queue full, dropping chunk");
-    free(chunk_data);
+    mem_track_free(MEM_MOD_TTS, chunk_data);
     return ESP_FAIL;
   }
 
@@ -325,7 +451,7 @@ void tts_player_deinit(void) {
   tts_player_stop();
 
   if (playback_task_handle != NULL) {
-    vTaskDelete(playback_task_handle);
+    task_arena_stop(TASK_SLOT_TTS_PLAYBACK);
     playback_task_handle = NULL;
   }
 
@@ -335,9 +461,14 @@ void tts_player_deinit(void) {
   }
 
   if (tts_buffer != NULL) {
-    free(tts_buffer);
+    mem_track_free(MEM_MOD_TTS, tts_buffer);
     tts_buffer = NULL;
   }
+  mem_track_free(MEM_MOD_TTS, pcm_buffer);
+  pcm_buffer = NULL;
+  mem_track_free(MEM_MOD_TTS, mix_buffer);
+  mix_buffer = NULL;
+  mix_buffer_samples = 0;
 
   if (mp3_decoder != NULL) {
     MP3FreeDecoder(mp3_decoder);
@@ -2,34 +2,66 @@
 #include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
 #include "va_control.h"
-#include <ctype.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "alarm_manager.h"
 #include "audio_capture.h"
 #include "beep_tone.h"
 #include "bsp_board_extra.h"
 #include "cJSON.h"
+#include "duration_parse.h"
+#include "event_bus.h"
 #include "ha_client.h"
 #include "led_status.h"
+#include "local_intent.h"
 #include "local_music_player.h"
+#include "local_tts.h"
+#include "mem_track.h"
+#include "mn_commands.h"
 #include "mqtt_ha.h"
 #include "oled_status.h"
+#include "pipeline_fsm.h"
 #include "ota_update.h"
+#include "settings_manager.h"
 #include "sys_diag.h"
+#include "task_arena.h"
 #include "timer_manager.h"
 #include "tts_player.h"
 #include "wake_prompt.h"
 
 #define TAG "voice_pipeline"
 #define FOLLOWUP_RECORDING_MS 7000
+#define ERROR_RESUME_DELAY_MS 2000
+#define INTENTS_FILE_MAX 16384
+#define VOLUME_STEP 10
+#define WAKE_HOLD_AFTER_TTS_MS 1000 // Wake words ignored after an answer
+#define HA_CONNECT_WAIT_MS 3000     // Reconnect before opening a run
+#define HA_RUN_RETRY_DELAY_MS 200
+
+// Offline command window: MultiNet listens right after wake without an HA
+// run; the audio is buffered meanwhile and replayed into a late HA run if
+// no command was recognised
+#define COMMAND_WINDOW_MS 2500
+#define COMMAND_AUDIO_READY_MS 2000
+// Live audio keeps landing in the buffer while the fallback waits for HA,
+// so it holds the window plus the longest wait for the run
+#define COMMAND_PREBUFFER_MS                                                   \
+  (COMMAND_WINDOW_MS + HA_CONNECT_WAIT_MS + HA_RUN_RETRY_DELAY_MS +            \
+   COMMAND_AUDIO_READY_MS)
+#define COMMAND_PREBUFFER_BYTES (COMMAND_PREBUFFER_MS * 16 * 2) // 16 kHz mono
+#define COMMAND_FLUSH_CHUNK 1024
 
 // Beep tone parameters (frequency Hz, duration ms, volume 0-100)
 #define BEEP_WAKE_FREQ 800
@@ -45,40 +77,45 @@
 #define BEEP_ERROR_VOLUME 60
 
 // Internal Command Queue
+#define PIPELINE_CMD_QUEUE_LEN 16
 typedef enum {
-  PIPELINE_CMD_WAKE_DETECTED,
+  PIPELINE_CMD_EVENT, // State machine event (data = vp_event_t)
   PIPELINE_CMD_OFFLINE_CMD,
   PIPELINE_CMD_RESUME_WWD,
   PIPELINE_CMD_STOP_WWD,
   PIPELINE_CMD_RESTART_WWD,
-  PIPELINE_CMD_START_FOLLOWUP_VAD,
-  PIPELINE_CMD_ERROR_RESUME,
-  PIPELINE_CMD_TIMER_BEEP,
-  PIPELINE_CMD_ALARM_BEEP,
   PIPELINE_CMD_CONFIRM_BEEP,
-  PIPELINE_CMD_ERROR_BEEP,
-  PIPELINE_CMD_MUSIC_CONTROL
+  PIPELINE_CMD_MUSIC_CONTROL,
+  PIPELINE_CMD_LOCAL_INTENT, // Run local_intent_match, then HANDLED
+  PIPELINE_CMD_COMMAND_FALLBACK, // No offline command: open the HA run
+                                 // (data = speech already ended)
+  PIPELINE_CMD_FOLLOWUP_PREPARE  // HA run ended, answer still playing: open
+                                 // the follow-up run early
 } pipeline_cmd_type_t;
 
 typedef struct {
   pipeline_cmd_type_t type;
   int data;
+  int arg;
+  int64_t posted_us;
 } pipeline_cmd_t;
 
 static QueueHandle_t pipeline_cmd_queue = NULL;
 static TaskHandle_t pipeline_task_handle = NULL;
 
-// PSRAM stack for pipeline_task (saves ~12KB internal RAM)
-#define PIPELINE_TASK_STACK_SIZE 12288
-static StackType_t *pipeline_task_stack = NULL;
-static StaticTask_t pipeline_task_tcb;
-
-// State variables
+// Conversation state: owned by pipeline_task and only changed through the
+// transition table in pipeline_fsm.c. Other tasks post events.
+static vp_fsm_t fsm;
+// fsm.state as of the last transition, for the bus dispatcher, the AFE
+// fetch task, the HA WebSocket task and the timer service; fsm_mux guards
+// the statistics copy
+static atomic_int fsm_state_published = VP_STATE_IDLE;
+static portMUX_TYPE fsm_mux = portMUX_INITIALIZER_UNLOCKED;
 static bool is_wwd_running = false;
-static bool is_pipeline_active = false;
-static bool wake_detect_pending = false;
-static bool followup_vad_pending = false;
-static bool music_paused_for_tts = false;
+
+// Run context: reset on wake, filled in by the HA/TTS callbacks of one run
+static bool followup_requested = false;
+static bool music_ducked_for_tts = false;
 static bool suppress_tts_audio = false;
 static bool timer_local_handled = false;
 static uint32_t pending_timer_seconds = 0;
@@ -86,10 +123,54 @@ static bool pending_timer_valid = false;
 static char last_stt_text[128];
 static bool timer_started_from_stt = false;
 static uint8_t last_timer_id = 0;
+static bool local_intent_handled = false;
+static local_intent_match_t local_intent_match;
+static char local_intent_service[48];
+static char local_intent_target[96];
+static int run_wake_word = 0;
+static volatile bool run_speech_seen = false; // VAD start or offline command
+static bool run_local_only = false; // Wake word routed to offline commands
+static char run_pipeline_id[40];    // HA assist pipeline, "" = preferred
+
+// Per wake word routes (see voice_pipeline_set_wake_route)
+static char wake_routes[AUDIO_CAPTURE_MAX_WAKE_WORDS][40];
+static portMUX_TYPE wake_routes_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Conversation session: wake word plus its follow-ups. HA's
+// conversation_id is carried into each follow-up run; the follow-up run is
+// opened while the answer still plays, capture once it has ended.
+static char session_conversation_id[64];
+static portMUX_TYPE session_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool followup_prepared = false; // Follow-up run already open
+
+// Offline command window
+static bool offline_commands_enabled = false;
+static TimerHandle_t command_window_timer = NULL;
+static uint8_t *command_prebuffer = NULL;
+static size_t command_prebuffer_len = 0;
+static bool command_prebuffer_active = false; // Audio goes to the buffer
+static bool command_prebuffer_overflow = false;
+static portMUX_TYPE command_prebuffer_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// End-to-end latency (wake to result) per path
+static int64_t run_start_us = 0;
+static bool run_result_noted = false;
+static voice_pipeline_run_stats_t run_stats;
+static uint64_t offline_total_ms = 0;
+static uint64_t ha_total_ms = 0;
+
+// Local command grammar; replaced as a whole when loaded from the SD card
+static local_intent_t *intents = NULL;
+static SemaphoreHandle_t intents_mutex = NULL;
+
+// On-device voice for timers and errors; loaded once, kept while the SD card
+// is released
+#define LOCAL_VOICE_CHUNK 256 // Samples rendered per I2S write
+static local_tts_t *volatile local_voice = NULL;
+static volatile bool alarm_from_timer = false; // ALARM raised by a timer
 
 #define HA_RESPONSE_TIMEOUT_MS 45000
 static TimerHandle_t ha_response_timeout_timer = NULL;
-static bool ha_response_waiting = false;
 
 static char *current_pipeline_handler = NULL;
 static int warmup_chunks_skip = 0;
@@ -106,9 +187,15 @@ static voice_pipeline_config_t current_config = {.wwd_threshold = 0.5f,
 
 // Forward decls
 static void pipeline_task(void *arg);
-static void on_wake_word_detected(const int16_t *audio_data, size_t samples);
+static void pipeline_dispatch(vp_event_t event, int arg, int64_t posted_us);
+static void on_wake_word_detected(const int16_t *audio_data, size_t samples,
+                                  int wake_word);
 static void on_offline_cmd_detected(int id, int index);
 static void vad_event_handler(audio_capture_vad_event_t event);
+static void handle_wake_event(const event_bus_event_t *event);
+static void handle_offline_cmd_event(const event_bus_event_t *event);
+static void handle_vad_start_event(const event_bus_event_t *event);
+static void handle_vad_end_event(const event_bus_event_t *event);
 static void audio_capture_handler(const uint8_t *audio_data, size_t length);
 static void stt_text_handler(const char *text, const char *conversation_id);
 static void intent_handler(const char *intent_name, const char *intent_data,
@@ -117,9 +204,10 @@ static void conversation_response_handler(const char *response_text,
                                           const char *conversation_id);
 static esp_err_t start_audio_streaming(uint32_t max_recording_ms,
                                        const char *context_tag);
+static esp_err_t start_capture(void);
 static void tts_audio_handler(const uint8_t *audio_data, size_t length);
 static void on_tts_complete(void);
-static void restart_task(void *arg);
+static void restart_job(void *arg);
 static void handle_local_music_play(void);
 static bool response_requests_music_selection(const char *response_text);
 static bool ascii_substr_case_insensitive(const char *haystack,
@@ -127,6 +215,9 @@ static bool ascii_substr_case_insensitive(const char *haystack,
 static int ascii_tolower_int(int c);
 static void timer_expired_callback(uint8_t timer_id);
 static void local_timer_start(uint32_t seconds);
+static bool local_voice_say(const local_tts_phrase_t *phrase);
+static bool local_voice_say_status(local_tts_status_t status);
+static void play_error(vp_event_t event);
 static void local_timer_stop(void);
 static void ha_pipeline_error_handler(const char *error_code,
                                       const char *error_message);
@@ -135,28 +226,46 @@ static void ha_response_timeout_start(void);
 static void ha_response_timeout_stop(void);
 static bool parse_timer_seconds_from_intent(const char *intent_data,
                                             uint32_t *out_seconds);
-static bool parse_duration_string_seconds(const char *text,
-                                          uint32_t *out_seconds);
-static bool parse_iso8601_duration_seconds(const char *text,
-                                           uint32_t *out_seconds);
 static bool parse_number_from_json_value(const cJSON *value, double *out);
 static bool parse_timer_seconds_from_text(const char *text,
                                           uint32_t *out_seconds);
 static bool response_indicates_timer_not_supported(const char *response_text);
-static int parse_cro_number_word(const char *word);
-static bool is_timer_keyword(const char *word);
 static void led_status_set_guarded(led_status_t status);
+static bool intent_lookup(const char *text, int command_id,
+                          local_intent_match_t *out);
+static void run_local_intent(const local_intent_match_t *match);
+static void command_window_timeout_cb(TimerHandle_t timer);
+static void command_window_fallback(bool speech_ended);
+static bool command_prebuffer_capture(const uint8_t *audio_data,
+                                      size_t length);
+static void command_prebuffer_reset(void);
+static void run_result_note(bool offline);
+static void session_note_conversation(const char *conversation_id);
+static void on_run_end(void);
+static void followup_prepare(void);
 
 // Helper to post commands
-static void pipeline_post_cmd(pipeline_cmd_type_t type, int data) {
+static void pipeline_post(pipeline_cmd_type_t type, int data, int arg) {
   if (pipeline_cmd_queue) {
-    pipeline_cmd_t cmd = {.type = type, .data = data};
+    pipeline_cmd_t cmd = {.type = type,
+                          .data = data,
+                          .arg = arg,
+                          .posted_us = esp_timer_get_time()};
     if (xQueueSend(pipeline_cmd_queue, &cmd, pdMS_TO_TICKS(100)) != pdTRUE) {
-      ESP_LOGE(TAG, "Command queue full, dropped cmd %d", type);
+      ESP_LOGE(TAG, "Command queue full, dropped cmd %d/%d", type, data);
     }
   }
 }
 
+static void pipeline_post_cmd(pipeline_cmd_type_t type, int data) {
+  pipeline_post(type, data, 0);
+}
+
+// Post a state machine event (any task)
+static void pipeline_post_event(vp_event_t event, int arg) {
+  pipeline_post(PIPELINE_CMD_EVENT, event, arg);
+}
+
 static void led_status_set_guarded(led_status_t status) {
   if (ota_update_is_running()) {
     return;
@@ -171,7 +280,12 @@ static void led_status_set_guarded(led_status_t status) {
 esp_err_t voice_pipeline_init(void) {
   ESP_LOGI(TAG, "Initializing Voice Pipeline...");
 
-  pipeline_cmd_queue = xQueueCreate(10, sizeof(pipeline_cmd_t));
+  vp_fsm_init(&fsm, esp_timer_get_time());
+  atomic_store_explicit(&fsm_state_published, fsm.state,
+                        memory_order_release);
+
+  pipeline_cmd_queue =
+      xQueueCreate(PIPELINE_CMD_QUEUE_LEN, sizeof(pipeline_cmd_t));
   if (!pipeline_cmd_queue)
     return ESP_ERR_NO_MEM;
 
@@ -181,6 +295,37 @@ esp_err_t voice_pipeline_init(void) {
   if (!ha_response_timeout_timer)
     return ESP_ERR_NO_MEM;
 
+  intents_mutex = xSemaphoreCreateMutex();
+  if (!intents_mutex)
+    return ESP_ERR_NO_MEM;
+  char intents_err[64];
+  intents = local_intent_compile(local_intent_default_grammar(), intents_err,
+                                 sizeof(intents_err));
+  if (!intents) {
+    ESP_LOGE(TAG, "Built-in intent grammar: %s", intents_err);
+  }
+  // The SD card may already be mounted; otherwise main loads it on mount
+  (void)voice_pipeline_load_intents(VOICE_PIPELINE_INTENTS_PATH);
+  if (!duration_parse_init()) {
+    ESP_LOGE(TAG, "Duration lexicon does not hash; spoken timers disabled");
+  }
+
+  command_window_timer =
+      xTimerCreate("cmd_window", pdMS_TO_TICKS(COMMAND_WINDOW_MS), pdFALSE,
+                   NULL, command_window_timeout_cb);
+  if (!command_window_timer)
+    return ESP_ERR_NO_MEM;
+
+  // Audio callbacks only post events; the reactions run on the bus
+  // dispatcher so the AFE fetch task never blocks on UI/MQTT/WebSocket
+  esp_err_t bus_ret = event_bus_init();
+  if (bus_ret != ESP_OK)
+    return bus_ret;
+  event_bus_subscribe(EVENT_BUS_WAKE_WORD, handle_wake_event);
+  event_bus_subscribe(EVENT_BUS_OFFLINE_CMD, handle_offline_cmd_event);
+  event_bus_subscribe(EVENT_BUS_VAD_START, handle_vad_start_event);
+  event_bus_subscribe(EVENT_BUS_VAD_END, handle_vad_end_event);
+
   // Initialize Audio Capture (includes AFE/WWD/MultiNet)
   audio_capture_stop_wait(100); // Ensure clean state
   esp_err_t audio_init_ret = audio_capture_init();
@@ -192,12 +337,22 @@ esp_err_t voice_pipeline_init(void) {
 
   // Register callbacks
   audio_capture_register_cmd_callback(on_offline_cmd_detected);
+  if (audio_capture_has_multinet()) {
+    // From the SD card if mounted already, else the copy in NVS
+    (void)mn_commands_load(MN_COMMANDS_PATH);
+    command_prebuffer = (uint8_t *)heap_caps_malloc(
+        COMMAND_PREBUFFER_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!command_prebuffer) {
+      ESP_LOGW(TAG, "No memory for the offline command window");
+    }
+  }
 
   // Register HA callbacks
   ha_client_register_intent_callback(intent_handler);
   ha_client_register_conversation_callback(conversation_response_handler);
   ha_client_register_stt_callback(stt_text_handler);
   ha_client_register_error_callback(ha_pipeline_error_handler);
+  ha_client_register_run_end_callback(on_run_end);
 
   // Register TTS callback
   tts_player_init();
@@ -207,24 +362,9 @@ esp_err_t voice_pipeline_init(void) {
   // Initialize Timer Manager
   timer_manager_init(timer_expired_callback);
 
-  // Initialize Wake Prompt Player (loads audio from SD card)
-  wake_prompt_init(); // Non-fatal if file not found - will use beep fallback
-
-  // Allocate pipeline_task stack from PSRAM to save internal RAM
-  if (!pipeline_task_stack) {
-    pipeline_task_stack = (StackType_t *)heap_caps_malloc(
-        PIPELINE_TASK_STACK_SIZE * sizeof(StackType_t), MALLOC_CAP_SPIRAM);
-    if (!pipeline_task_stack) {
-      ESP_LOGE(TAG, "Failed to allocate pipeline_task stack from PSRAM");
-      return ESP_ERR_NO_MEM;
-    }
-  }
-
-  // Start the manager task with PSRAM stack
-  pipeline_task_handle = xTaskCreateStatic(
-      pipeline_task, "voice_pipeline", PIPELINE_TASK_STACK_SIZE, NULL, 5,
-      pipeline_task_stack, &pipeline_task_tcb);
-  if (!pipeline_task_handle) {
+  // Start the manager task (stack in the PSRAM part of the arena)
+  if (task_arena_start(TASK_SLOT_VOICE_PIPELINE, pipeline_task, NULL, 5,
+                       tskNO_AFFINITY, &pipeline_task_handle) != ESP_OK) {
     ESP_LOGE(TAG, "Failed to create pipeline_task");
     return ESP_FAIL;
   }
@@ -244,7 +384,9 @@ esp_err_t voice_pipeline_stop(void) {
   return ESP_OK;
 }
 
-void voice_pipeline_trigger_wake(void) { on_wake_word_detected(NULL, 0); }
+void voice_pipeline_trigger_wake(void) {
+  pipeline_post_event(VP_EVENT_WAKE, 0);
+}
 
 void voice_pipeline_on_music_state_change(bool is_playing) {
   if (is_playing) {
@@ -273,7 +415,144 @@ void voice_pipeline_get_config(voice_pipeline_config_t *config) {
 
 bool voice_pipeline_is_running(void) { return is_wwd_running; }
 
-bool voice_pipeline_is_active(void) { return is_pipeline_active; }
+/**
+ * @brief Conversation state, safe to read from any task
+ */
+static vp_state_t pipeline_state(void) {
+  return (vp_state_t)atomic_load_explicit(&fsm_state_published,
+                                          memory_order_acquire);
+}
+
+bool voice_pipeline_is_active(void) {
+  return pipeline_state() != VP_STATE_IDLE;
+}
+
+esp_err_t voice_pipeline_get_fsm_stats(vp_fsm_t *stats) {
+  if (!stats)
+    return ESP_ERR_INVALID_ARG;
+  portENTER_CRITICAL(&fsm_mux);
+  *stats = fsm;
+  portEXIT_CRITICAL(&fsm_mux);
+  return ESP_OK;
+}
+
+void voice_pipeline_set_offline_commands(bool enable) {
+  offline_commands_enabled = enable;
+  if (enable && !audio_capture_has_multinet()) {
+    ESP_LOGW(TAG, "Offline commands enabled but no MultiNet model is loaded");
+  }
+}
+
+bool voice_pipeline_get_offline_commands(void) {
+  return offline_commands_enabled;
+}
+
+void voice_pipeline_get_run_stats(voice_pipeline_run_stats_t *stats) {
+  if (stats) {
+    *stats = run_stats;
+  }
+}
+
+esp_err_t voice_pipeline_set_wake_route(int wake_word, const char *route) {
+  if (wake_word < 0 || wake_word >= AUDIO_CAPTURE_MAX_WAKE_WORDS)
+    return ESP_ERR_INVALID_ARG;
+  if (route && strlen(route) >= sizeof(wake_routes[0]))
+    return ESP_ERR_INVALID_SIZE;
+
+  portENTER_CRITICAL(&wake_routes_mux);
+  strcpy(wake_routes[wake_word], route ? route : "");
+  portEXIT_CRITICAL(&wake_routes_mux);
+  ESP_LOGI(TAG, "Wake word %d -> %s", wake_word,
+           route && route[0] ? route : "HA (preferred pipeline)");
+  return ESP_OK;
+}
+
+/**
+ * @brief Take the route of the word that started this run (LISTENING entry)
+ */
+static void run_route_select(int wake_word) {
+  if (wake_word < 0 || wake_word >= AUDIO_CAPTURE_MAX_WAKE_WORDS)
+    wake_word = 0;
+  run_wake_word = wake_word;
+  portENTER_CRITICAL(&wake_routes_mux);
+  strcpy(run_pipeline_id, wake_routes[wake_word]);
+  portEXIT_CRITICAL(&wake_routes_mux);
+  run_local_only = strcmp(run_pipeline_id, VOICE_PIPELINE_ROUTE_LOCAL) == 0;
+  if (run_local_only)
+    run_pipeline_id[0] = '\0';
+}
+
+esp_err_t voice_pipeline_load_intents(const char *path) {
+  if (!path)
+    return ESP_ERR_INVALID_ARG;
+  if (!intents_mutex)
+    return ESP_ERR_INVALID_STATE; // voice_pipeline_init() loads it later
+
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return ESP_ERR_NOT_FOUND;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size <= 0 || size > INTENTS_FILE_MAX) {
+    ESP_LOGE(TAG, "Invalid intent grammar size: %ld bytes (max: %d)", size,
+             INTENTS_FILE_MAX);
+    fclose(f);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  char *text = malloc((size_t)size + 1);
+  if (!text) {
+    fclose(f);
+    return ESP_ERR_NO_MEM;
+  }
+  size_t read = fread(text, 1, (size_t)size, f);
+  fclose(f);
+  text[read] = '\0';
+
+  char err[64];
+  int64_t start_us = esp_timer_get_time();
+  local_intent_t *compiled = local_intent_compile(text, err, sizeof(err));
+  uint32_t compile_us = (uint32_t)(esp_timer_get_time() - start_us);
+  free(text);
+  if (!compiled) {
+    ESP_LOGE(TAG, "%s: %s (keeping previous grammar)", path, err);
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  xSemaphoreTake(intents_mutex, portMAX_DELAY);
+  local_intent_t *old = intents;
+  intents = compiled;
+  xSemaphoreGive(intents_mutex);
+  local_intent_free(old);
+
+  int rules = 0;
+  int phrases = 0;
+  local_intent_get_size(compiled, &rules, &phrases);
+  ESP_LOGI(TAG, "Intent grammar loaded from %s: %d rules, %d phrases (%lu us)",
+           path, rules, phrases, (unsigned long)compile_us);
+  return ESP_OK;
+}
+
+esp_err_t voice_pipeline_load_voice(const char *dir) {
+  if (!dir)
+    return ESP_ERR_INVALID_ARG;
+  if (local_voice)
+    return ESP_OK; // Loaded once; the pipeline may be speaking with it
+
+  int64_t start_us = esp_timer_get_time();
+  local_tts_t *voice = local_tts_load(dir);
+  if (!voice)
+    return ESP_ERR_NOT_FOUND;
+  local_tts_info_t info;
+  local_tts_get_info(voice, &info);
+  ESP_LOGI(TAG, "Local voice loaded from %s: %d units (%d missing), %lu KB, "
+           "%lu ms",
+           dir, info.units_loaded, info.units_missing,
+           (unsigned long)(info.bytes / 1024),
+           (unsigned long)((esp_timer_get_time() - start_us) / 1000));
+  local_voice = voice;
+  return ESP_OK;
+}
 
 void voice_pipeline_test_tts(const char *text) {
   if (text && ha_client_is_connected()) {
@@ -282,17 +561,283 @@ void voice_pipeline_test_tts(const char *text) {
 }
 
 void voice_pipeline_trigger_restart(void) {
-  xTaskCreate(restart_task, "restart", 2048, NULL, 3, NULL);
+  if (task_arena_submit_control(restart_job, NULL) != ESP_OK) {
+    ESP_LOGW(TAG, "Job queue full, restart request dropped");
+  }
 }
 
 void voice_pipeline_trigger_alarm(int alarm_id) {
-  pipeline_post_cmd(PIPELINE_CMD_ALARM_BEEP, alarm_id);
+  alarm_from_timer = false;
+  pipeline_post_event(VP_EVENT_ALARM, alarm_id);
 }
 
 // =============================================================================
 // INTERNAL LOGIC
 // =============================================================================
 
+static void wwd_stop(void) {
+  audio_capture_stop_wait(500);
+  is_wwd_running = false;
+}
+
+static void wwd_resume(void) {
+  // The microphone belongs to the conversation until it is back to idle
+  if (pipeline_state() != VP_STATE_IDLE) {
+    return;
+  }
+  if (local_music_player_is_initialized() &&
+      (local_music_player_get_state() == MUSIC_STATE_PLAYING ||
+       local_music_player_get_state() == MUSIC_STATE_PAUSED)) {
+    return;
+  }
+
+  audio_capture_stop_wait(500);
+  vTaskDelay(pdMS_TO_TICKS(100));
+
+  if (audio_capture_start_wake_word_mode(on_wake_word_detected) == ESP_OK) {
+    is_wwd_running = true;
+    led_status_set_guarded(LED_STATUS_IDLE);
+    oled_status_set_va_state(OLED_VA_IDLE);
+    if (mqtt_ha_is_connected())
+      mqtt_ha_update_sensor("va_status", "SPREMAN");
+    ESP_LOGI(TAG, "WWD Resumed");
+  }
+}
+
+static void free_pipeline_handler(void) {
+  if (current_pipeline_handler) {
+    mem_track_free(MEM_MOD_PIPELINE, current_pipeline_handler);
+    current_pipeline_handler = NULL;
+  }
+}
+
+/**
+ * @brief Open the HA run and start streaming (LISTENING / FOLLOWUP entry)
+ */
+static void enter_stream(uint32_t max_recording_ms, const char *context_tag) {
+  if (start_audio_streaming(max_recording_ms, context_tag) == ESP_OK) {
+    pipeline_dispatch(VP_EVENT_STREAM_STARTED, 0, esp_timer_get_time());
+  } else {
+    pipeline_dispatch(VP_EVENT_STREAM_FAILED, 0, esp_timer_get_time());
+  }
+}
+
+/**
+ * @brief Listen for an offline command only (LISTENING entry)
+ */
+static void enter_command_window(void) {
+  command_prebuffer_reset();
+  portENTER_CRITICAL(&command_prebuffer_mux);
+  command_prebuffer_active = true;
+  portEXIT_CRITICAL(&command_prebuffer_mux);
+  warmup_chunks_skip = 2;
+
+  // State first, so the first chunk already goes to the buffer
+  pipeline_dispatch(VP_EVENT_COMMAND_WINDOW, 0, esp_timer_get_time());
+  audio_capture_enable_vad(NULL, vad_event_handler);
+  if (audio_capture_start(audio_capture_handler) != ESP_OK) {
+    pipeline_dispatch(VP_EVENT_STREAM_FAILED, 1, esp_timer_get_time());
+    return;
+  }
+  xTimerChangePeriod(command_window_timer, pdMS_TO_TICKS(COMMAND_WINDOW_MS),
+                     0);
+  oled_status_set_last_event("cmd-window");
+}
+
+static void log_run_summary(void) {
+  ESP_LOGI(TAG,
+           "Run: listening %lu ms, streaming %lu ms, awaiting %lu ms, "
+           "speaking %lu ms",
+           (unsigned long)(fsm.states[VP_STATE_LISTENING].last_us / 1000),
+           (unsigned long)(fsm.states[VP_STATE_STREAMING].last_us / 1000),
+           (unsigned long)(fsm.states[VP_STATE_AWAITING_RESPONSE].last_us /
+                           1000),
+           (unsigned long)(fsm.states[VP_STATE_SPEAKING].last_us / 1000));
+}
+
+/**
+ * @brief Entry actions, run after each transition
+ *
+ * @param from State left
+ * @param event Event that caused the transition
+ * @param arg Event argument
+ */
+static void enter_state(vp_state_t from, vp_event_t event, int arg) {
+  switch (fsm.state) {
+  case VP_STATE_IDLE:
+    audio_capture_stop_wait(500);
+    ha_response_timeout_stop();
+    xTimerStop(command_window_timer, 0);
+    command_prebuffer_reset();
+    if (followup_prepared) {
+      // The answer was a question but the conversation ended anyway
+      followup_prepared = false;
+      (void)ha_client_abandon_run();
+    }
+    free_pipeline_handler();
+    if (event == VP_EVENT_ERROR || event == VP_EVENT_TIMEOUT ||
+        (event == VP_EVENT_STREAM_FAILED && arg)) {
+      play_error(event);
+      oled_status_set_va_state(OLED_VA_ERROR);
+      oled_status_set_last_event("err");
+      if (event != VP_EVENT_STREAM_FAILED && arg > 0) {
+        vTaskDelay(pdMS_TO_TICKS(arg)); // Let the error state be seen
+      }
+    }
+    if (from != VP_STATE_ALARM && from != VP_STATE_LISTENING) {
+      log_run_summary();
+      if (!run_speech_seen) {
+        // The mic was open and nobody spoke: most likely a false wake
+        run_stats.false_wakes++;
+        ESP_LOGI(TAG, "No speech after the wake word (%lu false wakes)",
+                 (unsigned long)run_stats.false_wakes);
+      }
+    }
+    if (from == VP_STATE_SPEAKING) {
+      // The tail of our own answer must not wake us again
+      audio_capture_hold_wake(WAKE_HOLD_AFTER_TTS_MS);
+    }
+    wwd_resume();
+    break;
+
+  case VP_STATE_LISTENING:
+    ha_response_timeout_stop();
+    // Safety cleanup: free any leftover pipeline handler
+    free_pipeline_handler();
+    timer_local_handled = false;
+    suppress_tts_audio = false;
+    pending_timer_valid = false;
+    timer_started_from_stt = false;
+    local_intent_handled = false;
+    followup_requested = false;
+    session_note_conversation(NULL); // A wake word starts a new conversation
+    run_speech_seen = false;
+    run_route_select(event == VP_EVENT_WAKE ? arg : 0);
+    run_start_us = esp_timer_get_time();
+    run_result_noted = false;
+    led_status_set_guarded(LED_STATUS_LISTENING);
+    oled_status_set_va_state(OLED_VA_LISTENING);
+    oled_status_set_last_event("wake");
+    if (mqtt_ha_is_connected())
+      mqtt_ha_update_sensor("va_status", "SLUŠAM...");
+
+    // Offline commands work without HA; the fallback needs it later
+    bool offline = (offline_commands_enabled || run_local_only) &&
+                   command_prebuffer && audio_capture_has_multinet();
+    if (run_local_only && !offline) {
+      ESP_LOGW(TAG, "Wake word %d is local-only but there is no MultiNet",
+               run_wake_word);
+      pipeline_dispatch(VP_EVENT_STREAM_FAILED, 1, esp_timer_get_time());
+      break;
+    }
+    if (!offline && !ha_client_is_connected()) {
+      ESP_LOGW(TAG, "Wake word detected but HA disconnected");
+      pipeline_dispatch(VP_EVENT_STREAM_FAILED, 1, esp_timer_get_time());
+      break;
+    }
+    wwd_stop();
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    ESP_LOGI(TAG, "Playing wake confirmation");
+    // Play voice prompt if available, otherwise fall back to beep
+    if (wake_prompt_is_available()) {
+      wake_prompt_play();
+    } else {
+      beep_tone_play(BEEP_WAKE_FREQ, BEEP_WAKE_DURATION, BEEP_WAKE_VOLUME);
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
+    if (offline) {
+      enter_command_window();
+    } else {
+      enter_stream(current_config.vad_max_recording_ms, "wake_word");
+    }
+    break;
+
+  case VP_STATE_AWAITING_RESPONSE:
+    led_status_set_guarded(LED_STATUS_PROCESSING);
+    oled_status_set_va_state(OLED_VA_PROCESSING);
+    oled_status_set_last_event("vad-end");
+    if (mqtt_ha_is_connected())
+      mqtt_ha_update_sensor("va_status", "OBRAĐUJEM...");
+    ha_response_timeout_start();
+    break;
+
+  case VP_STATE_FOLLOWUP:
+    led_status_set_guarded(LED_STATUS_LISTENING);
+    oled_status_set_va_state(OLED_VA_LISTENING);
+    if (mqtt_ha_is_connected())
+      mqtt_ha_update_sensor("va_status", "SLUSAM...");
+    audio_capture_stop_wait(500);
+    if (followup_prepared) {
+      // Run opened during playback; capture only now, since starting it
+      // sets the codec to 16 kHz mono under whatever is playing
+      followup_prepared = false;
+      vp_event_t started = start_capture() == ESP_OK ? VP_EVENT_STREAM_STARTED
+                                                     : VP_EVENT_STREAM_FAILED;
+      pipeline_dispatch(started, 0, esp_timer_get_time());
+      break;
+    }
+    enter_stream(FOLLOWUP_RECORDING_MS, "follow-up");
+    break;
+
+  case VP_STATE_ALARM: {
+    ESP_LOGI(TAG, "Playing Alarm/Timer Sound!");
+    wwd_stop();
+    int prev_volume = bsp_extra_codec_volume_get();
+    bsp_extra_codec_volume_set(100, NULL);
+    for (int i = 0; i < 5; i++) {
+      beep_tone_play(1000, 500, 100);
+      vTaskDelay(pdMS_TO_TICKS(500));
+      sys_diag_wdt_feed(); // Feed during long loops
+    }
+    if (alarm_from_timer) {
+      alarm_from_timer = false;
+      (void)local_voice_say_status(LOCAL_TTS_TIMER_DONE);
+    }
+    bsp_extra_codec_volume_set(prev_volume, NULL);
+    pipeline_dispatch(VP_EVENT_ALARM_DONE, 0, esp_timer_get_time());
+    break;
+  }
+
+  case VP_STATE_STREAMING:
+  case VP_STATE_SPEAKING:
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Apply an event to the state machine (pipeline_task only)
+ */
+static void pipeline_dispatch(vp_event_t event, int arg, int64_t posted_us) {
+  // The follow-up decision is run context; turn it into its own event
+  if (event == VP_EVENT_TTS_DONE && followup_requested &&
+      fsm.state == VP_STATE_SPEAKING) {
+    event = VP_EVENT_FOLLOWUP;
+  }
+
+  vp_state_t from = fsm.state;
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&fsm_mux);
+  bool applied = vp_fsm_dispatch(&fsm, event, posted_us, now_us);
+  portEXIT_CRITICAL(&fsm_mux);
+  if (!applied) {
+    ESP_LOGD(TAG, "Event %s ignored in state %s", vp_fsm_event_name(event),
+             vp_fsm_state_name(from));
+    return;
+  }
+  atomic_store_explicit(&fsm_state_published, fsm.state,
+                        memory_order_release);
+  if (event == VP_EVENT_TTS_START ||
+      (event == VP_EVENT_HANDLED && from != VP_STATE_COMMAND)) {
+    run_result_note(false); // First audible/handled result of an HA run
+  }
+  ESP_LOGI(TAG, "State %s -> %s (%s, %lu ms)", vp_fsm_state_name(from),
+           vp_fsm_state_name(fsm.state), vp_fsm_event_name(event),
+           (unsigned long)(fsm.states[from].last_us / 1000));
+  enter_state(from, event, arg);
+}
+
 static void pipeline_task(void *arg) {
   sys_diag_wdt_add();
   pipeline_cmd_t cmd;
@@ -304,158 +849,93 @@ static void pipeline_task(void *arg) {
       sys_diag_wdt_feed();
 
       switch (cmd.type) {
-      case PIPELINE_CMD_WAKE_DETECTED:
-        oled_status_set_last_event("wake");
-        if (!ha_client_is_connected()) {
-          ESP_LOGW(TAG, "Wake word detected but HA disconnected");
-          pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
-          pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
-          break;
-        }
-        audio_capture_stop_wait(100);
-        is_wwd_running = false;
-        vTaskDelay(pdMS_TO_TICKS(50));
-
-        ESP_LOGI(TAG, "Playing wake confirmation");
-        // Play voice prompt if available, otherwise fall back to beep
-        if (wake_prompt_is_available()) {
-          wake_prompt_play();
-        } else {
-          beep_tone_play(BEEP_WAKE_FREQ, BEEP_WAKE_DURATION, BEEP_WAKE_VOLUME);
-        }
-        vTaskDelay(pdMS_TO_TICKS(50));
-
-        start_audio_streaming(current_config.vad_max_recording_ms, "wake_word");
-        wake_detect_pending = false;
+      case PIPELINE_CMD_EVENT:
+        pipeline_dispatch((vp_event_t)cmd.data, cmd.arg, cmd.posted_us);
         break;
 
-      case PIPELINE_CMD_OFFLINE_CMD:
+      case PIPELINE_CMD_OFFLINE_CMD: {
         ESP_LOGI(TAG, "⚡ Executing Offline Command ID: %d", cmd.data);
         beep_tone_play(1000, 100, 80);
 
         audio_capture_stop_wait(100);
-        if (ha_client_is_connected())
+        xTimerStop(command_window_timer, 0);
+        if (current_pipeline_handler && ha_client_is_connected())
           ha_client_end_audio_stream();
 
-        // Actions
-        switch (cmd.data) {
-        case 0: // Light On
-          ESP_LOGI(TAG, "Action: LIGHT ON");
-          led_status_set_guarded(LED_STATUS_LISTENING);
-          break;
-        case 1: // Light Off
-          ESP_LOGI(TAG, "Action: LIGHT OFF");
-          led_status_set_guarded(LED_STATUS_IDLE);
-          break;
-        case 2: // Music Play
-          ESP_LOGI(TAG, "Action: MUSIC PLAY");
-          if (local_music_player_is_initialized())
-            local_music_player_play();
-          break;
-        case 3: // Music Stop
-          ESP_LOGI(TAG, "Action: MUSIC STOP");
-          if (local_music_player_is_initialized())
-            local_music_player_stop();
-          break;
-        case 4: // Next
-          if (local_music_player_is_initialized())
-            local_music_player_next();
-          break;
-        case 5: // Prev
-          if (local_music_player_is_initialized())
-            local_music_player_previous();
-          break;
+        local_intent_match_t match;
+        if (intent_lookup(NULL, cmd.data, &match)) {
+          run_local_intent(&match);
+        } else {
+          ESP_LOGW(TAG, "No intent rule for command %d", cmd.data);
         }
-
-        pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+        // HA was never involved if this came from the command window
+        run_result_note(fsm.state == VP_STATE_COMMAND);
+        // Queued behind any music command, like the HA music path
+        pipeline_post_event(VP_EVENT_HANDLED, 0);
         break;
+      }
 
-      case PIPELINE_CMD_RESUME_WWD:
-        if (local_music_player_is_initialized() &&
-            (local_music_player_get_state() == MUSIC_STATE_PLAYING ||
-             local_music_player_get_state() == MUSIC_STATE_PAUSED)) {
-          break;
-        }
-
-        audio_capture_stop_wait(500);
-        vTaskDelay(pdMS_TO_TICKS(100));
-
-        if (audio_capture_start_wake_word_mode(on_wake_word_detected) ==
-            ESP_OK) {
-          is_wwd_running = true;
-          led_status_set_guarded(LED_STATUS_IDLE);
-          oled_status_set_va_state(OLED_VA_IDLE);
-          if (mqtt_ha_is_connected())
-            mqtt_ha_update_sensor("va_status", "SPREMAN");
-          ESP_LOGI(TAG, "WWD Resumed");
-        }
+      case PIPELINE_CMD_LOCAL_INTENT:
+        run_local_intent(&local_intent_match);
+        beep_tone_play(BEEP_CONFIRM_FREQ, BEEP_CONFIRM_DURATION,
+                       BEEP_CONFIRM_VOLUME);
+        run_result_note(false); // Still needed HA speech-to-text
+        ESP_LOGI(TAG, "Local intent %s done %lu ms after STT",
+                 local_intent_action_name(local_intent_match.action),
+                 (unsigned long)((esp_timer_get_time() - cmd.posted_us) /
+                                 1000));
+        pipeline_post_event(VP_EVENT_HANDLED, 0);
         break;
 
-      case PIPELINE_CMD_STOP_WWD:
-        audio_capture_stop_wait(500);
-        is_wwd_running = false;
+      case PIPELINE_CMD_COMMAND_FALLBACK:
+        command_window_fallback(cmd.data != 0);
         break;
 
-      case PIPELINE_CMD_RESTART_WWD:
-        pipeline_post_cmd(PIPELINE_CMD_STOP_WWD, 0);
-        pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+      case PIPELINE_CMD_FOLLOWUP_PREPARE:
+        followup_prepare();
         break;
 
-      case PIPELINE_CMD_START_FOLLOWUP_VAD:
-        audio_capture_stop_wait(500);
-        led_status_set_guarded(LED_STATUS_LISTENING);
-        oled_status_set_va_state(OLED_VA_LISTENING);
-        if (mqtt_ha_is_connected())
-          mqtt_ha_update_sensor("va_status", "SLUSAM...");
-
-        if (start_audio_streaming(FOLLOWUP_RECORDING_MS, "follow-up") !=
-            ESP_OK) {
-          followup_vad_pending = false;
-          pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
-        }
+      case PIPELINE_CMD_RESUME_WWD:
+        wwd_resume();
         break;
 
-      case PIPELINE_CMD_TIMER_BEEP:
-      case PIPELINE_CMD_ALARM_BEEP:
-        ESP_LOGI(TAG, "Playing Alarm/Timer Sound!");
-        audio_capture_stop_wait(500);
-        int prev_volume = bsp_extra_codec_volume_get();
-        bsp_extra_codec_volume_set(100, NULL);
-        for (int i = 0; i < 5; i++) {
-          beep_tone_play(1000, 500, 100);
-          vTaskDelay(pdMS_TO_TICKS(500));
-          sys_diag_wdt_feed(); // Feed during long loops
-        }
-        bsp_extra_codec_volume_set(prev_volume, NULL);
-        pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+      case PIPELINE_CMD_STOP_WWD:
+        wwd_stop();
         break;
 
-      case PIPELINE_CMD_ERROR_RESUME:
-        vTaskDelay(pdMS_TO_TICKS(2000));
-        pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+      case PIPELINE_CMD_RESTART_WWD:
+        // wwd_threshold is the threshold of the main wake word
+        (void)audio_capture_set_wake_threshold(0, current_config.wwd_threshold);
+        if (fsm.state == VP_STATE_IDLE) {
+          wwd_stop();
+          wwd_resume();
+        }
         break;
 
-      case PIPELINE_CMD_CONFIRM_BEEP:
+      case PIPELINE_CMD_CONFIRM_BEEP: {
+        // data: seconds of the timer just started, spoken if possible
+        local_tts_phrase_t phrase;
+        local_tts_phrase_clear(&phrase);
+        if (cmd.data > 0 &&
+            local_tts_phrase_status(&phrase, LOCAL_TTS_TIMER_SET) &&
+            local_tts_phrase_duration(&phrase, (uint32_t)cmd.data) &&
+            local_voice_say(&phrase)) {
+          break;
+        }
         beep_tone_play(BEEP_CONFIRM_FREQ, BEEP_CONFIRM_DURATION,
                        BEEP_CONFIRM_VOLUME);
         vTaskDelay(pdMS_TO_TICKS(120));
         beep_tone_play(BEEP_CONFIRM_FREQ, BEEP_CONFIRM_DURATION,
                        BEEP_CONFIRM_VOLUME);
         break;
-
-      case PIPELINE_CMD_ERROR_BEEP:
-        beep_tone_play(BEEP_ERROR_FREQ, BEEP_ERROR_DURATION, BEEP_ERROR_VOLUME);
-        oled_status_set_va_state(OLED_VA_ERROR);
-        oled_status_set_last_event("err");
-        break;
+      }
 
       case PIPELINE_CMD_MUSIC_CONTROL:
         ESP_LOGI(TAG, "Pipeline Music Control: Stopping WWD/Mic first...");
         sys_diag_wdt_feed(); // Feed before heavy operation
 
         // 1. Stop Microphone / WWD
-        audio_capture_stop_wait(500);
-        is_wwd_running = false;
+        wwd_stop();
 
         // 2. Wait a bit for I2S cleanup
         sys_diag_wdt_feed();
@@ -469,7 +949,9 @@ static void pipeline_task(void *arg) {
             local_music_player_play();
           } else {
             ESP_LOGW(TAG, "Music player not initialized!");
-            pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
+            beep_tone_play(BEEP_ERROR_FREQ, BEEP_ERROR_DURATION,
+                           BEEP_ERROR_VOLUME);
+            wwd_resume();
           }
         } else {
           ESP_LOGI(TAG, "Stopping Music Player...");
@@ -477,7 +959,7 @@ static void pipeline_task(void *arg) {
             local_music_player_stop();
           }
           // For STOP, we usually want to resume listening after
-          pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+          wwd_resume();
         }
         sys_diag_wdt_feed();
         break;
@@ -491,83 +973,91 @@ static void pipeline_task(void *arg) {
     }
   }
   sys_diag_wdt_remove();
-  vTaskDelete(NULL);
+  task_arena_exit(TASK_SLOT_VOICE_PIPELINE);
 }
 
 // =============================================================================
 // EVENT HANDLERS
 // =============================================================================
 
-static void on_wake_word_detected(const int16_t *audio_data, size_t samples) {
-  if (wake_detect_pending)
-    return;
-  wake_detect_pending = true;
-  ha_response_timeout_stop();
-
-  // Safety cleanup: free any leftover pipeline handler from interrupted session
-  if (current_pipeline_handler) {
-    free(current_pipeline_handler);
-    current_pipeline_handler = NULL;
-  }
+// The audio_capture callbacks below run on the AFE fetch task: they only
+// post to the event bus. The handle_*_event functions run on the bus
+// dispatcher and turn them into state machine events. Repeated detections
+// are ignored by the state machine.
 
-  timer_local_handled = false;
-  suppress_tts_audio = false;
-  pending_timer_valid = false;
-  timer_started_from_stt = false;
-  led_status_set_guarded(LED_STATUS_LISTENING);
-  oled_status_set_va_state(OLED_VA_LISTENING);
-  oled_status_set_last_event("wake");
-  if (mqtt_ha_is_connected())
-    mqtt_ha_update_sensor("va_status", "SLUŠAM...");
-  pipeline_post_cmd(PIPELINE_CMD_WAKE_DETECTED, 0);
+static void on_wake_word_detected(const int16_t *audio_data, size_t samples,
+                                  int wake_word) {
+  event_bus_post(EVENT_BUS_WAKE_WORD, wake_word);
 }
 
 static void on_offline_cmd_detected(int id, int index) {
-  pipeline_post_cmd(PIPELINE_CMD_OFFLINE_CMD, id);
+  event_bus_post(EVENT_BUS_OFFLINE_CMD, id);
 }
 
 static void vad_event_handler(audio_capture_vad_event_t event) {
   if (event == VAD_EVENT_SPEECH_START) {
-    ESP_LOGI(TAG, "VAD: Speech Start");
-    oled_status_set_va_state(OLED_VA_LISTENING);
-    oled_status_set_last_event("vad-start");
+    event_bus_post(EVENT_BUS_VAD_START, 0);
   } else if (event == VAD_EVENT_SPEECH_END) {
-    ESP_LOGI(TAG, "VAD: Speech End");
-    is_pipeline_active = false;
+    // Stop capture right here so no audio follows the end of the stream
     audio_capture_stop_wait(0);
-
-    if (ha_client_is_connected()) {
-      esp_err_t err = ha_client_end_audio_stream();
-      if (err == ESP_OK) {
-        led_status_set_guarded(LED_STATUS_PROCESSING);
-        oled_status_set_va_state(OLED_VA_PROCESSING);
-        oled_status_set_last_event("vad-end");
-        if (mqtt_ha_is_connected())
-          mqtt_ha_update_sensor("va_status", "OBRAĐUJEM...");
-        ha_response_timeout_start();
-      } else {
-        ESP_LOGW(TAG, "HA end_audio_stream failed: %s", esp_err_to_name(err));
-        (void)ha_client_request_reconnect("end_audio_stream failed");
-        ha_response_timeout_stop();
-        pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
-        pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
-      }
-    } else {
-      ESP_LOGW(TAG, "HA not connected at speech end");
-      ha_response_timeout_stop();
-      pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
-      pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    if (!event_bus_post(EVENT_BUS_VAD_END, 0)) {
+      handle_vad_end_event(NULL); // Must not be lost: finish inline
     }
+  }
+}
+
+static void handle_wake_event(const event_bus_event_t *event) {
+  pipeline_post_event(VP_EVENT_WAKE, (int)event->arg);
+}
 
-    if (current_pipeline_handler) {
-      free(current_pipeline_handler);
-      current_pipeline_handler = NULL;
+static void handle_offline_cmd_event(const event_bus_event_t *event) {
+  run_speech_seen = true;
+  pipeline_post_cmd(PIPELINE_CMD_OFFLINE_CMD, event->arg);
+}
+
+static void handle_vad_start_event(const event_bus_event_t *event) {
+  (void)event;
+  ESP_LOGI(TAG, "VAD: Speech Start");
+  run_speech_seen = true;
+  oled_status_set_va_state(OLED_VA_LISTENING);
+  oled_status_set_last_event("vad-start");
+}
+
+static void handle_vad_end_event(const event_bus_event_t *event) {
+  (void)event;
+  ESP_LOGI(TAG, "VAD: Speech End");
+
+  vp_state_t state = pipeline_state();
+  if (state == VP_STATE_COMMAND) {
+    // Spoken, but not a command: HA gets the buffered utterance
+    pipeline_post_cmd(PIPELINE_CMD_COMMAND_FALLBACK, 1);
+    return;
+  }
+  if (state != VP_STATE_STREAMING) {
+    // HA's stt-end got there first and the stream is already closed
+    ESP_LOGD(TAG, "VAD end in state %s ignored", vp_fsm_state_name(state));
+    return;
+  }
+
+  if (ha_client_is_connected()) {
+    esp_err_t err = ha_client_end_audio_stream();
+    if (err == ESP_OK) {
+      pipeline_post_event(VP_EVENT_SPEECH_END, 0);
+    } else {
+      ESP_LOGW(TAG, "HA end_audio_stream failed: %s", esp_err_to_name(err));
+      (void)ha_client_request_reconnect("end_audio_stream failed");
+      pipeline_post_event(VP_EVENT_ERROR, 0);
     }
+  } else {
+    ESP_LOGW(TAG, "HA not connected at speech end");
+    pipeline_post_event(VP_EVENT_ERROR, 0);
   }
 }
 
 static void audio_capture_handler(const uint8_t *audio_data, size_t length) {
-  if (!is_pipeline_active || !current_pipeline_handler)
+  if (command_prebuffer_capture(audio_data, length))
+    return;
+  if (pipeline_state() != VP_STATE_STREAMING || !current_pipeline_handler)
     return;
 
   if (ha_client_is_audio_ready()) {
@@ -599,33 +1089,57 @@ static void stt_text_handler(const char *text, const char *conversation_id) {
     timer_started_from_stt = true;
     pending_timer_valid = false;
     suppress_tts_audio = true;
-    followup_vad_pending = false;
-    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, 0);
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    followup_requested = false;
+    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, (int)pending_timer_seconds);
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
+    return;
   }
-}
 
-static esp_err_t start_audio_streaming(uint32_t max_recording_ms,
-                                       const char *context_tag) {
-  // If HA not connected, we still record for VAD, but maybe don't stream?
-  // audio_capture_handler handles the check.
-
-  audio_capture_enable_vad(NULL, vad_event_handler);
+  // Common commands run here instead of waiting for the HA intent and TTS;
+  // whatever HA answers for this run is dropped
+  if (intent_lookup(last_stt_text, -1, &local_intent_match)) {
+    ESP_LOGI(TAG, "Local intent: %s (rule %d, value %d)",
+             local_intent_action_name(local_intent_match.action),
+             local_intent_match.rule, local_intent_match.value);
+    local_intent_handled = true;
+    suppress_tts_audio = true;
+    followup_requested = false;
+    oled_status_set_last_event("local");
+    pipeline_post_cmd(PIPELINE_CMD_LOCAL_INTENT, 0);
+  } else if (pipeline_state() == VP_STATE_STREAMING) {
+    // HA ended STT before the local VAD did: close the mic as the VAD end
+    // would, so the run waits for the answer instead of for silence
+    audio_capture_stop_wait(0);
+    pipeline_post_event(VP_EVENT_SPEECH_END, 0);
+  }
+}
 
+/**
+ * @brief Open the assist_pipeline/run; current_pipeline_handler stays NULL
+ * if HA is not available
+ */
+static void open_ha_run(void) {
   // Ensure HA connection is ready before starting conversation
   // This handles the case where WebSocket disconnected during inactivity
-  if (ha_client_ensure_connected(3000) != ESP_OK) {
+  if (ha_client_ensure_connected(HA_CONNECT_WAIT_MS) != ESP_OK) {
     ESP_LOGW(TAG, "HA connection not available after timeout");
     // Continue anyway - VAD will still work, just no streaming
   }
 
   if (ha_client_is_connected()) {
-    current_pipeline_handler = ha_client_start_conversation();
+    char conversation_id[sizeof(session_conversation_id)];
+    portENTER_CRITICAL(&session_mux);
+    strcpy(conversation_id, session_conversation_id);
+    portEXIT_CRITICAL(&session_mux);
+
+    current_pipeline_handler =
+        ha_client_start_conversation(run_pipeline_id, conversation_id);
     if (current_pipeline_handler == NULL) {
       // Retry once after short delay - connection may have just reconnected
       ESP_LOGW(TAG, "First start_conversation attempt failed, retrying...");
-      vTaskDelay(pdMS_TO_TICKS(200));
-      current_pipeline_handler = ha_client_start_conversation();
+      vTaskDelay(pdMS_TO_TICKS(HA_RUN_RETRY_DELAY_MS));
+      current_pipeline_handler =
+          ha_client_start_conversation(run_pipeline_id, conversation_id);
     }
     if (current_pipeline_handler == NULL) {
       ESP_LOGW(TAG,
@@ -633,28 +1147,39 @@ static esp_err_t start_audio_streaming(uint32_t max_recording_ms,
     }
     oled_status_set_last_event("run-start");
   }
+}
 
-  is_pipeline_active = true;
+/**
+ * @brief Start capture with VAD; audio goes to the open run (if any)
+ *
+ * Reconfigures the codec for 16 kHz capture, so not while audio plays.
+ */
+static esp_err_t start_capture(void) {
+  audio_capture_enable_vad(NULL, vad_event_handler);
   oled_status_set_va_state(OLED_VA_LISTENING);
   warmup_chunks_skip = 2;
   return audio_capture_start(audio_capture_handler);
 }
 
+static esp_err_t start_audio_streaming(uint32_t max_recording_ms,
+                                       const char *context_tag) {
+  // Without HA we still record for VAD; audio_capture_handler drops the
+  // audio
+  open_ha_run();
+  return start_capture();
+}
+
 static void on_tts_complete(void) {
   tts_stream_active = false;
   ha_response_timeout_stop();
   oled_status_set_tts_state(OLED_TTS_IDLE);
   oled_status_set_last_event("tts-done");
-  if (music_paused_for_tts) {
-    local_music_player_resume();
-    music_paused_for_tts = false;
-  }
-  // Only resume WWD if we are not waiting for a follow-up
-  if (!followup_vad_pending) {
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
-  } else {
-    pipeline_post_cmd(PIPELINE_CMD_START_FOLLOWUP_VAD, 0);
+  if (music_ducked_for_tts) {
+    local_music_player_duck(false);
+    music_ducked_for_tts = false;
   }
+  // Back to idle, or to the follow-up if the answer was a question
+  pipeline_post_event(VP_EVENT_TTS_DONE, 0);
 }
 
 static void tts_audio_handler(const uint8_t *audio_data, size_t length) {
@@ -667,10 +1192,11 @@ static void tts_audio_handler(const uint8_t *audio_data, size_t length) {
     return;
   }
 
-  if (local_music_player_is_initialized() &&
+  // Keep music playing underneath; tts_player mixes the answer into it
+  if (!music_ducked_for_tts && local_music_player_is_initialized() &&
       local_music_player_get_state() == MUSIC_STATE_PLAYING) {
-    local_music_player_pause();
-    music_paused_for_tts = true;
+    local_music_player_duck(true);
+    music_ducked_for_tts = true;
   }
   if (audio_data == NULL || length == 0) {
     // End of stream: signal the player to start playback, but do NOT resume WWD
@@ -682,6 +1208,7 @@ static void tts_audio_handler(const uint8_t *audio_data, size_t length) {
   } else {
     if (!tts_stream_active) {
       tts_stream_active = true;
+      pipeline_post_event(VP_EVENT_TTS_START, 0);
       oled_status_set_tts_state(OLED_TTS_DOWNLOADING);
       oled_status_set_last_event("tts-start");
       oled_status_set_va_state(OLED_VA_SPEAKING);
@@ -692,31 +1219,37 @@ static void tts_audio_handler(const uint8_t *audio_data, size_t length) {
 
 static void conversation_response_handler(const char *response_text,
                                           const char *conversation_id) {
+  if (conversation_id) {
+    session_note_conversation(conversation_id);
+  }
+  if (local_intent_handled) {
+    suppress_tts_audio = true;
+    return;
+  }
+
   if (pending_timer_valid &&
       response_indicates_timer_not_supported(response_text)) {
     local_timer_start(pending_timer_seconds);
     timer_local_handled = true;
     pending_timer_valid = false;
     suppress_tts_audio = true;
-    followup_vad_pending = false;
-    ha_response_timeout_stop();
-    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, 0);
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    followup_requested = false;
+    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, (int)pending_timer_seconds);
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
     return;
   }
 
   if (timer_local_handled) {
     timer_local_handled = false;
     suppress_tts_audio = true;
-    followup_vad_pending = false;
-    ha_response_timeout_stop();
+    followup_requested = false;
     oled_status_set_response_preview("TIMER");
     if (mqtt_ha_is_connected()) {
       mqtt_ha_update_sensor("va_response",
                             last_timer_id > 0 ? "TIMER POSTAVLJEN" : "TIMER");
       mqtt_ha_update_sensor("va_status", "SPREMAN");
     }
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
     return;
   }
 
@@ -724,22 +1257,23 @@ static void conversation_response_handler(const char *response_text,
   if (local_music_ready && response_requests_music_selection(response_text)) {
     ESP_LOGI(TAG, "HA asked for music selection; playing local SD music");
     suppress_tts_audio = true;
-    followup_vad_pending = false;
-    ha_response_timeout_stop();
+    followup_requested = false;
     oled_status_set_response_preview("GLAZBA");
     handle_local_music_play();
     if (mqtt_ha_is_connected()) {
       mqtt_ha_update_sensor("va_response", "PUSTAM GLAZBU");
       mqtt_ha_update_sensor("va_status", "GLAZBA...");
     }
+    // Queued behind the music command, so wake word detection stays off
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
     return;
   }
 
   if (response_text && response_text[0] &&
       response_text[strlen(response_text) - 1] == '?') {
-    followup_vad_pending = true;
+    followup_requested = true;
   } else {
-    followup_vad_pending = false;
+    followup_requested = false;
   }
 
   if (mqtt_ha_is_connected()) {
@@ -749,8 +1283,7 @@ static void conversation_response_handler(const char *response_text,
   oled_status_set_response_preview(response_text ? response_text : "");
 
   if (!response_text || strlen(response_text) == 0) {
-    ha_response_timeout_stop();
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
   }
 }
 
@@ -760,13 +1293,6 @@ static void ha_pipeline_error_handler(const char *error_code,
            error_message ? error_message : "?");
   ha_response_timeout_stop();
 
-  // Cleanup pipeline handler to prevent memory leak
-  if (current_pipeline_handler) {
-    free(current_pipeline_handler);
-    current_pipeline_handler = NULL;
-  }
-  is_pipeline_active = false;
-
   led_status_set_guarded(LED_STATUS_ERROR);
   oled_status_set_va_state(OLED_VA_ERROR);
   oled_status_set_last_event("ha-err");
@@ -775,43 +1301,34 @@ static void ha_pipeline_error_handler(const char *error_code,
     mqtt_ha_update_sensor("va_response",
                           error_message ? error_message : "HA ERROR");
   }
-  pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
-  pipeline_post_cmd(PIPELINE_CMD_ERROR_RESUME, 0);
+  // The run handler is freed by pipeline_task on the way back to idle
+  pipeline_post_event(VP_EVENT_ERROR, ERROR_RESUME_DELAY_MS);
 }
 
 static void ha_response_timeout_cb(TimerHandle_t timer) {
   (void)timer;
-  if (!ha_response_waiting)
+  // Only applies while awaiting the response; the state machine ignores it
+  // anywhere else
+  if (pipeline_state() != VP_STATE_AWAITING_RESPONSE)
     return;
-  ha_response_waiting = false;
   ESP_LOGW(TAG, "HA response timeout");
 
-  // Cleanup pipeline handler to prevent memory leak
-  if (current_pipeline_handler) {
-    free(current_pipeline_handler);
-    current_pipeline_handler = NULL;
-  }
-  is_pipeline_active = false;
-
   oled_status_set_last_event("ha-to");
   if (mqtt_ha_is_connected()) {
     mqtt_ha_update_sensor("va_status", "GRESKA");
     mqtt_ha_update_sensor("va_response", "HA TIMEOUT");
   }
-  pipeline_post_cmd(PIPELINE_CMD_ERROR_BEEP, 0);
-  pipeline_post_cmd(PIPELINE_CMD_ERROR_RESUME, 0);
+  pipeline_post_event(VP_EVENT_TIMEOUT, ERROR_RESUME_DELAY_MS);
 }
 
 static void ha_response_timeout_start(void) {
   if (!ha_response_timeout_timer)
     return;
-  ha_response_waiting = true;
   xTimerStop(ha_response_timeout_timer, 0);
   xTimerStart(ha_response_timeout_timer, 0);
 }
 
 static void ha_response_timeout_stop(void) {
-  ha_response_waiting = false;
   if (!ha_response_timeout_timer)
     return;
   xTimerStop(ha_response_timeout_timer, 0);
@@ -819,7 +1336,7 @@ static void ha_response_timeout_stop(void) {
 
 static void intent_handler(const char *intent_name, const char *intent_data,
                            const char *conversation_id) {
-  (void)conversation_id;
+  session_note_conversation(conversation_id);
 
   if (!intent_name) {
     return;
@@ -828,6 +1345,10 @@ static void intent_handler(const char *intent_name, const char *intent_data,
   ESP_LOGI(TAG, "HA intent: %s", intent_name);
   oled_status_set_last_event("intent-end");
 
+  if (local_intent_handled) {
+    return; // Already done on the device
+  }
+
   if (strstr(intent_name, "Timer") || strstr(intent_name, "timer")) {
     if (timer_started_from_stt && strcmp(intent_name, "HassTimerCancel") != 0 &&
         strcmp(intent_name, "HassTimerStop") != 0) {
@@ -837,21 +1358,24 @@ static void intent_handler(const char *intent_name, const char *intent_data,
     if (parse_timer_seconds_from_intent(intent_data, &seconds) && seconds > 0) {
       local_timer_start(seconds);
     } else if (pending_timer_valid && pending_timer_seconds > 0) {
-      local_timer_start(pending_timer_seconds);
+      seconds = pending_timer_seconds;
+      local_timer_start(seconds);
       pending_timer_valid = false;
     } else if (strcmp(intent_name, "HassTimerCancel") == 0 ||
                strcmp(intent_name, "HassTimerStop") == 0) {
       local_timer_stop();
       timer_started_from_stt = false;
+      seconds = 0;
     } else {
       ESP_LOGW(TAG, "Timer intent missing duration");
+      seconds = 0;
     }
     timer_local_handled = true;
     suppress_tts_audio = true;
     pending_timer_valid = false;
-    followup_vad_pending = false;
-    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, 0);
-    pipeline_post_cmd(PIPELINE_CMD_RESUME_WWD, 0);
+    followup_requested = false;
+    pipeline_post_cmd(PIPELINE_CMD_CONFIRM_BEEP, (int)seconds);
+    pipeline_post_event(VP_EVENT_HANDLED, 0);
     return;
   }
 
@@ -926,10 +1450,314 @@ static void handle_local_music_play(void) {
   }
 }
 
+/**
+ * @brief Match STT text (text != NULL) or a MultiNet command id
+ *
+ * Service strings are copied out, so the match stays valid if the grammar
+ * is replaced meanwhile.
+ */
+static bool intent_lookup(const char *text, int command_id,
+                          local_intent_match_t *out) {
+  if (!intents_mutex)
+    return false;
+
+  xSemaphoreTake(intents_mutex, portMAX_DELAY);
+  bool found = text ? local_intent_match_text(intents, text, out)
+                    : local_intent_match_command(intents, command_id, out);
+  if (found) {
+    snprintf(local_intent_service, sizeof(local_intent_service), "%s",
+             out->service ? out->service : "");
+    snprintf(local_intent_target, sizeof(local_intent_target), "%s",
+             out->target ? out->target : "");
+    out->service = local_intent_service;
+    out->target = local_intent_target;
+  }
+  xSemaphoreGive(intents_mutex);
+  return found;
+}
+
+static void set_output_volume(int volume) {
+  if (volume < 0)
+    volume = 0;
+  if (volume > 100)
+    volume = 100;
+  bsp_extra_codec_volume_set(volume, NULL);
+  if (mqtt_ha_is_connected())
+    (void)mqtt_ha_update_number("output_volume", (float)volume);
+
+  app_settings_t s;
+  if (settings_manager_load(&s) == ESP_OK) {
+    s.output_volume = volume;
+    (void)settings_manager_save(&s);
+  }
+  ESP_LOGI(TAG, "Output volume: %d", volume);
+}
+
+/**
+ * @brief Carry out a local intent (pipeline_task)
+ */
+static void run_local_intent(const local_intent_match_t *match) {
+  bool music = local_music_player_is_initialized();
+
+  switch (match->action) {
+  case LOCAL_INTENT_MUSIC_PLAY:
+    handle_local_music_play();
+    break;
+  case LOCAL_INTENT_MUSIC_STOP:
+    if (music)
+      local_music_player_stop();
+    break;
+  case LOCAL_INTENT_MUSIC_PAUSE:
+    if (music)
+      local_music_player_pause();
+    break;
+  case LOCAL_INTENT_MUSIC_NEXT:
+    if (music)
+      local_music_player_next();
+    break;
+  case LOCAL_INTENT_MUSIC_PREVIOUS:
+    if (music)
+      local_music_player_previous();
+    break;
+  case LOCAL_INTENT_VOLUME_UP:
+    set_output_volume(bsp_extra_codec_volume_get() + VOLUME_STEP);
+    break;
+  case LOCAL_INTENT_VOLUME_DOWN:
+    set_output_volume(bsp_extra_codec_volume_get() - VOLUME_STEP);
+    break;
+  case LOCAL_INTENT_VOLUME_SET:
+    if (match->value >= 0)
+      set_output_volume(match->value);
+    break;
+  case LOCAL_INTENT_TIMER_CANCEL:
+    local_timer_stop();
+    timer_started_from_stt = false;
+    break;
+  case LOCAL_INTENT_ALARM_STOP:
+    alarm_manager_stop_ringing();
+    break;
+  case LOCAL_INTENT_LED_ON:
+    led_status_set_guarded(LED_STATUS_LISTENING);
+    break;
+  case LOCAL_INTENT_LED_OFF:
+    led_status_set_guarded(LED_STATUS_IDLE);
+    break;
+  case LOCAL_INTENT_SERVICE: {
+    esp_err_t err =
+        ha_client_call_service(match->service, match->target[0] ? match->target
+                                                                : NULL);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "call_service %s failed: %s", match->service,
+               esp_err_to_name(err));
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// =============================================================================
+// OFFLINE COMMAND WINDOW
+// =============================================================================
+
+static void command_window_timeout_cb(TimerHandle_t timer) {
+  (void)timer;
+  pipeline_post_cmd(PIPELINE_CMD_COMMAND_FALLBACK, 0);
+}
+
+static void command_prebuffer_reset(void) {
+  portENTER_CRITICAL(&command_prebuffer_mux);
+  command_prebuffer_active = false;
+  command_prebuffer_len = 0;
+  command_prebuffer_overflow = false;
+  portEXIT_CRITICAL(&command_prebuffer_mux);
+}
+
+/**
+ * @brief Keep window audio for a possible HA run (fetch task)
+ *
+ * @return true if the chunk was taken by the buffer
+ */
+static bool command_prebuffer_capture(const uint8_t *audio_data,
+                                      size_t length) {
+  bool overflow = false;
+  portENTER_CRITICAL(&command_prebuffer_mux);
+  if (!command_prebuffer_active) {
+    portEXIT_CRITICAL(&command_prebuffer_mux);
+    return false;
+  }
+  if (warmup_chunks_skip > 0) {
+    warmup_chunks_skip--;
+  } else if (command_prebuffer_len + length <= COMMAND_PREBUFFER_BYTES) {
+    memcpy(command_prebuffer + command_prebuffer_len, audio_data, length);
+    command_prebuffer_len += length;
+  } else if (!command_prebuffer_overflow) {
+    command_prebuffer_overflow = true;
+    overflow = true;
+  }
+  portEXIT_CRITICAL(&command_prebuffer_mux);
+
+  if (overflow) {
+    // Still talking: end the window now rather than lose audio. Only queues
+    // a timer command, so the fetch task does not block.
+    xTimerChangePeriod(command_window_timer, 1, 0);
+  }
+  return true;
+}
+
+/**
+ * @brief No command recognised: open the HA run and replay the window
+ *
+ * Waits for HA on pipeline_task; the prebuffer is sized for the longest
+ * wait, so the utterance is not cut while the run opens.
+ *
+ * @param speech_ended VAD already saw the end of the utterance
+ */
+static void command_window_fallback(bool speech_ended) {
+  if (fsm.state == VP_STATE_STREAMING && speech_ended) {
+    // Queued by a VAD end while an earlier fallback waited for HA: the
+    // run it opened gets the end of speech
+    handle_vad_end_event(NULL);
+    return;
+  }
+  if (fsm.state != VP_STATE_COMMAND) {
+    return; // A command was recognised meanwhile
+  }
+  xTimerStop(command_window_timer, 0);
+  if (run_local_only) {
+    ESP_LOGI(TAG, "No offline command for local-only wake word %d",
+             run_wake_word);
+    pipeline_dispatch(VP_EVENT_STREAM_FAILED, 1, esp_timer_get_time());
+    return;
+  }
+  ESP_LOGI(TAG, "No offline command, handing over to HA (%u bytes buffered)",
+           (unsigned)command_prebuffer_len);
+
+  open_ha_run();
+  int64_t ready_deadline_us =
+      esp_timer_get_time() + COMMAND_AUDIO_READY_MS * 1000LL;
+  while (current_pipeline_handler && !ha_client_is_audio_ready() &&
+         esp_timer_get_time() < ready_deadline_us) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  if (!current_pipeline_handler || !ha_client_is_audio_ready()) {
+    ESP_LOGW(TAG, "HA run not available for the fallback");
+    pipeline_dispatch(VP_EVENT_STREAM_FAILED, 1, esp_timer_get_time());
+    return;
+  }
+
+  // Live chunks keep landing in the buffer until it has been drained, so
+  // HA gets the audio in order
+  pipeline_dispatch(VP_EVENT_STREAM_STARTED, 0, esp_timer_get_time());
+  size_t sent = 0;
+  while (1) {
+    portENTER_CRITICAL(&command_prebuffer_mux);
+    size_t available = command_prebuffer_len - sent;
+    if (available == 0) {
+      command_prebuffer_active = false;
+    }
+    portEXIT_CRITICAL(&command_prebuffer_mux);
+    if (available == 0) {
+      break;
+    }
+    size_t chunk =
+        available < COMMAND_FLUSH_CHUNK ? available : COMMAND_FLUSH_CHUNK;
+    ha_client_stream_audio(command_prebuffer + sent, chunk,
+                           current_pipeline_handler);
+    sent += chunk;
+  }
+
+  if (speech_ended) {
+    // Capture already stopped at the end of speech
+    handle_vad_end_event(NULL);
+  }
+}
+
+/**
+ * @brief Remember HA's conversation_id for the follow-ups of this session
+ *
+ * @param conversation_id From the intent result, NULL to start over
+ */
+static void session_note_conversation(const char *conversation_id) {
+  portENTER_CRITICAL(&session_mux);
+  if (conversation_id) {
+    strncpy(session_conversation_id, conversation_id,
+            sizeof(session_conversation_id) - 1);
+    session_conversation_id[sizeof(session_conversation_id) - 1] = '\0';
+  } else {
+    session_conversation_id[0] = '\0';
+  }
+  portEXIT_CRITICAL(&session_mux);
+}
+
+// HA finished the run; TTS is usually still playing (ha_client task)
+static void on_run_end(void) {
+  if (followup_requested) {
+    pipeline_post_cmd(PIPELINE_CMD_FOLLOWUP_PREPARE, 0);
+  }
+}
+
+/**
+ * @brief Open the follow-up run and capture while the answer plays
+ *
+ * HA gets the next assist_pipeline/run (same conversation_id) and the AFE
+ * its warm-up now, so listening starts on the first frame after playback
+ * instead of after a capture restart and a run round trip. Audio and VAD
+ * are discarded until the FOLLOWUP state.
+ */
+static void followup_prepare(void) {
+  if (fsm.state != VP_STATE_SPEAKING || !followup_requested ||
+      followup_prepared || !ha_client_is_connected()) {
+    return;
+  }
+  free_pipeline_handler(); // The finished run
+  open_ha_run();
+  if (!current_pipeline_handler) {
+    ESP_LOGW(TAG, "Early follow-up failed, will open it after playback");
+    (void)ha_client_abandon_run();
+    return;
+  }
+  followup_prepared = true;
+  ESP_LOGI(TAG, "Follow-up run open before playback end");
+}
+
+/**
+ * @brief Record the wake-to-result time of the current run (once per run)
+ *
+ * @param offline Handled by MultiNet without any HA involvement
+ */
+static void run_result_note(bool offline) {
+  if (run_result_noted || run_start_us == 0) {
+    return;
+  }
+  run_result_noted = true;
+  uint32_t ms = (uint32_t)((esp_timer_get_time() - run_start_us) / 1000);
+
+  run_stats.runs++;
+  if (offline) {
+    run_stats.offline_runs++;
+    offline_total_ms += ms;
+    run_stats.offline_last_ms = ms;
+    run_stats.offline_avg_ms =
+        (uint32_t)(offline_total_ms / run_stats.offline_runs);
+  } else {
+    uint32_t ha_runs = run_stats.runs - run_stats.offline_runs;
+    ha_total_ms += ms;
+    run_stats.ha_last_ms = ms;
+    run_stats.ha_avg_ms = (uint32_t)(ha_total_ms / ha_runs);
+  }
+  ESP_LOGI(TAG, "Run result via %s after %lu ms (%lu of %lu runs offline)",
+           offline ? "offline command" : "HA", (unsigned long)ms,
+           (unsigned long)run_stats.offline_runs,
+           (unsigned long)run_stats.runs);
+}
+
 // Timer manager callback when a timer expires
 static void timer_expired_callback(uint8_t timer_id) {
   ESP_LOGI(TAG, "Timer #%d expired! Playing alarm sound.", timer_id);
-  pipeline_post_cmd(PIPELINE_CMD_TIMER_BEEP, (int)timer_id);
+  alarm_from_timer = true;
+  pipeline_post_event(VP_EVENT_ALARM, (int)timer_id);
 }
 
 static void local_timer_start(uint32_t seconds) {
@@ -972,7 +1800,9 @@ static void local_timer_start(uint32_t seconds) {
              (unsigned)secs);
   }
 
-  ha_client_request_tts(tts_msg);
+  // The local voice confirms it from PIPELINE_CMD_CONFIRM_BEEP
+  if (!local_voice)
+    ha_client_request_tts(tts_msg);
 }
 
 static void local_timer_stop(void) {
@@ -980,6 +1810,62 @@ static void local_timer_stop(void) {
   ESP_LOGI(TAG, "All timers stopped");
 }
 
+/**
+ * @brief Speak a phrase with the local voice (pipeline_task, blocking)
+ *
+ * @return false if the voice is not loaded or lacks a unit of the phrase
+ */
+static bool local_voice_say(const local_tts_phrase_t *phrase) {
+  local_tts_t *voice = local_voice;
+  if (!local_tts_can_say(voice, phrase))
+    return false;
+  if (bsp_extra_codec_set_fs(LOCAL_TTS_SAMPLE_RATE, 16, I2S_SLOT_MODE_MONO) !=
+      ESP_OK)
+    return false;
+  bsp_extra_codec_mute_set(false);
+
+  int16_t buf[LOCAL_VOICE_CHUNK];
+  local_tts_reader_t reader;
+  local_tts_reader_init(&reader, phrase);
+  int64_t render_us = 0;
+  uint32_t samples = 0;
+  while (1) {
+    int64_t t0 = esp_timer_get_time();
+    size_t n = local_tts_read(voice, &reader, buf, LOCAL_VOICE_CHUNK);
+    render_us += esp_timer_get_time() - t0;
+    if (n == 0)
+      break;
+    size_t written = 0;
+    if (bsp_extra_i2s_write(buf, n * sizeof(int16_t), &written, 1000) !=
+        ESP_OK)
+      break;
+    samples += n;
+  }
+  ESP_LOGI(TAG, "Local voice: %lu ms of speech, rendered in %lu us",
+           (unsigned long)(samples / (LOCAL_TTS_SAMPLE_RATE / 1000)),
+           (unsigned long)render_us);
+  return true;
+}
+
+static bool local_voice_say_status(local_tts_status_t status) {
+  local_tts_phrase_t phrase;
+  local_tts_phrase_clear(&phrase);
+  return local_tts_phrase_status(&phrase, status) && local_voice_say(&phrase);
+}
+
+/**
+ * @brief Say why the run failed, or beep without the local voice
+ */
+static void play_error(vp_event_t event) {
+  local_tts_status_t status = LOCAL_TTS_ERROR;
+  if (event == VP_EVENT_TIMEOUT)
+    status = LOCAL_TTS_HA_NO_RESPONSE;
+  else if (!ha_client_is_connected() && !run_local_only)
+    status = LOCAL_TTS_HA_UNAVAILABLE;
+  if (!local_voice_say_status(status))
+    beep_tone_play(BEEP_ERROR_FREQ, BEEP_ERROR_DURATION, BEEP_ERROR_VOLUME);
+}
+
 static bool parse_timer_seconds_from_intent(const char *intent_data,
                                             uint32_t *out_seconds) {
   if (!intent_data || !out_seconds) {
@@ -1023,10 +1909,12 @@ static bool parse_timer_seconds_from_intent(const char *intent_data,
         }
       } else if (strcmp(name, "duration") == 0) {
         if (cJSON_IsString(value) && value->valuestring) {
-          uint32_t parsed = 0;
-          if (parse_duration_string_seconds(value->valuestring, &parsed) &&
-              parsed > 0) {
-            total_seconds += parsed;
+          duration_parse_result_t parsed;
+          double v = 0;
+          if (duration_parse(value->valuestring, &parsed)) {
+            total_seconds += parsed.seconds;
+          } else if (duration_parse_number(value->valuestring, &v) && v > 0) {
+            total_seconds += (uint32_t)v; // Bare number: seconds
           }
         } else if (cJSON_IsObject(value)) {
           const cJSON *sec =
@@ -1057,86 +1945,6 @@ static bool parse_timer_seconds_from_intent(const char *intent_data,
   return true;
 }
 
-static bool parse_duration_string_seconds(const char *text,
-                                          uint32_t *out_seconds) {
-  if (!text || !out_seconds) {
-    return false;
-  }
-
-  if (parse_iso8601_duration_seconds(text, out_seconds)) {
-    return true;
-  }
-
-  int parts[3] = {0, 0, 0};
-  int count = 0;
-  const char *p = text;
-  while (*p && count < 3) {
-    char *end = NULL;
-    long v = strtol(p, &end, 10);
-    if (end == p)
-      break;
-    parts[count++] = (int)v;
-    if (*end == ':') {
-      p = end + 1;
-    } else {
-      p = end;
-      break;
-    }
-  }
-
-  if (count == 3) {
-    *out_seconds = (uint32_t)(parts[0] * 3600 + parts[1] * 60 + parts[2]);
-    return true;
-  }
-  if (count == 2) {
-    *out_seconds = (uint32_t)(parts[0] * 60 + parts[1]);
-    return true;
-  }
-  if (count == 1) {
-    *out_seconds = (uint32_t)parts[0];
-    return true;
-  }
-
-  return false;
-}
-
-static bool parse_iso8601_duration_seconds(const char *text,
-                                           uint32_t *out_seconds) {
-  if (!text || !out_seconds) {
-    return false;
-  }
-
-  if (strncmp(text, "PT", 2) != 0) {
-    return false;
-  }
-
-  uint32_t total = 0;
-  const char *p = text + 2;
-  while (*p) {
-    char *end = NULL;
-    long v = strtol(p, &end, 10);
-    if (end == p)
-      return false;
-    if (*end == 'H') {
-      total += (uint32_t)(v * 3600);
-    } else if (*end == 'M') {
-      total += (uint32_t)(v * 60);
-    } else if (*end == 'S') {
-      total += (uint32_t)v;
-    } else {
-      return false;
-    }
-    p = end + 1;
-  }
-
-  if (total == 0) {
-    return false;
-  }
-
-  *out_seconds = total;
-  return true;
-}
-
 static bool parse_number_from_json_value(const cJSON *value, double *out) {
   if (!value || !out) {
     return false;
@@ -1146,12 +1954,8 @@ static bool parse_number_from_json_value(const cJSON *value, double *out) {
     return true;
   }
   if (cJSON_IsString(value) && value->valuestring) {
-    char *end = NULL;
-    double v = strtod(value->valuestring, &end);
-    if (end != value->valuestring) {
-      *out = v;
-      return true;
-    }
+    // "5", "2.5" or "dvadeset pet"
+    return duration_parse_number(value->valuestring, out);
   }
   if (cJSON_IsObject(value)) {
     const cJSON *v_item =
@@ -1169,92 +1973,12 @@ static bool parse_timer_seconds_from_text(const char *text,
     return false;
   }
 
-  bool has_timer = false;
-  uint32_t total_seconds = 0;
-  double pending = -1.0;
-  const char *p = text;
-
-  while (*p) {
-    while (*p && !isalnum((unsigned char)*p) && *p != ':' && *p != 'P' &&
-           *p != 'p') {
-      p++;
-    }
-    if (!*p)
-      break;
-
-    char word[32];
-    size_t len = 0;
-    while (*p && (isalnum((unsigned char)*p) || *p == ':' || *p == '-')) {
-      if (len < sizeof(word) - 1) {
-        word[len++] = *p;
-      }
-      p++;
-    }
-    word[len] = '\0';
-
-    char lower[32];
-    for (size_t i = 0; i < len && i < sizeof(lower) - 1; i++) {
-      lower[i] = (char)ascii_tolower_int((unsigned char)word[i]);
-    }
-    lower[len < sizeof(lower) - 1 ? len : sizeof(lower) - 1] = '\0';
-
-    if (is_timer_keyword(lower)) {
-      has_timer = true;
-      continue;
-    }
-
-    if (strcmp(lower, "pola") == 0) {
-      pending = 0.5;
-      continue;
-    }
-
-    if (strchr(lower, ':') || (lower[0] == 'p' && lower[1] == 't')) {
-      uint32_t parsed = 0;
-      if (parse_duration_string_seconds(lower, &parsed) && parsed > 0) {
-        total_seconds += parsed;
-        pending = -1.0;
-      }
-      continue;
-    }
-
-    int word_num = parse_cro_number_word(lower);
-    if (word_num >= 0) {
-      pending = (double)word_num;
-      continue;
-    }
-
-    char *end = NULL;
-    double v = strtod(lower, &end);
-    if (end != lower && *end == '\0') {
-      pending = v;
-      continue;
-    }
-
-    if (pending > 0) {
-      if (strcmp(lower, "sat") == 0 || strcmp(lower, "sata") == 0 ||
-          strcmp(lower, "sati") == 0 || strcmp(lower, "satova") == 0) {
-        total_seconds += (uint32_t)(pending * 3600.0);
-        pending = -1.0;
-      } else if (strcmp(lower, "min") == 0 || strcmp(lower, "minuta") == 0 ||
-                 strcmp(lower, "minute") == 0 || strcmp(lower, "minutu") == 0 ||
-                 strcmp(lower, "minut") == 0) {
-        total_seconds += (uint32_t)(pending * 60.0);
-        pending = -1.0;
-      } else if (strcmp(lower, "sek") == 0 || strcmp(lower, "sekunda") == 0 ||
-                 strcmp(lower, "sekundi") == 0 ||
-                 strcmp(lower, "sekunde") == 0 ||
-                 strcmp(lower, "sekundu") == 0) {
-        total_seconds += (uint32_t)(pending);
-        pending = -1.0;
-      }
-    }
-  }
-
-  if (total_seconds == 0 || !has_timer) {
+  duration_parse_result_t parsed;
+  if (!duration_parse(text, &parsed) || !parsed.has_timer_word) {
     return false;
   }
 
-  *out_seconds = total_seconds;
+  *out_seconds = parsed.seconds;
   return true;
 }
 
@@ -1286,90 +2010,6 @@ static bool response_indicates_timer_not_supported(const char *response_text) {
   return false;
 }
 
-static int parse_cro_number_word(const char *word) {
-  if (!word)
-    return -1;
-
-  // Basic numbers 0-12
-  if (strcmp(word, "nula") == 0)
-    return 0;
-  if (strcmp(word, "jedan") == 0 || strcmp(word, "jedna") == 0 ||
-      strcmp(word, "jednu") == 0)
-    return 1;
-  if (strcmp(word, "dva") == 0 || strcmp(word, "dvije") == 0)
-    return 2;
-  if (strcmp(word, "tri") == 0)
-    return 3;
-  if (strcmp(word, "cetiri") == 0 || strcmp(word, "chetiri") == 0)
-    return 4;
-  if (strcmp(word, "pet") == 0)
-    return 5;
-  if (strcmp(word, "sest") == 0 || strcmp(word, "shest") == 0)
-    return 6;
-  if (strcmp(word, "sedam") == 0)
-    return 7;
-  if (strcmp(word, "osam") == 0)
-    return 8;
-  if (strcmp(word, "devet") == 0)
-    return 9;
-  if (strcmp(word, "deset") == 0)
-    return 10;
-  if (strcmp(word, "jedanaest") == 0)
-    return 11;
-  if (strcmp(word, "dvanaest") == 0)
-    return 12;
-
-  // Teens 13-19
-  if (strcmp(word, "trinaest") == 0)
-    return 13;
-  if (strcmp(word, "cetrnaest") == 0 || strcmp(word, "chetrnaest") == 0)
-    return 14;
-  if (strcmp(word, "petnaest") == 0)
-    return 15;
-  if (strcmp(word, "sesnaest") == 0 || strcmp(word, "shesnaest") == 0)
-    return 16;
-  if (strcmp(word, "sedamnaest") == 0)
-    return 17;
-  if (strcmp(word, "osamnaest") == 0)
-    return 18;
-  if (strcmp(word, "devetnaest") == 0)
-    return 19;
-
-  // Tens 20-90
-  if (strcmp(word, "dvadeset") == 0)
-    return 20;
-  if (strcmp(word, "trideset") == 0)
-    return 30;
-  if (strcmp(word, "cetrdeset") == 0 || strcmp(word, "chetrdeset") == 0)
-    return 40;
-  if (strcmp(word, "pedeset") == 0)
-    return 50;
-  if (strcmp(word, "sezdeset") == 0 || strcmp(word, "shezdeset") == 0)
-    return 60;
-  if (strcmp(word, "sedamdeset") == 0)
-    return 70;
-  if (strcmp(word, "osamdeset") == 0)
-    return 80;
-  if (strcmp(word, "devedeset") == 0)
-    return 90;
-
-  return -1;
-}
-
-static bool is_timer_keyword(const char *word) {
-  if (!word)
-    return false;
-  if (strcmp(word, "timer") == 0 || strcmp(word, "tajmer") == 0)
-    return true;
-  if (strcmp(word, "odbrojavanje") == 0 || strcmp(word, "odbroj") == 0)
-    return true;
-  // New keywords
-  if (strcmp(word, "alarm") == 0 || strcmp(word, "alarma") == 0)
-    return true;
-  if (strcmp(word, "podsjetnik") == 0 || strcmp(word, "podsjetnika") == 0)
-    return true;
-  return false;
-}
 static bool response_requests_music_selection(const char *response_text) {
   if (!response_text || response_text[0] == '\0') {
     return false;
@@ -1432,7 +2072,7 @@ static int ascii_tolower_int(int c) {
   return c;
 }
 
-static void restart_task(void *arg) {
+static void restart_job(void *arg) {
   vTaskDelay(pdMS_TO_TICKS(2000));
   esp_restart();
 }
@@ -1467,7 +2107,9 @@ uint16_t va_control_get_agc_target_level(void) {
   return current_config.agc_target_level;
 }
 
-bool va_control_get_pipeline_active(void) { return is_pipeline_active; }
+bool va_control_get_pipeline_active(void) {
+  return pipeline_state() == VP_STATE_STREAMING;
+}
 
 bool va_control_get_wwd_running(void) { return is_wwd_running; }
 
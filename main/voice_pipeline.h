@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include "pipeline_fsm.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -54,6 +55,42 @@ void voice_pipeline_get_config(voice_pipeline_config_t *config);
 bool voice_pipeline_is_running(void); // WWD running?
 bool voice_pipeline_is_active(void);  // Processing/Speaking?
 
+// State machine dwell times and transition latencies (snapshot)
+esp_err_t voice_pipeline_get_fsm_stats(vp_fsm_t *stats);
+
+// Offline command window: after wake, MultiNet gets the first try and HA is
+// only asked if no command was recognised (needs a MultiNet model)
+void voice_pipeline_set_offline_commands(bool enable);
+bool voice_pipeline_get_offline_commands(void);
+
+// Wake-to-result latency, offline commands vs the HA pipeline
+typedef struct {
+  uint32_t runs;         // Runs that produced a result
+  uint32_t offline_runs; // Of those, handled by an offline command
+  uint32_t offline_last_ms;
+  uint32_t offline_avg_ms;
+  uint32_t ha_last_ms; // Wake to first TTS audio (or HA-side handling)
+  uint32_t ha_avg_ms;
+  uint32_t false_wakes; // Runs that heard no speech after the wake word
+} voice_pipeline_run_stats_t;
+
+void voice_pipeline_get_run_stats(voice_pipeline_run_stats_t *stats);
+
+// Where a wake word sends the run (word index from
+// audio_capture_get_wake_words()): "" or NULL = the preferred HA pipeline,
+// "local" = offline commands only, anything else = an HA assist pipeline id
+#define VOICE_PIPELINE_ROUTE_LOCAL "local"
+esp_err_t voice_pipeline_set_wake_route(int wake_word, const char *route);
+
+// Local command grammar (see local_intent.h); replaces the built-in one
+#define VOICE_PIPELINE_INTENTS_PATH "/sdcard/intents.txt"
+esp_err_t voice_pipeline_load_intents(const char *path);
+
+// Recorded words for timer and error phrases without HA (see local_tts.h);
+// loaded once into PSRAM
+#define VOICE_PIPELINE_VOICE_DIR "/sdcard/voice"
+esp_err_t voice_pipeline_load_voice(const char *dir);
+
 // Test commands
 void voice_pipeline_test_tts(const char *text);
 void voice_pipeline_trigger_restart(void);
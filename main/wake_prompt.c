@@ -6,7 +6,10 @@
 #include "wake_prompt.h"
 #include "bsp_board_extra.h"
 #include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "mp3dec.h"
 #include <stdio.h>
 #include <string.h>
@@ -15,9 +18,10 @@ static const char *TAG = "wake_prompt";
 
 #define WAKE_PROMPT_PATH "/sdcard/sounds/wake_prompt.mp3"
 #define MAX_AUDIO_SIZE (64 * 1024) // 64KB max for wake prompt
-#define PCM_BUFFER_SIZE (MAX_NCHAN * MAX_NSAMP * 2)
+#define PCM_BUFFER_SIZE (MAX_NGRAN * MAX_NCHAN * MAX_NSAMP * sizeof(int16_t))
 
 static uint8_t *audio_buffer = NULL;
+static int16_t *pcm_buffer = NULL; // One decoded frame, internal RAM
 static size_t audio_size = 0;
 static HMP3Decoder mp3_decoder = NULL;
 static bool is_initialized = false;
@@ -49,10 +53,18 @@ esp_err_t wake_prompt_init(void) {
     return ESP_ERR_INVALID_SIZE;
   }
 
-  // Allocate buffer
-  audio_buffer = (uint8_t *)malloc(audio_size);
-  if (audio_buffer == NULL) {
-    ESP_LOGE(TAG, "Failed to allocate audio buffer");
+  // The MP3 in PSRAM stays loaded while the SD card is released; the decoded
+  // frame is written to I2S every frame and kept in internal RAM
+  audio_buffer = mem_place_alloc(MEM_MOD_WAKE_PROMPT, MEM_PLACE_COLD,
+                                 audio_size);
+  if (pcm_buffer == NULL) {
+    pcm_buffer =
+        mem_place_alloc(MEM_MOD_WAKE_PROMPT, MEM_PLACE_HOT, PCM_BUFFER_SIZE);
+  }
+  if (audio_buffer == NULL || pcm_buffer == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate audio buffers");
+    mem_track_free(MEM_MOD_WAKE_PROMPT, audio_buffer);
+    audio_buffer = NULL;
     fclose(f);
     return ESP_ERR_NO_MEM;
   }
@@ -63,7 +75,7 @@ esp_err_t wake_prompt_init(void) {
 
   if (read != audio_size) {
     ESP_LOGE(TAG, "Failed to read audio file: %d/%d bytes", read, audio_size);
-    free(audio_buffer);
+    mem_track_free(MEM_MOD_WAKE_PROMPT, audio_buffer);
     audio_buffer = NULL;
     return ESP_FAIL;
   }
@@ -72,7 +84,7 @@ esp_err_t wake_prompt_init(void) {
   mp3_decoder = MP3InitDecoder();
   if (mp3_decoder == NULL) {
     ESP_LOGE(TAG, "Failed to initialize MP3 decoder");
-    free(audio_buffer);
+    mem_track_free(MEM_MOD_WAKE_PROMPT, audio_buffer);
     audio_buffer = NULL;
     return ESP_ERR_NO_MEM;
   }
@@ -92,13 +104,6 @@ esp_err_t wake_prompt_play(void) {
 
   ESP_LOGI(TAG, "Playing wake prompt...");
 
-  // Allocate PCM buffer
-  int16_t *pcm_buffer = (int16_t *)malloc(PCM_BUFFER_SIZE);
-  if (pcm_buffer == NULL) {
-    ESP_LOGE(TAG, "Failed to allocate PCM buffer");
-    return ESP_ERR_NO_MEM;
-  }
-
   // Ensure codec is unmuted
   bsp_extra_codec_mute_set(false);
 
@@ -143,7 +148,6 @@ esp_err_t wake_prompt_play(void) {
 
       if (ret != ESP_OK) {
         ESP_LOGE(TAG, "I2S write failed: %s", esp_err_to_name(ret));
-        free(pcm_buffer);
         return ret;
       }
 
@@ -160,7 +164,6 @@ esp_err_t wake_prompt_play(void) {
     }
   }
 
-  free(pcm_buffer);
   ESP_LOGI(TAG, "Wake prompt playback complete: %d samples", total_samples);
   return ESP_OK;
 }
@@ -0,0 +1,199 @@
+/**
+ * @file wake_verify.c
+ * @brief Second-stage check of wake word detections
+ */
+
+#include "wake_verify.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_MS 20
+#define MIN_PREROLL_FRAMES 10 // 200 ms of background before the word
+#define NOISE_PERCENTILE 25   // Pre-roll frame used as the noise floor
+#define VOICED_RATIO 4.0f     // 6 dB over the floor (energy ratio)
+
+struct wake_verify {
+  wake_verify_config_t cfg;
+  uint32_t frame_samples;
+  int frames;      ///< Ring capacity
+  int word_frames; ///< Frames in the word window
+  float *energy;   ///< Mean square per frame, ring
+  float *scratch;  ///< Sorting space for the noise floor
+  int head;        ///< Next frame slot
+  int filled;      ///< Frames in the ring
+  double acc;      ///< Sum of squares of the frame being built
+  uint32_t acc_samples;
+  int64_t hold_until_ms;
+  wake_verify_stats_t stats;
+};
+
+static const char *const result_names[WAKE_VERIFY_RESULT_COUNT] = {
+    [WAKE_VERIFY_ACCEPT] = "accept",
+    [WAKE_VERIFY_REJECT_COOLDOWN] = "cooldown",
+    [WAKE_VERIFY_REJECT_LEVEL] = "level",
+    [WAKE_VERIFY_REJECT_SNR] = "snr",
+    [WAKE_VERIFY_REJECT_VOICED] = "voiced",
+};
+
+void wake_verify_default_config(wake_verify_config_t *cfg) {
+  if (!cfg)
+    return;
+  cfg->sample_rate = 16000;
+  cfg->ring_ms = 2000;
+  cfg->word_ms = 800;
+  cfg->min_snr_db = 6.0f;
+  cfg->min_word_rms = 100;
+  cfg->min_voiced_ratio = 0.3f;
+  cfg->reject_cooldown_ms = 1000;
+}
+
+wake_verify_t *wake_verify_create(const wake_verify_config_t *cfg) {
+  if (!cfg || cfg->sample_rate < 1000 || cfg->word_ms < FRAME_MS ||
+      cfg->ring_ms < cfg->word_ms + MIN_PREROLL_FRAMES * FRAME_MS) {
+    return NULL;
+  }
+  wake_verify_t *wv = calloc(1, sizeof(*wv));
+  if (!wv)
+    return NULL;
+  wv->cfg = *cfg;
+  wv->frame_samples = cfg->sample_rate * FRAME_MS / 1000;
+  wv->frames = (int)(cfg->ring_ms / FRAME_MS);
+  wv->word_frames = (int)(cfg->word_ms / FRAME_MS);
+  wv->energy = calloc((size_t)wv->frames, sizeof(float));
+  wv->scratch = calloc((size_t)wv->frames, sizeof(float));
+  if (!wv->energy || !wv->scratch) {
+    wake_verify_free(wv);
+    return NULL;
+  }
+  return wv;
+}
+
+void wake_verify_free(wake_verify_t *wv) {
+  if (!wv)
+    return;
+  free(wv->energy);
+  free(wv->scratch);
+  free(wv);
+}
+
+void wake_verify_reset(wake_verify_t *wv) {
+  if (!wv)
+    return;
+  wv->head = 0;
+  wv->filled = 0;
+  wv->acc = 0.0;
+  wv->acc_samples = 0;
+}
+
+void wake_verify_push(wake_verify_t *wv, const int16_t *pcm, size_t samples) {
+  if (!wv || !pcm)
+    return;
+  for (size_t i = 0; i < samples; i++) {
+    wv->acc += (double)pcm[i] * pcm[i];
+    if (++wv->acc_samples < wv->frame_samples)
+      continue;
+    wv->energy[wv->head] = (float)(wv->acc / wv->acc_samples);
+    wv->head = (wv->head + 1) % wv->frames;
+    if (wv->filled < wv->frames)
+      wv->filled++;
+    wv->acc = 0.0;
+    wv->acc_samples = 0;
+  }
+}
+
+/**
+ * @brief Energy of the frame `age` frames before the newest (0 = newest)
+ */
+static float frame_at(const wake_verify_t *wv, int age) {
+  int idx = wv->head - 1 - age;
+  while (idx < 0)
+    idx += wv->frames;
+  return wv->energy[idx];
+}
+
+static int float_cmp(const void *a, const void *b) {
+  float fa = *(const float *)a;
+  float fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
+static wake_verify_result_t verdict(wake_verify_t *wv, int64_t now_ms,
+                                    wake_verify_result_t result) {
+  wv->stats.checks++;
+  wv->stats.results[result]++;
+  if (result != WAKE_VERIFY_ACCEPT && result != WAKE_VERIFY_REJECT_COOLDOWN)
+    wake_verify_hold(wv, now_ms, wv->cfg.reject_cooldown_ms);
+  return result;
+}
+
+wake_verify_result_t wake_verify_check(wake_verify_t *wv, int64_t now_ms) {
+  if (!wv)
+    return WAKE_VERIFY_ACCEPT;
+  if (now_ms < wv->hold_until_ms)
+    return verdict(wv, now_ms, WAKE_VERIFY_REJECT_COOLDOWN);
+
+  int word_frames = wv->filled < wv->word_frames ? wv->filled : wv->word_frames;
+  if (word_frames == 0)
+    return verdict(wv, now_ms, WAKE_VERIFY_ACCEPT); // Nothing to judge by
+
+  double word_sum = 0.0;
+  for (int i = 0; i < word_frames; i++)
+    word_sum += frame_at(wv, i);
+  float word_energy = (float)(word_sum / word_frames);
+  if (sqrtf(word_energy) < wv->cfg.min_word_rms)
+    return verdict(wv, now_ms, WAKE_VERIFY_REJECT_LEVEL);
+
+  int preroll = wv->filled - word_frames;
+  if (preroll < MIN_PREROLL_FRAMES) {
+    wv->stats.last_snr_db = 0.0f;
+    wv->stats.last_voiced = 0.0f;
+    return verdict(wv, now_ms, WAKE_VERIFY_ACCEPT);
+  }
+
+  // Noise floor: a low percentile of the pre-roll, so speech just before
+  // the wake word does not raise it much
+  for (int i = 0; i < preroll; i++)
+    wv->scratch[i] = frame_at(wv, word_frames + i);
+  qsort(wv->scratch, (size_t)preroll, sizeof(float), float_cmp);
+  float noise = wv->scratch[preroll * NOISE_PERCENTILE / 100];
+  if (noise < 1.0f)
+    noise = 1.0f;
+
+  int voiced = 0;
+  for (int i = 0; i < word_frames; i++) {
+    if (frame_at(wv, i) > noise * VOICED_RATIO)
+      voiced++;
+  }
+  wv->stats.last_snr_db = 10.0f * log10f(word_energy / noise);
+  wv->stats.last_voiced = (float)voiced / (float)word_frames;
+
+  if (wv->stats.last_snr_db < wv->cfg.min_snr_db)
+    return verdict(wv, now_ms, WAKE_VERIFY_REJECT_SNR);
+  if (wv->stats.last_voiced < wv->cfg.min_voiced_ratio)
+    return verdict(wv, now_ms, WAKE_VERIFY_REJECT_VOICED);
+  return verdict(wv, now_ms, WAKE_VERIFY_ACCEPT);
+}
+
+void wake_verify_hold(wake_verify_t *wv, int64_t now_ms,
+                      uint32_t duration_ms) {
+  if (!wv)
+    return;
+  int64_t until = now_ms + duration_ms;
+  if (until > wv->hold_until_ms)
+    wv->hold_until_ms = until;
+}
+
+void wake_verify_get_stats(const wake_verify_t *wv,
+                           wake_verify_stats_t *stats) {
+  if (!wv || !stats)
+    return;
+  *stats = wv->stats;
+}
+
+const char *wake_verify_result_name(wake_verify_result_t result) {
+  if (result < 0 || result >= WAKE_VERIFY_RESULT_COUNT)
+    return "?";
+  return result_names[result];
+}
@@ -0,0 +1,110 @@
+/**
+ * @file wake_verify.h
+ * @brief Second-stage check of wake word detections
+ *
+ * WakeNet fires on anything close enough to the wake word, including TV
+ * speech and our own TTS tail. Every false wake costs a capture restart, a
+ * prompt and an HA run, so detections are checked against the audio that
+ * led up to them before anything else happens:
+ *
+ *  - the word window (the last ~0.8 s) must be louder than the noise floor
+ *    of the pre-roll by min_snr_db, and above an absolute floor;
+ *  - enough of the word window must be voiced (frames well above the floor),
+ *    which rejects clicks and short bursts;
+ *  - detections inside a cooldown window (after a rejection, or one set by
+ *    the caller, e.g. right after TTS) are dropped.
+ *
+ * Only frame energies (20 ms) are kept, not the audio itself, so a check is
+ * a pass over about a hundred numbers.
+ *
+ * The module has no ESP-IDF dependencies and takes time as a parameter. It
+ * is not thread-safe: the capture task pushes audio and runs the checks.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint32_t sample_rate;        ///< Hz (16000)
+  uint32_t ring_ms;            ///< Energy history kept (pre-roll + word)
+  uint32_t word_ms;            ///< Window before the detection (the word)
+  float min_snr_db;            ///< Word energy over the pre-roll noise floor
+  uint16_t min_word_rms;       ///< Absolute word level (int16 RMS)
+  float min_voiced_ratio;      ///< Share of word frames 6 dB over the floor
+  uint32_t reject_cooldown_ms; ///< Detections ignored after a rejection
+} wake_verify_config_t;
+
+typedef enum {
+  WAKE_VERIFY_ACCEPT = 0,
+  WAKE_VERIFY_REJECT_COOLDOWN,
+  WAKE_VERIFY_REJECT_LEVEL,  ///< Word too quiet
+  WAKE_VERIFY_REJECT_SNR,    ///< Word not above the background
+  WAKE_VERIFY_REJECT_VOICED, ///< Too little sustained sound in the word
+  WAKE_VERIFY_RESULT_COUNT
+} wake_verify_result_t;
+
+typedef struct {
+  uint32_t checks;
+  uint32_t results[WAKE_VERIFY_RESULT_COUNT];
+  float last_snr_db; ///< Of the most recent check
+  float last_voiced; ///< Voiced share of the most recent check
+} wake_verify_stats_t;
+
+typedef struct wake_verify wake_verify_t;
+
+/**
+ * @brief Defaults for 16 kHz wake word audio
+ */
+void wake_verify_default_config(wake_verify_config_t *cfg);
+
+/**
+ * @return Verifier, or NULL if out of memory or the config is invalid
+ */
+wake_verify_t *wake_verify_create(const wake_verify_config_t *cfg);
+
+void wake_verify_free(wake_verify_t *wv);
+
+/**
+ * @brief Drop the energy history (capture restarted); keeps cooldown/stats
+ */
+void wake_verify_reset(wake_verify_t *wv);
+
+/**
+ * @brief Add audio that WakeNet has seen
+ *
+ * @param pcm 16-bit mono samples
+ * @param samples Number of samples
+ */
+void wake_verify_push(wake_verify_t *wv, const int16_t *pcm, size_t samples);
+
+/**
+ * @brief Check a detection against the audio pushed so far
+ *
+ * With less history than the word window plus a little pre-roll (right
+ * after a restart) only the cooldown and level checks apply.
+ *
+ * @param now_ms Monotonic time
+ */
+wake_verify_result_t wake_verify_check(wake_verify_t *wv, int64_t now_ms);
+
+/**
+ * @brief Ignore detections until now_ms + duration_ms
+ *
+ * Extends, never shortens, a running cooldown.
+ */
+void wake_verify_hold(wake_verify_t *wv, int64_t now_ms, uint32_t duration_ms);
+
+void wake_verify_get_stats(const wake_verify_t *wv, wake_verify_stats_t *stats);
+
+const char *wake_verify_result_name(wake_verify_result_t result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,8 @@
 #include "ha_client.h"
 #include "led_status.h"
 #include "local_music_player.h"
+#include "mem_place.h"
+#include "mem_track.h"
 #include "mqtt_ha.h"
 #include "network_manager.h"
 #include "ota_update.h"
@@ -31,7 +33,7 @@ static httpd_handle_t server = NULL;
 static bool server_running = false;
 
 #define LOG_BUFFER_SIZE 8192
-static char log_buffer[LOG_BUFFER_SIZE];
+static char *log_buffer = NULL; // PSRAM, allocated once by webserial_init()
 static size_t log_buffer_pos = 0;
 static uint32_t log_seq = 0;
 static uint32_t log_base_seq = 0;
@@ -297,6 +299,20 @@ static esp_err_t api_status_handler(httpd_req_t *req) {
   return httpd_resp_send(req, json, strlen(json));
 }
 
+static esp_err_t api_memory_handler(httpd_req_t *req) {
+  const size_t len = 2048;
+  char *json = malloc(len);
+  if (!json) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+    return ESP_FAIL;
+  }
+  size_t n = mem_track_format_json(json, len);
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t ret = httpd_resp_send(req, json, n);
+  free(json);
+  return ret;
+}
+
 static esp_err_t api_action_handler(httpd_req_t *req) {
   char body[128];
   if (recv_body(req, body, sizeof(body)) == ESP_OK) {
@@ -353,16 +369,25 @@ static esp_err_t webserial_page_handler(httpd_req_t *req) {
 esp_err_t webserial_init(void) {
   if (server_running)
     return ESP_OK;
+  if (!log_buffer) {
+    log_buffer = mem_place_alloc(MEM_MOD_WEB, MEM_PLACE_COLD, LOG_BUFFER_SIZE);
+    if (!log_buffer) {
+      return ESP_ERR_NO_MEM;
+    }
+    log_buffer[0] = '\0';
+  }
   log_mutex = xSemaphoreCreateMutex();
 
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.max_open_sockets = 5; // Increased for better stability
   config.max_req_hdr_len = 8192;
+  config.max_uri_handlers = 12; // Default 8 is taken
 
   if (httpd_start(&server, &config) == ESP_OK) {
     httpd_uri_t uris[] = {
         {"/", HTTP_GET, dashboard_handler, NULL},
         {"/api/status", HTTP_GET, api_status_handler, NULL},
+        {"/api/memory", HTTP_GET, api_memory_handler, NULL},
         {"/api/action", HTTP_POST, api_action_handler, NULL},
         {"/api/config", HTTP_POST, api_config_handler, NULL},
         {"/api/ota", HTTP_POST, api_ota_handler, NULL},
@@ -209,3 +209,17 @@ esp_err_t wifi_manager_stop(void)
 
     return ESP_OK;
 }
+
+esp_err_t wifi_manager_set_power_save(bool standby)
+{
+    // Max modem sleep wakes only for every listen_interval-th beacon; the
+    // association and DHCP lease survive, traffic just sees more latency
+    wifi_ps_type_t ps = standby ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM;
+    esp_err_t ret = esp_wifi_set_ps(ps);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_set_ps failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "WiFi power save: %s", standby ? "standby (max modem)" : "active (min modem)");
+    return ESP_OK;
+}
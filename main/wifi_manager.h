@@ -60,6 +60,15 @@ static inline bool wifi_manager_is_active(void) {
  */
 esp_err_t wifi_manager_stop(void);
 
+/**
+ * @brief Switch WiFi power save between standby and active use
+ *
+ * @param standby true: maximum modem sleep while Ethernet carries traffic,
+ *                false: default modem sleep for active use
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_manager_set_power_save(bool standby);
+
 #ifdef __cplusplus
 }
 #endif
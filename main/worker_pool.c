@@ -0,0 +1,121 @@
+/**
+ * @file worker_pool.c
+ * @brief Fixed set of tasks running submitted jobs
+ */
+
+#include "worker_pool.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "worker_pool";
+
+typedef struct {
+  worker_job_fn_t fn; // NULL: worker exits
+  void *arg;
+} worker_job_t;
+
+struct worker_pool {
+  QueueHandle_t jobs;
+  SemaphoreHandle_t exited; // Counts workers that have stopped
+  int workers;
+};
+
+static void worker_task(void *arg) {
+  worker_pool_handle_t pool = arg;
+  worker_job_t job;
+
+  while (xQueueReceive(pool->jobs, &job, portMAX_DELAY) == pdTRUE) {
+    if (!job.fn) {
+      break;
+    }
+    job.fn(job.arg);
+  }
+
+  xSemaphoreGive(pool->exited);
+  vTaskDelete(NULL);
+}
+
+esp_err_t worker_pool_create(const worker_pool_config_t *config,
+                             worker_pool_handle_t *out) {
+  if (!config || !out || config->workers <= 0 || config->queue_len <= 0 ||
+      (config->stacks && !config->tcbs)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  worker_pool_handle_t pool = calloc(1, sizeof(*pool));
+  if (!pool) {
+    return ESP_ERR_NO_MEM;
+  }
+  // Room for the stop markers on top of the jobs
+  pool->jobs =
+      xQueueCreate(config->queue_len + config->workers, sizeof(worker_job_t));
+  pool->exited = xSemaphoreCreateCounting(config->workers, 0);
+  if (!pool->jobs || !pool->exited) {
+    ESP_LOGE(TAG, "Failed to create pool sync objects");
+    worker_pool_destroy(pool);
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (int i = 0; i < config->workers; i++) {
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "%s%d", config->name ? config->name : "wp", i);
+    bool created;
+    if (config->stacks) {
+      created = xTaskCreateStatic(worker_task, name, config->stack_size, pool,
+                                  config->priority, config->stacks[i],
+                                  config->tcbs[i]) != NULL;
+    } else {
+      created = xTaskCreate(worker_task, name, config->stack_size, pool,
+                            config->priority, NULL) == pdPASS;
+    }
+    if (!created) {
+      ESP_LOGE(TAG, "Failed to create worker %s", name);
+      worker_pool_destroy(pool);
+      return ESP_ERR_NO_MEM;
+    }
+    pool->workers++;
+  }
+
+  *out = pool;
+  return ESP_OK;
+}
+
+esp_err_t worker_pool_submit(worker_pool_handle_t pool, worker_job_fn_t fn,
+                             void *arg, uint32_t timeout_ms) {
+  if (!pool || !fn) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  worker_job_t job = {.fn = fn, .arg = arg};
+  if (xQueueSend(pool->jobs, &job, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    return ESP_ERR_TIMEOUT;
+  }
+  return ESP_OK;
+}
+
+void worker_pool_destroy(worker_pool_handle_t pool) {
+  if (!pool) {
+    return;
+  }
+
+  // One stop marker per worker, queued behind the remaining jobs
+  worker_job_t stop = {0};
+  for (int i = 0; i < pool->workers; i++) {
+    xQueueSend(pool->jobs, &stop, portMAX_DELAY);
+  }
+  for (int i = 0; i < pool->workers; i++) {
+    xSemaphoreTake(pool->exited, portMAX_DELAY);
+  }
+
+  if (pool->jobs) {
+    vQueueDelete(pool->jobs);
+  }
+  if (pool->exited) {
+    vSemaphoreDelete(pool->exited);
+  }
+  free(pool);
+}
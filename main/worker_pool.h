@@ -0,0 +1,67 @@
+/**
+ * @file worker_pool.h
+ * @brief Fixed set of tasks running submitted jobs
+ *
+ * Jobs are queued FIFO and picked up by whichever worker is free. A job may
+ * block (network waits, model loading): the other workers keep going.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct worker_pool *worker_pool_handle_t;
+
+typedef void (*worker_job_fn_t)(void *arg);
+
+/**
+ * @brief Worker pool configuration
+ */
+typedef struct {
+  const char *name;           ///< Task name prefix (workers are "<name>0", ...)
+  int workers;                ///< Number of tasks
+  uint32_t stack_size;        ///< Stack per worker in bytes (internal RAM)
+  int priority;               ///< Task priority
+  int queue_len;              ///< Jobs that can wait for a worker
+  StackType_t *const *stacks; ///< Optional: stack per worker (stack_size)
+  StaticTask_t *const *tcbs;  ///< Required with stacks: TCB per worker
+} worker_pool_config_t;
+
+/**
+ * @brief Create a pool and start its workers
+ *
+ * With config->stacks the workers run on that memory and nothing is
+ * allocated for them; it must stay valid for the life of the pool.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG or ESP_ERR_NO_MEM
+ */
+esp_err_t worker_pool_create(const worker_pool_config_t *config,
+                             worker_pool_handle_t *out);
+
+/**
+ * @brief Queue a job
+ *
+ * @param timeout_ms Time to wait for room in the queue
+ * @return ESP_OK, or ESP_ERR_TIMEOUT if the queue stayed full
+ */
+esp_err_t worker_pool_submit(worker_pool_handle_t pool, worker_job_fn_t fn,
+                             void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief Let queued jobs finish, stop the workers and free the pool
+ *
+ * Blocks until every worker has exited. Must not be called from a job.
+ */
+void worker_pool_destroy(worker_pool_handle_t pool);
+
+#ifdef __cplusplus
+}
+#endif
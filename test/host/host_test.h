@@ -0,0 +1,40 @@
+/**
+ * @file host_test.h
+ * @brief Minimal checks for the host tests
+ *
+ * A failed check prints where and carries on, so one run reports every
+ * failure; host_test_done() turns the count into the exit status.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+static int host_test_failures;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      host_test_failures++;                                                    \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do {                                                                         \
+    long long va_ = (long long)(a), vb_ = (long long)(b);                      \
+    if (va_ != vb_) {                                                          \
+      fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__,      \
+              __LINE__, #a, #b, va_, vb_);                                     \
+      host_test_failures++;                                                    \
+    }                                                                          \
+  } while (0)
+
+static inline int host_test_done(const char *name) {
+  if (host_test_failures) {
+    printf("%s: %d check(s) FAILED\n", name, host_test_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
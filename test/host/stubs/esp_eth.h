@@ -0,0 +1,60 @@
+/**
+ * @file esp_eth.h
+ * @brief Host stand-in: Ethernet driver setup and link events
+ *
+ * Only the configuration shapes network_manager fills in; the test defines
+ * the driver calls.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef void *esp_eth_handle_t;
+typedef struct esp_eth_mac_s esp_eth_mac_t;
+typedef struct esp_eth_phy_s esp_eth_phy_t;
+
+typedef struct {
+  int unused;
+} eth_mac_config_t;
+
+typedef struct {
+  struct {
+    int mdc_num;
+    int mdio_num;
+  } smi_gpio;
+} eth_esp32_emac_config_t;
+
+typedef struct {
+  int phy_addr;
+  int reset_gpio_num;
+} eth_phy_config_t;
+
+typedef struct {
+  esp_eth_mac_t *mac;
+  esp_eth_phy_t *phy;
+} esp_eth_config_t;
+
+#define ETH_MAC_DEFAULT_CONFIG() ((eth_mac_config_t){0})
+#define ETH_ESP32_EMAC_DEFAULT_CONFIG() ((eth_esp32_emac_config_t){{0, 0}})
+#define ETH_PHY_DEFAULT_CONFIG() ((eth_phy_config_t){0, 0})
+#define ETH_DEFAULT_CONFIG(m, p) ((esp_eth_config_t){.mac = (m), .phy = (p)})
+
+extern esp_event_base_t const ETH_EVENT;
+
+typedef enum {
+  ETHERNET_EVENT_START,
+  ETHERNET_EVENT_STOP,
+  ETHERNET_EVENT_CONNECTED,
+  ETHERNET_EVENT_DISCONNECTED,
+} eth_event_t;
+
+esp_eth_mac_t *esp_eth_mac_new_esp32(const eth_esp32_emac_config_t *emac,
+                                     const eth_mac_config_t *mac);
+esp_eth_phy_t *esp_eth_phy_new_ip101(const eth_phy_config_t *config);
+esp_err_t esp_eth_driver_install(const esp_eth_config_t *config,
+                                 esp_eth_handle_t *handle);
+void *esp_eth_new_netif_glue(esp_eth_handle_t handle);
+esp_err_t esp_eth_start(esp_eth_handle_t handle);
+esp_err_t esp_eth_stop(esp_eth_handle_t handle);
@@ -0,0 +1,8 @@
+/**
+ * @file esp_eth_mac.h
+ * @brief Host stand-in: everything lives in esp_eth.h
+ */
+
+#pragma once
+
+#include "esp_eth.h"
@@ -0,0 +1,33 @@
+/**
+ * @file esp_heap_caps.h
+ * @brief Host stand-in: one heap, capabilities ignored
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps) {
+  (void)caps;
+  return malloc(size);
+}
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+  (void)caps;
+  return calloc(n, size);
+}
+
+static inline void *heap_caps_aligned_alloc(size_t align, size_t size,
+                                            uint32_t caps) {
+  (void)caps;
+  return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static inline void heap_caps_free(void *p) { free(p); }
@@ -0,0 +1,37 @@
+/**
+ * @file esp_log.h
+ * @brief Host stand-in: warnings and errors to stderr, the rest dropped
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...)                                                \
+  fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)                                                \
+  fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+// Type-checked and their arguments counted as used, but silent
+#define ESP_LOG_QUIET(tag, fmt, ...)                                           \
+  do {                                                                         \
+    if (0) {                                                                   \
+      fprintf(stderr, "%s: " fmt "\n", tag, ##__VA_ARGS__);                    \
+    }                                                                          \
+  } while (0)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_QUIET(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOG_QUIET(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_LOG_QUIET(tag, fmt, ##__VA_ARGS__)
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+static inline void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  (void)tag;
+  (void)level;
+}
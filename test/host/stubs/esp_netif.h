@@ -0,0 +1,66 @@
+/**
+ * @file esp_netif.h
+ * @brief Host stand-in: netif handles, IP info and IP events
+ *
+ * Netifs are opaque; the test defines the calls and decides which handle
+ * each key returns.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+  uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+  esp_ip4_addr_t netmask;
+  esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum { ESP_NETIF_DNS_MAIN } esp_netif_dns_type_t;
+
+typedef struct {
+  int unused;
+} esp_netif_config_t;
+
+#define ESP_NETIF_DEFAULT_ETH() ((esp_netif_config_t){0})
+
+extern esp_event_base_t const IP_EVENT;
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP,
+  IP_EVENT_STA_LOST_IP,
+  IP_EVENT_ETH_GOT_IP,
+} ip_event_t;
+
+typedef struct {
+  int if_index;
+  esp_netif_ip_info_t ip_info;
+  bool ip_changed;
+} ip_event_got_ip_t;
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(a)                                                              \
+  (int)((a)->addr & 0xff), (int)(((a)->addr >> 8) & 0xff),                     \
+      (int)(((a)->addr >> 16) & 0xff), (int)(((a)->addr >> 24) & 0xff)
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_new(const esp_netif_config_t *config);
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *key);
+esp_err_t esp_netif_set_default_netif(esp_netif_t *netif);
+esp_err_t esp_netif_attach(esp_netif_t *netif, void *glue);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *info);
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *info);
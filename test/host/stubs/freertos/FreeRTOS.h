@@ -0,0 +1,33 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in: the FreeRTOS types the tested modules use
+ *
+ * Tasks are pthreads and mutexes are pthread mutexes (semphr.h, task.h);
+ * one tick is one millisecond. Critical sections are a pthread mutex per
+ * portMUX, which is enough for modules that never nest them.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffU
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
@@ -0,0 +1,82 @@
+/**
+ * @file semphr.h
+ * @brief Host stand-in: mutexes and binary semaphores on pthreads
+ *
+ * Both are a count guarded by a condition variable: a mutex starts at one,
+ * a binary semaphore at zero, and neither goes above one.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count;
+} host_sem_t;
+
+typedef host_sem_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t host_sem_create(int count) {
+  SemaphoreHandle_t s = malloc(sizeof(*s));
+  if (s) {
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->count = count;
+  }
+  return s;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return host_sem_create(1);
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return host_sem_create(0);
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t t) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += t / 1000;
+  deadline.tv_nsec += (long)(t % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&s->lock);
+  while (s->count == 0 && t != 0) {
+    if (t == portMAX_DELAY) {
+      pthread_cond_wait(&s->cond, &s->lock);
+    } else if (pthread_cond_timedwait(&s->cond, &s->lock, &deadline) ==
+               ETIMEDOUT) {
+      break;
+    }
+  }
+  BaseType_t got = s->count > 0;
+  if (got) {
+    s->count--;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return got ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  pthread_mutex_lock(&s->lock);
+  BaseType_t ok = s->count == 0;
+  s->count = 1;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  return ok ? pdTRUE : pdFALSE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t s) {
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file task.h
+ * @brief Host stand-in: task handles with notifications
+ *
+ * The tests start tasks themselves (on pthreads) and hand out a
+ * host_task_t as the handle; this header only provides the calls the
+ * modules make on a handle.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <pthread.h>
+
+typedef struct {
+  int x;
+} StaticTask_t;
+
+typedef struct host_task {
+  pthread_t thread;
+  SemaphoreHandle_t notify;
+  TaskFunction_t fn;
+  void *arg;
+} host_task_t;
+
+typedef host_task_t *TaskHandle_t;
+
+extern __thread host_task_t *host_current_task;
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  xSemaphoreGive(task->notify);
+  return pdPASS;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t t) {
+  (void)clear; // Notifications are binary here
+  return xSemaphoreTake(host_current_task->notify, t) == pdTRUE;
+}
+
+static inline void vTaskDelay(TickType_t t) {
+  struct timespec ts = {t / 1000, (long)(t % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
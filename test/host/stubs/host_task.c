@@ -0,0 +1,33 @@
+/**
+ * @file host_task.c
+ * @brief Host stand-in: tasks as detached pthreads
+ */
+
+#include "host_task.h"
+#include <stdlib.h>
+
+__thread host_task_t *host_current_task;
+
+static void *trampoline(void *p) {
+  host_task_t *task = p;
+  host_current_task = task;
+  task->fn(task->arg);
+  return NULL;
+}
+
+TaskHandle_t host_task_start(TaskFunction_t fn, void *arg) {
+  host_task_t *task = calloc(1, sizeof(*task));
+  if (!task) {
+    return NULL;
+  }
+  task->fn = fn;
+  task->arg = arg;
+  task->notify = xSemaphoreCreateBinary();
+  if (!task->notify ||
+      pthread_create(&task->thread, NULL, trampoline, task) != 0) {
+    free(task);
+    return NULL;
+  }
+  pthread_detach(task->thread);
+  return task;
+}
@@ -0,0 +1,14 @@
+/**
+ * @file host_task.h
+ * @brief Host stand-in: start a FreeRTOS-style task on a pthread
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Run fn(arg) on a new thread; NULL if it cannot be started
+ */
+TaskHandle_t host_task_start(TaskFunction_t fn, void *arg);
@@ -0,0 +1,116 @@
+/**
+ * @file mp3dec.h
+ * @brief Host stand-in for libhelix: a frame-level model, not a decoder
+ *
+ * MP3Decode() checks and consumes one whole Layer III frame the way libhelix
+ * does (sync, header, underflow when the frame is not all in the buffer) and
+ * writes PCM made from the frame's own bytes, mp3_model_sample(). A test can
+ * then walk the file's frames itself and know exactly what the plug-in must
+ * return, which checks the plug-in's syncing, refilling, ID3 skipping and
+ * seeking. The bit reservoir is not modelled: every frame stands alone.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MAINBUF_SIZE 1940
+#define MAX_NCHAN 2
+#define MAX_NGRAN 2
+#define MAX_NSAMP 576
+
+enum {
+  ERR_MP3_NONE = 0,
+  ERR_MP3_INDATA_UNDERFLOW = -1,
+  ERR_MP3_MAINDATA_UNDERFLOW = -2,
+  ERR_MP3_INVALID_FRAMEHEADER = -6,
+};
+
+typedef struct {
+  int bitrate;
+  int nChans;
+  int samprate;
+  int bitsPerSample;
+  int outputSamps;
+  int layer;
+  int version;
+} MP3FrameInfo;
+
+typedef MP3FrameInfo *HMP3Decoder;
+
+/**
+ * @brief Parse a Layer III header
+ *
+ * @return Frame length in bytes, 0 if h is not a valid header
+ */
+static inline int mp3_model_frame(const unsigned char *h, MP3FrameInfo *info) {
+  static const short kbps[2][15] = {
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}};
+  static const int rates[3] = {44100, 48000, 32000};
+  int version = (h[1] >> 3) & 3, br = h[2] >> 4, sr = (h[2] >> 2) & 3;
+  if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0 || version == 1 ||
+      ((h[1] >> 1) & 3) != 1 || br == 0 || br == 15 || sr == 3) {
+    return 0;
+  }
+  int mpeg1 = version == 3;
+  info->samprate = rates[sr] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+  info->bitrate = kbps[mpeg1][br] * 1000;
+  info->nChans = (h[3] >> 6) == 3 ? 1 : 2;
+  info->bitsPerSample = 16;
+  info->outputSamps = info->nChans * (mpeg1 ? 1152 : 576);
+  info->layer = 3;
+  info->version = mpeg1 ? 0 : (version == 2 ? 1 : 2);
+  return (mpeg1 ? 144 : 72) * kbps[mpeg1][br] * 1000 / info->samprate +
+         ((h[2] >> 1) & 1);
+}
+
+/**
+ * @brief Output sample k of the frame at f (len bytes)
+ */
+static inline short mp3_model_sample(const unsigned char *f, int len, int k) {
+  return (short)((f[4 + k % (len - 4)] << 8) ^ (k * 37));
+}
+
+static inline HMP3Decoder MP3InitDecoder(void) {
+  return calloc(1, sizeof(MP3FrameInfo));
+}
+
+static inline void MP3FreeDecoder(HMP3Decoder d) { free(d); }
+
+static inline int MP3FindSyncWord(unsigned char *buf, int n) {
+  for (int i = 0; i + 1 < n; i++) {
+    if (buf[i] == 0xFF && (buf[i + 1] & 0xE0) == 0xE0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static inline int MP3Decode(HMP3Decoder d, unsigned char **in, int *left,
+                            short *out, int mode) {
+  (void)mode;
+  if (*left < 4) {
+    return ERR_MP3_INDATA_UNDERFLOW;
+  }
+  MP3FrameInfo info;
+  int len = mp3_model_frame(*in, &info);
+  if (len == 0) {
+    return ERR_MP3_INVALID_FRAMEHEADER;
+  }
+  if (*left < len) {
+    return ERR_MP3_INDATA_UNDERFLOW;
+  }
+  for (int k = 0; k < info.outputSamps; k++) {
+    out[k] = mp3_model_sample(*in, len, k);
+  }
+  *d = info;
+  *in += len;
+  *left -= len;
+  return ERR_MP3_NONE;
+}
+
+static inline void MP3GetLastFrameInfo(HMP3Decoder d, MP3FrameInfo *info) {
+  *info = *d;
+}
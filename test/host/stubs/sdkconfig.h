@@ -0,0 +1,8 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host stand-in for the ESP32-P4 options the tested modules read
+ */
+
+#pragma once
+
+#define CONFIG_CACHE_L2_CACHE_LINE_SIZE 128
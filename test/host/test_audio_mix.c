@@ -0,0 +1,284 @@
+/**
+ * @file test_audio_mix.c
+ * @brief Duck ramp endpoints, resampler error and timing, mix cost
+ *
+ * The resampler is fed a sine in irregular chunks, as TTS frames arrive, and
+ * its output is compared with the same sine evaluated at the positions the
+ * Q16 step lands on (interpolation error) and with the nominal rate ratio
+ * (timing drift over a long answer). The mix pass then runs the music task's
+ * per-block work on a ducked 44.1 kHz stereo stream with 24 kHz mono TTS
+ * added, checking where the TTS lands and what one block costs.
+ */
+
+#include "audio_mix.h"
+#include "host_test.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MUSIC_RATE 44100
+#define BLOCK_FRAMES 1152 // One music decoder block of stereo
+#define TONE_HZ 1000.0
+#define TONE_AMP 16000.0
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ---------- Gain ramp ---------- */
+
+/**
+ * @brief Ramp a DC signal in uneven slices; check both ends of the ramp
+ */
+static void check_ramp(uint32_t from, uint32_t to, uint32_t ramp_frames) {
+  enum { FRAMES = 6000, LEVEL = 20000 };
+  static int16_t pcm[FRAMES * 2];
+  for (int i = 0; i < FRAMES * 2; i++) {
+    pcm[i] = (int16_t)(i & 1 ? -LEVEL : LEVEL);
+  }
+  audio_gain_t g;
+  audio_gain_init(&g, from);
+  audio_gain_set_target(&g, to, ramp_frames);
+  static const size_t slices[] = {1, 37, 128, 441, 1000};
+  size_t done = 0;
+  for (int s = 0; done < FRAMES; s++) {
+    size_t n = slices[s % 5];
+    n = n < FRAMES - done ? n : FRAMES - done;
+    audio_gain_apply(&g, pcm + done * 2, n, 2);
+    done += n;
+  }
+
+  int16_t start = (int16_t)((LEVEL * (int32_t)from) >> 15);
+  int16_t end = (int16_t)((LEVEL * (int32_t)to) >> 15);
+  int32_t max_jump = abs((int32_t)end - start) / (int32_t)ramp_frames + 2;
+  // Integer steps may need one frame more than asked for
+  CHECK_EQ(pcm[ramp_frames * 2], end);
+  CHECK_EQ(pcm[FRAMES * 2 - 2], end);
+  CHECK_EQ(pcm[FRAMES * 2 - 1], (int16_t)((-LEVEL * (int32_t)to) >> 15));
+  CHECK(pcm[(ramp_frames - 2) * 2] != end);
+  CHECK(abs(pcm[0] - start) <= max_jump);
+  for (uint32_t i = 1; i <= ramp_frames; i++) {
+    int32_t d = pcm[i * 2] - pcm[(i - 1) * 2];
+    if (abs(d) > max_jump || (to < from ? d > 0 : d < 0)) {
+      fprintf(stderr, "ramp %u->%u: frame %u jumps by %d\n", from, to, i, d);
+      host_test_failures++;
+      break;
+    }
+    // Same gain on both channels (the negative one rounds down)
+    CHECK(abs(pcm[i * 2 + 1] + pcm[i * 2]) <= 1);
+  }
+  CHECK_EQ(audio_gain_is_unity(&g), to == AUDIO_GAIN_UNITY);
+}
+
+static void test_ramp(void) {
+  check_ramp(AUDIO_GAIN_UNITY, AUDIO_GAIN_UNITY * 3 / 10, 4410);
+  check_ramp(AUDIO_GAIN_UNITY * 3 / 10, AUDIO_GAIN_UNITY, 4410);
+  check_ramp(AUDIO_GAIN_UNITY, 0, 1000);
+  check_ramp(0, AUDIO_GAIN_UNITY, 3);
+
+  // No ramp jumps at once; unity is a no-op
+  audio_gain_t g;
+  int16_t pcm[4] = {10000, -10000, 32767, -32768};
+  audio_gain_init(&g, AUDIO_GAIN_UNITY);
+  CHECK(audio_gain_is_unity(&g));
+  audio_gain_apply(&g, pcm, 2, 2);
+  CHECK(pcm[2] == 32767 && pcm[3] == -32768);
+  audio_gain_set_target(&g, AUDIO_GAIN_UNITY / 2, 0);
+  audio_gain_apply(&g, pcm, 2, 2);
+  CHECK(pcm[0] == 5000 && pcm[1] == -5000);
+  CHECK(!audio_gain_is_unity(&g));
+}
+
+/* ---------- Resampler ---------- */
+
+typedef struct {
+  uint32_t in_rate;
+  int in_channels;
+  uint32_t out_rate;
+  int out_channels;
+} rate_case_t;
+
+static const rate_case_t rate_cases[] = {
+    {24000, 1, 44100, 2}, // Cloud TTS into 44.1 kHz music
+    {22050, 1, 44100, 2}, {16000, 1, 48000, 2}, {24000, 1, 48000, 1},
+    {44100, 2, 48000, 2}, {48000, 2, 44100, 1}, {32000, 2, 44100, 2},
+};
+
+static double tone(double t_in_frames, uint32_t rate, int ch) {
+  // Right channel quieter, so a channel swap or bad downmix shows
+  return (ch ? 0.5 : 1.0) * TONE_AMP *
+         sin(2 * M_PI * TONE_HZ * t_in_frames / rate);
+}
+
+static void test_resampler(void) {
+  enum { SECONDS = 10 };
+  for (size_t c = 0; c < sizeof(rate_cases) / sizeof(*rate_cases); c++) {
+    const rate_case_t *rc = &rate_cases[c];
+    size_t in_frames = (size_t)rc->in_rate * SECONDS;
+    int16_t *in = malloc(in_frames * rc->in_channels * sizeof(int16_t));
+    for (size_t i = 0; i < in_frames; i++) {
+      for (int ch = 0; ch < rc->in_channels; ch++) {
+        in[i * rc->in_channels + ch] =
+            (int16_t)lrint(tone((double)i, rc->in_rate, ch));
+      }
+    }
+
+    audio_resampler_t whole, chunked;
+    audio_resampler_init(&whole, rc->in_rate, rc->in_channels, rc->out_rate,
+                         rc->out_channels);
+    chunked = whole;
+    size_t cap = audio_resampler_max_out(&whole, in_frames);
+    int16_t *ref = malloc(cap * rc->out_channels * sizeof(int16_t));
+    int16_t *out = malloc(cap * rc->out_channels * sizeof(int16_t));
+    size_t ref_n = audio_resampler_process(&whole, in, in_frames, ref);
+
+    // Uneven chunks, each within its max_out bound
+    static const size_t chunks[] = {576, 1, 1152, 7, 333};
+    size_t pos = 0, out_n = 0;
+    for (int k = 0; pos < in_frames; k++) {
+      size_t n = chunks[k % 5] < in_frames - pos ? chunks[k % 5]
+                                                 : in_frames - pos;
+      size_t got = audio_resampler_process(
+          &chunked, in + pos * rc->in_channels, n,
+          out + out_n * rc->out_channels);
+      CHECK(got <= audio_resampler_max_out(&chunked, n));
+      out_n += got;
+      pos += n;
+    }
+    CHECK_EQ(out_n, ref_n);
+    CHECK(memcmp(out, ref, ref_n * rc->out_channels * 2) == 0);
+
+    // Output j sits at input position j * step - 1 (one carried frame)
+    double signal = 0, error = 0;
+    for (size_t j = 2; j < out_n; j++) {
+      double t = (double)j * whole.step / 65536.0 - 1;
+      for (int ch = 0; ch < rc->out_channels; ch++) {
+        double want = rc->in_channels == 1 ? tone(t, rc->in_rate, 0)
+                      : rc->out_channels == 2
+                          ? tone(t, rc->in_rate, ch)
+                          : (tone(t, rc->in_rate, 0) +
+                             tone(t, rc->in_rate, 1)) / 2;
+        double d = out[j * rc->out_channels + ch] - want;
+        signal += want * want;
+        error += d * d;
+      }
+    }
+    double snr = 10 * log10(signal / error);
+
+    // Frames a perfect converter would produce vs. what the Q16 step gives
+    double ideal = (double)in_frames * rc->out_rate / rc->in_rate;
+    double drift_ppm = (out_n - ideal) / ideal * 1e6;
+    double drift_ms = (out_n - ideal) * 1000.0 / rc->out_rate;
+    printf("resample %5u Hz %d ch -> %5u Hz %d ch: SNR %.1f dB at 1 kHz, "
+           "drift %+.1f ppm (%+.2f ms over %d s)\n",
+           rc->in_rate, rc->in_channels, rc->out_rate, rc->out_channels, snr,
+           drift_ppm, drift_ms, SECONDS);
+    // Linear interpolation: about -34 dB error at 1 kHz from 16 kHz. The
+    // truncated Q16 step runs fast by less than one step unit.
+    CHECK(snr > 30);
+    CHECK(drift_ppm >= 0 && drift_ppm < 1e6 / whole.step + 1);
+
+    free(in);
+    free(ref);
+    free(out);
+  }
+}
+
+/* ---------- Mix ---------- */
+
+static void test_mix_add(void) {
+  int16_t dst[6] = {30000, -30000, 100, -100, 32767, 0};
+  static const int16_t src[6] = {10000, -10000, -200, 50, 1, -32768};
+  audio_mix_add(dst, src, 6);
+  CHECK(dst[0] == 32767 && dst[1] == -32768);
+  CHECK(dst[2] == -100 && dst[3] == -50);
+  CHECK(dst[4] == 32767 && dst[5] == -32768);
+}
+
+/**
+ * @brief The music task's duck-and-mix pass, TTS through a FIFO as on device
+ *
+ * Music is silent so the output is the TTS alone: it has to start on the
+ * first mixed frame and last as long as the answer.
+ */
+static void test_mix_timing(void) {
+  enum { TTS_RATE = 24000, TTS_FRAME = 576, TTS_FRAMES = 300 }; // 7.2 s
+  size_t tts_len = (size_t)TTS_FRAME * TTS_FRAMES;
+  int16_t *tts = malloc(tts_len * sizeof(int16_t));
+  for (size_t i = 0; i < tts_len; i++) {
+    tts[i] = (int16_t)lrint(tone((double)i, TTS_RATE, 0)) | 1; // Never 0
+  }
+
+  audio_resampler_t rs;
+  audio_resampler_init(&rs, TTS_RATE, 1, MUSIC_RATE, 2);
+  size_t fifo_cap = audio_resampler_max_out(&rs, tts_len) * 2;
+  int16_t *fifo = malloc(fifo_cap * sizeof(int16_t));
+  size_t fifo_len = 0;
+  for (int f = 0; f < TTS_FRAMES; f++) {
+    fifo_len += 2 * audio_resampler_process(&rs, tts + f * TTS_FRAME,
+                                            TTS_FRAME, fifo + fifo_len);
+  }
+
+  audio_gain_t gain;
+  audio_gain_init(&gain, AUDIO_GAIN_UNITY);
+  audio_gain_set_target(&gain, AUDIO_GAIN_UNITY * 3 / 10, MUSIC_RATE / 10);
+  int16_t block[BLOCK_FRAMES * 2];
+  size_t fifo_pos = 0, first = SIZE_MAX, last = 0, frame = 0;
+  double dsp_ns = 0;
+  int blocks = 0;
+  while (fifo_pos < fifo_len || frame < 2 * (size_t)BLOCK_FRAMES) {
+    memset(block, 0, sizeof(block));
+    double t0 = now_ns();
+    audio_gain_apply(&gain, block, BLOCK_FRAMES, 2);
+    size_t take = fifo_len - fifo_pos < BLOCK_FRAMES * 2 ? fifo_len - fifo_pos
+                                                          : BLOCK_FRAMES * 2;
+    audio_mix_add(block, fifo + fifo_pos, take);
+    dsp_ns += now_ns() - t0;
+    fifo_pos += take;
+    blocks++;
+    for (int i = 0; i < BLOCK_FRAMES; i++, frame++) {
+      if (block[2 * i] != 0) {
+        first = first < frame ? first : frame;
+        last = frame;
+      }
+    }
+  }
+  double expected = (double)tts_len * MUSIC_RATE / TTS_RATE;
+  CHECK_EQ(first, 0);
+  // Longer by at most the step's truncation, as in test_resampler()
+  double slack = expected / rs.step + 2;
+  CHECK(last + 1 >= expected - 2 && last + 1 <= expected + slack);
+
+  // Cost of a block including the resampling of the TTS that fills it
+  audio_resampler_init(&rs, TTS_RATE, 1, MUSIC_RATE, 2);
+  int16_t tts_out[BLOCK_FRAMES * 2 + 8];
+  size_t in_per_block = (size_t)BLOCK_FRAMES * TTS_RATE / MUSIC_RATE;
+  double t0 = now_ns();
+  for (int b = 0; b < blocks; b++) {
+    audio_resampler_process(&rs, tts + (b * in_per_block) % (tts_len - 1024),
+                            in_per_block, tts_out);
+  }
+  double resample_ns = now_ns() - t0;
+  double block_ns = 1e9 * BLOCK_FRAMES / MUSIC_RATE;
+  double per_block = (dsp_ns + resample_ns) / blocks;
+  printf("mix: TTS lands on frame %zu, ends at %zu (expected %.0f); "
+         "%.1f us per %.1f ms block (%.3f%% of real time)\n",
+         first, last + 1, expected, per_block / 1e3, block_ns / 1e6,
+         per_block / block_ns * 100);
+  CHECK(per_block < block_ns);
+
+  free(tts);
+  free(fifo);
+}
+
+int main(void) {
+  test_ramp();
+  test_resampler();
+  test_mix_add();
+  test_mix_timing();
+  return host_test_done("audio_mix");
+}
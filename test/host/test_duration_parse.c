@@ -0,0 +1,210 @@
+/**
+ * @file test_duration_parse.c
+ * @brief Timer durations from STT text: phrases, fuzzing, throughput
+ *
+ * The fuzz pass feeds random bytes and random soups of lexicon words, digit
+ * and clock fragments, and cut UTF-8 sequences; every result has to stay in
+ * range. The benchmark runs a mixed STT corpus, most of it not timers, as
+ * the pipeline sees it for every utterance.
+ */
+
+#include "duration_parse.h"
+#include "host_test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FUZZ_ROUNDS 400000
+#define BENCH_ROUNDS 500000
+
+typedef struct {
+  const char *text;
+  bool ok;
+  uint32_t seconds;
+  bool timer_word;
+} text_case_t;
+
+static const text_case_t text_cases[] = {
+    {"Postavi timer na 5 minuta", true, 300, true},
+    {"postavi tajmer na pet minuta", true, 300, true},
+    {"Tajmer na dvadeset pet minuta", true, 1500, true},
+    {"tajmer dvadeset i pet sekundi", true, 25, true},
+    {"timer za sat i pol", true, 5400, true},
+    {"timer za dva i pol sata", true, 9000, true},
+    {"tajmer na pola sata", true, 1800, true},
+    {"Postavi tajmer na jedan sat i trideset minuta", true, 5400, true},
+    {"postavi tajmer na minutu", true, 60, true},
+    {"tajmer na četiri minute", true, 240, true},
+    {"TAJMER NA ŠEST MINUTA", true, 360, true},
+    {"tajmer na šezdeset sekundi", true, 60, true},
+    {"odbrojavanje 10 sekundi", true, 10, true},
+    {"set a timer for twenty five minutes", true, 1500, true},
+    {"set a timer for an hour and a half", true, 5400, true},
+    {"timer for half an hour", true, 1800, true},
+    {"timer for one hundred twenty seconds", true, 120, true},
+    {"timer sto dvadeset sekundi", true, 120, true},
+    {"timer 2,5 minute", true, 150, true},
+    {"timer 1:30", true, 90, true},
+    {"timer 1:02:03", true, 3723, true},
+    {"timer PT1H30M", true, 5400, true},
+    {"PT5M", true, 300, false},
+    {"P1DT2H", true, 93600, false},
+    {"PT1.5S", true, 2, false},
+    {"timer 5min", true, 300, true},
+    {"tajmer pet minuta i pola sata", true, 2100, true},
+    // "što" is a filler, not "sto" (100) after folding
+    {"tajmer što pet minuta", true, 300, true},
+    {"ŠTO tajmer na deset sekundi", true, 10, true},
+    // A half neither after "i" nor before a unit is not a duration
+    {"tajmer deset minuta pola", true, 600, true},
+    {"tajmer pola deset minuta", true, 600, true},
+    {"koliko je sati", false, 0, false},
+    {"upali svjetlo", false, 0, false},
+    {"tajmer", false, 0, true},
+    {"tajmer na 10", false, 0, true},
+    {"pet", false, 0, false},
+    {"", false, 0, false},
+    {"timer 9999999 hours", false, 0, true},
+    {"minuta", false, 0, false},
+};
+
+typedef struct {
+  const char *text;
+  bool ok;
+  double value;
+} number_case_t;
+
+static const number_case_t number_cases[] = {
+    {"25", true, 25},          {"2.5", true, 2.5},
+    {"dvadeset pet", true, 25}, {"twenty five", true, 25},
+    {"dva i pol", true, 2.5},  {"sto", true, 100},
+    {"što", false, 0},         {"5 minuta", false, 0},
+    {"abc", false, 0},         {"", false, 0},
+};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void test_phrases(void) {
+  for (size_t i = 0; i < sizeof(text_cases) / sizeof(*text_cases); i++) {
+    const text_case_t *c = &text_cases[i];
+    duration_parse_result_t r;
+    memset(&r, 0xaa, sizeof(r));
+    bool ok = duration_parse(c->text, &r);
+    if (ok != c->ok || r.has_timer_word != c->timer_word ||
+        (ok && r.seconds != c->seconds)) {
+      fprintf(stderr, "\"%s\": got %s %u s, timer word %d\n", c->text,
+              ok ? "ok" : "fail", r.seconds, r.has_timer_word);
+      host_test_failures++;
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(number_cases) / sizeof(*number_cases); i++) {
+    const number_case_t *c = &number_cases[i];
+    double v = -1;
+    bool ok = duration_parse_number(c->text, &v);
+    if (ok != c->ok || (ok && v != c->value)) {
+      fprintf(stderr, "number \"%s\": got %s %g\n", c->text,
+              ok ? "ok" : "fail", v);
+      host_test_failures++;
+    }
+  }
+
+  duration_parse_result_t r;
+  double v;
+  CHECK(!duration_parse(NULL, &r));
+  CHECK(!duration_parse("pet minuta", NULL));
+  CHECK(!duration_parse_number(NULL, &v));
+}
+
+/**
+ * @brief Random bytes on odd rounds, token soup on even ones
+ */
+static void test_fuzz(void) {
+  static const char *const tokens[] = {
+      "pet",  "i",    "pol",    "pola",  "sat",   "minuta", "P",  "T",
+      "1",    ":",    "2,",     "5",     "PT",    "tajmer", "š",  "\xc5",
+      "\xc4", "half", "hundred", "sto",  "što",   "and",    " ",  "9999999999",
+  };
+  enum { TOKENS = sizeof(tokens) / sizeof(*tokens) };
+  char buf[256];
+  srand(1);
+  for (int round = 0; round < FUZZ_ROUNDS; round++) {
+    size_t len = 0;
+    if (round & 1) {
+      size_t want = (size_t)rand() % (sizeof(buf) - 1);
+      while (len < want) {
+        buf[len++] = (char)(rand() % 255 + 1);
+      }
+    } else {
+      while (len < 200) {
+        const char *t = tokens[rand() % TOKENS];
+        size_t n = strlen(t);
+        memcpy(buf + len, t, n);
+        len += n;
+        if (rand() % 2) {
+          buf[len++] = ' ';
+        }
+      }
+    }
+    buf[len] = '\0';
+
+    duration_parse_result_t r;
+    double v;
+    if (duration_parse(buf, &r) &&
+        (r.seconds < 1 || r.seconds > DURATION_PARSE_MAX_SECONDS)) {
+      fprintf(stderr, "fuzz round %d: %u s out of range\n", round, r.seconds);
+      host_test_failures++;
+    }
+    if (duration_parse_number(buf, &v) && !(v >= 0)) {
+      fprintf(stderr, "fuzz round %d: number %g\n", round, v);
+      host_test_failures++;
+    }
+  }
+  printf("fuzz: %d rounds\n", FUZZ_ROUNDS);
+}
+
+static void bench_corpus(void) {
+  static const char *const corpus[] = {
+      "Postavi tajmer na pet minuta.",
+      "Tajmer na dvadeset pet minuta molim",
+      "Koliko je sati?",
+      "Upali svjetlo u kuhinji",
+      "Pusti glazbu",
+      "Postavi timer na sat i pol",
+      "Stavi alarm za pola sata",
+      "Set a timer for ten minutes",
+      "Glasnoća na pedeset",
+      "Ugasi svjetla u dnevnom boravku i spavaćoj sobi",
+  };
+  enum { PHRASES = sizeof(corpus) / sizeof(*corpus) };
+  size_t bytes = 0;
+  for (int i = 0; i < PHRASES; i++) {
+    bytes += strlen(corpus[i]);
+  }
+
+  uint32_t sum = 0;
+  double t0 = now_ns();
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    duration_parse_result_t r;
+    duration_parse(corpus[round % PHRASES], &r);
+    sum += r.seconds;
+  }
+  double ns = (now_ns() - t0) / BENCH_ROUNDS;
+  printf("corpus: %.0f ns per phrase, %.0f MB/s\n", ns,
+         (double)bytes / PHRASES / ns * 1e3);
+  // 300 + 1500 + 5400 + 1800 + 600 per pass over the corpus
+  CHECK_EQ(sum, (uint32_t)(BENCH_ROUNDS / PHRASES) * 9600u);
+}
+
+int main(void) {
+  CHECK(duration_parse_init());
+  test_phrases();
+  test_fuzz();
+  bench_corpus();
+  return host_test_done("duration_parse");
+}
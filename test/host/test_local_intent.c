@@ -0,0 +1,215 @@
+/**
+ * @file test_local_intent.c
+ * @brief Local intent grammar: built-in phrases, errors, and a large grammar
+ *
+ * The benchmark compiles a generated grammar of GEN_RULES service rules and
+ * matches STT-like sentences against it, next to the same sentences against
+ * the built-in grammar; the automaton should make the two cost about the
+ * same.
+ */
+
+#include "host_test.h"
+#include "local_intent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GEN_RULES 5000
+#define GEN_PHRASES 3 // Per rule
+#define BENCH_ROUNDS 200000
+
+typedef struct {
+  const char *text;
+  local_intent_action_t action; // LOCAL_INTENT_NONE: no match
+  int value;
+} text_case_t;
+
+static const text_case_t text_cases[] = {
+    {"Pusti glazbu.", LOCAL_INTENT_MUSIC_PLAY, -1},
+    {"Molim te, sljedeća pjesma!", LOCAL_INTENT_MUSIC_NEXT, -1},
+    {"Stavi glasnoću na 35 posto", LOCAL_INTENT_VOLUME_SET, 35},
+    {"Glasnoća 80%", LOCAL_INTENT_VOLUME_SET, 80},
+    {"set volume to 40", LOCAL_INTENT_VOLUME_SET, 40},
+    {"Otkaži timer", LOCAL_INTENT_TIMER_CANCEL, -1},
+    {"ŠTO JE TIŠE", LOCAL_INTENT_VOLUME_DOWN, -1},
+    {"ugasi  alarm   odmah", LOCAL_INTENT_ALARM_STOP, -1},
+    {"Koliko je sati?", LOCAL_INTENT_NONE, -1},
+    {"pusti", LOCAL_INTENT_NONE, -1},
+    {"", LOCAL_INTENT_NONE, -1},
+    // Same length: the earlier rule wins
+    {"volume 40 volume up", LOCAL_INTENT_VOLUME_UP, -1},
+};
+
+static const char *const bad_grammars[] = {
+    "foo : x",          "music.play x : y",     "music.play : 5 x",
+    "music.play : a |", "service light : x",    "volume.set : {n} {n}",
+    "music.play pusti",
+};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void test_default_grammar(void) {
+  char err[64] = "";
+  local_intent_t *li =
+      local_intent_compile(local_intent_default_grammar(), err, sizeof(err));
+  CHECK(li != NULL);
+  CHECK_EQ(err[0], '\0');
+
+  for (size_t i = 0; i < sizeof(text_cases) / sizeof(*text_cases); i++) {
+    const text_case_t *c = &text_cases[i];
+    local_intent_match_t m;
+    bool hit = local_intent_match_text(li, c->text, &m);
+    if (hit != (c->action != LOCAL_INTENT_NONE) ||
+        (hit && (m.action != c->action || m.value != c->value))) {
+      fprintf(stderr, "\"%s\": got %s value %d\n", c->text,
+              hit ? local_intent_action_name(m.action) : "no match",
+              hit ? m.value : 0);
+      host_test_failures++;
+    }
+  }
+
+  // MultiNet ids 0-5 as the old hard-coded switch had them
+  static const local_intent_action_t commands[] = {
+      LOCAL_INTENT_LED_ON,     LOCAL_INTENT_LED_OFF,
+      LOCAL_INTENT_MUSIC_PLAY, LOCAL_INTENT_MUSIC_STOP,
+      LOCAL_INTENT_MUSIC_NEXT, LOCAL_INTENT_MUSIC_PREVIOUS};
+  local_intent_match_t m;
+  for (int id = 0; id < 6; id++) {
+    CHECK(local_intent_match_command(li, id, &m));
+    CHECK_EQ(m.action, commands[id]);
+    CHECK_EQ(m.tokens, 0);
+  }
+  CHECK(!local_intent_match_command(li, 6, &m));
+  local_intent_free(li);
+}
+
+static void test_grammar_errors(void) {
+  for (size_t i = 0; i < sizeof(bad_grammars) / sizeof(*bad_grammars); i++) {
+    char err[64] = "";
+    local_intent_t *li =
+        local_intent_compile(bad_grammars[i], err, sizeof(err));
+    CHECK(li == NULL);
+    CHECK(strncmp(err, "line 1: ", 8) == 0);
+    local_intent_free(li);
+  }
+
+  // Service rule next to a shorter built-in action, comments skipped
+  local_intent_t *li = local_intent_compile(
+      "# lights\n"
+      "service light.turn_on light.x : upali svjetlo | svjetlo upali\n"
+      "\n"
+      "led.on : upali\n",
+      NULL, 0);
+  CHECK(li != NULL);
+  int rules, phrases;
+  local_intent_get_size(li, &rules, &phrases);
+  CHECK_EQ(rules, 2);
+  CHECK_EQ(phrases, 3);
+  local_intent_match_t m;
+  CHECK(local_intent_match_text(li, "upali svjetlo u boravku", &m));
+  CHECK_EQ(m.action, LOCAL_INTENT_SERVICE);
+  CHECK(strcmp(m.service, "light.turn_on") == 0);
+  CHECK(strcmp(m.target, "light.x") == 0);
+  CHECK(local_intent_match_text(li, "molim upali", &m));
+  CHECK_EQ(m.action, LOCAL_INTENT_LED_ON);
+  CHECK_EQ(m.rule, 1);
+  local_intent_free(li);
+}
+
+/**
+ * @brief Letters-only name for index n (numbers are not allowed in phrases)
+ */
+static void gen_name(int n, char *out) {
+  int len = 0;
+  do {
+    out[len++] = (char)('a' + n % 26);
+    n /= 26;
+  } while (n > 0);
+  memcpy(out + len, "ov", 3);
+}
+
+static char *gen_grammar(void) {
+  size_t cap = (size_t)GEN_RULES * 160;
+  char *g = malloc(cap);
+  size_t len = 0;
+  char name[16];
+  for (int i = 0; i < GEN_RULES; i++) {
+    gen_name(i, name);
+    len += (size_t)snprintf(g + len, cap - len,
+                            "service switch.turn_on switch.%s : upali %s"
+                            " | ukljuci uredjaj %s | %s ukljuci sada\n",
+                            name, name, name, name);
+  }
+  return g;
+}
+
+static void bench_large_grammar(void) {
+  char *grammar = gen_grammar();
+  double t0 = now_ns();
+  local_intent_t *big = local_intent_compile(grammar, NULL, 0);
+  double compile_ms = (now_ns() - t0) / 1e6;
+  free(grammar);
+  CHECK(big != NULL);
+  if (!big) {
+    return;
+  }
+  int rules, phrases;
+  local_intent_get_size(big, &rules, &phrases);
+  CHECK_EQ(rules, GEN_RULES);
+  CHECK_EQ(phrases, GEN_RULES * GEN_PHRASES);
+
+  // Every phrase of every rule is found inside a longer sentence
+  char name[16], text[128], target[32];
+  for (int i = 0; i < GEN_RULES; i++) {
+    gen_name(i, name);
+    snprintf(target, sizeof(target), "switch.%s", name);
+    for (int p = 0; p < GEN_PHRASES; p++) {
+      static const char *const forms[GEN_PHRASES] = {
+          "hej molim te upali %s u sobi", "ukljuci uredjaj %s molim",
+          "ajde %s ukljuci sada"};
+      snprintf(text, sizeof(text), forms[p], name);
+      local_intent_match_t m;
+      if (!local_intent_match_text(big, text, &m) || m.rule != i ||
+          strcmp(m.target, target) != 0) {
+        fprintf(stderr, "\"%s\" did not match rule %d\n", text, i);
+        host_test_failures++;
+      }
+    }
+  }
+
+  local_intent_t *small =
+      local_intent_compile(local_intent_default_grammar(), NULL, 0);
+  const char *sentence =
+      "hej molim te stavi glasnocu na 35 posto u dnevnom boravku";
+  local_intent_match_t m;
+  double per_match[2];
+  const local_intent_t *grammars[2] = {small, big};
+  for (int g = 0; g < 2; g++) {
+    t0 = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      local_intent_match_text(grammars[g], sentence, &m);
+    }
+    per_match[g] = (now_ns() - t0) / BENCH_ROUNDS;
+  }
+  CHECK(local_intent_match_text(small, sentence, &m) && m.value == 35);
+  CHECK(!local_intent_match_text(big, sentence, &m));
+  printf("%d rules / %d phrases compiled in %.1f ms; 11-word sentence "
+         "%.0f ns per match (built-in grammar %.0f ns)\n",
+         rules, phrases, compile_ms, per_match[1], per_match[0]);
+  // Linear in the text, not the grammar: allow cache effects, not a scan
+  CHECK(per_match[1] < per_match[0] * 5);
+  local_intent_free(small);
+  local_intent_free(big);
+}
+
+int main(void) {
+  test_default_grammar();
+  test_grammar_errors();
+  bench_large_grammar();
+  return host_test_done("local_intent");
+}
@@ -0,0 +1,310 @@
+/**
+ * @file test_local_tts.c
+ * @brief Phrase grammar and rendering of local_tts, checked through WAV files
+ *
+ * Every unit is generated as a flat tone of its own length and level, so a
+ * rendered phrase can be read back from its WAV file and turned into the
+ * unit names again: runs of audio separated by the word gaps. The rendered
+ * phrases stay in build/local_tts/ for listening.
+ */
+
+#include "host_test.h"
+#include "local_tts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OUT_DIR "build/local_tts"
+#define UNIT_DIR OUT_DIR "/units"
+#define FADE 48  // Samples of fade at each unit edge (3 ms)
+#define GAP 640  // Samples between units (40 ms)
+#define BENCH_PHRASES 2000
+
+// Same order as unit_names in local_tts.c
+static const char *const names[] = {
+    "n0",  "n1",  "n2",  "n3",  "n4",  "n5",  "n6",  "n7",  "n8",  "n9",
+    "n10", "n11", "n12", "n13", "n14", "n15", "n16", "n17", "n18", "n19",
+    "n1f", "n2f",
+    "n20", "n30", "n40", "n50", "n60", "n70", "n80", "n90",
+    "n100", "n200", "n300", "n400", "n500", "n600", "n700", "n800", "n900",
+    "sat", "sata", "sati", "minuta", "minute", "sekunda", "sekunde",
+    "sekundi", "i",
+    "ha_nedostupan", "ha_ne_odgovara", "greska", "tajmer_postavljen",
+    "tajmer_istekao",
+};
+#define UNITS (int)(sizeof(names) / sizeof(*names))
+
+typedef struct {
+  uint32_t seconds;
+  const char *says; // NULL: not speakable
+} duration_case_t;
+
+static const duration_case_t durations[] = {
+    {0, "n0 sekundi"},
+    {1, "n1f sekunda"},
+    {21, "n20 n1f sekunda"},
+    {62, "n1f minuta i n2f sekunde"},
+    {111, "n1f minuta i n50 n1f sekunda"},
+    {300, "n5 minuta"},
+    {660, "n11 minuta"},
+    {1320, "n20 n2f minute"},
+    {3600, "n1 sat"},
+    {3661, "n1 sat n1f minuta i n1f sekunda"},
+    {7322, "n2 sata n2f minute i n2f sekunde"},
+    {7500, "n2 sata i n5 minuta"},
+    {86399, "n20 n3 sata n50 n9 minuta i n50 n9 sekundi"},
+    {215 * 3600, "n200 n15 sati"},
+    {999 * 3600, "n900 n90 n9 sati"},
+    {1000 * 3600, NULL},
+};
+
+static uint32_t unit_len(int u) { return 1600 + 16 * (uint32_t)u; }
+static int16_t unit_level(int u) { return (int16_t)(1000 + 300 * u); }
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+/**
+ * @brief Unit WAV with a LIST chunk before the data, as editors write them
+ */
+static void write_unit(int u, uint32_t rate) {
+  char path[128];
+  snprintf(path, sizeof(path), UNIT_DIR "/%s.wav", names[u]);
+  uint32_t n = unit_len(u);
+  uint8_t hdr[56];
+  memcpy(hdr, "RIFF", 4);
+  put32(hdr + 4, 48 + n * 2);
+  memcpy(hdr + 8, "WAVEfmt ", 8);
+  put32(hdr + 16, 16);
+  put16(hdr + 20, 1);
+  put16(hdr + 22, 1);
+  put32(hdr + 24, rate);
+  put32(hdr + 28, rate * 2);
+  put16(hdr + 32, 2);
+  put16(hdr + 34, 16);
+  memcpy(hdr + 36, "LIST", 4);
+  put32(hdr + 40, 4);
+  memcpy(hdr + 44, "INFO", 4);
+  memcpy(hdr + 48, "data", 4);
+  put32(hdr + 52, n * 2);
+
+  FILE *f = fopen(path, "wb");
+  CHECK(f != NULL);
+  fwrite(hdr, 1, sizeof(hdr), f);
+  int16_t *pcm = malloc(n * sizeof(int16_t));
+  for (uint32_t i = 0; i < n; i++) {
+    pcm[i] = unit_level(u);
+  }
+  fwrite(pcm, sizeof(int16_t), n, f);
+  free(pcm);
+  fclose(f);
+}
+
+static local_tts_t *make_voice(void) {
+  CHECK(system("rm -rf " OUT_DIR " && mkdir -p " UNIT_DIR) == 0);
+  for (int u = 0; u < UNITS; u++) {
+    write_unit(u, LOCAL_TTS_SAMPLE_RATE);
+  }
+  return local_tts_load(UNIT_DIR);
+}
+
+/**
+ * @brief Render a phrase to a WAV file and read the unit names back from it
+ */
+static bool render_and_read(const local_tts_t *lt,
+                            const local_tts_phrase_t *phrase,
+                            const char *file, char *says, size_t says_len) {
+  char path[128];
+  snprintf(path, sizeof(path), OUT_DIR "/%s.wav", file);
+  FILE *f = fopen(path, "wb");
+  int ret = local_tts_write_wav(lt, phrase, f);
+  fclose(f);
+  if (ret != 0) {
+    return false;
+  }
+
+  f = fopen(path, "rb");
+  uint8_t hdr[44];
+  CHECK(fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr));
+  CHECK(memcmp(hdr + 36, "data", 4) == 0);
+  uint32_t bytes = hdr[40] | hdr[41] << 8 | hdr[42] << 16 |
+                   (uint32_t)hdr[43] << 24;
+  CHECK_EQ(bytes, local_tts_phrase_samples(lt, phrase) * 2);
+  uint32_t n = bytes / 2;
+  int16_t *pcm = malloc(bytes);
+  CHECK(fread(pcm, 2, n, f) == n);
+  fclose(f);
+
+  // Units start and end at zero (fades); gaps are GAP zeros long
+  says[0] = '\0';
+  size_t len = 0;
+  uint32_t i = 0;
+  while (i < n) {
+    uint32_t zeros = i;
+    while (i < n && pcm[i] == 0) {
+      i++;
+    }
+    if (len && i < n) {
+      CHECK_EQ(i - zeros, GAP + 2); // Plus the faded edge samples
+    }
+    uint32_t start = i;
+    while (i < n && pcm[i] != 0) {
+      i++;
+    }
+    if (i == start) {
+      break;
+    }
+    int unit = -1;
+    for (int u = 0; u < UNITS; u++) {
+      // Fades zero the first and last sample
+      if (unit_len(u) - 2 == i - start &&
+          pcm[start + FADE] == unit_level(u)) {
+        unit = u;
+      }
+    }
+    len += (size_t)snprintf(says + len, says_len - len, "%s%s",
+                            len ? " " : "", unit >= 0 ? names[unit] : "?");
+  }
+  free(pcm);
+  return true;
+}
+
+static void test_load(local_tts_t *lt) {
+  CHECK(lt != NULL);
+  local_tts_info_t info;
+  local_tts_get_info(lt, &info);
+  CHECK_EQ(info.units_loaded, UNITS);
+  CHECK_EQ(info.units_missing, 0);
+  uint32_t bytes = 0;
+  for (int u = 0; u < UNITS; u++) {
+    bytes += unit_len(u) * 2;
+  }
+  CHECK_EQ(info.bytes, bytes);
+  CHECK(local_tts_load(OUT_DIR "/nowhere") == NULL);
+}
+
+static void test_durations(const local_tts_t *lt) {
+  char says[256], file[32];
+  for (size_t i = 0; i < sizeof(durations) / sizeof(*durations); i++) {
+    const duration_case_t *c = &durations[i];
+    local_tts_phrase_t phrase;
+    local_tts_phrase_clear(&phrase);
+    bool ok = local_tts_phrase_duration(&phrase, c->seconds);
+    CHECK_EQ(ok, c->says != NULL);
+    if (!ok || !c->says) {
+      continue;
+    }
+    snprintf(file, sizeof(file), "duration_%u", (unsigned)c->seconds);
+    CHECK(render_and_read(lt, &phrase, file, says, sizeof(says)));
+    if (strcmp(says, c->says) != 0) {
+      fprintf(stderr, "%u s: \"%s\", expected \"%s\"\n",
+              (unsigned)c->seconds, says, c->says);
+      host_test_failures++;
+    }
+  }
+}
+
+static void test_status(const local_tts_t *lt) {
+  char says[256];
+  local_tts_phrase_t phrase;
+  local_tts_phrase_clear(&phrase);
+  CHECK(local_tts_phrase_status(&phrase, LOCAL_TTS_TIMER_SET));
+  CHECK(local_tts_phrase_duration(&phrase, 90));
+  CHECK(render_and_read(lt, &phrase, "timer_set", says, sizeof(says)));
+  CHECK(strcmp(says, "tajmer_postavljen n1f minuta i n30 sekundi") == 0);
+
+  local_tts_phrase_clear(&phrase);
+  CHECK(!local_tts_phrase_status(&phrase, LOCAL_TTS_STATUS_COUNT));
+  CHECK(local_tts_phrase_status(&phrase, LOCAL_TTS_HA_UNAVAILABLE));
+  CHECK(render_and_read(lt, &phrase, "ha_unavailable", says, sizeof(says)));
+  CHECK(strcmp(says, "ha_nedostupan") == 0);
+
+  // Full phrase: appending fails instead of overflowing
+  for (int i = 0; i < LOCAL_TTS_MAX_UNITS; i++) {
+    local_tts_phrase_number(&phrase, 1, LOCAL_TTS_MASCULINE);
+  }
+  CHECK_EQ(phrase.count, LOCAL_TTS_MAX_UNITS);
+  CHECK(!local_tts_phrase_number(&phrase, 1, LOCAL_TTS_MASCULINE));
+  CHECK(!local_tts_phrase_number(&phrase, 1000, LOCAL_TTS_MASCULINE));
+}
+
+/**
+ * @brief Units that are missing or in the wrong format are not spoken
+ */
+static void test_bad_units(void) {
+  remove(UNIT_DIR "/n7.wav");
+  write_unit(47, 44100); // "i" at the wrong rate
+  local_tts_t *lt = local_tts_load(UNIT_DIR);
+  CHECK(lt != NULL);
+  local_tts_info_t info;
+  local_tts_get_info(lt, &info);
+  CHECK_EQ(info.units_loaded, UNITS - 2);
+  CHECK_EQ(info.units_missing, 2);
+
+  local_tts_phrase_t phrase;
+  local_tts_phrase_clear(&phrase);
+  local_tts_phrase_duration(&phrase, 7 * 60);
+  CHECK(!local_tts_can_say(lt, &phrase));
+  CHECK_EQ(local_tts_phrase_samples(lt, &phrase), 0);
+  FILE *f = fopen(OUT_DIR "/missing.wav", "wb");
+  CHECK_EQ(local_tts_write_wav(lt, &phrase, f), -1);
+  fclose(f);
+  local_tts_phrase_clear(&phrase);
+  local_tts_phrase_duration(&phrase, 6 * 60 + 5); // Needs "i"
+  CHECK(!local_tts_can_say(lt, &phrase));
+  local_tts_phrase_clear(&phrase);
+  local_tts_phrase_duration(&phrase, 6 * 60);
+  CHECK(local_tts_can_say(lt, &phrase));
+  local_tts_free(lt);
+}
+
+static void bench_render(const local_tts_t *lt) {
+  int16_t chunk[256]; // What the player pulls per write
+  uint64_t samples = 0;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int r = 0; r < BENCH_PHRASES; r++) {
+    local_tts_phrase_t phrase;
+    local_tts_phrase_clear(&phrase);
+    local_tts_phrase_status(&phrase, LOCAL_TTS_TIMER_SET);
+    local_tts_phrase_duration(&phrase, (uint32_t)r * 37 % 86400 + 1);
+    local_tts_reader_t reader;
+    local_tts_reader_init(&reader, &phrase);
+    size_t n;
+    while ((n = local_tts_read(lt, &reader, chunk, 256)) > 0) {
+      samples += n;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  double audio_s = (double)samples / LOCAL_TTS_SAMPLE_RATE;
+  local_tts_info_t info;
+  local_tts_get_info(lt, &info);
+  printf("rendered %.0f s of speech in %.3f s (%.0fx real time), "
+         "%u KB of units, %zu B of render state\n",
+         audio_s, s, audio_s / s, (unsigned)(info.bytes / 1024),
+         sizeof(local_tts_phrase_t) + sizeof(local_tts_reader_t));
+  CHECK(audio_s / s > 1);
+}
+
+int main(void) {
+  local_tts_t *lt = make_voice();
+  test_load(lt);
+  if (!lt) {
+    return host_test_done("local_tts");
+  }
+  test_durations(lt);
+  test_status(lt);
+  bench_render(lt);
+  local_tts_free(lt);
+  test_bad_units();
+  return host_test_done("local_tts");
+}
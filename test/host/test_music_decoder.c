@@ -0,0 +1,977 @@
+/**
+ * @file test_music_decoder.c
+ * @brief MP3/WAV/FLAC plug-ins against reference PCM, seeking, throughput
+ *
+ * Fixtures are written fresh on every run:
+ *   - FLAC from a small encoder below that cycles every subframe type (constant,
+ *     verbatim, fixed 0-4, LPC with 32- and 64-bit prediction, escaped and
+ *     5-bit Rice parameters, wasted bits) and every stereo decorrelation mode.
+ *     FLAC is lossless, so the source samples are the reference.
+ *   - WAV at 8, 16, 24 and 32 bits, with LIST and odd-sized chunks.
+ *   - MP3: sounds/wake_prompt.mp3, a tagged CBR file with an Xing TOC, and a
+ *     copy with junk between frames and a cut-off last frame. libhelix is
+ *     replaced by a frame model (stubs/mp3dec.h), so this checks the plug-in
+ *     around the decoder, not the decoder itself.
+ *
+ * Throughput is host time: compare formats with each other, not with the
+ * device.
+ */
+
+#include "host_test.h"
+#include "mp3dec.h"
+#include "music_decoder.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define OUT_DIR "build/music_decoder"
+#define WAKE_PROMPT "../../sounds/wake_prompt.mp3"
+#define FLAC_BLOCK 4096
+#define LPC_MAX 32
+#define MP3_FRAMES 300
+#define BENCH_SECONDS 0.5 // Decode time per format
+
+typedef struct {
+  int16_t *pcm; // Interleaved
+  size_t len;   // Samples (all channels)
+  uint32_t rate;
+  int channels;
+} ref_t;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_file(const char *path, const void *data, size_t len) {
+  FILE *fp = fopen(path, "wb");
+  CHECK(fp && fwrite(data, 1, len, fp) == len);
+  if (fp) {
+    fclose(fp);
+  }
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  *len = (size_t)ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *data = malloc(*len);
+  if (fread(data, 1, *len, fp) != *len) {
+    free(data);
+    data = NULL;
+  }
+  fclose(fp);
+  return data;
+}
+
+static void ref_push(ref_t *ref, int16_t v) {
+  if ((ref->len & 0xFFFF) == 0) {
+    ref->pcm = realloc(ref->pcm, (ref->len + 0x10000) * sizeof(int16_t));
+  }
+  ref->pcm[ref->len++] = v;
+}
+
+static uint32_t noise(long i, int ch) {
+  uint32_t h = (uint32_t)i * 2654435761u + (uint32_t)ch * 0x9E3779B9u;
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  return h;
+}
+
+/**
+ * @brief Two tones and a little noise, with blocks that force special cases
+ */
+static int32_t source(long i, int ch, int bps, uint32_t rate) {
+  long block = i / FLAC_BLOCK;
+  int32_t full = (int32_t)((1u << (bps - 1)) - 1);
+  if (block == 1) {
+    return 0; // Silence: constant subframes
+  }
+  if (block == 2) {
+    return ch ? -full / 3 : full / 5; // DC, different per channel
+  }
+  double t = (double)i / rate;
+  double v = 0.35 * sin(2 * M_PI * (220 + 110 * ch) * t) +
+             0.2 * sin(2 * M_PI * 1375 * t + ch);
+  // Loud noise in block 7: large residuals, wide Rice parameters
+  v += (block == 7 ? 0.4 : 0.01) * ((int32_t)noise(i, ch) / 2147483648.0);
+  int32_t s = (int32_t)lrint(v * full);
+  return block == 5 ? s & ~3 : s; // Two wasted bits
+}
+
+/* ---------- FLAC encoder ---------- */
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+  uint64_t acc;
+  int bits; // Pending bits in acc, < 8 between calls
+} bw_t;
+
+static void bw_put(bw_t *w, uint32_t v, int n) {
+  if (n == 0) {
+    return;
+  }
+  w->acc = (w->acc << n) | (n == 32 ? v : v & ((1u << n) - 1));
+  w->bits += n;
+  while (w->bits >= 8) {
+    if (w->len == w->cap) {
+      w->cap = w->cap ? w->cap * 2 : 65536;
+      w->buf = realloc(w->buf, w->cap);
+    }
+    w->bits -= 8;
+    w->buf[w->len++] = (uint8_t)(w->acc >> w->bits);
+  }
+}
+
+static void bw_unary(bw_t *w, uint32_t zeros) {
+  for (; zeros >= 31; zeros -= 31) {
+    bw_put(w, 0, 31);
+  }
+  bw_put(w, 1, (int)zeros + 1);
+}
+
+static void bw_align(bw_t *w) {
+  if (w->bits) {
+    bw_put(w, 0, 8 - w->bits);
+  }
+}
+
+static uint8_t crc8(const uint8_t *p, size_t n) {
+  uint8_t crc = 0;
+  while (n--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) {
+      crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t n) {
+  uint16_t crc = 0;
+  while (n--) {
+    crc ^= (uint16_t)(*p++ << 8);
+    for (int i = 0; i < 8; i++) {
+      crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+enum {
+  KIND_VERBATIM,
+  KIND_FIXED0, // .. KIND_FIXED0 + 4
+  KIND_LPC8 = KIND_FIXED0 + 5,
+  KIND_LPC32,
+  KIND_ESCAPE, // Fixed order 2, every partition escaped
+  KIND_COUNT
+};
+
+// What the encoded fixtures exercise in the decoder
+static struct {
+  int constant, verbatim, fixed[5], lpc_narrow, lpc_wide;
+  int escape, rice5, wasted, stereo[4];
+} cov;
+
+/**
+ * @brief Partitioned Rice residual for res[order..n)
+ */
+static void put_residual(bw_t *w, const int64_t *res, uint32_t n, int order,
+                         bool escape) {
+  int part_order = 4;
+  while (part_order > 0 && (n % (1u << part_order) ||
+                            (n >> part_order) < (uint32_t)order)) {
+    part_order--;
+  }
+  uint32_t parts = 1u << part_order, part_size = n >> part_order;
+
+  int ks[16];
+  bool wide = false;
+  for (uint32_t p = 0; p < parts; p++) {
+    uint64_t sum = 0;
+    uint32_t start = p ? p * part_size : (uint32_t)order;
+    for (uint32_t i = start; i < (p + 1) * part_size; i++) {
+      sum += (uint64_t)(res[i] < 0 ? -2 * res[i] - 1 : 2 * res[i]);
+    }
+    uint64_t count = (p + 1) * part_size - start;
+    int k = 0;
+    while (k < 30 && (count << (k + 1)) < sum) {
+      k++;
+    }
+    ks[p] = k;
+    wide |= k > 14;
+  }
+
+  bw_put(w, wide ? 1 : 0, 2);
+  bw_put(w, (uint32_t)part_order, 4);
+  cov.rice5 += wide;
+  for (uint32_t p = 0; p < parts; p++) {
+    uint32_t start = p ? p * part_size : (uint32_t)order;
+    uint32_t end = (p + 1) * part_size;
+    if (escape) {
+      int bits = 0;
+      for (uint32_t i = start; i < end; i++) {
+        while (res[i] < -(1LL << (bits - 1 < 0 ? 0 : bits - 1)) ||
+               res[i] >= (bits ? 1LL << (bits - 1) : 1)) {
+          bits++;
+        }
+      }
+      bw_put(w, wide ? 31 : 15, wide ? 5 : 4);
+      bw_put(w, (uint32_t)bits, 5);
+      for (uint32_t i = start; i < end; i++) {
+        bw_put(w, (uint32_t)res[i], bits);
+      }
+      continue;
+    }
+    int k = ks[p];
+    bw_put(w, (uint32_t)k, wide ? 5 : 4);
+    for (uint32_t i = start; i < end; i++) {
+      uint32_t u = (uint32_t)(res[i] < 0 ? -2 * res[i] - 1 : 2 * res[i]);
+      bw_unary(w, u >> k);
+      bw_put(w, u, k);
+    }
+  }
+}
+
+/**
+ * @brief Quantized LPC coefficients (Levinson-Durbin, no window)
+ */
+static void lpc_coefs(const int32_t *s, uint32_t n, int order, int precision,
+                      int32_t *q, int *shift) {
+  double r[LPC_MAX + 1], a[LPC_MAX + 1] = {0}, tmp[LPC_MAX + 1];
+  for (int lag = 0; lag <= order; lag++) {
+    r[lag] = 0;
+    for (uint32_t i = (uint32_t)lag; i < n; i++) {
+      r[lag] += (double)s[i] * s[i - lag];
+    }
+  }
+  r[0] *= 1.0 + 1e-9;
+  double err = r[0];
+  for (int i = 1; i <= order && err > 0; i++) {
+    double acc = r[i];
+    for (int j = 1; j < i; j++) {
+      acc -= a[j] * r[i - j];
+    }
+    double k = acc / err;
+    memcpy(tmp, a, sizeof(a));
+    a[i] = k;
+    for (int j = 1; j < i; j++) {
+      a[j] = tmp[j] - k * tmp[i - j];
+    }
+    err *= 1 - k * k;
+  }
+
+  double max = 0;
+  for (int j = 1; j <= order; j++) {
+    max = fmax(max, fabs(a[j]));
+  }
+  int32_t limit = (1 << (precision - 1)) - 1;
+  *shift = 15;
+  while (*shift > 0 && max * (1 << *shift) > limit) {
+    (*shift)--;
+  }
+  for (int j = 0; j < order; j++) {
+    long v = lrint(a[j + 1] * (1 << *shift));
+    q[j] = (int32_t)(v > limit ? limit : v < -limit - 1 ? -limit - 1 : v);
+  }
+}
+
+static void put_subframe(bw_t *w, const int32_t *in, uint32_t n, int bps,
+                         int kind) {
+  bool constant = true;
+  uint32_t bits_used = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    constant &= in[i] == in[0];
+    bits_used |= (uint32_t)in[i];
+  }
+  if (constant) {
+    bw_put(w, 0, 8); // Pad, type 0, no wasted bits
+    bw_put(w, (uint32_t)in[0], bps);
+    cov.constant++;
+    return;
+  }
+
+  int wasted = __builtin_ctz(bits_used);
+  int32_t *s = malloc(n * sizeof(int32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    s[i] = in[i] >> wasted;
+  }
+  bps -= wasted;
+  cov.wasted += wasted > 0;
+
+  int order = 0, type = 1;
+  int32_t coefs[LPC_MAX];
+  int precision = 0, shift = 0;
+  if (kind >= KIND_FIXED0 && kind < KIND_FIXED0 + 5) {
+    order = kind - KIND_FIXED0;
+    type = 8 + order;
+    cov.fixed[order]++;
+  } else if (kind == KIND_ESCAPE) {
+    order = 2;
+    type = 10;
+    cov.escape++;
+  } else if (kind == KIND_LPC8 || kind == KIND_LPC32) {
+    order = kind == KIND_LPC8 ? 8 : 32;
+    precision = kind == KIND_LPC8 ? 12 : 15;
+    type = 32 + order - 1;
+    lpc_coefs(s, n, order, precision, coefs, &shift);
+    int log2_order = 32 - __builtin_clz((uint32_t)order);
+    if (bps + precision + log2_order > 32) {
+      cov.lpc_wide++;
+    } else {
+      cov.lpc_narrow++;
+    }
+  } else {
+    cov.verbatim++;
+  }
+
+  bw_put(w, 0, 1);
+  bw_put(w, (uint32_t)type, 6);
+  bw_put(w, wasted ? 1 : 0, 1);
+  if (wasted) {
+    bw_unary(w, (uint32_t)wasted - 1);
+  }
+  if (type == 1) {
+    for (uint32_t i = 0; i < n; i++) {
+      bw_put(w, (uint32_t)s[i], bps);
+    }
+    free(s);
+    return;
+  }
+  for (int i = 0; i < order; i++) {
+    bw_put(w, (uint32_t)s[i], bps);
+  }
+
+  int64_t *res = malloc(n * sizeof(int64_t));
+  for (uint32_t i = (uint32_t)order; i < n; i++) {
+    int64_t pred = 0;
+    if (precision) {
+      for (int j = 0; j < order; j++) {
+        pred += (int64_t)coefs[j] * s[i - 1 - j];
+      }
+      pred >>= shift;
+    } else if (order == 1) {
+      pred = s[i - 1];
+    } else if (order == 2) {
+      pred = 2LL * s[i - 1] - s[i - 2];
+    } else if (order == 3) {
+      pred = 3LL * s[i - 1] - 3LL * s[i - 2] + s[i - 3];
+    } else if (order == 4) {
+      pred = 4LL * s[i - 1] - 6LL * s[i - 2] + 4LL * s[i - 3] - s[i - 4];
+    }
+    res[i] = s[i] - pred;
+  }
+  if (precision) {
+    bw_put(w, (uint32_t)precision - 1, 4);
+    bw_put(w, (uint32_t)shift, 5);
+    for (int j = 0; j < order; j++) {
+      bw_put(w, (uint32_t)coefs[j], precision);
+    }
+  }
+  put_residual(w, res, n, order, kind == KIND_ESCAPE);
+  free(res);
+  free(s);
+}
+
+static void put_utf8(bw_t *w, uint32_t v) {
+  if (v < 0x80) {
+    bw_put(w, v, 8);
+  } else if (v < 0x800) {
+    bw_put(w, 0xC0 | (v >> 6), 8);
+    bw_put(w, 0x80 | (v & 0x3F), 8);
+  } else {
+    bw_put(w, 0xE0 | (v >> 12), 8);
+    bw_put(w, 0x80 | ((v >> 6) & 0x3F), 8);
+    bw_put(w, 0x80 | (v & 0x3F), 8);
+  }
+}
+
+static void put_frame(bw_t *w, int32_t *const chans[], int channels,
+                      uint32_t n, int bps, uint32_t frame_no) {
+  static const int assignments[4] = {1, 8, 9, 10}; // Indep., L/S, S/R, M/S
+  int mode = channels == 2 ? (int)(frame_no % 4) : 0;
+  int assignment = channels == 2 ? assignments[mode] : 0;
+  cov.stereo[mode] += channels == 2;
+
+  size_t start = w->len;
+  bw_put(w, 0xFFF8, 16);
+  uint32_t bs_code = n == FLAC_BLOCK ? 12 : n <= 256 ? 6 : 7;
+  bw_put(w, bs_code, 4);
+  bw_put(w, 0, 4); // Rate from STREAMINFO
+  bw_put(w, (uint32_t)assignment, 4);
+  bw_put(w, bps == 16 ? 4 : 6, 3);
+  bw_put(w, 0, 1);
+  put_utf8(w, frame_no);
+  if (bs_code != 12) {
+    bw_put(w, n - 1, bs_code == 6 ? 8 : 16);
+  }
+  bw_put(w, crc8(w->buf + start, w->len - start), 8);
+
+  int32_t *sub[2] = {chans[0], channels == 2 ? chans[1] : NULL};
+  int32_t *tmp[2] = {NULL, NULL};
+  if (assignment >= 8) {
+    const int32_t *l = chans[0], *r = chans[1];
+    tmp[0] = malloc(n * sizeof(int32_t));
+    tmp[1] = malloc(n * sizeof(int32_t));
+    for (uint32_t i = 0; i < n; i++) {
+      int32_t side = l[i] - r[i];
+      tmp[0][i] = assignment == 9 ? side : assignment == 10
+                                               ? (l[i] + r[i]) >> 1
+                                               : l[i];
+      tmp[1][i] = assignment == 9 ? r[i] : side;
+    }
+    sub[0] = tmp[0];
+    sub[1] = tmp[1];
+  }
+  for (int ch = 0; ch < channels; ch++) {
+    bool side = (assignment == 8 && ch == 1) || (assignment == 9 && ch == 0) ||
+                (assignment == 10 && ch == 1);
+    int kind = (int)((frame_no + (uint32_t)ch * 4) % KIND_COUNT);
+    put_subframe(w, sub[ch], n, bps + side, kind);
+  }
+  free(tmp[0]);
+  free(tmp[1]);
+
+  bw_align(w);
+  bw_put(w, crc16(w->buf + start, w->len - start), 16);
+}
+
+static void put_block_header(bw_t *w, bool last, int type, uint32_t len) {
+  bw_put(w, (last ? 0x80u : 0) | (uint32_t)type, 8);
+  bw_put(w, len, 24);
+}
+
+static void put_le32(bw_t *w, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    bw_put(w, (v >> (8 * i)) & 0xFF, 8);
+  }
+}
+
+/**
+ * @brief Encode source() to a FLAC file and its 16-bit reference
+ *
+ * @param seek_every SEEKTABLE point every this many frames, 0 for none
+ */
+static void make_flac(const char *path, uint32_t rate, int channels, int bps,
+                      long frames_total, int seek_every, ref_t *ref) {
+  bw_t audio = {0};
+  uint32_t frame_count =
+      (uint32_t)((frames_total + FLAC_BLOCK - 1) / FLAC_BLOCK);
+  uint64_t *offsets = calloc(frame_count, sizeof(uint64_t));
+  int32_t *chans[2];
+  for (int ch = 0; ch < channels; ch++) {
+    chans[ch] = malloc(FLAC_BLOCK * sizeof(int32_t));
+  }
+  *ref = (ref_t){.rate = rate, .channels = channels};
+  for (uint32_t f = 0; f < frame_count; f++) {
+    long first = (long)f * FLAC_BLOCK;
+    uint32_t n = (uint32_t)(frames_total - first < FLAC_BLOCK
+                                ? frames_total - first
+                                : FLAC_BLOCK);
+    for (uint32_t i = 0; i < n; i++) {
+      for (int ch = 0; ch < channels; ch++) {
+        chans[ch][i] = source(first + (long)i, ch, bps, rate);
+        ref_push(ref, (int16_t)(chans[ch][i] >> (bps - 16)));
+      }
+    }
+    offsets[f] = audio.len;
+    put_frame(&audio, chans, channels, n, bps, f);
+  }
+
+  bw_t w = {0};
+  bw_put(&w, 0x664C6143, 32); // "fLaC"
+  put_block_header(&w, false, 0, 34);
+  bw_put(&w, FLAC_BLOCK, 16);
+  bw_put(&w, FLAC_BLOCK, 16);
+  bw_put(&w, 0, 24);
+  bw_put(&w, 0, 24);
+  bw_put(&w, rate, 20);
+  bw_put(&w, (uint32_t)channels - 1, 3);
+  bw_put(&w, (uint32_t)bps - 1, 5);
+  bw_put(&w, 0, 4); // Total samples, upper bits
+  bw_put(&w, (uint32_t)frames_total, 32);
+  for (int i = 0; i < 4; i++) {
+    bw_put(&w, 0, 32); // MD5 not set
+  }
+  if (seek_every) {
+    uint32_t points = (frame_count + (uint32_t)seek_every - 1) / seek_every;
+    put_block_header(&w, false, 3, (points + 1) * 18);
+    for (uint32_t f = 0; f < frame_count; f += (uint32_t)seek_every) {
+      uint64_t sample = (uint64_t)f * FLAC_BLOCK;
+      bw_put(&w, (uint32_t)(sample >> 32), 32);
+      bw_put(&w, (uint32_t)sample, 32);
+      bw_put(&w, 0, 32);
+      bw_put(&w, (uint32_t)offsets[f], 32);
+      bw_put(&w, FLAC_BLOCK, 16);
+    }
+    bw_put(&w, 0xFFFFFFFF, 32); // Placeholder point
+    bw_put(&w, 0xFFFFFFFF, 32);
+    bw_put(&w, 0, 32);
+    bw_put(&w, 0, 32);
+    bw_put(&w, 0, 16);
+  }
+  static const char *const comments[] = {"TITLE=Encoder Sweep",
+                                         "ARTIST=Host Test"};
+  uint32_t len = 4 + 4 + 4;
+  for (int i = 0; i < 2; i++) {
+    len += 4 + (uint32_t)strlen(comments[i]);
+  }
+  put_block_header(&w, false, 4, len);
+  put_le32(&w, 4);
+  bw_put(&w, 0x74657374, 32); // Vendor "test"
+  put_le32(&w, 2);
+  for (int i = 0; i < 2; i++) {
+    put_le32(&w, (uint32_t)strlen(comments[i]));
+    for (const char *c = comments[i]; *c; c++) {
+      bw_put(&w, (uint8_t)*c, 8);
+    }
+  }
+  put_block_header(&w, true, 1, 100); // Padding
+  for (int i = 0; i < 100; i++) {
+    bw_put(&w, 0, 8);
+  }
+
+  FILE *fp = fopen(path, "wb");
+  CHECK(fp != NULL);
+  fwrite(w.buf, 1, w.len, fp);
+  fwrite(audio.buf, 1, audio.len, fp);
+  fclose(fp);
+  for (int ch = 0; ch < channels; ch++) {
+    free(chans[ch]);
+  }
+  free(offsets);
+  free(w.buf);
+  free(audio.buf);
+}
+
+/* ---------- WAV ---------- */
+
+static void put_le(uint8_t *p, uint32_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+static void make_wav(const char *path, uint32_t rate, int channels, int bits,
+                     long frames, bool extensible, ref_t *ref) {
+  static const uint8_t list[] = "INFOINAM\x05\0\0\0Tone\0\0IART\x03\0\0\0Me\0\0";
+  uint32_t data = (uint32_t)(frames * channels * (bits / 8));
+  uint32_t fmt = extensible ? 40 : 16;
+  size_t size = 12 + 8 + fmt + 8 + (sizeof(list) - 1) + 8 + 4 + 8 + data;
+  uint8_t *buf = calloc(1, size + 1);
+  uint8_t *p = buf;
+  memcpy(p, "RIFF", 4);
+  put_le(p + 4, (uint32_t)size - 8, 4);
+  memcpy(p + 8, "WAVEfmt ", 8);
+  put_le(p + 16, fmt, 4);
+  p += 20;
+  put_le(p, extensible ? 0xFFFE : 1, 2);
+  put_le(p + 2, (uint32_t)channels, 2);
+  put_le(p + 4, rate, 4);
+  put_le(p + 8, rate * (uint32_t)(channels * bits / 8), 4);
+  put_le(p + 12, (uint32_t)(channels * bits / 8), 2);
+  put_le(p + 14, (uint32_t)bits, 2);
+  if (extensible) {
+    put_le(p + 16, 22, 2);
+    put_le(p + 24, 1, 2); // PCM sub-format
+  }
+  p += fmt;
+  memcpy(p, "LIST", 4);
+  put_le(p + 4, sizeof(list) - 1, 4);
+  memcpy(p + 8, list, sizeof(list) - 1);
+  p += 8 + sizeof(list) - 1;
+  memcpy(p, "junk", 4); // Odd size: one pad byte follows
+  put_le(p + 4, 3, 4);
+  p += 12;
+  memcpy(p, "data", 4);
+  put_le(p + 4, data, 4);
+  p += 8;
+
+  *ref = (ref_t){.rate = rate, .channels = channels};
+  for (long i = 0; i < frames; i++) {
+    for (int ch = 0; ch < channels; ch++) {
+      int32_t s = source(i, ch, bits, rate);
+      uint32_t raw = bits == 8 ? (uint32_t)(s + 128) : (uint32_t)s;
+      put_le(p, raw, bits / 8);
+      p += bits / 8;
+      ref_push(ref, (int16_t)(bits == 8 ? s * 256 : s >> (bits - 16)));
+    }
+  }
+  write_file(path, buf, size);
+  free(buf);
+}
+
+/* ---------- MP3 ---------- */
+
+/**
+ * @brief Model output of every whole frame in data[start..len), junk skipped
+ */
+static void mp3_reference(const uint8_t *data, size_t len, size_t start,
+                          ref_t *ref) {
+  MP3FrameInfo info = {0};
+  *ref = (ref_t){0};
+  for (size_t i = start; i + 4 <= len;) {
+    int flen = mp3_model_frame(data + i, &info);
+    if (flen == 0 || i + (size_t)flen > len) {
+      i++;
+      continue;
+    }
+    for (int k = 0; k < info.outputSamps; k++) {
+      ref_push(ref, mp3_model_sample(data + i, flen, k));
+    }
+    ref->rate = (uint32_t)info.samprate;
+    ref->channels = info.nChans;
+    i += (size_t)flen;
+  }
+}
+
+/**
+ * @brief ID3v2.3 tag (with a fake frame sync inside), Xing frame with TOC,
+ * then MPEG-1 128 kbps 48 kHz stereo frames of 384 bytes
+ */
+static void make_tagged_mp3(const char *path, ref_t *ref) {
+  enum { FRAME = 384 };
+  static const uint8_t tag_frames[] =
+      "TIT2\0\0\0\x07\0\0\0Tagged"
+      "TPE1\0\0\0\x06\0\0\0Model"
+      "APIC\0\0\0\x08\0\0\0\xFF\xFB\x94\0\xFF\xFB\x94"; // Looks like sync
+  size_t tag_len = sizeof(tag_frames) - 1;
+  size_t size = 10 + tag_len + (size_t)(MP3_FRAMES + 1) * FRAME;
+  uint8_t *buf = calloc(1, size);
+  memcpy(buf, "ID3\x03\0\0", 6);
+  buf[9] = (uint8_t)tag_len; // Syncsafe, < 128
+  memcpy(buf + 10, tag_frames, tag_len);
+
+  uint8_t *f = buf + 10 + tag_len;
+  static const uint8_t header[4] = {0xFF, 0xFB, 0x94, 0x00};
+  memcpy(f, header, 4);
+  memcpy(f + 36, "Xing", 4);
+  put_le(f + 40, 0x07000000, 4); // Big-endian 7: frames, bytes, TOC
+  uint32_t frames = MP3_FRAMES + 1, bytes = (MP3_FRAMES + 1) * FRAME;
+  uint8_t be[8] = {frames >> 24, frames >> 16, frames >> 8, frames,
+                   bytes >> 24,  bytes >> 16,  bytes >> 8,  bytes};
+  memcpy(f + 44, be, 8);
+  for (int i = 0; i < 100; i++) {
+    f[52 + i] = (uint8_t)(i * 256 / 100);
+  }
+  for (int n = 1; n <= MP3_FRAMES; n++) {
+    uint8_t *fr = f + n * FRAME;
+    memcpy(fr, header, 4);
+    for (int i = 4; i < FRAME; i++) {
+      fr[i] = (uint8_t)(noise(n * FRAME + i, 0) % 255); // Never 0xFF
+    }
+  }
+  write_file(path, buf, size);
+  mp3_reference(buf, size, 10 + tag_len, ref);
+  free(buf);
+}
+
+/**
+ * @brief The wake prompt with junk after every tenth frame and its last
+ * frame cut in half
+ */
+static void make_junk_mp3(const uint8_t *src, size_t len, const char *path,
+                          ref_t *ref) {
+  uint8_t *buf = malloc(len * 2);
+  size_t out = 0, i = 0;
+  int n = 0;
+  MP3FrameInfo info;
+  int flen;
+  while (i + 4 <= len && (flen = mp3_model_frame(src + i, &info)) > 0 &&
+         i + (size_t)flen <= len) {
+    bool last = i + (size_t)flen == len;
+    size_t keep = last ? (size_t)flen / 2 : (size_t)flen;
+    memcpy(buf + out, src + i, keep);
+    out += keep;
+    i += (size_t)flen;
+    if (++n % 10 == 0 && !last) {
+      for (int j = 0; j < 37; j++) {
+        buf[out++] = (uint8_t)(0x20 + j);
+      }
+    }
+  }
+  write_file(path, buf, out);
+  mp3_reference(buf, out, 0, ref);
+  free(buf);
+}
+
+/* ---------- Checks ---------- */
+
+static bool open_track(const char *path, FILE **fp, music_decoder_t *dec) {
+  *fp = fopen(path, "rb");
+  if (!*fp) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    host_test_failures++;
+    return false;
+  }
+  if (music_decoder_open(dec, *fp) != ESP_OK) {
+    fprintf(stderr, "%s: decoder did not open\n", path);
+    host_test_failures++;
+    fclose(*fp);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Decode until n samples are collected or the stream ends
+ */
+static size_t decode_some(music_decoder_t *dec, int16_t *out, size_t n) {
+  int16_t block[MUSIC_DECODER_BLOCK_SAMPLES];
+  size_t got = 0;
+  while (got < n) {
+    int r = music_decoder_decode(dec, block);
+    if (r <= 0) {
+      break;
+    }
+    size_t take = (size_t)r < n - got ? (size_t)r : n - got;
+    memcpy(out + got, block, take * sizeof(int16_t));
+    got += take;
+  }
+  return got;
+}
+
+static void check_decode(const char *path, const ref_t *ref) {
+  FILE *fp;
+  music_decoder_t dec;
+  if (!open_track(path, &fp, &dec)) {
+    return;
+  }
+  CHECK_EQ(dec.sample_rate, ref->rate);
+  CHECK_EQ(dec.channels, ref->channels);
+  int16_t *out = malloc((ref->len + MUSIC_DECODER_BLOCK_SAMPLES) * 2);
+  size_t got = decode_some(&dec, out, ref->len + MUSIC_DECODER_BLOCK_SAMPLES);
+  if (got != ref->len) {
+    fprintf(stderr, "%s: %zu samples, expected %zu\n", path, got, ref->len);
+    host_test_failures++;
+  }
+  for (size_t i = 0; i < got && i < ref->len; i++) {
+    if (out[i] != ref->pcm[i]) {
+      fprintf(stderr, "%s: sample %zu is %d, expected %d\n", path, i, out[i],
+              ref->pcm[i]);
+      host_test_failures++;
+      break;
+    }
+  }
+  free(out);
+  music_decoder_close(&dec);
+  fclose(fp);
+}
+
+/**
+ * @brief Seek, then compare what follows with the reference
+ *
+ * @param slack 0: must land on the target; else the frame size the landing
+ *              may be off by, the data still has to match where it really is
+ */
+static void check_seek(const char *path, const ref_t *ref, uint64_t target,
+                       uint64_t slack) {
+  FILE *fp;
+  music_decoder_t dec;
+  if (!open_track(path, &fp, &dec)) {
+    return;
+  }
+  uint64_t actual = 0;
+  CHECK_EQ(music_decoder_seek(&dec, target, &actual), ESP_OK);
+  enum { SPAN = 4096 };
+  int16_t out[SPAN];
+  size_t got = decode_some(&dec, out, SPAN);
+  size_t frames = ref->len / (size_t)ref->channels;
+
+  bool found = false;
+  uint64_t at = actual;
+  if (slack == 0) {
+    CHECK_EQ(actual, target);
+    size_t want = (frames - actual) * ref->channels;
+    found = got == (want < SPAN ? want : SPAN) &&
+            memcmp(out, ref->pcm + actual * ref->channels, got * 2) == 0;
+  } else {
+    // Where the decoded frame really starts, among frame boundaries near it
+    uint64_t from = actual > 2 * slack ? (actual / slack - 2) * slack : 0;
+    for (at = from; at <= actual + 2 * slack && at < frames; at += slack) {
+      size_t avail = (frames - at) * ref->channels;
+      size_t n = got < avail ? got : avail;
+      if (n > 0 && memcmp(out, ref->pcm + at * ref->channels, n * 2) == 0) {
+        found = true;
+        break;
+      }
+    }
+    CHECK(found && (at > actual ? at - actual : actual - at) < slack);
+  }
+  if (!found) {
+    fprintf(stderr, "%s: seek to %llu (landed %llu) decodes wrong data\n",
+            path, (unsigned long long)target, (unsigned long long)actual);
+    host_test_failures++;
+  }
+  music_decoder_close(&dec);
+  fclose(fp);
+}
+
+static void check_probe(const char *path, const ref_t *ref, uint32_t ms,
+                        const char *title, const char *artist) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    host_test_failures++;
+    return;
+  }
+  const music_decoder_ops_t *ops = music_decoder_sniff(fp);
+  CHECK(ops != NULL);
+  if (ops) {
+    fseek(fp, 0, SEEK_END);
+    uint32_t size = (uint32_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t buf[4096];
+    music_probe_t probe = {0};
+    CHECK_EQ(ops->probe(fp, size, buf, sizeof(buf), &probe), ESP_OK);
+    CHECK_EQ(probe.sample_rate, ref->rate);
+    CHECK_EQ(probe.channels, ref->channels);
+    CHECK_EQ(probe.duration_ms, ms);
+    CHECK(strcmp(probe.title, title) == 0);
+    CHECK(strcmp(probe.artist, artist) == 0);
+  }
+  fclose(fp);
+}
+
+/**
+ * @brief Decode the whole file repeatedly for about BENCH_SECONDS
+ */
+static void bench(const char *label, const char *path) {
+  FILE *fp;
+  music_decoder_t dec;
+  double t0 = now_s(), elapsed = 0;
+  uint64_t samples = 0, frames = 0;
+  uint32_t rate = 0;
+  int16_t block[MUSIC_DECODER_BLOCK_SAMPLES];
+  while (elapsed < BENCH_SECONDS) {
+    if (!open_track(path, &fp, &dec)) {
+      return;
+    }
+    rate = dec.sample_rate;
+    int r;
+    while ((r = music_decoder_decode(&dec, block)) > 0) {
+      samples += (uint64_t)r;
+      frames += (uint64_t)r / dec.channels;
+    }
+    music_decoder_close(&dec);
+    fclose(fp);
+    elapsed = now_s() - t0;
+  }
+  printf("%-24s %7.1f Msamples/s, %6.0fx real time\n", label,
+         samples / elapsed / 1e6, (double)frames / rate / elapsed);
+}
+
+int main(void) {
+  mkdir("build", 0755);
+  mkdir(OUT_DIR, 0755);
+  ref_t ref;
+
+  // FLAC: 10 s stereo 16-bit with no SEEKTABLE; 3 s mono 24-bit with one
+  static const char *flac16 = OUT_DIR "/stereo16.flac";
+  static const char *flac24 = OUT_DIR "/mono24.flac";
+  ref_t ref16, ref24;
+  make_flac(flac16, 44100, 2, 16, 441000, 0, &ref16);
+  make_flac(flac24, 48000, 1, 24, 144000, 8, &ref24);
+  printf("FLAC coverage: %d constant, %d verbatim, fixed %d/%d/%d/%d/%d, "
+         "LPC %d 32-bit + %d 64-bit, %d escaped, %d 5-bit Rice, %d wasted, "
+         "stereo %d/%d/%d/%d\n",
+         cov.constant, cov.verbatim, cov.fixed[0], cov.fixed[1], cov.fixed[2],
+         cov.fixed[3], cov.fixed[4], cov.lpc_narrow, cov.lpc_wide, cov.escape,
+         cov.rice5, cov.wasted, cov.stereo[0], cov.stereo[1], cov.stereo[2],
+         cov.stereo[3]);
+  CHECK(cov.constant && cov.verbatim && cov.lpc_narrow && cov.lpc_wide &&
+        cov.escape && cov.rice5 && cov.wasted);
+  for (int i = 0; i < 5; i++) {
+    CHECK(cov.fixed[i] > 0);
+  }
+  for (int i = 0; i < 4; i++) {
+    CHECK(cov.stereo[i] > 0);
+  }
+  check_decode(flac16, &ref16);
+  check_decode(flac24, &ref24);
+  check_probe(flac16, &ref16, 10000, "Encoder Sweep", "Host Test");
+  check_probe(flac24, &ref24, 3000, "Encoder Sweep", "Host Test");
+  static const uint64_t flac_targets[] = {0, 4095, 12345, 50 * 4096 + 7,
+                                          440990};
+  for (size_t i = 0; i < sizeof(flac_targets) / sizeof(*flac_targets); i++) {
+    check_seek(flac16, &ref16, flac_targets[i], 0);
+  }
+  check_seek(flac24, &ref24, 100000, 0);
+  check_seek(flac24, &ref24, 5, 0);
+  check_seek(flac24, &ref24, 143999, 0);
+
+  // WAV: each sample size, one WAVE_FORMAT_EXTENSIBLE
+  static const struct {
+    int bits, channels;
+    bool extensible;
+    const char *path;
+  } wavs[] = {
+      {16, 2, false, OUT_DIR "/pcm16.wav"},
+      {8, 1, false, OUT_DIR "/pcm8.wav"},
+      {24, 2, true, OUT_DIR "/pcm24.wav"},
+      {32, 1, false, OUT_DIR "/pcm32.wav"},
+  };
+  ref_t wav16 = {0};
+  for (size_t i = 0; i < sizeof(wavs) / sizeof(*wavs); i++) {
+    make_wav(wavs[i].path, 44100, wavs[i].channels, wavs[i].bits, 441000 / 4 +
+             1, wavs[i].extensible, &ref);
+    check_decode(wavs[i].path, &ref);
+    check_probe(wavs[i].path, &ref, 2500, "Tone", "Me");
+    check_seek(wavs[i].path, &ref, 20000, 0);
+    check_seek(wavs[i].path, &ref, 110250, 0);
+    if (i == 0) {
+      wav16 = ref;
+    } else {
+      free(ref.pcm);
+    }
+  }
+  free(wav16.pcm);
+  make_wav(OUT_DIR "/bench16.wav", 44100, 2, 16, 441000, false, &wav16);
+
+  // MP3
+  static const char *tagged = OUT_DIR "/tagged.mp3";
+  static const char *junk = OUT_DIR "/junk.mp3";
+  make_tagged_mp3(tagged, &ref);
+  check_decode(tagged, &ref);
+  check_probe(tagged, &ref, (MP3_FRAMES + 1) * 1152 * 1000 / 48000, "Tagged",
+              "Model");
+  check_seek(tagged, &ref, 1152 * 150 + 100, 1152);
+  check_seek(tagged, &ref, 1152 * MP3_FRAMES - 1, 1152);
+  free(ref.pcm);
+
+  size_t prompt_len;
+  uint8_t *prompt = read_file(WAKE_PROMPT, &prompt_len);
+  CHECK(prompt != NULL);
+  if (prompt) {
+    mp3_reference(prompt, prompt_len, 0, &ref);
+    CHECK(ref.len > 0);
+    check_decode(WAKE_PROMPT, &ref);
+    check_seek(WAKE_PROMPT, &ref, 576 * 60, 576);
+    free(ref.pcm);
+    make_junk_mp3(prompt, prompt_len, junk, &ref);
+    check_decode(junk, &ref);
+    free(ref.pcm);
+    free(prompt);
+  }
+
+  bench("WAV 16-bit stereo", OUT_DIR "/bench16.wav");
+  bench("WAV 24-bit stereo", OUT_DIR "/pcm24.wav");
+  bench("FLAC 16-bit stereo", flac16);
+  bench("FLAC 24-bit mono", flac24);
+  bench("MP3 plug-in (model)", tagged);
+
+  free(wav16.pcm);
+  free(ref16.pcm);
+  free(ref24.pcm);
+  return host_test_done("music_decoder");
+}
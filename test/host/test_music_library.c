@@ -0,0 +1,214 @@
+/**
+ * @file test_music_library.c
+ * @brief Build and query the music index over a generated 10k-file tree
+ *
+ * The tree is written fresh on every run. Changes are made the way FATFS
+ * shows them: the directory mtime is put back afterwards, since FAT does not
+ * update it for new entries. Only the listing fingerprint can notice them.
+ */
+
+#include "host_test.h"
+#include "music_library.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACKS 10000
+
+static const char *music_dir = MUSIC_LIBRARY_INDEX_DIR "/music";
+static const char *index_path = MUSIC_LIBRARY_INDEX_DIR "/.music_index.bin";
+
+static uint32_t track_rate(int n) { return n % 2 ? 44100 : 16000; }
+static uint16_t track_channels(int n) { return n % 3 ? 2 : 1; }
+static uint32_t track_frames(int n) { return 100 + (uint32_t)n % 50; }
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void write_wav(const char *name, int n) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", music_dir, name);
+  uint16_t ch = track_channels(n);
+  uint32_t data = track_frames(n) * ch * 2;
+  uint8_t hdr[44];
+  memcpy(hdr, "RIFF", 4);
+  put32(hdr + 4, 36 + data);
+  memcpy(hdr + 8, "WAVEfmt ", 8);
+  put32(hdr + 16, 16);
+  put16(hdr + 20, 1); // PCM
+  put16(hdr + 22, ch);
+  put32(hdr + 24, track_rate(n));
+  put32(hdr + 28, track_rate(n) * ch * 2);
+  put16(hdr + 32, (uint16_t)(ch * 2));
+  put16(hdr + 34, 16);
+  memcpy(hdr + 36, "data", 4);
+  put32(hdr + 40, data);
+
+  FILE *fp = fopen(path, "wb");
+  CHECK(fp != NULL);
+  CHECK(fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+  uint8_t *pcm = calloc(1, data);
+  CHECK(fwrite(pcm, 1, data, fp) == data);
+  free(pcm);
+  fclose(fp);
+}
+
+static void make_tree(void) {
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s && mkdir -p %s",
+           MUSIC_LIBRARY_INDEX_DIR, music_dir);
+  CHECK(system(cmd) == 0);
+  char name[32];
+  for (int n = 0; n < TRACKS; n++) {
+    snprintf(name, sizeof(name), "track%05d.wav", n);
+    write_wav(name, n);
+  }
+  // Not indexed: hidden, unsupported, subdirectory
+  write_wav(".hidden.wav", 0);
+  write_wav("notes.txt", 0);
+  snprintf(cmd, sizeof(cmd), "%s/sub", music_dir);
+  CHECK(mkdir(cmd, 0755) == 0);
+}
+
+/**
+ * @brief Run fn, then put the directory mtime back as FAT would leave it
+ */
+static void keep_dir_mtime(void (*fn)(void)) {
+  struct stat st;
+  CHECK(stat(music_dir, &st) == 0);
+  fn();
+  struct timeval tv[2] = {{st.st_atime, 0}, {st.st_mtime, 0}};
+  CHECK(utimes(music_dir, tv) == 0);
+}
+
+static ino_t index_inode(void) {
+  struct stat st;
+  return stat(index_path, &st) == 0 ? st.st_ino : 0;
+}
+
+static double ms_since(const struct timespec *t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief Every record matches the file it was built from
+ */
+static void check_all_tracks(int expected) {
+  CHECK_EQ(music_library_get_count(), expected);
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  char name[64];
+  for (int i = 0; i < expected; i++) {
+    CHECK_EQ(music_library_get_path(i, path, sizeof(path)), ESP_OK);
+    const char *base = strrchr(path, '/') + 1;
+    int n;
+    CHECK(sscanf(base, "track%d.wav", &n) == 1);
+    music_track_info_t info;
+    CHECK_EQ(music_library_get_info(i, &info), ESP_OK);
+    CHECK_EQ(info.format, MUSIC_FORMAT_WAV);
+    CHECK_EQ(info.sample_rate, track_rate(n));
+    CHECK_EQ(info.channels, track_channels(n));
+    CHECK_EQ(info.duration_ms, track_frames(n) * 1000 / track_rate(n));
+    CHECK_EQ(music_library_get_display_name(i, name, sizeof(name)), ESP_OK);
+    CHECK(strncmp(name, base, strlen(name)) == 0 && !strchr(name, '.'));
+  }
+  CHECK(music_library_get_info(expected, &(music_track_info_t){0}) ==
+        ESP_ERR_INVALID_ARG);
+}
+
+static void add_track(void) { write_wav("track99999.wav", 99999); }
+
+// Same name, new content: a different length and a later mtime
+static void replace_track(void) {
+  write_wav("track00011.wav", 0);
+  char path[256];
+  snprintf(path, sizeof(path), "%s/track00011.wav", music_dir);
+  struct timeval tv[2] = {{0, 0}, {time(NULL) + 10, 0}};
+  CHECK(utimes(path, tv) == 0);
+}
+
+static void rename_track(void) {
+  char from[256], to[256];
+  snprintf(from, sizeof(from), "%s/track00007.wav", music_dir);
+  snprintf(to, sizeof(to), "%s/moved00007.wav", music_dir);
+  CHECK(rename(from, to) == 0);
+}
+
+int main(void) {
+  make_tree();
+
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  CHECK_EQ(music_library_open(music_dir), ESP_OK);
+  printf("build: %d tracks in %.0f ms\n", music_library_get_count(),
+         ms_since(&t0));
+  ino_t built = index_inode();
+  CHECK(built != 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  check_all_tracks(TRACKS);
+  printf("query: %d paths + infos + names in %.0f ms\n", TRACKS,
+         ms_since(&t0));
+
+  // Unchanged tree: the index is reused, not rebuilt
+  music_library_close();
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  CHECK_EQ(music_library_open(music_dir), ESP_OK);
+  printf("reopen: %.1f ms\n", ms_since(&t0));
+  CHECK(index_inode() == built);
+  CHECK_EQ(music_library_get_count(), TRACKS);
+
+  // New file, directory mtime unchanged: rebuilt anyway
+  keep_dir_mtime(add_track);
+  music_library_close();
+  CHECK_EQ(music_library_open(music_dir), ESP_OK);
+  CHECK(index_inode() != built);
+  check_all_tracks(TRACKS + 1);
+
+  // Same count, different name: rebuilt too
+  built = index_inode();
+  keep_dir_mtime(rename_track);
+  music_library_close();
+  CHECK_EQ(music_library_open(music_dir), ESP_OK);
+  CHECK(index_inode() != built);
+  CHECK_EQ(music_library_get_count(), TRACKS + 1);
+
+  // Same count and names, one file replaced: rebuilt, new info read
+  built = index_inode();
+  keep_dir_mtime(replace_track);
+  music_library_close();
+  CHECK_EQ(music_library_open(music_dir), ESP_OK);
+  CHECK(index_inode() != built);
+  CHECK_EQ(music_library_get_count(), TRACKS + 1);
+  char path[MUSIC_LIBRARY_PATH_MAX];
+  music_track_info_t info = {0};
+  for (int i = 0; i < TRACKS + 1; i++) {
+    music_library_get_path(i, path, sizeof(path));
+    if (strstr(path, "track00011.wav")) {
+      CHECK_EQ(music_library_get_info(i, &info), ESP_OK);
+    }
+  }
+  CHECK_EQ(info.sample_rate, track_rate(0));
+  CHECK_EQ(info.channels, track_channels(0));
+
+  // Forced rescan
+  built = index_inode();
+  CHECK_EQ(music_library_rebuild(), ESP_OK);
+  CHECK(index_inode() != built);
+
+  music_library_close();
+  return host_test_done("music_library");
+}
@@ -0,0 +1,448 @@
+/**
+ * @file test_network_failover.c
+ * @brief Ethernet link-down simulation: WiFi fallback and standby commands
+ *
+ * network_manager.c runs against fakes of the Ethernet driver, netif, WiFi
+ * manager and job arena. Jobs are queued rather than run, so each scenario
+ * decides exactly when the WiFi job runs relative to link events, and hooks
+ * inside the fakes drop or restore the link in the middle of a job, where a
+ * worker thread would race the event loop. Each scenario runs in its own
+ * process, since the module keeps its state in statics.
+ *
+ * After everything settles: with the cable in, Ethernet is the active
+ * network and WiFi is stopped (cold fallback) or asleep (standby); with it
+ * out, WiFi is active and awake.
+ */
+
+#include "esp_eth.h"
+#include "host_test.h"
+#include "network_manager.h"
+#include "settings_manager.h"
+#include "task_arena.h"
+#include "wifi_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_JOBS 8
+#define FLAP_ROUNDS 2000
+
+esp_event_base_t const ETH_EVENT = "ETH_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+typedef enum {
+  AT_NONE,
+  AT_WIFI_START,    // Inside wifi_init_sta(), before it returns
+  AT_IS_CONNECTED,  // Inside the next wifi_is_connected() from a job
+  AT_POWER_SAVE_ON, // Inside wifi_manager_set_power_save(true)
+} hook_point_t;
+
+static struct {
+  bool standby_setting;
+  bool cable;
+  bool wifi_up;
+  bool power_save;
+  int wifi_starts;
+  int power_save_on_calls;
+  esp_netif_t *default_netif;
+  bool queue_full;
+  bool in_job;
+  hook_point_t hook_at;
+  void (*hook)(void);
+} fake;
+
+static struct {
+  worker_job_fn_t fn;
+  void *arg;
+} jobs[MAX_JOBS];
+static int job_count = 0;
+
+static esp_event_handler_t eth_handler = NULL;
+static esp_event_handler_t ip_handler = NULL;
+static char eth_netif, sta_netif; // Addresses only
+
+static void fire(hook_point_t at) {
+  if (fake.hook_at == at) {
+    fake.hook_at = AT_NONE;
+    fake.hook();
+  }
+}
+
+/* ---------- Fakes ---------- */
+
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id,
+                                     esp_event_handler_t handler, void *arg) {
+  (void)id;
+  (void)arg;
+  if (base == ETH_EVENT) {
+    eth_handler = handler;
+  } else {
+    ip_handler = handler;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void) { return ESP_OK; }
+
+esp_netif_t *esp_netif_new(const esp_netif_config_t *config) {
+  (void)config;
+  return (esp_netif_t *)&eth_netif;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *key) {
+  return strcmp(key, "WIFI_STA_DEF") == 0 && fake.wifi_starts > 0
+             ? (esp_netif_t *)&sta_netif
+             : NULL;
+}
+
+esp_err_t esp_netif_set_default_netif(esp_netif_t *netif) {
+  fake.default_netif = netif;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_attach(esp_netif_t *netif, void *glue) {
+  (void)netif;
+  (void)glue;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *info) {
+  (void)netif;
+  memset(info, 0, sizeof(*info));
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *info) {
+  (void)netif;
+  (void)type;
+  memset(info, 0, sizeof(*info));
+  return ESP_OK;
+}
+
+esp_eth_mac_t *esp_eth_mac_new_esp32(const eth_esp32_emac_config_t *emac,
+                                     const eth_mac_config_t *mac) {
+  (void)emac;
+  (void)mac;
+  return (esp_eth_mac_t *)&eth_netif;
+}
+
+esp_eth_phy_t *esp_eth_phy_new_ip101(const eth_phy_config_t *config) {
+  (void)config;
+  return (esp_eth_phy_t *)&eth_netif;
+}
+
+esp_err_t esp_eth_driver_install(const esp_eth_config_t *config,
+                                 esp_eth_handle_t *handle) {
+  (void)config;
+  *handle = &eth_netif;
+  return ESP_OK;
+}
+
+void *esp_eth_new_netif_glue(esp_eth_handle_t handle) { return handle; }
+
+static void link_up(void);
+
+esp_err_t esp_eth_start(esp_eth_handle_t handle) {
+  (void)handle;
+  if (fake.cable) {
+    link_up();
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_eth_stop(esp_eth_handle_t handle) {
+  (void)handle;
+  return ESP_OK;
+}
+
+esp_err_t settings_manager_load(app_settings_t *settings) {
+  memset(settings, 0, sizeof(*settings));
+  strcpy(settings->wifi_ssid, "test");
+  settings->wifi_standby = fake.standby_setting;
+  return ESP_OK;
+}
+
+esp_err_t wifi_init_sta(const char *ssid, const char *password) {
+  (void)ssid;
+  (void)password;
+  fake.wifi_starts++;
+  fake.wifi_up = true;
+  fake.power_save = false;
+  fire(AT_WIFI_START);
+  // Associated: the lease arrives as an event
+  ip_event_got_ip_t got = {0};
+  ip_handler(NULL, IP_EVENT, IP_EVENT_STA_GOT_IP, &got);
+  return ESP_OK;
+}
+
+bool wifi_is_connected(void) {
+  if (fake.in_job) {
+    fire(AT_IS_CONNECTED);
+  }
+  return fake.wifi_up;
+}
+
+esp_err_t wifi_manager_stop(void) {
+  CHECK(fake.wifi_up); // Only stopped when up
+  fake.wifi_up = false;
+  return ESP_OK;
+}
+
+esp_err_t wifi_manager_set_power_save(bool standby) {
+  CHECK(fake.wifi_up);
+  fake.power_save = standby;
+  if (standby) {
+    fake.power_save_on_calls++;
+    fire(AT_POWER_SAVE_ON);
+  }
+  return ESP_OK;
+}
+
+esp_err_t task_arena_submit_job(worker_job_fn_t fn, void *arg) {
+  if (fake.queue_full || job_count == MAX_JOBS) {
+    return ESP_ERR_TIMEOUT;
+  }
+  jobs[job_count].fn = fn;
+  jobs[job_count].arg = arg;
+  job_count++;
+  return ESP_OK;
+}
+
+/* ---------- Simulation ---------- */
+
+static void link_up(void) {
+  fake.cable = true;
+  eth_handler(NULL, ETH_EVENT, ETHERNET_EVENT_CONNECTED, NULL);
+  ip_event_got_ip_t got = {0};
+  ip_handler(NULL, IP_EVENT, IP_EVENT_ETH_GOT_IP, &got);
+}
+
+static void link_down(void) {
+  fake.cable = false;
+  eth_handler(NULL, ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, NULL);
+}
+
+static void toggle_link(void) {
+  if (fake.cable) {
+    link_down();
+  } else {
+    link_up();
+  }
+}
+
+/**
+ * @brief Run the oldest queued job, as the job worker would
+ *
+ * @return false if none was queued
+ */
+static bool run_one_job(void) {
+  if (job_count == 0) {
+    return false;
+  }
+  worker_job_fn_t fn = jobs[0].fn;
+  void *arg = jobs[0].arg;
+  memmove(jobs, jobs + 1, --job_count * sizeof(jobs[0]));
+  fake.in_job = true;
+  fn(arg);
+  fake.in_job = false;
+  return true;
+}
+
+static void run_jobs(void) {
+  while (run_one_job()) {
+  }
+}
+
+/**
+ * @brief Check the settled state for the current cable position
+ */
+static void check_settled(const char *where) {
+  run_jobs();
+  network_type_t active = network_manager_get_active_type();
+  bool ok;
+  if (fake.cable) {
+    ok = active == NETWORK_TYPE_ETHERNET &&
+         fake.default_netif == (esp_netif_t *)&eth_netif &&
+         (fake.standby_setting ? fake.wifi_up && fake.power_save
+                               : !fake.wifi_up);
+  } else {
+    // Cold fallback leaves the route to netif priority once Ethernet is
+    // down; a promoted standby link is made the default explicitly
+    ok = active == NETWORK_TYPE_WIFI && fake.wifi_up && !fake.power_save &&
+         (!fake.standby_setting ||
+          fake.default_netif == (esp_netif_t *)&sta_netif);
+  }
+  if (!ok) {
+    fprintf(stderr,
+            "%s: cable %s, active %s, default %s, wifi %s, power save %s\n",
+            where, fake.cable ? "in" : "out",
+            network_manager_type_to_string(active),
+            fake.default_netif == (esp_netif_t *)&eth_netif   ? "eth"
+            : fake.default_netif == (esp_netif_t *)&sta_netif ? "sta"
+                                                              : "none",
+            fake.wifi_up ? "up" : "down", fake.power_save ? "on" : "off");
+    host_test_failures++;
+  }
+}
+
+static void boot(bool standby, bool cable) {
+  fake.standby_setting = standby;
+  fake.cable = cable;
+  CHECK_EQ(network_manager_init(), ESP_OK);
+  CHECK_EQ(network_manager_is_wifi_standby(), standby);
+  check_settled("boot");
+}
+
+/* ---------- Scenarios ---------- */
+
+// Cable back while STANDBY is queued, pulled again before it runs: the
+// promotion's ACTIVATE must not be lost behind the queued STANDBY
+static void standby_promote_while_queued(void) {
+  boot(true, true);
+  link_down();
+  check_settled("first failover");
+  link_up();
+  CHECK_EQ(job_count, 1);
+  link_down();
+  check_settled("promoted with STANDBY queued");
+}
+
+// Cable pulled while the job is putting WiFi to sleep
+static void standby_promote_during_sleep(void) {
+  boot(true, true);
+  link_down();
+  link_up();
+  fake.hook_at = AT_POWER_SAVE_ON;
+  fake.hook = link_down;
+  check_settled("promoted during set_power_save(true)");
+  CHECK_EQ(fake.hook_at, AT_NONE);
+}
+
+// Cable pulled after the job associated but before it decides to sleep
+static void standby_promote_before_check(void) {
+  boot(true, true);
+  link_down();
+  link_up();
+  int sleeps = fake.power_save_on_calls;
+  fake.hook_at = AT_IS_CONNECTED;
+  fake.hook = link_down;
+  check_settled("promoted before the power save check");
+  CHECK_EQ(fake.power_save_on_calls, sleeps); // Never put to sleep
+}
+
+// Cable back before the cold START ran: STOP supersedes it, and the
+// fallback flag is cleared so the next pull starts WiFi again
+static void cold_cable_back_before_start(void) {
+  boot(false, true);
+  link_down();
+  CHECK_EQ(job_count, 1);
+  link_up();
+  check_settled("cable back before START");
+  CHECK_EQ(fake.wifi_starts, 0);
+  link_down();
+  check_settled("next pull");
+  CHECK_EQ(fake.wifi_starts, 1);
+}
+
+// Cable back while WiFi is associating
+static void cold_cable_back_during_start(void) {
+  boot(false, true);
+  link_down();
+  fake.hook_at = AT_WIFI_START;
+  fake.hook = link_up;
+  check_settled("cable back during START");
+}
+
+// Job queue full: the command is dropped, the next one still goes through
+static void queue_full_recovers(void) {
+  boot(false, true);
+  fake.queue_full = true;
+  link_down();
+  CHECK_EQ(job_count, 0);
+  fake.queue_full = false;
+  link_up();
+  link_down();
+  check_settled("after a dropped command");
+}
+
+static void forced_fallback(void) {
+  boot(true, true);
+  run_jobs();
+  fake.cable = false; // esp_eth_stop(): the cable stays, the link goes
+  CHECK_EQ(network_manager_force_wifi_fallback(), ESP_OK);
+  check_settled("forced fallback");
+  CHECK(network_manager_get_last_failover_ms() < 100);
+}
+
+// Random link flaps, job runs and mid-job hooks
+static void flap(bool standby) {
+  static const hook_point_t points[] = {AT_NONE, AT_WIFI_START,
+                                        AT_IS_CONNECTED, AT_POWER_SAVE_ON};
+  boot(standby, rand() % 2);
+  for (int round = 0; round < FLAP_ROUNDS; round++) {
+    switch (rand() % 4) {
+    case 0:
+      toggle_link();
+      break;
+    case 1:
+      run_one_job();
+      break;
+    case 2:
+      fake.hook_at = points[rand() % 4];
+      fake.hook = toggle_link;
+      break;
+    default:
+      if (rand() % 8 == 0) {
+        fake.hook_at = AT_NONE;
+        check_settled("flap");
+      }
+      break;
+    }
+  }
+  fake.hook_at = AT_NONE;
+  check_settled("flap end");
+}
+
+static void flap_cold(void) { flap(false); }
+static void flap_standby(void) { flap(true); }
+
+static const struct {
+  const char *name;
+  void (*fn)(void);
+} scenarios[] = {
+    {"standby: promote while STANDBY queued", standby_promote_while_queued},
+    {"standby: promote during sleep", standby_promote_during_sleep},
+    {"standby: promote before the check", standby_promote_before_check},
+    {"cold: cable back before START", cold_cable_back_before_start},
+    {"cold: cable back during START", cold_cable_back_during_start},
+    {"cold: job queue full", queue_full_recovers},
+    {"standby: forced fallback", forced_fallback},
+    {"cold: random flaps", flap_cold},
+    {"standby: random flaps", flap_standby},
+};
+
+int main(void) {
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(*scenarios); i++) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      srand((unsigned)i + 1);
+      scenarios[i].fn();
+      exit(host_test_failures ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "scenario failed: %s\n", scenarios[i].name);
+      host_test_failures++;
+    }
+  }
+  printf("network failover: %zu scenarios, %d random flap rounds each mode\n",
+         sizeof(scenarios) / sizeof(*scenarios), FLAP_ROUNDS);
+  return host_test_done("network_failover");
+}
@@ -0,0 +1,204 @@
+/**
+ * @file test_pipeline_fsm.c
+ * @brief Scripted runs through the voice pipeline transition table
+ *
+ * Each script is the event sequence one conversation produces, with the
+ * simulated time every event is raised at and the state expected after it.
+ * Time only moves forward by the script, so the dwell and latency statistics
+ * can be checked exactly.
+ */
+
+#include "host_test.h"
+#include "pipeline_fsm.h"
+#include <stdio.h>
+#include <time.h>
+
+#define POST_DELAY_US 300 // Queue time of every scripted event
+
+typedef struct {
+  int64_t at_ms; // Time the event is raised
+  vp_event_t event;
+  vp_state_t expect;
+} step_t;
+
+#define STEP(ms, ev, st) {ms, VP_EVENT_##ev, VP_STATE_##st}
+#define RUN(fsm, steps) run(fsm, #steps, steps, sizeof(steps) / sizeof(*steps))
+
+static int64_t run(vp_fsm_t *fsm, const char *name, const step_t *steps,
+                   size_t count) {
+  int64_t now_us = 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t posted_us = steps[i].at_ms * 1000;
+    now_us = posted_us + POST_DELAY_US;
+    vp_fsm_dispatch(fsm, steps[i].event, posted_us, now_us);
+    if (fsm->state != steps[i].expect) {
+      fprintf(stderr, "%s step %zu: %s left %s, expected %s\n", name, i,
+              vp_fsm_event_name(steps[i].event), vp_fsm_state_name(fsm->state),
+              vp_fsm_state_name(steps[i].expect));
+    }
+    CHECK_EQ(fsm->state, steps[i].expect);
+  }
+  return now_us;
+}
+
+// Wake word, speech, answer
+static const step_t normal[] = {
+    STEP(1000, WAKE, LISTENING),
+    STEP(1400, STREAM_STARTED, STREAMING),
+    STEP(3400, SPEECH_END, AWAITING_RESPONSE),
+    STEP(4200, TTS_START, SPEAKING),
+    STEP(6200, TTS_DONE, IDLE),
+};
+
+// HA ends STT first; the late VAD end must not reopen a wait for the answer
+static const step_t stt_end_first[] = {
+    STEP(1000, WAKE, LISTENING),
+    STEP(1400, STREAM_STARTED, STREAMING),
+    STEP(2900, TTS_START, SPEAKING),
+    STEP(3300, SPEECH_END, SPEAKING),
+    STEP(5000, TTS_DONE, IDLE),
+    STEP(5100, TIMEOUT, IDLE),
+};
+
+// Same, but the answer was suppressed (timer set from the STT text)
+static const step_t stt_end_silent[] = {
+    STEP(1000, WAKE, LISTENING),
+    STEP(1400, STREAM_STARTED, STREAMING),
+    STEP(2900, TTS_DONE, IDLE),
+    STEP(3300, SPEECH_END, IDLE),
+};
+
+// The answer is a question: the mic reopens for one more turn
+static const step_t followup[] = {
+    STEP(1000, WAKE, LISTENING),
+    STEP(1400, STREAM_STARTED, STREAMING),
+    STEP(3000, SPEECH_END, AWAITING_RESPONSE),
+    STEP(3800, TTS_START, SPEAKING),
+    STEP(5000, FOLLOWUP, FOLLOWUP),
+    STEP(5100, STREAM_STARTED, STREAMING),
+    STEP(7000, SPEECH_END, AWAITING_RESPONSE),
+    STEP(7500, HANDLED, IDLE),
+};
+
+// Offline command window, then the fallback to HA
+static const step_t command[] = {
+    STEP(1000, WAKE, LISTENING),
+    STEP(1300, COMMAND_WINDOW, COMMAND),
+    STEP(2500, HANDLED, IDLE),
+    STEP(3000, WAKE, LISTENING),
+    STEP(3300, COMMAND_WINDOW, COMMAND),
+    STEP(5000, STREAM_STARTED, STREAMING),
+    STEP(5100, SPEECH_END, AWAITING_RESPONSE),
+    STEP(15100, TIMEOUT, IDLE),
+};
+
+// An alarm takes over from any state; stray events change nothing
+static const step_t alarm[] = {
+    STEP(500, TTS_DONE, IDLE),
+    STEP(1000, WAKE, LISTENING),
+    STEP(1100, WAKE, LISTENING),
+    STEP(1400, STREAM_STARTED, STREAMING),
+    STEP(2000, ALARM, ALARM),
+    STEP(2100, WAKE, ALARM),
+    STEP(4600, ALARM_DONE, IDLE),
+    STEP(5000, WAKE, LISTENING),
+    STEP(5100, STREAM_FAILED, IDLE),
+};
+
+static void test_scripts(void) {
+  vp_fsm_t fsm;
+
+  vp_fsm_init(&fsm, 0);
+  int64_t end_us = RUN(&fsm, normal);
+  CHECK_EQ(fsm.states[VP_STATE_STREAMING].last_us, 2000 * 1000);
+  CHECK_EQ(fsm.states[VP_STATE_AWAITING_RESPONSE].last_us, 800 * 1000);
+  CHECK_EQ(fsm.states[VP_STATE_SPEAKING].last_us, 2000 * 1000);
+  CHECK_EQ(fsm.states[VP_STATE_IDLE].entries, 2);
+  CHECK_EQ(fsm.events[VP_EVENT_WAKE].max_latency_us, POST_DELAY_US);
+  CHECK_EQ(vp_fsm_current_dwell_us(&fsm, end_us + 1000), 1000);
+
+  vp_fsm_init(&fsm, 0);
+  RUN(&fsm, stt_end_first);
+  CHECK_EQ(fsm.states[VP_STATE_AWAITING_RESPONSE].entries, 0);
+  CHECK_EQ(fsm.events[VP_EVENT_SPEECH_END].ignored, 1);
+  CHECK_EQ(fsm.events[VP_EVENT_TIMEOUT].applied, 0);
+
+  vp_fsm_init(&fsm, 0);
+  RUN(&fsm, stt_end_silent);
+  CHECK_EQ(fsm.events[VP_EVENT_SPEECH_END].ignored, 1);
+
+  vp_fsm_init(&fsm, 0);
+  RUN(&fsm, followup);
+  CHECK_EQ(fsm.states[VP_STATE_STREAMING].entries, 2);
+  CHECK_EQ(fsm.states[VP_STATE_STREAMING].max_us, 1900 * 1000);
+
+  vp_fsm_init(&fsm, 0);
+  RUN(&fsm, command);
+  CHECK_EQ(fsm.states[VP_STATE_COMMAND].entries, 2);
+  CHECK_EQ(fsm.states[VP_STATE_AWAITING_RESPONSE].last_us, 10000 * 1000);
+
+  vp_fsm_init(&fsm, 0);
+  RUN(&fsm, alarm);
+  CHECK_EQ(fsm.events[VP_EVENT_WAKE].applied, 2);
+  CHECK_EQ(fsm.events[VP_EVENT_WAKE].ignored, 2);
+  CHECK_EQ(fsm.events[VP_EVENT_TTS_DONE].ignored, 1);
+  CHECK_EQ(fsm.states[VP_STATE_ALARM].last_us, 2600 * 1000);
+}
+
+/**
+ * @brief Every state can be left back to IDLE, so no run can get stuck
+ */
+static void test_no_dead_ends(void) {
+  static const vp_event_t exits[] = {VP_EVENT_ERROR, VP_EVENT_TIMEOUT,
+                                     VP_EVENT_HANDLED, VP_EVENT_ALARM_DONE,
+                                     VP_EVENT_STREAM_FAILED};
+  for (int s = VP_STATE_LISTENING; s < VP_STATE_COUNT; s++) {
+    bool can_leave = false;
+    for (size_t e = 0; e < sizeof(exits) / sizeof(*exits); e++) {
+      vp_fsm_t fsm;
+      vp_fsm_init(&fsm, 0);
+      fsm.state = (vp_state_t)s;
+      vp_fsm_dispatch(&fsm, exits[e], 0, 0);
+      can_leave |= fsm.state == VP_STATE_IDLE;
+    }
+    if (!can_leave) {
+      fprintf(stderr, "no way back to idle from %s\n",
+              vp_fsm_state_name((vp_state_t)s));
+    }
+    CHECK(can_leave);
+  }
+  CHECK(!vp_fsm_dispatch(&(vp_fsm_t){0}, VP_EVENT_COUNT, 0, 0));
+  CHECK(vp_fsm_event_name(VP_EVENT_COUNT)[0] == '?');
+}
+
+static void bench_dispatch(void) {
+  enum { ROUNDS = 1000000 };
+  static const step_t *const scripts[] = {normal, followup, alarm};
+  static const size_t lengths[] = {sizeof(normal) / sizeof(*normal),
+                                   sizeof(followup) / sizeof(*followup),
+                                   sizeof(alarm) / sizeof(*alarm)};
+  vp_fsm_t fsm;
+  vp_fsm_init(&fsm, 0);
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  long events = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    const step_t *s = scripts[r % 3];
+    for (size_t i = 0; i < lengths[r % 3]; i++) {
+      vp_fsm_dispatch(&fsm, s[i].event, r, r);
+    }
+    events += (long)lengths[r % 3];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) /
+              (double)events;
+  printf("dispatch: %.1f ns per event over %ld events\n", ns, events);
+  CHECK_EQ(fsm.state, VP_STATE_IDLE);
+}
+
+int main(void) {
+  test_scripts();
+  test_no_dead_ends();
+  bench_dispatch();
+  return host_test_done("pipeline_fsm");
+}
@@ -0,0 +1,201 @@
+/**
+ * @file test_sd_stream.c
+ * @brief Read-ahead reader against a slow card stand-in: data, throughput,
+ * underruns
+ *
+ * read() is wrapped (-Wl,--wrap=read) with a simple SDMMC model: a fixed
+ * cost per command plus bus time per byte, and optional latency spikes such
+ * as a card doing internal housekeeping. Reported:
+ *   - throughput and card commands for a full read, against 4 KB reads
+ *     straight from the file (what a small stdio buffer does)
+ *   - underruns for a consumer paced like a decoder while the card stalls
+ */
+
+#include "host_task.h"
+#include "host_test.h"
+#include "sd_stream.h"
+#include "task_arena.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_SIZE (2 * 1024 * 1024 + 1234) // Not a whole number of blocks
+#define CARD_CMD_US 500                    // Per read command
+#define CARD_BYTES_PER_US 25               // ~25 MB/s bus
+#define STDIO_READ 4096
+#define PACED_BYTES_PER_S (1024 * 1024) // ~6x a 44.1 kHz stereo WAV
+#define PACED_BYTES (1024 * 1024)
+#define SPIKE_EVERY 8  // Reads between latency spikes
+#define SPIKE_US 40000 // Spike length
+
+static const char *path = "build/sd_stream.bin";
+
+static struct {
+  int spikes;
+  int calls;
+} card;
+
+ssize_t __real_read(int fd, void *buf, size_t len);
+
+ssize_t __wrap_read(int fd, void *buf, size_t len) {
+  int call = __atomic_fetch_add(&card.calls, 1, __ATOMIC_RELAXED);
+  long us = CARD_CMD_US + (long)(len / CARD_BYTES_PER_US);
+  if (card.spikes && call % SPIKE_EVERY == SPIKE_EVERY - 1) {
+    us += SPIKE_US;
+  }
+  struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+  nanosleep(&ts, NULL);
+  return __real_read(fd, buf, len);
+}
+
+esp_err_t task_arena_start(task_slot_t slot, TaskFunction_t fn, void *arg,
+                           UBaseType_t priority, BaseType_t core,
+                           TaskHandle_t *out) {
+  (void)slot;
+  (void)priority;
+  (void)core;
+  *out = host_task_start(fn, arg);
+  return *out ? ESP_OK : ESP_FAIL;
+}
+
+static uint8_t expected(long off) { return (uint8_t)(off * 131 + off / 977); }
+
+static void make_file(void) {
+  uint8_t *data = malloc(FILE_SIZE);
+  for (long i = 0; i < FILE_SIZE; i++) {
+    data[i] = expected(i);
+  }
+  FILE *fp = fopen(path, "wb");
+  CHECK(fp && fwrite(data, 1, FILE_SIZE, fp) == FILE_SIZE);
+  fclose(fp);
+  free(data);
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool check_data(const uint8_t *buf, long off, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (buf[i] != expected(off + (long)i)) {
+      fprintf(stderr, "mismatch at %ld\n", off + (long)i);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Odd-sized reads and seeks inside and outside the buffered window
+ */
+static void test_data(void) {
+  FILE *fp = sd_stream_fopen(path);
+  CHECK(fp != NULL);
+  uint8_t buf[5000];
+  long off = 0;
+  size_t n;
+  srand(7);
+  while ((n = fread(buf, 1, 1 + rand() % sizeof(buf), fp)) > 0) {
+    CHECK(check_data(buf, off, n));
+    off += (long)n;
+  }
+  CHECK_EQ(off, FILE_SIZE);
+
+  const long seeks[] = {0, 100, 40000, 39000, FILE_SIZE - 10, 65536, 1};
+  for (size_t i = 0; i < sizeof(seeks) / sizeof(seeks[0]); i++) {
+    CHECK_EQ(fseek(fp, seeks[i], SEEK_SET), 0);
+    CHECK_EQ(ftell(fp), seeks[i]);
+    n = fread(buf, 1, sizeof(buf), fp);
+    long want = FILE_SIZE - seeks[i];
+    CHECK_EQ(n, want < (long)sizeof(buf) ? want : (long)sizeof(buf));
+    CHECK(check_data(buf, seeks[i], n));
+  }
+  CHECK_EQ(fseek(fp, -3, SEEK_END), 0);
+  CHECK_EQ(fread(buf, 1, sizeof(buf), fp), 3);
+  fclose(fp);
+}
+
+static void bench_throughput(void) {
+  uint8_t *buf = malloc(STDIO_READ);
+
+  card.calls = 0;
+  double t0 = now_s();
+  int fd = open(path, O_RDONLY);
+  while (read(fd, buf, STDIO_READ) > 0) {
+  }
+  close(fd);
+  double direct_s = now_s() - t0;
+  int direct_calls = card.calls;
+
+  card.calls = 0;
+  t0 = now_s();
+  FILE *fp = sd_stream_fopen(path);
+  long total = 0;
+  size_t n;
+  while ((n = fread(buf, 1, STDIO_READ, fp)) > 0) {
+    total += (long)n;
+  }
+  fclose(fp);
+  double stream_s = now_s() - t0;
+  CHECK_EQ(total, FILE_SIZE);
+
+  printf("throughput: 4 KB reads %.1f MB/s in %d commands, "
+         "read-ahead %.1f MB/s in %d commands\n",
+         FILE_SIZE / direct_s / 1e6, direct_calls, FILE_SIZE / stream_s / 1e6,
+         card.calls);
+  // One command per block plus the short read that finds the end
+  CHECK(card.calls <= FILE_SIZE / SD_STREAM_BLOCK_SIZE + 2);
+  CHECK(stream_s < direct_s);
+  free(buf);
+}
+
+/**
+ * @brief Decoder-paced consumer while every SPIKE_EVERY-th read stalls
+ */
+static void bench_underruns(void) {
+  sd_stream_stats_t before, after;
+  sd_stream_get_stats(&before);
+  card.spikes = 1;
+
+  uint8_t *buf = malloc(STDIO_READ);
+  FILE *fp = sd_stream_fopen(path);
+  usleep(50000); // Opened ahead, as the prefetch task does
+  double t0 = now_s();
+  long total = 0;
+  size_t n;
+  while (total < PACED_BYTES && (n = fread(buf, 1, STDIO_READ, fp)) > 0) {
+    total += (long)n;
+    double due = t0 + (double)total / PACED_BYTES_PER_S;
+    double wait = due - now_s();
+    if (wait > 0) {
+      usleep((useconds_t)(wait * 1e6));
+    }
+  }
+  fclose(fp);
+  free(buf);
+  card.spikes = 0;
+
+  sd_stream_get_stats(&after);
+  uint32_t underruns = after.underruns - before.underruns;
+  printf("paced %d KB/s, %d ms stall every %d reads: %u underruns, "
+         "%.1f s for %.1f s of data\n",
+         PACED_BYTES_PER_S / 1024, SPIKE_US / 1000, SPIKE_EVERY,
+         (unsigned)underruns, now_s() - t0,
+         (double)PACED_BYTES / PACED_BYTES_PER_S);
+  CHECK_EQ(total, PACED_BYTES);
+  CHECK_EQ(underruns, 0);
+}
+
+int main(void) {
+  make_file();
+  test_data();
+  bench_throughput();
+  bench_underruns();
+  printf("card average: %u KB/s\n", (unsigned)sd_stream_get_throughput_kbps());
+  return host_test_done("sd_stream");
+}
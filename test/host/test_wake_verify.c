@@ -0,0 +1,482 @@
+/**
+ * @file test_wake_verify.c
+ * @brief Replays of level traces through the wake word verifier
+ *
+ * A trace is a list of segments, each a stretch of background noise with an
+ * optional voiced tone on top, at given RMS levels. It is rendered to 16 kHz
+ * PCM, pushed through wake_verify as the capture task would, and WakeNet is
+ * taken to fire at its end. The tone fills whole periods of a 20 ms frame
+ * and the noise is white, so each frame has the energy the trace asks for
+ * and the reported SNR can be checked against the designed one.
+ *
+ * The scripted cases check every accept/reject path and the cooldown. Sweeps
+ * then take each gate across its limit: noise only at every level (the
+ * floor estimate), words from 0 to 12 dB over the floor (SNR), and sound
+ * filling more and more of the word window (voiced share), plus clean wakes
+ * over every floor. A seeded batch of wakes and non-wakes gives the
+ * false-accept and false-reject rates, and every check is timed for the
+ * cost per detection.
+ */
+
+#include "host_test.h"
+#include "wake_verify.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define RATE 16000
+#define FRAME 320      // 20 ms
+#define TONE_HZ 250.0f // 5 periods per frame
+#define MAX_SEGS 8
+#define BATCH 500
+
+typedef struct {
+  uint32_t ms;
+  float noise_rms; // White noise under everything
+  float tone_rms;  // Voiced sound on top, 0 = none
+  bool burst;      // Tone only in the first frame of the segment (click)
+} seg_t;
+
+typedef struct {
+  const char *name;
+  seg_t segs[MAX_SEGS];
+  wake_verify_result_t expect;
+} trace_t;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return rng_state;
+}
+
+static float rng_unit(void) { return (float)(rng() >> 8) / (float)(1u << 24); }
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int16_t clamp16(float v) {
+  if (v > 32767.0f)
+    return 32767;
+  if (v < -32768.0f)
+    return -32768;
+  return (int16_t)lrintf(v);
+}
+
+/**
+ * @brief Render and push one segment
+ */
+static void push_seg(wake_verify_t *wv, const seg_t *seg) {
+  int16_t pcm[FRAME];
+  // Uniform on [-a, a] has an RMS of a / sqrt(3)
+  float noise_amp = seg->noise_rms * sqrtf(3.0f);
+  float tone_amp = seg->tone_rms * sqrtf(2.0f);
+  uint32_t frames = seg->ms / 20;
+  for (uint32_t f = 0; f < frames; f++) {
+    bool tone = seg->tone_rms > 0.0f && (!seg->burst || f == 0);
+    for (int i = 0; i < FRAME; i++) {
+      float v = (2.0f * rng_unit() - 1.0f) * noise_amp;
+      if (tone) {
+        v += tone_amp * sinf(2.0f * (float)M_PI * TONE_HZ * i / RATE);
+      }
+      pcm[i] = clamp16(v);
+    }
+    wake_verify_push(wv, pcm, FRAME);
+  }
+}
+
+/**
+ * @brief Push every segment of a trace (MAX_SEGS slots)
+ *
+ * @return Length of the trace in ms
+ */
+static int64_t push_trace(wake_verify_t *wv, const seg_t *segs) {
+  int64_t ms = 0;
+  for (int i = 0; i < MAX_SEGS; i++) { // Unused slots are 0 ms
+    push_seg(wv, &segs[i]);
+    ms += segs[i].ms;
+  }
+  return ms;
+}
+
+/**
+ * @brief Push a trace; *now_ms advances by its length
+ *
+ * @return Check result at the end of the trace (WakeNet fires there)
+ */
+static wake_verify_result_t replay(wake_verify_t *wv, const seg_t *segs,
+                                   int64_t *now_ms, int64_t *check_ns) {
+  *now_ms += push_trace(wv, segs);
+  int64_t t0 = now_ns();
+  wake_verify_result_t r = wake_verify_check(wv, *now_ms);
+  if (check_ns) {
+    *check_ns = now_ns() - t0;
+  }
+  return r;
+}
+
+static float snr_db(float word_rms, float noise_rms) {
+  return 20.0f * log10f(word_rms / noise_rms);
+}
+
+// Quiet room: 1.2 s of background, then the word. The word window is 0.8 s
+// and the word 0.6 s of it, so 75 % of the window is voiced.
+#define ROOM 30.0f
+#define PREROLL(n) {1200, n, 0, false}
+#define WORD(n, t) {200, n, 0, false}, {600, n, t, false}
+
+static const trace_t traces[] = {
+    {"clean wake", {PREROLL(ROOM), WORD(ROOM, 2000)}, WAKE_VERIFY_ACCEPT},
+    {"far talker", {PREROLL(ROOM), WORD(ROOM, 150)}, WAKE_VERIFY_ACCEPT},
+    {"whisper", {PREROLL(ROOM), WORD(ROOM, 60)}, WAKE_VERIFY_REJECT_LEVEL},
+    // Steady speech-level background (TV): the word does not stand out
+    {"tv", {PREROLL(1500), WORD(1500, 600)}, WAKE_VERIFY_REJECT_SNR},
+    // One loud frame in a quiet room: loud and above the floor on average,
+    // but not sustained
+    {"click",
+     {PREROLL(ROOM), {200, ROOM, 0, false}, {600, ROOM, 9000, true}},
+     WAKE_VERIFY_REJECT_VOICED},
+    // Right after a capture restart: no pre-roll, only the level applies
+    {"cold start", {WORD(ROOM, 2000)}, WAKE_VERIFY_ACCEPT},
+    {"cold whisper", {WORD(ROOM, 60)}, WAKE_VERIFY_REJECT_LEVEL},
+};
+
+static void check_traces(const wake_verify_config_t *cfg) {
+  for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+    wake_verify_t *wv = wake_verify_create(cfg);
+    int64_t now_ms = 0;
+    wake_verify_result_t r = replay(wv, traces[i].segs, &now_ms, NULL);
+    if (r != traces[i].expect) {
+      wake_verify_stats_t st;
+      wake_verify_get_stats(wv, &st);
+      fprintf(stderr, "%s: %s, expected %s (SNR %.1f dB, voiced %.2f)\n",
+              traces[i].name, wake_verify_result_name(r),
+              wake_verify_result_name(traces[i].expect), st.last_snr_db,
+              st.last_voiced);
+    }
+    CHECK_EQ(r, traces[i].expect);
+    wake_verify_free(wv);
+  }
+}
+
+/**
+ * @brief A rejection holds off the next detection for the cooldown
+ *
+ * Once a clean wake is in the history only the check time moves, so the
+ * cooldown edges can be hit to the millisecond.
+ */
+static void check_cooldown(const wake_verify_config_t *cfg) {
+  wake_verify_t *wv = wake_verify_create(cfg);
+  const seg_t tv[MAX_SEGS] = {PREROLL(1500), WORD(1500, 600)};
+  const seg_t clean[MAX_SEGS] = {PREROLL(ROOM), WORD(ROOM, 2000)};
+  int64_t cooldown = cfg->reject_cooldown_ms;
+
+  push_trace(wv, tv);
+  CHECK_EQ(wake_verify_check(wv, 2000), WAKE_VERIFY_REJECT_SNR);
+  push_trace(wv, clean);
+  // A cooldown rejection does not extend the cooldown
+  CHECK_EQ(wake_verify_check(wv, 2000 + cooldown - 1),
+           WAKE_VERIFY_REJECT_COOLDOWN);
+  CHECK_EQ(wake_verify_check(wv, 2000 + cooldown), WAKE_VERIFY_ACCEPT);
+
+  // A caller hold (after TTS) works the same way and is never shortened
+  wake_verify_hold(wv, 5000, 1000);
+  wake_verify_hold(wv, 5000, 200);
+  CHECK_EQ(wake_verify_check(wv, 5999), WAKE_VERIFY_REJECT_COOLDOWN);
+  CHECK_EQ(wake_verify_check(wv, 6000), WAKE_VERIFY_ACCEPT);
+  // An accepted wake starts no cooldown
+  CHECK_EQ(wake_verify_check(wv, 6001), WAKE_VERIFY_ACCEPT);
+
+  // A capture restart drops the history but keeps the cooldown
+  push_trace(wv, tv);
+  CHECK_EQ(wake_verify_check(wv, 8000), WAKE_VERIFY_REJECT_SNR);
+  wake_verify_reset(wv);
+  push_trace(wv, clean);
+  CHECK_EQ(wake_verify_check(wv, 8000 + cooldown - 1),
+           WAKE_VERIFY_REJECT_COOLDOWN);
+  CHECK_EQ(wake_verify_check(wv, 8000 + cooldown), WAKE_VERIFY_ACCEPT);
+
+  wake_verify_stats_t st;
+  wake_verify_get_stats(wv, &st);
+  CHECK_EQ(st.checks, 9);
+  CHECK_EQ(st.results[WAKE_VERIFY_ACCEPT], 4);
+  CHECK_EQ(st.results[WAKE_VERIFY_REJECT_COOLDOWN], 3);
+  CHECK_EQ(st.results[WAKE_VERIFY_REJECT_SNR], 2);
+  wake_verify_free(wv);
+}
+
+/**
+ * @brief Replay one trace on a fresh verifier
+ */
+static wake_verify_result_t replay_fresh(const wake_verify_config_t *cfg,
+                                         const seg_t *segs,
+                                         wake_verify_stats_t *st) {
+  wake_verify_t *wv = wake_verify_create(cfg);
+  int64_t now_ms = 0;
+  wake_verify_result_t r = replay(wv, segs, &now_ms, NULL);
+  wake_verify_get_stats(wv, st);
+  wake_verify_free(wv);
+  return r;
+}
+
+/**
+ * @brief SNR the verifier should report for a word over white noise
+ *
+ * @param tone_db Tone level over the noise
+ * @param voiced Share of the word window the tone fills
+ */
+static float predicted_snr_db(float tone_db, float voiced) {
+  return 10.0f * log10f(1.0f + voiced * powf(10.0f, tone_db / 10.0f));
+}
+
+/**
+ * @brief Noise only, steady or wavering, at every level: never a wake
+ */
+static void check_noise_only(const wake_verify_config_t *cfg) {
+  static const float floors[] = {10, 30, 100, 300, 1000, 3000, 8000};
+  int traces = 0, accepted = 0;
+  for (size_t i = 0; i < sizeof(floors) / sizeof(floors[0]); i++) {
+    float n = floors[i];
+    seg_t steady[MAX_SEGS] = {{2000, n, 0, false}};
+    // +-1.5 dB every 200 ms, like a fan or traffic
+    seg_t waver[MAX_SEGS];
+    for (int k = 0; k < MAX_SEGS; k++) {
+      waver[k] = (seg_t){k < MAX_SEGS - 1 ? 300 : 0,
+                         k % 2 ? n * 1.19f : n / 1.19f, 0, false};
+    }
+    const seg_t *cases[] = {steady, waver};
+    for (int c = 0; c < 2; c++) {
+      wake_verify_stats_t st;
+      wake_verify_result_t r = replay_fresh(cfg, cases[c], &st);
+      traces++;
+      accepted += r == WAKE_VERIFY_ACCEPT;
+      CHECK(r != WAKE_VERIFY_ACCEPT);
+      if (n >= 300) {
+        // Loud enough to be judged on the floor, which it is
+        CHECK_EQ(r, WAKE_VERIFY_REJECT_SNR);
+        CHECK(fabsf(st.last_snr_db) < 3.0f);
+      }
+    }
+  }
+  printf("wake verify: noise only, %d/%d traces accepted\n", accepted,
+         traces);
+}
+
+/**
+ * @brief Words from 0 to 12 dB over a steady floor
+ *
+ * The reported SNR must match the one the trace was built with, and the
+ * decision must flip at min_snr_db.
+ */
+static void check_snr_sweep(const wake_verify_config_t *cfg) {
+  const float n = 300.0f;
+  const float voiced = 0.75f; // WORD(): 600 of 800 ms
+  float first_accept_db = -1.0f;
+  for (int db = 0; db <= 12; db++) {
+    seg_t segs[MAX_SEGS] = {PREROLL(n), WORD(n, n * powf(10.0f, db / 20.0f))};
+    wake_verify_stats_t st;
+    wake_verify_result_t r = replay_fresh(cfg, segs, &st);
+    float expect_db = predicted_snr_db((float)db, voiced);
+    if (fabsf(st.last_snr_db - expect_db) >= 0.5f) {
+      fprintf(stderr, "tone %d dB: SNR %.2f dB, expected %.2f dB\n", db,
+              st.last_snr_db, expect_db);
+    }
+    CHECK(fabsf(st.last_snr_db - expect_db) < 0.5f);
+    if (fabsf(expect_db - cfg->min_snr_db) < 0.5f) {
+      continue; // Too close to call with random noise
+    }
+    bool loud = expect_db > cfg->min_snr_db;
+    // Below the SNR limit the word may also be only partly voiced
+    CHECK(loud ? r == WAKE_VERIFY_ACCEPT
+               : r == WAKE_VERIFY_REJECT_SNR || r == WAKE_VERIFY_REJECT_VOICED);
+    if (r == WAKE_VERIFY_ACCEPT && first_accept_db < 0.0f) {
+      first_accept_db = (float)db;
+    }
+  }
+  printf("wake verify: low SNR, accepted from a tone %.0f dB over the floor\n",
+         first_accept_db);
+}
+
+/**
+ * @brief Loud sound filling 0-100 % of the word window
+ */
+static void check_voiced_sweep(const wake_verify_config_t *cfg) {
+  const float n = 300.0f;
+  int first_accept_ms = -1;
+  for (uint32_t ms = 0; ms <= 800; ms += 100) {
+    seg_t segs[MAX_SEGS] = {PREROLL(n), {800 - ms, n, 0, false},
+                            {ms, n, n * 10.0f, false}};
+    wake_verify_stats_t st;
+    wake_verify_result_t r = replay_fresh(cfg, segs, &st);
+    float ratio = ms / 800.0f;
+    CHECK(fabsf(st.last_voiced - ratio) < 0.03f);
+    if (ms == 0) {
+      CHECK_EQ(r, WAKE_VERIFY_REJECT_SNR);
+    } else if (ratio < cfg->min_voiced_ratio) {
+      CHECK_EQ(r, WAKE_VERIFY_REJECT_VOICED);
+    } else {
+      CHECK_EQ(r, WAKE_VERIFY_ACCEPT);
+      if (first_accept_ms < 0) {
+        first_accept_ms = (int)ms;
+      }
+    }
+  }
+  printf("wake verify: voiced gate, accepted from %d of 800 ms\n",
+         first_accept_ms);
+}
+
+/**
+ * @brief Clean wakes over every floor, with and without talk before them
+ *
+ * The floor is a low percentile of the pre-roll, so someone speaking for
+ * part of it does not raise the floor the word is judged against.
+ */
+static void check_clean_wakes(const wake_verify_config_t *cfg) {
+  static const float floors[] = {10, 30, 100, 300, 1000, 2000};
+  for (size_t i = 0; i < sizeof(floors) / sizeof(floors[0]); i++) {
+    float n = floors[i];
+    float word = n * 10.0f > 300.0f ? n * 10.0f : 300.0f;
+    float expect_db = predicted_snr_db(snr_db(word, n), 0.75f);
+    seg_t quiet[MAX_SEGS] = {PREROLL(n), WORD(n, word)};
+    // 480 of the 1200 ms pre-roll is speech at the level of the word
+    seg_t talk[MAX_SEGS] = {{480, n, word, false}, {720, n, 0, false},
+                            WORD(n, word)};
+    const seg_t *cases[] = {quiet, talk};
+    for (int c = 0; c < 2; c++) {
+      wake_verify_stats_t st;
+      wake_verify_result_t r = replay_fresh(cfg, cases[c], &st);
+      if (r != WAKE_VERIFY_ACCEPT) {
+        fprintf(stderr, "floor %.0f%s: %s (SNR %.1f dB)\n", n,
+                c ? " after talk" : "", wake_verify_result_name(r),
+                st.last_snr_db);
+      }
+      CHECK_EQ(r, WAKE_VERIFY_ACCEPT);
+      CHECK(fabsf(st.last_snr_db - expect_db) < 0.5f);
+    }
+  }
+}
+
+typedef struct {
+  int trials;
+  int accepted;
+  int64_t check_ns_total;
+  int64_t check_ns_max;
+} tally_t;
+
+static void tally_note(tally_t *t, wake_verify_result_t r, int64_t check_ns) {
+  t->trials++;
+  if (r == WAKE_VERIFY_ACCEPT) {
+    t->accepted++;
+  }
+  t->check_ns_total += check_ns;
+  if (check_ns > t->check_ns_max) {
+    t->check_ns_max = check_ns;
+  }
+}
+
+/**
+ * @brief One random trace: a wake (positive) or a lookalike (negative)
+ */
+static void random_trace(seg_t *segs, bool positive) {
+  memset(segs, 0, MAX_SEGS * sizeof(*segs));
+  float floor_rms = 20.0f + rng_unit() * 480.0f;
+  segs[0] = (seg_t){1000 + (rng() % 10) * 100, floor_rms, 0, false};
+  if (positive) {
+    // 12-30 dB over the floor, 0.5-0.7 s of the window voiced, and clear
+    // of the absolute level floor
+    float word = floor_rms * powf(10.0f, (12.0f + rng_unit() * 18.0f) / 20);
+    if (word < 200.0f) {
+      word = 200.0f;
+    }
+    uint32_t voiced_ms = 500 + (rng() % 3) * 100;
+    segs[1] = (seg_t){800 - voiced_ms, floor_rms, 0, false};
+    segs[2] = (seg_t){voiced_ms, floor_rms, word, false};
+    return;
+  }
+  switch (rng() % 3) {
+  case 0: // Background speech at the level of the "word"
+    segs[0].tone_rms = floor_rms * (0.5f + rng_unit());
+    segs[1] = (seg_t){800, floor_rms, segs[0].tone_rms, false};
+    break;
+  case 1: // A bang in a quiet room
+    segs[1] = (seg_t){200 + (rng() % 4) * 100, floor_rms, 0, false};
+    segs[2] = (seg_t){800 - segs[1].ms, floor_rms, floor_rms * 30, true};
+    break;
+  default: // Barely above the floor
+    segs[1] = (seg_t){800, floor_rms, floor_rms * rng_unit(), false};
+    break;
+  }
+}
+
+static void check_batch(const wake_verify_config_t *cfg) {
+  tally_t pos = {0}, neg = {0};
+  seg_t segs[MAX_SEGS];
+  rng_state = 12345;
+  for (int i = 0; i < 2 * BATCH; i++) {
+    bool positive = i % 2 == 0;
+    random_trace(segs, positive);
+    // Fresh verifier per trial: no cooldown carried over
+    wake_verify_t *wv = wake_verify_create(cfg);
+    int64_t now_ms = 0, check_ns = 0;
+    wake_verify_result_t r = replay(wv, segs, &now_ms, &check_ns);
+    tally_note(positive ? &pos : &neg, r, check_ns);
+    wake_verify_free(wv);
+  }
+
+  float far = 100.0f * neg.accepted / neg.trials;
+  float frr = 100.0f * (pos.trials - pos.accepted) / pos.trials;
+  int64_t checks = pos.trials + neg.trials;
+  printf("wake verify: FAR %.1f%% (%d/%d), FRR %.1f%% (%d/%d)\n", far,
+         neg.accepted, neg.trials, frr, pos.trials - pos.accepted, pos.trials);
+  printf("wake verify: check %.2f us mean, %.2f us max per detection\n",
+         (double)(pos.check_ns_total + neg.check_ns_total) / checks / 1000.0,
+         (double)(pos.check_ns_max > neg.check_ns_max ? pos.check_ns_max
+                                                      : neg.check_ns_max) /
+             1000.0);
+  CHECK_EQ(neg.accepted, 0);
+  CHECK_EQ(pos.accepted, pos.trials);
+}
+
+/**
+ * @brief Cost of keeping the energy history, per second of capture
+ */
+static void bench_push(const wake_verify_config_t *cfg) {
+  enum { SECONDS = 60 };
+  static int16_t pcm[RATE];
+  for (int i = 0; i < RATE; i++) {
+    pcm[i] = (int16_t)((int)(rng() >> 16) - 32768);
+  }
+  wake_verify_t *wv = wake_verify_create(cfg);
+  int64_t t0 = now_ns();
+  for (int s = 0; s < SECONDS; s++) {
+    wake_verify_push(wv, pcm, RATE);
+  }
+  double us_per_s = (double)(now_ns() - t0) / SECONDS / 1000.0;
+  printf("wake verify: push %.1f us per second of audio\n", us_per_s);
+  wake_verify_free(wv);
+}
+
+int main(void) {
+  wake_verify_config_t cfg;
+  wake_verify_default_config(&cfg);
+
+  // The scripted levels are designed around the defaults
+  CHECK(snr_db(150, ROOM) > cfg.min_snr_db);
+  CHECK(snr_db(600, 1500) < cfg.min_snr_db);
+  CHECK(60 < cfg.min_word_rms && cfg.min_word_rms < 150);
+
+  check_traces(&cfg);
+  check_cooldown(&cfg);
+  check_noise_only(&cfg);
+  check_snr_sweep(&cfg);
+  check_voiced_sweep(&cfg);
+  check_clean_wakes(&cfg);
+  check_batch(&cfg);
+  bench_push(&cfg);
+  return host_test_done("wake_verify");
+}